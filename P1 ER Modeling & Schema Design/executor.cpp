@@ -0,0 +1,441 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "executor.h"
+#include "page_iterator.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+const std::size_t Batch::ROWS;
+
+/**
+ * Splits a tuple into its first fields, up to field last, as views; a quoted
+ * field runs to its closing quote, even over separators.  Missing fields are
+ * empty.
+ */
+static void splitTuple(const RecordView& tuple, const std::size_t last, std::vector<RecordView>& fields)
+{
+  fields.clear();
+  const char* p = tuple.data();
+  const char* const end = p + tuple.size();
+  while (fields.size() <= last) {
+    const char* start = p;
+    if (p < end && *p == '"') {
+      // A doubled quote is part of the text.
+      for (p++; p < end; p++) {
+        if (*p == '"') {
+          if (p + 1 < end && p[1] == '"') {
+            p++;
+          } else {
+            p++;
+            break;
+          }
+        }
+      }
+    }
+    const char* separator = static_cast<const char*>(std::memchr(p, '|', end - p));
+    if (separator == NULL) {
+      separator = end;
+    }
+    fields.push_back(RecordView(start, separator - start));
+    p = separator < end ? separator + 1 : end;
+  }
+}
+
+HeapScan::HeapScan(BufMgr& bufMgr, File& file, const std::vector<std::size_t>& fields)
+  : bufMgr(bufMgr), file(file), fields(fields),
+    lastField(fields.empty() ? 0 : *std::max_element(fields.begin(), fields.end())),
+    pageNo(0), limit(file.pageLimit()), page(NULL) {}
+
+HeapScan::~HeapScan()
+{
+  unpin();
+}
+
+void HeapScan::unpin()
+{
+  if (page != NULL) {
+    bufMgr.unPinPage(&file, pageNo, false);
+    page = NULL;
+  }
+}
+
+bool HeapScan::next(Batch& batch)
+{
+  batch.reset(fields.size());
+  unpin();
+  while (batch.rows == 0) {
+    if (++pageNo >= limit) {
+      pageNo = limit;
+      return false;
+    }
+    try {
+      bufMgr.readPage(&file, pageNo, page);
+    } catch (InvalidPageException&) {
+      // A free page holds no tuples.
+      continue;
+    }
+    for (PageIterator it = page->begin(); it != page->end(); ++it) {
+      if (!fields.empty()) {
+        splitTuple(*it, lastField, split);
+        for (const std::size_t field : fields) {
+          batch.values.push_back(split[field]);
+        }
+      }
+      batch.rows++;
+    }
+    if (batch.rows == 0) {
+      unpin();
+    }
+  }
+  return true;
+}
+
+Filter::Filter(OperatorPtr child, const Predicate& predicate)
+  : child(std::move(child)), predicate(predicate) {}
+
+bool Filter::next(Batch& batch)
+{
+  for (;;) {
+    if (!child->next(batch)) {
+      return false;
+    }
+    // Keep the rows that pass in place, moved up over those that did not.
+    std::size_t kept = 0;
+    for (std::size_t r = 0; r < batch.rows; r++) {
+      const RecordView* row = batch.row(r);
+      if (predicate(row)) {
+        std::copy(row, row + batch.columns, batch.values.begin() + kept * batch.columns);
+        kept++;
+      }
+    }
+    if (kept > 0) {
+      batch.rows = kept;
+      batch.values.resize(kept * batch.columns);
+      return true;
+    }
+  }
+}
+
+std::size_t ViewHash::operator()(const RecordView& view) const
+{
+  // FNV-1a
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (std::size_t i = 0; i < view.size(); i++) {
+    hash ^= static_cast<unsigned char>(view[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return static_cast<std::size_t>(hash);
+}
+
+HashJoin::HashJoin(OperatorPtr build, const std::size_t buildKey, OperatorPtr probe,
+                   const std::size_t probeKey)
+  : build(std::move(build)), buildKey(buildKey), probe(std::move(probe)),
+    probeKey(probeKey), built(false) {}
+
+void HashJoin::buildTable()
+{
+  const std::size_t columns = build->columns();
+  Batch batch;
+  while (build->next(batch)) {
+    for (std::size_t r = 0; r < batch.rows; r++) {
+      const RecordView* row = batch.row(r);
+      const std::size_t index = buildRows.size() / columns;
+      for (std::size_t c = 0; c < columns; c++) {
+        storage.push_back(row[c].str());
+        buildRows.push_back(RecordView(storage.back()));
+      }
+      // Chain the row in ahead of the earlier rows of its key.
+      const RecordView key = buildRows[index * columns + buildKey];
+      std::pair<std::unordered_map<RecordView, std::size_t, ViewHash>::iterator, bool> head =
+          heads.emplace(key, index);
+      chains.push_back(head.second ? index : head.first->second);
+      head.first->second = index;
+    }
+  }
+  built = true;
+}
+
+bool HashJoin::next(Batch& batch)
+{
+  if (!built) {
+    buildTable();
+  }
+  const std::size_t buildColumns = build->columns();
+  const std::size_t probeColumns = probe->columns();
+  batch.reset(probeColumns + buildColumns);
+  while (batch.rows == 0) {
+    if (!probe->next(probeBatch)) {
+      return false;
+    }
+    for (std::size_t r = 0; r < probeBatch.rows; r++) {
+      const RecordView* row = probeBatch.row(r);
+      std::unordered_map<RecordView, std::size_t, ViewHash>::const_iterator head = heads.find(row[probeKey]);
+      if (head == heads.end()) {
+        continue;
+      }
+      // Walk the chain until it loops back on itself.
+      std::size_t match = head->second;
+      for (;;) {
+        batch.values.insert(batch.values.end(), row, row + probeColumns);
+        batch.values.insert(batch.values.end(), buildRows.begin() + match * buildColumns,
+                            buildRows.begin() + (match + 1) * buildColumns);
+        batch.rows++;
+        if (chains[match] == match) {
+          break;
+        }
+        match = chains[match];
+      }
+    }
+  }
+  // The probe batch, which the rows view, stays as it is until the next call.
+  return true;
+}
+
+HashAggregate::HashAggregate(OperatorPtr child, const std::vector<std::size_t>& groupBy,
+                             const std::vector<Aggregate>& aggregates)
+  : child(std::move(child)), groupBy(groupBy), aggregates(aggregates), consumed(false),
+    emitted(0) {}
+
+void HashAggregate::consume()
+{
+  const std::size_t width = aggregates.size();
+  Batch batch;
+  while (child->next(batch)) {
+    for (std::size_t r = 0; r < batch.rows; r++) {
+      const RecordView* values = batch.row(r);
+      // The key of a group is its values, each preceded by its length.
+      key.clear();
+      for (const std::size_t column : groupBy) {
+        const std::uint32_t length = static_cast<std::uint32_t>(values[column].size());
+        key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        key.append(values[column].data(), values[column].size());
+      }
+      std::unordered_map<RecordView, std::size_t, ViewHash>::iterator group = groups.find(RecordView(key));
+      if (group == groups.end()) {
+        const std::size_t index = groups.size();
+        storage.push_back(key);
+        group = groups.emplace(RecordView(storage.back()), index).first;
+        for (const std::size_t column : groupBy) {
+          storage.push_back(values[column].str());
+          groupValues.push_back(RecordView(storage.back()));
+        }
+        for (const Aggregate& aggregate : aggregates) {
+          state.push_back(aggregate.function == MAX ? -std::numeric_limits<double>::infinity()
+                          : aggregate.function == MIN ? std::numeric_limits<double>::infinity() : 0);
+        }
+      }
+      double* sink = state.data() + group->second * width;
+      for (std::size_t a = 0; a < width; a++) {
+        if (aggregates[a].function == COUNT) {
+          sink[a]++;
+          continue;
+        }
+        const double value = number(values[aggregates[a].column]);
+        if (std::isnan(value)) {
+          continue;
+        }
+        switch (aggregates[a].function) {
+          case MAX: sink[a] = std::max(sink[a], value); break;
+          case MIN: sink[a] = std::min(sink[a], value); break;
+          default: sink[a] += value; break;
+        }
+      }
+    }
+  }
+  if (groupBy.empty() && groups.empty()) {
+    // One group of no rows, as COUNT(*) of an empty table.
+    groups.emplace(RecordView(""), 0);
+    for (const Aggregate& aggregate : aggregates) {
+      state.push_back(aggregate.function == COUNT ? 0 : std::numeric_limits<double>::quiet_NaN());
+    }
+  }
+  consumed = true;
+}
+
+bool HashAggregate::next(Batch& batch)
+{
+  if (!consumed) {
+    consume();
+  }
+  batch.reset(columns());
+  // The aggregates formatted for the previous batch are no longer viewed.
+  output.clear();
+  const std::size_t width = aggregates.size();
+  for (; emitted < groups.size() && batch.rows < Batch::ROWS; emitted++) {
+    row.assign(groupValues.begin() + emitted * groupBy.size(),
+               groupValues.begin() + (emitted + 1) * groupBy.size());
+    for (std::size_t a = 0; a < width; a++) {
+      const double value = state[emitted * width + a];
+      char formatted[32];
+      if (std::isnan(value) || std::isinf(value)) {
+        std::strcpy(formatted, "NULL");
+      } else {
+        std::snprintf(formatted, sizeof(formatted), "%.15g", value);
+      }
+      output.push_back(formatted);
+      row.push_back(RecordView(output.back()));
+    }
+    batch.append(row.data());
+  }
+  return batch.rows > 0;
+}
+
+TopK::TopK(OperatorPtr child, const std::size_t k, const std::size_t column,
+           const bool descending)
+  : child(std::move(child)), k(k), column(column), descending(descending),
+    consumed(false), emitted(0) {}
+
+bool TopK::before(const Entry& a, const Entry& b) const
+{
+  return descending ? a.key > b.key : a.key < b.key;
+}
+
+void TopK::consume()
+{
+  // The heap has the row that would leave first, the last in order, on top.
+  const std::function<bool(const Entry&, const Entry&)> order =
+      [this](const Entry& a, const Entry& b) { return before(a, b); };
+  Batch batch;
+  while (k > 0 && child->next(batch)) {
+    for (std::size_t r = 0; r < batch.rows; r++) {
+      const RecordView* values = batch.row(r);
+      const double key = number(values[column]);
+      if (std::isnan(key)) {
+        continue;
+      }
+      if (heap.size() == k) {
+        if (!(descending ? key > heap.front().key : key < heap.front().key)) {
+          continue;
+        }
+        std::pop_heap(heap.begin(), heap.end(), order);
+        heap.pop_back();
+      }
+      Entry entry;
+      entry.key = key;
+      for (std::size_t c = 0; c < batch.columns; c++) {
+        entry.values.push_back(values[c].str());
+      }
+      heap.push_back(std::move(entry));
+      std::push_heap(heap.begin(), heap.end(), order);
+    }
+  }
+  std::sort_heap(heap.begin(), heap.end(), order);
+  consumed = true;
+}
+
+bool TopK::next(Batch& batch)
+{
+  if (!consumed) {
+    consume();
+  }
+  batch.reset(columns());
+  for (; emitted < heap.size() && batch.rows < Batch::ROWS; emitted++) {
+    row.clear();
+    for (const std::string& value : heap[emitted].values) {
+      row.push_back(RecordView(value));
+    }
+    batch.append(row.data());
+  }
+  return batch.rows > 0;
+}
+
+double number(const RecordView& value)
+{
+  char digits[64];
+  if (value.empty() || value.size() >= sizeof(digits) || isNull(value)) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  std::memcpy(digits, value.data(), value.size());
+  digits[value.size()] = '\0';
+  char* end = NULL;
+  const double parsed = std::strtod(digits, &end);
+  return end == digits + value.size() ? parsed : std::numeric_limits<double>::quiet_NaN();
+}
+
+std::string text(const RecordView& value)
+{
+  if (value.size() < 2 || value[0] != '"') {
+    return value.str();
+  }
+  std::string unquoted;
+  for (std::size_t i = 1; i + 1 < value.size(); i++) {
+    unquoted += value[i];
+    if (value[i] == '"') {
+      i++;
+    }
+  }
+  return unquoted;
+}
+
+bool isNull(const RecordView& value)
+{
+  return value == RecordView("NULL");
+}
+
+bool isOverflow(const RecordView& value)
+{
+  return !value.empty() && value[0] == '@';
+}
+
+/**
+ * Reads the record id page.slot from p, before end, into rid and returns the
+ * position after it
+ */
+static const char* readReference(const char* p, const char* const end, RecordId& rid)
+{
+  std::uint64_t parts[2] = {0, 0};
+  for (int k = 0; k < 2; k++) {
+    const char* const start = p;
+    while (p < end && *p >= '0' && *p <= '9' && parts[k] <= 0xffffffff) {
+      parts[k] = parts[k] * 10 + (*p++ - '0');
+    }
+    if (p == start || (k == 0 && (p == end || *p++ != '.'))) {
+      throw BadgerDbException("Bad overflow reference");
+    }
+  }
+  rid.page_number = static_cast<PageId>(parts[0]);
+  rid.slot_number = static_cast<SlotId>(parts[1]);
+  return p;
+}
+
+std::string overflowValue(BufMgr& bufMgr, File& overflow, const RecordView& value)
+{
+  RecordId rid;
+  readReference(value.data() + 1, value.data() + value.size(), rid);
+  std::string joined;
+  while (rid.page_number != 0) {
+    const PageId pageNo = rid.page_number;
+    Page* page;
+    bufMgr.readPage(&overflow, pageNo, page);
+    try {
+      const RecordView part = page->getRecordView(rid);
+      const char* const end = part.data() + part.size();
+      const char* p = readReference(part.data(), end, rid);
+      if (p == end || *p != '|') {
+        throw BadgerDbException("Bad overflow record");
+      }
+      joined.append(p + 1, end);
+    } catch (...) {
+      bufMgr.unPinPage(&overflow, pageNo, false);
+      throw;
+    }
+    bufMgr.unPinPage(&overflow, pageNo, false);
+  }
+  return joined;
+}
+
+}
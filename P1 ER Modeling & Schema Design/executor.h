@@ -0,0 +1,328 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Rows passed from one operator to the next, many at a time
+ *
+ * Every value is a view of a column: a field of a tuple in a pinned page, or
+ * a value an operator keeps.  Tuples are the '|'-separated lines of the
+ * loader, with text quoted and absent values NULL.  Values are valid until
+ * next() is called again on the operator that filled the batch.
+ */
+struct Batch {
+	/**
+	 * Number of rows an operator that makes rows of its own puts in a batch
+	 */
+  static const std::size_t ROWS = 1024;
+
+	/**
+	 * Columns of every row, and number of rows
+	 */
+  std::size_t columns;
+  std::size_t rows;
+
+	/**
+	 * The values of the rows, row after row
+	 */
+  std::vector<RecordView> values;
+
+  Batch() : columns(0), rows(0) {}
+
+	/**
+	 * Empties the batch for rows of the given number of columns
+	 */
+  void reset(const std::size_t columnCount)
+  {
+    columns = columnCount;
+    rows = 0;
+    values.clear();
+  }
+
+	/**
+	 * Returns the values of row r
+	 */
+  const RecordView* row(const std::size_t r) const { return values.data() + r * columns; }
+
+	/**
+	 * Appends a row of columns values
+	 */
+  void append(const RecordView* row)
+  {
+    values.insert(values.end(), row, row + columns);
+    rows++;
+  }
+};
+
+/**
+ * @brief Producer of rows, a batch at a time
+ *
+ * Operators form a tree: each pulls batches from its children, so a query
+ * runs one batch at a time through the whole tree instead of one row at a
+ * time, and rows are only copied by operators that must keep them.
+ */
+class Operator {
+ public:
+  virtual ~Operator() {}
+
+	/**
+	 * Number of columns of the rows produced
+	 */
+  virtual std::size_t columns() const = 0;
+
+	/**
+	 * Fills batch with the next rows, at least one
+	 *
+	 * @param batch  Batch to fill, emptied first
+	 * @return  False once there are no more rows, with batch empty
+	 */
+  virtual bool next(Batch& batch) = 0;
+};
+
+typedef std::unique_ptr<Operator> OperatorPtr;
+
+/**
+ * @brief Scan of the tuples of a heap file through the buffer manager
+ *
+ * The fields named are taken from every tuple in place, so batches hold the
+ * page they view pinned; the pin is dropped at the next call.  Each batch
+ * holds the tuples of one page.  Pages are read in order, which the buffer
+ * manager notices and prefetches ahead of.
+ */
+class HeapScan : public Operator {
+ public:
+	/**
+	 * @param bufMgr  Buffer manager to read the pages through
+	 * @param file    Heap file
+	 * @param fields  Fields of the tuples making up the columns, by position
+	 */
+  HeapScan(BufMgr& bufMgr, File& file, const std::vector<std::size_t>& fields);
+  ~HeapScan();
+
+  std::size_t columns() const { return fields.size(); }
+  bool next(Batch& batch);
+
+ private:
+  BufMgr& bufMgr;
+  File& file;
+  const std::vector<std::size_t> fields;
+  std::size_t lastField;
+  PageId pageNo;
+  PageId limit;
+  Page* page;
+  std::vector<RecordView> split;
+
+  void unpin();
+};
+
+/**
+ * @brief Rows of its child for which a predicate holds
+ */
+class Filter : public Operator {
+ public:
+  typedef std::function<bool(const RecordView* row)> Predicate;
+
+  Filter(OperatorPtr child, const Predicate& predicate);
+
+  std::size_t columns() const { return child->columns(); }
+  bool next(Batch& batch);
+
+ private:
+  OperatorPtr child;
+  const Predicate predicate;
+};
+
+/**
+ * Hash of views, for hash tables keyed by values in place
+ */
+struct ViewHash {
+  std::size_t operator()(const RecordView& view) const;
+};
+
+/**
+ * @brief Equijoin of two children through a hash table of one of them
+ *
+ * The build child is read whole into a hash table on its key column at the
+ * first call; the probe child then streams through it.  A row is produced
+ * for every pair of rows with equal keys: the columns of the probe row, then
+ * those of the build row.
+ */
+class HashJoin : public Operator {
+ public:
+	/**
+	 * @param build     Child kept in the hash table, preferably the smaller
+	 * @param buildKey  Column of the key in the rows of build
+	 * @param probe     Child streamed through the table
+	 * @param probeKey  Column of the key in the rows of probe
+	 */
+  HashJoin(OperatorPtr build, const std::size_t buildKey, OperatorPtr probe,
+           const std::size_t probeKey);
+
+  std::size_t columns() const { return build->columns() + probe->columns(); }
+  bool next(Batch& batch);
+
+ private:
+  OperatorPtr build;
+  const std::size_t buildKey;
+  OperatorPtr probe;
+  const std::size_t probeKey;
+  bool built;
+
+  /**
+   * Values of the rows of build, row after row, in stable storage
+   */
+  std::deque<std::string> storage;
+  std::vector<RecordView> buildRows;
+
+  /**
+   * First row of build of every key, and the next row of the same key of
+   * every row
+   */
+  std::unordered_map<RecordView, std::size_t, ViewHash> heads;
+  std::vector<std::size_t> chains;
+
+  Batch probeBatch;
+
+  void buildTable();
+};
+
+/**
+ * @brief Groups of the rows of its child with aggregates of each group
+ *
+ * Every input row is added to the group of its values in the group columns,
+ * found in a hash table.  Rows are produced once the child is exhausted: the
+ * group columns, then one column for every aggregate, as text.  Without
+ * group columns all rows form one group, produced even if there are none.
+ */
+class HashAggregate : public Operator {
+ public:
+	/**
+	 * Function computed over each group: the number of rows, or the largest,
+	 * smallest or sum of the numbers in a column, skipping NULL
+	 */
+  enum Function { COUNT, MAX, MIN, SUM };
+
+  struct Aggregate {
+    Function function;
+    std::size_t column;
+  };
+
+  HashAggregate(OperatorPtr child, const std::vector<std::size_t>& groupBy,
+                const std::vector<Aggregate>& aggregates);
+
+  std::size_t columns() const { return groupBy.size() + aggregates.size(); }
+  bool next(Batch& batch);
+
+ private:
+  OperatorPtr child;
+  const std::vector<std::size_t> groupBy;
+  const std::vector<Aggregate> aggregates;
+  bool consumed;
+
+  /**
+   * Key and group column values of every group, in stable storage
+   */
+  std::deque<std::string> storage;
+  std::unordered_map<RecordView, std::size_t, ViewHash> groups;
+  std::vector<RecordView> groupValues;
+  std::vector<double> state;
+  std::size_t emitted;
+
+  /**
+   * Aggregates of the rows of the last batch, formatted
+   */
+  std::deque<std::string> output;
+  std::vector<RecordView> row;
+  std::string key;
+
+  void consume();
+};
+
+/**
+ * @brief The k rows of its child with the largest, or smallest, number in a
+ *        column, in that order
+ *
+ * Rows are kept in a heap of k, so each input row costs at most log k
+ * comparisons and only rows that enter the heap are copied.  Rows whose
+ * column is NULL are skipped.
+ */
+class TopK : public Operator {
+ public:
+  TopK(OperatorPtr child, const std::size_t k, const std::size_t column,
+       const bool descending);
+
+  std::size_t columns() const { return child->columns(); }
+  bool next(Batch& batch);
+
+ private:
+  struct Entry {
+    double key;
+    std::vector<std::string> values;
+  };
+
+  OperatorPtr child;
+  const std::size_t k;
+  const std::size_t column;
+  const bool descending;
+  bool consumed;
+  std::vector<Entry> heap;
+  std::size_t emitted;
+  std::vector<RecordView> row;
+
+  bool before(const Entry& a, const Entry& b) const;
+  void consume();
+};
+
+/**
+ * Returns a column as a number, or NaN for NULL and text that is no number
+ */
+double number(const RecordView& value);
+
+/**
+ * Returns a text column without its quotes, with doubled quotes made single
+ */
+std::string text(const RecordView& value);
+
+/**
+ * Returns true if a column is NULL
+ */
+bool isNull(const RecordView& value);
+
+/**
+ * Returns true if a column is a reference @page.slot to an overflow chain,
+ * which the loader writes in place of a value too long for a page
+ */
+bool isOverflow(const RecordView& value);
+
+/**
+ * Returns the value an overflow reference stands for: the parts held by the
+ * records of its chain in the overflow heap file, joined
+ *
+ * @param bufMgr    Buffer manager to read the pages through
+ * @param overflow  Heap file of the chains, such as ItemOverflow.db
+ * @param value     A column for which isOverflow() holds
+ * @throws  BadgerDbException  If a record of the chain is no part of one
+ */
+std::string overflowValue(BufMgr& bufMgr, File& overflow, const RecordView& value);
+
+}
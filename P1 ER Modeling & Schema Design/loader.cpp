@@ -0,0 +1,920 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Loads the eBay items into BadgerDB heap files in one pass, in place of
+ * parser.py, sort, uniq and the sqlite import.  Every file named on the
+ * command line is read by one of several threads, which writes the Item, Bid
+ * and BelongTo tuples of its items straight into pages of the heap files
+ * through the buffer manager, and offers the User and Category tuples to
+ * hash sets that keep one tuple per key.  Those are written once every file
+ * has been read.
+ *
+ * Tuples are the lines parser.py writes, without the newline: columns are
+ * separated by '|', text is quoted with quotes doubled, and absent values
+ * are NULL.  Of the rows of a user, the one met first, in the order of the
+ * files and then of the file, is kept.  A record cannot span pages, so a
+ * description too long for the page of its item is stored in a chain of
+ * records of ItemOverflow.db, and the item holds @page.slot, the record id of
+ * the first, in its place; see overflowValue() in executor.h.
+ *
+ * Build and run with runLoader.sh, or:
+ *   ./loader <output directory> ebay_data/items-*.json
+ * which creates Item.db, ItemOverflow.db, User.db, Category.db, Bid.db and
+ * BelongTo.db.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Column separator of the tuples, as in parser.py
+ */
+const char SEPARATOR = '|';
+
+/**
+ * Frames of the buffer pool; every thread pins one page of each table
+ */
+const std::uint32_t POOL_FRAMES = 1024;
+
+/**
+ * Longest tuple, which fills an empty page
+ */
+const std::size_t MAX_TUPLE = Page::DATA_SIZE - sizeof(PageSlot);
+
+/**
+ * Bytes of a long value in each record of its overflow chain, which leaves
+ * room for the record id of the next in front of them
+ */
+const std::size_t OVERFLOW_CHUNK = MAX_TUPLE - 32;
+
+/**
+ * Month numbers by name, as in parser.py
+ */
+const char* const MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                              "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+/**
+ * Reads a JSON document in place, one value at a time, without building a
+ * tree.  The ends of strings are found with memchr(), which scans a vector
+ * register of bytes at a time, and strings without escapes are copied as
+ * they are.
+ */
+class JsonReader {
+ public:
+  JsonReader(const char* begin, const char* end, const std::string& name)
+    : begin(begin), pos(begin), end(end), name(name) {}
+
+  /**
+   * Returns the next character that is not white space, without taking it;
+   * '\0' at the end of the document
+   */
+  char peek()
+  {
+    while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+      pos++;
+    }
+    return pos < end ? *pos : '\0';
+  }
+
+  /**
+   * Takes the next character, which must be c
+   */
+  void expect(const char c)
+  {
+    if (peek() != c) {
+      fail(std::string("expected '") + c + "'");
+    }
+    pos++;
+  }
+
+  /**
+   * Takes c if it is next and returns whether it was
+   */
+  bool take(const char c)
+  {
+    if (peek() != c) {
+      return false;
+    }
+    pos++;
+    return true;
+  }
+
+  /**
+   * Takes null if it is next and returns whether it was
+   */
+  bool takeNull()
+  {
+    if (peek() != 'n' || end - pos < 4 || std::memcmp(pos, "null", 4) != 0) {
+      return false;
+    }
+    pos += 4;
+    return true;
+  }
+
+  /**
+   * Iterates over the members of an object, calling member with the key of
+   * every member with the reader at its value, which member must take
+   */
+  template <class Member>
+  void object(Member member)
+  {
+    expect('{');
+    if (take('}')) {
+      return;
+    }
+    std::string key;
+    do {
+      string(key);
+      expect(':');
+      member(key);
+    } while (take(','));
+    expect('}');
+  }
+
+  /**
+   * Iterates over the elements of an array, calling element with the reader
+   * at each of them, which element must take
+   */
+  template <class Element>
+  void array(Element element)
+  {
+    expect('[');
+    if (take(']')) {
+      return;
+    }
+    do {
+      element();
+    } while (take(','));
+    expect(']');
+  }
+
+  /**
+   * Takes a string, or the text of a number, true or false, into out
+   */
+  void string(std::string& out)
+  {
+    if (peek() != '"') {
+      const char* start = pos;
+      while (pos < end && std::strchr(",}] \n\r\t", *pos) == NULL) {
+        pos++;
+      }
+      if (pos == start) {
+        fail("expected a value");
+      }
+      out.assign(start, pos);
+      return;
+    }
+    const char* start = ++pos;
+    const char* close = start;
+    bool escaped = false;
+    for (;;) {
+      close = static_cast<const char*>(std::memchr(close, '"', end - close));
+      if (close == NULL) {
+        fail("unterminated string");
+      }
+      // The quote ends the string unless an odd number of backslashes escapes it.
+      const char* slash = close;
+      while (slash > start && slash[-1] == '\\') {
+        slash--;
+      }
+      if ((close - slash) % 2 == 0) {
+        break;
+      }
+      escaped = true;
+      close++;
+    }
+    pos = close + 1;
+    if (!escaped && std::memchr(start, '\\', close - start) == NULL) {
+      out.assign(start, close);
+      return;
+    }
+    out.clear();
+    for (const char* p = start; p < close; p++) {
+      if (*p != '\\') {
+        out += *p;
+        continue;
+      }
+      switch (*++p) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': p = unicode(p, close, out); break;
+        default: out += *p; break;
+      }
+    }
+  }
+
+  /**
+   * Takes a value of any kind, ignoring it
+   */
+  void skip()
+  {
+    std::string ignored;
+    switch (peek()) {
+      case '{':
+        object([this](const std::string&) { skip(); });
+        break;
+      case '[':
+        array([this]() { skip(); });
+        break;
+      default:
+        if (!takeNull()) {
+          string(ignored);
+        }
+        break;
+    }
+  }
+
+  /**
+   * Throws a BadgerDbException naming the document and the offending position
+   */
+  void fail(const std::string& what) const
+  {
+    std::ostringstream message;
+    message << name << ": " << what << " at byte " << (pos - begin);
+    throw BadgerDbException(message.str());
+  }
+
+ private:
+  const char* const begin;
+  const char* pos;
+  const char* const end;
+  const std::string name;
+
+  /**
+   * Appends the character of the \uXXXX escape at p, and of a low surrogate
+   * escape following a high one, as UTF-8, returning the last byte taken
+   */
+  const char* unicode(const char* p, const char* close, std::string& out) const
+  {
+    std::uint32_t code = 0;
+    if (!hex(p + 1, close, code)) {
+      fail("bad unicode escape");
+    }
+    p += 4;
+    std::uint32_t low = 0;
+    if (code >= 0xd800 && code < 0xdc00 && close - p > 6 && p[1] == '\\' && p[2] == 'u' &&
+        hex(p + 3, close, low) && low >= 0xdc00 && low < 0xe000) {
+      code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+      p += 6;
+    }
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xc0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xe0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+    return p;
+  }
+
+  /**
+   * Reads the four hex digits at p into code
+   */
+  static bool hex(const char* p, const char* close, std::uint32_t& code)
+  {
+    if (close - p < 4) {
+      return false;
+    }
+    code = 0;
+    for (int i = 0; i < 4; i++) {
+      const char c = p[i];
+      code <<= 4;
+      if (c >= '0' && c <= '9') {
+        code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        code |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+/**
+ * Appends text quoted, with its quotes doubled, as removeQuote() in parser.py
+ */
+void quote(std::string& out, const std::string& text)
+{
+  out += '"';
+  for (const char c : text) {
+    if (c == '"') {
+      out += '"';
+    }
+    out += c;
+  }
+  out += '"';
+}
+
+/**
+ * Appends a dollar amount such as $3,453.23 as 3453.23, as transformDollar()
+ */
+void dollar(std::string& out, const std::string& money)
+{
+  for (const char c : money) {
+    if ((c >= '0' && c <= '9') || c == '.') {
+      out += c;
+    }
+  }
+}
+
+/**
+ * Appends a time such as Dec-03-01 18:10:40 as 2001-12-03 18:10:40, as
+ * transformDttm()
+ */
+std::string timestamp(const std::string& dttm)
+{
+  const std::size_t first = dttm.find_first_not_of(' ');
+  const std::size_t last = dttm.find_last_not_of(' ');
+  const std::string trimmed = first == std::string::npos ? "" : dttm.substr(first, last - first + 1);
+  const std::size_t space = trimmed.find(' ');
+  const std::string date = trimmed.substr(0, space);
+  const std::size_t dash1 = date.find('-');
+  const std::size_t dash2 = date.find('-', dash1 + 1);
+  if (dash1 == std::string::npos || dash2 == std::string::npos) {
+    return trimmed;
+  }
+  std::string month = date.substr(0, dash1);
+  for (int m = 0; m < 12; m++) {
+    if (month == MONTHS[m]) {
+      month = std::string(1, static_cast<char>('0' + (m + 1) / 10)) + static_cast<char>('0' + (m + 1) % 10);
+    }
+  }
+  return "20" + date.substr(dash2 + 1) + "-" + month + "-" + date.substr(dash1 + 1, dash2 - dash1 - 1) +
+         " " + (space == std::string::npos ? "" : trimmed.substr(space + 1, trimmed.find(' ', space + 1) - space - 1));
+}
+
+/**
+ * Appends a text value quoted, or NULL if it is absent
+ */
+void quoteOrNull(std::string& out, const bool present, const std::string& text)
+{
+  if (present) {
+    quote(out, text);
+  } else {
+    out += "NULL";
+  }
+}
+
+/**
+ * A heap file being loaded, shared by the threads
+ */
+struct Table {
+  explicit Table(const std::string& path)
+    : file(create(path)), tuples(0) {}
+
+  static File create(const std::string& path)
+  {
+    try {
+      File::remove(path);
+    } catch (FileNotFoundException&) {
+    }
+    return File::create(path);
+  }
+
+  File file;
+
+  /**
+   * Serialises allocations, since File::allocatePage() is not threadsafe
+   */
+  std::mutex allocLatch;
+
+  std::atomic<std::uint64_t> tuples;
+};
+
+/**
+ * The page of a table one thread is filling, pinned in the buffer pool
+ */
+struct Cursor {
+  Table* table;
+  PageId pageNo;
+  Page* page;
+};
+
+/**
+ * Inserts tuple into the page of cursor, moving on to a new page of the table
+ * when it is full, and returns its record id
+ */
+RecordId append(BufMgr& bufMgr, Cursor& cursor, const std::string& tuple)
+{
+  if (cursor.page == NULL || !cursor.page->hasSpaceForRecord(tuple)) {
+    if (cursor.page != NULL) {
+      bufMgr.unPinPage(&cursor.table->file, cursor.pageNo, true);
+      cursor.page = NULL;
+    }
+    std::lock_guard<std::mutex> guard(cursor.table->allocLatch);
+    bufMgr.allocPage(&cursor.table->file, cursor.pageNo, cursor.page);
+  }
+  const RecordId rid = cursor.page->insertRecord(tuple);
+  cursor.table->tuples++;
+  return rid;
+}
+
+/**
+ * Writes value, too long for a page, into a chain of records of the table of
+ * cursor, and appends the reference @page.slot to the first to tuple.  Every
+ * record is the record id of the next, page.slot, 0.0 in the last, then '|'
+ * and the next part of value; they are written last first, so that each can
+ * name the next.
+ */
+void appendChain(BufMgr& bufMgr, Cursor& cursor, std::string& tuple, const std::string& value)
+{
+  RecordId next = {0, 0};
+  std::string record;
+  for (std::size_t part = (value.size() + OVERFLOW_CHUNK - 1) / OVERFLOW_CHUNK; part-- > 0;) {
+    record = std::to_string(next.page_number) + '.' + std::to_string(next.slot_number) + SEPARATOR;
+    record.append(value, part * OVERFLOW_CHUNK, OVERFLOW_CHUNK);
+    next = append(bufMgr, cursor, record);
+  }
+  tuple += '@';
+  tuple += std::to_string(next.page_number) + '.' + std::to_string(next.slot_number);
+}
+
+/**
+ * Unpins the page of cursor, if any
+ */
+void finish(BufMgr& bufMgr, Cursor& cursor)
+{
+  if (cursor.page != NULL) {
+    bufMgr.unPinPage(&cursor.table->file, cursor.pageNo, true);
+    cursor.page = NULL;
+  }
+}
+
+/**
+ * Tuples offered by the threads, kept once per key: the one offered with the
+ * lowest order.  Sharded by key, so that threads rarely wait for each other.
+ */
+class UniqueTuples {
+ public:
+  void offer(const std::string& key, const std::uint64_t order, const std::string& tuple)
+  {
+    Shard& shard = shards[std::hash<std::string>()(key) % SHARDS];
+    std::lock_guard<std::mutex> guard(shard.latch);
+    std::pair<std::unordered_map<std::string, Entry>::iterator, bool> slot =
+        shard.tuples.emplace(key, Entry(order, tuple));
+    if (!slot.second && order < slot.first->second.first) {
+      slot.first->second = Entry(order, tuple);
+    }
+  }
+
+  /**
+   * Returns the tuples kept, in the order of their keys
+   */
+  std::vector<std::string> sorted() const
+  {
+    std::vector<std::pair<std::string, std::string> > all;
+    for (const Shard& shard : shards) {
+      for (const std::pair<const std::string, Entry>& entry : shard.tuples) {
+        all.push_back(std::make_pair(entry.first, entry.second.second));
+      }
+    }
+    std::sort(all.begin(), all.end());
+    std::vector<std::string> tuples;
+    tuples.reserve(all.size());
+    for (std::pair<std::string, std::string>& entry : all) {
+      tuples.push_back(std::move(entry.second));
+    }
+    return tuples;
+  }
+
+ private:
+  static const std::size_t SHARDS = 64;
+
+  typedef std::pair<std::uint64_t, std::string> Entry;
+
+  struct Shard {
+    std::mutex latch;
+    std::unordered_map<std::string, Entry> tuples;
+  };
+
+  Shard shards[SHARDS];
+};
+
+/**
+ * Everything the threads load into
+ */
+struct Load {
+  BufMgr& bufMgr;
+  Table& items;
+  Table& bids;
+  Table& belongTo;
+  UniqueTuples users;
+  UniqueTuples categories;
+  std::atomic<std::uint64_t> longDescriptions;
+
+  Load(BufMgr& bufMgr, Table& items, Table& bids, Table& belongTo)
+    : bufMgr(bufMgr), items(items), bids(bids), belongTo(belongTo), longDescriptions(0) {}
+};
+
+/**
+ * A user as met in an item: the seller or a bidder
+ */
+struct User {
+  std::string userId;
+  std::string rating;
+  std::string location;
+  std::string country;
+  bool hasLocation;
+  bool hasCountry;
+
+  User() : hasLocation(false), hasCountry(false) {}
+
+  void read(JsonReader& json)
+  {
+    json.object([&](const std::string& key) {
+      if (key == "UserID") {
+        json.string(userId);
+      } else if (key == "Rating") {
+        json.string(rating);
+      } else if (key == "Location") {
+        hasLocation = !json.takeNull();
+        if (hasLocation) {
+          json.string(location);
+        }
+      } else if (key == "Country") {
+        hasCountry = !json.takeNull();
+        if (hasCountry) {
+          json.string(country);
+        }
+      } else {
+        json.skip();
+      }
+    });
+  }
+
+  /**
+   * Offers the tuple of the user, as parser.py writes it
+   */
+  void offer(Load& load, const std::uint64_t order) const
+  {
+    std::string tuple;
+    quoteOrNull(tuple, hasLocation, location);
+    tuple += SEPARATOR;
+    quoteOrNull(tuple, hasCountry, country);
+    tuple += SEPARATOR;
+    quote(tuple, userId);
+    tuple += SEPARATOR;
+    tuple += rating;
+    load.users.offer(userId, order, tuple);
+  }
+};
+
+/**
+ * A bid of an item
+ */
+struct Bid {
+  User bidder;
+  std::string time;
+  std::string amount;
+
+  void read(JsonReader& json)
+  {
+    json.object([&](const std::string& key) {
+      if (key != "Bid") {
+        json.skip();
+        return;
+      }
+      json.object([&](const std::string& field) {
+        if (field == "Bidder") {
+          bidder.read(json);
+        } else if (field == "Time") {
+          json.string(time);
+        } else if (field == "Amount") {
+          json.string(amount);
+        } else {
+          json.skip();
+        }
+      });
+    });
+  }
+};
+
+/**
+ * An item, with the fields parser.py uses
+ */
+struct Item {
+  std::string itemId;
+  std::string name;
+  std::string currently;
+  std::string buyPrice;
+  std::string firstBid;
+  std::string numberOfBids;
+  std::string location;
+  std::string country;
+  std::string started;
+  std::string ends;
+  std::string description;
+  bool hasBuyPrice;
+  bool hasDescription;
+  std::vector<std::string> categories;
+  std::vector<Bid> bids;
+  User seller;
+
+  void read(JsonReader& json)
+  {
+    hasBuyPrice = false;
+    hasDescription = false;
+    categories.clear();
+    bids.clear();
+    seller = User();
+    json.object([&](const std::string& key) {
+      if (key == "ItemID") {
+        json.string(itemId);
+      } else if (key == "Name") {
+        json.string(name);
+      } else if (key == "Currently") {
+        json.string(currently);
+      } else if (key == "Buy_Price") {
+        hasBuyPrice = !json.takeNull();
+        if (hasBuyPrice) {
+          json.string(buyPrice);
+        }
+      } else if (key == "First_Bid") {
+        json.string(firstBid);
+      } else if (key == "Number_of_Bids") {
+        json.string(numberOfBids);
+      } else if (key == "Location") {
+        json.string(location);
+      } else if (key == "Country") {
+        json.string(country);
+      } else if (key == "Started") {
+        json.string(started);
+      } else if (key == "Ends") {
+        json.string(ends);
+      } else if (key == "Description") {
+        hasDescription = !json.takeNull();
+        if (hasDescription) {
+          json.string(description);
+        }
+      } else if (key == "Category") {
+        json.array([&]() {
+          categories.push_back(std::string());
+          json.string(categories.back());
+        });
+      } else if (key == "Bids") {
+        if (!json.takeNull()) {
+          json.array([&]() {
+            bids.push_back(Bid());
+            bids.back().read(json);
+          });
+        }
+      } else if (key == "Seller") {
+        seller.read(json);
+      } else {
+        json.skip();
+      }
+    });
+  }
+
+  /**
+   * Writes the tuples of the item, its categories and bids, and the chain of
+   * a long description, and offers those of its category names and users;
+   * order numbers the users it offers
+   */
+  void load(Load& load, Cursor& items, Cursor& overflow, Cursor& bidCursor, Cursor& belongTo,
+            std::uint64_t& order) const
+  {
+    std::string tuple;
+    for (std::size_t i = 0; i < categories.size(); i++) {
+      const std::string& category = categories[i];
+      // An item may list a category twice; uniq kept one BelongTo tuple.
+      if (std::find(categories.begin(), categories.begin() + i, category) != categories.begin() + i) {
+        continue;
+      }
+      std::string quoted;
+      quote(quoted, category);
+      load.categories.offer(category, 0, quoted);
+      tuple = itemId + SEPARATOR + quoted;
+      append(load.bufMgr, belongTo, tuple);
+    }
+    for (const Bid& bid : bids) {
+      tuple = itemId + SEPARATOR;
+      quote(tuple, bid.bidder.userId);
+      tuple += SEPARATOR;
+      quote(tuple, timestamp(bid.time));
+      tuple += SEPARATOR;
+      dollar(tuple, bid.amount);
+      append(load.bufMgr, bidCursor, tuple);
+      bid.bidder.offer(load, order++);
+    }
+    // The seller's row carries the location and country of the item.
+    User sellerRow = seller;
+    sellerRow.location = location;
+    sellerRow.country = country;
+    sellerRow.hasLocation = true;
+    sellerRow.hasCountry = true;
+    sellerRow.offer(load, order++);
+
+    tuple = itemId + SEPARATOR;
+    quote(tuple, name);
+    tuple += SEPARATOR;
+    dollar(tuple, currently);
+    tuple += SEPARATOR;
+    if (hasBuyPrice) {
+      dollar(tuple, buyPrice);
+    } else {
+      tuple += "NULL";
+    }
+    tuple += SEPARATOR;
+    dollar(tuple, firstBid);
+    tuple += SEPARATOR;
+    tuple += numberOfBids;
+    tuple += SEPARATOR;
+    quote(tuple, started);
+    tuple += SEPARATOR;
+    quote(tuple, ends);
+    tuple += SEPARATOR;
+    quote(tuple, seller.userId);
+    tuple += SEPARATOR;
+    if (!hasDescription) {
+      tuple += "NULL";
+    } else {
+      std::string quoted;
+      quote(quoted, description);
+      if (tuple.size() + quoted.size() <= MAX_TUPLE) {
+        tuple += quoted;
+      } else {
+        appendChain(load.bufMgr, overflow, tuple, quoted);
+        load.longDescriptions++;
+      }
+    }
+    append(load.bufMgr, items, tuple);
+  }
+};
+
+/**
+ * Loads the items of the file; fileIndex orders the users it offers before
+ * those of later files
+ */
+void loadFile(Load& load, const std::string& path, const std::uint64_t fileIndex,
+              Cursor& items, Cursor& overflow, Cursor& bids, Cursor& belongTo)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw FileNotFoundException(path);
+  }
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  const std::string text = contents.str();
+  JsonReader json(text.data(), text.data() + text.size(), path);
+  std::uint64_t order = fileIndex << 40;
+  Item item;
+  json.object([&](const std::string& key) {
+    if (key != "Items") {
+      json.skip();
+      return;
+    }
+    json.array([&]() {
+      item.read(json);
+      item.load(load, items, overflow, bids, belongTo, order);
+    });
+  });
+}
+
+/**
+ * Returns true if the name ends in .json, as isJson() in parser.py
+ */
+bool isJson(const std::string& name)
+{
+  return name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <output directory> <path to json files>" << std::endl;
+    return 1;
+  }
+  const std::string directory = argv[1];
+  std::vector<std::string> paths;
+  for (int i = 2; i < argc; i++) {
+    if (isJson(argv[i])) {
+      paths.push_back(argv[i]);
+    }
+  }
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  Table items(directory + "/Item.db");
+  Table overflow(directory + "/ItemOverflow.db");
+  Table users(directory + "/User.db");
+  Table categories(directory + "/Category.db");
+  Table bids(directory + "/Bid.db");
+  Table belongTo(directory + "/BelongTo.db");
+  Table* const tables[] = {&items, &overflow, &users, &categories, &bids, &belongTo};
+  try {
+    BufMgr bufMgr(POOL_FRAMES);
+    Load load(bufMgr, items, bids, belongTo);
+
+    const std::size_t threads = std::max<std::size_t>(
+        1, std::min<std::size_t>(paths.size(), std::thread::hardware_concurrency()));
+    std::atomic<std::size_t> next(0);
+    std::mutex errorLatch;
+    std::string error;
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&]() {
+        Cursor itemCursor = {&items, 0, NULL};
+        Cursor overflowCursor = {&overflow, 0, NULL};
+        Cursor bidCursor = {&bids, 0, NULL};
+        Cursor belongToCursor = {&belongTo, 0, NULL};
+        try {
+          for (std::size_t i = next++; i < paths.size(); i = next++) {
+            loadFile(load, paths[i], i, itemCursor, overflowCursor, bidCursor, belongToCursor);
+            std::lock_guard<std::mutex> guard(errorLatch);
+            std::cout << "Success parsing " << paths[i] << std::endl;
+          }
+        } catch (const std::exception& e) {
+          std::lock_guard<std::mutex> guard(errorLatch);
+          if (error.empty()) {
+            error = e.what();
+          }
+          next = paths.size();
+        }
+        finish(bufMgr, itemCursor);
+        finish(bufMgr, overflowCursor);
+        finish(bufMgr, bidCursor);
+        finish(bufMgr, belongToCursor);
+      }));
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+    if (!error.empty()) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+
+    Cursor userCursor = {&users, 0, NULL};
+    for (const std::string& tuple : load.users.sorted()) {
+      append(bufMgr, userCursor, tuple);
+    }
+    finish(bufMgr, userCursor);
+    Cursor categoryCursor = {&categories, 0, NULL};
+    for (const std::string& tuple : load.categories.sorted()) {
+      append(bufMgr, categoryCursor, tuple);
+    }
+    finish(bufMgr, categoryCursor);
+
+    for (Table* table : tables) {
+      bufMgr.flushFile(&table->file);
+    }
+    if (load.longDescriptions > 0) {
+      std::cout << load.longDescriptions << " descriptions stored in overflow chains" << std::endl;
+    }
+  } catch (const BadgerDbException& e) {
+    std::cerr << e.message() << std::endl;
+    return 1;
+  }
+
+  const char* const names[] = {"Item", "ItemOverflow", "User", "Category", "Bid", "BelongTo"};
+  for (int i = 0; i < 6; i++) {
+    std::cout << names[i] << ": " << tables[i]->tuples << " tuples in "
+              << tables[i]->file.pageLimit() - 1 << " pages" << std::endl;
+  }
+  std::cout << "Loaded " << paths.size() << " files in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+            << " s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,223 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Runs query1.sql to query7.sql natively, as plans of the operators of
+ * executor.h over the heap files loader.cpp writes, and prints the result
+ * of every query with the best time of several runs.  All the tables fit in
+ * the buffer pool, so every run after the first reads them from memory.
+ *
+ * Build and run with runQueries.sh, or:
+ *   ./queries <directory of the heap files> [runs]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "exceptions/badgerdb_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Frames of the buffer pool, enough for every table
+ */
+const std::uint32_t POOL_FRAMES = 8192;
+
+/**
+ * Fields of the tuples of every table, in the order of create.sql
+ */
+enum ItemField { ITEM_ID, ITEM_NAME, ITEM_CURRENTLY, ITEM_BUY_PRICE, ITEM_FIRST_BID,
+                 ITEM_NUMBER_OF_BIDS, ITEM_STARTED, ITEM_ENDS, ITEM_SELLER_ID, ITEM_DESCRIPTION };
+enum UserField { USER_LOCATION, USER_COUNTRY, USER_ID, USER_RATING };
+enum BidField { BID_ITEM_ID, BID_USER_ID, BID_TIME, BID_AMOUNT };
+enum BelongToField { BELONG_TO_ITEM_ID, BELONG_TO_NAME };
+
+/**
+ * The heap files of the tables
+ */
+struct Tables {
+  explicit Tables(const std::string& directory)
+    : item(File::open(directory + "/Item.db")), user(File::open(directory + "/User.db")),
+      bid(File::open(directory + "/Bid.db")), belongTo(File::open(directory + "/BelongTo.db")) {}
+
+  File item;
+  File user;
+  File bid;
+  File belongTo;
+};
+
+OperatorPtr scan(BufMgr& bufMgr, File& file, const std::vector<std::size_t>& fields)
+{
+  return OperatorPtr(new HeapScan(bufMgr, file, fields));
+}
+
+OperatorPtr filter(OperatorPtr child, const Filter::Predicate& predicate)
+{
+  return OperatorPtr(new Filter(std::move(child), predicate));
+}
+
+OperatorPtr join(OperatorPtr build, const std::size_t buildKey, OperatorPtr probe,
+                 const std::size_t probeKey)
+{
+  return OperatorPtr(new HashJoin(std::move(build), buildKey, std::move(probe), probeKey));
+}
+
+OperatorPtr aggregate(OperatorPtr child, const std::vector<std::size_t>& groupBy,
+                      const std::vector<HashAggregate::Aggregate>& aggregates)
+{
+  return OperatorPtr(new HashAggregate(std::move(child), groupBy, aggregates));
+}
+
+/**
+ * COUNT(*) of the rows of child
+ */
+OperatorPtr count(OperatorPtr child)
+{
+  return aggregate(std::move(child), {}, {{HashAggregate::COUNT, 0}});
+}
+
+/**
+ * Returns the first column of every row of the plan, one row a line
+ */
+std::string run(Operator& plan)
+{
+  std::string result;
+  Batch batch;
+  while (plan.next(batch)) {
+    for (std::size_t r = 0; r < batch.rows; r++) {
+      result += batch.row(r)[0].str();
+      result += '\n';
+    }
+  }
+  return result;
+}
+
+/**
+ * The plan of every query, built afresh for every run
+ */
+struct Query {
+  const char* name;
+  std::string (*execute)(BufMgr& bufMgr, Tables& tables);
+};
+
+// SELECT Count(*) FROM User;
+std::string query1(BufMgr& bufMgr, Tables& tables)
+{
+  OperatorPtr plan = count(scan(bufMgr, tables.user, {}));
+  return run(*plan);
+}
+
+// SELECT Count(*) FROM User WHERE User.Location = "New York";
+std::string query2(BufMgr& bufMgr, Tables& tables)
+{
+  OperatorPtr plan = count(filter(scan(bufMgr, tables.user, {USER_LOCATION}),
+                                  [](const RecordView* row) { return text(row[0]) == "New York"; }));
+  return run(*plan);
+}
+
+// Items in exactly four categories
+std::string query3(BufMgr& bufMgr, Tables& tables)
+{
+  OperatorPtr perItem = aggregate(scan(bufMgr, tables.belongTo, {BELONG_TO_ITEM_ID, BELONG_TO_NAME}),
+                                  {0}, {{HashAggregate::COUNT, 1}});
+  OperatorPtr plan = count(filter(std::move(perItem),
+                                  [](const RecordView* row) { return number(row[1]) == 4; }));
+  return run(*plan);
+}
+
+// Items whose current price is the highest, found by a top-1 first
+std::string query4(BufMgr& bufMgr, Tables& tables)
+{
+  OperatorPtr highest = OperatorPtr(new TopK(scan(bufMgr, tables.item, {ITEM_CURRENTLY}), 1, 0, true));
+  Batch batch;
+  if (!highest->next(batch)) {
+    return "";
+  }
+  const double currently = number(batch.row(0)[0]);
+  OperatorPtr plan = filter(scan(bufMgr, tables.item, {ITEM_ID, ITEM_CURRENTLY}),
+                            [currently](const RecordView* row) { return number(row[1]) == currently; });
+  return run(*plan);
+}
+
+// Sellers rated above 1000
+std::string query5(BufMgr& bufMgr, Tables& tables)
+{
+  // Rows: SellerID, UserID, Rating
+  OperatorPtr sellers = join(scan(bufMgr, tables.user, {USER_ID, USER_RATING}), 0,
+                             scan(bufMgr, tables.item, {ITEM_SELLER_ID}), 0);
+  OperatorPtr perSeller = aggregate(std::move(sellers), {1}, {{HashAggregate::MAX, 2}});
+  OperatorPtr plan = count(filter(std::move(perSeller),
+                                  [](const RecordView* row) { return number(row[1]) > 1000; }));
+  return run(*plan);
+}
+
+// Users who are both sellers and bidders
+std::string query6(BufMgr& bufMgr, Tables& tables)
+{
+  // Rows: Bid.UserID, User.UserID, then the distinct SellerID
+  OperatorPtr bidders = join(scan(bufMgr, tables.user, {USER_ID}), 0,
+                             scan(bufMgr, tables.bid, {BID_USER_ID}), 0);
+  OperatorPtr sellers = aggregate(scan(bufMgr, tables.item, {ITEM_SELLER_ID}), {0}, {});
+  OperatorPtr both = join(std::move(sellers), 0, std::move(bidders), 1);
+  OperatorPtr plan = count(aggregate(std::move(both), {1}, {}));
+  return run(*plan);
+}
+
+// Categories with an item bid more than $100 on
+std::string query7(BufMgr& bufMgr, Tables& tables)
+{
+  // Rows: ItemID, then Bid.ItemID and Amount of the bids over $100
+  OperatorPtr bids = filter(scan(bufMgr, tables.bid, {BID_ITEM_ID, BID_AMOUNT}),
+                            [](const RecordView* row) { return number(row[1]) > 100; });
+  OperatorPtr items = join(std::move(bids), 0, scan(bufMgr, tables.item, {ITEM_ID}), 0);
+  // Rows: BelongTo.ItemID, Name, then those of items
+  OperatorPtr categories = join(std::move(items), 0,
+                                scan(bufMgr, tables.belongTo, {BELONG_TO_ITEM_ID, BELONG_TO_NAME}), 0);
+  OperatorPtr plan = count(aggregate(std::move(categories), {1}, {{HashAggregate::COUNT, 2}}));
+  return run(*plan);
+}
+
+const Query QUERIES[] = {
+  {"query1", query1}, {"query2", query2}, {"query3", query3}, {"query4", query4},
+  {"query5", query5}, {"query6", query6}, {"query7", query7},
+};
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <directory of the heap files> [runs]" << std::endl;
+    return 1;
+  }
+  const int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+  try {
+    Tables tables(argv[1]);
+    BufMgr bufMgr(POOL_FRAMES);
+    for (const Query& query : QUERIES) {
+      std::string result;
+      double best = 0;
+      for (int run = 0; run < runs; run++) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        result = query.execute(bufMgr, tables);
+        const double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        best = run == 0 ? ms : std::min(best, ms);
+      }
+      std::cout << query.name << " (" << best << " ms):\n" << result;
+    }
+  } catch (const BadgerDbException& e) {
+    std::cerr << e.message() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,4 @@
+P2="../P2 Buffer Manager"
+g++ -std=c++14 -O2 -pthread -I"$P2" loader.cpp "$P2"/buf*.cpp "$P2"/crc32c.cpp "$P2"/file.cpp "$P2"/ioEngine.cpp \
+    "$P2"/page.cpp "$P2"/pageCodec.cpp "$P2"/wal.cpp "$P2"/exceptions/*.cpp -o loader
+./loader . ebay_data/items-*.json
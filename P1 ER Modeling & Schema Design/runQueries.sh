@@ -0,0 +1,10 @@
+P2="../P2 Buffer Manager"
+g++ -std=c++14 -O2 -pthread -I"$P2" queries.cpp executor.cpp "$P2"/buf*.cpp "$P2"/crc32c.cpp "$P2"/file.cpp \
+    "$P2"/ioEngine.cpp "$P2"/page.cpp "$P2"/pageCodec.cpp "$P2"/wal.cpp "$P2"/exceptions/*.cpp -o queries
+./queries .
+# With the sqlite database of the same data as argument, time it on the same queries.
+if [ -n "$1" ]; then
+    for q in query*.sql; do
+        /usr/bin/time -f "$q sqlite (%e s)" sqlite3 "$1" < $q
+    done
+fi
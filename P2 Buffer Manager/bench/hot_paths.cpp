@@ -0,0 +1,495 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Google Benchmark suite of the hot paths of the buffer manager, the file and
+ * the page: readPage hits and misses, allocPage, unPinPage, eviction by each
+ * replacement policy under pool pressure, and Page insertRecord, deleteRecord
+ * and getRecord, and the CRC-32C of a page, alone and as part of each miss
+ * in every checksum mode.  Buffer manager runs are parameterized by pool
+ * size, thread count and access distribution: uniform, Zipfian (theta 0.99)
+ * or a scan.
+ * Pages are in the operating system's cache, so a miss costs a copy, not a
+ * disk read.
+ *
+ * Build from the buffer manager directory, against Google Benchmark 1.7 or
+ * later, with every source but main.cpp:
+ *   g++ -std=c++14 -O2 -pthread -I. bench/hot_paths.cpp \
+ *       $(ls *.cpp | grep -v '^main.cpp$') $(find exceptions -name '*.cpp') \
+ *       -lbenchmark -o hot_paths
+ * CRC instructions are used only when the build targets them, for example
+ * with -msse4.2 or -march=native added; BM_PageChecksum reports which.
+ * Run: ./hot_paths [--benchmark_filter=ReadPage]
+ *      ./hot_paths --benchmark_out=hot_paths.json --benchmark_out_format=json
+ */
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "buffer.h"
+#include "crc32c.h"
+#include "shardedTable.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+//access distributions of the page numbers a run reads
+enum Access { UNIFORM = 0, ZIPFIAN = 1, SCAN = 2 };
+
+//page numbers every thread precomputes, so that drawing them is not timed
+static const std::size_t TRACE_LENGTH = 1 << 16;
+
+//pages unpinned per timed batch of BM_UnPinPage
+static const std::size_t UNPIN_BATCH = 64;
+
+static const char *const BENCH_FILE = "bench.hot";
+
+//pool and file shared by the threads of a run, made by setUp() before they start
+static std::unique_ptr<BufMgr> bufMgr;
+static std::unique_ptr<File> file;
+static PageId filePages;
+
+/**
+* @param pages in the file, frames in the pool, replacement policy
+* @return none
+* @purpose make the file and the pool of a run
+*/
+static void makeFixture(const PageId pages, const std::uint32_t frames, const ReplacementPolicy policy) {
+    try {
+        File::remove(BENCH_FILE);
+    }
+    catch (FileNotFoundException &) {
+    }
+    file.reset(new File(File::create(BENCH_FILE)));
+    const std::string record(100, 'r');
+    for (PageId p = 0; p < pages; p++) {
+        Page page = file->allocatePage();
+        page.insertRecord(record);
+        file->writePage(page);
+    }
+    filePages = pages;
+    bufMgr.reset(new BufMgr(frames, policy));
+}
+
+/**
+* @param state of the run
+* @return none
+* @purpose drop the pool, then the file, after every thread of a run is done
+*/
+static void tearDown(const benchmark::State &) {
+    bufMgr.reset();
+    file.reset();
+    File::remove(BENCH_FILE);
+}
+
+/**
+* @param state: frames, access
+* @return none
+* @purpose a file of half as many pages as the pool has frames, all read in
+*/
+static void setUpResident(const benchmark::State &state) {
+    const std::uint32_t frames = static_cast<std::uint32_t>(state.range(0));
+    makeFixture(frames / 2, frames, TWO_Q);
+    for (PageId pageNo = 1; pageNo <= filePages; pageNo++) {
+        Page *page;
+        bufMgr->readPage(file.get(), pageNo, page);
+        bufMgr->unPinPage(file.get(), pageNo, false);
+    }
+}
+
+/**
+* @param state: frames, access, replacement policy
+* @return none
+* @purpose a file of four times as many pages as the pool has frames
+*/
+static void setUpPressure(const benchmark::State &state) {
+    const std::uint32_t frames = static_cast<std::uint32_t>(state.range(0));
+    makeFixture(4 * frames, frames, static_cast<ReplacementPolicy>(state.range(2)));
+}
+
+/**
+* @param state: frames, access, checksum mode
+* @return none
+* @purpose a file of four times as many pages as the pool has frames, its
+*          pages checked as the mode asks when they are read
+*/
+static void setUpChecksum(const benchmark::State &state) {
+    const std::uint32_t frames = static_cast<std::uint32_t>(state.range(0));
+    makeFixture(4 * frames, frames, TWO_Q);
+    bufMgr->verifyChecksums(static_cast<ChecksumMode>(state.range(2)));
+}
+
+/**
+* @param state: frames
+* @return none
+* @purpose an empty file the run allocates pages in
+*/
+static void setUpEmpty(const benchmark::State &state) {
+    makeFixture(0, static_cast<std::uint32_t>(state.range(0)), TWO_Q);
+}
+
+/**
+* @param access distribution, pages to draw from, seed
+* @return TRACE_LENGTH page numbers, between 1 and pages
+* @purpose the pages a thread reads, in order
+*/
+static std::vector<PageId> makeTrace(const Access access, const PageId pages, const unsigned seed) {
+    std::vector<PageId> trace(TRACE_LENGTH);
+    unsigned state = seed;
+    if (access == SCAN) {
+        //every thread scans from its own place in the file
+        const PageId start = rand_r(&state) % pages;
+        for (std::size_t i = 0; i < trace.size(); i++) {
+            trace[i] = 1 + (start + i) % pages;
+        }
+        return trace;
+    }
+    if (access == UNIFORM) {
+        for (PageId &pageNo : trace) {
+            pageNo = 1 + rand_r(&state) % pages;
+        }
+        return trace;
+    }
+    //Gray et al., Quickly Generating Billion-Record Synthetic Databases
+    const double theta = 0.99;
+    double zetan = 0;
+    for (PageId rank = 1; rank <= pages; rank++) {
+        zetan += 1 / std::pow(rank, theta);
+    }
+    const double zeta2 = 1 + 1 / std::pow(2, theta);
+    const double alpha = 1 / (1 - theta);
+    const double eta = (1 - std::pow(2.0 / pages, 1 - theta)) / (1 - zeta2 / zetan);
+    for (PageId &pageNo : trace) {
+        const double u = rand_r(&state) / (RAND_MAX + 1.0);
+        const double uz = u * zetan;
+        PageId rank = uz < 1 ? 0 : uz < zeta2 ? 1 : static_cast<PageId>(pages * std::pow(eta * u - eta + 1, alpha));
+        if (rank >= pages) {
+            rank = pages - 1;
+        }
+        //the hottest pages are spread over the file
+        pageNo = 1 + static_cast<PageId>((rank * 2654435761ULL) % pages);
+    }
+    return trace;
+}
+
+/**
+* @param state of the run
+* @return none
+* @purpose readPage and unPinPage of pages of the trace, reporting the hit
+*          ratio of the pool over the run
+*/
+static void readPages(benchmark::State &state) {
+    const std::vector<PageId> trace = makeTrace(static_cast<Access>(state.range(1)), filePages,
+                                                29 + state.thread_index());
+    if (state.thread_index() == 0) {
+        bufMgr->clearBufStats();
+    }
+    std::size_t next = 0;
+    for (auto _ : state) {
+        const PageId pageNo = trace[next];
+        next = (next + 1) % trace.size();
+        Page *page;
+        bufMgr->readPage(file.get(), pageNo, page);
+        benchmark::DoNotOptimize(page);
+        bufMgr->unPinPage(file.get(), pageNo, false);
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        const BufStats stats = bufMgr->getBufStats();
+        state.counters["hit_ratio"] = stats.accesses == 0 ? 0 : static_cast<double>(stats.hits) / stats.accesses;
+    }
+}
+
+/**
+* @param state: frames, access
+* @return none
+* @purpose readPage of pages all in the pool
+*/
+static void BM_ReadPageHit(benchmark::State &state) {
+    readPages(state);
+}
+
+/**
+* @param state: frames, access, replacement policy
+* @return none
+* @purpose readPage of a file four times the pool, so that misses evict pages
+*/
+static void BM_ReadPageMiss(benchmark::State &state) {
+    readPages(state);
+}
+
+/**
+* @param state: frames, access, checksum mode
+* @return none
+* @purpose readPage misses that check the pages read, at once, in the
+*          background or not at all
+*/
+static void BM_ReadPageMissChecksum(benchmark::State &state) {
+    readPages(state);
+    if (state.thread_index() == 0) {
+        state.counters["verified"] = static_cast<double>(bufMgr->getBufStats().verified);
+    }
+}
+
+/**
+* @param state: frames
+* @return none
+* @purpose allocPage of new pages, which evicts the dirty pages allocated before
+*/
+static void BM_AllocPage(benchmark::State &state) {
+    for (auto _ : state) {
+        PageId pageNo;
+        Page *page;
+        bufMgr->allocPage(file.get(), pageNo, page);
+        bufMgr->unPinPage(file.get(), pageNo, true);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+* @param state: frames, access
+* @return none
+* @purpose unPinPage alone, timing batches of unpins of pages pinned untimed
+*/
+static void BM_UnPinPage(benchmark::State &state) {
+    const std::vector<PageId> trace = makeTrace(static_cast<Access>(state.range(1)), filePages,
+                                                29 + state.thread_index());
+    std::size_t next = 0;
+    PageId batch[UNPIN_BATCH];
+    for (auto _ : state) {
+        for (PageId &pageNo : batch) {
+            pageNo = trace[next];
+            next = (next + 1) % trace.size();
+            Page *page;
+            bufMgr->readPage(file.get(), pageNo, page);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        for (const PageId pageNo : batch) {
+            bufMgr->unPinPage(file.get(), pageNo, false);
+        }
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    state.SetItemsProcessed(state.iterations() * UNPIN_BATCH);
+}
+
+/**
+* @param state: record bytes
+* @return none
+* @purpose insertRecord into an empty page until it is full, again and again
+*/
+static void BM_PageInsert(benchmark::State &state) {
+    const std::string record(state.range(0), 'r');
+    Page page;
+    for (auto _ : state) {
+        if (!page.hasSpaceForRecord(record)) {
+            page = Page();
+        }
+        benchmark::DoNotOptimize(page.insertRecord(record));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+* @param state: record bytes
+* @return none
+* @purpose deleteRecord of a random record of a full page, and an insertRecord
+*          that takes its place
+*/
+static void BM_PageDeleteInsert(benchmark::State &state) {
+    const std::string record(state.range(0), 'r');
+    Page page;
+    std::vector<RecordId> rids;
+    while (page.hasSpaceForRecord(record)) {
+        rids.push_back(page.insertRecord(record));
+    }
+    unsigned seed = 35;
+    for (auto _ : state) {
+        const std::size_t victim = rand_r(&seed) % rids.size();
+        page.deleteRecord(rids[victim]);
+        rids[victim] = page.insertRecord(record);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+* @param state: record bytes
+* @return none
+* @purpose getRecord, a copy, of random records of a full page
+*/
+static void BM_PageGetRecord(benchmark::State &state) {
+    const std::string record(state.range(0), 'r');
+    Page page;
+    std::vector<RecordId> rids;
+    while (page.hasSpaceForRecord(record)) {
+        rids.push_back(page.insertRecord(record));
+    }
+    unsigned seed = 35;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(page.getRecord(rids[rand_r(&seed) % rids.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ReadPageHit)
+    ->ArgNames({"frames", "access"})
+    ->ArgsProduct({{64, 1024, 16384}, {UNIFORM, ZIPFIAN, SCAN}})
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Setup(setUpResident)->Teardown(tearDown);
+
+BENCHMARK(BM_ReadPageMiss)
+    ->ArgNames({"frames", "access", "policy"})
+    ->ArgsProduct({{64, 1024}, {UNIFORM, ZIPFIAN, SCAN}, {CLOCK, LRU_K, TWO_Q}})
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Setup(setUpPressure)->Teardown(tearDown);
+
+BENCHMARK(BM_AllocPage)
+    ->ArgNames({"frames"})
+    ->Arg(64)->Arg(1024)
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Setup(setUpEmpty)->Teardown(tearDown);
+
+BENCHMARK(BM_UnPinPage)
+    ->ArgNames({"frames", "access"})
+    ->ArgsProduct({{1024, 16384}, {UNIFORM, ZIPFIAN}})
+    ->ThreadRange(1, 8)
+    ->UseManualTime()
+    ->Setup(setUpResident)->Teardown(tearDown);
+
+/**
+* @param state: 1 for the tables whatever the build targets
+* @return none
+* @purpose CRC-32C of a full page, the cost checksums add to every write back
+*          and checked read
+*/
+static void BM_PageChecksum(benchmark::State &state) {
+    std::vector<unsigned char> bytes(Page::SIZE);
+    unsigned seed = 35;
+    for (unsigned char &byte : bytes) {
+        byte = static_cast<unsigned char>(rand_r(&seed));
+    }
+    const bool portable = state.range(0) != 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(portable ? Crc32c::extendPortable(0, bytes.data(), bytes.size())
+                                          : Crc32c::extend(0, bytes.data(), bytes.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.size());
+    state.SetLabel(portable || !Crc32c::hardware() ? "tables" : "instructions");
+}
+
+BENCHMARK(BM_ReadPageMissChecksum)
+    ->ArgNames({"frames", "access", "checksum"})
+    ->ArgsProduct({{1024}, {UNIFORM, ZIPFIAN}, {CHECKSUM_ON_MISS, CHECKSUM_SCRUB, CHECKSUM_OFF}})
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Setup(setUpChecksum)->Teardown(tearDown);
+
+BENCHMARK(BM_PageChecksum)->ArgNames({"portable"})->Arg(0)->Arg(1);
+
+BENCHMARK(BM_PageInsert)->ArgNames({"bytes"})->Arg(16)->Arg(128)->Arg(1024);
+BENCHMARK(BM_PageDeleteInsert)->ArgNames({"bytes"})->Arg(16)->Arg(128)->Arg(1024);
+BENCHMARK(BM_PageGetRecord)->ArgNames({"bytes"})->Arg(16)->Arg(128)->Arg(1024);
+
+/**
+* @param state: segments, workers
+* @return none
+* @purpose scans of a table four times the pool striped over segments files,
+*          read by workers threads
+*/
+static void BM_ShardedScan(benchmark::State &state) {
+    const std::uint32_t segments = static_cast<std::uint32_t>(state.range(0));
+    std::vector<std::string> names;
+    for (std::uint32_t s = 0; s < segments; s++) {
+        names.push_back(std::string(BENCH_FILE) + "." + std::to_string(s));
+        try {
+            File::remove(names.back());
+        }
+        catch (FileNotFoundException &) {
+        }
+    }
+    const std::uint32_t frames = 256;
+    std::uint64_t pages = 0;
+    {
+        BufMgr scanMgr(frames);
+        ShardedTable table = ShardedTable::create(scanMgr, names);
+        // two records a page
+        const std::string record(Page::DATA_SIZE / 2 - 16, 'r');
+        for (std::uint32_t r = 0; r < 2 * 4 * frames; r++) {
+            table.insertRecord(record);
+        }
+        table.flush();
+        for (auto _ : state) {
+            const ShardScanStats stats = table.scan(static_cast<unsigned>(state.range(1)),
+                [](const unsigned, const std::uint32_t, Page &page) {
+                    benchmark::DoNotOptimize(page.getFreeSpace());
+                });
+            pages += stats.pages;
+        }
+    }
+    ShardedTable::remove(names);
+    state.SetItemsProcessed(static_cast<std::int64_t>(pages));
+}
+
+BENCHMARK(BM_ShardedScan)
+    ->ArgNames({"segments", "workers"})
+    ->ArgsProduct({{1, 4}, {1, 4}})
+    ->UseRealTime();
+
+/**
+* @param state: scans, shared
+* @return none
+* @purpose concurrent full scans of a file four times the pool, as shared
+*          scans or as readPage loops, counting the disk reads of a pass
+*/
+static void BM_ConcurrentScans(benchmark::State &state) {
+    const std::uint32_t frames = 256;
+    makeFixture(4 * frames, frames, TWO_Q);
+    const int scans = static_cast<int>(state.range(0));
+    const bool shared = state.range(1) != 0;
+    bufMgr->clearBufStats();
+    for (auto _ : state) {
+        std::vector<std::thread> scanners;
+        for (int s = 0; s < scans; s++) {
+            scanners.emplace_back([shared]() {
+                Page *page;
+                if (shared) {
+                    SharedScan scan = bufMgr->openSharedScan(file.get());
+                    while (scan.next(page)) {
+                        benchmark::DoNotOptimize(page->getFreeSpace());
+                    }
+                    return;
+                }
+                for (PageId pageNo = 1; pageNo <= filePages; pageNo++) {
+                    bufMgr->readPage(file.get(), pageNo, page);
+                    benchmark::DoNotOptimize(page->getFreeSpace());
+                    bufMgr->unPinPage(file.get(), pageNo, false);
+                }
+            });
+        }
+        for (std::thread &scanner : scanners) {
+            scanner.join();
+        }
+    }
+    const BufStats stats = bufMgr->getBufStats();
+    state.counters["reads/pass"] = static_cast<double>(stats.diskreads) / state.iterations() / filePages;
+    state.SetItemsProcessed(state.iterations() * scans * static_cast<std::int64_t>(filePages));
+    tearDown(state);
+}
+
+BENCHMARK(BM_ConcurrentScans)
+    ->ArgNames({"scans", "shared"})
+    ->ArgsProduct({{1, 4}, {0, 1}})
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,107 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Frames per second read into the buffer pool from a plain and a compressed
+ * file holding the same pages, and the disk space each file takes.  Pages
+ * imitate half full B+ tree leaves: sorted integer keys and record ids.
+ *
+ * Build from the buffer manager directory, with every source but main.cpp:
+ *   g++ -std=c++14 -O2 -pthread -I. bench/page_compression.cpp \
+ *       $(ls *.cpp | grep -v '^main.cpp$') $(find exceptions -name '*.cpp') \
+ *       -o page_compression
+ * Run: ./page_compression [pages] [passes]
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+//frames in the pool, far fewer than pages so that every read misses
+static const std::uint32_t POOL_FRAMES = 64;
+
+/**
+* @param file name, whether to compress, number of pages
+* @return none
+* @purpose create a file of leaf-like pages
+*/
+static void fill(const std::string &name, const bool compressed, const PageId pages) {
+    try {
+        File::remove(name);
+    }
+    catch (FileNotFoundException &) {
+    }
+    File file = File::create(name, false, compressed);
+    //one record per half leaf: keys, then the record ids they point to
+    const std::size_t keys = Page::DATA_SIZE / 4 / (sizeof(std::uint32_t) * 3);
+    std::vector<std::uint32_t> leaf(keys * 3);
+    std::uint32_t key = 0;
+    for (PageId p = 0; p < pages; p++) {
+        Page page = file.allocatePage();
+        for (std::size_t k = 0; k < keys; k++) {
+            key += 1 + rand() % 8;
+            leaf[k] = key;
+            leaf[keys + 2 * k] = key / 40;      //page of the record
+            leaf[keys + 2 * k + 1] = key % 40;  //slot of the record
+        }
+        page.insertRecord(std::string(reinterpret_cast<const char *>(leaf.data()),
+                                      leaf.size() * sizeof(std::uint32_t)));
+        file.writePage(page);
+    }
+    file.sync();
+}
+
+/**
+* @param file name, number of passes over the file
+* @return none
+* @purpose read every page of the file through a small pool and report
+*/
+static void measure(const std::string &name, const int passes) {
+    File file = File::open(name);
+    const PageId limit = file.pageLimit();
+    BufMgr bufMgr(POOL_FRAMES);
+    std::uint64_t frames = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        //a stride defeats read-ahead, which would hide the cost of a miss
+        for (PageId p = 1; p < 8; p++) {
+            for (PageId pageNo = p; pageNo < limit; pageNo += 7) {
+                Page *page;
+                bufMgr.readPage(&file, pageNo, page);
+                bufMgr.unPinPage(&file, pageNo, false);
+                frames++;
+            }
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    struct stat status;
+    stat(name.c_str(), &status);
+    printf("%-12s %12.0f frames/s  %10.1f KB on disk  %s\n", name.c_str(), frames / seconds,
+           status.st_blocks * 512 / 1024.0, file.isCompressed() ? "compressed" : "plain");
+}
+
+int main(int argc, char **argv) {
+    const PageId pages = argc > 1 ? atoi(argv[1]) : 20000;
+    const int passes = argc > 2 ? atoi(argv[2]) : 3;
+    fill("bench.plain", false, pages);
+    fill("bench.lz4", true, pages);
+    //cached reads show the codec's cost; drop the page cache between the
+    //runs to see the bandwidth saved
+    measure("bench.plain", passes);
+    measure("bench.lz4", passes);
+    File::remove("bench.plain");
+    File::remove("bench.lz4");
+    return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Nanoseconds per record deleted and inserted again on a page holding
+ * hundreds of small records, and per record viewed by a scan of the page.
+ * Deletes leave holes and inserts reuse their slots, so the page compacts
+ * whenever the free space between slots and records runs out.
+ *
+ * Build from the buffer manager directory:
+ *   g++ -std=c++14 -O2 -I. bench/page_slots.cpp page.cpp \
+ *       $(find exceptions -name '*.cpp') -o page_slots
+ * Run: ./page_slots [records] [record bytes] [operations]
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "page.h"
+#include "page_iterator.h"
+
+using namespace badgerdb;
+
+/**
+* @param start time
+* @return nanoseconds since start
+* @purpose time a phase of the benchmark
+*/
+static double nanosSince(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    const std::size_t records = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 400;
+    const std::size_t bytes = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 12;
+    const std::size_t operations = argc > 3 ? std::strtoul(argv[3], NULL, 10) : 2000000;
+
+    Page page;
+    std::vector<RecordId> rids;
+    const std::string record(bytes, 'r');
+    while (rids.size() < records && page.hasSpaceForRecord(record)) {
+        rids.push_back(page.insertRecord(record));
+    }
+    std::cout << rids.size() << " records of " << bytes << " bytes, "
+              << page.getFreeSpace() << " bytes free" << std::endl;
+
+    //a random record out and a new one in, so that the page stays as full
+    unsigned seed = 35;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (std::size_t op = 0; op < operations; op++) {
+        const std::size_t victim = rand_r(&seed) % rids.size();
+        page.deleteRecord(rids[victim]);
+        rids[victim] = page.insertRecord(record);
+    }
+    std::cout << "delete + insert: " << nanosSince(start) / operations << " ns" << std::endl;
+
+    std::size_t viewed = 0;
+    std::size_t checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (std::size_t pass = 0; pass < operations / rids.size() + 1; pass++) {
+        for (PageIterator it = page.begin(); it != page.end(); ++it) {
+            checksum += (*it).size();
+            viewed++;
+        }
+    }
+    std::cout << "scan: " << nanosSince(start) / viewed << " ns per record"
+              << (checksum == viewed * bytes ? "" : " (records damaged)") << std::endl;
+    return 0;
+}
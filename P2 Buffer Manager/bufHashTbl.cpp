@@ -11,104 +11,161 @@
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint64_t BufHashTbl::hash(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
+  // 64-bit finalizer of MurmurHash3 over the pointer and the page number, so
+  // consecutive pages of a file, and files allocated next to each other, are
+  // spread over all stripes and slots
+  std::uint64_t value = (std::uint64_t)(std::uintptr_t)file;
+  value ^= (std::uint64_t)pageNo * 0x9e3779b97f4a7c15ULL;
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
   return value;
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+hashStripe& BufHashTbl::stripe(const File* file, const PageId pageNo)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  return stripes[(hash(file, pageNo) >> 32) % numStripes];
 }
 
-BufHashTbl::~BufHashTbl()
+hashBucket* BufHashTbl::find(const File* file, const PageId pageNo)
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
+  const std::uint64_t value = hash(file, pageNo);
+  const hashStripe& s = stripes[(value >> 32) % numStripes];
+  const std::uint32_t mask = s.size - 1;
+  std::uint32_t index = (std::uint32_t)value & mask;
+  while (s.ht[index].file &&
+         !(s.ht[index].file == file && s.ht[index].pageNo == pageNo)) {
+    index = (index + 1) & mask;
   }
-  delete [] ht;
+  return &s.ht[index];
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+void BufHashTbl::grow(hashStripe& s)
 {
-  int index = hash(file, pageNo);
+  hashBucket* old = s.ht;
+  const std::uint32_t oldSize = s.size;
+  s.size = oldSize * 2;
+  s.ht = new hashBucket[s.size];
+  for(std::uint32_t i = 0; i < s.size; i++)
+    s.ht[i].file = NULL;
+
+  // the entries keep their stripe, only their slots change
+  const std::uint32_t mask = s.size - 1;
+  for(std::uint32_t i = 0; i < oldSize; i++) {
+    if (!old[i].file)
+      continue;
+    std::uint32_t index = (std::uint32_t)hash(old[i].file, old[i].pageNo) & mask;
+    while (s.ht[index].file)
+      index = (index + 1) & mask;
+    s.ht[index] = old[i];
+  }
+  delete [] old;
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+BufHashTbl::BufHashTbl(int bufs, int stripeCount)
+	: numStripes(stripeCount)
+{
+  // keep every stripe at most half full on average, with enough headroom for
+  // small pools whose entries spread unevenly over the stripes
+  const std::uint32_t perStripe = bufs / stripeCount + 1;
+  std::uint32_t size = 1;
+  while (size < 2 * perStripe + 16)
+    size <<= 1;
+
+  // allocate every slot the pool needs up front; only a pool that grows
+  // makes insert() allocate
+  stripes = new hashStripe[numStripes];
+  for(int s = 0; s < numStripes; s++) {
+    stripes[s].ht = new hashBucket[size];
+    stripes[s].size = size;
+    stripes[s].count = 0;
+    for(std::uint32_t i = 0; i < size; i++)
+      stripes[s].ht[i].file = NULL;
   }
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+BufHashTbl::~BufHashTbl()
+{
+  for(int s = 0; s < numStripes; s++)
+    delete [] stripes[s].ht;
+  delete [] stripes;
+}
 
+std::mutex& BufHashTbl::latch(const File* file, const PageId pageNo)
+{
+  return stripe(file, pageNo).latch;
+}
+
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  hashBucket* tmpBuc = find(file, pageNo);
+  if (tmpBuc->file)
+  	throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
+
+  // keep the stripe at most half full, so that probe runs stay short and
+  // always end at an empty slot
+  hashStripe& s = stripe(file, pageNo);
+  if (2 * (s.count + 1) > s.size) {
+    grow(s);
+    tmpBuc = find(file, pageNo);
+  }
+
+  ++s.count;
   tmpBuc->file = (File*) file;
   tmpBuc->pageNo = pageNo;
   tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
+}
 
-  throw HashNotFoundException(file->filename(), pageNo);
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo)
+{
+  hashBucket* tmpBuc = find(file, pageNo);
+  if (tmpBuc->file)
+  {
+    frameNo = tmpBuc->frameNo; // return frameNo by reference
+    return true;
+  }
+  return false;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc)
+  hashBucket* tmpBuc = find(file, pageNo);
+  if (!tmpBuc->file)
+    throw HashNotFoundException(file->filename(), pageNo);
+
+  // backward shift deletion: pull every later entry of the probe run whose
+  // home slot is not between the hole and itself into the hole
+  hashStripe& s = stripe(file, pageNo);
+  hashBucket* ht = s.ht;
+  const std::uint32_t mask = s.size - 1;
+  --s.count;
+  std::uint32_t hole = tmpBuc - ht;
+  std::uint32_t next = (hole + 1) & mask;
+  while (ht[next].file)
 	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
+    const std::uint32_t home =
+        (std::uint32_t)hash(ht[next].file, ht[next].pageNo) & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask))
 		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+      ht[hole] = ht[next];
+      hole = next;
     }
+    next = (next + 1) & mask;
   }
-
-  throw HashNotFoundException(file->filename(), pageNo);
+  ht[hole].file = NULL;
 }
 
 }
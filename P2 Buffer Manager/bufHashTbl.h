@@ -7,12 +7,16 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+
 #include "file.h"
 
 namespace badgerdb {
 
 /**
-* @brief Declarations for buffer pool hash table
+* @brief Declarations for buffer pool hash table.  One slot of the open
+* addressing table; a slot whose file is NULL is empty.
 */
 struct hashBucket {
 	/**
@@ -29,50 +33,129 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
+};
+
+
+/**
+* @brief One independently latched partition of the buffer pool hash table
+*/
+struct hashStripe {
+	/**
+	 * Latch protecting every slot of this stripe
+	 */
+	std::mutex latch;
+
+	/**
+	 * Slots of this stripe, linearly probed
+	 */
+	hashBucket*  ht;
+
+	/**
+	 * Number of slots, a power of two
+	 */
+	std::uint32_t size;
 
 	/**
-	 * Next node in the hash table
+	 * Number of occupied slots
 	 */
-	hashBucket*   next;
+	std::uint32_t count;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* The table is partitioned into stripes, each with its own latch, so that
+* lookups of pages that fall into different stripes never contend.  Every
+* stripe is a flat, linearly probed array of slots; remove() shifts later
+* entries of the probe run back instead of leaving tombstones.  A stripe
+* that an insert() would fill more than half doubles, rehashing its own
+* entries under its latch, so that the table grows with the pool one stripe
+* at a time and lookups in the other stripes go on meanwhile.  Stripes never
+* shrink.
+*
+* The table itself does not take any latch: callers must hold
+* latch(file, pageNo) around insert(), lookup() and remove() of that
+* (file, pageNo).
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 *	Number of stripes
 	 */
-  int HTSIZE;
+  int numStripes;
+
 	/**
-	 * Actual Hash table object
+	 * Actual Hash table object, one entry per stripe
 	 */
-  hashBucket**  ht;
+  hashStripe*  stripes;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns the stripe (file, pageNo) hashes to
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-	 * @return  			Hash value.
+	 * @return  			Stripe of the hash table.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  hashStripe& stripe(const File* file, const PageId pageNo);
+
+	/**
+	 * returns the slot holding (file, pageNo), or the empty slot that ends its
+	 * probe run if the entry is absent
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Slot of the entry.
+	 */
+  hashBucket* find(const File* file, const PageId pageNo);
+
+	/**
+	 * doubles the slots of a stripe and rehashes its entries into them
+	 *
+	 * @param s  			Stripe, whose latch the caller holds
+	 */
+  void grow(hashStripe& s);
 
  public:
 	/**
+	 * Default number of stripes
+	 */
+  static const int NUM_STRIPES = 16;
+
+	/**
+	 * returns hash value computed by mixing file and pageNo; the stripe is
+	 * derived from bits 32 and up and the slot inside the stripe from the low
+	 * half, which leaves the top 16 bits to split pages over several tables
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Hash value.
+	 */
+  static std::uint64_t hash(const File* file, const PageId pageNo);
+
+	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param bufs        Number of entries the table is sized for up front,
+	 *                    i.e. the number of frames in the buffer pool
+	 * @param stripeCount Number of independently latched stripes
 	 */
-	BufHashTbl(const int htSize);  // constructor
+	BufHashTbl(const int bufs, const int stripeCount = NUM_STRIPES);  // constructor
 
 	/**
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
+
+	/**
+   * Returns the latch of the stripe that (file, pageNo) hashes to.
+	 *
+	 * @param file   	File object
+	 * @param pageNo 	Page number in the file
+	 * @return        Latch to hold while accessing the entry of (file, pageNo)
+	 */
+  std::mutex& latch(const File* file, const PageId pageNo);
 	
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
@@ -81,7 +164,6 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -96,6 +178,18 @@ class BufHashTbl
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table), without throwing when it is not.  This is the lookup
+   * the buffer manager uses, since a miss is an expected outcome there.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only set if the entry is found
+	 * @return        True if the page entry is found in the hash table
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo);
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
@@ -0,0 +1,500 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+
+#include "bufReplacer.h"
+
+namespace badgerdb {
+
+const FrameId FrameList::NONE;
+const std::uint32_t TwoQReplacer::NO_GHOST;
+
+FrameList::FrameList(std::uint32_t bufs)
+	: prev(bufs, NONE), next(bufs, NONE), member(bufs, 0),
+	  head(NONE), tail(NONE), count(0)
+{
+}
+
+void FrameList::pushFront(FrameId frame)
+{
+  prev[frame] = NONE;
+  next[frame] = head;
+  if (head != NONE)
+    prev[head] = frame;
+  else
+    tail = frame;
+  head = frame;
+  member[frame] = 1;
+  ++count;
+}
+
+void FrameList::pushBack(FrameId frame)
+{
+  next[frame] = NONE;
+  prev[frame] = tail;
+  if (tail != NONE)
+    next[tail] = frame;
+  else
+    head = frame;
+  tail = frame;
+  member[frame] = 1;
+  ++count;
+}
+
+void FrameList::remove(FrameId frame)
+{
+  if (prev[frame] != NONE)
+    next[prev[frame]] = next[frame];
+  else
+    head = next[frame];
+  if (next[frame] != NONE)
+    prev[next[frame]] = prev[frame];
+  else
+    tail = prev[frame];
+  member[frame] = 0;
+  --count;
+}
+
+BufReplacer* BufReplacer::create(const ReplacementPolicy policy, const std::uint32_t bufs,
+                                 const FrameId firstFrame)
+{
+  switch (policy) {
+    case CLOCK:
+      return new ClockReplacer(bufs, firstFrame);
+    case LRU_K:
+      return new LruKReplacer(bufs, firstFrame);
+    case TWO_Q:
+    default:
+      return new TwoQReplacer(bufs, firstFrame);
+  }
+}
+
+BufReplacer::BufReplacer(const std::uint32_t bufs, const FrameId firstFrame)
+	: numBufs(bufs), numActive(bufs), firstFrame(firstFrame), pageOf(bufs), isFree(bufs, 1),
+	  use(bufs, FRAME_ACTIVE)
+{
+  // hand out low frame numbers first
+  freeFrames.reserve(bufs);
+  for (FrameId i = bufs; i > 0; i--)
+    freeFrames.push_back(i - 1);
+}
+
+void BufReplacer::recordInsert(const FrameId frame, const File* file, const PageId pageNo)
+{
+  const FrameId local = frame - firstFrame;
+  std::lock_guard<std::mutex> guard(latch);
+  pageOf[local].file = file;
+  pageOf[local].pageNo = pageNo;
+  insertLocked(local);
+}
+
+void BufReplacer::recordRequeue(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  requeueLocked(frame - firstFrame);
+}
+
+void BufReplacer::recordRemove(const FrameId frame)
+{
+  const FrameId local = frame - firstFrame;
+  std::lock_guard<std::mutex> guard(latch);
+  if (isFree[local])
+    return;
+  removeLocked(local);
+  if (use[local] != FRAME_ACTIVE) {
+    use[local] = FRAME_RELEASED;
+    return;
+  }
+  isFree[local] = 1;
+  freeFrames.push_back(local);
+}
+
+bool BufReplacer::pickVictim(FrameId& frame, const ClaimFn& tryClaim)
+{
+  // the policies number their frames from 0, and may still hold retired ones
+  std::lock_guard<std::mutex> guard(latch);
+  ClaimFn offsetClaim;
+  const ClaimFn* claim = &tryClaim;
+  if (firstFrame != 0 || numActive != numBufs) {
+    offsetClaim = [this, &tryClaim](FrameId local) {
+      return use[local] == FRAME_ACTIVE && tryClaim(local + firstFrame);
+    };
+    claim = &offsetClaim;
+  }
+  while (!freeFrames.empty()) {
+    const FrameId candidate = freeFrames.back();
+    freeFrames.pop_back();
+    isFree[candidate] = 0;
+    if ((*claim)(candidate)) {
+      frame = candidate + firstFrame;
+      return true;
+    }
+  }
+  if (!victimLocked(frame, *claim))
+    return false;
+  frame += firstFrame;
+  return true;
+}
+
+bool BufReplacer::claim(const FrameId frame, const ClaimFn& tryClaim)
+{
+  const FrameId local = frame - firstFrame;
+  std::lock_guard<std::mutex> guard(latch);
+  if (isFree[local] || use[local] != FRAME_ACTIVE || !tryClaim(frame))
+    return false;
+  removeLocked(local);
+  return true;
+}
+
+void BufReplacer::retire(const FrameId frame, const std::uint32_t count)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (FrameId local = frame - firstFrame; local < frame - firstFrame + count; local++) {
+    if (use[local] != FRAME_ACTIVE)
+      continue;
+    --numActive;
+    use[local] = isFree[local] ? FRAME_RELEASED : FRAME_DRAINING;
+    isFree[local] = 0;
+  }
+  freeFrames.erase(std::remove_if(freeFrames.begin(), freeFrames.end(),
+                                  [this](FrameId f) { return use[f] != FRAME_ACTIVE; }),
+                   freeFrames.end());
+  resizedLocked();
+}
+
+void BufReplacer::restore(const FrameId frame, const std::uint32_t count)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  // pushed from the top down, so that low frame numbers are handed out first
+  for (FrameId local = frame - firstFrame + count; local > frame - firstFrame; local--) {
+    if (use[local - 1] == FRAME_ACTIVE)
+      continue;
+    ++numActive;
+    if (use[local - 1] == FRAME_RELEASED) {
+      isFree[local - 1] = 1;
+      freeFrames.push_back(local - 1);
+    }
+    use[local - 1] = FRAME_ACTIVE;
+  }
+  resizedLocked();
+}
+
+ClockReplacer::ClockReplacer(const std::uint32_t bufs, const FrameId firstFrame)
+	: BufReplacer(bufs, firstFrame), refbit(new std::atomic<bool>[bufs]),
+	  resident(bufs, 0), clockHand(bufs - 1)
+{
+  for (FrameId i = 0; i < bufs; i++)
+    refbit[i] = false;
+}
+
+void ClockReplacer::accessed(const FrameId frame)
+{
+  refbit[frame] = true;
+}
+
+void ClockReplacer::insertLocked(const FrameId frame)
+{
+  refbit[frame] = true;
+  resident[frame] = 1;
+}
+
+void ClockReplacer::removeLocked(const FrameId frame)
+{
+  resident[frame] = 0;
+}
+
+bool ClockReplacer::victimLocked(FrameId& frame, const ClaimFn& tryClaim)
+{
+  // two full sweeps: the first may only clear refbits
+  for (std::uint32_t scanned = 0; scanned < 2 * numBufs; scanned++) {
+    clockHand = (clockHand + 1) % numBufs;
+    if (!resident[clockHand])
+      continue;
+    if (refbit[clockHand].exchange(false))
+      continue;
+    if (tryClaim(clockHand)) {
+      resident[clockHand] = 0;
+      frame = clockHand;
+      return true;
+    }
+  }
+  return false;
+}
+
+LruKReplacer::LruKReplacer(const std::uint32_t bufs, const FrameId firstFrame, const int k)
+	: BufReplacer(bufs, firstFrame), K(k), now(0), history(bufs * k, 0),
+	  accesses(bufs, 0), heapPos(bufs, FrameList::NONE)
+{
+  heap.reserve(bufs);
+  skipped.reserve(bufs);
+}
+
+void LruKReplacer::touch(const FrameId frame)
+{
+  std::uint64_t* h = &history[frame * K];
+  for (int i = K - 1; i > 0; i--)
+    h[i] = h[i - 1];
+  h[0] = ++now;
+  if (accesses[frame] < K)
+    ++accesses[frame];
+}
+
+std::uint64_t LruKReplacer::key(const FrameId frame) const
+{
+  // frames with fewer than K references have an infinite backward
+  // K-distance and sort before every other frame, oldest last access first
+  if (accesses[frame] < K)
+    return history[frame * K];
+  return (1ULL << 63) | history[frame * K + K - 1];
+}
+
+void LruKReplacer::accessed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (heapPos[frame] == FrameList::NONE)
+    return;
+  touch(frame);
+  const std::uint32_t pos = heapPos[frame];
+  siftDown(pos);
+  siftUp(heapPos[frame]);
+}
+
+void LruKReplacer::insertLocked(const FrameId frame)
+{
+  if (heapPos[frame] != FrameList::NONE)
+    heapErase(frame);
+  accesses[frame] = 0;
+  touch(frame);
+  heapPush(frame);
+}
+
+void LruKReplacer::removeLocked(const FrameId frame)
+{
+  if (heapPos[frame] != FrameList::NONE)
+    heapErase(frame);
+}
+
+bool LruKReplacer::victimLocked(FrameId& frame, const ClaimFn& tryClaim)
+{
+  bool found = false;
+  while (!heap.empty()) {
+    const FrameId candidate = heap[0];
+    heapErase(candidate);
+    if (tryClaim(candidate)) {
+      frame = candidate;
+      found = true;
+      break;
+    }
+    skipped.push_back(candidate);
+  }
+  // pinned or busy candidates keep their history
+  for (FrameId f : skipped)
+    heapPush(f);
+  skipped.clear();
+  return found;
+}
+
+void LruKReplacer::heapPush(const FrameId frame)
+{
+  heapPos[frame] = heap.size();
+  heap.push_back(frame);
+  siftUp(heapPos[frame]);
+}
+
+void LruKReplacer::heapErase(const FrameId frame)
+{
+  const std::uint32_t pos = heapPos[frame];
+  const std::uint32_t last = heap.size() - 1;
+  if (pos != last) {
+    heapSwap(pos, last);
+    heap.pop_back();
+    siftDown(pos);
+    siftUp(pos);
+  } else {
+    heap.pop_back();
+  }
+  heapPos[frame] = FrameList::NONE;
+}
+
+void LruKReplacer::siftUp(std::uint32_t pos)
+{
+  while (pos > 0) {
+    const std::uint32_t parent = (pos - 1) / 2;
+    if (key(heap[parent]) <= key(heap[pos]))
+      break;
+    heapSwap(pos, parent);
+    pos = parent;
+  }
+}
+
+void LruKReplacer::siftDown(std::uint32_t pos)
+{
+  const std::uint32_t size = heap.size();
+  for (;;) {
+    std::uint32_t smallest = pos;
+    const std::uint32_t left = 2 * pos + 1;
+    const std::uint32_t right = left + 1;
+    if (left < size && key(heap[left]) < key(heap[smallest]))
+      smallest = left;
+    if (right < size && key(heap[right]) < key(heap[smallest]))
+      smallest = right;
+    if (smallest == pos)
+      break;
+    heapSwap(pos, smallest);
+    pos = smallest;
+  }
+}
+
+void LruKReplacer::heapSwap(std::uint32_t a, std::uint32_t b)
+{
+  std::swap(heap[a], heap[b]);
+  heapPos[heap[a]] = a;
+  heapPos[heap[b]] = b;
+}
+
+TwoQReplacer::TwoQReplacer(const std::uint32_t bufs, const FrameId firstFrame)
+	: BufReplacer(bufs, firstFrame), a1in(bufs), am(bufs),
+	  kin(bufs / 4 > 0 ? bufs / 4 : 1),
+	  ghostRing(bufs / 2 > 0 ? bufs / 2 : 1), ghostShift(64), ghostSeq(0)
+{
+  for (PageKey& key : ghostRing)
+    key.file = NULL;
+  std::size_t size = 1;
+  while (size < 2 * ghostRing.size()) {
+    size <<= 1;
+    ghostShift--;
+  }
+  ghostTable.assign(size, NO_GHOST);
+}
+
+void TwoQReplacer::accessed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (am.contains(frame))
+    am.remove(frame);
+  else if (a1in.contains(frame))
+    a1in.remove(frame);
+  else
+    return;
+  am.pushFront(frame);
+}
+
+void TwoQReplacer::insertLocked(const FrameId frame)
+{
+  removeLocked(frame);
+  std::uint32_t* ghost = findGhost(pageOf[frame]);
+  if (*ghost != NO_GHOST) {
+    // re-referenced after leaving probation: a hot page
+    forgetGhost(ghost);
+    am.pushFront(frame);
+  } else {
+    a1in.pushFront(frame);
+  }
+}
+
+void TwoQReplacer::removeLocked(const FrameId frame)
+{
+  if (a1in.contains(frame))
+    a1in.remove(frame);
+  else if (am.contains(frame))
+    am.remove(frame);
+}
+
+void TwoQReplacer::requeueLocked(const FrameId frame)
+{
+  removeLocked(frame);
+  std::uint32_t* ghost = findGhost(pageOf[frame]);
+  if (*ghost != NO_GHOST)
+    forgetGhost(ghost);
+  a1in.pushBack(frame);
+}
+
+void TwoQReplacer::resizedLocked()
+{
+  kin = numActive / 4 > 0 ? numActive / 4 : 1;
+}
+
+bool TwoQReplacer::victimLocked(FrameId& frame, const ClaimFn& tryClaim)
+{
+  if (a1in.size() > kin) {
+    if (claimFrom(a1in, frame, tryClaim)) {
+      rememberGhost(pageOf[frame]);
+      return true;
+    }
+    return claimFrom(am, frame, tryClaim);
+  }
+  if (claimFrom(am, frame, tryClaim))
+    return true;
+  if (claimFrom(a1in, frame, tryClaim)) {
+    rememberGhost(pageOf[frame]);
+    return true;
+  }
+  return false;
+}
+
+bool TwoQReplacer::claimFrom(FrameList& list, FrameId& frame, const ClaimFn& tryClaim)
+{
+  for (FrameId f = list.back(); f != FrameList::NONE; f = list.towardsHead(f)) {
+    if (tryClaim(f)) {
+      list.remove(f);
+      frame = f;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TwoQReplacer::rememberGhost(const PageKey& key)
+{
+  const std::uint32_t slot = (std::uint32_t)(ghostSeq % ghostRing.size());
+  const PageKey& oldest = ghostRing[slot];
+  // the oldest key is forgotten unless it was remembered again since
+  if (oldest.file) {
+    std::uint32_t* ghost = findGhost(oldest);
+    if (*ghost == slot)
+      forgetGhost(ghost);
+  }
+  std::uint32_t* ghost = findGhost(key);
+  ghostRing[slot] = key;
+  *ghost = slot;
+  ++ghostSeq;
+}
+
+std::size_t TwoQReplacer::ghostHome(const PageKey& key) const
+{
+  // Fibonacci hashing: the top bits of the product
+  return (std::size_t)(((std::uint64_t)PageKeyHash()(key) * 0x9e3779b97f4a7c15ULL) >> ghostShift);
+}
+
+std::uint32_t* TwoQReplacer::findGhost(const PageKey& key)
+{
+  const std::size_t mask = ghostTable.size() - 1;
+  std::size_t index = ghostHome(key);
+  while (ghostTable[index] != NO_GHOST && !(ghostRing[ghostTable[index]] == key))
+    index = (index + 1) & mask;
+  return &ghostTable[index];
+}
+
+void TwoQReplacer::forgetGhost(std::uint32_t* entry)
+{
+  // backward shift deletion, as in BufHashTbl::remove
+  const std::size_t mask = ghostTable.size() - 1;
+  std::size_t hole = entry - ghostTable.data();
+  std::size_t next = (hole + 1) & mask;
+  while (ghostTable[next] != NO_GHOST) {
+    const std::size_t home = ghostHome(ghostRing[ghostTable[next]]);
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      ghostTable[hole] = ghostTable[next];
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  ghostTable[hole] = NO_GHOST;
+}
+
+}
@@ -0,0 +1,426 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+* @brief Page replacement policies selectable at BufMgr construction
+*/
+enum ReplacementPolicy {
+	CLOCK = 0,  /* single reference bit second chance */
+	LRU_K = 1,  /* evict the largest backward distance to the K-th last access */
+	TWO_Q = 2   /* FIFO probation queue, ghost queue and LRU main queue */
+};
+
+/**
+* @brief Identifies the page held by a frame
+*/
+struct PageKey {
+	/**
+	 * File the page belongs to
+	 */
+	const File* file;
+
+	/**
+	 * Page number within the file
+	 */
+	PageId pageNo;
+
+	bool operator==(const PageKey& rhs) const {
+		return file == rhs.file && pageNo == rhs.pageNo;
+	}
+};
+
+/**
+* @brief Hash functor for PageKey
+*/
+struct PageKeyHash {
+	std::size_t operator()(const PageKey& key) const {
+		return std::hash<const File*>()(key.file) ^ ((std::size_t)key.pageNo * 0x9e3779b97f4a7c15ULL);
+	}
+};
+
+/**
+* @brief Doubly linked list of frames threaded through preallocated arrays
+*
+* Every frame is in at most one FrameList; pushes and removals neither
+* allocate nor free memory.
+*/
+class FrameList {
+ public:
+	/**
+	 * Frame number marking the end of the list
+	 */
+  static const FrameId NONE = ~(FrameId)0;
+
+	/**
+	 * Constructor of FrameList class
+	 *
+	 * @param bufs Number of frames in the buffer pool
+	 */
+  FrameList(std::uint32_t bufs);
+
+	/**
+	 * Insert frame at the head (most recent end) of the list
+	 */
+  void pushFront(FrameId frame);
+
+	/**
+	 * Insert frame at the tail (least recent end) of the list
+	 */
+  void pushBack(FrameId frame);
+
+	/**
+	 * Unlink frame from the list; frame must be in the list
+	 */
+  void remove(FrameId frame);
+
+	/**
+	 * True if frame is in the list
+	 */
+  bool contains(FrameId frame) const { return member[frame] != 0; }
+
+	/**
+	 * Frame at the tail (least recent end) of the list, or NONE
+	 */
+  FrameId back() const { return tail; }
+
+	/**
+	 * Frame following frame towards the head, or NONE
+	 */
+  FrameId towardsHead(FrameId frame) const { return prev[frame]; }
+
+	/**
+	 * Number of frames in the list
+	 */
+  std::uint32_t size() const { return count; }
+
+ private:
+  std::vector<FrameId> prev;
+  std::vector<FrameId> next;
+  std::vector<char> member;
+  FrameId head;
+  FrameId tail;
+  std::uint32_t count;
+};
+
+/**
+* @brief Interface of page replacement policies used by BufMgr::allocBuf
+*
+* The buffer manager reports every page placed in a frame (recordInsert),
+* every hit (recordAccess), every claimed frame it hands back after writing
+* its page back (recordRequeue) and every frame that becomes free without
+* being chosen as a victim (recordRemove).  pickVictim offers candidate frames in
+* policy order to a claim callback supplied by the buffer manager, which
+* latches the frame if it is unpinned; the claimed frame is dropped from the
+* policy.  Free frames are always handed out before any resident one.
+*
+* A replacer manages a contiguous range of frames, so that a partitioned
+* pool can run one per partition; frame numbers passed in and out are those
+* of the whole pool.  Frames of the range may be taken out of use and put
+* back (retire, restore) as the pool shrinks and grows.
+*
+* Implementations are threadsafe.  The claim callback is invoked with the
+* policy latch held, so it must only try-lock.
+*/
+class BufReplacer {
+ public:
+	/**
+	 * Callback returning true if the frame was unpinned and has been latched
+	 */
+  typedef std::function<bool(FrameId)> ClaimFn;
+
+	/**
+	 * Creates the replacer implementing policy for frames firstFrame to
+	 * firstFrame + bufs - 1
+	 */
+  static BufReplacer* create(const ReplacementPolicy policy, const std::uint32_t bufs,
+                             const FrameId firstFrame = 0);
+
+	/**
+	 * Constructor of BufReplacer class; all frames start out free
+	 */
+  BufReplacer(const std::uint32_t bufs, const FrameId firstFrame);
+
+  virtual ~BufReplacer() {}
+
+	/**
+	 * Records a buffer hit on a resident frame
+	 */
+  void recordAccess(const FrameId frame) { accessed(frame - firstFrame); }
+
+	/**
+	 * Records that (file, pageNo) was placed in frame
+	 */
+  void recordInsert(const FrameId frame, const File* file, const PageId pageNo);
+
+	/**
+	 * Records that frame, claimed by pickVictim but not reused, holds its page
+	 * again; unlike recordInsert this is not a new reference to the page
+	 */
+  void recordRequeue(const FrameId frame);
+
+	/**
+	 * Returns frame to the free frames, whether or not it was resident
+	 */
+  void recordRemove(const FrameId frame);
+
+	/**
+	 * Selects and claims a frame to reuse.
+	 *
+	 * @param frame     Frame reference, claimed frame returned via this variable
+	 * @param tryClaim  Claim callback, see class description
+	 * @return          False if no frame could be claimed
+	 */
+  bool pickVictim(FrameId& frame, const ClaimFn& tryClaim);
+
+	/**
+	 * Claims a given resident frame to reuse, as if pickVictim had chosen it
+	 *
+	 * @param frame     Frame to claim
+	 * @param tryClaim  Claim callback, see class description
+	 * @return          False if the frame is free, retired, out of the policy
+	 *                  or not claimed by the callback
+	 */
+  bool claim(const FrameId frame, const ClaimFn& tryClaim);
+
+	/**
+	 * Takes frames frame to frame + count - 1 out of use.  Free ones leave
+	 * the free frames at once; resident ones are no longer offered to the
+	 * claim callback, and leave the policy at their recordRemove, which does
+	 * not return them to the free frames.
+	 */
+  void retire(const FrameId frame, const std::uint32_t count);
+
+	/**
+	 * Puts frames frame to frame + count - 1 back into use; those that have
+	 * left the policy since retire() become free
+	 */
+  void restore(const FrameId frame, const std::uint32_t count);
+
+ protected:
+	/**
+	 * Policy hook for recordAccess, called without latch
+	 */
+  virtual void accessed(const FrameId frame) = 0;
+
+	/**
+	 * Policy hooks, called with latch held
+	 */
+  virtual void insertLocked(const FrameId frame) = 0;
+  virtual void removeLocked(const FrameId frame) = 0;
+  virtual bool victimLocked(FrameId& frame, const ClaimFn& tryClaim) = 0;
+  virtual void requeueLocked(const FrameId frame) { insertLocked(frame); }
+
+	/**
+	 * Policy hook for retire and restore, called with latch held after
+	 * numActive has changed
+	 */
+  virtual void resizedLocked() {}
+
+	/**
+	 * Number of frames managed; policy hooks see them numbered from 0
+	 */
+  std::uint32_t numBufs;
+
+	/**
+	 * Number of frames managed that are not retired
+	 */
+  std::uint32_t numActive;
+
+	/**
+	 * Pool frame number of the first frame managed
+	 */
+  FrameId firstFrame;
+
+	/**
+	 * Latch protecting the policy state
+	 */
+  std::mutex latch;
+
+	/**
+	 * Page held by every resident frame
+	 */
+  std::vector<PageKey> pageOf;
+
+ private:
+	/**
+	 * Frames holding no page, reused last-in first-out
+	 */
+  std::vector<FrameId> freeFrames;
+
+	/**
+	 * True for frames in freeFrames
+	 */
+  std::vector<char> isFree;
+
+	/**
+	 * Use of a frame: in use, retired but still holding a page or claimed,
+	 * or retired and out of the policy
+	 */
+  enum FrameUse { FRAME_ACTIVE = 0, FRAME_DRAINING = 1, FRAME_RELEASED = 2 };
+  std::vector<char> use;
+};
+
+/**
+* @brief CLOCK: a hit sets the frame's reference bit, the hand clears set bits
+* and evicts the first unreferenced unpinned frame.  Hits take no latch.
+*/
+class ClockReplacer : public BufReplacer {
+ public:
+  ClockReplacer(const std::uint32_t bufs, const FrameId firstFrame = 0);
+
+ protected:
+  void accessed(const FrameId frame);
+  void insertLocked(const FrameId frame);
+  void removeLocked(const FrameId frame);
+  bool victimLocked(FrameId& frame, const ClaimFn& tryClaim);
+
+ private:
+  std::unique_ptr<std::atomic<bool>[]> refbit;
+  std::vector<char> resident;
+  FrameId clockHand;
+};
+
+/**
+* @brief LRU-K: evicts the frame whose K-th most recent access is oldest.
+* Frames referenced fewer than K times since they were loaded go first, in
+* LRU order, so pages touched once by a scan never displace pages that are
+* re-referenced.  Frames are kept in an indexed binary heap.
+*/
+class LruKReplacer : public BufReplacer {
+ public:
+	/**
+	 * Default number of accesses tracked per frame
+	 */
+  static const int DEFAULT_K = 2;
+
+  LruKReplacer(const std::uint32_t bufs, const FrameId firstFrame = 0, const int k = DEFAULT_K);
+
+ protected:
+  void accessed(const FrameId frame);
+  void insertLocked(const FrameId frame);
+  void removeLocked(const FrameId frame);
+  bool victimLocked(FrameId& frame, const ClaimFn& tryClaim);
+
+ private:
+	/**
+	 * Appends an access at the current time to the history of frame
+	 */
+  void touch(const FrameId frame);
+
+	/**
+	 * Eviction priority of frame; the smallest key is evicted first
+	 */
+  std::uint64_t key(const FrameId frame) const;
+
+  void heapPush(const FrameId frame);
+  void heapErase(const FrameId frame);
+  void siftUp(std::uint32_t pos);
+  void siftDown(std::uint32_t pos);
+  void heapSwap(std::uint32_t a, std::uint32_t b);
+
+  int K;
+  std::uint64_t now;
+	/**
+	 * Last K access times of every frame, most recent at history[frame * K]
+	 */
+  std::vector<std::uint64_t> history;
+  std::vector<int> accesses;
+  std::vector<FrameId> heap;
+  std::vector<std::uint32_t> heapPos;
+  std::vector<FrameId> skipped;
+};
+
+/**
+* @brief 2Q: newly loaded pages enter a FIFO probation queue (A1in).  Pages
+* evicted from it are remembered in a ghost queue (A1out); a page that misses
+* again while remembered is loaded straight into the LRU main queue (Am), as
+* does a page hit while on probation: callers keep a page pinned while they
+* work on it, so a second readPage is a genuine re-reference.  A sequential
+* scan therefore only cycles through A1in and leaves hot pages in Am alone.
+*/
+class TwoQReplacer : public BufReplacer {
+ public:
+  TwoQReplacer(const std::uint32_t bufs, const FrameId firstFrame = 0);
+
+ protected:
+  void accessed(const FrameId frame);
+  void insertLocked(const FrameId frame);
+  void removeLocked(const FrameId frame);
+  bool victimLocked(FrameId& frame, const ClaimFn& tryClaim);
+
+	/**
+	 * A frame handed back was claimed from the end of a queue, so it goes back
+	 * to the eviction end of A1in without a ghost that would make it hot
+	 */
+  void requeueLocked(const FrameId frame);
+
+	/**
+	 * Keeps A1in at a quarter of the frames in use
+	 */
+  void resizedLocked();
+
+ private:
+	/**
+	 * Claims the least recent claimable frame of list
+	 */
+  bool claimFrom(FrameList& list, FrameId& frame, const ClaimFn& tryClaim);
+
+	/**
+	 * Remembers key in A1out, forgetting the oldest ghost if A1out is full
+	 */
+  void rememberGhost(const PageKey& key);
+
+	/**
+	 * Returns the entry of ghostTable holding the ring slot of key, or the
+	 * empty entry where it would go
+	 */
+  std::uint32_t* findGhost(const PageKey& key);
+
+	/**
+	 * Empties an entry of ghostTable, keeping the probe runs through it whole
+	 */
+  void forgetGhost(std::uint32_t* entry);
+
+	/**
+	 * Returns the entry of ghostTable the probe run of key starts at
+	 */
+  std::size_t ghostHome(const PageKey& key) const;
+
+	/**
+	 * Entry of ghostTable holding no ring slot
+	 */
+  static const std::uint32_t NO_GHOST = ~(std::uint32_t)0;
+
+  FrameList a1in;
+  FrameList am;
+  std::uint32_t kin;
+	/**
+	 * A1out as a ring of keys, and an open addressing table of the slot of
+	 * the ring each remembered key was last put in.  The table has a power of
+	 * two entries, at least twice the ring's, so it is never more than half
+	 * full and remembering or forgetting a ghost does not allocate.
+	 */
+  std::vector<PageKey> ghostRing;
+  std::vector<std::uint32_t> ghostTable;
+  unsigned ghostShift;
+  std::uint64_t ghostSeq;
+};
+
+}
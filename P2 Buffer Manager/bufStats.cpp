@@ -0,0 +1,205 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <functional>
+#include <thread>
+
+#include "bufStats.h"
+
+namespace badgerdb {
+
+const int BufStatsCollector::MAX_PARTITIONS;
+
+std::uint64_t LatencyHistogram::percentileNanos(const double percentile) const
+{
+  const double target = count * percentile / 100.0;
+  std::uint64_t seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen > 0 && seen >= target)
+      return 1ULL << (i + 1);
+  }
+  return 0;
+}
+
+void LatencyHistogram::clear()
+{
+  for (int i = 0; i < NUM_BUCKETS; i++)
+    buckets[i] = 0;
+  count = totalNanos = 0;
+}
+
+BufStatsCollector::BufStatsCollector(const int partitions)
+	: numPartitions(partitions), slotsUsed(0), closedSeen(0)
+{
+  for (int f = 0; f < MAX_FILES; f++)
+    slotStream[f] = 0;
+  slotName[MAX_FILES - 1] = "<other>";
+  clear();
+}
+
+int BufStatsCollector::shardIndex()
+{
+  static thread_local const int shard =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) % NUM_SHARDS;
+  return shard;
+}
+
+int BufStatsCollector::fileSlot(const File* file)
+{
+  // the last slot is reserved for files that do not fit
+  const int tracked = MAX_FILES - 1;
+  const std::uint64_t stream = file->streamId();
+  if (stream == 0)
+    return tracked;
+  int slot = stream % tracked;
+  for (int probe = 0; probe < tracked; probe++) {
+    const std::uint64_t owner = slotStream[slot].load(std::memory_order_acquire);
+    if (owner == stream)
+      return slot;
+    if (owner == 0)
+      break;
+    slot = (slot + 1) % tracked;
+  }
+  return claimSlot(file, stream);
+}
+
+int BufStatsCollector::claimSlot(const File* file, const std::uint64_t stream)
+{
+  const int tracked = MAX_FILES - 1;
+  // read before the slots are looked at, so a file closing meanwhile is
+  // looked for again
+  const std::uint64_t closed = File::streamsClosed();
+  if (slotsUsed.load(std::memory_order_relaxed) == tracked &&
+      closedSeen.load(std::memory_order_relaxed) == closed)
+    return tracked;
+  std::lock_guard<std::mutex> guard(slotLatch);
+  int slot = stream % tracked;
+  int reusable = -1;
+  for (int probe = 0; probe < tracked; probe++) {
+    const std::uint64_t owner = slotStream[slot].load(std::memory_order_relaxed);
+    if (owner == stream)
+      return slot;
+    if (owner == 0)
+      break;
+    if (reusable < 0 && !slotHandle[slot].isOpen())
+      reusable = slot;
+    slot = (slot + 1) % tracked;
+  }
+  if (reusable >= 0) {
+    // reused in place, so the probe sequences through it stay whole
+    retireSlot(reusable);
+    slot = reusable;
+  } else if (slotStream[slot].load(std::memory_order_relaxed) != 0) {
+    // every slot is taken by an open file
+    closedSeen.store(closed, std::memory_order_relaxed);
+    return tracked;
+  } else {
+    ++slotsUsed;
+  }
+  slotName[slot] = file->filename();
+  slotHandle[slot] = file->syncHandle();
+  slotStream[slot].store(stream, std::memory_order_release);
+  return slot;
+}
+
+void BufStatsCollector::retireSlot(const int slot)
+{
+  // nothing counts for a closed file any more
+  for (int s = 0; s < NUM_SHARDS; s++)
+    for (int c = 0; c < NUM_BUF_COUNTERS; c++)
+      shards[s].files[MAX_FILES - 1].counters[c].fetch_add(
+          shards[s].files[slot].counters[c].exchange(0, std::memory_order_relaxed),
+          std::memory_order_relaxed);
+}
+
+void BufStatsCollector::recordLatency(const bool write, const std::uint64_t nanos)
+{
+  int bucket = 0;
+  while (bucket < LatencyHistogram::NUM_BUCKETS - 1 && (nanos >> (bucket + 1)) != 0)
+    bucket++;
+  Histogram& h = latency[write ? 1 : 0];
+  h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  h.count.fetch_add(1, std::memory_order_relaxed);
+  h.totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+BufStats BufStatsCollector::snapshot()
+{
+  BufStats stats;
+  for (int f = 0; f < MAX_FILES; f++) {
+    if (f < MAX_FILES - 1 && slotStream[f].load(std::memory_order_acquire) == 0)
+      continue;
+    FileBufStats file;
+    bool used = f < MAX_FILES - 1;
+    for (int c = 0; c < NUM_BUF_COUNTERS; c++) {
+      file.counters[c] = 0;
+      for (int s = 0; s < NUM_SHARDS; s++)
+        file.counters[c] += shards[s].files[f].counters[c].load(std::memory_order_relaxed);
+      used = used || file.counters[c] != 0;
+    }
+    if (!used)
+      continue;
+    {
+      std::lock_guard<std::mutex> guard(slotLatch);
+      file.filename = slotName[f];
+    }
+    stats.hits += file.counters[STAT_HITS];
+    stats.misses += file.counters[STAT_MISSES];
+    stats.diskreads += file.counters[STAT_MISSES] + file.counters[STAT_ALLOCS] + file.counters[STAT_PREFETCHES];
+    stats.diskwrites += file.counters[STAT_DISKWRITES];
+    stats.evictions += file.counters[STAT_EVICTIONS];
+    stats.dirtyEvictions += file.counters[STAT_DIRTY_EVICTIONS];
+    stats.prefetches += file.counters[STAT_PREFETCHES];
+    stats.verified += file.counters[STAT_VERIFIED];
+    stats.checksumFailures += file.counters[STAT_CHECKSUM_FAILURES];
+    stats.ringReuses += file.counters[STAT_RING_REUSES];
+    stats.files.push_back(file);
+  }
+  stats.accesses = stats.hits + stats.diskreads - stats.prefetches;
+
+  for (int p = 0; p < numPartitions; p++) {
+    PartitionBufStats partition;
+    partition.node = 0;
+    partition.frames = 0;
+    for (int c = 0; c < NUM_BUF_COUNTERS; c++) {
+      partition.counters[c] = 0;
+      for (int s = 0; s < NUM_SHARDS; s++)
+        partition.counters[c] += shards[s].partitions[p].counters[c].load(std::memory_order_relaxed);
+    }
+    stats.partitions.push_back(partition);
+  }
+
+  LatencyHistogram* out[2] = {&stats.readLatency, &stats.writeLatency};
+  for (int w = 0; w < 2; w++) {
+    for (int b = 0; b < LatencyHistogram::NUM_BUCKETS; b++)
+      out[w]->buckets[b] = latency[w].buckets[b].load(std::memory_order_relaxed);
+    out[w]->count = latency[w].count.load(std::memory_order_relaxed);
+    out[w]->totalNanos = latency[w].totalNanos.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void BufStatsCollector::clear()
+{
+  for (int s = 0; s < NUM_SHARDS; s++) {
+    for (int f = 0; f < MAX_FILES; f++)
+      for (int c = 0; c < NUM_BUF_COUNTERS; c++)
+        shards[s].files[f].counters[c].store(0, std::memory_order_relaxed);
+    for (int p = 0; p < MAX_PARTITIONS; p++)
+      for (int c = 0; c < NUM_BUF_COUNTERS; c++)
+        shards[s].partitions[p].counters[c].store(0, std::memory_order_relaxed);
+  }
+  for (int w = 0; w < 2; w++) {
+    for (int b = 0; b < LatencyHistogram::NUM_BUCKETS; b++)
+      latency[w].buckets[b].store(0, std::memory_order_relaxed);
+    latency[w].count.store(0, std::memory_order_relaxed);
+    latency[w].totalNanos.store(0, std::memory_order_relaxed);
+  }
+}
+
+}
@@ -0,0 +1,342 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+* @brief Events counted by the buffer manager
+*/
+enum BufCounter {
+	STAT_HITS = 0,        /* readPage found the page in the pool */
+	STAT_MISSES,          /* readPage read the page from disk */
+	STAT_ALLOCS,          /* allocPage placed a new page in the pool */
+	STAT_DISKWRITES,      /* page written back to disk */
+	STAT_EVICTIONS,       /* valid frame reused for another page */
+	STAT_DIRTY_EVICTIONS, /* victim that had to be written back before reuse */
+	STAT_PREFETCHES,      /* page read into the pool ahead of readPage */
+	STAT_VERIFIED,        /* page read checked against its checksum, on the miss or by the scrubber */
+	STAT_CHECKSUM_FAILURES, /* page read that did not match its checksum */
+	STAT_RING_REUSES,     /* frame of a shared scan's ring reused for the scan's next page */
+	NUM_BUF_COUNTERS
+};
+
+/**
+* @brief Histogram of I/O latencies with power of two buckets
+*/
+struct LatencyHistogram
+{
+	/**
+   * Number of buckets; bucket i counts operations that took less than 2^(i+1)
+   * and at least 2^i nanoseconds (bucket 0 also holds faster ones, the last
+   * bucket also holds slower ones)
+	 */
+  static const int NUM_BUCKETS = 40;
+
+	/**
+   * Number of operations per bucket
+	 */
+  std::uint64_t buckets[NUM_BUCKETS];
+
+	/**
+   * Number of operations recorded
+	 */
+  std::uint64_t count;
+
+	/**
+   * Sum of all recorded latencies in nanoseconds
+	 */
+  std::uint64_t totalNanos;
+
+	/**
+   * Upper bound, in nanoseconds, of the bucket holding the given percentile
+	 *
+	 * @param percentile  Percentile between 0 and 100
+	 */
+  std::uint64_t percentileNanos(const double percentile) const;
+
+	/**
+   * Clear all values
+	 */
+  void clear();
+
+	/**
+   * Constructor of LatencyHistogram class
+	 */
+  LatencyHistogram()
+  {
+		clear();
+  }
+};
+
+/**
+* @brief Buffer usage statistics of a single file
+*/
+struct FileBufStats
+{
+	/**
+   * Name of the file; "<other>" collects files beyond the tracked maximum,
+   * and the counts of closed files whose slots were given to other files
+	 */
+  std::string filename;
+
+	/**
+   * Counters indexed by BufCounter
+	 */
+  std::uint64_t counters[NUM_BUF_COUNTERS];
+};
+
+/**
+* @brief Buffer usage statistics of a single partition of the buffer pool
+*/
+struct PartitionBufStats
+{
+	/**
+   * NUMA node the frames of the partition are placed on
+	 */
+  int node;
+
+	/**
+   * Number of frames in the partition
+	 */
+  std::uint32_t frames;
+
+	/**
+   * Counters indexed by BufCounter, of the events on frames of the partition
+	 */
+  std::uint64_t counters[NUM_BUF_COUNTERS];
+};
+
+/**
+* @brief Class to maintain statistics of buffer usage
+*/
+struct BufStats
+{
+	/**
+   * Total number of accesses to buffer pool
+	 */
+  std::uint64_t accesses;
+
+	/**
+   * Number of accesses that found the page in the pool
+	 */
+  std::uint64_t hits;
+
+	/**
+   * Number of accesses that had to read the page from disk
+	 */
+  std::uint64_t misses;
+
+	/**
+   * Number of pages read from disk (including allocs and prefetches)
+	 */
+  std::uint64_t diskreads;
+
+	/**
+   * Number of pages written back to disk
+	 */
+  std::uint64_t diskwrites;
+
+	/**
+   * Number of valid frames reused for another page
+	 */
+  std::uint64_t evictions;
+
+	/**
+   * Number of evictions that wrote back a dirty page
+	 */
+  std::uint64_t dirtyEvictions;
+
+	/**
+   * Number of pages read ahead of readPage
+	 */
+  std::uint64_t prefetches;
+
+	/**
+   * Number of pages read whose checksum was verified
+	 */
+  std::uint64_t verified;
+
+	/**
+   * Number of pages read that did not match their checksum
+	 */
+  std::uint64_t checksumFailures;
+
+	/**
+   * Number of evictions that reused a frame of a shared scan's ring
+	 */
+  std::uint64_t ringReuses;
+
+	/**
+   * Latency of File::readPage calls made by the buffer manager
+	 */
+  LatencyHistogram readLatency;
+
+	/**
+   * Latency of File::writePage calls made by the buffer manager
+	 */
+  LatencyHistogram writeLatency;
+
+	/**
+   * Breakdown per file, in the order files were first seen
+	 */
+  std::vector<FileBufStats> files;
+
+	/**
+   * Breakdown per buffer pool partition
+	 */
+  std::vector<PartitionBufStats> partitions;
+
+	/**
+   * Clear all values
+	 */
+  void clear()
+  {
+		accesses = hits = misses = diskreads = diskwrites = evictions = dirtyEvictions = prefetches = 0;
+		verified = checksumFailures = ringReuses = 0;
+		readLatency.clear();
+		writeLatency.clear();
+		files.clear();
+		partitions.clear();
+  }
+
+	/**
+   * Constructor of BufStats class
+	 */
+  BufStats()
+  {
+		clear();
+  }
+};
+
+/**
+* @brief Collects the buffer manager's counters and I/O latencies
+*
+* Counters are kept per file and sharded by thread, each shard on its own
+* cache lines, so concurrent hits from different threads do not contend.
+* Files are told apart by File::streamId(), which every File object open on
+* the same file shares; a new slot is claimed the first time a file is seen,
+* up to MAX_FILES - 1 open files.  The slot of a file that has been closed is
+* given to the next new file, its counts moving to "<other>".  Every event is
+* also counted for the partition of the buffer pool it happened in.
+* snapshot() and clear() may be called from any thread at any time.
+*/
+class BufStatsCollector
+{
+ public:
+	/**
+   * Maximum number of files tracked individually, including "<other>"
+	 */
+  static const int MAX_FILES = 64;
+
+	/**
+   * Number of counter shards
+	 */
+  static const int NUM_SHARDS = 16;
+
+	/**
+   * Maximum number of buffer pool partitions
+	 */
+  static const int MAX_PARTITIONS = 16;
+
+	/**
+   * Constructor of BufStatsCollector class
+	 *
+	 * @param partitions  Number of buffer pool partitions, at most MAX_PARTITIONS
+	 */
+  BufStatsCollector(const int partitions = 1);
+
+	/**
+   * Count one event for file in the given partition
+	 */
+  void record(const File* file, const BufCounter counter, const int partition)
+  {
+		Shard& shard = shards[shardIndex()];
+		shard.files[fileSlot(file)].counters[counter].fetch_add(1, std::memory_order_relaxed);
+		shard.partitions[partition].counters[counter].fetch_add(1, std::memory_order_relaxed);
+  }
+
+	/**
+   * Record the latency of one File::readPage (write false) or File::writePage
+   * (write true) call
+	 */
+  void recordLatency(const bool write, const std::uint64_t nanos);
+
+	/**
+   * Sum all shards into a consistent-enough copy of the statistics.  The node
+   * and size of each partition are left for the buffer manager to fill in.
+	 */
+  BufStats snapshot();
+
+	/**
+   * Clear all values; files keep their slots
+	 */
+  void clear();
+
+ private:
+  struct FileCounters {
+    std::atomic<std::uint64_t> counters[NUM_BUF_COUNTERS];
+    char pad[64 - (NUM_BUF_COUNTERS * sizeof(std::uint64_t)) % 64];
+  };
+
+  struct Shard {
+    FileCounters files[MAX_FILES];
+    FileCounters partitions[MAX_PARTITIONS];
+  };
+
+  struct Histogram {
+    std::atomic<std::uint64_t> buckets[LatencyHistogram::NUM_BUCKETS];
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> totalNanos;
+  };
+
+	/**
+   * Shard of the calling thread
+	 */
+  static int shardIndex();
+
+	/**
+   * Slot of file, claiming a new one the first time it is seen
+	 */
+  int fileSlot(const File* file);
+
+	/**
+   * Claim a slot for the file of stream, taking that of a closed file if
+   * there is no free one
+	 */
+  int claimSlot(const File* file, const std::uint64_t stream);
+
+	/**
+   * Move the counts of the slot of a closed file to "<other>", with
+   * slotLatch held
+	 */
+  void retireSlot(const int slot);
+
+  Shard shards[NUM_SHARDS];
+  const int numPartitions;
+  /** streamId() of the file of each slot, 0 for a free slot */
+  std::atomic<std::uint64_t> slotStream[MAX_FILES];
+  /** name and handle of the file of each slot, guarded by slotLatch */
+  std::string slotName[MAX_FILES];
+  File::SyncHandle slotHandle[MAX_FILES];
+  std::atomic<int> slotsUsed;
+  /** File::streamsClosed() when every slot was last found open */
+  std::atomic<std::uint64_t> closedSeen;
+  std::mutex slotLatch;
+  Histogram latency[2];
+};
+
+}
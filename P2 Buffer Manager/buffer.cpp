@@ -8,39 +8,337 @@
 /**
  * Authors: Erzhen Zhang 9075858317, Yingjie Shen 9076384123, Xinping Liu 9078291599
  * Filename: buffer.cpp
- * Purpose: This file defines the functions of Buffer Manager. By using clock algorithm and other operations, we could allocate a buffer frame
+ * Purpose: This file defines the functions of Buffer Manager. By using the configured replacement policy and other operations, we
+ * could allocate a buffer frame
+ *
+ * Latch order: a frame latch, then a hash table stripe latch, then the replacer latch or the io latch. The replacer
+ * calls back into the buffer manager with its latch held, but only to try-lock frame latches. No thread ever holds
+ * two stripe latches at once. Write-back completions run on the I/O engine's thread and take no frame or stripe
+ * latch. The write-ahead log takes only latches of its own, and is called with a frame latch held at most.
  */
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <memory>
+#include <new>
+#include <vector>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "buffer.h"
+#include "trace.h"
+#include "exceptions/badgerdb_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/corrupt_page_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
-#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/read_only_file_exception.h"
 
 namespace badgerdb {
 
+    //alignment of the buffer pool arena, the virtual memory page size
+    static const std::size_t POOL_ALIGNMENT = 4096;
+
+    //memory policy of mbind(2) placing the pages on the node while it has memory
+    static const int MPOL_PREFERRED_NODE = 1;
+
+    //sizes of the huge pages the pool arena can be backed with
+    static const std::size_t HUGE_PAGE_2MB = 2UL << 20;
+    static const std::size_t HUGE_PAGE_1GB = 1UL << 30;
+
+    //mmap(2) flags selecting the huge page size, for older headers
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+    //first and largest read-ahead window, in pages; the window doubles each
+    //time the reader catches up with it
+    static const PageId READ_AHEAD_MIN = 4;
+    static const PageId READ_AHEAD_MAX = 32;
+
+    //most write-backs the background writer has in flight at once
+    static const std::uint32_t FLUSH_BATCH = 32;
+
+    //independently latched shards of the frame lists of the files
+    static const std::uint32_t FILE_FRAME_SHARDS = 64;
+
+    //first word of a hot set sidecar, "HOT1"
+    static const std::uint32_t HOT_SET_MAGIC = 0x31544f48;
+
+    //longest file name a hot set sidecar may hold
+    static const std::uint32_t HOT_SET_MAX_NAME = 4096;
+
+    //pause of the scrubber before it retries the frames that were pinned
+    static const std::chrono::milliseconds SCRUB_RETRY(100);
+
+    //longest a shared scan waits at a time for another to read a page it is
+    //about to evict
+    static const std::chrono::microseconds SCAN_WAIT(1000);
+
+    const std::uint32_t BufMgr::SCAN_RING_FRAMES;
+
+    /**
+    * @brief Progress of a shared scan, written by its own thread
+    */
+    struct SharedScanMember {
+        //next page to read, and number of pages still to read
+        std::atomic<PageId> following;
+        std::atomic<PageId> remaining;
+
+        //set by a scan that gave up waiting for this one, cleared when it moves
+        std::atomic<bool> stalled;
+    };
+
+    /**
+    * @brief Shared scans of one file: the page the latest of them moved to,
+    * the progress of each, and the ring of frames the pages they read from
+    * disk are placed in
+    */
+    struct SharedScanGroup {
+        //a page read into the ring, numBufs as a frame for none
+        struct Slot {
+            FrameId frame;
+            PageId pageNo;
+        };
+
+        const File *file;
+
+        //number of scans open, guarded by BufMgr::scanLatch
+        std::uint32_t scans;
+
+        //page the latest scan moved to
+        std::atomic<PageId> position;
+
+        //protects members, ring and next; never held while taking another latch
+        std::mutex latch;
+        std::vector<std::shared_ptr<SharedScanMember> > members;
+        std::vector<Slot> ring;
+        std::uint32_t next;
+    };
+
+    /**
+    * @param none
+    * @return nanoseconds on a monotonic clock
+    * @purpose time I/O calls for the latency histograms
+    */
+    static std::uint64_t nowNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+    * @param none
+    * @return NUMA nodes with memory in ascending order, node 0 alone if unknown
+    * @purpose find the nodes the buffer pool can be spread over
+    */
+    static const std::vector<int> &numaNodes() {
+        static const std::vector<int> nodes = [] {
+            std::vector<int> found;
+            //a list of ranges such as "0-1,3"
+            std::ifstream list("/sys/devices/system/node/has_memory");
+            std::string range;
+            while (std::getline(list, range, ',')) {
+                int first, last;
+                const int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+                if (fields < 1) {
+                    continue;
+                }
+                for (int node = first; node <= (fields == 2 ? last : first); node++) {
+                    found.push_back(node);
+                }
+            }
+            if (found.empty()) {
+                found.push_back(0);
+            }
+            return found;
+        }();
+        return nodes;
+    }
+
+    /**
+    * @param none
+    * @return NUMA node of the CPU the calling thread runs on, or -1
+    * @purpose place pages near the thread that reads them
+    */
+    static int currentNode() {
+        unsigned cpu, node;
+        if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+            return -1;
+        }
+        return node;
+    }
+
+    /**
+    * @param start address, length in bytes, NUMA node
+    * @return none
+    * @purpose ask the kernel to place the pages of a range, not yet touched, on a node
+    */
+    static void bindToNode(void *start, const std::size_t length, const int node) {
+        std::vector<unsigned long> mask(node / 64 + 1, 0);
+        mask[node / 64] |= 1UL << (node % 64);
+        //only a hint; without NUMA support the pages land wherever they are touched
+        syscall(SYS_mbind, start, length, MPOL_PREFERRED_NODE, mask.data(), mask.size() * 64 + 1, 0);
+    }
+
+    /**
+    * @param length in bytes, kind of pages wanted, length and kind of pages mapped
+    * @return start of a fresh, untouched mapping of at least length bytes
+    * @purpose map the buffer pool arena on the largest pages the system provides
+    */
+    static void *mapArena(const std::size_t length, const PoolPages pages,
+                          std::size_t &mapped, PoolPages &got) {
+        const int prot = PROT_READ | PROT_WRITE;
+        const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        //reserved huge pages; mmap fails unless enough of them are free
+        if (pages == POOL_HUGE_1GB || pages == POOL_HUGE_2MB) {
+            const bool gigantic = pages == POOL_HUGE_1GB;
+            const std::size_t size = gigantic ? HUGE_PAGE_1GB : HUGE_PAGE_2MB;
+            mapped = (length + size - 1) / size * size;
+            void *arena = mmap(NULL, mapped, prot, flags | MAP_HUGETLB | ((gigantic ? 30 : 21) << MAP_HUGE_SHIFT), -1, 0);
+            if (arena != MAP_FAILED) {
+                got = pages;
+                return arena;
+            }
+            return mapArena(length, gigantic ? POOL_HUGE_2MB : POOL_HUGE_TRANSPARENT, mapped, got);
+        }
+        mapped = (length + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT;
+        if (pages == POOL_SMALL || mapped < HUGE_PAGE_2MB) {
+            void *arena = mmap(NULL, mapped, prot, flags, -1, 0);
+            if (arena == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            got = POOL_SMALL;
+            return arena;
+        }
+        //transparent huge pages only back 2 MB aligned ranges, so map more
+        //and trim the unaligned ends
+        mapped = (length + HUGE_PAGE_2MB - 1) / HUGE_PAGE_2MB * HUGE_PAGE_2MB;
+        char *reserved = static_cast<char *>(mmap(NULL, mapped + HUGE_PAGE_2MB, prot, flags, -1, 0));
+        if (reserved == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        char *arena = reinterpret_cast<char *>(
+                (reinterpret_cast<std::uintptr_t>(reserved) + HUGE_PAGE_2MB - 1) & ~(HUGE_PAGE_2MB - 1));
+        if (arena != reserved) {
+            munmap(reserved, arena - reserved);
+        }
+        munmap(arena + mapped, reserved + HUGE_PAGE_2MB - arena);
+        //only a hint; the pool works on regular pages without it
+        got = madvise(arena, mapped, MADV_HUGEPAGE) == 0 ? POOL_HUGE_TRANSPARENT : POOL_SMALL;
+        return arena;
+    }
+
+    /**
+    * @param number of frames, requested number of partitions or 0
+    * @return number of partitions the pool is split into
+    * @purpose default to one partition per NUMA node, within the supported bounds
+    */
+    static int partitionsFor(const std::uint32_t bufs, const int requested) {
+        int count = requested > 0 ? requested : (int) numaNodes().size();
+        count = std::min(count, BufStatsCollector::MAX_PARTITIONS);
+        if ((std::uint32_t) count > bufs) {
+            count = bufs;
+        }
+        return count > 0 ? count : 1;
+    }
+
+    /**
+    * @param frames in use, frames reserved, first and number of frames reserved for a partition
+    * @return frames of the partition in use
+    * @purpose share the frames in use out over the partitions in proportion
+    *          to the frames reserved for them; the shares add up to bufs
+    */
+    static std::uint32_t shareOf(const std::uint32_t bufs, const std::uint32_t capacity,
+                                 const FrameId first, const std::uint32_t count) {
+        if (capacity == 0) {
+            return 0;
+        }
+        return static_cast<std::uint32_t>((std::uint64_t) bufs * (first + count) / capacity
+                                          - (std::uint64_t) bufs * first / capacity);
+    }
+
     /**
     * @param uint32_t
     * @return BufMgr 
     * @purpose Constructor of BufMgr class
     */
-    BufMgr::BufMgr(std::uint32_t bufs)
-            : numBufs(bufs) {
-        bufDescTable = new BufDesc[bufs];
+    BufMgr::BufMgr(std::uint32_t bufs, const ReplacementPolicy policy, const WriteMode mode,
+                   const double dirtyTarget, const int partitionCount, const BufPlacement placement,
+                   const PoolPages pages, WriteAheadLog *log, const std::uint32_t maxBufs)
+            : numBufs(std::max(bufs, maxBufs)), activeBufs(bufs), placement(placement),
+              bufStats(partitionsFor(std::max(bufs, maxBufs), partitionCount)),
+              writeMode(mode), log(log), asyncInFlight(0), asyncCompleted(0), writeError(0),
+              dirtyTarget(dirtyTarget), flusherOwner(0), flusherStop(false), evictPressure(false),
+              flushCursor(0), hotSetInterval(0), hotSetOwner(0), hotSetStop(false),
+              checksumMode(CHECKSUM_ON_MISS), scrubRequested(false), scrubberOwner(0), scrubberStop(false),
+              damagedCount(0) {
+        //descriptors apart from the frames, each on cache lines of its own
+        void *descs = NULL;
+        if (posix_memalign(&descs, alignof(BufDesc), sizeof(BufDesc) * (numBufs > 0 ? numBufs : 1)) != 0) {
+            throw std::bad_alloc();
+        }
+        bufDescTable = static_cast<BufDesc *>(descs);
+        for (FrameId i = 0; i < numBufs; i++) {
+            new(&bufDescTable[i]) BufDesc();
+        }
 
-        for (FrameId i = 0; i < bufs; i++) {
+        for (FrameId i = 0; i < numBufs; i++) {
             bufDescTable[i].frameNo = i;
             bufDescTable[i].valid = false;
+            bufDescTable[i].filePrev = numBufs;
+            bufDescTable[i].fileNext = numBufs;
         }
+        fileFrames.reset(new FileFrames[FILE_FRAME_SHARDS]);
+
+        //all frames in one contiguous arena, laid out exactly as on disk; mapped
+        //afresh so that no page of it is touched before it is bound to its node
+        bufPool = static_cast<Page *>(mapArena(sizeof(Page) * (numBufs > 0 ? numBufs : 1), pages,
+                                               arenaSize, arenaPages));
 
-        bufPool = new Page[bufs];
+        //equal ranges of frames, spread round robin over the nodes
+        const std::vector<int> &nodes = numaNodes();
+        const int count = partitionsFor(numBufs, partitionCount);
+        std::vector<BufPartition>(count).swap(partitions);
+        nodePartitions.resize(nodes.back() + 1);
+        for (int p = 0; p < count; p++) {
+            BufPartition &partition = partitions[p];
+            partition.firstFrame = (std::uint64_t) numBufs * p / count;
+            partition.numFrames = (std::uint64_t) numBufs * (p + 1) / count - partition.firstFrame;
+            partition.activeFrames = shareOf(bufs, numBufs, partition.firstFrame, partition.numFrames);
+            partition.node = nodes[p % nodes.size()];
+            if (nodes.size() > 1) {
+                bindToNode(&bufPool[partition.firstFrame], sizeof(Page) * partition.numFrames, partition.node);
+            }
+            nodePartitions[partition.node].push_back(p);
+
+            //the shard holds the pages hashing to it, about as many as the partition has
+            //frames in use; it grows along with the pool
+            partition.hashTable.reset(new BufHashTbl(partition.activeFrames));
+            partition.replacer.reset(BufReplacer::create(policy, partition.numFrames, partition.firstFrame));
+            if (partition.activeFrames < partition.numFrames) {
+                partition.replacer->retire(partition.firstFrame + partition.activeFrames,
+                                           partition.numFrames - partition.activeFrames);
+            }
 
-        int htsize = ((((int) (bufs * 1.2)) * 2) / 2) + 1;
-        hashTable = new BufHashTbl(htsize);  // set up a hash table for the buffer manager
+            for (FrameId i = partition.firstFrame; i < partition.firstFrame + partition.numFrames; i++) {
+                bufDescTable[i].partition = p;
+            }
+            for (FrameId i = partition.firstFrame; i < partition.firstFrame + partition.activeFrames; i++) {
+                new(&bufPool[i]) Page();  //first touch, on the node
+            }
+        }
 
-        clockHand = bufs - 1;
+        ioEngine = IoEngine::create();
     }
 
     /**
@@ -49,68 +347,196 @@ namespace badgerdb {
     * @purpose Clean out the dirty pages out of buffer pool
     */
     BufMgr::~BufMgr() {
-        delete[] bufPool;
-    }
+        {
+            std::lock_guard<std::mutex> guard(scrubLatch);
+            scrubberStop = true;
+        }
+        scrubWake.notify_all();
+        if (scrubber && scrubberOwner == getpid()) {
+            scrubber->join();
+            scrubber.reset();
+        }
+        scrubber.release();
 
-    /**
-    * @param none
-    * @return none 
-    * @purpose find the next frame in the buffer pool
-    */
-    void BufMgr::advanceClock() {
-        clockHand = (clockHand + 1) % numBufs;
+        {
+            std::lock_guard<std::mutex> guard(hotSetLatch);
+            hotSetStop = true;
+        }
+        hotSetWake.notify_all();
+        if (hotSetWriter && hotSetOwner == getpid()) {
+            hotSetWriter->join();
+            hotSetWriter.reset();
+        }
+        hotSetWriter.release();
+        //the last hot set, for the next buffer manager to warm up from
+        if (!hotSetPath.empty()) {
+            try {
+                saveHotSet(hotSetPath);
+            }
+            catch (...) {
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(flushLatch);
+            flusherStop = true;
+        }
+        flushWake.notify_all();
+        if (flusher && flusherOwner == getpid()) {
+            flusher->join();
+            flusher.reset();
+        }
+        //a flusher inherited through fork() does not exist in this process
+        flusher.release();
+        ioEngine->drain();
+
+        //nobody can report errors from here, so failed writes are dropped
+        for (FrameId i = 0; i < numBufs; i++) {
+            BufDesc &desc = bufDescTable[i];
+            if (desc.valid && desc.dirty && !desc.file->isClosed()) {
+                try {
+                    writeBack(i);
+                }
+                catch (...) {
+                }
+            }
+        }
+        for (const auto &unsynced : unsyncedFiles) {
+            try {
+                unsynced.second.sync();
+            }
+            catch (...) {
+            }
+        }
+
+        delete ioEngine;
+        munmap(bufPool, arenaSize);  //pages are trivially destructible
+        for (FrameId i = 0; i < numBufs; i++) {
+            bufDescTable[i].~BufDesc();
+        }
+        free(bufDescTable);
     }
 
     /**
     * @param FrameId
     * @return none 
-    * @purpose By using the clock algorithm, allocate a free frame
-    */
-    void BufMgr::allocBuf(FrameId &frame) {
-        bool found = false;
-        std::uint32_t pinnedCount = 0;
-        while (!found) {
-            advanceClock(); //point the clock to next frame
-            //if all pages are pinned, throw exception
-            if (pinnedCount >= numBufs) {
-                throw BufferExceededException();
-            }
-            //check if it is valid
-            if (bufDescTable[clockHand].valid) {
-                //check if the refbit was recently referenced
-                if (bufDescTable[clockHand].refbit) {
-                    //reset
-                    bufDescTable[clockHand].refbit = false;
-                    continue;
-                } else {
-                    //check if the page is pinned
-                    if (bufDescTable[clockHand].pinCnt > 0) {
-                        pinnedCount++;
-                        continue;
-                     //if not pinned
-                    } else {
-                        //remove content from hasg table
-                        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-                        //check th dirty bit
-                        if (bufDescTable[clockHand].dirty) {
-                            bufDescTable[clockHand].file->writePage(bufPool[clockHand]);
-                            bufDescTable[clockHand].Clear();
-                            found = true;
-                        } else {
-                            //set page
-                            bufDescTable[clockHand].Clear();
-                            //exit loop
-                            found = true;
-                        }
-                        frame = bufDescTable[clockHand].frameNo; //set frame
+    * @purpose Ask the replacement policy for a victim and evict it
+    */
+    void BufMgr::allocBuf(FrameId &frame, const File *file, const PageId pageNo) {
+        const std::uint32_t home = homePartition(file, pageNo);
+        //claim only unpinned frames that no other thread is filling or evicting
+        BufReplacer::ClaimFn tryClaim = [this](FrameId f) {
+            BufDesc &desc = bufDescTable[f];
+            if (!desc.latch.try_lock()) {
+                return false;
+            }
+            if ((desc.valid && desc.pinCnt > 0) || desc.writing || desc.reading) {
+                desc.latch.unlock();
+                return false;
+            }
+            return true;
+        };
+        for (;;) {
+            std::uint64_t completed;
+            {
+                std::lock_guard<std::mutex> guard(asyncLatch);
+                completed = asyncCompleted;
+            }
+            //the home partition first, then the others in turn
+            bool found = false;
+            for (std::uint32_t n = 0; n < partitions.size() && !found; n++) {
+                found = partitions[(home + n) % partitions.size()].replacer->pickVictim(frame, tryClaim);
+            }
+            if (!found) {
+                //every candidate is pinned, being written back or being prefetched
+                ioEngine->submit();
+                std::unique_lock<std::mutex> lock(asyncLatch);
+                while (asyncCompleted == completed && asyncInFlight > 0) {
+                    asyncDone.wait(lock);
+                }
+                if (writeError != 0) {
+                    const int error = writeError;
+                    writeError = 0;
+                    throw FileIOException(writeErrorFile, "write back", error);
+                }
+                //if all pages are pinned, throw exception
+                if (asyncCompleted == completed) {
+                    throw BufferExceededException();
+                }
+                continue;
+            }
+            BufDesc &desc = bufDescTable[frame];
+            if (!desc.valid) {
+                desc.Clear();
+                ioEngine->submit();
+                return;
+            }
+            //the pool is full; keep the background writer ahead of evictions
+            if (!evictPressure.exchange(true)) {
+                wakeFlusher();
+            }
+            //check th dirty bit, write back while the page can still be found
+            const bool wasDirty = desc.dirty.exchange(false);
+            if (wasDirty && writeMode == WRITE_BUFFERED) {
+                //clean it in the background and look for another victim
+                bufStats.record(desc.file, STAT_DIRTY_EVICTIONS, desc.partition);
+                startWriteBack(frame);
+                desc.latch.unlock();
+                continue;
+            }
+            if (wasDirty) {
+                try {
+                    writeBack(frame);
+                    syncFile(desc.file);
+                }
+                catch (...) {
+                    desc.dirty = true;
+                    replacerOf(frame).recordInsert(frame, desc.file, desc.pageNo);
+                    desc.latch.unlock();
+                    ioEngine->submit();
+                    throw;
+                }
+            }
+            {
+                //no new pins can be taken while we hold the stripe latch
+                BufHashTbl &table = tableOf(desc.file, desc.pageNo);
+                std::lock_guard<std::mutex> stripe(table.latch(desc.file, desc.pageNo));
+                if (desc.pinCnt == 0 && !desc.dirty) {
+                    //remove content from hash table
+                    table.remove(desc.file, desc.pageNo);
+                    bufStats.record(desc.file, STAT_EVICTIONS, desc.partition);
+                    BADGERDB_TRACE(TRACE_BUF_EVICT, desc.file, desc.pageNo);
+                    if (wasDirty) {
+                        bufStats.record(desc.file, STAT_DIRTY_EVICTIONS, desc.partition);
                     }
+                    releaseFrame(frame);
+                    ioEngine->submit();
+                    return;
                 }
-            } else {
-                bufDescTable[clockHand].Clear();
-                frame = bufDescTable[clockHand].frameNo; 
-                found = true;
             }
+            //pinned or dirtied again during the write back, keep it resident
+            replacerOf(frame).recordInsert(frame, desc.file, desc.pageNo);
+            desc.latch.unlock();
+        }
+    }
+
+    /**
+    * @param File pointer, constant PageId
+    * @return partition to place the page in
+    * @purpose choose the home partition of a page by the configured placement
+    */
+    std::uint32_t BufMgr::homePartition(const File *file, const PageId pageNo) const {
+        const std::uint32_t shard = shardOf(file, pageNo);
+        if (placement == PLACE_HASHED || numaNodes().size() == 1) {
+            return shard;
         }
+        const int node = currentNode();
+        if (node < 0 || (std::size_t) node >= nodePartitions.size() || nodePartitions[node].empty()) {
+            return shard;
+        }
+        //spread the pages over the partitions of the node
+        const std::vector<std::uint32_t> &local = nodePartitions[node];
+        return local[shard % local.size()];
     }
 
     /**
@@ -119,113 +545,1933 @@ namespace badgerdb {
     * @purpose Read a page from disk and set it into buffer pool 
     */
     void BufMgr::readPage(File *file, const PageId pageNo, Page *&page) {
-        //check if the page is already in the buffer pool
-        FrameId index;
-        try {
-            //page is in the pool
-            hashTable->lookup(file, pageNo, index);
-            //set refbit
-            bufDescTable[index].refbit = true;
-            bufDescTable[index].pinCnt++; //increment pin count
-            page = &bufPool[index]; 
-        }
-        catch (HashNotFoundException e) {
-            allocBuf(index); //allocate buffer frame 
-            bufPool[index] = file->readPage(pageNo); //read page
-            hashTable->insert(file, pageNo, index); //insert page into hash table
-            bufDescTable[index].Set(file, pageNo);
-            page = &bufPool[index];
+        if (file->isMapped()) {
+            readMapped(file, pageNo, page);
+            return;
         }
+        readFrame(file, pageNo, page, NULL);
     }
 
     /**
-    * @param File pointer, constant PageId, constant bool 
-    * @return none 
-    * @purpose decrement pinCnt and set dirty bit
+    * @param File pointer, constant PageId, Page reference, shared scan or NULL
+    * @return none
+    * @purpose pin a page of a file not mapped, reading it from disk on a miss
     */
-    void BufMgr::unPinPage(File *file, const PageId pageNo, const bool dirty) {
-        try {
+    void BufMgr::readFrame(File *file, const PageId pageNo, Page *&page, SharedScan *scan) {
+        SharedScanGroup *group = scan == NULL ? NULL : scan->group.get();
+        const bool reference = group == NULL;
+        BufHashTbl &table = tableOf(file, pageNo);
+        std::mutex &stripe = table.latch(file, pageNo);
+        for (;;) {
+            //check if the page is already in the buffer pool
             FrameId index;
-            //find the file and page number
-            hashTable->lookup(file, pageNo, index);
-            if (bufDescTable[index].pinCnt == 0) {
-                throw PageNotPinnedException("PinCnt already 0", pageNo, index);
+            {
+                std::lock_guard<std::mutex> guard(stripe);
+                if (table.tryLookup(file, pageNo, index)) {
+                    //page is in the pool
+                    bufDescTable[index].pinCnt++; //increment pin count
+                    //set refbit
+                    bufDescTable[index].refbit = true;
+                } else {
+                    index = numBufs;
+                }
             }
-            bufDescTable[index].pinCnt--;
-            if (dirty) {
-                bufDescTable[index].dirty = true;
+            if (index < numBufs && usePinned(index, file, pageNo, page, reference)) {
+                return;
+            }
+
+            //allocate buffer frame, latched
+            std::uint32_t slot = 0;
+            if (group == NULL || !reuseRingFrame(index, *scan, slot)) {
+                allocBuf(index, file, pageNo);
+            }
+            BufDesc &desc = bufDescTable[index];
+            try {
+                //read straight into the frame; positioned reads need no io latch
+                const std::uint64_t start = nowNanos();
+                file->readPageInto(pageNo, bufPool[index]);
+                bufStats.recordLatency(false, nowNanos() - start);
+                if (!checkRead(index, file, pageNo)) {
+                    bufStats.record(file, STAT_CHECKSUM_FAILURES, desc.partition);
+                    throw CorruptPageException(pageNo, file->filename());
+                }
+            }
+            catch (...) {
+                replacerOf(index).recordRemove(index);
+                desc.latch.unlock();
+                throw;
+            }
+            FrameId other;
+            {
+                std::lock_guard<std::mutex> guard(stripe);
+                if (table.tryLookup(file, pageNo, other)) {
+                    //another thread read the same page meanwhile, use its frame
+                    bufDescTable[other].pinCnt++;
+                    bufDescTable[other].refbit = true;
+                } else {
+                    other = numBufs;
+                    table.insert(file, pageNo, index); //insert page into hash table
+                    assignFrame(index, file, pageNo);
+                }
+            }
+            if (other < numBufs) {
+                replacerOf(index).recordRemove(index);
+                desc.latch.unlock();
+                if (usePinned(other, file, pageNo, page, reference)) {
+                    return;
+                }
+                continue;
+            }
+            bufStats.record(file, STAT_MISSES, desc.partition);
+            BADGERDB_TRACE(TRACE_BUF_MISS, file, pageNo);
+            replacerOf(index).recordInsert(index, file, pageNo);
+            if (group != NULL) {
+                std::lock_guard<std::mutex> guard(group->latch);
+                group->ring[slot].frame = index;
+                group->ring[slot].pageNo = pageNo;
             }
+            desc.latch.unlock();
+            page = &bufPool[index];
+            //read-ahead would place the pages of a shared scan outside its ring
+            if (group == NULL) {
+                noteRead(file, pageNo);
+            }
+            return;
         }
-        catch (HashNotFoundException e) {} //catch exception if the look up failed
     }
 
     /**
-    * @param File pointer
-    * @return none 
-    * @purpose remove all pages from the file 
+    * @param FrameId reference, shared scan, slot reference
+    * @return true if the frame of the oldest page of the ring was reused
+    * @purpose evict the oldest page of the ring of shared scans to read their next page into its frame
     */
-    void BufMgr::flushFile(const File *file) {
-        for (unsigned int i = 0; i < numBufs; ++i) {
-            //check if the page is valid
-            if (bufDescTable[i].file == file && bufDescTable[i].valid == true) {
-                if (bufDescTable[i].pinCnt > 0) {
-                    throw PagePinnedException("Pinned page", bufDescTable[i].pageNo, bufDescTable[i].frameNo);
+    bool BufMgr::reuseRingFrame(FrameId &frame, SharedScan &scan, std::uint32_t &slot) {
+        SharedScanGroup &group = *scan.group;
+        SharedScanGroup::Slot oldest;
+        {
+            std::lock_guard<std::mutex> guard(group.latch);
+            slot = group.next;
+            group.next = (group.next + 1) % group.ring.size();
+            oldest = group.ring[slot];
+            //the slot goes to the page about to be read
+            group.ring[slot].frame = numBufs;
+        }
+        if (oldest.frame >= numBufs) {
+            return false;
+        }
+        waitForScansBehind(scan, oldest.pageNo);
+        //only the page the ring placed there, unpinned, clean and without I/O
+        BufReplacer::ClaimFn tryClaim = [this, &group, &oldest](FrameId f) {
+            BufDesc &desc = bufDescTable[f];
+            if (!desc.latch.try_lock()) {
+                return false;
+            }
+            if (!desc.valid || desc.file != group.file || desc.pageNo != oldest.pageNo
+                || desc.pinCnt > 0 || desc.dirty || desc.writing || desc.reading) {
+                desc.latch.unlock();
+                return false;
+            }
+            return true;
+        };
+        if (!replacerOf(oldest.frame).claim(oldest.frame, tryClaim)) {
+            //in use, or gone; the pool keeps it
+            return false;
+        }
+        BufDesc &desc = bufDescTable[oldest.frame];
+        {
+            //no new pins can be taken while we hold the stripe latch
+            BufHashTbl &table = tableOf(desc.file, desc.pageNo);
+            std::lock_guard<std::mutex> stripe(table.latch(desc.file, desc.pageNo));
+            if (desc.pinCnt == 0 && !desc.dirty) {
+                table.remove(desc.file, desc.pageNo);
+                bufStats.record(desc.file, STAT_EVICTIONS, desc.partition);
+                bufStats.record(desc.file, STAT_RING_REUSES, desc.partition);
+                BADGERDB_TRACE(TRACE_BUF_EVICT, desc.file, desc.pageNo);
+                releaseFrame(oldest.frame);
+                frame = oldest.frame;
+                return true;
+            }
+        }
+        //pinned or dirtied since the claim, keep it resident
+        replacerOf(oldest.frame).recordRequeue(oldest.frame);
+        desc.latch.unlock();
+        return false;
+    }
+
+    /**
+    * @param shared scan, PageId
+    * @return none
+    * @purpose hold a shared scan back while the others of its file are about to read a page it would evict
+    */
+    void BufMgr::waitForScansBehind(SharedScan &scan, const PageId pageNo) {
+        SharedScanGroup &group = *scan.group;
+        //pages are read in a cycle from the first page to the last
+        const PageId span = scan.limit - 1;
+        const PageId window = static_cast<PageId>(group.ring.size());
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + SCAN_WAIT;
+        for (;;) {
+            std::shared_ptr<SharedScanMember> behind;
+            PageId seen = 0;
+            {
+                std::lock_guard<std::mutex> guard(group.latch);
+                for (const std::shared_ptr<SharedScanMember> &other : group.members) {
+                    if (other == scan.member || other->stalled) {
+                        continue;
+                    }
+                    const PageId following = other->following;
+                    const PageId distance = (pageNo + span - following) % span;
+                    if (following < scan.limit && distance < window && distance < other->remaining) {
+                        behind = other;
+                        seen = following;
+                        break;
+                    }
                 }
-                //check the dirty bit
-                if (bufDescTable[i].dirty) {
-                    //flush page to dick
-                    bufDescTable[i].file->writePage(bufPool[bufDescTable[i].frameNo]);
-                    //reset dirty bit
-                    bufDescTable[i].dirty = false;
-                }
-                //remove page from hashtable
-                hashTable->remove(file, bufDescTable[i].pageNo);
-                bufDescTable[i].Clear();
+            }
+            if (!behind) {
+                return;
+            }
+            while (behind->following == seen && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+            if (behind->following == seen) {
+                //not moving; go on without it until it does
+                behind->stalled = true;
+            }
+        }
+    }
+
+    /**
+    * @param File pointer
+    * @return shared scan of the file
+    * @purpose open a scan of the file that joins those in progress at their position
+    */
+    SharedScan BufMgr::openSharedScan(File *file) {
+        const PageId limit = file->pageLimit();
+        std::shared_ptr<SharedScanGroup> group;
+        const std::shared_ptr<SharedScanMember> member = std::make_shared<SharedScanMember>();
+        member->stalled = false;
+        PageId start = 1;
+        {
+            std::lock_guard<std::mutex> guard(scanLatch);
+            std::shared_ptr<SharedScanGroup> &found = scanGroups[file];
+            if (!found) {
+                found = std::make_shared<SharedScanGroup>();
+                found->file = file;
+                found->scans = 0;
+                found->position = 1;
+                const std::uint32_t frames = std::max<std::uint32_t>(1, activeBufs / 8);
+                const SharedScanGroup::Slot none = {numBufs, Page::INVALID_NUMBER};
+                found->ring.assign(std::min(frames, SCAN_RING_FRAMES), none);
+                found->next = 0;
             } else {
-                throw BadBufferException(bufDescTable[i].frameNo, bufDescTable[i].dirty, bufDescTable[i].valid,
-                                         bufDescTable[i].refbit);  
+                start = found->position;
             }
+            found->scans++;
+            group = found;
+        }
+        if (start >= limit) {
+            start = 1;
         }
+        member->following = start;
+        member->remaining = limit > 1 ? limit - 1 : 0;
+        {
+            std::lock_guard<std::mutex> guard(group->latch);
+            group->members.push_back(member);
+        }
+        file->adviseSequential();
+        return SharedScan(this, file, group, member, start, limit);
     }
 
     /**
-    * @param File pointer, PageId, Page reference
-    * @return none 
-    * @purpose allocate an empty page and return both page number and a pointer to the buffer frame
+    * @param File pointer, shared scans, progress of the scan
+    * @return none
+    * @purpose count a shared scan out of the scans of its file
     */
-    void BufMgr::allocPage(File *file, PageId &pageNo, Page *&page) {
-        //allocate a new page
-        Page newPage = file->allocatePage();
-        FrameId index;
-        allocBuf(index); // obtain a buffer pool frame
-        bufPool[index] = newPage;
-        //insert entry into hash table
-        hashTable->insert(file, newPage.page_number(), index);
-        bufDescTable[index].Set(file, newPage.page_number());
-        //return both page number and a pointer to the buffer frame
-        pageNo = newPage.page_number(); 
+    void BufMgr::leaveSharedScan(const File *file, const std::shared_ptr<SharedScanGroup> &group,
+                                 const std::shared_ptr<SharedScanMember> &member) {
+        {
+            std::lock_guard<std::mutex> guard(group->latch);
+            group->members.erase(std::find(group->members.begin(), group->members.end(), member));
+        }
+        std::lock_guard<std::mutex> guard(scanLatch);
+        if (--group->scans == 0) {
+            scanGroups.erase(file);
+        }
+    }
+
+    SharedScan::SharedScan(BufMgr *bufMgr, File *file, const std::shared_ptr<SharedScanGroup> &group,
+                           const std::shared_ptr<SharedScanMember> &member, const PageId start,
+                           const PageId limit)
+            : bufMgr(bufMgr), file(file), group(group), member(member), start(start), limit(limit),
+              current(Page::INVALID_NUMBER) {}
+
+    SharedScan::SharedScan(SharedScan &&other)
+            : bufMgr(other.bufMgr), file(other.file), group(std::move(other.group)),
+              member(std::move(other.member)), start(other.start), limit(other.limit),
+              current(other.current) {
+        other.group.reset();
+        other.member.reset();
+        other.current = Page::INVALID_NUMBER;
+    }
+
+    SharedScan::~SharedScan() {
+        //nothing to report a failure to
+        try {
+            close();
+        }
+        catch (...) {
+        }
+    }
+
+    /**
+    * @param Page reference
+    * @return false once every page has been returned
+    * @purpose move a shared scan to its next used page
+    */
+    bool SharedScan::next(Page *&page) {
+        if (current != Page::INVALID_NUMBER) {
+            const PageId left = current;
+            current = Page::INVALID_NUMBER;
+            bufMgr->unPinPage(file, left, false);
+        }
+        while (group && member->remaining > 0) {
+            const PageId pageNo = member->following;
+            bool used = true;
+            try {
+                if (file->isMapped()) {
+                    bufMgr->readMapped(file, pageNo, page);
+                } else {
+                    bufMgr->readFrame(file, pageNo, page, this);
+                }
+            }
+            catch (InvalidPageException &) {
+                used = false;
+            }
+            //moved on only once the page is read, for the scans that wait for it
+            member->remaining--;
+            member->following = pageNo + 1 < limit ? pageNo + 1 : 1;
+            member->stalled = false;
+            if (!used) {
+                continue;
+            }
+            current = pageNo;
+            group->position.store(pageNo, std::memory_order_relaxed);
+            return true;
+        }
+        close();
+        return false;
+    }
+
+    /**
+    * @param none
+    * @return none
+    * @purpose unpin the page of a shared scan and leave the scans of its file
+    */
+    void SharedScan::close() {
+        if (!group) {
+            return;
+        }
+        const std::shared_ptr<SharedScanGroup> leaving = std::move(group);
+        const std::shared_ptr<SharedScanMember> left = std::move(member);
+        group.reset();
+        member.reset();
+        bufMgr->leaveSharedScan(file, leaving, left);
+        if (current != Page::INVALID_NUMBER) {
+            const PageId left = current;
+            current = Page::INVALID_NUMBER;
+            bufMgr->unPinPage(file, left, false);
+        }
+    }
+
+    /**
+    * @param FrameId, File pointer, constant PageId, Page reference, whether the hit is a reference
+    * @return true if the pinned frame holds the page, false if it was dropped
+    * @purpose finish a hit on a frame pinned by readPage
+    */
+    bool BufMgr::usePinned(FrameId index, File *file, const PageId pageNo, Page *&page, const bool reference) {
+        BufDesc &desc = bufDescTable[index];
+        //a prefetch may still be filling the frame
+        if (desc.reading) {
+            std::unique_lock<std::mutex> lock(asyncLatch);
+            while (desc.reading) {
+                asyncDone.wait(lock);
+            }
+        }
+        if (desc.readFailed) {
+            dropFailedPrefetch(index, file, pageNo);
+            return false;
+        }
+        bufStats.record(file, STAT_HITS, desc.partition);
+        BADGERDB_TRACE(TRACE_BUF_HIT, file, pageNo);
+        if (reference) {
+            replacerOf(index).recordAccess(index);
+        }
         page = &bufPool[index];
+        //the reader caught up with the read-ahead
+        if (desc.prefetched.exchange(false)) {
+            noteRead(file, pageNo);
+        }
+        return true;
     }
 
     /**
-    * @param File pointer, constant PageId
-    * @return none 
-    * @purpose delete a page from file 
+    * @param File pointer, PageId array, number of pages, Page pointer array
+    * @return none
+    * @purpose read and pin several pages, batching lookups and disk reads
     */
-    void BufMgr::disposePage(File *file, const PageId PageNo) {
-        FrameId index;
-        //delete a page from file 
+    void BufMgr::readPages(File *file, const PageId *pageNos, const std::size_t count, Page **pages) {
+        if (file->isMapped()) {
+            //no I/O to batch, the pages are used in place
+            std::size_t i = 0;
+            try {
+                for (; i < count; i++) {
+                    readMapped(file, pageNos[i], pages[i]);
+                }
+            }
+            catch (...) {
+                for (; i > 0; i--) {
+                    unPinMapped(file, pageNos[i - 1], false);
+                }
+                throw;
+            }
+            return;
+        }
+        std::vector<std::size_t> order;
+        std::vector<std::mutex *> stripes;
+        groupByStripe(file, pageNos, count, order, stripes);
+        //pin every page already in the pool
+        std::vector<FrameId> hits(count, numBufs);
+        for (std::size_t k = 0; k < count;) {
+            std::mutex *stripe = stripes[order[k]];
+            std::lock_guard<std::mutex> guard(*stripe);
+            for (; k < count && stripes[order[k]] == stripe; k++) {
+                const std::size_t i = order[k];
+                FrameId index;
+                if (tableOf(file, pageNos[i]).tryLookup(file, pageNos[i], index)) {
+                    bufDescTable[index].pinCnt++;
+                    bufDescTable[index].refbit = true;
+                    hits[i] = index;
+                }
+            }
+        }
+        std::vector<char> pinned(count, 0);
+        std::vector<std::size_t> missing;
+        for (std::size_t i = 0; i < count; i++) {
+            if (hits[i] < numBufs && usePinned(hits[i], file, pageNos[i], pages[i])) {
+                pinned[i] = 1;
+            } else {
+                missing.push_back(i);
+            }
+        }
+        if (missing.empty()) {
+            return;
+        }
         try {
-            //check if the page is allocated to a frame in the buffer pool
-            hashTable->lookup(file, PageNo, index);
-            bufDescTable[index].Clear();
-            hashTable->remove(file, PageNo);
-        } catch (HashNotFoundException e) {
-
+            readMissing(file, pageNos, missing, pages, pinned);
         }
+        catch (...) {
+            for (std::size_t i = 0; i < count; i++) {
+                if (pinned[i]) {
+                    unPinPage(file, pageNos[i], false);
+                }
+            }
+            throw;
+        }
+    }
+
+    /**
+    * @param File pointer, PageId array, indexes of the missing pages, Page pointer array, pinned flags
+    * @return none
+    * @purpose read the misses of readPages in batches as large as the free frames allow
+    */
+    void BufMgr::readMissing(File *file, const PageId *pageNos, const std::vector<std::size_t> &missing,
+                             Page **pages, std::vector<char> &pinned) {
+        std::size_t next = 0;
+        while (next < missing.size()) {
+            //claim a frame for as many misses as possible
+            std::vector<std::size_t> batch;
+            std::vector<FrameId> frames;
+            for (; next < missing.size(); next++) {
+                FrameId index;
+                try {
+                    allocBuf(index, file, pageNos[missing[next]]); //latched
+                }
+                catch (BufferExceededException &) {
+                    if (batch.empty()) {
+                        throw;
+                    }
+                    //read what fits; the next round throws if the
+                    //remaining pages still find no frame
+                    break;
+                }
+                catch (...) {
+                    for (FrameId f : frames) {
+                        replacerOf(f).recordRemove(f);
+                        bufDescTable[f].latch.unlock();
+                    }
+                    throw;
+                }
+                batch.push_back(missing[next]);
+                frames.push_back(index);
+            }
+
+            //one submission for the whole batch
+            std::vector<int> errors(batch.size(), 0);
+            std::size_t pending = batch.size();
+            const std::uint64_t start = nowNanos();
+            for (std::size_t j = 0; j < batch.size(); j++) {
+                file->readPageAsync(*ioEngine, pageNos[batch[j]], bufPool[frames[j]],
+                                    [this, j, start, &errors, &pending](const int error) {
+                    if (error == 0) {
+                        bufStats.recordLatency(false, nowNanos() - start);
+                    }
+                    {
+                        std::lock_guard<std::mutex> guard(asyncLatch);
+                        errors[j] = error;
+                        pending--;
+                    }
+                    asyncDone.notify_all();
+                });
+            }
+            ioEngine->submit();
+            {
+                std::unique_lock<std::mutex> lock(asyncLatch);
+                while (pending > 0) {
+                    asyncDone.wait(lock);
+                }
+            }
+
+            //publish the pages read, as readPage does
+            std::vector<std::size_t> retry;
+            for (std::size_t j = 0; j < batch.size(); j++) {
+                const std::size_t i = batch[j];
+                const PageId pageNo = pageNos[i];
+                BufDesc &desc = bufDescTable[frames[j]];
+                //a damaged page is read again alone, which throws
+                if (errors[j] == 0 && !checkRead(frames[j], file, pageNo)) {
+                    errors[j] = EBADMSG;
+                }
+                if (errors[j] != 0) {
+                    replacerOf(frames[j]).recordRemove(frames[j]);
+                    desc.latch.unlock();
+                    retry.push_back(i);
+                    continue;
+                }
+                FrameId other;
+                {
+                    BufHashTbl &table = tableOf(file, pageNo);
+                    std::lock_guard<std::mutex> guard(table.latch(file, pageNo));
+                    if (table.tryLookup(file, pageNo, other)) {
+                        //read meanwhile, or earlier in this batch
+                        bufDescTable[other].pinCnt++;
+                        bufDescTable[other].refbit = true;
+                    } else {
+                        other = numBufs;
+                        table.insert(file, pageNo, frames[j]);
+                        assignFrame(frames[j], file, pageNo);
+                    }
+                }
+                if (other < numBufs) {
+                    replacerOf(frames[j]).recordRemove(frames[j]);
+                    desc.latch.unlock();
+                    if (usePinned(other, file, pageNo, pages[i])) {
+                        pinned[i] = 1;
+                    } else {
+                        retry.push_back(i);
+                    }
+                    continue;
+                }
+                bufStats.record(file, STAT_MISSES, desc.partition);
+                BADGERDB_TRACE(TRACE_BUF_MISS, file, pageNo);
+                replacerOf(frames[j]).recordInsert(frames[j], file, pageNo);
+                desc.latch.unlock();
+                pages[i] = &bufPool[frames[j]];
+                pinned[i] = 1;
+            }
+            //throws the exception a single read would have
+            for (std::size_t i : retry) {
+                readPage(file, pageNos[i], pages[i]);
+                pinned[i] = 1;
+            }
+        }
+    }
+
+    /**
+    * @param File pointer, PageId array, number of pages, constant bool
+    * @return none
+    * @purpose unpin several pages, latching each hash table stripe once
+    */
+    void BufMgr::unPinPages(File *file, const PageId *pageNos, const std::size_t count, const bool dirty) {
+        if (file->isMapped()) {
+            if (dirty) {
+                throw ReadOnlyFileException(file->filename(), "dirty a page of");
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                unPinMapped(file, pageNos[i], false);
+            }
+            return;
+        }
+        std::vector<std::size_t> order;
+        std::vector<std::mutex *> stripes;
+        groupByStripe(file, pageNos, count, order, stripes);
+        bool unpinned = true;
+        PageId failedPage = Page::INVALID_NUMBER;
+        FrameId failedFrame = 0;
+        std::vector<std::pair<PageId, std::size_t> > freeSpace;
+        for (std::size_t k = 0; k < count;) {
+            std::mutex *stripe = stripes[order[k]];
+            std::lock_guard<std::mutex> guard(*stripe);
+            for (; k < count && stripes[order[k]] == stripe; k++) {
+                const PageId pageNo = pageNos[order[k]];
+                FrameId index;
+                if (!tableOf(file, pageNo).tryLookup(file, pageNo, index)) {
+                    continue;
+                }
+                if (bufDescTable[index].pinCnt == 0) {
+                    if (unpinned) {
+                        unpinned = false;
+                        failedPage = pageNo;
+                        failedFrame = index;
+                    }
+                    continue;
+                }
+                if (dirty) {
+                    bufDescTable[index].dirty = true;
+                    bufDescTable[index].unverified = false;
+                    freeSpace.push_back(std::make_pair(pageNo, bufPool[index].getFreeSpace()));
+                }
+                bufDescTable[index].pinCnt--;
+            }
+        }
+        for (std::size_t k = 0; k < freeSpace.size(); k++) {
+            file->recordFreeSpace(freeSpace[k].first, freeSpace[k].second);
+        }
+        if (!unpinned) {
+            throw PageNotPinnedException("PinCnt already 0", failedPage, failedFrame);
+        }
+    }
+
+    /**
+    * @param File pointer, PageId array, number of pages, order and stripe vectors
+    * @return none
+    * @purpose group a batch of pages by hash table stripe
+    */
+    void BufMgr::groupByStripe(const File *file, const PageId *pageNos, const std::size_t count,
+                               std::vector<std::size_t> &order, std::vector<std::mutex *> &stripes) {
+        stripes.resize(count);
+        for (std::size_t i = 0; i < count; i++) {
+            stripes[i] = &tableOf(file, pageNos[i]).latch(file, pageNos[i]);
+        }
+        order.resize(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&stripes](std::size_t a, std::size_t b) {
+            return std::less<std::mutex *>()(stripes[a], stripes[b]);
+        });
+    }
+
+    /**
+    * @param File pointer, constant PageId, constant bool 
+    * @return none 
+    * @purpose decrement pinCnt and set dirty bit
+    */
+    void BufMgr::unPinPage(File *file, const PageId pageNo, const bool dirty) {
+        if (file->isMapped()) {
+            unPinMapped(file, pageNo, dirty);
+            return;
+        }
+        std::size_t freeSpace = 0;
+        {
+            BufHashTbl &table = tableOf(file, pageNo);
+            std::lock_guard<std::mutex> guard(table.latch(file, pageNo));
+            FrameId index;
+            //find the file and page number, nothing to do if it is not in the pool
+            if (!table.tryLookup(file, pageNo, index)) {
+                return;
+            }
+            if (bufDescTable[index].pinCnt == 0) {
+                throw PageNotPinnedException("PinCnt already 0", pageNo, index);
+            }
+            if (!dirty) {
+                bufDescTable[index].pinCnt--;
+                return;
+            }
+            //mark dirty before the pin is dropped, so an evictor sees it
+            bufDescTable[index].dirty = true;
+            //the checksum read with the page is stale now
+            bufDescTable[index].unverified = false;
+            //read while pinned, the frame may hold another page once unpinned
+            freeSpace = bufPool[index].getFreeSpace();
+            bufDescTable[index].pinCnt--;
+        }
+        //keep the file's free space map current before the page is written back
+        file->recordFreeSpace(pageNo, freeSpace);
+    }
+
+    /**
+    * @param File pointer, PageId, offset and length of the change
+    * @return LSN of the log record
+    * @purpose log a change to a pinned page and mark it dirty
+    */
+    Lsn BufMgr::logUpdate(File *file, const PageId pageNo, const std::size_t offset, const std::size_t length) {
+        if (file->isMapped()) {
+            throw ReadOnlyFileException(file->filename(), "log a change to");
+        }
+        FrameId index = numBufs;
+        {
+            BufHashTbl &table = tableOf(file, pageNo);
+            std::lock_guard<std::mutex> guard(table.latch(file, pageNo));
+            if (!table.tryLookup(file, pageNo, index) || bufDescTable[index].pinCnt == 0) {
+                throw PageNotPinnedException("Page not pinned", pageNo, index);
+            }
+        }
+        //the caller's pin keeps the frame assigned to the page
+        BufDesc &desc = bufDescTable[index];
+        std::lock_guard<std::mutex> frame(desc.latch);
+        //the page LSN and recLsn must not change under a write back in flight
+        waitForIo(index);
+        Lsn lsn = 0;
+        if (log != NULL) {
+            //a bound below the LSN of the record, in place before the record is,
+            //so that a checkpoint never starts redo past it
+            if (desc.recLsn == 0) {
+                desc.recLsn = log->endLsn();
+            }
+            lsn = log->append(file->filename(), pageNo, offset,
+                              reinterpret_cast<const char *>(&bufPool[index]) + offset, length);
+            bufPool[index].set_lsn(lsn);
+        }
+        desc.dirty = true;
+        desc.unverified = false;
+        return lsn;
+    }
+
+    /**
+    * @param File pointer
+    * @return shard of the frame lists
+    * @purpose find the shard holding the list of the frames of a file
+    */
+    BufMgr::FileFrames &BufMgr::framesOf(const File *file) {
+        return fileFrames[(BufHashTbl::hash(file, 0) >> 48) % FILE_FRAME_SHARDS];
+    }
+
+    /**
+    * @param FrameId, File pointer, constant PageId
+    * @return none
+    * @purpose assign a frame to a page and add it to the frames of the file
+    */
+    void BufMgr::assignFrame(FrameId frame, File *file, const PageId pageNo) {
+        BufDesc &desc = bufDescTable[frame];
+        desc.Set(file, pageNo);
+        FileFrames &shard = framesOf(file);
+        std::lock_guard<std::mutex> guard(shard.latch);
+        //new frames go in front, the order does not matter
+        FrameId &head = shard.heads.emplace(file, numBufs).first->second;
+        desc.filePrev = numBufs;
+        desc.fileNext = head;
+        if (head < numBufs) {
+            bufDescTable[head].filePrev = frame;
+        }
+        head = frame;
+    }
+
+    /**
+    * @param FrameId
+    * @return none
+    * @purpose take a frame off the frames of its file and clear it
+    */
+    void BufMgr::releaseFrame(FrameId frame) {
+        BufDesc &desc = bufDescTable[frame];
+        if (desc.file != NULL) {
+            FileFrames &shard = framesOf(desc.file);
+            std::lock_guard<std::mutex> guard(shard.latch);
+            if (desc.filePrev < numBufs) {
+                bufDescTable[desc.filePrev].fileNext = desc.fileNext;
+            } else if (desc.fileNext < numBufs) {
+                shard.heads[desc.file] = desc.fileNext;
+            } else {
+                shard.heads.erase(desc.file);
+            }
+            if (desc.fileNext < numBufs) {
+                bufDescTable[desc.fileNext].filePrev = desc.filePrev;
+            }
+            desc.filePrev = numBufs;
+            desc.fileNext = numBufs;
+        }
+        desc.Clear();
+    }
+
+    /**
+    * @param File pointer
+    * @return none 
+    * @purpose remove all pages from the file 
+    */
+    void BufMgr::flushFile(const File *file) {
+        if (file->isMapped()) {
+            //nothing to write back, the file only has to be unpinned
+            std::lock_guard<std::mutex> guard(mappedLatch);
+            for (const auto &pin : mappedPins) {
+                if (pin.first.file == file) {
+                    throw PagePinnedException("Pinned page", pin.first.pageNo, numBufs);
+                }
+            }
+            return;
+        }
+        //the frames of the file, to be written back in page order
+        std::vector<std::pair<PageId, FrameId> > frames;
+        {
+            FileFrames &shard = framesOf(file);
+            std::lock_guard<std::mutex> guard(shard.latch);
+            const auto head = shard.heads.find(file);
+            if (head != shard.heads.end()) {
+                for (FrameId i = head->second; i < numBufs; i = bufDescTable[i].fileNext) {
+                    frames.push_back(std::make_pair(bufDescTable[i].pageNo, i));
+                }
+            }
+        }
+        std::sort(frames.begin(), frames.end());
+        for (const auto &listed : frames) {
+            const FrameId i = listed.second;
+            std::lock_guard<std::mutex> frame(bufDescTable[i].latch);
+            waitForIo(i);
+            //evicted since the list was read, and maybe reused
+            if (bufDescTable[i].file != file || bufDescTable[i].pageNo != listed.first) {
+                continue;
+            }
+            //check if the page is valid
+            if (!bufDescTable[i].valid) {
+                throw BadBufferException(bufDescTable[i].frameNo, bufDescTable[i].dirty, bufDescTable[i].valid,
+                                         bufDescTable[i].refbit);
+            }
+            BufHashTbl &table = tableOf(file, bufDescTable[i].pageNo);
+            std::lock_guard<std::mutex> stripe(table.latch(file, bufDescTable[i].pageNo));
+            if (bufDescTable[i].pinCnt > 0) {
+                throw PagePinnedException("Pinned page", bufDescTable[i].pageNo, bufDescTable[i].frameNo);
+            }
+            //check the dirty bit
+            if (bufDescTable[i].dirty) {
+                //flush page to dick
+                writeBack(i);
+                //reset dirty bit
+                bufDescTable[i].dirty = false;
+            }
+            //remove page from hashtable
+            table.remove(file, bufDescTable[i].pageNo);
+            releaseFrame(i);
+            replacerOf(i).recordRemove(i);
+        }
+        {
+            std::lock_guard<std::mutex> guard(readAheadLatch);
+            readAhead.erase(file);
+        }
+        forgetDamaged(file);
+        //make the write backs of the file durable, including earlier evictions
+        syncFile(file);
+    }
+
+    /**
+    * @param none
+    * @return none
+    * @purpose write back every dirty page and sync every file with unsynced write backs
+    */
+    void BufMgr::checkpoint() {
+        for (FrameId i = 0; i < numBufs; i++) {
+            BufDesc &desc = bufDescTable[i];
+            std::lock_guard<std::mutex> frame(desc.latch);
+            //a write-back in flight reports its file as unsynced once done
+            waitForIo(i);
+            //clear the dirty bit first, a concurrent unpin marks the page again
+            if (!desc.valid || !desc.dirty.exchange(false)) {
+                continue;
+            }
+            try {
+                writeBack(i);
+            }
+            catch (...) {
+                desc.dirty = true;
+                throw;
+            }
+        }
+        fuzzyCheckpoint();
+    }
+
+    /**
+    * @param none
+    * @return LSN recovery starts from
+    * @purpose sync every file with unsynced write backs and move the redo point of the log on
+    */
+    Lsn BufMgr::fuzzyCheckpoint() {
+        //taken before the syncs: every change before it was written back by then
+        const Lsn redo = log != NULL ? redoPoint() : 0;
+        std::vector<std::pair<std::string, File::SyncHandle> > files;
+        {
+            std::lock_guard<std::mutex> guard(syncLatch);
+            files.assign(unsyncedFiles.begin(), unsyncedFiles.end());
+        }
+        for (const auto &file : files) {
+            syncFile(file.first, file.second);
+        }
+        if (log != NULL) {
+            log->checkpoint(redo);
+        }
+        return redo;
+    }
+
+    /**
+    * @param none
+    * @return oldest LSN of a change not yet written back
+    * @purpose find where redo has to start from
+    */
+    Lsn BufMgr::redoPoint() {
+        //the end first: a change logged after it gets an LSN past it
+        Lsn redo = log->endLsn();
+        for (FrameId i = 0; i < numBufs; i++) {
+            const Lsn rec = bufDescTable[i].recLsn;
+            const Lsn flushing = bufDescTable[i].flushingLsn;
+            if (rec != 0 && rec < redo) {
+                redo = rec;
+            }
+            if (flushing != 0 && flushing < redo) {
+                redo = flushing;
+            }
+        }
+        return redo;
+    }
+
+    /**
+    * @param FrameId
+    * @return none
+    * @purpose write the page in a frame back to its file
+    */
+    void BufMgr::writeBack(FrameId frame) {
+        BufDesc &desc = bufDescTable[frame];
+        desc.flushingLsn = desc.recLsn.load();
+        desc.recLsn = 0;
+        try {
+            if (log != NULL) {
+                //write-ahead: the records of the changes go to disk before the page
+                log->flush(bufPool[frame].lsn());
+            }
+            std::lock_guard<std::mutex> io(ioLatch);
+            const std::uint64_t start = nowNanos();
+            desc.file->writePage(bufPool[frame]);
+            bufStats.recordLatency(true, nowNanos() - start);
+        }
+        catch (...) {
+            desc.recLsn = desc.flushingLsn.load();
+            desc.flushingLsn = 0;
+            throw;
+        }
+        bufStats.record(desc.file, STAT_DISKWRITES, desc.partition);
+        BADGERDB_TRACE(TRACE_BUF_WRITE_BACK, desc.file, desc.pageNo);
+        noteUnsynced(desc.file);
+        //only once a checkpoint syncing the unsynced files would include it
+        desc.flushingLsn = 0;
+    }
+
+    /**
+    * @param FrameId
+    * @return none
+    * @purpose queue an asynchronous write of the page in a frame back to its file
+    */
+    void BufMgr::startWriteBack(FrameId frame) {
+        BufDesc &desc = bufDescTable[frame];
+        BADGERDB_TRACE(TRACE_BUF_WRITE_BACK, desc.file, desc.pageNo);
+        desc.writing = true;
+        {
+            std::lock_guard<std::mutex> guard(asyncLatch);
+            asyncInFlight++;
+        }
+        const std::uint64_t start = nowNanos();
+        desc.flushingLsn = desc.recLsn.load();
+        desc.recLsn = 0;
+        if (log != NULL) {
+            try {
+                //write-ahead: the records of the changes go to disk before the page
+                log->flush(bufPool[frame].lsn());
+            }
+            catch (const FileIOException &e) {
+                finishWriteBack(frame, start, e.error() != 0 ? e.error() : EIO);
+                return;
+            }
+        }
+        desc.file->writePageAsync(*ioEngine, bufPool[frame], [this, frame, start](const int error) {
+            finishWriteBack(frame, start, error);
+        });
+    }
+
+    /**
+    * @param FrameId, start time, errno of the write or 0
+    * @return none
+    * @purpose account for a completed write-back and make the frame evictable again
+    */
+    void BufMgr::finishWriteBack(FrameId frame, std::uint64_t start, int error) {
+        BufDesc &desc = bufDescTable[frame];
+        if (error != 0) {
+            //keep the changes, the next eviction tries again
+            desc.dirty = true;
+            desc.recLsn = desc.flushingLsn.load();
+        } else {
+            bufStats.recordLatency(true, nowNanos() - start);
+            bufStats.record(desc.file, STAT_DISKWRITES, desc.partition);
+            noteUnsynced(desc.file);
+        }
+        desc.flushingLsn = 0;
+        desc.writing = false;
+        replacerOf(frame).recordRequeue(frame);
+        {
+            std::lock_guard<std::mutex> guard(asyncLatch);
+            asyncInFlight--;
+            asyncCompleted++;
+            if (error != 0) {
+                writeError = error;
+                writeErrorFile = desc.file->filename();
+            }
+        }
+        asyncDone.notify_all();
+    }
+
+    /**
+    * @param FrameId
+    * @return none
+    * @purpose wait for an asynchronous write-back of a frame to complete
+    */
+    void BufMgr::waitForIo(FrameId frame) {
+        BufDesc &desc = bufDescTable[frame];
+        if (!desc.writing && !desc.reading) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(asyncLatch);
+        while (desc.writing || desc.reading) {
+            asyncDone.wait(lock);
+        }
+    }
+
+    /**
+    * @param File pointer, first PageId, number of pages
+    * @return none
+    * @purpose read pages into unpinned frames in the background
+    */
+    void BufMgr::prefetch(File *file, const PageId firstPage, const PageId count) {
+        if (file->isMapped()) {
+            file->adviseWillNeed(firstPage, count);
+            return;
+        }
+        const PageId limit = file->pageLimit();
+        const PageId endPage = firstPage + count < limit ? firstPage + count : limit;
+        for (PageId pageNo = firstPage; pageNo < endPage; pageNo++) {
+            if (pageNo == Page::INVALID_NUMBER) {
+                continue;
+            }
+            BufHashTbl &table = tableOf(file, pageNo);
+            std::mutex &stripe = table.latch(file, pageNo);
+            FrameId index;
+            {
+                std::lock_guard<std::mutex> guard(stripe);
+                if (table.tryLookup(file, pageNo, index)) {
+                    continue;
+                }
+            }
+            try {
+                allocBuf(index, file, pageNo); //latched
+            }
+            catch (BufferExceededException &) {
+                break;
+            }
+            BufDesc &desc = bufDescTable[index];
+            bool present;
+            {
+                std::lock_guard<std::mutex> guard(stripe);
+                FrameId other;
+                present = table.tryLookup(file, pageNo, other);
+                if (!present) {
+                    //published unpinned; readers pin it and wait for the read
+                    table.insert(file, pageNo, index);
+                    assignFrame(index, file, pageNo);
+                    desc.pinCnt = 0;
+                    desc.refbit = false;
+                    desc.reading = true;
+                    desc.prefetched = true;
+                }
+            }
+            if (present) {
+                replacerOf(index).recordRemove(index);
+                desc.latch.unlock();
+                continue;
+            }
+            replacerOf(index).recordInsert(index, file, pageNo);
+            {
+                std::lock_guard<std::mutex> guard(asyncLatch);
+                asyncInFlight++;
+            }
+            file->readPageAsync(*ioEngine, pageNo, bufPool[index], [this, index](const int error) {
+                finishPrefetch(index, error);
+            });
+            desc.latch.unlock();
+        }
+        ioEngine->submit();
+    }
+
+    /**
+    * @param FrameId, errno of the read or 0
+    * @return none
+    * @purpose publish a prefetched page, or drop its frame if the read failed
+    */
+    void BufMgr::finishPrefetch(FrameId frame, int error) {
+        BufDesc &desc = bufDescTable[frame];
+        //a damaged page fails like a read, its reader reads it again and throws
+        if (error == 0 && !checkRead(frame, desc.file, desc.pageNo)) {
+            error = EBADMSG;
+        }
+        if (error == 0) {
+            bufStats.record(desc.file, STAT_PREFETCHES, desc.partition);
+        } else {
+            desc.readFailed = true;
+        }
+        desc.reading = false;
+        //free the frame unless a reader is waiting for it, who then drops it
+        if (error != 0 && desc.latch.try_lock()) {
+            {
+                BufHashTbl &table = tableOf(desc.file, desc.pageNo);
+                std::lock_guard<std::mutex> stripe(table.latch(desc.file, desc.pageNo));
+                if (desc.pinCnt == 0) {
+                    table.remove(desc.file, desc.pageNo);
+                    releaseFrame(frame);
+                    replacerOf(frame).recordRemove(frame);
+                }
+            }
+            desc.latch.unlock();
+        }
+        {
+            std::lock_guard<std::mutex> guard(asyncLatch);
+            asyncInFlight--;
+            asyncCompleted++;
+        }
+        asyncDone.notify_all();
+    }
+
+    /**
+    * @param FrameId, File pointer, PageId
+    * @return none
+    * @purpose give up a pin on a frame whose prefetch failed
+    */
+    void BufMgr::dropFailedPrefetch(FrameId frame, File *file, PageId pageNo) {
+        BufDesc &desc = bufDescTable[frame];
+        std::lock_guard<std::mutex> latch(desc.latch);
+        BufHashTbl &table = tableOf(file, pageNo);
+        std::lock_guard<std::mutex> stripe(table.latch(file, pageNo));
+        FrameId mapped;
+        if (table.tryLookup(file, pageNo, mapped) && mapped == frame) {
+            table.remove(file, pageNo);
+        }
+        if (--desc.pinCnt == 0) {
+            releaseFrame(frame);
+            replacerOf(frame).recordRemove(frame);
+        }
+    }
+
+    /**
+    * @param none
+    * @return none
+    * @purpose wake the background writer up, starting it in this process if needed
+    */
+    void BufMgr::wakeFlusher() {
+        if (dirtyTarget >= 1) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(flushLatch);
+            if (flusherStop) {
+                return;
+            }
+            if (flusherOwner != getpid()) {
+                //one inherited through fork() does not exist in this process
+                flusher.release();
+                flusher.reset(new std::thread(&BufMgr::runFlusher, this));
+                flusherOwner = getpid();
+            }
+        }
+        flushWake.notify_one();
+    }
+
+    /**
+    * @param none
+    * @return none
+    * @purpose background writer keeping the dirty frames at dirtyTarget
+    */
+    void BufMgr::runFlusher() {
+        std::unique_lock<std::mutex> lock(flushLatch);
+        for (;;) {
+            flushWake.wait(lock, [this] { return flusherStop || evictPressure; });
+            if (flusherStop) {
+                return;
+            }
+            lock.unlock();
+            evictPressure = false;
+            //of the frames in use now, the pool may have been resized since
+            const std::uint32_t limit = static_cast<std::uint32_t>(dirtyTarget * activeBufs);
+            std::uint32_t dirty = 0;
+            for (FrameId i = 0; i < numBufs; i++) {
+                if (bufDescTable[i].dirty) {
+                    dirty++;
+                }
+            }
+            //pinned frames are skipped, so a pass may not reach the target
+            while (dirty > limit) {
+                const std::uint32_t written = flushBatch();
+                if (written == 0) {
+                    break;
+                }
+                dirty = written < dirty ? dirty - written : 0;
+            }
+            lock.lock();
+        }
+    }
+
+    /**
+    * @param none
+    * @return number of frames written back
+    * @purpose write back a batch of dirty unpinned frames that stay resident
+    */
+    std::uint32_t BufMgr::flushBatch() {
+        //write-ahead: only pages whose changes are all in the log on disk are written
+        Lsn durable = ~Lsn(0);
+        if (log != NULL) {
+            try {
+                log->flush(log->endLsn());
+            }
+            catch (const FileIOException &) {
+                //reported by the next write-back or flush of the log
+                return 0;
+            }
+            durable = log->durableLsn();
+        }
+        std::vector<FrameId> frames;
+        //completions may arrive while the batch is still being collected
+        int errors[FLUSH_BATCH];
+        std::uint32_t pending = 0;
+        for (std::uint32_t scanned = 0; scanned < numBufs && frames.size() < FLUSH_BATCH; scanned++) {
+            const FrameId i = flushCursor;
+            flushCursor = (flushCursor + 1) % numBufs;
+            BufDesc &desc = bufDescTable[i];
+            if (!desc.dirty || !desc.latch.try_lock()) {
+                continue;
+            }
+            if (desc.valid && desc.pinCnt == 0 && !desc.writing && !desc.reading && bufPool[i].lsn() < durable &&
+                desc.dirty.exchange(false)) {
+                //keeps evictions and flushFile away until the batch is done
+                desc.writing = true;
+                desc.flushingLsn = desc.recLsn.load();
+                desc.recLsn = 0;
+                {
+                    std::lock_guard<std::mutex> guard(asyncLatch);
+                    asyncInFlight++;
+                    pending++;
+                }
+                const std::size_t slot = frames.size();
+                frames.push_back(i);
+                errors[slot] = 0;
+                const std::uint64_t start = nowNanos();
+                File *file = desc.file;
+                const int partition = desc.partition;
+                BADGERDB_TRACE(TRACE_BUF_WRITE_BACK, file, desc.pageNo);
+                file->writePageAsync(*ioEngine, bufPool[i], [this, file, partition, start, slot, &errors, &pending](const int error) {
+                    if (error == 0) {
+                        bufStats.recordLatency(true, nowNanos() - start);
+                        bufStats.record(file, STAT_DISKWRITES, partition);
+                        noteUnsynced(file);
+                    }
+                    {
+                        std::lock_guard<std::mutex> guard(asyncLatch);
+                        errors[slot] = error;
+                        pending--;
+                    }
+                    asyncDone.notify_all();
+                });
+            }
+            desc.latch.unlock();
+        }
+        if (frames.empty()) {
+            return 0;
+        }
+        ioEngine->submit();
+        {
+            std::unique_lock<std::mutex> lock(asyncLatch);
+            while (pending > 0) {
+                asyncDone.wait(lock);
+            }
+        }
+        if (writeMode == WRITE_GROUP_COMMIT) {
+            //the frames may only be reused once their pages are durable
+            std::unordered_set<const File *> files;
+            for (FrameId i : frames) {
+                files.insert(bufDescTable[i].file);
+            }
+            for (const File *file : files) {
+                try {
+                    syncFile(file);
+                }
+                catch (...) {
+                    for (std::size_t f = 0; f < frames.size(); f++) {
+                        if (bufDescTable[frames[f]].file == file && errors[f] == 0) {
+                            errors[f] = EIO;
+                        }
+                    }
+                }
+            }
+        }
+        for (std::size_t f = 0; f < frames.size(); f++) {
+            BufDesc &desc = bufDescTable[frames[f]];
+            if (errors[f] != 0) {
+                //keep the changes, eviction or a later pass tries again
+                desc.dirty = true;
+                desc.recLsn = desc.flushingLsn.load();
+            }
+            desc.flushingLsn = 0;
+            desc.writing = false;
+        }
+        {
+            std::lock_guard<std::mutex> guard(asyncLatch);
+            asyncInFlight -= frames.size();
+            asyncCompleted += frames.size();
+        }
+        asyncDone.notify_all();
+        return frames.size();
+    }
+
+    /**
+    * @param File pointer, PageId
+    * @return none
+    * @purpose detect sequential reads of a file and prefetch ahead of them
+    */
+    void BufMgr::noteRead(File *file, PageId pageNo) {
+        PageId first;
+        PageId count;
+        {
+            std::lock_guard<std::mutex> guard(readAheadLatch);
+            auto found = readAhead.find(file);
+            if (found == readAhead.end()) {
+                ReadAhead fresh = {pageNo, pageNo + 1, 0};
+                readAhead[file] = fresh;
+                return;
+            }
+            ReadAhead &state = found->second;
+            //small gaps are pages not in use, which scans skip
+            const bool sequential = pageNo > state.last && pageNo - state.last <= READ_AHEAD_MIN;
+            state.last = pageNo;
+            if (!sequential) {
+                state.ahead = pageNo + 1;
+                state.window = 0;
+                return;
+            }
+            if (state.ahead <= pageNo) {
+                state.ahead = pageNo + 1;
+            }
+            //keep the next window in flight while the reader consumes this one
+            if (state.window > 0 && pageNo + state.window / 2 < state.ahead) {
+                return;
+            }
+            const std::uint32_t frames = activeBufs;
+            PageId largest = frames / 4 < READ_AHEAD_MAX ? frames / 4 : READ_AHEAD_MAX;
+            if (largest == 0) {
+                return;
+            }
+            count = state.window == 0 ? READ_AHEAD_MIN : 2 * state.window;
+            if (count > largest) {
+                count = largest;
+            }
+            first = state.ahead;
+            state.ahead += count;
+            state.window = count;
+        }
+        try {
+            prefetch(file, first, count);
+        }
+        catch (...) {
+            //only a hint; a failed write-back stays dirty and is retried
+        }
+    }
+
+    /**
+    * @param File pointer, constant PageId, Page reference
+    * @return none
+    * @purpose pin a page of a mapped file and return it in place
+    */
+    void BufMgr::readMapped(File *file, const PageId pageNo, Page *&page) {
+        //throws for pages not in the mapping before anything is pinned
+        const Page *mapped = file->mappedPage(pageNo);
+        {
+            std::lock_guard<std::mutex> guard(mappedLatch);
+            mappedPins[PageKey{file, pageNo}]++;
+        }
+        bufStats.record(file, STAT_HITS, shardOf(file, pageNo));
+        BADGERDB_TRACE(TRACE_BUF_HIT, file, pageNo);
+        //read-only; the mapping faults on writes
+        page = const_cast<Page *>(mapped);
+    }
+
+    /**
+    * @param File pointer, constant PageId, constant bool
+    * @return none
+    * @purpose unpin a page of a mapped file
+    */
+    void BufMgr::unPinMapped(File *file, const PageId pageNo, const bool dirty) {
+        if (dirty) {
+            throw ReadOnlyFileException(file->filename(), "dirty a page of");
+        }
+        std::lock_guard<std::mutex> guard(mappedLatch);
+        auto pin = mappedPins.find(PageKey{file, pageNo});
+        //like a page not in the pool, an unpinned page is left alone
+        if (pin == mappedPins.end()) {
+            return;
+        }
+        if (--pin->second == 0) {
+            mappedPins.erase(pin);
+        }
+    }
+
+    /**
+    * @param File pointer
+    * @return none
+    * @purpose sync a file, making all its write backs so far durable
+    */
+    void BufMgr::syncFile(const File *file) {
+        syncFile(file->filename(), file->syncHandle());
+    }
+
+    /**
+    * @param file name, handle on the file
+    * @return none
+    * @purpose sync the file of a handle if it is still open, making all its write backs so far durable
+    */
+    void BufMgr::syncFile(const std::string &name, const File::SyncHandle &handle) {
+        {
+            //forget the file before syncing: a write back noted after this
+            //point may not be covered by the sync and notes the file again.
+            //Always sync, a write back noted earlier may belong to a sync
+            //that another thread has not finished yet.
+            std::lock_guard<std::mutex> guard(syncLatch);
+            unsyncedFiles.erase(name);
+        }
+        try {
+            handle.sync();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> guard(syncLatch);
+            unsyncedFiles.emplace(name, handle);
+            throw;
+        }
+    }
+
+    /**
+    * @param File pointer
+    * @return none
+    * @purpose note a write back of the file that is not durable until the file is synced
+    */
+    void BufMgr::noteUnsynced(const File *file) {
+        const File::SyncHandle handle = file->syncHandle();
+        std::lock_guard<std::mutex> guard(syncLatch);
+        //replaces the handle on a copy of the file closed since
+        unsyncedFiles[file->filename()] = handle;
+    }
+
+    /**
+    * @param File pointer, PageId, Page reference
+    * @return none 
+    * @purpose allocate an empty page and return both page number and a pointer to the buffer frame
+    */
+    void BufMgr::allocPage(File *file, PageId &pageNo, Page *&page) {
+        //allocate a new page
+        Page newPage;
+        {
+            std::lock_guard<std::mutex> io(ioLatch);
+            newPage = file->allocatePage();
+        }
+        FrameId index;
+        allocBuf(index, file, newPage.page_number()); // obtain a buffer pool frame, latched
+        bufPool[index] = newPage;
+        {
+            //insert entry into hash table
+            BufHashTbl &table = tableOf(file, newPage.page_number());
+            std::lock_guard<std::mutex> guard(table.latch(file, newPage.page_number()));
+            table.insert(file, newPage.page_number(), index);
+            assignFrame(index, file, newPage.page_number());
+        }
+        bufStats.record(file, STAT_ALLOCS, bufDescTable[index].partition);
+        replacerOf(index).recordInsert(index, file, newPage.page_number());
+        bufDescTable[index].latch.unlock();
+        //return both page number and a pointer to the buffer frame
+        pageNo = newPage.page_number(); 
+        page = &bufPool[index];
+    }
+
+    /**
+    * @param File pointer, constant PageId
+    * @return none 
+    * @purpose delete a page from file 
+    */
+    void BufMgr::disposePage(File *file, const PageId PageNo) {
+        BufHashTbl &table = tableOf(file, PageNo);
+        std::mutex &stripe = table.latch(file, PageNo);
+        FrameId index;
+        bool cached;
+        //check if the page is allocated to a frame in the buffer pool
+        {
+            std::lock_guard<std::mutex> guard(stripe);
+            cached = table.tryLookup(file, PageNo, index);
+        }
+        if (cached) {
+            //frame latch is always taken before the stripe latch
+            std::lock_guard<std::mutex> frame(bufDescTable[index].latch);
+            waitForIo(index);
+            std::lock_guard<std::mutex> guard(stripe);
+            if (bufDescTable[index].file == file && bufDescTable[index].pageNo == PageNo) {
+                releaseFrame(index);
+                table.remove(file, PageNo);
+                replacerOf(index).recordRemove(index);
+            }
+        }
+        if (damagedCount > 0) {
+            std::lock_guard<std::mutex> guard(damagedLatch);
+            damagedCount -= damaged.erase(PageKey{file, PageNo});
+        }
+        //delete a page from file 
+        std::lock_guard<std::mutex> io(ioLatch);
         file->deletePage(PageNo);
     }
 
+    /**
+    * @param sidecar file name
+    * @return none
+    * @purpose save the pages in the pool, hottest first, for warmUp()
+    */
+    void BufMgr::saveHotSet(const std::string &path) {
+        //pinned pages and those referenced since the last save first; clearing
+        //the reference bits makes the next save see only newer references
+        std::vector<const File *> files;
+        std::unordered_map<const File *, std::uint32_t> fileIndex;
+        std::vector<std::uint32_t> hot, cold;
+        for (FrameId i = 0; i < numBufs; i++) {
+            BufDesc &desc = bufDescTable[i];
+            std::lock_guard<std::mutex> latch(desc.latch);
+            if (!desc.valid || desc.file->isClosed()) {
+                continue;
+            }
+            auto known = fileIndex.find(desc.file);
+            if (known == fileIndex.end()) {
+                known = fileIndex.insert(std::make_pair(desc.file, (std::uint32_t) files.size())).first;
+                files.push_back(desc.file);
+            }
+            std::vector<std::uint32_t> &group = desc.pinCnt > 0 || desc.refbit.exchange(false) ? hot : cold;
+            group.push_back(known->second);
+            group.push_back(desc.pageNo);
+        }
+        hot.insert(hot.end(), cold.begin(), cold.end());
+
+        //magic, file names, then (file, page) pairs; written aside and renamed
+        //over the old sidecar so that a crash leaves one or the other
+        std::vector<std::uint32_t> words;
+        words.push_back(HOT_SET_MAGIC);
+        words.push_back(files.size());
+        std::string names;
+        for (const File *file : files) {
+            const std::string name = file->filename();
+            words.push_back(name.size());
+            names += name;
+        }
+        //saves may run concurrently, each from a file of its own
+        static std::atomic<std::uint32_t> saves(0);
+        const std::string tmpPath = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(saves++);
+        FILE *out = fopen(tmpPath.c_str(), "wb");
+        if (out == NULL) {
+            throw FileIOException(tmpPath, "open", errno);
+        }
+        const std::uint32_t pairs = hot.size() / 2;
+        bool written = fwrite(words.data(), sizeof(std::uint32_t), words.size(), out) == words.size()
+                       && fwrite(names.data(), 1, names.size(), out) == names.size()
+                       && fwrite(&pairs, sizeof(pairs), 1, out) == 1
+                       && fwrite(hot.data(), sizeof(std::uint32_t), hot.size(), out) == hot.size();
+        int error = errno;
+        if (fclose(out) != 0 && written) {
+            written = false;
+            error = errno;
+        }
+        if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            if (written) {
+                error = errno;
+            }
+            remove(tmpPath.c_str());
+            throw FileIOException(path, "write", error);
+        }
+    }
+
+    /**
+    * @param sidecar file name, files the pages may belong to
+    * @return number of pages prefetching was started for
+    * @purpose refill the pool from a hot set saved by saveHotSet()
+    */
+    std::uint32_t BufMgr::warmUp(const std::string &path, const std::vector<File *> &files) {
+        FILE *in = fopen(path.c_str(), "rb");
+        if (in == NULL) {
+            return 0;
+        }
+        //a damaged sidecar is read up to the damage
+        std::vector<File *> sidecarFiles;
+        std::vector<std::pair<File *, PageId> > pages;
+        std::uint32_t header[2];
+        if (fread(header, sizeof(std::uint32_t), 2, in) == 2 && header[0] == HOT_SET_MAGIC) {
+            std::vector<std::uint32_t> lengths(header[1] <= numBufs ? header[1] : 0);
+            bool intact = lengths.size() == header[1]
+                          && fread(lengths.data(), sizeof(std::uint32_t), lengths.size(), in) == lengths.size();
+            for (std::uint32_t f = 0; intact && f < header[1]; f++) {
+                std::string name(lengths[f] <= HOT_SET_MAX_NAME ? lengths[f] : 0, '\0');
+                intact = name.size() == lengths[f] && fread(&name[0], 1, name.size(), in) == name.size();
+                File *match = NULL;
+                for (File *file : files) {
+                    if (file->filename() == name) {
+                        match = file;
+                    }
+                }
+                sidecarFiles.push_back(match);
+            }
+            std::uint32_t count = 0;
+            if (intact && fread(&count, sizeof(count), 1, in) == 1) {
+                //only as many of the hottest pages as the pool can hold
+                std::uint32_t entry[2];
+                for (std::uint32_t e = 0; e < count && pages.size() < activeBufs
+                                          && fread(entry, sizeof(std::uint32_t), 2, in) == 2; e++) {
+                    if (entry[0] < sidecarFiles.size() && sidecarFiles[entry[0]] != NULL) {
+                        pages.push_back(std::make_pair(sidecarFiles[entry[0]], entry[1]));
+                    }
+                }
+            }
+        }
+        fclose(in);
+
+        //sequential runs of each file, read one batch per run
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+        for (std::size_t run = 0; run < pages.size();) {
+            std::size_t end = run + 1;
+            while (end < pages.size() && pages[end].first == pages[run].first
+                   && pages[end].second == pages[run].second + (end - run)) {
+                end++;
+            }
+            prefetch(pages[run].first, pages[run].second, end - run);
+            run = end;
+        }
+        return pages.size();
+    }
+
+    /**
+    * @param sidecar file name, time between saves
+    * @return none
+    * @purpose save the hot page set periodically from a thread of its own
+    */
+    void BufMgr::dumpHotSetEvery(const std::string &path, const std::chrono::milliseconds interval) {
+        std::lock_guard<std::mutex> guard(hotSetLatch);
+        hotSetPath = path;
+        hotSetInterval = interval;
+        if (hotSetStop || hotSetOwner == getpid()) {
+            return;
+        }
+        //one inherited through fork() does not exist in this process
+        hotSetWriter.release();
+        hotSetWriter.reset(new std::thread(&BufMgr::runHotSetWriter, this));
+        hotSetOwner = getpid();
+    }
+
+    /**
+    * @param none
+    * @return none
+    * @purpose hot set writer saving the hot page set every hotSetInterval
+    */
+    void BufMgr::runHotSetWriter() {
+        std::unique_lock<std::mutex> lock(hotSetLatch);
+        while (!hotSetWake.wait_for(lock, hotSetInterval, [this] { return hotSetStop; })) {
+            const std::string path = hotSetPath;
+            lock.unlock();
+            try {
+                saveHotSet(path);
+            }
+            catch (FileIOException &) {
+                //the next save tries again
+            }
+            lock.lock();
+        }
+    }
+
+    /**
+    * @param when pages are checked against their checksums
+    * @return none
+    * @purpose set when the pages read are checked against their checksums
+    */
+    void BufMgr::verifyChecksums(const ChecksumMode mode) {
+        checksumMode = mode;
+    }
+
+    /**
+    * @param FrameId, File pointer, constant PageId
+    * @return false if the page read does not match its checksum
+    * @purpose check a page read into a frame as the checksum mode asks
+    */
+    bool BufMgr::checkRead(FrameId frame, File *file, const PageId pageNo) {
+        const ChecksumMode mode = checksumMode;
+        if (mode == CHECKSUM_OFF || !file->hasChecksums()) {
+            return true;
+        }
+        bool wasDamaged = false;
+        if (damagedCount > 0) {
+            std::lock_guard<std::mutex> guard(damagedLatch);
+            wasDamaged = damaged.count(PageKey{file, pageNo}) > 0;
+        }
+        BufDesc &desc = bufDescTable[frame];
+        if (mode == CHECKSUM_SCRUB && !wasDamaged) {
+            desc.unverified = true;
+            if (!scrubRequested.exchange(true)) {
+                wakeScrubber();
+            }
+            return true;
+        }
+        if (!file->checksumMatches(bufPool[frame])) {
+            return false;
+        }
+        bufStats.record(file, STAT_VERIFIED, desc.partition);
+        if (wasDamaged) {
+            //written again since
+            std::lock_guard<std::mutex> guard(damagedLatch);
+            damagedCount -= damaged.erase(PageKey{file, pageNo});
+        }
+        return true;
+    }
+
+    /**
+    * @param none
+    * @return none
+    * @purpose wake the scrubber up, starting it in this process if needed
+    */
+    void BufMgr::wakeScrubber() {
+        {
+            std::lock_guard<std::mutex> guard(scrubLatch);
+            if (scrubberStop) {
+                return;
+            }
+            if (scrubberOwner != getpid()) {
+                //one inherited through fork() does not exist in this process
+                scrubber.release();
+                scrubber.reset(new std::thread(&BufMgr::runScrubber, this));
+                scrubberOwner = getpid();
+            }
+        }
+        scrubWake.notify_one();
+    }
+
+    /**
+    * @param none
+    * @return none
+    * @purpose scrubber checking the pages left to it against their checksums
+    */
+    void BufMgr::runScrubber() {
+        std::unique_lock<std::mutex> lock(scrubLatch);
+        for (;;) {
+            scrubWake.wait(lock, [this] { return scrubberStop || scrubRequested; });
+            if (scrubberStop) {
+                return;
+            }
+            lock.unlock();
+            scrubRequested = false;
+            const bool busy = scrubPass();
+            lock.lock();
+            if (busy && !scrubWake.wait_for(lock, SCRUB_RETRY, [this] { return scrubberStop; })) {
+                scrubRequested = true;
+            }
+        }
+    }
+
+    /**
+    * @param none
+    * @return true if frames were skipped because they were busy
+    * @purpose check the unpinned clean frames left to the scrubber, dropping the damaged pages
+    */
+    bool BufMgr::scrubPass() {
+        bool busy = false;
+        for (FrameId i = 0; i < numBufs; i++) {
+            BufDesc &desc = bufDescTable[i];
+            if (!desc.unverified) {
+                continue;
+            }
+            //the frame latch keeps the frame assigned to its page
+            if (!desc.latch.try_lock()) {
+                busy = true;
+                continue;
+            }
+            if (desc.unverified && desc.valid) {
+                File *file = desc.file;
+                const PageId pageNo = desc.pageNo;
+                BufHashTbl &table = tableOf(file, pageNo);
+                //no pin can be taken, so nobody changes the page while it is checked
+                std::lock_guard<std::mutex> stripe(table.latch(file, pageNo));
+                if (desc.pinCnt > 0 || desc.writing || desc.reading) {
+                    busy = true;
+                } else if (desc.dirty) {
+                    desc.unverified = false;
+                } else if (file->checksumMatches(bufPool[i])) {
+                    desc.unverified = false;
+                    bufStats.record(file, STAT_VERIFIED, desc.partition);
+                } else {
+                    bufStats.record(file, STAT_CHECKSUM_FAILURES, desc.partition);
+                    {
+                        //before the page can be missed again
+                        std::lock_guard<std::mutex> guard(damagedLatch);
+                        if (damaged.insert(PageKey{file, pageNo}).second) {
+                            damagedCount++;
+                        }
+                    }
+                    table.remove(file, pageNo);
+                    releaseFrame(i);
+                    replacerOf(i).recordRemove(i);
+                }
+            }
+            desc.latch.unlock();
+        }
+        return busy;
+    }
+
+    /**
+    * @param File pointer
+    * @return none
+    * @purpose forget the damaged pages of a file whose pages left the pool
+    */
+    void BufMgr::forgetDamaged(const File *file) {
+        if (damagedCount == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(damagedLatch);
+        for (auto i = damaged.begin(); i != damaged.end();) {
+            if (i->file == file) {
+                i = damaged.erase(i);
+                damagedCount--;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    /**
+    * @param number of frames
+    * @return none
+    * @purpose grow or shrink the frames in use of every partition while the pool is in use
+    */
+    void BufMgr::resize(const std::uint32_t bufs) {
+        if (bufs == 0 || bufs > numBufs) {
+            throw BadgerDbException("Buffer pool of " + std::to_string(numBufs) + " frames reserved cannot be resized to "
+                                    + std::to_string(bufs) + " frames");
+        }
+        std::lock_guard<std::mutex> guard(resizeLatch);
+        for (BufPartition &partition : partitions) {
+            const std::uint32_t active = partition.activeFrames;
+            const std::uint32_t target = shareOf(bufs, numBufs, partition.firstFrame, partition.numFrames);
+            if (target > active) {
+                //released frames are untouched, so this is their first touch, on the node
+                for (FrameId i = partition.firstFrame + active; i < partition.firstFrame + target; i++) {
+                    new(&bufPool[i]) Page();
+                }
+                partition.replacer->restore(partition.firstFrame + active, target - active);
+                partition.activeFrames = target;
+                activeBufs += target - active;
+                continue;
+            }
+            if (target == active) {
+                continue;
+            }
+            //no new page goes into the frames from here on; the last is drained first,
+            //so that the frames in use stay the first ones if a write-back fails
+            partition.replacer->retire(partition.firstFrame + target, active - target);
+            std::uint32_t kept = active;
+            try {
+                for (; kept > target; kept--) {
+                    drainFrame(partition.firstFrame + kept - 1);
+                    partition.activeFrames = kept - 1;
+                    activeBufs--;
+                }
+            }
+            catch (...) {
+                partition.replacer->restore(partition.firstFrame + target, kept - target);
+                releaseMemory(partition.firstFrame + kept, active - kept);
+                throw;
+            }
+            releaseMemory(partition.firstFrame + target, active - target);
+        }
+    }
+
+    /**
+    * @param FrameId
+    * @return none
+    * @purpose evict the page of a retired frame, waiting for its pins and I/O
+    */
+    void BufMgr::drainFrame(FrameId frame) {
+        BufDesc &desc = bufDescTable[frame];
+        for (;;) {
+            std::unique_lock<std::mutex> latch(desc.latch);
+            if (!desc.valid && !desc.reading && !desc.writing) {
+                //free, or handed back by a thread that claimed it before it was retired
+                replacerOf(frame).recordRemove(frame);
+                return;
+            }
+            if (desc.valid && desc.pinCnt == 0 && !desc.reading && !desc.writing) {
+                const bool wasDirty = desc.dirty.exchange(false);
+                if (wasDirty) {
+                    try {
+                        writeBack(frame);
+                        if (writeMode == WRITE_GROUP_COMMIT) {
+                            syncFile(desc.file);
+                        }
+                    }
+                    catch (...) {
+                        desc.dirty = true;
+                        throw;
+                    }
+                }
+                //no new pins can be taken while we hold the stripe latch
+                BufHashTbl &table = tableOf(desc.file, desc.pageNo);
+                std::lock_guard<std::mutex> stripe(table.latch(desc.file, desc.pageNo));
+                if (desc.pinCnt == 0 && !desc.dirty) {
+                    table.remove(desc.file, desc.pageNo);
+                    bufStats.record(desc.file, STAT_EVICTIONS, desc.partition);
+                    BADGERDB_TRACE(TRACE_BUF_EVICT, desc.file, desc.pageNo);
+                    if (wasDirty) {
+                        bufStats.record(desc.file, STAT_DIRTY_EVICTIONS, desc.partition);
+                    }
+                    releaseFrame(frame);
+                    replacerOf(frame).recordRemove(frame);
+                    return;
+                }
+                continue;
+            }
+            //pinned, or its I/O is in flight; queued write-backs may wait for a submit
+            latch.unlock();
+            ioEngine->submit();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    /**
+    * @param first frame, number of frames
+    * @return none
+    * @purpose give the whole arena pages of frames out of use back to the system
+    */
+    void BufMgr::releaseMemory(FrameId first, std::uint32_t count) {
+        const std::size_t page = arenaPages == POOL_HUGE_1GB ? HUGE_PAGE_1GB
+                               : arenaPages == POOL_HUGE_2MB ? HUGE_PAGE_2MB : POOL_ALIGNMENT;
+        const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(&bufPool[first]);
+        const std::uintptr_t end = reinterpret_cast<std::uintptr_t>(&bufPool[first + count]);
+        const std::uintptr_t from = (start + page - 1) / page * page;
+        const std::uintptr_t to = end / page * page;
+        //only frees memory; frames are touched afresh before they are used again
+        if (from < to) {
+            madvise(reinterpret_cast<void *>(from), to - from, MADV_DONTNEED);
+        }
+    }
+
     /**
     * @param void
     * @return void 
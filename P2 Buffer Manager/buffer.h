@@ -7,8 +7,25 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <sys/types.h>
+
 #include "file.h"
 #include "bufHashTbl.h"
+#include "bufReplacer.h"
+#include "bufStats.h"
+#include "ioEngine.h"
+#include "wal.h"
 
 namespace badgerdb {
 
@@ -19,12 +36,76 @@ class BufMgr;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* Descriptors are kept apart from the frames they describe, in an array of
+* their own aligned to cache lines, so that victim searches never touch page
+* data.  The fields a victim search reads come first and share the first
+* cache line of the descriptor.
 */
-class BufDesc {
+class alignas(64) BufDesc {
 
 	friend class BufMgr;
 
  private:
+	/**
+   * Latch held while the frame is being evicted, filled from disk or
+   * disposed.  The clock only ever try-locks it, so busy frames are skipped.
+	 */
+  std::mutex latch;
+
+	/**
+   * Number of times this page has been pinned.  Only raised while holding the
+   * hash table latch of (file, pageNo), so that an evictor holding that latch
+   * sees a stable zero.
+	 */
+  std::atomic<int> pinCnt;
+
+	/**
+   * True if page is dirty;  false otherwise
+	 */
+  std::atomic<bool> dirty;
+
+	/**
+   * True if page is valid
+	 */
+  bool valid;
+
+	/**
+   * Has this buffer frame been reference recently
+	 */
+  std::atomic<bool> refbit;
+
+	/**
+   * True while an asynchronous write-back of the frame is in flight; the
+   * frame is out of the replacement policy until it completes.  Kept by
+   * Clear(), which the write-back does not race with.
+	 */
+  std::atomic<bool> writing;
+
+	/**
+   * True while a prefetch is reading the page into the frame.  The frame is
+   * already in the hash table, so readers pin it and wait.
+	 */
+  std::atomic<bool> reading;
+
+	/**
+   * True if the prefetch read failed, for example because the page is not in
+   * use; the first reader drops the frame and reads the page itself
+	 */
+  std::atomic<bool> readFailed;
+
+	/**
+   * True if the page was prefetched and has not been read since
+	 */
+  std::atomic<bool> prefetched;
+
+	/**
+   * True while the page read into the frame waits for the scrubber to check
+   * it against its checksum (CHECKSUM_SCRUB); cleared once the page is
+   * dirtied, as the checksum in the frame is stale from then on
+	 */
+  std::atomic<bool> unverified;
+
 	/**
    * Pointer to file to which corresponding frame is assigned
 	 */
@@ -41,24 +122,30 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * Partition of the buffer pool the frame belongs to
 	 */
-  int pinCnt;
+  int partition;
 
 	/**
-   * True if page is dirty;  false otherwise
+   * Neighbours of the frame in the list of the frames of its file, numBufs
+   * at either end.  Guarded by the latch of the file's FileFrames shard, and
+   * left alone by Clear().
 	 */
-  bool dirty;
+  FrameId filePrev;
+  FrameId fileNext;
 
 	/**
-   * True if page is valid
+   * LSN of the first change logged since the page was last written back, 0
+   * if there is none; at most the LSN of the record, which may not exist yet
 	 */
-  bool valid;
+  std::atomic<Lsn> recLsn;
 
 	/**
-   * Has this buffer frame been reference recently
+   * recLsn of the page while a write-back of it is in flight, 0 otherwise.
+   * A write-back moves recLsn here before clearing it, so that a checkpoint
+   * reading recLsn and then flushingLsn sees it in one or the other.
 	 */
-  bool refbit;
+  std::atomic<Lsn> flushingLsn;
 
 	/**
    * Initialize buffer frame for a new user
@@ -71,6 +158,10 @@ class BufDesc {
     dirty = false;
     refbit = false;
 		valid = false;
+    readFailed = false;
+    prefetched = false;
+    unverified = false;
+    recLsn = 0;
   };
 
 	/**
@@ -111,69 +202,268 @@ class BufDesc {
 	 */
   BufDesc()
 	{
+    writing = false;
+    reading = false;
+    flushingLsn = 0;
   	Clear();
   }
 };
 
 
 /**
-* @brief Class to maintain statistics of buffer usage 
+* @brief When the pages written back by BufMgr become durable
 */
-struct BufStats
-{
+enum WriteMode {
+	WRITE_BUFFERED = 0,     /* at the next flushFile() or checkpoint() */
+	WRITE_GROUP_COMMIT = 1  /* before an eviction reuses the frame; concurrent evictions share an fsync */
+};
+
+
+/**
+* @brief When BufMgr checks the pages it reads from disk against their
+* checksums.  Pages of files without checksums are never checked.
+*/
+enum ChecksumMode {
+	CHECKSUM_ON_MISS = 0,  /* before a page read is handed out; a mismatch throws CorruptPageException */
+	CHECKSUM_SCRUB = 1,    /* later, by a background scrubber; a damaged page is dropped and throws at its next read */
+	CHECKSUM_OFF = 2       /* never */
+};
+
+
+/**
+* @brief Kind of memory pages backing the buffer pool arena.  Each kind falls
+* back to the next one when the system cannot provide it.
+*/
+enum PoolPages {
+	POOL_HUGE_1GB = 0,       /* reserved 1 GB huge pages */
+	POOL_HUGE_2MB = 1,       /* reserved 2 MB huge pages */
+	POOL_HUGE_TRANSPARENT = 2, /* regular pages, 2 MB aligned and offered for transparent huge pages */
+	POOL_SMALL = 3           /* regular pages only */
+};
+
+
+/**
+* @brief Which partition of the buffer pool a page read into it is placed in
+*/
+enum BufPlacement {
+	PLACE_NODE_LOCAL = 0,  /* a partition on the NUMA node of the thread that reads the page */
+	PLACE_HASHED = 1       /* the partition the page hashes to, spreading every file over all nodes */
+};
+
+
+/**
+* @brief One partition of the buffer pool: a contiguous range of frames whose
+* memory is placed on one NUMA node, with its own replacement policy (and
+* clock hand), and the hash table shard of the pages that hash to it.  A page
+* may sit in a frame of another partition than the shard that maps it.
+*/
+struct BufPartition {
+	/**
+   * First frame of the partition
+	 */
+  FrameId firstFrame;
+
 	/**
-   * Total number of accesses to buffer pool
+   * Number of frames reserved for the partition
 	 */
-  int accesses;
+  std::uint32_t numFrames;
+
+	/**
+   * Number of those frames in use, the first ones; the others are reserved
+   * for BufMgr::resize() to grow the partition into
+	 */
+  std::atomic<std::uint32_t> activeFrames;
+
+	/**
+   * NUMA node the frames are placed on
+	 */
+  int node;
+
+	/**
+   * Hash table mapping the pages of this shard to their frames
+	 */
+  std::unique_ptr<BufHashTbl> hashTable;
+
+	/**
+   * Replacement policy choosing the frames of the partition allocBuf reuses
+	 */
+  std::unique_ptr<BufReplacer> replacer;
+};
+
+
+/**
+* @brief Shared state of the shared scans of one file, kept by BufMgr
+*/
+struct SharedScanGroup;
+
+/**
+* @brief Progress of one shared scan, which the others of its file see
+*/
+struct SharedScanMember;
+
+
+/**
+* @brief A sequential scan of every used page of a file, opened by
+* BufMgr::openSharedScan(), that shares its reads with the other shared
+* scans of the file
+*
+* A scan opened while another scan of the file is in progress starts at the
+* page that scan last moved to, reads on to the end of the file and wraps
+* around to the first page, so that scans running together read each page
+* about once between them.  Pages the scans read from disk go into a ring of
+* at most BufMgr::SCAN_RING_FRAMES frames shared by the scans of the file:
+* once it is full, the page read next reuses the frame of the oldest page of
+* the ring, if that page is unpinned and clean, instead of a frame the
+* replacement policy picks.  A scan therefore evicts no more than the ring
+* from the rest of the pool, and pages found in the pool are not counted as
+* references to them.  A scan about to reuse the frame of a page that
+* another scan of the file is within the ring of reading waits for it to
+* move on, for at most a millisecond at a time, so that a scan ahead does
+* not leave the others to read the pages again; a scan that does not move
+* at all meanwhile is not waited for until it does.  Pages are not read ahead into the pool for a shared
+* scan; the operating system is told that the file is read sequentially.
+*
+* Each page returned stays pinned until the next call to next() or the scan
+* is closed, and must not be changed.  A scan is used by one thread at a
+* time, and must be closed before the buffer manager is destroyed.
+*/
+class SharedScan
+{
+ public:
+  SharedScan(SharedScan&& other);
+
+  SharedScan(const SharedScan&) = delete;
+  SharedScan& operator=(const SharedScan&) = delete;
 
 	/**
-   * Number of pages read from disk (including allocs)
+   * Closes the scan
 	 */
-  int diskreads;
+  ~SharedScan();
 
 	/**
-   * Number of pages written back to disk
+	 * Moves to the next used page of the file, unpinning the page the scan
+	 * was at
+	 *
+	 * @param page  	Set to the page, pinned
+	 * @return 		False once every page of the file has been returned; the
+	 *            scan is closed then
+   * @throws CorruptPageException If the page read does not match its checksum
 	 */
-  int diskwrites;
+  bool next(Page*& page);
 
 	/**
-   * Clear all values 
+   * Number of the page the scan is at, Page::INVALID_NUMBER before the
+   * first next() and once it is closed
 	 */
-  void clear()
+  PageId pageNo() const
   {
-		accesses = diskreads = diskwrites = 0;
+		return current;
   }
-      
+
 	/**
-   * Constructor of BufStats class 
+   * Number of the page the scan started at
 	 */
-  BufStats()
+  PageId startPage() const
   {
-		clear();
+		return start;
   }
+
+	/**
+   * Unpins the page the scan is at and leaves the scans of the file;
+   * next() returns false from then on
+	 */
+  void close();
+
+ private:
+  friend class BufMgr;
+
+  SharedScan(BufMgr* bufMgr, File* file, const std::shared_ptr<SharedScanGroup>& group,
+             const std::shared_ptr<SharedScanMember>& member, const PageId start,
+             const PageId limit);
+
+  BufMgr* bufMgr;
+  File* file;
+
+	/**
+   * Scans of the file this one belongs to, and the progress of this one
+   * among them; NULL once it is closed
+	 */
+  std::shared_ptr<SharedScanGroup> group;
+  std::shared_ptr<SharedScanMember> member;
+
+	/**
+   * First page, and bound on the page numbers as the file was opened at
+	 */
+  PageId start;
+  PageId limit;
+
+	/**
+   * Page returned last and still pinned, Page::INVALID_NUMBER if none
+	 */
+  PageId current;
 };
 
 
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* All public methods may be called concurrently from multiple threads.  The
+* hash table is striped so that pins of unrelated pages do not contend, pin
+* counts are atomic, and each frame carries a latch that the replacement
+* policy try-locks while selecting a victim.
+*
+* The pool is split into partitions, by default one per NUMA node, whose
+* frames are placed on their node.  A page read into the pool goes to a
+* frame of its home partition, chosen by the BufPlacement, and to another
+* partition only when every frame there is pinned or busy.
 */
 class BufMgr 
 {
+  friend class SharedScan;
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Number of frames reserved for the buffer pool, the most resize() can
+   * grow it to
 	 */
-  FrameId clockHand;
+  std::uint32_t numBufs;
 
 	/**
-   * Number of frames in the buffer pool
+   * Number of frames in use
 	 */
-  std::uint32_t numBufs;
+  std::atomic<std::uint32_t> activeBufs;
+
+	/**
+   * Serializes resize(); never held while taking another latch but those of
+   * the frames being released
+	 */
+  std::mutex resizeLatch;
 	
 	/**
-   * Hash table mapping (File, page) to frame
+   * Partitions of the pool, each with its own hash table shard and
+   * replacement policy
+	 */
+  std::vector<BufPartition> partitions;
+
+	/**
+   * Partitions on every NUMA node, indexed by node
+	 */
+  std::vector<std::vector<std::uint32_t> > nodePartitions;
+
+	/**
+   * How the home partition of a page is chosen
 	 */
-  BufHashTbl *hashTable;
+  BufPlacement placement;
+
+	/**
+   * Length of the mapping holding bufPool, rounded up to its page size
+	 */
+  std::size_t arenaSize;
+
+	/**
+   * Kind of pages the arena got
+	 */
+  PoolPages arenaPages;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -183,34 +473,637 @@ class BufMgr
 	/**
    * Maintains Buffer pool usage statistics 
 	 */
-  BufStats bufStats;
+  BufStatsCollector bufStats;
+
+	/**
+   * Serializes calls into File that use its shared stream, which is not
+   * threadsafe.  Page reads on a miss are positioned and run without it.
+	 */
+  std::mutex ioLatch;
+
+	/**
+   * When write-backs are made durable
+	 */
+  WriteMode writeMode;
+
+	/**
+   * Log the changes passed to logUpdate() go to, NULL if there is none
+	 */
+  WriteAheadLog *log;
+
+	/**
+   * Files with write-backs that have not been synced since, by name, guarded
+   * by syncLatch.  Handles rather than File pointers, so that a file closed
+   * before it was synced is skipped, not used after it is gone.
+	 */
+  std::unordered_map<std::string, File::SyncHandle> unsyncedFiles;
+
+	/**
+   * Protects unsyncedFiles; never held while taking another latch
+	 */
+  std::mutex syncLatch;
+
+	/**
+   * Issues write-backs of dirty victims and prefetch reads asynchronously
+	 */
+  IoEngine *ioEngine;
+
+	/**
+   * Number of asynchronous write-backs and prefetches in flight and completed
+   * so far, and the errno of the last write-back that failed (0 once
+   * reported); guarded by asyncLatch
+	 */
+  std::uint32_t asyncInFlight;
+  std::uint64_t asyncCompleted;
+  int writeError;
+  std::string writeErrorFile;
+
+	/**
+   * Protects the asynchronous I/O counters; never held while taking another
+   * latch
+	 */
+  std::mutex asyncLatch;
+
+	/**
+   * Signalled with asyncLatch whenever an asynchronous write-back or prefetch
+   * completes
+	 */
+  std::condition_variable asyncDone;
+
+	/**
+   * Sequential access detection of one file
+	 */
+  struct ReadAhead {
+    PageId last;    /* page of the latest miss or first hit on a prefetched page */
+    PageId ahead;   /* first page not prefetched yet */
+    PageId window;  /* pages prefetched by the latest read-ahead */
+  };
+
+	/**
+   * Read-ahead state of every file read through the pool, dropped by
+   * flushFile(); guarded by readAheadLatch
+	 */
+  std::unordered_map<const File*, ReadAhead> readAhead;
+
+	/**
+   * Protects readAhead; never held while taking another latch
+	 */
+  std::mutex readAheadLatch;
+
+	/**
+   * Frames of the files that hash to one shard, each file's threaded into a
+   * list through the descriptors, so that flushFile() visits only the frames
+   * of its file
+	 */
+  struct FileFrames {
+    std::mutex latch;  /* never held while taking another latch */
+    std::unordered_map<const File*, FrameId> heads;  /* first frame of every file with frames */
+  };
+
+	/**
+   * FILE_FRAME_SHARDS shards of the frame lists of the files
+	 */
+  std::unique_ptr<FileFrames[]> fileFrames;
+
+	/**
+   * Pin count of every pinned page of a file opened by File::openMapped();
+   * such pages are used in place and take no frame.  Guarded by mappedLatch.
+	 */
+  std::unordered_map<PageKey, std::uint32_t, PageKeyHash> mappedPins;
+
+	/**
+   * Protects mappedPins; never held while taking another latch
+	 */
+  std::mutex mappedLatch;
+
+	/**
+   * Fraction of the frames the background writer lets be dirty
+	 */
+  double dirtyTarget;
+
+	/**
+   * Background writer, started by the first eviction in each process
+	 */
+  std::unique_ptr<std::thread> flusher;
+
+	/**
+   * Process the background writer runs in, guarded by flushLatch
+	 */
+  pid_t flusherOwner;
+
+	/**
+   * True once the destructor has asked the background writer to return,
+   * guarded by flushLatch
+	 */
+  bool flusherStop;
+
+	/**
+   * Set by evictions since the background writer's last pass
+	 */
+  std::atomic<bool> evictPressure;
+
+	/**
+   * Frame at which the background writer's next pass starts
+	 */
+  FrameId flushCursor;
+
+	/**
+   * Protects the background writer's thread state; never held while taking
+   * another latch
+	 */
+  std::mutex flushLatch;
+
+	/**
+   * Wakes the background writer up
+	 */
+  std::condition_variable flushWake;
+
+	/**
+   * Sidecar file the hot page set is saved to periodically, and how often;
+   * empty while dumpHotSetEvery() has not been called
+	 */
+  std::string hotSetPath;
+  std::chrono::milliseconds hotSetInterval;
+
+	/**
+   * Thread saving the hot page set, and the process it runs in; guarded by
+   * hotSetLatch
+	 */
+  std::unique_ptr<std::thread> hotSetWriter;
+  pid_t hotSetOwner;
+
+	/**
+   * True once the destructor has asked the hot set writer to return,
+   * guarded by hotSetLatch
+	 */
+  bool hotSetStop;
+
+	/**
+   * Protects the hot set writer's state; never held while taking another
+   * latch
+	 */
+  std::mutex hotSetLatch;
+
+	/**
+   * Wakes the hot set writer up to return
+	 */
+  std::condition_variable hotSetWake;
+
+	/**
+   * When pages read are checked against their checksums
+	 */
+  std::atomic<ChecksumMode> checksumMode;
+
+	/**
+   * Set when pages are left to the scrubber, cleared by the scrubber before
+   * each pass
+	 */
+  std::atomic<bool> scrubRequested;
+
+	/**
+   * Thread checking pages read in CHECKSUM_SCRUB mode, and the process it
+   * runs in; guarded by scrubLatch
+	 */
+  std::unique_ptr<std::thread> scrubber;
+  pid_t scrubberOwner;
+
+	/**
+   * True once the destructor has asked the scrubber to return, guarded by
+   * scrubLatch
+	 */
+  bool scrubberStop;
+
+	/**
+   * Protects the scrubber's thread state; never held while taking another
+   * latch
+	 */
+  std::mutex scrubLatch;
+
+	/**
+   * Wakes the scrubber up
+	 */
+  std::condition_variable scrubWake;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Pages the scrubber found damaged and dropped, checked at their next
+   * read whatever the mode but CHECKSUM_OFF; guarded by damagedLatch, a
+   * latch taken last.  damagedCount mirrors their number, so that reads
+   * skip the latch while there are none.
 	 */
-  void advanceClock();
+  std::unordered_set<PageKey, PageKeyHash> damaged;
+  std::atomic<std::uint32_t> damagedCount;
+  std::mutex damagedLatch;
 
 	/**
-	 * Allocate a free frame.  
+   * Shared scans open on every file, dropped once the last of them is
+   * closed; guarded by scanLatch
+	 */
+  std::unordered_map<const File*, std::shared_ptr<SharedScanGroup> > scanGroups;
+
+	/**
+   * Protects scanGroups; never held while taking another latch
+	 */
+  std::mutex scanLatch;
+
+	/**
+	 * Write the page in frame back to its file, timed and counted, and note
+	 * that the file needs a sync.  Called with the frame latch held.
+	 *
+	 * @param frame   	Frame number of the dirty page
+	 */
+  void writeBack(FrameId frame);
+
+	/**
+	 * LSN redo may start from: the oldest recLsn of a page not yet written
+	 * back, or the end of the log if there is none
+	 */
+  Lsn redoPoint();
+
+	/**
+	 * Sync file and forget that it has unsynced write-backs
+	 *
+	 * @param file   	File object
+	 */
+  void syncFile(const File* file);
+
+	/**
+	 * Sync the file of a handle, if it is still open, and forget that it has
+	 * unsynced write-backs
+	 *
+	 * @param name   	Name of the file
+	 * @param handle 	Handle on the file
+	 */
+  void syncFile(const std::string& name, const File::SyncHandle& handle);
+
+	/**
+	 * Note that file has a write-back that has not been synced yet
+	 *
+	 * @param file   	File object
+	 */
+  void noteUnsynced(const File* file);
+
+	/**
+	 * Queue an asynchronous write-back of the dirty page in frame, which is
+	 * kept out of the replacement policy until the write completes.  Called
+	 * with the frame latch held and the dirty bit cleared; the write is
+	 * issued by the next ioEngine->submit().
+	 *
+	 * @param frame   	Frame number of the dirty page
+	 */
+  void startWriteBack(FrameId frame);
+
+	/**
+	 * Completion of startWriteBack(), run on the I/O engine's thread
+	 */
+  void finishWriteBack(FrameId frame, std::uint64_t start, int error);
+
+	/**
+	 * Completion of a prefetch read into frame, run on the I/O engine's thread
+	 */
+  void finishPrefetch(FrameId frame, int error);
+
+	/**
+	 * Wait until an asynchronous write-back or prefetch of frame, if any, has
+	 * completed.  Called with the frame latch or a pin held.
+	 *
+	 * @param frame   	Frame number
+	 */
+  void waitForIo(FrameId frame);
+
+	/**
+	 * Finish a hit of readPage on a frame it pinned, waiting for a prefetch of
+	 * the frame to complete
+	 *
+	 * @param frame   	Frame number, pinned by the caller
+	 * @param file   	File object
+	 * @param pageNo  	Page number
+	 * @param page  	Set to the frame's page on success
+	 * @param reference	Count the hit as a reference by the replacement policy
+	 * @return 		False if the prefetch failed and the pin was dropped
+	 */
+  bool usePinned(FrameId frame, File* file, const PageId pageNo, Page*& page,
+                 const bool reference = true);
+
+	/**
+	 * Unpin a frame whose prefetch failed and drop it once no reader holds it
+	 *
+	 * @param frame   	Frame number, pinned by the caller
+	 * @param file   	File object
+	 * @param pageNo  	Page number the frame was prefetching
+	 */
+  void dropFailedPrefetch(FrameId frame, File* file, PageId pageNo);
+
+	/**
+	 * Wake the background writer up, starting it if this process has none
+	 */
+  void wakeFlusher();
+
+	/**
+	 * Body of the background writer: after evictions, write back dirty
+	 * unpinned frames until at most dirtyTarget of the pool is dirty
+	 */
+  void runFlusher();
+
+	/**
+	 * Body of the hot set writer: save the hot page set to hotSetPath every
+	 * hotSetInterval
+	 */
+  void runHotSetWriter();
+
+	/**
+	 * Check the page just read into frame against its checksum, as the mode
+	 * asks, and count it verified if it matches.  In CHECKSUM_SCRUB mode the
+	 * frame is left to the scrubber instead.  Failures are left to the caller
+	 * to count.
+	 *
+	 * @param frame   	Frame number of the page, not yet handed out
+	 * @param file   	File the page was read from
+	 * @param pageNo  	Page number
+	 * @return 		False if the page does not match its checksum
+	 */
+  bool checkRead(FrameId frame, File* file, const PageId pageNo);
+
+	/**
+	 * Wake the scrubber up, starting it in this process if needed
+	 */
+  void wakeScrubber();
+
+	/**
+	 * Body of the scrubber: check the frames left to it whenever pages are
+	 * left to it, retrying the pinned ones after SCRUB_RETRY
+	 */
+  void runScrubber();
+
+	/**
+	 * Check every unpinned clean frame left to the scrubber, dropping the
+	 * damaged pages from the pool and noting them in damaged
+	 *
+	 * @return 		True if frames were skipped because they were busy
+	 */
+  bool scrubPass();
+
+	/**
+	 * Forget the damaged pages of file, when its pages leave the pool
+	 */
+  void forgetDamaged(const File* file);
+
+	/**
+	 * Write back up to FLUSH_BATCH dirty unpinned frames in one batch, found
+	 * from flushCursor on, and wait for the writes (and, with
+	 * WRITE_GROUP_COMMIT, their syncs).  The frames stay resident and
+	 * evictable once clean.
+	 *
+	 * @return 		Number of frames written back
+	 */
+  std::uint32_t flushBatch();
+
+	/**
+	 * Order the pages by hash table stripe, so that a batch takes every
+	 * stripe latch once
+	 *
+	 * @param file   	File object
+	 * @param pageNos  	Page numbers
+	 * @param count  	Number of pages
+	 * @param order  	Set to the indexes of the pages, grouped by stripe
+	 * @param stripes  	Set to the stripe latch of every page
+	 */
+  void groupByStripe(const File* file, const PageId* pageNos, const std::size_t count,
+                     std::vector<std::size_t>& order, std::vector<std::mutex*>& stripes);
+
+	/**
+	 * Read the pages that readPages() did not find in the pool, all misses
+	 * the pool has frames for in one batch of I/O, and pin them
+	 *
+	 * @param file   	File object
+	 * @param pageNos  	Page numbers requested by readPages()
+	 * @param missing  	Indexes of the pages to read
+	 * @param pages  	Receives the frame of every page read
+	 * @param pinned  	Set for every page pinned, so that the caller can undo
+	 */
+  void readMissing(File* file, const PageId* pageNos, const std::vector<std::size_t>& missing,
+                   Page** pages, std::vector<char>& pinned);
+
+	/**
+	 * readPage() of a page of a file not mapped.  For a shared scan, a miss
+	 * is read into the ring of its file and neither a miss nor a hit is
+	 * counted as a reference to the page by the replacement policy.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  	Page number
+	 * @param page  	Set to the page
+	 * @param scan  	Shared scan the page is read for, or NULL
+	 */
+  void readFrame(File* file, const PageId pageNo, Page*& page, SharedScan* scan);
+
+	/**
+	 * Take the next slot of the ring of the shared scans of a file for a
+	 * page about to be read, and reuse the frame of the page it holds if
+	 * that page is unpinned and clean, once the scans about to read it have.
+	 * The frame is returned as allocBuf() returns it.
+	 *
+	 * @param frame   	Set to the frame reused
+	 * @param scan  	Shared scan the page is read for
+	 * @param slot  	Set to the slot taken, to be given the frame the page is read into
+	 * @return 		False if no frame was reused, and one has to be allocated
+	 */
+  bool reuseRingFrame(FrameId& frame, SharedScan& scan, std::uint32_t& slot);
+
+	/**
+	 * Wait for the other shared scans of a file that are within the ring of
+	 * reading a page to read it, as long as they move
+	 *
+	 * @param scan  	Shared scan about to evict the page
+	 * @param pageNo  	Page number
+	 */
+  void waitForScansBehind(SharedScan& scan, const PageId pageNo);
+
+	/**
+	 * Leave the shared scans of a file, dropping them once none is left
+	 */
+  void leaveSharedScan(const File* file, const std::shared_ptr<SharedScanGroup>& group,
+                       const std::shared_ptr<SharedScanMember>& member);
+
+	/**
+	 * Feed a miss, or the first hit on a prefetched page, to the sequential
+	 * access detection of file, prefetching ahead of the reader once two
+	 * consecutive pages were read
+	 *
+	 * @param file   	File object
+	 * @param pageNo  	Page number read
+	 */
+  void noteRead(File* file, PageId pageNo);
+
+	/**
+	 * readPage() of a file opened by File::openMapped(): pin the page and
+	 * return it in place in the mapping
+	 *
+	 * @param file   	Mapped file
+	 * @param pageNo  	Page number
+	 * @param page  	Set to the page in the mapping
+	 */
+  void readMapped(File* file, const PageId pageNo, Page*& page);
+
+	/**
+	 * unPinPage() of a file opened by File::openMapped()
+	 *
+	 * @param file   	Mapped file
+	 * @param pageNo  	Page number
+	 * @param dirty		Must be false
+	 */
+  void unPinMapped(File* file, const PageId pageNo, const bool dirty);
+
+	/**
+	 * Allocate a free frame, evicting the victim chosen by the replacement
+	 * policy if there is none.  The frame is returned cleared, absent from the
+	 * hash table and with its latch held; the caller releases the latch once
+	 * the frame has been filled and published (or abandoned).  Dirty victims
+	 * are written back in the background, all of those found by one call in
+	 * one batch, and the search goes on for a clean one; if there is none it
+	 * waits for a write-back to complete.  Frames of the home partition of
+	 * the page are preferred, the other partitions are tried in turn.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param file   	File of the page the frame is for
+	 * @param pageNo  	Page the frame is for
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 * @throws FileIOException If a background write-back failed
+	 */
+  void allocBuf(FrameId & frame, const File* file, const PageId pageNo);
+
+	/**
+	 * Assign a frame to a page, as BufDesc::Set() does, and add it to the
+	 * list of the frames of the file.  Called with the frame latch and the
+	 * stripe latch of the page held.
+	 *
+	 * @param frame   	Frame number
+	 * @param file   	File object
+	 * @param pageNo  	Page number in the file
+	 */
+  void assignFrame(FrameId frame, File* file, const PageId pageNo);
+
+	/**
+	 * Take a frame off the list of the frames of its file, if it has one, and
+	 * clear it as BufDesc::Clear() does.  Called with the frame latch held.
+	 *
+	 * @param frame   	Frame number
+	 */
+  void releaseFrame(FrameId frame);
+
+	/**
+	 * Shard of the frame lists holding the list of file
+	 */
+  FileFrames& framesOf(const File* file);
+
+	/**
+	 * Evict the page of a frame that its replacer has retired, writing it back
+	 * if it is dirty, and take the frame out of the policy.  Waits while the
+	 * page is pinned or its I/O is in flight.
+	 *
+	 * @param frame   	Frame number
+   * @throws FileIOException If the page cannot be written back
+	 */
+  void drainFrame(FrameId frame);
+
+	/**
+	 * Give the memory of frames no longer in use back to the system, as much
+	 * of it as whole pages of the arena cover
+	 *
+	 * @param first   	First frame
+	 * @param count   	Number of frames
+	 */
+  void releaseMemory(FrameId first, std::uint32_t count);
+
+	/**
+	 * Partition whose hash table shard maps (file, pageNo)
+	 */
+  std::uint32_t shardOf(const File* file, const PageId pageNo) const
+  {
+		return (BufHashTbl::hash(file, pageNo) >> 48) % partitions.size();
+  }
+
+	/**
+	 * Hash table shard mapping (file, pageNo)
 	 */
-  void allocBuf(FrameId & frame);
+  BufHashTbl& tableOf(const File* file, const PageId pageNo)
+  {
+		return *partitions[shardOf(file, pageNo)].hashTable;
+  }
+
+	/**
+	 * Replacement policy of the partition frame belongs to
+	 */
+  BufReplacer& replacerOf(const FrameId frame)
+  {
+		return *partitions[bufDescTable[frame].partition].replacer;
+  }
+
+	/**
+	 * Partition whose frames a page read now should be placed in
+	 *
+	 * @param file   	File object
+	 * @param pageNo  	Page number
+	 */
+  std::uint32_t homePartition(const File* file, const PageId pageNo) const;
 
  public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Most frames in the ring of the shared scans of a file; the ring takes
+   * an eighth of the pool if that is fewer
+	 */
+  static const std::uint32_t SCAN_RING_FRAMES = 32;
+
+	/**
+   * Actual buffer pool from which frames are allocated, one contiguous
+   * page aligned array of numBufs pages, of which the frames not in use
+   * take no memory
 	 */
   Page* bufPool;
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs    Number of frames in the buffer pool
+	 * @param policy  Page replacement policy.  The default, 2Q, keeps pages that
+	 *                are re-referenced (such as B+ tree inner nodes) resident
+	 *                while large sequential scans stream through.
+	 * @param mode    When written back pages become durable.  Files written
+	 *                back must stay open until flushFile() or checkpoint() has
+	 *                been called for them.  With WRITE_GROUP_COMMIT victims
+	 *                are written back and synced before allocBuf() returns
+	 *                instead of in the background.
+	 * @param dirtyTarget  Fraction of the frames that may stay dirty.  Once
+	 *                the pool evicts, a background writer trickles dirty
+	 *                unpinned frames to disk beyond it, so that victims are
+	 *                mostly clean; 1 disables the writer.
+	 * @param partitionCount  Number of partitions, spread round robin over
+	 *                the NUMA nodes with memory; 0 makes one per node.  At
+	 *                most BufStatsCollector::MAX_PARTITIONS and bufs are made.
+	 * @param placement  Which partition pages are read into
+	 * @param pages   Kind of memory pages to back the pool with; large pools
+	 *                take fewer TLB misses on huge pages.  Kinds the system
+	 *                cannot provide fall back to smaller ones.
+	 * @param log     Write-ahead log for logUpdate(), or NULL.  No page is
+	 *                written back before the log records of its changes are
+	 *                durable.  The log must outlive the buffer manager, and
+	 *                WriteAheadLog::recover() be called before it reads the files.
+	 * @param maxBufs Number of frames resize() may grow the pool to, bufs if
+	 *                smaller.  Their address space and descriptors are
+	 *                reserved up front, their memory only once they are in
+	 *                use; reserved huge pages are taken for all of them.
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, const ReplacementPolicy policy = TWO_Q,
+         const WriteMode mode = WRITE_BUFFERED, const double dirtyTarget = 0.1,
+         const int partitionCount = 0, const BufPlacement placement = PLACE_NODE_LOCAL,
+         const PoolPages pages = POOL_HUGE_TRANSPARENT, WriteAheadLog *log = NULL,
+         const std::uint32_t maxBufs = 0);
 	
 	/**
-   * Destructor of BufMgr class
+   * Destructor of BufMgr class.  Stops the background writer and saves the
+   * hot page set if dumpHotSetEvery() was called, then writes back and
+   * syncs the dirty pages of every file that is still open; pages
+   * of closed files are dropped, but their logged changes are redone by
+   * WriteAheadLog::recover().  File objects with pages in the pool must
+   * outlive the buffer manager or be flushed first.
 	 */
   ~BufMgr();
 
@@ -218,23 +1111,89 @@ class BufMgr
 	 * Reads the given page from the file into a frame and returns the pointer to page.
 	 * If the requested page is already present in the buffer pool pointer to that frame is returned
 	 * otherwise a new frame is allocated from the buffer pool for reading the page.
+	 * Pages of a file opened by File::openMapped() are pinned without a frame
+	 * and returned in place in the mapping; they must not be written to.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+   * @throws CorruptPageException If the page read does not match its checksum, see verifyChecksums()
 	 */
   void readPage(File* file, const PageId PageNo, Page*& page);
 
+	/**
+	 * Opens a shared scan of every used page of the file, see SharedScan.  It
+	 * joins the shared scans of the file in progress, if any, at the page the
+	 * latest of them moved to.
+	 *
+	 * @param file   	File object
+	 * @return 		The scan, before its first page
+	 */
+  SharedScan openSharedScan(File* file);
+
+	/**
+	 * Reads several pages of the file, as readPage() does for each of them.
+	 * Pages in the pool are pinned in one pass that takes each hash table
+	 * latch once, and the misses are read in one batch of I/O.  Page numbers
+	 * may repeat, each occurrence pins the page once.  If an exception is
+	 * thrown no page is left pinned.
+	 *
+	 * @param file   	File object
+	 * @param pageNos  	Numbers of the pages to read
+	 * @param count  	Number of pages
+	 * @param pages  	Array of count page pointers, set to the frame of each page
+	 * @throws BufferExceededException If the pages do not fit into the unpinned frames
+	 * @throws InvalidPageException If a page is not in use
+	 * @throws CorruptPageException If a page read does not match its checksum
+	 */
+  void readPages(File* file, const PageId* pageNos, const std::size_t count, Page** pages);
+
+	/**
+	 * Unpins several pages of the file, as unPinPage() does for each of them,
+	 * taking each hash table latch once
+	 *
+	 * @param file   	File object
+	 * @param pageNos  	Numbers of the pages to unpin
+	 * @param count  	Number of pages
+	 * @param dirty		True if the pages need to be marked dirty
+   * @throws  PageNotPinnedException If a page is not pinned; the other pages are still unpinned
+	 */
+  void unPinPages(File* file, const PageId* pageNos, const std::size_t count, const bool dirty);
+
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
+	 * A page unpinned dirty has its free space recorded in the free space map
+	 * of the file (File::recordFreeSpace()) before it is written back.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number
 	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
    * @throws  PageNotPinnedException If the page is not already pinned
+   * @throws  ReadOnlyFileException If dirty is set for a page of a mapped file
 	 */
   void unPinPage(File* file, const PageId PageNo, const bool dirty);
 
+	/**
+	 * Logs a change the caller has made to a page it has pinned: length bytes
+	 * at offset of the page, copied from its frame, in one record of the
+	 * write-ahead log, which becomes the LSN of the page.  The page is marked
+	 * dirty.  The change is durable once WriteAheadLog::flush() has been
+	 * called for the LSN returned, without writing the page; changes only
+	 * marked dirty by unPinPage() become durable through flushFile() and
+	 * checkpoint() alone.  Allocating and disposing of pages is not logged.
+	 * Without a log the page is only marked dirty.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  	Page number
+	 * @param offset  	Offset of the change in the page, counting the page header
+	 * @param length  	Number of bytes changed
+	 * @return 		LSN of the record, 0 without a log
+   * @throws  PageNotPinnedException If the page is not pinned
+   * @throws  ReadOnlyFileException If the page is of a mapped file
+   * @throws  FileIOException If the log has failed
+	 */
+  Lsn logUpdate(File* file, const PageId pageNo, const std::size_t offset, const std::size_t length);
+
 	/**
 	 * Allocates a new, empty page in the file and returns the Page object.
 	 * The newly allocated page is also assigned a frame in the buffer pool.
@@ -246,9 +1205,27 @@ class BufMgr
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Starts reading pages firstPage to firstPage + count - 1 of the file into
+	 * unpinned frames in the background and returns without waiting, so that
+	 * later readPage() calls for them hit.  Pages already in the pool, not in
+	 * use or beyond the end of the file are skipped, and prefetching stops
+	 * early when no frame can be had.  readPage() calls that are sequential
+	 * within a file prefetch ahead by themselves.  For a file opened by
+	 * File::openMapped() the operating system is asked to read the pages.
+	 *
+	 * @param file   	File object
+	 * @param firstPage	Number of the first page to prefetch
+	 * @param count		Number of pages to prefetch
+   * @throws FileIOException If a background write-back failed
+	 */
+  void prefetch(File* file, const PageId firstPage, const PageId count);
+
+	/**
+	 * Writes out all dirty pages of the file to disk and syncs it.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
+	 * Otherwise Error returned.  Only the frames of the file are visited, from
+	 * the list the pool keeps of them, and written back in page order, so the
+	 * cost is that of the pages of the file in the pool, not of the pool.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
@@ -256,6 +1233,83 @@ class BufMgr
 	 */
   void flushFile(const File* file);
 
+	/**
+	 * Writes every dirty page in the buffer pool back to its file and syncs
+	 * every file written back since the last sync, so that all changes
+	 * unpinned before the call are durable when it returns.  Pages stay in
+	 * the pool, and pinned pages may be checkpointed while in use.  With a
+	 * write-ahead log, recovery then starts from the oldest change logged
+	 * since, as after fuzzyCheckpoint().
+	 *
+   * @throws  FileIOException If a write or sync fails
+	 */
+  void checkpoint();
+
+	/**
+	 * Shortens the write-ahead log without writing pages back: syncs every
+	 * file written back since the last sync and records in the log that
+	 * recovery may start from the oldest logged change of a page not written
+	 * back yet, removing the log segments before it.  The background writer
+	 * and evictions move that point on as they clean pages.  Without a log
+	 * only the files are synced.
+	 *
+	 * @return 		LSN recovery starts from, 0 without a log
+   * @throws  FileIOException If a sync or the log fails
+	 */
+  Lsn fuzzyCheckpoint();
+
+	/**
+	 * Saves the pages in the pool to a sidecar file, hottest first: pinned
+	 * and recently referenced pages, then the others.  Pages are recorded by
+	 * file name and page number, so that warmUp() can read them back into a
+	 * later buffer manager.  The sidecar is replaced atomically.  Pages of
+	 * mapped or closed files are left out.
+	 *
+	 * @param path   	Name of the sidecar file
+   * @throws FileIOException If the sidecar cannot be written
+	 */
+  void saveHotSet(const std::string& path);
+
+	/**
+	 * Reads the pages saved by saveHotSet() back into the pool, the hottest
+	 * ones that fit in its frames.  They are sorted by file and page number
+	 * and prefetched in sequential runs, so the pool refills in few large
+	 * batches of I/O instead of a readPage() miss at a time.  Pages of files
+	 * not among files, no longer in use or beyond the end of their file are
+	 * skipped.  Returns without waiting for the reads.
+	 *
+	 * @param path   	Name of the sidecar file; missing or damaged ones are ignored
+	 * @param files  	Open files whose pages may be read, matched by name
+	 * @return 		Number of pages prefetching was started for
+   * @throws FileIOException If a background write-back failed
+	 */
+  std::uint32_t warmUp(const std::string& path, const std::vector<File*>& files);
+
+	/**
+	 * Saves the hot page set to path every interval from a thread of its own,
+	 * and once more when the buffer manager is destroyed.  Failed saves are
+	 * dropped; the next one tries again.  Calling it again changes the path
+	 * and interval.  The thread is not carried over fork().
+	 *
+	 * @param path   	Name of the sidecar file
+	 * @param interval	Time between saves
+	 */
+  void dumpHotSetEvery(const std::string& path, const std::chrono::milliseconds interval);
+
+	/**
+	 * Sets when the pages read from disk are checked against their checksums;
+	 * CHECKSUM_ON_MISS until it is called.  With CHECKSUM_SCRUB a miss costs
+	 * no more than without checksums: a scrubber thread checks the pages once
+	 * they are unpinned, and drops the damaged ones, counted in
+	 * BufStats::checksumFailures, so that their next read throws
+	 * CorruptPageException.  Pages dirtied before the scrubber reached them
+	 * are not checked.  Pages of mapped files are used in place and never
+	 * checked.  The scrubber is not carried over fork().
+	 *
+	 * @param mode   	When pages are checked
+	 */
+  void verifyChecksums(const ChecksumMode mode);
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
@@ -271,15 +1325,64 @@ class BufMgr
   void  printSelf();
 
 	/**
-   * Get buffer pool usage statistics
+	 * Grows or shrinks the pool to bufs frames while it is in use, spread over
+	 * the partitions in proportion to the frames reserved for them.  Frames
+	 * added are free at once.  Frames removed, the last ones of each
+	 * partition, are no longer handed out; their pages are evicted one at a
+	 * time, dirty ones written back, and their memory given back to the
+	 * system.  Other threads go on using the pool meanwhile, pages of the
+	 * frames being removed included, and the call waits for those to be
+	 * unpinned, so the caller itself must not hold them pinned.  Calls are
+	 * serialized.
+	 *
+	 * @param bufs   	Number of frames, between 1 and poolCapacity()
+   * @throws BadgerDbException If bufs is out of range
+   * @throws FileIOException If a page of a frame removed cannot be written
+   *         back; the frames not removed yet stay in use
 	 */
-  BufStats & getBufStats()
+  void resize(const std::uint32_t bufs);
+
+	/**
+   * Number of frames in use
+	 */
+  std::uint32_t poolSize() const
   {
-		return bufStats;
+		return activeBufs;
+  }
+
+	/**
+   * Number of frames the pool can grow to
+	 */
+  std::uint32_t poolCapacity() const
+  {
+		return numBufs;
+  }
+
+	/**
+   * Kind of memory pages the buffer pool actually got
+	 */
+  PoolPages poolPages() const
+  {
+		return arenaPages;
+  }
+
+	/**
+   * Get a snapshot of buffer pool usage statistics, overall, per file and
+   * per partition.  Safe to call from a monitoring thread while the pool is
+   * in use.
+	 */
+  BufStats getBufStats()
+  {
+		BufStats stats = bufStats.snapshot();
+		for (std::size_t p = 0; p < partitions.size(); p++) {
+			stats.partitions[p].node = partitions[p].node;
+			stats.partitions[p].frames = partitions[p].activeFrames;
+		}
+		return stats;
   }
 
 	/**
-   * Clear buffer pool usage statistics
+   * Clear buffer pool usage statistics; safe to call while the pool is in use
 	 */
   void clearBufStats() 
   {
@@ -0,0 +1,176 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#include <arm_acle.h>
+#endif
+
+namespace badgerdb {
+
+namespace {
+
+// The Castagnoli polynomial, bit reversed.
+const std::uint32_t POLY = 0x82f63b78;
+
+// Bytes of each of the three lanes of a long input.  Three lanes fit a page
+// once, so a page takes a single combine.
+const std::size_t LANE = 2560;
+
+std::uint64_t read64(const unsigned char* bytes) {
+  std::uint64_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+// Tables of the CRC of a byte followed by 0 to 7 zero bytes.
+struct Tables {
+  std::uint32_t slice[8][256];
+
+  Tables() {
+    for (std::uint32_t i = 0; i < 256; i++) {
+      std::uint32_t c = i;
+      for (int bit = 0; bit < 8; bit++) {
+        c = c & 1 ? (c >> 1) ^ POLY : c >> 1;
+      }
+      slice[0][i] = c;
+    }
+    for (std::uint32_t i = 0; i < 256; i++) {
+      for (int k = 1; k < 8; k++) {
+        slice[k][i] = (slice[k - 1][i] >> 8) ^ slice[0][slice[k - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+const Tables& tables() {
+  static const Tables instance;
+  return instance;
+}
+
+// Runs the CRC register c over length bytes, eight at a time.
+std::uint32_t tableRun(std::uint32_t c, const unsigned char* bytes,
+                       std::size_t length) {
+  const Tables& t = tables();
+  for (; length >= 8; bytes += 8, length -= 8) {
+    const std::uint64_t word = read64(bytes) ^ c;
+    c = t.slice[7][word & 0xff] ^ t.slice[6][(word >> 8) & 0xff] ^
+        t.slice[5][(word >> 16) & 0xff] ^ t.slice[4][(word >> 24) & 0xff] ^
+        t.slice[3][(word >> 32) & 0xff] ^ t.slice[2][(word >> 40) & 0xff] ^
+        t.slice[1][(word >> 48) & 0xff] ^ t.slice[0][word >> 56];
+  }
+  for (; length > 0; bytes++, length--) {
+    c = (c >> 8) ^ t.slice[0][(c ^ *bytes) & 0xff];
+  }
+  return c;
+}
+
+#if (defined(__SSE4_2__) && defined(__x86_64__)) || \
+    (defined(__ARM_FEATURE_CRC32) && defined(__aarch64__))
+#define BADGERDB_CRC32C_HARDWARE 1
+
+std::uint32_t crcWord(const std::uint32_t c, const std::uint64_t word) {
+#if defined(__SSE4_2__)
+  return static_cast<std::uint32_t>(_mm_crc32_u64(c, word));
+#else
+  return __crc32cd(c, word);
+#endif
+}
+
+std::uint32_t crcByte(const std::uint32_t c, const unsigned char byte) {
+#if defined(__SSE4_2__)
+  return _mm_crc32_u8(c, byte);
+#else
+  return __crc32cb(c, byte);
+#endif
+}
+
+// Product of the polynomials a and b modulo POLY, bit reversed as the
+// register is.
+std::uint32_t multiplyModPoly(std::uint32_t a, std::uint32_t b) {
+  std::uint32_t product = 0;
+  for (std::uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+    if (a & bit) {
+      product ^= b;
+    }
+    b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+  }
+  return product;
+}
+
+// x to the power of 8 * bytes modulo POLY: multiplying a register by it
+// runs the register over that many zero bytes.
+std::uint32_t zeroBytesOperator(std::size_t bytes) {
+  std::uint32_t power = 1u << 31;   // x^0
+  std::uint32_t square = 1u << 23;  // x^8
+  for (; bytes != 0; bytes >>= 1) {
+    if (bytes & 1) {
+      power = multiplyModPoly(power, square);
+    }
+    square = multiplyModPoly(square, square);
+  }
+  return power;
+}
+
+// Runs the CRC register c over length bytes with the instructions.
+std::uint32_t hardwareRun(std::uint32_t c, const unsigned char* bytes,
+                          std::size_t length) {
+  static const std::uint32_t shiftOne = zeroBytesOperator(LANE);
+  static const std::uint32_t shiftTwo = zeroBytesOperator(2 * LANE);
+  // Each instruction waits for the one before; three independent lanes keep
+  // the unit busy.
+  for (; length >= 3 * LANE; bytes += 3 * LANE, length -= 3 * LANE) {
+    std::uint32_t a = c;
+    std::uint32_t b = 0;
+    std::uint32_t d = 0;
+    for (std::size_t i = 0; i < LANE; i += 8) {
+      a = crcWord(a, read64(bytes + i));
+      b = crcWord(b, read64(bytes + LANE + i));
+      d = crcWord(d, read64(bytes + 2 * LANE + i));
+    }
+    c = multiplyModPoly(a, shiftTwo) ^ multiplyModPoly(b, shiftOne) ^ d;
+  }
+  for (; length >= 8; bytes += 8, length -= 8) {
+    c = crcWord(c, read64(bytes));
+  }
+  for (; length > 0; bytes++, length--) {
+    c = crcByte(c, *bytes);
+  }
+  return c;
+}
+#endif
+
+}
+
+std::uint32_t Crc32c::extend(const std::uint32_t crc, const void* data,
+                             const std::size_t length) {
+#if defined(BADGERDB_CRC32C_HARDWARE)
+  return ~hardwareRun(~crc, static_cast<const unsigned char*>(data), length);
+#else
+  return extendPortable(crc, data, length);
+#endif
+}
+
+std::uint32_t Crc32c::extendPortable(const std::uint32_t crc, const void* data,
+                                     const std::size_t length) {
+  return ~tableRun(~crc, static_cast<const unsigned char*>(data), length);
+}
+
+bool Crc32c::hardware() {
+#if defined(BADGERDB_CRC32C_HARDWARE)
+  return true;
+#else
+  return false;
+#endif
+}
+
+}
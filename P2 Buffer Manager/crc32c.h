@@ -0,0 +1,50 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+* @brief CRC-32C (Castagnoli), the checksum of pages on disk
+*
+* Computed with the CRC32 instructions of SSE4.2 on x86 and of ARMv8 when the
+* build targets them (-msse4.2 or -march=native, -march=armv8-a+crc), and with
+* tables eight bytes at a time otherwise.  Long inputs are split into three
+* lanes checksummed together and combined, which hides the latency of the
+* instructions.
+*/
+class Crc32c {
+ public:
+	/**
+	 * Extends the checksum crc of some bytes with length more bytes
+	 *
+	 * @param crc       Checksum of the bytes before, 0 for none
+	 * @param data      Bytes to add
+	 * @param length    Number of bytes
+	 * @return  Checksum of the bytes before followed by data
+	 */
+  static std::uint32_t extend(const std::uint32_t crc, const void* data,
+                              const std::size_t length);
+
+	/**
+	 * extend() with the tables, whatever the build targets; for tests and
+	 * benchmarks
+	 */
+  static std::uint32_t extendPortable(const std::uint32_t crc, const void* data,
+                                      const std::size_t length);
+
+	/**
+	 * True if extend() uses CRC instructions
+	 */
+  static bool hardware();
+};
+
+}
@@ -0,0 +1,23 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "read_only_file_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+ReadOnlyFileException::ReadOnlyFileException(const std::string& name,
+                                             const std::string& operation)
+    : BadgerDbException(""), filename_(name) {
+  std::stringstream ss;
+  ss << "Cannot " << operation << " read-only file " << filename_;
+  message_.assign(ss.str());
+}
+
+}
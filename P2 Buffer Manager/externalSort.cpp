@@ -0,0 +1,369 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "externalSort.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+const std::uint32_t ExternalSort::MIN_FRAMES;
+
+/**
+ * Entries tying on their prefix that are sorted by insertion instead of a
+ * call to std::sort
+ */
+static const std::size_t SMALL_GROUP = 16;
+
+/**
+ * True if a goes before b by their bytes
+ */
+static bool bytesBefore(const RecordView& a, const RecordView& b)
+{
+  const int order = std::memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+  return order < 0 || (order == 0 && a.size() < b.size());
+}
+
+/**
+ * First eight bytes of a record as a big-endian number, padded with zeros
+ */
+static std::uint64_t prefixOf(const RecordView& record)
+{
+  std::uint64_t prefix = 0;
+  const std::size_t length = std::min<std::size_t>(record.size(), sizeof(prefix));
+  for (std::size_t i = 0; i < length; i++) {
+    prefix |= static_cast<std::uint64_t>(static_cast<unsigned char>(record[i])) << (56 - 8 * i);
+  }
+  return prefix;
+}
+
+ExternalSort::ExternalSort(BufMgr& bufMgr, const std::uint32_t frames, const std::string& path,
+                           const Less& less)
+  : bufMgr(bufMgr), frames(std::max(frames, MIN_FRAMES)), path(path), less(less),
+    workspaceBytes(0), runCount(0), added(0), reading(false), emitted(0), winner(0),
+    advance(false) {}
+
+ExternalSort::~ExternalSort()
+{
+  // Nothing to report a failure to; what cannot be removed stays behind.
+  try {
+    closeMerge();
+  } catch (...) {
+  }
+  for (const std::string& name : runs) {
+    try {
+      File::remove(name);
+    } catch (...) {
+    }
+  }
+}
+
+bool ExternalSort::before(const RecordView& a, const RecordView& b) const
+{
+  return less ? less(a, b) : bytesBefore(a, b);
+}
+
+void ExternalSort::add(const RecordView& record)
+{
+  if (reading) {
+    throw BadgerDbException("Record added to the sort of " + path + " after it was read");
+  }
+  if (record.size() + sizeof(PageSlot) > Page::DATA_SIZE) {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, record.size(), Page::DATA_SIZE);
+  }
+  // Offsets of entries are 32 bits, which bounds the workspace.
+  const std::size_t capacity = std::min<std::size_t>(
+      static_cast<std::size_t>(frames) * Page::SIZE, std::numeric_limits<std::uint32_t>::max());
+  const std::size_t bytes = record.size() + sizeof(Entry);
+  if (workspaceBytes + bytes > capacity && !entries.empty()) {
+    spill();
+  }
+  if (workspace.capacity() == 0) {
+    workspace.reserve(capacity);
+  }
+  Entry entry;
+  entry.prefix = prefixOf(record);
+  entry.offset = static_cast<std::uint32_t>(workspace.size());
+  entry.length = static_cast<std::uint32_t>(record.size());
+  workspace.insert(workspace.end(), record.begin(), record.end());
+  entries.push_back(entry);
+  workspaceBytes += bytes;
+  added++;
+}
+
+void ExternalSort::sortWorkspace()
+{
+  if (less) {
+    std::sort(entries.begin(), entries.end(), [this](const Entry& a, const Entry& b) {
+      return less(recordOf(a), recordOf(b));
+    });
+    return;
+  }
+  // Least significant digit radix sort of the prefixes, a byte at a time,
+  // skipping the bytes every prefix shares.
+  const std::size_t count = entries.size();
+  std::vector<Entry> sorted(count);
+  for (unsigned shift = 0; shift < 64; shift += 8) {
+    std::size_t offsets[256] = {0};
+    for (const Entry& entry : entries) {
+      offsets[(entry.prefix >> shift) & 0xff]++;
+    }
+    if (offsets[entries.empty() ? 0 : (entries[0].prefix >> shift) & 0xff] == count) {
+      continue;
+    }
+    std::size_t start = 0;
+    for (std::size_t& offset : offsets) {
+      const std::size_t digits = offset;
+      offset = start;
+      start += digits;
+    }
+    for (const Entry& entry : entries) {
+      sorted[offsets[(entry.prefix >> shift) & 0xff]++] = entry;
+    }
+    entries.swap(sorted);
+  }
+  // Records tying on their prefix are ordered by the rest of their bytes.
+  const auto order = [this](const Entry& a, const Entry& b) {
+    return bytesBefore(recordOf(a), recordOf(b));
+  };
+  for (std::size_t first = 0; first < count;) {
+    std::size_t last = first + 1;
+    while (last < count && entries[last].prefix == entries[first].prefix) {
+      last++;
+    }
+    if (last - first > SMALL_GROUP) {
+      std::sort(entries.begin() + first, entries.begin() + last, order);
+    } else {
+      for (std::size_t i = first + 1; i < last; i++) {
+        const Entry entry = entries[i];
+        std::size_t j = i;
+        for (; j > first && order(entry, entries[j - 1]); j--) {
+          entries[j] = entries[j - 1];
+        }
+        entries[j] = entry;
+      }
+    }
+    first = last;
+  }
+}
+
+std::string ExternalSort::newRun()
+{
+  return path + ".run" + std::to_string(++runCount);
+}
+
+void ExternalSort::spill()
+{
+  sortWorkspace();
+  std::vector<RecordView> records;
+  records.reserve(entries.size());
+  for (const Entry& entry : entries) {
+    records.push_back(recordOf(entry));
+  }
+  const std::string name = newRun();
+  File run = File::create(name);
+  run.appendRecords(records.data(), records.size());
+  run.close();
+  runs.push_back(name);
+  workspace.clear();
+  entries.clear();
+  workspaceBytes = 0;
+}
+
+void ExternalSort::step(Run& run)
+{
+  while (!run.done) {
+    if (run.page != NULL) {
+      ++run.it;
+      if (run.it != run.page->end()) {
+        run.current = *run.it;
+        return;
+      }
+      bufMgr.unPinPage(&run.file, run.pageNo, false);
+      run.page = NULL;
+    }
+    if (++run.pageNo >= run.limit) {
+      // Read to the end: its frames go back to the pool and the run away.
+      run.done = true;
+      run.current = RecordView();
+      bufMgr.flushFile(&run.file);
+      run.file.close();
+      File::remove(run.name);
+      return;
+    }
+    try {
+      bufMgr.readPage(&run.file, run.pageNo, run.page);
+    } catch (InvalidPageException&) {
+      run.page = NULL;
+      continue;
+    }
+    run.it = run.page->begin();
+    if (run.it != run.page->end()) {
+      run.current = *run.it;
+      return;
+    }
+    bufMgr.unPinPage(&run.file, run.pageNo, false);
+    run.page = NULL;
+  }
+}
+
+bool ExternalSort::beats(const std::uint32_t a, const std::uint32_t b) const
+{
+  const Run& first = *merging[a];
+  const Run& second = *merging[b];
+  if (first.done || second.done) {
+    return !first.done && (second.done || a < b);
+  }
+  if (before(second.current, first.current)) {
+    return false;
+  }
+  return before(first.current, second.current) || a < b;
+}
+
+void ExternalSort::startMerge(const std::vector<std::string>& names)
+{
+  for (const std::string& name : names) {
+    merging.push_back(std::unique_ptr<Run>(new Run(name)));
+    step(*merging.back());
+  }
+  // Leaves k to 2k - 1 are the runs; every node above keeps the loser of the
+  // match of its children and passes the winner up.
+  const std::uint32_t k = static_cast<std::uint32_t>(merging.size());
+  losers.assign(k, 0);
+  std::vector<std::uint32_t> winners(2 * k);
+  for (std::uint32_t i = 0; i < k; i++) {
+    winners[k + i] = i;
+  }
+  for (std::uint32_t node = k - 1; node >= 1; node--) {
+    const std::uint32_t left = winners[2 * node];
+    const std::uint32_t right = winners[2 * node + 1];
+    const bool leftWins = beats(left, right);
+    winners[node] = leftWins ? left : right;
+    losers[node] = leftWins ? right : left;
+  }
+  winner = k > 1 ? winners[1] : 0;
+  advance = false;
+}
+
+void ExternalSort::advanceWinner()
+{
+  step(*merging[winner]);
+  // Only the matches on the path of the winner's leaf can change.
+  std::uint32_t current = winner;
+  const std::uint32_t k = static_cast<std::uint32_t>(merging.size());
+  for (std::uint32_t node = (winner + k) / 2; node >= 1; node /= 2) {
+    if (beats(losers[node], current)) {
+      std::swap(losers[node], current);
+    }
+  }
+  winner = current;
+}
+
+void ExternalSort::closeMerge()
+{
+  for (std::unique_ptr<Run>& run : merging) {
+    if (run->page != NULL) {
+      bufMgr.unPinPage(&run->file, run->pageNo, false);
+      run->page = NULL;
+    }
+    if (!run->done) {
+      run->done = true;
+      bufMgr.flushFile(&run->file);
+      run->file.close();
+      File::remove(run->name);
+    }
+  }
+  merging.clear();
+}
+
+std::string ExternalSort::mergeInto(const std::vector<std::string>& names)
+{
+  startMerge(names);
+  const std::string name = newRun();
+  File out = File::create(name);
+  // The output frame of the budget: records are appended a page at a time.
+  std::string bytes;
+  std::vector<std::size_t> lengths;
+  std::vector<RecordView> records;
+  const auto flush = [&]() {
+    records.clear();
+    std::size_t offset = 0;
+    for (const std::size_t length : lengths) {
+      records.push_back(RecordView(bytes.data() + offset, length));
+      offset += length;
+    }
+    out.appendRecords(records.data(), records.size());
+    bytes.clear();
+    lengths.clear();
+  };
+  while (!merging[winner]->done) {
+    const RecordView record = merging[winner]->current;
+    if (bytes.size() + (lengths.size() + 1) * sizeof(PageSlot) + record.size() > Page::DATA_SIZE) {
+      flush();
+    }
+    bytes.append(record.data(), record.size());
+    lengths.push_back(record.size());
+    advanceWinner();
+  }
+  if (!lengths.empty()) {
+    flush();
+  }
+  out.close();
+  closeMerge();
+  return name;
+}
+
+bool ExternalSort::next(RecordView& record)
+{
+  if (!reading) {
+    reading = true;
+    if (runs.empty()) {
+      sortWorkspace();
+    } else {
+      if (!entries.empty()) {
+        spill();
+      }
+      std::vector<char>().swap(workspace);
+      std::vector<Entry>().swap(entries);
+      // Merge the fewest runs that bring the rest down to what the last merge
+      // may pin, besides the frame the caller's output takes.
+      const std::size_t fanIn = frames - 1;
+      while (runs.size() > fanIn) {
+        const std::size_t group = std::min(fanIn, runs.size() - fanIn + 1);
+        const std::vector<std::string> names(runs.begin(), runs.begin() + group);
+        runs.erase(runs.begin(), runs.begin() + group);
+        runs.push_back(mergeInto(names));
+      }
+      const std::vector<std::string> names(runs);
+      runs.clear();
+      startMerge(names);
+    }
+  }
+  if (merging.empty()) {
+    if (emitted == entries.size()) {
+      return false;
+    }
+    record = recordOf(entries[emitted++]);
+    return true;
+  }
+  if (advance) {
+    advanceWinner();
+  }
+  if (merging[winner]->done) {
+    return false;
+  }
+  record = merging[winner]->current;
+  advance = true;
+  return true;
+}
+
+}
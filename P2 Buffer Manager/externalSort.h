@@ -0,0 +1,230 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "page_iterator.h"
+
+namespace badgerdb {
+
+/**
+* @brief Sort of more records than fit in memory, within a budget of pages
+*
+* Records are added one at a time and copied into a workspace of the budget's
+* size.  Whenever it fills up, its records are sorted and written out as a
+* run, a temporary file of sorted pages.  Records are then read back in order
+* by a merge of the runs through the buffer manager, which pins one page of
+* every run and prefetches ahead of each, as runs are read sequentially.
+* When there are more runs than the budget lets the merge pin, groups of them
+* are merged into longer runs first.  If every record fits in the workspace
+* nothing is written at all.
+*
+* Without an ordering records are sorted by their bytes, shorter first among
+* records that are equal as far as the shorter goes, with a radix sort of their
+* first eight bytes followed by a sort of the records that tie on them.  With
+* an ordering they are sorted by it.  The sort is not stable.  The merge is a
+* tree of losers, so a record costs log2 of the number of runs comparisons.
+*
+* Reusable wherever data larger than memory has to be ordered: building an
+* index bottom up, removing duplicates (they come out next to each other),
+* and ORDER BY.  Not threadsafe.
+*/
+class ExternalSort {
+ public:
+	/**
+	 * Strict ordering of records, true if a goes before b
+	 */
+  typedef std::function<bool(const RecordView& a, const RecordView& b)> Less;
+
+	/**
+	 * Smallest budget: a workspace page, and two runs merged into one output page
+	 */
+  static const std::uint32_t MIN_FRAMES = 3;
+
+	/**
+	 * @param bufMgr  Buffer manager the runs are read through
+	 * @param frames  Budget in buffer pool frames, raised to MIN_FRAMES: the
+	 *                workspace holds this many pages of records, and a merge
+	 *                pins at most this many frames less one
+	 * @param path    Path the runs are named after: path.run1, path.run2, ...
+	 * @param less    Ordering of the records, by their bytes if empty
+	 */
+  ExternalSort(BufMgr& bufMgr, const std::uint32_t frames, const std::string& path,
+               const Less& less = Less());
+
+	/**
+	 * Unpins the pages still pinned and removes the runs left
+	 */
+  ~ExternalSort();
+
+	/**
+	 * Adds a record to the sort, before the first call to next()
+	 *
+	 * @param record  Record, copied
+	 * @throws InsufficientSpaceException If the record does not fit in an empty page
+	 * @throws BadgerDbException If next() has been called
+	 * @throws FileIOException If a run cannot be written
+	 */
+  void add(const RecordView& record);
+
+	/**
+	 * Returns the next record in order.  The first call sorts the records
+	 * still in the workspace and merges the runs down to as many as the budget
+	 * lets the last merge pin.
+	 *
+	 * @param record  Set to the record, valid until the next call
+	 * @return  False once every record has been returned
+	 * @throws FileIOException If a run cannot be written or read
+	 * @throws BufferExceededException If the buffer pool has no frame to read a run into
+	 */
+  bool next(RecordView& record);
+
+	/**
+	 * Number of records added
+	 */
+  std::uint64_t size() const { return added; }
+
+	/**
+	 * Number of runs written so far, including those of merges before the last
+	 */
+  std::uint32_t runsWritten() const { return runCount; }
+
+ private:
+	/**
+	 * A record in the workspace, with its first eight bytes as a big-endian
+	 * number, which orders records like their bytes do
+	 */
+  struct Entry {
+    std::uint64_t prefix;
+    std::uint32_t offset;
+    std::uint32_t length;
+  };
+
+	/**
+	 * A run being merged, with the page of its current record pinned
+	 */
+  struct Run {
+    std::string name;
+    File file;
+    PageId pageNo;
+    PageId limit;
+    Page* page;
+    PageIterator it;
+    RecordView current;
+    bool done;
+
+    Run(const std::string& name) : name(name), file(File::open(name)), pageNo(0),
+                                   limit(file.pageLimit()), page(NULL), done(false) {}
+  };
+
+  BufMgr& bufMgr;
+  const std::uint32_t frames;
+  const std::string path;
+  const Less less;
+
+	/**
+	 * Records in the workspace, their entries, and the bytes both take
+	 */
+  std::vector<char> workspace;
+  std::vector<Entry> entries;
+  std::size_t workspaceBytes;
+
+	/**
+	 * Names of the runs written and not yet merged, oldest first
+	 */
+  std::vector<std::string> runs;
+  std::uint32_t runCount;
+  std::uint64_t added;
+
+	/**
+	 * Set by the first next(), and the entry it returns next if the records
+	 * never left the workspace
+	 */
+  bool reading;
+  std::size_t emitted;
+
+	/**
+	 * Runs of the last merge, the tree of losers over them, and its winner.
+	 * The winner's current record is the one next() returned last, and is
+	 * only advanced past at the next call.
+	 */
+  std::vector<std::unique_ptr<Run> > merging;
+  std::vector<std::uint32_t> losers;
+  std::uint32_t winner;
+  bool advance;
+
+	/**
+	 * True if a goes before b in the order of the sort
+	 */
+  bool before(const RecordView& a, const RecordView& b) const;
+
+	/**
+	 * Returns the record of an entry in the workspace
+	 */
+  RecordView recordOf(const Entry& entry) const
+  {
+    return RecordView(workspace.data() + entry.offset, entry.length);
+  }
+
+	/**
+	 * Sorts the entries of the workspace
+	 */
+  void sortWorkspace();
+
+	/**
+	 * Sorts the workspace, writes it out as a run and empties it
+	 */
+  void spill();
+
+	/**
+	 * Returns the name of a new run, and counts it
+	 */
+  std::string newRun();
+
+	/**
+	 * Opens runs, reads their first records and builds the tree over them
+	 */
+  void startMerge(const std::vector<std::string>& names);
+
+	/**
+	 * Moves a run to its next record, unpinning the page it leaves; a run
+	 * read to the end is removed
+	 */
+  void step(Run& run);
+
+	/**
+	 * Moves the winner to its next record and replays its path of the tree
+	 */
+  void advanceWinner();
+
+	/**
+	 * True if run a goes before run b; finished runs go after every other
+	 */
+  bool beats(const std::uint32_t a, const std::uint32_t b) const;
+
+	/**
+	 * Unpins and removes the runs of the current merge
+	 */
+  void closeMerge();
+
+	/**
+	 * Merges names into one new run
+	 */
+  std::string mergeInto(const std::vector<std::string>& names);
+};
+
+}
@@ -7,31 +7,246 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <new>
 #include <string>
 #include <cstdio>
 #include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "exceptions/bad_file_format_exception.h"
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/read_only_file_exception.h"
 #include "file_iterator.h"
 #include "page.h"
+#include "pageCodec.h"
+#include "trace.h"
 
 namespace badgerdb {
 
+const std::size_t File::DIRECT_ALIGNMENT;
+const PageId File::PAGE_TABLE_ENTRIES;
+const std::size_t File::SPACE_CATEGORIES;
+const std::size_t File::SPACE_CATEGORY_SIZE;
+const PageId File::SPACE_MAP_ENTRIES;
+const std::uint32_t FileHeader::COMPRESSED;
+const std::uint32_t FileHeader::CHECKSUMMED;
+const std::uint32_t FileHeader::MAGIC;
+const std::uint32_t FileHeader::VERSION;
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+std::atomic<std::uint64_t> File::last_stream_id_(0);
+std::atomic<std::uint64_t> File::closed_streams_(0);
 
-File File::create(const std::string& filename) {
-  return File(filename, true /* create_new */);
+namespace {
+
+bool isDirectAligned(const void* buffer, const std::size_t length,
+                     const off_t offset) {
+  const std::size_t mask = File::DIRECT_ALIGNMENT - 1;
+  return (reinterpret_cast<std::uintptr_t>(buffer) & mask) == 0 &&
+         (length & mask) == 0 && (static_cast<std::size_t>(offset) & mask) == 0;
+}
+
+// Memory for direct I/O, released with free().
+void* allocateDirect(const std::size_t length) {
+  void* block = NULL;
+  if (posix_memalign(&block, File::DIRECT_ALIGNMENT, length) != 0) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+// The error of an asynchronous transfer of length bytes: an engine may move
+// fewer bytes than asked, which leaves the page torn, so that is EIO.
+int transferError(const ssize_t result, const std::size_t length) {
+  if (result < 0) {
+    return static_cast<int>(-result);
+  }
+  return static_cast<std::size_t>(result) == length ? 0 : EIO;
+}
+
+std::size_t roundToBlocks(const std::size_t length) {
+  return (length + File::DIRECT_ALIGNMENT - 1) & ~(File::DIRECT_ALIGNMENT - 1);
+}
+
+// First page of a free space map file; the map pages follow it.
+struct SpaceMapHeader {
+  std::uint32_t magic;
+  PageId covered_pages;
+};
+
+// Pages appendRecords() fills before writing them with one write.
+const PageId APPEND_BATCH_PAGES = 64;
+
+const std::uint32_t SPACE_MAP_MAGIC = 0x4d534642;  // "BFSM"
+
+std::uint8_t spaceCategory(const std::size_t free_space) {
+  return static_cast<std::uint8_t>(std::min<std::size_t>(
+      free_space / File::SPACE_CATEGORY_SIZE, File::SPACE_CATEGORIES - 1));
+}
+
+}
+
+File::Stream::~Stream() {
+  // Nothing to report a failure to; sync() is the way to learn about it.
+  writePageTablesIfDirty();
+  writeHeaderIfDirty();
+  writeSpaceMapIfDirty();
+  if (mapping != NULL) {
+    munmap(const_cast<char*>(mapping), mapping_size);
+  }
+  if (space_descriptor >= 0) {
+    ::close(space_descriptor);
+  }
+  ::close(descriptor);
+  closed_streams_.fetch_add(1, std::memory_order_release);
+}
+
+bool File::Stream::writeHeaderIfDirty() {
+  std::lock_guard<std::mutex> guard(header_latch);
+  if (!header_dirty) {
+    return true;
+  }
+  if (direct) {
+    // The header is alone in page 0, so its block can be written whole.
+    void* block = NULL;
+    if (posix_memalign(&block, DIRECT_ALIGNMENT, DIRECT_ALIGNMENT) != 0) {
+      return false;
+    }
+    std::memset(block, 0, DIRECT_ALIGNMENT);
+    std::memcpy(block, &header, sizeof(header));
+    const ssize_t written = ::pwrite(descriptor, block, DIRECT_ALIGNMENT, 0);
+    std::free(block);
+    if (written != static_cast<ssize_t>(DIRECT_ALIGNMENT)) {
+      return false;
+    }
+  } else if (::pwrite(descriptor, &header, sizeof(header), 0 /* pos */) !=
+             static_cast<ssize_t>(sizeof(header))) {
+    return false;
+  }
+  header_dirty = false;
+  return true;
+}
+
+bool File::Stream::writePageTablesIfDirty() {
+  std::lock_guard<std::mutex> guard(table_latch);
+  for (std::size_t group = 0; group < table_dirty.size(); ++group) {
+    if (!table_dirty[group]) {
+      continue;
+    }
+    void* block = NULL;
+    if (posix_memalign(&block, DIRECT_ALIGNMENT, Page::SIZE) != 0) {
+      errno = ENOMEM;
+      return false;
+    }
+    std::memset(block, 0, Page::SIZE);
+    const std::size_t first = group * PAGE_TABLE_ENTRIES;
+    const std::size_t count =
+        std::min<std::size_t>(PAGE_TABLE_ENTRIES, stored_lengths.size() - first);
+    std::memcpy(block, &stored_lengths[first], count * sizeof(std::uint16_t));
+    const ssize_t written =
+        ::pwrite(descriptor, block, Page::SIZE, pageTablePosition(group));
+    const int error = errno;
+    std::free(block);
+    errno = error;
+    if (written != static_cast<ssize_t>(Page::SIZE)) {
+      return false;
+    }
+    table_dirty[group] = 0;
+  }
+  return true;
+}
+
+bool File::Stream::writeSpaceMapIfDirty() {
+  std::lock_guard<std::mutex> guard(space_latch);
+  if (!space_loaded) {
+    return true;
+  }
+  if (!space_header_dirty &&
+      std::find(space_dirty.begin(), space_dirty.end(), 1) ==
+          space_dirty.end()) {
+    return true;
+  }
+  if (space_descriptor < 0) {
+    space_descriptor = ::open(space_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (space_descriptor < 0) {
+      return false;
+    }
+  }
+  std::vector<std::uint8_t> block(Page::SIZE);
+  for (std::size_t map_page = 0; map_page < space_dirty.size(); ++map_page) {
+    if (!space_dirty[map_page]) {
+      continue;
+    }
+    // Two pages a byte, the lower numbered one in the low four bits.
+    std::fill(block.begin(), block.end(), 0);
+    const std::size_t first = map_page * SPACE_MAP_ENTRIES;
+    const std::size_t last =
+        std::min<std::size_t>(first + SPACE_MAP_ENTRIES, space_leaves);
+    for (std::size_t page = first; page < last; ++page) {
+      block[(page - first) / 2] |= space_tree[space_leaves + page]
+                                   << ((page - first) % 2 * 4);
+    }
+    if (::pwrite(space_descriptor, block.data(), Page::SIZE,
+                 static_cast<off_t>(map_page + 1) * Page::SIZE) !=
+        static_cast<ssize_t>(Page::SIZE)) {
+      return false;
+    }
+    space_dirty[map_page] = 0;
+  }
+  // The header goes last, so it never covers map pages not written.
+  const SpaceMapHeader map_header = {SPACE_MAP_MAGIC, space_pages};
+  if (::pwrite(space_descriptor, &map_header, sizeof(map_header), 0) !=
+      static_cast<ssize_t>(sizeof(map_header))) {
+    return false;
+  }
+  space_header_dirty = false;
+  return true;
+}
+
+File File::create(const std::string& filename, const bool direct,
+                  const bool compressed) {
+  return File(filename, true /* create_new */, direct, compressed);
 }
 
-File File::open(const std::string& filename) {
-  return File(filename, false /* create_new */);
+File File::open(const std::string& filename, const bool direct) {
+  return File(filename, false /* create_new */, direct);
+}
+
+File File::openMapped(const std::string& filename) {
+  File file(filename, false /* create_new */);
+  Stream& stream = *file.stream_;
+  if (stream.compressed) {
+    return file;
+  }
+  if (stream.mapping == NULL) {
+    const FileHeader header = file.readHeader();
+    const std::size_t size = pagePosition(header.num_pages);
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, stream.descriptor, 0);
+    if (mapping == MAP_FAILED) {
+      throw FileIOException(filename, "map", errno);
+    }
+    stream.mapping = static_cast<const char*>(mapping);
+    stream.mapping_size = size;
+    stream.mapped_pages = header.num_pages;
+  }
+  file.mapped_ = true;
+  return file;
 }
 
 void File::remove(const std::string& filename) {
@@ -42,6 +257,7 @@ void File::remove(const std::string& filename) {
     throw FileOpenException(filename);
   }
   std::remove(filename.c_str());
+  std::remove(spaceMapName(filename).c_str());
 }
 
 bool File::isOpen(const std::string& filename) {
@@ -64,8 +280,10 @@ bool File::exists(const std::string& filename) {
 
 File::File(const File& other)
   : filename_(other.filename_),
-    stream_(open_streams_[filename_]) {
+    stream_(open_streams_[filename_]),
+    mapped_(other.mapped_) {
   ++open_counts_[filename_];
+  BADGERDB_TRACE_NAME(this, filename_);
 }
 
 File& File::operator=(const File& rhs) {
@@ -74,6 +292,8 @@ File& File::operator=(const File& rhs) {
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
+  mapped_ = rhs.mapped_;
+  BADGERDB_TRACE_NAME(this, filename_);
   return *this;
 }
 
@@ -82,70 +302,136 @@ File::~File() {
 }
 
 Page File::allocatePage() {
+  checkWritable("allocate a page of");
   FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-    header.first_free_page = new_page.next_page_number();
+    loadFreeMap(header);
+    const PageId page_number = header.first_free_page;
+    // The free list is threaded through the headers of the free pages.
+    header.first_free_page = readPageHeader(page_number).next_page_number;
     --header.num_free_pages;
+    setPageFree(page_number, false);
+    new_page.set_page_number(page_number);
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
+    // Keep the used list in page number order: link the page in after the
+    // closest used page before it, or at the head if there is none.
+    const PageId previous_page_number = previousUsedPage(page_number);
+    if (previous_page_number == Page::INVALID_NUMBER) {
+      new_page.set_next_page_number(header.first_used_page);
+      header.first_used_page = page_number;
     } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
+      new_page.set_next_page_number(
+          readPageHeader(previous_page_number).next_page_number);
+      writeNextPageNumber(previous_page_number, page_number);
     }
 
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   } else {
+    // Without free pages every page is used, so the last one is the tail of
+    // the used list.
     new_page.set_page_number(header.num_pages);
     if (header.first_used_page == Page::INVALID_NUMBER) {
       header.first_used_page = new_page.page_number();
     } else {
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+      writeNextPageNumber(header.num_pages - 1, new_page.page_number());
     }
     ++header.num_pages;
+    if (stream_->free_map_loaded) {
+      setPageFree(new_page.page_number(), false);
+    }
   }
   writePage(new_page.page_number(), new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page);
-  }
   writeHeader(header);
+  recordFreeSpace(new_page.page_number(), new_page.getFreeSpace());
 
   return new_page;
 }
 
+std::vector<RecordId> File::appendRecords(const RecordView* records,
+                                         const std::size_t count) {
+  checkWritable("append to");
+  std::vector<RecordId> rids;
+  if (count == 0) {
+    return rids;
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    if (records[i].length() + sizeof(PageSlot) > Page::DATA_SIZE) {
+      throw InsufficientSpaceException(Page::INVALID_NUMBER,
+                                       records[i].length(), Page::DATA_SIZE);
+    }
+  }
+  rids.reserve(count);
+  FileHeader header = readHeader();
+  const PageId first_page_number = header.num_pages;
+  // Aligned, so that direct I/O writes the batch as it is.
+  std::unique_ptr<void, void (*)(void*)> block(
+      allocateDirect(APPEND_BATCH_PAGES * Page::SIZE), std::free);
+  Page* batch = static_cast<Page*>(block.get());
+  PageId batch_start = first_page_number;
+  PageId filled = 0;
+  std::vector<std::uint16_t> free_space;
+  const auto write_batch = [&]() {
+    for (PageId k = 0; k < filled; ++k) {
+      stampChecksum(batch[k]);
+    }
+    if (stream_->compressed) {
+      for (PageId k = 0; k < filled; ++k) {
+        writeSlot(batch_start + k, batch[k]);
+      }
+    } else {
+      writeAt(batch, filled * Page::SIZE, pagePosition(batch_start));
+    }
+    for (PageId k = 0; k < filled; ++k) {
+      free_space.push_back(batch[k].getFreeSpace());
+    }
+    batch_start += filled;
+    filled = 0;
+  };
+  new (&batch[0]) Page();
+  batch[0].set_page_number(batch_start);
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!batch[filled].hasSpaceForRecord(records[i])) {
+      batch[filled].set_next_page_number(batch_start + filled + 1);
+      if (++filled == APPEND_BATCH_PAGES) {
+        write_batch();
+      }
+      new (&batch[filled]) Page();
+      batch[filled].set_page_number(batch_start + filled);
+    }
+    rids.push_back(batch[filled].insertRecord(records[i]));
+  }
+  ++filled;
+  write_batch();
+
+  // The pages are on disk past the end of the file; link them in after the
+  // last used page and make them part of the file.
+  PageId last_used_page = Page::INVALID_NUMBER;
+  if (header.first_used_page != Page::INVALID_NUMBER) {
+    if (header.num_free_pages == 0) {
+      last_used_page = header.num_pages - 1;
+    } else {
+      loadFreeMap(header);
+      last_used_page = previousUsedPage(header.num_pages);
+    }
+  }
+  if (last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = first_page_number;
+  } else {
+    writeNextPageNumber(last_used_page, first_page_number);
+  }
+  header.num_pages = batch_start;
+  if (stream_->free_map_loaded) {
+    setPageFree(batch_start - 1, false);
+  }
+  writeHeader(header);
+  for (std::size_t k = 0; k < free_space.size(); ++k) {
+    recordFreeSpace(first_page_number + k, free_space[k]);
+  }
+  return rids;
+}
+
 Page File::readPage(const PageId page_number) const {
   FileHeader header = readHeader();
   if (page_number >= header.num_pages) {
@@ -154,11 +440,21 @@ Page File::readPage(const PageId page_number) const {
   return readPage(page_number, false /* allow_free */);
 }
 
+void File::readPageInto(const PageId page_number, Page& frame) const {
+  if (page_number == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  // A page past the end of the file comes back short, which saves reading the
+  // file header to check the page number.
+  const std::size_t bytes = readSlot(page_number, frame);
+  if (bytes != Page::SIZE || !frame.isUsed()) {
+    throw InvalidPageException(page_number, filename_);
+  }
+}
+
 Page File::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  readSlot(page_number, page);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
@@ -167,6 +463,7 @@ Page File::readPage(const PageId page_number, const bool allow_free) const {
 }
 
 void File::writePage(const Page& new_page) {
+  checkWritable("write");
   PageHeader header = readPageHeader(new_page.page_number());
   if (header.current_page_number == Page::INVALID_NUMBER) {
     // Page has been deleted since it was read.
@@ -179,36 +476,222 @@ void File::writePage(const Page& new_page) {
   header = new_page.header_;
   header.next_page_number = next_page_number;
   writePage(new_page.page_number(), header, new_page);
+  recordFreeSpace(new_page.page_number(), new_page.getFreeSpace());
+}
+
+void File::readPageAsync(IoEngine& engine, const PageId page_number,
+                         Page& frame, const IoCallback& done) const {
+  if (page_number == Page::INVALID_NUMBER) {
+    done(ENODATA);
+    return;
+  }
+  Page* target = &frame;
+  const std::uint16_t length =
+      stream_->compressed ? storedLength(page_number) : 0;
+  if (length != 0) {
+    // Read the compressed bytes aside and decompress them into the frame.
+    const std::size_t stored = roundToBlocks(length);
+    std::shared_ptr<void> block(allocateDirect(stored), std::free);
+    engine.prepareRead(stream_->descriptor, block.get(), stored,
+                       compressedPosition(page_number),
+                       [block, length, target, done](const ssize_t result) {
+      // The stored bytes are known to be in the file, so none may be missing.
+      if (result < 0) {
+        done(static_cast<int>(-result));
+      } else if (result < length) {
+        done(EIO);
+      } else if (!PageCodec::decompress(static_cast<const char*>(block.get()),
+                                        length, reinterpret_cast<char*>(target),
+                                        Page::SIZE)) {
+        done(EIO);
+      } else if (!target->isUsed()) {
+        done(ENODATA);
+      } else {
+        done(0);
+      }
+    });
+    return;
+  }
+  engine.prepareRead(stream_->descriptor, target, Page::SIZE,
+                     slotPosition(page_number),
+                     [target, done](const ssize_t result) {
+    if (result == 0) {
+      // A page past the end of the file comes back empty.
+      done(ENODATA);
+    } else if (const int error = transferError(result, Page::SIZE)) {
+      done(error);
+    } else if (!target->isUsed()) {
+      done(ENODATA);
+    } else {
+      done(0);
+    }
+  });
+}
+
+void File::writePageAsync(IoEngine& engine, const Page& frame,
+                          const IoCallback& done) {
+  checkWritable("write");
+  recordFreeSpace(frame.page_number(), frame.getFreeSpace());
+  if (stream_->compressed) {
+    // Encode a copy carrying the next page number on disk, written whole.
+    const PageId page_number = frame.page_number();
+    std::shared_ptr<Stream> stream = stream_;
+    std::shared_ptr<void> block;
+    std::size_t bytes;
+    {
+      std::unique_lock<std::mutex> lock(stream->link_latch);
+      waitForWrites(page_number, lock);
+      Page on_disk;
+      readSlot(page_number, on_disk);
+      Page copy = frame;
+      copy.header_.next_page_number = on_disk.header_.next_page_number;
+      stampChecksum(copy);
+      bytes = encodeSlot(page_number, copy, block);
+      ++stream->writes_in_flight[page_number];
+    }
+    engine.prepareWrite(
+        stream->descriptor, block.get(), bytes, compressedPosition(page_number),
+        [stream, block, bytes, page_number, done](const ssize_t result) {
+          {
+            std::lock_guard<std::mutex> guard(stream->link_latch);
+            if (--stream->writes_in_flight[page_number] == 0) {
+              stream->writes_in_flight.erase(page_number);
+            }
+          }
+          stream->write_done.notify_all();
+          done(transferError(result, bytes));
+        });
+    return;
+  }
+  // Both halves report to a shared state; the last one to finish calls done.
+  struct Halves {
+    std::atomic<int> remaining;
+    std::atomic<int> error;
+  };
+  std::shared_ptr<Halves> halves = std::make_shared<Halves>();
+  halves->remaining = 2;
+  halves->error = 0;
+  // With checksums the halves are written from a copy the checksum is of,
+  // which lives until both are done; direct I/O writes a copy of its own.
+  std::shared_ptr<void> block;
+  const char* bytes = reinterpret_cast<const char*>(&frame);
+  if (stream_->checksummed && !stream_->direct) {
+    block.reset(allocateDirect(Page::SIZE), std::free);
+    Page* copy = new (block.get()) Page(frame);
+    stampChecksum(*copy);
+    bytes = reinterpret_cast<const char*>(copy);
+  }
+  const auto finish = [halves, block, done](const std::size_t length) {
+    return [halves, block, done, length](const ssize_t result) {
+      if (const int error = transferError(result, length)) {
+        halves->error = error;
+      }
+      if (--halves->remaining == 0) {
+        done(halves->error);
+      }
+    };
+  };
+  const off_t position = pagePosition(frame.page_number());
+  if (stream_->direct) {
+    // Write a whole aligned copy that carries the next page number on disk.
+    const PageId page_number = frame.page_number();
+    std::shared_ptr<Stream> stream = stream_;
+    std::shared_ptr<void> block(allocateDirect(Page::SIZE), std::free);
+    Page* copy = new (block.get()) Page(frame);
+    stampChecksum(*copy);
+    {
+      std::lock_guard<std::mutex> guard(stream->link_latch);
+      copy->header_.next_page_number =
+          readPageHeader(page_number).next_page_number;
+      ++stream->writes_in_flight[page_number];
+    }
+    engine.prepareWrite(
+        stream->descriptor, copy, Page::SIZE, position,
+        [stream, block, page_number, done](const ssize_t result) {
+          {
+            std::lock_guard<std::mutex> guard(stream->link_latch);
+            if (--stream->writes_in_flight[page_number] == 0) {
+              stream->writes_in_flight.erase(page_number);
+            }
+          }
+          stream->write_done.notify_all();
+          done(transferError(result, Page::SIZE));
+        });
+    return;
+  }
+  // Everything but the next page number, which is maintained on disk.
+  const std::size_t next_offset = offsetof(PageHeader, next_page_number);
+  const std::size_t rest_offset = next_offset + sizeof(PageId);
+  engine.prepareWrite(stream_->descriptor, bytes, next_offset, position,
+                      finish(next_offset));
+  engine.prepareWrite(stream_->descriptor, bytes + rest_offset,
+                      Page::SIZE - rest_offset, position + rest_offset,
+                      finish(Page::SIZE - rest_offset));
 }
 
 void File::deletePage(const PageId page_number) {
+  checkWritable("delete a page of");
   FileHeader header = readHeader();
-  Page existing_page = readPage(page_number);
-  Page previous_page;
+  if (page_number == Page::INVALID_NUMBER ||
+      page_number >= header.num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const PageHeader existing_header = readPageHeader(page_number);
+  if (existing_header.current_page_number == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  loadFreeMap(header);
   // If this page is the head of the used list, update the header to point to
-  // the next page in line.
+  // the next page in line; otherwise unlink it from the closest used page
+  // before it.
   if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+    header.first_used_page = existing_header.next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    writeNextPageNumber(previousUsedPage(page_number),
+                        existing_header.next_page_number);
   }
   // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
+  Page free_page;
+  free_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page);
-  }
-  writePage(page_number, existing_page);
+  setPageFree(page_number, true);
+  writePage(page_number, free_page);
   writeHeader(header);
+  // Free pages are never offered; allocatePage() reuses them.
+  recordFreeSpace(page_number, 0);
+}
+
+PageId File::findPageWithSpace(const std::size_t record_size) const {
+  const std::size_t category =
+      (record_size + sizeof(PageSlot) + SPACE_CATEGORY_SIZE - 1) /
+      SPACE_CATEGORY_SIZE;
+  if (category >= SPACE_CATEGORIES) {
+    return Page::INVALID_NUMBER;
+  }
+  Stream& stream = *stream_;
+  std::lock_guard<std::mutex> guard(stream.space_latch);
+  loadSpaceMap();
+  const std::vector<std::uint8_t>& tree = stream.space_tree;
+  if (tree[1] < category) {
+    return Page::INVALID_NUMBER;
+  }
+  // Go left wherever the left subtree has a page with room.
+  std::size_t node = 1;
+  while (node < stream.space_leaves) {
+    node = tree[2 * node] >= category ? 2 * node : 2 * node + 1;
+  }
+  return static_cast<PageId>(node - stream.space_leaves);
+}
+
+void File::recordFreeSpace(const PageId page_number,
+                           const std::size_t free_space) {
+  checkWritable("record free space of");
+  Stream& stream = *stream_;
+  std::lock_guard<std::mutex> guard(stream.space_latch);
+  if (stream.space_loaded && page_number != Page::INVALID_NUMBER) {
+    setSpaceCategory(page_number, spaceCategory(free_space));
+  }
 }
 
 FileIterator File::begin() {
@@ -220,24 +703,32 @@ FileIterator File::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
-  openIfNeeded(create_new);
+File::File(const std::string& name, const bool create_new, const bool direct,
+           const bool compressed)
+    : filename_(name), mapped_(false) {
+  openIfNeeded(create_new, direct);
+  BADGERDB_TRACE_NAME(this, filename_);
 
   if (create_new) {
     // File starts with 1 page (the header).
-    FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+    FileHeader header = {
+        FileHeader::MAGIC, FileHeader::VERSION,
+        1 /* num_pages */, 0 /* first_used_page */, 0 /* num_free_pages */,
+        0 /* first_free_page */,
+        FileHeader::CHECKSUMMED |
+            (compressed ? FileHeader::COMPRESSED : 0) /* flags */};
+    stream_->compressed = compressed;
+    stream_->checksummed = true;
     writeHeader(header);
   }
 }
 
-void File::openIfNeeded(const bool create_new) {
+void File::openIfNeeded(const bool create_new, const bool direct) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
@@ -245,14 +736,51 @@ void File::openIfNeeded(const bool create_new) {
         throw FileExistsException(filename_);
       }
       // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags = flags | O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
+    bool is_direct = direct;
+    int descriptor =
+        ::open(filename_.c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+    if (descriptor < 0 && direct && errno == EINVAL) {
+      // The filesystem does not support direct I/O; use its cache instead.
+      is_direct = false;
+      descriptor = ::open(filename_.c_str(), flags, 0644);
+    }
+    if (descriptor < 0) {
+      throw FileIOException(filename_, "open", errno);
+    }
+    stream_ = std::make_shared<Stream>(descriptor, is_direct);
+    stream_->space_path = spaceMapName(filename_);
+    if (create_new) {
+      // A map left by an earlier file of the same name describes nothing.
+      ::unlink(stream_->space_path.c_str());
+    } else {
+      // New files get their header from the constructor.
+      if (readAt(&stream_->header, sizeof(stream_->header), 0 /* pos */) !=
+              sizeof(stream_->header) ||
+          stream_->header.magic != FileHeader::MAGIC ||
+          stream_->header.version != FileHeader::VERSION) {
+        // Its pages would be read at the wrong offsets.
+        throw BadFileFormatException(filename_);
+      }
+      if (stream_->header.flags & FileHeader::COMPRESSED) {
+        stream_->compressed = true;
+        loadPageTable(stream_->header);
+      }
+      stream_->checksummed =
+          (stream_->header.flags & FileHeader::CHECKSUMMED) != 0;
+      // A file with a map keeps it up to date from the start.
+      stream_->space_descriptor = ::open(stream_->space_path.c_str(), O_RDWR);
+      if (stream_->space_descriptor >= 0) {
+        std::lock_guard<std::mutex> guard(stream_->space_latch);
+        loadSpaceMap();
+      }
+    }
     open_streams_[filename_] = stream_;
     open_counts_[filename_] = 1;
   }
@@ -275,33 +803,480 @@ void File::writePage(const PageId page_number, const Page& new_page) {
 
 void File::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->write(new_page.data_.c_str(),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  if (!stream_->checksummed &&
+      std::memcmp(&header, &new_page.header_, sizeof(header)) == 0) {
+    writeSlot(page_number, new_page);
+    return;
+  }
+  // Copying the page is far cheaper than a second system call, and the
+  // checksum is of the copy, which cannot change while it is written.
+  // Aligned, so that direct I/O writes it as it is.
+  std::unique_ptr<void, void (*)(void*)> block(allocateDirect(Page::SIZE),
+                                               std::free);
+  Page* page = new (block.get()) Page(new_page);
+  page->header_ = header;
+  stampChecksum(*page);
+  writeSlot(page_number, *page);
 }
 
-FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+PageId File::pageLimit() const {
+  return readHeader().num_pages;
+}
 
-  return header;
+PageId File::getFirstPageNo() const {
+  return readHeader().first_used_page;
+}
+
+void File::adviseSequential() const {
+  // Only a hint; nothing to do if the kernel ignores it.
+  posix_fadvise(stream_->descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void File::adviseWillNeed(const PageId first_page, const PageId count) const {
+  if (count == 0) {
+    return;
+  }
+  const PageId first = first_page > 1 ? first_page : 1;
+  posix_fadvise(stream_->descriptor, slotPosition(first),
+                slotPosition(first + count) - slotPosition(first),
+                POSIX_FADV_WILLNEED);
+}
+
+const Page* File::mappedPage(const PageId page_number) const {
+  const Stream& stream = *stream_;
+  if (stream.mapping == NULL || page_number == Page::INVALID_NUMBER ||
+      page_number >= stream.mapped_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const Page* page =
+      reinterpret_cast<const Page*>(stream.mapping + pagePosition(page_number));
+  if (!page->isUsed()) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return page;
+}
+
+void File::throwReadOnly(const char* operation) const {
+  throw ReadOnlyFileException(filename_, operation);
+}
+
+FileHeader File::readHeader() const {
+  std::lock_guard<std::mutex> guard(stream_->header_latch);
+  return stream_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->flush();
+  std::lock_guard<std::mutex> guard(stream_->header_latch);
+  stream_->header = header;
+  stream_->header_dirty = true;
 }
 
 PageHeader File::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (stream_->compressed) {
+    // The header is only found by decompressing the page.
+    std::unique_lock<std::mutex> lock(stream_->link_latch);
+    waitForWrites(page_number, lock);
+    Page page;
+    if (readSlot(page_number, page) == 0) {
+      std::memset(&page.header_, 0, sizeof(page.header_));
+    }
+    return page.header_;
+  }
+  readAt(&header, sizeof(header), pagePosition(page_number));
 
   return header;
 }
 
+void File::sync() const {
+  syncStream(*stream_, filename_);
+}
+
+bool File::SyncHandle::sync() const {
+  // Holding the stream keeps it open until the sync is done.
+  const std::shared_ptr<Stream> stream = stream_.lock();
+  if (!stream) {
+    return false;
+  }
+  syncStream(*stream, filename_);
+  return true;
+}
+
+void File::syncStream(Stream& stream, const std::string& filename) {
+  // The header goes to disk before taking a ticket, so the fsync covers it.
+  if (!stream.writePageTablesIfDirty() || !stream.writeHeaderIfDirty() ||
+      !stream.writeSpaceMapIfDirty()) {
+    throw FileIOException(filename, "write", errno);
+  }
+  std::unique_lock<std::mutex> lock(stream.sync_latch);
+  const std::uint64_t ticket = ++stream.syncs_requested;
+  while (stream.syncs_completed < ticket) {
+    if (stream.syncing) {
+      // The running fsync may have started before our writes completed.
+      stream.sync_done.wait(lock);
+      continue;
+    }
+    stream.syncing = true;
+    const std::uint64_t covered = stream.syncs_requested;
+    lock.unlock();
+    const int result = ::fdatasync(stream.descriptor);
+    const int error = errno;
+    lock.lock();
+    stream.syncing = false;
+    if (result == 0) {
+      stream.syncs_completed = covered;
+    }
+    stream.sync_done.notify_all();
+    if (result != 0) {
+      throw FileIOException(filename, "sync", error);
+    }
+  }
+}
+
+void File::writeNextPageNumber(const PageId page_number,
+                               const PageId next_page_number) {
+  const off_t position =
+      pagePosition(page_number) + offsetof(PageHeader, next_page_number);
+  if (!stream_->direct && !stream_->compressed) {
+    writeAt(&next_page_number, sizeof(next_page_number), position);
+    return;
+  }
+  // Rewriting the page under an asynchronous write of it would race with
+  // it; wait for those, which already carry the old next page number.
+  std::unique_lock<std::mutex> lock(stream_->link_latch);
+  waitForWrites(page_number, lock);
+  if (!stream_->compressed) {
+    writeAt(&next_page_number, sizeof(next_page_number), position);
+    return;
+  }
+  Page page;
+  readSlot(page_number, page);
+  page.header_.next_page_number = next_page_number;
+  writeSlot(page_number, page);
+}
+
+void File::waitForWrites(const PageId page_number,
+                         std::unique_lock<std::mutex>& lock) const {
+  Stream& stream = *stream_;
+  while (stream.writes_in_flight.count(page_number) > 0) {
+    stream.write_done.wait(lock);
+  }
+}
+
+std::size_t File::readSlot(const PageId page_number, Page& page) const {
+  BADGERDB_TRACE_SPAN(TRACE_FILE_READ, this, page_number);
+  if (!stream_->compressed) {
+    return readAt(&page, Page::SIZE, pagePosition(page_number));
+  }
+  const std::uint16_t length = storedLength(page_number);
+  if (length == 0) {
+    return readAt(&page, Page::SIZE, compressedPosition(page_number));
+  }
+  const std::size_t stored = roundToBlocks(length);
+  std::unique_ptr<char, void (*)(void*)> block(
+      static_cast<char*>(allocateDirect(stored)), std::free);
+  if (readAt(block.get(), stored, compressedPosition(page_number)) < length) {
+    return 0;
+  }
+  if (!PageCodec::decompress(block.get(), length,
+                             reinterpret_cast<char*>(&page), Page::SIZE)) {
+    throw FileIOException(filename_, "decompress", EIO);
+  }
+  return Page::SIZE;
+}
+
+void File::writeSlot(const PageId page_number, const Page& page) {
+  BADGERDB_TRACE_SPAN(TRACE_FILE_WRITE, this, page_number);
+  if (!stream_->compressed) {
+    writeAt(&page, Page::SIZE, pagePosition(page_number));
+    return;
+  }
+  std::shared_ptr<void> block;
+  const std::size_t bytes = encodeSlot(page_number, page, block);
+  writeAt(block.get(), bytes, compressedPosition(page_number));
+}
+
+std::size_t File::encodeSlot(const PageId page_number, const Page& page,
+                             std::shared_ptr<void>& block) {
+  char* bytes = static_cast<char*>(allocateDirect(Page::SIZE));
+  block.reset(bytes, std::free);
+  // Compressing only pays if it saves a whole block on disk.
+  const std::size_t length =
+      PageCodec::compress(reinterpret_cast<const char*>(&page), Page::SIZE,
+                          bytes, Page::SIZE - DIRECT_ALIGNMENT);
+  std::size_t stored = Page::SIZE;
+  if (length == 0) {
+    std::memcpy(bytes, &page, Page::SIZE);
+  } else {
+    stored = roundToBlocks(length);
+    std::memset(bytes + length, 0, stored - length);
+  }
+  {
+    Stream& stream = *stream_;
+    std::lock_guard<std::mutex> guard(stream.table_latch);
+    if (page_number >= stream.stored_lengths.size()) {
+      stream.stored_lengths.resize(page_number + 1, 0);
+    }
+    stream.stored_lengths[page_number] = static_cast<std::uint16_t>(length);
+    const PageId group = page_number / PAGE_TABLE_ENTRIES;
+    if (group >= stream.table_dirty.size()) {
+      stream.table_dirty.resize(group + 1, 0);
+    }
+    stream.table_dirty[group] = 1;
+  }
+  if (stored < Page::SIZE) {
+    // Only saves space; a filesystem without holes keeps the old bytes,
+    // which the stored length makes unused.
+    fallocate(stream_->descriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              compressedPosition(page_number) + stored, Page::SIZE - stored);
+  }
+  return stored;
+}
+
+std::uint16_t File::storedLength(const PageId page_number) const {
+  const Stream& stream = *stream_;
+  std::lock_guard<std::mutex> guard(stream.table_latch);
+  return page_number < stream.stored_lengths.size()
+             ? stream.stored_lengths[page_number] : 0;
+}
+
+void File::loadPageTable(const FileHeader& header) {
+  Stream& stream = *stream_;
+  const PageId groups =
+      (header.num_pages + PAGE_TABLE_ENTRIES - 1) / PAGE_TABLE_ENTRIES;
+  stream.stored_lengths.assign(
+      static_cast<std::size_t>(groups) * PAGE_TABLE_ENTRIES, 0);
+  stream.table_dirty.assign(groups, 0);
+  for (PageId group = 0; group < groups; ++group) {
+    // A table never written reads short, leaving its pages stored as is.
+    readAt(&stream.stored_lengths[group * PAGE_TABLE_ENTRIES], Page::SIZE,
+           pageTablePosition(group));
+  }
+}
+
+void File::loadSpaceMap() const {
+  Stream& stream = *stream_;
+  if (stream.space_loaded) {
+    return;
+  }
+  const PageId pages = readHeader().num_pages;
+  stream.space_leaves = 64;
+  while (stream.space_leaves < pages) {
+    stream.space_leaves *= 2;
+  }
+  stream.space_tree.assign(2 * stream.space_leaves, 0);
+  stream.space_dirty.assign(
+      (stream.space_leaves + SPACE_MAP_ENTRIES - 1) / SPACE_MAP_ENTRIES, 0);
+  std::uint8_t* leaves = &stream.space_tree[stream.space_leaves];
+  // Page 0 holds the file header and is never offered.
+  PageId covered = 1;
+  SpaceMapHeader map_header;
+  if (stream.space_descriptor >= 0 &&
+      ::pread(stream.space_descriptor, &map_header, sizeof(map_header), 0) ==
+          static_cast<ssize_t>(sizeof(map_header)) &&
+      map_header.magic == SPACE_MAP_MAGIC) {
+    covered = std::max<PageId>(1, std::min(map_header.covered_pages, pages));
+    std::vector<std::uint8_t> block(Page::SIZE);
+    for (PageId first = 0; first < covered; first += SPACE_MAP_ENTRIES) {
+      // A map page never written reads short, as pages without room.
+      std::fill(block.begin(), block.end(), 0);
+      if (::pread(stream.space_descriptor, block.data(), Page::SIZE,
+                  static_cast<off_t>(first / SPACE_MAP_ENTRIES + 1) *
+                      Page::SIZE) < 0) {
+        throw FileIOException(filename_, "read", errno);
+      }
+      const PageId last = std::min(first + SPACE_MAP_ENTRIES, covered);
+      for (PageId page = first; page < last; ++page) {
+        leaves[page] = (block[(page - first) / 2] >> ((page - first) % 2 * 4)) &
+                       (SPACE_CATEGORIES - 1);
+      }
+    }
+    leaves[0] = 0;
+  }
+  for (PageId page = covered; page < pages; ++page) {
+    const PageHeader page_header = readPageHeader(page);
+    if (page_header.current_page_number != Page::INVALID_NUMBER) {
+      leaves[page] = spaceCategory(page_header.free_space_upper_bound -
+                                   page_header.free_space_lower_bound +
+                                   page_header.fragmented_space);
+    }
+    stream.space_dirty[page / SPACE_MAP_ENTRIES] = 1;
+  }
+  for (std::size_t node = stream.space_leaves - 1; node > 0; --node) {
+    stream.space_tree[node] = std::max(stream.space_tree[2 * node],
+                                       stream.space_tree[2 * node + 1]);
+  }
+  stream.space_pages = pages;
+  stream.space_header_dirty = covered < pages;
+  stream.space_loaded = true;
+}
+
+void File::setSpaceCategory(const PageId page_number,
+                            const std::uint8_t category) const {
+  Stream& stream = *stream_;
+  std::vector<std::uint8_t>& tree = stream.space_tree;
+  if (page_number >= stream.space_leaves) {
+    // Double the leaves and rebuild the nodes above them.
+    std::size_t leaves = stream.space_leaves;
+    while (leaves <= page_number) {
+      leaves *= 2;
+    }
+    std::vector<std::uint8_t> grown(2 * leaves, 0);
+    std::copy(tree.begin() + stream.space_leaves, tree.end(),
+              grown.begin() + leaves);
+    for (std::size_t node = leaves - 1; node > 0; --node) {
+      grown[node] = std::max(grown[2 * node], grown[2 * node + 1]);
+    }
+    tree.swap(grown);
+    stream.space_leaves = leaves;
+    stream.space_dirty.resize(
+        (leaves + SPACE_MAP_ENTRIES - 1) / SPACE_MAP_ENTRIES, 0);
+  }
+  if (page_number >= stream.space_pages) {
+    stream.space_pages = page_number + 1;
+    stream.space_header_dirty = true;
+  }
+  std::size_t node = stream.space_leaves + page_number;
+  if (tree[node] == category) {
+    return;
+  }
+  tree[node] = category;
+  stream.space_dirty[page_number / SPACE_MAP_ENTRIES] = 1;
+  for (node /= 2; node > 0; node /= 2) {
+    const std::uint8_t largest = std::max(tree[2 * node], tree[2 * node + 1]);
+    if (tree[node] == largest) {
+      break;
+    }
+    tree[node] = largest;
+  }
+}
+
+void File::loadFreeMap(const FileHeader& header) {
+  Stream& stream = *stream_;
+  if (stream.free_map_loaded) {
+    return;
+  }
+  stream.free_map.assign(header.num_pages / 64 + 1, 0);
+  // Page 0 holds the file header and is never used.
+  stream.free_map[0] = 1;
+  PageId page_number = header.first_free_page;
+  for (PageId i = 0; i < header.num_free_pages; ++i) {
+    stream.free_map[page_number / 64] |= 1ULL << (page_number % 64);
+    page_number = readPageHeader(page_number).next_page_number;
+  }
+  stream.free_map_loaded = true;
+}
+
+void File::setPageFree(const PageId page_number, const bool free) {
+  std::vector<std::uint64_t>& free_map = stream_->free_map;
+  if (page_number / 64 >= free_map.size()) {
+    free_map.resize(page_number / 64 + 1, 0);
+  }
+  if (free) {
+    free_map[page_number / 64] |= 1ULL << (page_number % 64);
+  } else {
+    free_map[page_number / 64] &= ~(1ULL << (page_number % 64));
+  }
+}
+
+PageId File::previousUsedPage(const PageId page_number) const {
+  const std::vector<std::uint64_t>& free_map = stream_->free_map;
+  if (page_number <= 1) {
+    return Page::INVALID_NUMBER;
+  }
+  const PageId last = page_number - 1;
+  std::size_t word = last / 64;
+  // Used pages up to and including last in the first word examined.
+  std::uint64_t used = ~free_map[word] & (~0ULL >> (63 - last % 64));
+  while (used == 0) {
+    if (word == 0) {
+      return Page::INVALID_NUMBER;
+    }
+    used = ~free_map[--word];
+  }
+  return static_cast<PageId>(word * 64 + 63 - __builtin_clzll(used));
+}
+
+std::size_t File::readAt(void* buffer, const std::size_t length,
+                         const off_t offset) const {
+  if (!stream_->direct || isDirectAligned(buffer, length, offset)) {
+    return readRaw(buffer, length, offset);
+  }
+  // Read the aligned blocks around the range and copy it out.
+  const off_t start = offset & ~static_cast<off_t>(DIRECT_ALIGNMENT - 1);
+  const std::size_t skip = offset - start;
+  const std::size_t span =
+      (skip + length + DIRECT_ALIGNMENT - 1) & ~(DIRECT_ALIGNMENT - 1);
+  std::unique_ptr<char, void (*)(void*)> block(
+      static_cast<char*>(allocateDirect(span)), std::free);
+  const std::size_t bytes = readRaw(block.get(), span, start);
+  const std::size_t copied = bytes > skip ? std::min(length, bytes - skip) : 0;
+  std::memcpy(buffer, block.get() + skip, copied);
+  return copied;
+}
+
+void File::writeAt(const void* buffer, const std::size_t length,
+                   const off_t offset) {
+  if (!stream_->direct || isDirectAligned(buffer, length, offset)) {
+    writeRaw(buffer, length, offset);
+    return;
+  }
+  // Merge the range into the aligned blocks around it, zeros past the end.
+  const off_t start = offset & ~static_cast<off_t>(DIRECT_ALIGNMENT - 1);
+  const std::size_t skip = offset - start;
+  const std::size_t span =
+      (skip + length + DIRECT_ALIGNMENT - 1) & ~(DIRECT_ALIGNMENT - 1);
+  std::unique_ptr<char, void (*)(void*)> block(
+      static_cast<char*>(allocateDirect(span)), std::free);
+  const std::size_t bytes = readRaw(block.get(), span, start);
+  std::memset(block.get() + bytes, 0, span - bytes);
+  std::memcpy(block.get() + skip, buffer, length);
+  writeRaw(block.get(), span, start);
+}
+
+std::size_t File::readRaw(void* buffer, const std::size_t length,
+                          const off_t offset) const {
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t bytes = ::pread(stream_->descriptor,
+                                  static_cast<char*>(buffer) + done,
+                                  length - done, offset + done);
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, "read", errno);
+    }
+    if (bytes == 0) {
+      break;
+    }
+    done += bytes;
+  }
+  return done;
+}
+
+void File::writeRaw(const void* buffer, const std::size_t length,
+                    const off_t offset) {
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t bytes = ::pwrite(stream_->descriptor,
+                                   static_cast<const char*>(buffer) + done,
+                                   length - done, offset + done);
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, "write", errno);
+    }
+    done += bytes;
+  }
+}
+
+void PageFile::writePage(const PageId page_number, const Page& new_page) {
+  if (new_page.page_number() != page_number) {
+    throw InvalidPageException(page_number, filename());
+  }
+  File::writePage(new_page);
+}
+
 }
@@ -7,11 +7,18 @@
 
 #pragma once
 
-#include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
 
+#include "ioEngine.h"
 #include "page.h"
 
 namespace badgerdb {
@@ -22,6 +29,17 @@ class FileIterator;
  * @brief Header metadata for files on disk which contain pages.
  */
 struct FileHeader {
+  /**
+   * MAGIC in every database file; files written before it existed keep
+   * their page count here.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Version of the layout of the file, VERSION in files this code writes.
+   */
+  std::uint32_t version;
+
   /**
    * Number of pages allocated in the file.
    */
@@ -42,6 +60,34 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Bit set of the formats of the file; zero in files written before flags
+   * existed.
+   */
+  std::uint32_t flags;
+
+  /**
+   * Flag of files whose pages are stored compressed.
+   */
+  static const std::uint32_t COMPRESSED = 1;
+
+  /**
+   * Flag of files whose pages carry a checksum; every file created since
+   * checksums exist.
+   */
+  static const std::uint32_t CHECKSUMMED = 2;
+
+  /**
+   * Marks the file as a database file.
+   */
+  static const std::uint32_t MAGIC = 0x42444742;  // "BGDB" on little-endian disks
+
+  /**
+   * Current version of the layout: page n at byte n * Page::SIZE and the
+   * header alone in page 0.
+   */
+  static const std::uint32_t VERSION = 1;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -49,10 +95,11 @@ struct FileHeader {
    * @return  True if the other header is equal to this one.
    */
   bool operator==(const FileHeader& rhs) const {
-    return num_pages == rhs.num_pages &&
+    return magic == rhs.magic && version == rhs.version &&
+        num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page && flags == rhs.flags;
   }
 };
 
@@ -60,25 +107,128 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor of an underlying file on disk.  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  Page n starts at byte n * Page::SIZE;
+ * page 0 holds the file header, so every page is aligned for direct I/O.
+ * Files of an older layout are refused on open by the magic and version of
+ * their header.
+ * If multiple File objects refer to the same
+ * underlying file, they will share the descriptor in memory.
  * If a file that has already been opened (possibly by another query), then the File class
  * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
+ *
+ * Writes are positioned writes into the operating system's cache and are not
+ * durable until sync() returns.  Files opened for direct I/O bypass that
+ * cache instead, leaving a buffer pool as the only one; their writes are
+ * still only durable once sync() returns.
+ *
+ * Files created compressed store every page compressed with PageCodec in a
+ * slot of its own, followed by a hole punched over the rest of the slot, so
+ * that pages that compress well take less disk space and are read and
+ * written in fewer blocks.  Every PAGE_TABLE_ENTRIES slots are preceded by a
+ * page table slot holding the stored length of each of those pages.  Slots
+ * never move, so a page rewritten with a different size stays in place.
+ * Pages go through the codec on every read and write, and callers such as a
+ * buffer pool always see them decompressed.
+ *
+ * Every page of a file with checksums (hasChecksums()) is written with the
+ * CRC-32C of its contents in its header, computed on a copy of the page
+ * taken as it is written, so that a page torn by a crash or damaged on disk
+ * is found by checksumMatches() once it is read back.  Reads do not check it
+ * themselves; a buffer pool verifies the pages it reads.
+ *
+ * Once findPageWithSpace() has been used on a file, a free space map records
+ * how much room every page has, in SPACE_CATEGORIES steps, and every write,
+ * allocation and deletion of a page updates it.  It is kept in memory and
+ * stored in pages of its own in the file named after the file with ".fsm"
+ * appended, written with the header.  The map is a hint, not synced and not
+ * part of the file: pages added while it was not kept are read again when
+ * it is loaded, and entries left behind by a crash only send callers to a
+ * page that turns out to be fuller, which they then report back.
  *
  * @warning This class is not threadsafe.
  */
 class File {
+  struct Stream;
+
  public:
+  /**
+   * Reference to the file, as opened by a File object, that does not keep it
+   * open: it stays valid for as long as some File object has the file open,
+   * and syncing through it then syncs the file.  May be kept in a structure
+   * that outlives the File object it was taken from.
+   */
+  class SyncHandle {
+   public:
+    /**
+     * Constructs a handle that refers to no file.
+     */
+    SyncHandle() {}
+
+    /**
+     * Makes every write to the file that completed before this call durable,
+     * as File::sync(), if the file is still open.
+     *
+     * @return  False if every File object for the file has been closed.
+     * @throws  FileIOException  If the operating system reports an error.
+     */
+    bool sync() const;
+
+    /**
+     * Returns true while some File object has the file open.
+     */
+    bool isOpen() const { return !stream_.expired(); }
+
+   private:
+    friend class File;
+
+    SyncHandle(const std::string& filename,
+               const std::shared_ptr<Stream>& stream)
+      : filename_(filename), stream_(stream) {}
+
+    std::string filename_;
+    std::weak_ptr<Stream> stream_;
+  };
+
+  /**
+   * Alignment of the memory, length and position of every transfer to and
+   * from a file opened for direct I/O.
+   */
+  static const std::size_t DIRECT_ALIGNMENT = 4096;
+
+  /**
+   * Number of pages described by each page table slot of a compressed file.
+   */
+  static const PageId PAGE_TABLE_ENTRIES = Page::SIZE / sizeof(std::uint16_t);
+
+  /**
+   * Number of categories of free space the free space map tells pages
+   * apart by; a page in category c has at least c * SPACE_CATEGORY_SIZE
+   * bytes free.
+   */
+  static const std::size_t SPACE_CATEGORIES = 16;
+  static const std::size_t SPACE_CATEGORY_SIZE = Page::SIZE / SPACE_CATEGORIES;
+
+  /**
+   * Number of pages described by each page of the free space map, at four
+   * bits a page.
+   */
+  static const PageId SPACE_MAP_ENTRIES = Page::SIZE * 2;
+
   /**
    * Creates a new file.
    *
-   * @param filename  Name of the file.
+   * @param filename    Name of the file.
+   * @param direct      Whether to bypass the operating system's cache, see
+   *                    open().
+   * @param compressed  Whether to store the pages compressed; the file header
+   *                    records it for every later open.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static File create(const std::string& filename);
+  static File create(const std::string& filename, const bool direct = false,
+                     const bool compressed = false);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
@@ -87,10 +237,37 @@ class File {
 	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
 	 * open_streams_ map.
    *
+   * With direct set the file is opened with O_DIRECT, so pages move between
+   * disk and memory without a copy in the operating system's cache.
+   * Transfers of whole pages from and to DIRECT_ALIGNMENT aligned memory,
+   * such as buffer pool frames, go to disk as they are; others are staged
+   * in aligned blocks.  A filesystem without direct I/O falls back to
+   * cached I/O.  The mode of the first open applies while the file stays
+   * open; see isDirect().
+   *
    * @param filename  Name of the file.
+   * @param direct    Whether to bypass the operating system's cache.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  BadFileFormatException  If the file has no header of this layout.
    */
-  static File open(const std::string& filename);
+  static File open(const std::string& filename, const bool direct = false);
+
+  /**
+   * Opens an existing file read-only and maps it into memory, so that its
+   * pages can be used in place through mappedPage() instead of being read.
+   * Pages are faulted in from the operating system's page cache on first
+   * touch.  The mapping covers the pages the file had when it was first
+   * mapped; pages appended through other File objects later are not
+   * visible through it.  All methods that change the file throw
+   * ReadOnlyFileException.  Compressed pages cannot be used in place, so a
+   * compressed file is opened as by open() instead, and isMapped() is false.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  BadFileFormatException  If the file has no header of this layout.
+   * @throws  FileIOException         If the file cannot be mapped.
+   */
+  static File openMapped(const std::string& filename);
 
   /**
    * Deletes an existing file.
@@ -133,12 +310,18 @@ class File {
   File& operator=(const File& rhs);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <stream_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
   void close();
 
+  /**
+   * Returns true if this object has been closed, or had nothing open to begin
+   * with.
+   */
+  bool isClosed() const { return !stream_; }
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -152,6 +335,23 @@ class File {
    */
   Page allocatePage();
 
+  /**
+   * Appends the given records to the file in new pages at its end, packed
+   * in the order given.  Pages are filled in memory and written in batches
+   * of consecutive pages with one write each, then linked to the end of the
+   * used list, so no page is read or searched and nothing is written for a
+   * record on its own.  Free pages are not reused.  Like writePage(), this
+   * does not go through a buffer pool; the new pages are in none.
+   *
+   * @param records   Records to append.
+   * @param count     Number of records.
+   * @return  IDs of the records, in the order given.
+   * @throws  InsufficientSpaceException  If a record does not fit in an empty
+   *                                      page; nothing is appended then.
+   */
+  std::vector<RecordId> appendRecords(const RecordView* records,
+                                      const std::size_t count);
+
   /**
    * Reads an existing page from the file.
    *
@@ -162,6 +362,66 @@ class File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file directly into caller-provided memory,
+   * such as a buffer pool frame, with a single positioned read.  Unlike the
+   * other methods this keeps no state besides the page read, so it may run
+   * concurrently with any other call on the file.
+   *
+   * @param page_number   Number of page to read.
+   * @param frame         Page overwritten with the contents read from disk.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.  The contents of frame
+   *                                are undefined in that case.
+   */
+  void readPageInto(const PageId page_number, Page& frame) const;
+
+  /**
+   * Returns true if this object was opened by openMapped().
+   */
+  bool isMapped() const { return mapped_; }
+
+  /**
+   * Returns true if the file is open for direct I/O.
+   */
+  bool isDirect() const { return stream_->direct; }
+
+  /**
+   * Returns true if the pages of the file are stored compressed.
+   */
+  bool isCompressed() const { return stream_->compressed; }
+
+  /**
+   * Returns true if the pages of the file carry checksums.  Files created
+   * before checksums existed do not.
+   */
+  bool hasChecksums() const { return stream_->checksummed; }
+
+  /**
+   * Returns true unless page, as read from this file, no longer matches the
+   * checksum it was written with.  Always true in a file without checksums.
+   *
+   * @param page  Page read from the file, not changed since.
+   */
+  bool checksumMatches(const Page& page) const {
+    return !stream_->checksummed ||
+           page.header_.checksum == page.computeChecksum();
+  }
+
+  /**
+   * Returns an existing page of a file opened by openMapped() in place, in
+   * the read-only mapping.  Writing to it is not allowed and faults.  The
+   * pointer stays valid while any File object of the file is open.  Like
+   * readPageInto(), this may be called concurrently with any other call on
+   * the file.
+   *
+   * @param page_number   Number of page to return.
+   * @return  The page in the mapping.
+   * @throws  InvalidPageException  If the page doesn't exist in the mapping or
+   *                                is not currently used.
+   */
+  const Page* mappedPage(const PageId page_number) const;
+
   /**
    * Writes a page into the file, replacing any existing contents.  The page
    * must have been already allocated in this file by a call to allocatePage().
@@ -171,6 +431,47 @@ class File {
    */
   void writePage(const Page& new_page);
 
+  /**
+   * Callback of asynchronous page I/O, receiving 0 on success or an errno
+   * value.  Runs on the completion thread of the engine.
+   */
+  typedef std::function<void(const int error)> IoCallback;
+
+  /**
+   * Queues an asynchronous read of an existing page into caller-provided
+   * memory; the read is issued by the next engine.submit().  The file must
+   * stay open until done runs.  Like readPageInto(), this may be called
+   * concurrently with any other call on the file.  For direct I/O frame
+   * must be DIRECT_ALIGNMENT aligned, or done receives EINVAL.
+   *
+   * @param engine        Engine to issue the read.
+   * @param page_number   Number of page to read.
+   * @param frame         Page overwritten with the contents read from disk.
+   * @param done          Receives ENODATA if the page doesn't exist in the
+   *                      file or is not currently used.
+   */
+  void readPageAsync(IoEngine& engine, const PageId page_number, Page& frame,
+                     const IoCallback& done) const;
+
+  /**
+   * Queues an asynchronous write of a page held in caller-provided memory,
+   * such as a buffer pool frame; the write is issued by the next
+   * engine.submit().  As with writePage(), the next page number on disk is
+   * kept; it is skipped rather than read first, so the page takes two
+   * requests that need no further I/O.  Direct I/O cannot skip part of a
+   * page, so there the next page number is read first and a copy of the
+   * page carrying it is written whole.  Unlike writePage() this does not
+   * check whether the page has been deleted.  frame must stay unchanged and
+   * the file open until done runs.  This may be called concurrently with any
+   * other call on the file.
+   *
+   * @param engine  Engine to issue the write.
+   * @param frame   Page to write.
+   * @param done    Receives the result.
+   */
+  void writePageAsync(IoEngine& engine, const Page& frame,
+                      const IoCallback& done);
+
   /**
    * Deletes a page from the file.
    *
@@ -178,6 +479,78 @@ class File {
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Returns the used page with the lowest number that the free space map
+   * records as having room for a record of the given size and its slot, in
+   * a single descent of the map.  The first call for a file loads the map,
+   * or builds it from the page headers if the file has none, which costs a
+   * header read per page once.  A page just written through a buffer pool
+   * is recorded when it is unpinned dirty, before it reaches the file.
+   * Entries are a hint: a caller that finds the page fuller, because of a
+   * crash or changes not written yet, reports the space it has through
+   * recordFreeSpace() and looks again.  Records of more than
+   * (SPACE_CATEGORIES - 1) * SPACE_CATEGORY_SIZE bytes and their slot are
+   * never placed.  Like readPageInto(), this may be called concurrently with
+   * any other call on the file.
+   *
+   * @param record_size   Size of the record in bytes.
+   * @return  Number of the page, or Page::INVALID_NUMBER if none has room.
+   */
+  PageId findPageWithSpace(const std::size_t record_size) const;
+
+  /**
+   * Records the free space of a used page in the free space map, if the map
+   * is kept for this file.  Writes of pages record it themselves.  Like
+   * readPageInto(), this may be called concurrently with any other call on
+   * the file.
+   *
+   * @param page_number   Number of page.
+   * @param free_space    Bytes free in the page, as Page::getFreeSpace().
+   */
+  void recordFreeSpace(const PageId page_number, const std::size_t free_space);
+
+  /**
+   * Makes every write to the file that completed before this call durable,
+   * writing the file header first if it has changed.
+   * Concurrent callers share fsyncs (group commit): a caller that arrives
+   * while another caller's fsync is running waits for it to finish and then
+   * at most one further fsync covers all callers that arrived meanwhile.
+   * Unlike the other methods this may be called concurrently with any other
+   * call on the file.
+   *
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void sync() const;
+
+  /**
+   * Returns a handle on the file, for syncing it later without keeping it
+   * open.
+   *
+   * @return  Handle on the file.
+   */
+  SyncHandle syncHandle() const { return SyncHandle(filename_, stream_); }
+
+  /**
+   * Returns a number that tells the opened file apart: every File object that
+   * has the file open shares it, and it is not given to another opening once
+   * the last of them closes.  Like sync(), this may be called concurrently
+   * with any other call on the file.
+   *
+   * @return  Number of the opened file, or 0 if this object is closed.
+   */
+  std::uint64_t streamId() const { return stream_ ? stream_->id : 0; }
+
+  /**
+   * Returns the number of times the last File object of a file has closed it,
+   * so that callers keeping something per opened file can tell when to look
+   * for the files that have closed.
+   *
+   * @return  Number of files closed so far.
+   */
+  static std::uint64_t streamsClosed() {
+    return closed_streams_.load(std::memory_order_acquire);
+  }
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -185,6 +558,38 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns the number of the first used page of the file, the head of the
+   * used list, which is kept in page number order.
+   *
+   * @return  Number of the page, or Page::INVALID_NUMBER if none is used.
+   */
+  PageId getFirstPageNo() const;
+
+  /**
+   * Returns the number of pages in the file, used or free, including the
+   * header page; every page number is below it.  Like readPageInto(), this may be
+   * called concurrently with any other call on the file.
+   *
+   * @return Bound on the page numbers of the file.
+   */
+  PageId pageLimit() const;
+
+  /**
+   * Tells the operating system that the file is about to be read from the
+   * first page on, so that it reads further ahead of each read.
+   */
+  void adviseSequential() const;
+
+  /**
+   * Tells the operating system that the given pages will be read soon, so
+   * that it starts reading them into its page cache in the background.
+   *
+   * @param first_page  Number of the first page.
+   * @param count       Number of pages.
+   */
+  void adviseWillNeed(const PageId first_page, const PageId count) const;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -203,15 +608,105 @@ class File {
  private:
   /**
    * Returns the position of the page with the given number in the file (as an
-   * offset from the beginning of the file).
+   * offset from the beginning of the file).  The header fills page 0.
    *
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static off_t pagePosition(const PageId page_number) {
+    return static_cast<off_t>(page_number) * Page::SIZE;
+  }
+
+  /**
+   * Returns the position of the page table slot of the given group of
+   * PAGE_TABLE_ENTRIES pages in a compressed file.  The first group, whose
+   * page 0 is the header, has its table right after the header.
+   */
+  static off_t pageTablePosition(const PageId group) {
+    return (static_cast<off_t>(group) * (PAGE_TABLE_ENTRIES + 1) + 1) *
+           Page::SIZE;
+  }
+
+  /**
+   * Returns the position of the slot of the page with the given number in a
+   * compressed file, after the page table describing it.
+   */
+  static off_t compressedPosition(const PageId page_number) {
+    return pageTablePosition(page_number / PAGE_TABLE_ENTRIES) +
+           static_cast<off_t>(page_number % PAGE_TABLE_ENTRIES + 1) *
+               Page::SIZE;
   }
 
+  /**
+   * Returns the position of the page with the given number in this file.
+   */
+  off_t slotPosition(const PageId page_number) const {
+    return stream_->compressed ? compressedPosition(page_number)
+                               : pagePosition(page_number);
+  }
+
+  /**
+   * Reads the page with the given number into page, decompressing it if
+   * the file is compressed.
+   *
+   * @return  Number of bytes of the page read; less than Page::SIZE only
+   *          past the end of file.
+   * @throws  FileIOException  If the operating system reports an error, or
+   *                           a compressed page is damaged.
+   */
+  std::size_t readSlot(const PageId page_number, Page& page) const;
+
+  /**
+   * Writes page to the slot of the page with the given number, compressing
+   * it if the file is compressed.  The page carries its checksum already,
+   * see stampChecksum().
+   *
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void writeSlot(const PageId page_number, const Page& page);
+
+  /**
+   * Encodes page for a write to its slot in a compressed file: compressed
+   * if that saves at least one DIRECT_ALIGNMENT block, as it is otherwise.
+   * Records the stored length in the page table and punches out the rest of
+   * the slot.
+   *
+   * @param block  Set to DIRECT_ALIGNMENT aligned memory holding the bytes
+   *               to write, released with free().
+   * @return  Number of bytes to write, a multiple of DIRECT_ALIGNMENT.
+   */
+  std::size_t encodeSlot(const PageId page_number, const Page& page,
+                         std::shared_ptr<void>& block);
+
+  /**
+   * Sets the checksum in the header of page, about to be written, if the file
+   * has checksums.
+   */
+  void stampChecksum(Page& page) const {
+    if (stream_->checksummed) {
+      page.header_.checksum = page.computeChecksum();
+    }
+  }
+
+  /**
+   * Returns the stored length of the page with the given number in a
+   * compressed file, 0 if it is stored as it is.
+   */
+  std::uint16_t storedLength(const PageId page_number) const;
+
+  /**
+   * Waits until no asynchronous write of the page with the given number is
+   * in flight.  Called with link_latch held, through lock.
+   */
+  void waitForWrites(const PageId page_number,
+                     std::unique_lock<std::mutex>& lock) const;
+
+  /**
+   * Reads the page tables of a compressed file describing its pages.
+   */
+  void loadPageTable(const FileHeader& header);
+
+ protected:
   /**
    * Constructs a file object representing a file on the filesystem.
    * This method should not be called directly; instead use the static methods
@@ -221,32 +716,53 @@ class File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param direct      Whether to open the file for direct I/O.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new, const bool direct = false,
+       const bool compressed = false);
+
+ private:
+
+  /**
+   * Throws ReadOnlyFileException if this object was opened by openMapped().
+   *
+   * @param operation   Name of the operation, for the exception.
+   */
+  void checkWritable(const char* operation) const {
+    if (mapped_) {
+      throwReadOnly(operation);
+    }
+  }
+
+  /**
+   * Throws ReadOnlyFileException; out of line to keep checkWritable() small.
+   */
+  void throwReadOnly(const char* operation) const;
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
+   * @param direct      Whether to open the file for direct I/O.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  void openIfNeeded(const bool create_new);
+  void openIfNeeded(const bool create_new, const bool direct = false);
 
   /**
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
@@ -279,14 +795,17 @@ class File {
                  const Page& new_page);
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file.  The header is read from disk once,
+   * when the file is opened, and served from memory afterwards.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  The in-memory copy is authoritative;
+   * it is written to disk by sync() or when the last File object for the file
+   * is closed.
    *
    * @param header  File header to write.
    */
@@ -301,8 +820,242 @@ class File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Replaces only the next page number in the header of the given page on
+   * disk.  No bounds checking is performed.
+   *
+   * @param page_number       Number of page whose header to update.
+   * @param next_page_number  New number of the next used page.
+   */
+  void writeNextPageNumber(const PageId page_number,
+                           const PageId next_page_number);
+
+  /**
+   * Builds the bitmap of free pages from the free list unless it is already
+   * loaded.  Costs one header read per free page, once per open file.
+   *
+   * @param header  Current file header.
+   */
+  void loadFreeMap(const FileHeader& header);
+
+  /**
+   * Returns the name of the file holding the free space map of the given
+   * file.
+   */
+  static std::string spaceMapName(const std::string& filename) {
+    return filename + ".fsm";
+  }
+
+  /**
+   * Loads the free space map from the map file, reading the headers of the
+   * pages it does not cover, unless it is already loaded.  Called with
+   * space_latch held.
+   */
+  void loadSpaceMap() const;
+
+  /**
+   * Sets the category of free space of the given page in the loaded free
+   * space map, growing the map if needed.  Called with space_latch held.
+   */
+  void setSpaceCategory(const PageId page_number,
+                        const std::uint8_t category) const;
+
+  /**
+   * Marks the given page free or used in the bitmap of free pages.
+   *
+   * @param page_number   Number of page.
+   * @param free          Whether the page is free.
+   */
+  void setPageFree(const PageId page_number, const bool free);
+
+  /**
+   * Returns the used page with the highest number below the given one, the
+   * predecessor of that page in the used list.  Requires the free map.
+   *
+   * @param page_number   Number of page.
+   * @return  Number of the previous used page, or Page::INVALID_NUMBER.
+   */
+  PageId previousUsedPage(const PageId page_number) const;
+
+  /**
+   * Reads up to length bytes at the given position in the file, staging
+   * transfers that direct I/O cannot issue as they are.
+   *
+   * @return  Number of bytes read; less than length only at the end of file.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  std::size_t readAt(void* buffer, const std::size_t length,
+                     const off_t offset) const;
+
+  /**
+   * Writes length bytes at the given position in the file, extending it if
+   * needed.  With direct I/O, a transfer that is not aligned rewrites the
+   * aligned blocks around it.
+   *
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void writeAt(const void* buffer, const std::size_t length,
+               const off_t offset);
+
+  /**
+   * readAt() and writeAt() without staging, however the transfer is aligned.
+   */
+  std::size_t readRaw(void* buffer, const std::size_t length,
+                      const off_t offset) const;
+  void writeRaw(const void* buffer, const std::size_t length,
+                const off_t offset);
+
+  /**
+   * Opened filesystem object, shared by all File objects for the same file.
+   */
+  struct Stream {
+    /**
+     * Number of the opening, as returned by streamId().
+     */
+    std::uint64_t id;
+
+    /**
+     * Descriptor of the underlying filesystem object.
+     */
+    int descriptor;
+
+    /**
+     * True if the descriptor was opened with O_DIRECT.
+     */
+    bool direct;
+
+    /**
+     * True if the pages are stored compressed.
+     */
+    bool compressed;
+
+    /**
+     * True if the pages carry checksums.
+     */
+    bool checksummed;
+
+    /**
+     * With direct I/O or compression, number of asynchronous writes in
+     * flight for every page being written, guarded by link_latch.
+     * writeNextPageNumber() waits for those of its page, which carry the
+     * next page number read when they were queued, and so does reading the
+     * header of a compressed page, whose stored length changes with them.
+     */
+    std::mutex link_latch;
+    std::condition_variable write_done;
+    std::unordered_map<PageId, int> writes_in_flight;
+
+    /**
+     * Group commit state of sync(): callers take a ticket from
+     * syncs_requested and wait until syncs_completed reaches it.
+     */
+    std::mutex sync_latch;
+    std::condition_variable sync_done;
+    std::uint64_t syncs_requested;
+    std::uint64_t syncs_completed;
+    bool syncing;
+
+    /**
+     * Authoritative copy of the file header, guarded by header_latch.
+     * header_dirty is set while it differs from the header on disk.
+     */
+    std::mutex header_latch;
+    FileHeader header;
+    bool header_dirty;
+
+    /**
+     * Bit set for every free page, page 0 included; loaded from the free list
+     * the first time a page is reused or deleted.  Only touched by
+     * allocatePage() and deletePage().
+     */
+    std::vector<std::uint64_t> free_map;
+    bool free_map_loaded;
+
+    /**
+     * Read-only mapping of the first mapped_pages pages of the file, made by
+     * the first openMapped() of the file, or NULL.
+     */
+    const char* mapping;
+    std::size_t mapping_size;
+    PageId mapped_pages;
+
+    /**
+     * Stored length of every page of a compressed file, 0 for pages stored
+     * as they are, and a flag for every page table slot that differs from
+     * disk; guarded by table_latch.
+     */
+    mutable std::mutex table_latch;
+    std::vector<std::uint16_t> stored_lengths;
+    std::vector<char> table_dirty;
+
+    /**
+     * Free space map, guarded by space_latch: a tree whose leaves, from
+     * space_leaves on, hold the category of free space of every page, and
+     * whose every other node holds the largest category below it, so the
+     * first page of a category is found by one descent from the root.
+     * space_pages is the number of pages it covers.  space_dirty flags the
+     * map pages that differ from the map file at space_path, and
+     * space_header_dirty a space_pages not recorded there.  Nothing is kept
+     * until space_loaded is set.
+     */
+    std::mutex space_latch;
+    bool space_loaded;
+    std::size_t space_leaves;
+    std::vector<std::uint8_t> space_tree;
+    std::vector<char> space_dirty;
+    PageId space_pages;
+    bool space_header_dirty;
+    std::string space_path;
+    int space_descriptor;
+
+    Stream(const int fd, const bool direct_io)
+      : id(++last_stream_id_), descriptor(fd), direct(direct_io), compressed(false),
+        checksummed(false), syncs_requested(0), syncs_completed(0),
+        syncing(false), header(), header_dirty(false),
+        free_map_loaded(false), mapping(NULL), mapping_size(0),
+        mapped_pages(0), space_loaded(false), space_leaves(0),
+        space_pages(0), space_header_dirty(false), space_descriptor(-1) {}
+
+    /**
+     * Writes the header, page tables and free space map if they are dirty,
+     * unmaps the file and closes the descriptors.
+     */
+    ~Stream();
+
+    /**
+     * Writes the pages of the free space map that differ from the map file,
+     * creating it if needed.
+     *
+     * @return  False if a write failed, with errno set.
+     */
+    bool writeSpaceMapIfDirty();
+
+    /**
+     * Writes the page table slots that differ from disk.
+     *
+     * @return  False if a write failed, with errno set.
+     */
+    bool writePageTablesIfDirty();
+
+    /**
+     * Writes the header to disk if it is dirty.
+     *
+     * @return  False if the write failed, with errno set.
+     */
+    bool writeHeaderIfDirty();
+  };
+
+  /**
+   * Makes the completed writes to the file of the stream durable, as sync().
+   *
+   * @param stream    Stream of the file.
+   * @param filename  Name of the file, for errors.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  static void syncStream(Stream& stream, const std::string& filename);
+
   typedef std::map<std::string,
-                   std::shared_ptr<std::fstream> > StreamMap;
+                   std::shared_ptr<Stream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
@@ -315,6 +1068,13 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Number of the last stream opened, and of the streams closed so far.
+   */
+  static std::atomic<std::uint64_t> last_stream_id_;
+  static std::atomic<std::uint64_t> closed_streams_;
+
+
   /**
    * Name of the file this object represents.
    */
@@ -323,10 +1083,88 @@ class File {
   /**
    * Stream for underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<Stream> stream_;
+
+  /**
+   * True if this object was opened by openMapped() and may only read.
+   */
+  bool mapped_;
 
   friend class FileIterator;
   friend class FileTest;
 };
 
+/**
+ * @brief A File with the page calls of the B+ tree project: files are opened
+ *        or created by the constructor, and pages are allocated and written
+ *        by number.
+ *
+ * Every page keeps the header File maintains, so whatever a caller lays out
+ * in a page goes after it, in the Page::DATA_SIZE bytes of the data area.
+ */
+class PageFile : public File {
+ public:
+  /**
+   * Creates a new file.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileExistsException     If the requested file already exists.
+   */
+  static PageFile create(const std::string& filename) {
+    return PageFile(filename, true /* create_new */);
+  }
+
+  /**
+   * Opens an existing file.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  BadFileFormatException  If the file has no header of this layout.
+   */
+  static PageFile open(const std::string& filename) {
+    return PageFile(filename, false /* create_new */);
+  }
+
+  /**
+   * Opens the file, or creates it if create_new is set.
+   *
+   * @param name        Name of the file.
+   * @param create_new  Whether to create a new file.
+   * @throws  FileExistsException     If the file exists and create_new is set.
+   * @throws  FileNotFoundException   If the file doesn't exist and create_new
+   *                                  is not set.
+   * @throws  BadFileFormatException  If the file has no header of this layout.
+   */
+  PageFile(const std::string& name, const bool create_new)
+      : File(name, create_new) {}
+
+  /**
+   * Allocates a new page in the file.
+   *
+   * @param new_page_number   Receives the number of the new page.
+   * @return The new page.
+   */
+  Page allocatePage(PageId& new_page_number) {
+    Page new_page = File::allocatePage();
+    new_page_number = new_page.page_number();
+    return new_page;
+  }
+
+  /**
+   * Writes a page allocated in this file, replacing its contents on disk.
+   *
+   * @param page_number   Number of the page; the number in its header.
+   * @param new_page      Page to write.
+   * @throws  InvalidPageException  If the page is not currently used, or
+   *                                carries another number.
+   */
+  void writePage(const PageId page_number, const Page& new_page);
+};
+
+/**
+ * @brief The files B+ tree indexes are stored in.  Their nodes are laid out
+ *        in the data area of the pages, so they are page files like any other.
+ */
+typedef PageFile BlobFile;
+
 }
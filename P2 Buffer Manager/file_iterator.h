@@ -41,6 +41,8 @@ class FileIterator {
     assert(file_ != NULL);
     const FileHeader& header = file_->readHeader();
     current_page_number_ = header.first_used_page;
+    // Dereferencing reads one page at a time; let the kernel read ahead.
+    file_->adviseSequential();
   }
 
   /**
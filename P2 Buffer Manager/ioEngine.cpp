@@ -0,0 +1,429 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/aio_abi.h>
+#include <linux/io_uring.h>
+
+#include "ioEngine.h"
+
+namespace badgerdb {
+
+/**
+ * user_data of the entry that wakes the completion thread up to stop it
+ */
+static const std::uint64_t STOP_TOKEN = ~0ULL;
+
+IoEngine* IoEngine::create(const unsigned depth)
+{
+  if (UringEngine::supported())
+    return new UringEngine(depth);
+  if (AioEngine::supported())
+    return new AioEngine(depth);
+  return new SyncEngine(depth);
+}
+
+IoEngine::IoEngine(const unsigned depth)
+	: depth(depth), slots(depth), inFlight(0), owner(0)
+{
+  freeSlots.reserve(depth);
+  for (std::uint32_t i = depth; i > 0; i--)
+    freeSlots.push_back(i - 1);
+}
+
+void IoEngine::prepareRead(const int fd, void* buffer, const std::size_t length,
+                           const off_t offset, const Callback& done)
+{
+  Request request = {fd, false, {buffer, length}, offset, done};
+  std::lock_guard<std::mutex> guard(latch);
+  prepared.push_back(std::move(request));
+}
+
+void IoEngine::prepareWrite(const int fd, const void* buffer, const std::size_t length,
+                            const off_t offset, const Callback& done)
+{
+  Request request = {fd, true, {const_cast<void*>(buffer), length}, offset, done};
+  std::lock_guard<std::mutex> guard(latch);
+  prepared.push_back(std::move(request));
+}
+
+void IoEngine::submit()
+{
+  std::unique_lock<std::mutex> lock(latch);
+  if (prepared.empty())
+    return;
+  if (owner != getpid()) {
+    // first use in this process; state inherited through fork() belongs to
+    // a completion thread that does not exist here
+    if (owner != 0) {
+      reaper.release();
+      freeSlots.clear();
+      for (std::uint32_t i = depth; i > 0; i--)
+        freeSlots.push_back(i - 1);
+      inFlight = 0;
+    }
+    start();
+    owner = getpid();
+  }
+  std::vector<Request> pending;
+  pending.swap(prepared);
+  std::vector<std::uint32_t> batch;
+  std::size_t next = 0;
+  while (next < pending.size()) {
+    batch.clear();
+    while (next < pending.size() && !freeSlots.empty()) {
+      const std::uint32_t slot = freeSlots.back();
+      freeSlots.pop_back();
+      slots[slot] = std::move(pending[next++]);
+      batch.push_back(slot);
+      ++inFlight;
+    }
+    if (batch.empty()) {
+      slotFreed.wait(lock);
+      continue;
+    }
+    submitSlots(batch);
+    // run callbacks of requests the backend finished on the spot
+    while (!finished.empty()) {
+      std::vector<std::pair<std::uint32_t, ssize_t> > done;
+      done.swap(finished);
+      lock.unlock();
+      for (const std::pair<std::uint32_t, ssize_t>& d : done)
+        complete(d.first, d.second);
+      lock.lock();
+    }
+  }
+}
+
+void IoEngine::drain()
+{
+  std::unique_lock<std::mutex> lock(latch);
+  while (inFlight > 0)
+    slotFreed.wait(lock);
+}
+
+void IoEngine::complete(const std::uint32_t slot, const ssize_t result)
+{
+  Callback done;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    done.swap(slots[slot].done);
+  }
+  if (done)
+    done(result);
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    freeSlots.push_back(slot);
+    --inFlight;
+  }
+  slotFreed.notify_all();
+}
+
+void IoEngine::completeLater(const std::uint32_t slot, const ssize_t result)
+{
+  finished.push_back(std::make_pair(slot, result));
+}
+
+void IoEngine::shutdown()
+{
+  drain();
+  if (reaper && owner == getpid()) {
+    stop();
+    reaper->join();
+  }
+  reaper.reset();
+}
+
+/**
+ * Raw io_uring system calls; glibc has no wrappers
+ */
+static int uringSetup(const unsigned entries, struct io_uring_params* params)
+{
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(const int fd, const unsigned toSubmit, const unsigned minComplete,
+                      const unsigned flags)
+{
+  return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+bool UringEngine::supported()
+{
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  const int fd = uringSetup(1, &params);
+  if (fd < 0)
+    return false;
+  close(fd);
+  return true;
+}
+
+UringEngine::UringEngine(const unsigned depth)
+	: IoEngine(depth), ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes(MAP_FAILED)
+{
+}
+
+UringEngine::~UringEngine()
+{
+  shutdown();
+  if (sqes != MAP_FAILED)
+    munmap(sqes, sqesSize);
+  if (cqRing != MAP_FAILED && cqRing != sqRing)
+    munmap(cqRing, cqRingSize);
+  if (sqRing != MAP_FAILED)
+    munmap(sqRing, sqRingSize);
+  if (ringFd >= 0)
+    close(ringFd);
+}
+
+void UringEngine::start()
+{
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  // one spare entry for the stop token
+  ringFd = uringSetup(depth + 1, &params);
+  if (ringFd < 0)
+    throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqRingSize > sqRingSize)
+      sqRingSize = cqRingSize;
+    cqRingSize = sqRingSize;
+  }
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED)
+    throw std::system_error(errno, std::generic_category(), "io_uring sq ring");
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cqRing = sqRing;
+  } else {
+    cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category(), "io_uring cq ring");
+  }
+  sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              ringFd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    throw std::system_error(errno, std::generic_category(), "io_uring sqes");
+
+  char* sq = static_cast<char*>(sqRing);
+  char* cq = static_cast<char*>(cqRing);
+  sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes = cq + params.cq_off.cqes;
+
+  reaper.reset(new std::thread(&UringEngine::reap, this));
+}
+
+bool UringEngine::pushEntry(const std::uint8_t opcode, const std::uint32_t slot)
+{
+  const unsigned tail = *sqTail;
+  if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > *sqMask)
+    return false;
+  const unsigned index = tail & *sqMask;
+  struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes) + index;
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  if (opcode == IORING_OP_NOP) {
+    sqe->fd = -1;
+    sqe->user_data = STOP_TOKEN;
+  } else {
+    // readv/writev rather than read/write, which need a 5.6 kernel
+    Request& request = slots[slot];
+    sqe->fd = request.fd;
+    sqe->off = request.offset;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&request.part);
+    sqe->len = 1;
+    sqe->user_data = slot;
+  }
+  sqArray[index] = index;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+int UringEngine::enter(const unsigned count)
+{
+  unsigned submitted = 0;
+  while (submitted < count) {
+    const int ret = uringEnter(ringFd, count - submitted, 0, 0);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        std::this_thread::yield();
+        continue;
+      }
+      return -errno;
+    }
+    submitted += ret;
+  }
+  return 0;
+}
+
+void UringEngine::submitSlots(const std::vector<std::uint32_t>& batch)
+{
+  const unsigned before = *sqTail;
+  for (std::uint32_t slot : batch)
+    pushEntry(slots[slot].write ? IORING_OP_WRITEV : IORING_OP_READV, slot);
+  const int error = enter(batch.size());
+  if (error < 0) {
+    // take back what the kernel did not consume and fail it
+    const unsigned consumed = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) - before;
+    __atomic_store_n(sqTail, before + consumed, __ATOMIC_RELEASE);
+    for (std::size_t i = consumed; i < batch.size(); i++)
+      completeLater(batch[i], error);
+  }
+}
+
+void UringEngine::stop()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  pushEntry(IORING_OP_NOP, 0);
+  enter(1);
+}
+
+void UringEngine::reap()
+{
+  for (;;) {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+      uringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+      continue;
+    }
+    const struct io_uring_cqe* cqe =
+        static_cast<const struct io_uring_cqe*>(cqes) + (head & *cqMask);
+    const std::uint64_t userData = cqe->user_data;
+    const ssize_t result = cqe->res;
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    if (userData == STOP_TOKEN)
+      return;
+    complete(static_cast<std::uint32_t>(userData), result);
+  }
+}
+
+bool AioEngine::supported()
+{
+  aio_context_t ctx = 0;
+  if (syscall(__NR_io_setup, 1, &ctx) < 0)
+    return false;
+  syscall(__NR_io_destroy, ctx);
+  return true;
+}
+
+AioEngine::AioEngine(const unsigned depth)
+	: IoEngine(depth), context(0), stopping(false), controls(depth * sizeof(struct iocb))
+{
+}
+
+AioEngine::~AioEngine()
+{
+  shutdown();
+  if (context != 0)
+    syscall(__NR_io_destroy, context);
+}
+
+void AioEngine::start()
+{
+  aio_context_t ctx = 0;
+  if (syscall(__NR_io_setup, depth, &ctx) < 0)
+    throw std::system_error(errno, std::generic_category(), "io_setup");
+  context = ctx;
+  stopping = false;
+  reaper.reset(new std::thread(&AioEngine::reap, this));
+}
+
+void AioEngine::submitSlots(const std::vector<std::uint32_t>& batch)
+{
+  struct iocb* blocks = reinterpret_cast<struct iocb*>(controls.data());
+  std::vector<struct iocb*> pointers;
+  pointers.reserve(batch.size());
+  for (std::uint32_t slot : batch) {
+    const Request& request = slots[slot];
+    struct iocb& cb = blocks[slot];
+    std::memset(&cb, 0, sizeof(cb));
+    cb.aio_data = slot;
+    cb.aio_lio_opcode = request.write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+    cb.aio_fildes = request.fd;
+    cb.aio_buf = reinterpret_cast<std::uint64_t>(request.part.iov_base);
+    cb.aio_nbytes = request.part.iov_len;
+    cb.aio_offset = request.offset;
+    pointers.push_back(&cb);
+  }
+  std::size_t submitted = 0;
+  while (submitted < pointers.size()) {
+    const long ret = syscall(__NR_io_submit, context, pointers.size() - submitted,
+                             pointers.data() + submitted);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        std::this_thread::yield();
+        continue;
+      }
+      const int error = -errno;
+      for (std::size_t i = submitted; i < batch.size(); i++)
+        completeLater(batch[i], error);
+      return;
+    }
+    submitted += ret;
+  }
+}
+
+void AioEngine::stop()
+{
+  stopping = true;
+}
+
+void AioEngine::reap()
+{
+  std::vector<struct io_event> events(depth);
+  while (!stopping) {
+    // wake up now and then to notice stop()
+    struct timespec timeout = {0, 50 * 1000 * 1000};
+    const long ret = syscall(__NR_io_getevents, context, 1, depth, events.data(), &timeout);
+    for (long i = 0; i < ret; i++)
+      complete(static_cast<std::uint32_t>(events[i].data), events[i].res);
+  }
+}
+
+SyncEngine::SyncEngine(const unsigned depth)
+	: IoEngine(depth)
+{
+}
+
+SyncEngine::~SyncEngine()
+{
+  shutdown();
+}
+
+void SyncEngine::submitSlots(const std::vector<std::uint32_t>& batch)
+{
+  for (std::uint32_t slot : batch) {
+    const Request& request = slots[slot];
+    ssize_t result;
+    do {
+      result = request.write
+          ? pwrite(request.fd, request.part.iov_base, request.part.iov_len, request.offset)
+          : pread(request.fd, request.part.iov_base, request.part.iov_len, request.offset);
+    } while (result < 0 && errno == EINTR);
+    completeLater(slot, result < 0 ? -errno : result);
+  }
+}
+
+}
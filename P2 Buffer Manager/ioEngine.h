@@ -0,0 +1,278 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace badgerdb {
+
+/**
+* @brief Asynchronous positioned reads and writes of file descriptors
+*
+* Requests are prepared by any thread and handed to the kernel in batches by
+* submit().  When a request completes its callback runs on the engine's
+* completion thread with the number of bytes transferred or -errno.  The
+* backend is io_uring where the kernel allows it, Linux native AIO otherwise,
+* and as a last resort plain pread/pwrite run by submit() itself.
+*
+* The kernel side is set up by the first submit() in each process, so an
+* engine created before fork() works in the child as long as the parent has
+* not used it.
+*
+* All methods are threadsafe.  Callbacks may prepare requests but must not
+* call submit() or drain().
+*/
+class IoEngine {
+ public:
+	/**
+	 * Callback receiving the number of bytes transferred, or -errno
+	 */
+  typedef std::function<void(const ssize_t result)> Callback;
+
+	/**
+	 * Available backends, in order of preference
+	 */
+  enum Backend {
+		IO_URING = 0,
+		LINUX_AIO = 1,
+		SYNC = 2
+  };
+
+	/**
+	 * Default maximum number of requests in flight
+	 */
+  static const unsigned DEFAULT_DEPTH = 128;
+
+	/**
+	 * Creates an engine using the best backend the kernel supports
+	 *
+	 * @param depth  Maximum number of requests in flight; submit() waits for
+	 *               completions beyond that
+	 */
+  static IoEngine* create(const unsigned depth = DEFAULT_DEPTH);
+
+	/**
+	 * Subclass destructors wait for every submitted request and stop the
+	 * completion thread
+	 */
+  virtual ~IoEngine() {}
+
+	/**
+	 * Backend used by this engine
+	 */
+  virtual Backend backend() const = 0;
+
+	/**
+	 * Queues a read of length bytes at offset of fd into buffer
+	 */
+  void prepareRead(const int fd, void* buffer, const std::size_t length,
+                   const off_t offset, const Callback& done);
+
+	/**
+	 * Queues a write of length bytes from buffer at offset of fd.  buffer must
+	 * stay unchanged until done runs.
+	 */
+  void prepareWrite(const int fd, const void* buffer, const std::size_t length,
+                    const off_t offset, const Callback& done);
+
+	/**
+	 * Hands every queued request to the kernel, in as few system calls as the
+	 * backend allows
+	 */
+  void submit();
+
+	/**
+	 * Waits until every submitted request has completed and its callback has
+	 * returned
+	 */
+  void drain();
+
+ protected:
+	/**
+	 * A prepared or in-flight request
+	 */
+  struct Request {
+    int fd;
+    bool write;
+    struct iovec part;
+    off_t offset;
+    Callback done;
+  };
+
+  IoEngine(const unsigned depth);
+
+	/**
+	 * Sets up the kernel side and starts the completion thread, if any.
+	 * Called with latch held by the first submit() of each process.
+	 */
+  virtual void start() = 0;
+
+	/**
+	 * Hands the requests in the given slots to the kernel.  Called with latch
+	 * held.
+	 */
+  virtual void submitSlots(const std::vector<std::uint32_t>& slots) = 0;
+
+	/**
+	 * Makes the completion thread return.  Called without latch after all
+	 * requests completed.
+	 */
+  virtual void stop() = 0;
+
+	/**
+	 * Runs the callback of a finished request and frees its slot.  Called
+	 * without latch.
+	 */
+  void complete(const std::uint32_t slot, const ssize_t result);
+
+	/**
+	 * Records a request that finished inside submitSlots(); its callback runs
+	 * once submit() has released latch.  Called with latch held.
+	 */
+  void completeLater(const std::uint32_t slot, const ssize_t result);
+
+	/**
+	 * Waits for every request, then stops and joins the completion thread;
+	 * for destructors of subclasses, which must call it before their kernel
+	 * resources go away
+	 */
+  void shutdown();
+
+	/**
+	 * Maximum number of requests in flight
+	 */
+  const unsigned depth;
+
+	/**
+	 * Slots of in-flight requests; user data of kernel requests is the slot
+	 */
+  std::vector<Request> slots;
+
+	/**
+	 * Completion thread, if the backend needs one
+	 */
+  std::unique_ptr<std::thread> reaper;
+
+	/**
+	 * Protects slots and all members below
+	 */
+  std::mutex latch;
+
+ private:
+  std::vector<std::uint32_t> freeSlots;
+  std::vector<Request> prepared;
+  std::vector<std::pair<std::uint32_t, ssize_t> > finished;
+  std::condition_variable slotFreed;
+  unsigned inFlight;
+  pid_t owner;
+};
+
+/**
+* @brief io_uring backend driven by raw system calls
+*/
+class UringEngine : public IoEngine {
+ public:
+  UringEngine(const unsigned depth);
+  ~UringEngine();
+  Backend backend() const { return IO_URING; }
+
+	/**
+	 * True if the kernel lets this process create an io_uring instance
+	 */
+  static bool supported();
+
+ protected:
+  void start();
+  void submitSlots(const std::vector<std::uint32_t>& slots);
+  void stop();
+
+ private:
+  void reap();
+
+	/**
+	 * Queues one submission entry; returns false if the ring is full
+	 */
+  bool pushEntry(const std::uint8_t opcode, const std::uint32_t slot);
+
+	/**
+	 * Submits entries pushed since the last call, returning -errno on failure
+	 */
+  int enter(const unsigned count);
+
+  int ringFd;
+  void* sqRing;
+  void* cqRing;
+  void* sqes;
+  std::size_t sqRingSize;
+  std::size_t cqRingSize;
+  std::size_t sqesSize;
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  void* cqes;
+};
+
+/**
+* @brief Linux native AIO backend driven by raw system calls
+*/
+class AioEngine : public IoEngine {
+ public:
+  AioEngine(const unsigned depth);
+  ~AioEngine();
+  Backend backend() const { return LINUX_AIO; }
+
+	/**
+	 * True if the kernel lets this process create an AIO context
+	 */
+  static bool supported();
+
+ protected:
+  void start();
+  void submitSlots(const std::vector<std::uint32_t>& slots);
+  void stop();
+
+ private:
+  void reap();
+
+  unsigned long context;
+  std::atomic<bool> stopping;
+	/**
+	 * Kernel control block of every slot
+	 */
+  std::vector<char> controls;
+};
+
+/**
+* @brief Fallback performing each request synchronously in submit()
+*/
+class SyncEngine : public IoEngine {
+ public:
+  SyncEngine(const unsigned depth);
+  ~SyncEngine();
+  Backend backend() const { return SYNC; }
+
+ protected:
+  void start() {}
+  void submitSlots(const std::vector<std::uint32_t>& slots);
+  void stop() {}
+};
+
+}
@@ -1,17 +1,35 @@
 #include <iostream>
+#include <algorithm>
 #include <stdlib.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 //#include <stdio.h>
+#include <cstdio>
 #include <cstring>
+#include <map>
 #include <memory>
+#include <thread>
+#include <vector>
+#include "crc32c.h"
 #include "page.h"
+#include "pageCodec.h"
 #include "buffer.h"
+#include "externalSort.h"
+#include "shardedTable.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
+#include "exceptions/bad_file_format_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/corrupt_page_exception.h"
+#include "exceptions/read_only_file_exception.h"
+#include "trace.h"
+#include "wal.h"
 
 #define PRINT_ERROR(str) \
 { \
@@ -23,6 +41,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
 
 int fork_test(void (*test)())
 {
@@ -60,6 +82,35 @@ void test5();
 void test6();
 void test7();
 void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void test33();
+void test34();
+void test35();
+void test36();
+void test37();
 void testBufMgr();
 
 int main() 
@@ -176,6 +227,35 @@ void testBufMgr()
 	fork_test(test6);
 	fork_test(test7);
 	fork_test(test8);
+	fork_test(test9);
+	fork_test(test10);
+	fork_test(test11);
+	fork_test(test12);
+	fork_test(test13);
+	fork_test(test14);
+	fork_test(test15);
+	fork_test(test16);
+	fork_test(test17);
+	fork_test(test18);
+	fork_test(test19);
+	fork_test(test20);
+	fork_test(test21);
+	fork_test(test22);
+	fork_test(test23);
+	fork_test(test24);
+	fork_test(test25);
+	fork_test(test26);
+	fork_test(test27);
+	fork_test(test28);
+	fork_test(test29);
+	fork_test(test30);
+	fork_test(test31);
+	fork_test(test32);
+	fork_test(test33);
+	fork_test(test34);
+	fork_test(test35);
+	fork_test(test36);
+	fork_test(test37);
 
 	//Close files before deleting them
 	file1.close();
@@ -387,3 +467,2692 @@ void test8()
 
 	std::cout << "Test 8 passed" << "\n";
 }
+
+void test9()
+{
+	// several threads pin and verify the pages of file1 while another one
+	// allocates pages in file2, forcing concurrent clock evictions.
+	// pid[0] was disposed of on disk by test8 but is still cached here, so it
+	// stays pinned to keep the clock from writing it back.
+	bufMgr->readPage(file1ptr, pid[0], page);
+
+	const int numReaders = 4;
+	std::vector<std::thread> workers;
+	for (int t = 0; t < numReaders; t++) {
+		workers.emplace_back([t]() {
+			char buf[100];
+			Page *p;
+			for (PageId k = 0; k < 20 * num; k++) {
+				PageId j = 1 + (k * 7 + t * 13) % (num - 1);
+				bufMgr->readPage(file1ptr, pid[j], p);
+				sprintf(buf, "test.1 Page %d %7.1f", pid[j], (float)pid[j]);
+				if (strncmp(p->getRecord(rid[j]).c_str(), buf, strlen(buf)) != 0)
+				{
+					PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+				}
+				bufMgr->unPinPage(file1ptr, pid[j], false);
+			}
+		});
+	}
+	workers.emplace_back([]() {
+		PageId pageNo;
+		Page *p;
+		for (PageId k = 0; k < num; k++) {
+			bufMgr->allocPage(file2ptr, pageNo, p);
+			bufMgr->unPinPage(file2ptr, pageNo, true);
+		}
+	});
+	for (std::thread &w : workers)
+		w.join();
+	bufMgr->unPinPage(file1ptr, pid[0], false);
+
+	std::cout << "Test 9 passed" << "\n";
+}
+
+void test10()
+{
+	// write and read back a file four times larger than the pool under every
+	// replacement policy, so that each one has to evict dirty pages
+	const std::string& filename = "test.6";
+	const ReplacementPolicy policies[] = {CLOCK, LRU_K, TWO_Q};
+	for (ReplacementPolicy policy : policies) {
+		try
+		{
+			File::remove(filename);
+		}
+		catch(FileNotFoundException &)
+		{
+		}
+		File file6 = File::create(filename);
+		BufMgr policyMgr(num / 4, policy);
+
+		for (i = 0; i < num; i++)
+		{
+			policyMgr.allocPage(&file6, pid[i], page);
+			sprintf((char*)tmpbuf, "test.6 Page %d %7.1f", pid[i], (float)pid[i]);
+			rid[i] = page->insertRecord(tmpbuf);
+			policyMgr.unPinPage(&file6, pid[i], true);
+		}
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (i = 0; i < num; i++)
+			{
+				policyMgr.readPage(&file6, pid[i], page);
+				sprintf((char*)&tmpbuf, "test.6 Page %d %7.1f", pid[i], (float)pid[i]);
+				if(strncmp(page->getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+				{
+					PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+				}
+				policyMgr.unPinPage(&file6, pid[i], false);
+			}
+		}
+		policyMgr.flushFile(&file6);
+		file6.close();
+		File::remove(filename);
+	}
+
+	std::cout << "Test 10 passed" << "\n";
+}
+
+void test11()
+{
+	// every frame fill, eviction and write back of a file twice the pool size
+	// shows up in the statistics
+	const std::string& filename = "test.7";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file7 = File::create(filename);
+	const PageId pages = 20;
+	BufMgr statsMgr(pages / 2);
+
+	for (i = 0; i < pages; i++)
+	{
+		statsMgr.allocPage(&file7, pid[i], page);
+		statsMgr.unPinPage(&file7, pid[i], true);
+	}
+	for (i = 0; i < pages; i++)
+	{
+		statsMgr.readPage(&file7, pid[i], page);
+		statsMgr.unPinPage(&file7, pid[i], false);
+	}
+	statsMgr.readPage(&file7, pid[pages - 1], page);
+	statsMgr.unPinPage(&file7, pid[pages - 1], false);
+	// let the last background write-backs complete
+	statsMgr.checkpoint();
+
+	// which pages are still resident when the reads start depends on the
+	// order background write-backs complete in, but every read either hits
+	// or misses and the sequential reads are read ahead of
+	BufStats stats = statsMgr.getBufStats();
+	if (stats.hits + stats.misses != pages + 1 || stats.prefetches == 0
+			|| stats.diskreads != pages + stats.misses + stats.prefetches
+			|| stats.accesses != 2 * pages + 1)
+	{
+		PRINT_ERROR("ERROR :: WRONG ACCESS COUNTS");
+	}
+	// all but the last pages / 2 frame fills evicted a page, and each
+	// allocated page was written back exactly once, on eviction or ahead of
+	// it by the background writer
+	if (stats.evictions != stats.diskreads - pages / 2 || stats.diskwrites != pages
+			|| stats.dirtyEvictions > pages)
+	{
+		PRINT_ERROR("ERROR :: WRONG EVICTION COUNTS");
+	}
+	if (stats.readLatency.count != stats.misses || stats.writeLatency.count != pages
+			|| stats.readLatency.percentileNanos(100) == 0)
+	{
+		PRINT_ERROR("ERROR :: WRONG LATENCY HISTOGRAMS");
+	}
+	if (stats.files.size() != 1 || stats.files[0].filename != filename
+			|| stats.files[0].counters[STAT_ALLOCS] != pages)
+	{
+		PRINT_ERROR("ERROR :: WRONG PER FILE COUNTS");
+	}
+
+	statsMgr.clearBufStats();
+	stats = statsMgr.getBufStats();
+	if (stats.accesses != 0 || stats.readLatency.count != 0)
+	{
+		PRINT_ERROR("ERROR :: STATISTICS NOT CLEARED");
+	}
+
+	statsMgr.flushFile(&file7);
+	file7.close();
+	File::remove(filename);
+
+	std::cout << "Test 11 passed" << "\n";
+}
+
+void test12()
+{
+	// concurrent evictions in group commit mode, then a checkpoint that must
+	// leave every page on disk while the pool keeps its copies
+	const std::string& filename = "test.8";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file8 = File::create(filename);
+	BufMgr commitMgr(num / 4, TWO_Q, WRITE_GROUP_COMMIT);
+
+	const int numWriters = 4;
+	const PageId perWriter = num / numWriters;
+	std::vector<PageId> pages(num);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < numWriters; t++) {
+		workers.emplace_back([&, t]() {
+			char buf[100];
+			Page *p;
+			for (PageId k = 0; k < perWriter; k++) {
+				PageId &pageNo = pages[t * perWriter + k];
+				commitMgr.allocPage(&file8, pageNo, p);
+				sprintf(buf, "test.8 Page %d %7.1f", pageNo, (float)pageNo);
+				p->insertRecord(buf);
+				commitMgr.unPinPage(&file8, pageNo, true);
+			}
+		});
+	}
+	for (std::thread &w : workers)
+		w.join();
+
+	commitMgr.checkpoint();
+	for (PageId pageNo : pages)
+	{
+		Page onDisk = file8.readPage(pageNo);
+		sprintf((char*)tmpbuf, "test.8 Page %d %7.1f", pageNo, (float)pageNo);
+		const RecordId first = {pageNo, 1};
+		if(strncmp(onDisk.getRecord(first).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: CHECKPOINTED CONTENTS DID NOT MATCH");
+		}
+	}
+	// nothing is dirty any more
+	const std::uint64_t written = commitMgr.getBufStats().diskwrites;
+	commitMgr.checkpoint();
+	if (commitMgr.getBufStats().diskwrites != written || written < num)
+	{
+		PRINT_ERROR("ERROR :: WRONG NUMBER OF WRITE BACKS");
+	}
+
+	commitMgr.flushFile(&file8);
+	file8.close();
+	File::remove(filename);
+
+	std::cout << "Test 12 passed" << "\n";
+}
+
+void test13()
+{
+	// the same batch of asynchronous page writes and reads on every backend
+	// the kernel offers keeps the file's page list intact
+	const std::string& filename = "test.9";
+	const PageId pages = 16;
+	std::vector<std::unique_ptr<IoEngine> > engines;
+	if (UringEngine::supported())
+		engines.emplace_back(new UringEngine(4));
+	if (AioEngine::supported())
+		engines.emplace_back(new AioEngine(4));
+	engines.emplace_back(new SyncEngine(4));
+
+	for (std::unique_ptr<IoEngine> &engine : engines)
+	{
+		try
+		{
+			File::remove(filename);
+		}
+		catch(FileNotFoundException &)
+		{
+		}
+		File file9 = File::create(filename);
+		std::vector<Page> frames(pages);
+		for (i = 0; i < pages; i++)
+		{
+			frames[i] = file9.allocatePage();
+			sprintf((char*)tmpbuf, "test.9 Page %d %7.1f", frames[i].page_number(), (float)frames[i].page_number());
+			frames[i].insertRecord(tmpbuf);
+		}
+		// more requests than the engine has slots
+		std::atomic<int> failed(0);
+		for (i = 0; i < pages; i++)
+		{
+			file9.writePageAsync(*engine, frames[i], [&failed](const int error) {
+				if (error != 0)
+					failed++;
+			});
+		}
+		engine->submit();
+		engine->drain();
+
+		std::vector<Page> copies(pages);
+		for (i = 0; i < pages; i++)
+		{
+			file9.readPageAsync(*engine, frames[i].page_number(), copies[i], [&failed](const int error) {
+				if (error != 0)
+					failed++;
+			});
+		}
+		std::atomic<int> missing(0);
+		Page scratch;
+		file9.readPageAsync(*engine, pages + 1, scratch, [&missing](const int error) {
+			if (error == ENODATA)
+				missing++;
+		});
+		engine->submit();
+		engine->drain();
+		if (failed != 0 || missing != 1)
+		{
+			PRINT_ERROR("ERROR :: ASYNCHRONOUS I/O FAILED");
+		}
+
+		for (i = 0; i < pages; i++)
+		{
+			sprintf((char*)tmpbuf, "test.9 Page %d %7.1f", copies[i].page_number(), (float)copies[i].page_number());
+			const RecordId first = {copies[i].page_number(), 1};
+			if(copies[i].page_number() != frames[i].page_number()
+					|| strncmp(copies[i].getRecord(first).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: ASYNCHRONOUS READ CONTENTS DID NOT MATCH");
+			}
+		}
+		PageId found = 0;
+		for (FileIterator iter = file9.begin(); iter != file9.end(); ++iter)
+			found++;
+		if (found != pages)
+		{
+			PRINT_ERROR("ERROR :: ASYNCHRONOUS WRITE BROKE THE PAGE LIST");
+		}
+		file9.close();
+		File::remove(filename);
+	}
+
+	std::cout << "Test 13 passed" << "\n";
+}
+
+void test14()
+{
+	// explicit prefetches turn later reads into hits, prefetches of pages
+	// not in use are dropped, and a forward scan reads ahead by itself
+	const std::string& filename = "test.10";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file10 = File::create(filename);
+	const PageId pages = 30;
+	BufMgr aheadMgr(40);
+
+	for (i = 0; i < pages; i++)
+	{
+		Page newPage = file10.allocatePage();
+		pid[i] = newPage.page_number();
+		sprintf((char*)tmpbuf, "test.10 Page %d %7.1f", pid[i], (float)pid[i]);
+		rid[i] = newPage.insertRecord(tmpbuf);
+		file10.writePage(newPage);
+	}
+	file10.deletePage(pid[10]);
+
+	aheadMgr.prefetch(&file10, pid[0], 11);
+	aheadMgr.prefetch(&file10, pid[pages - 1] + 1, 5);
+	// backwards, so that the reads are not taken for a scan
+	for (i = 10; i > 0; i--)
+	{
+		aheadMgr.readPage(&file10, pid[i - 1], page);
+		sprintf((char*)tmpbuf, "test.10 Page %d %7.1f", pid[i - 1], (float)pid[i - 1]);
+		if(strncmp(page->getRecord(rid[i - 1]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: PREFETCHED CONTENTS DID NOT MATCH");
+		}
+		aheadMgr.unPinPage(&file10, pid[i - 1], false);
+	}
+	BufStats stats = aheadMgr.getBufStats();
+	if (stats.prefetches != 10 || stats.hits != 10 || stats.misses != 0)
+	{
+		PRINT_ERROR("ERROR :: WRONG PREFETCH COUNTS");
+	}
+	try
+	{
+		aheadMgr.readPage(&file10, pid[10], page);
+		PRINT_ERROR("ERROR :: InvalidPageException should have been thrown before reaches this point.");
+	}
+	catch(InvalidPageException &)
+	{
+	}
+
+	aheadMgr.clearBufStats();
+	for (i = 11; i < pages; i++)
+	{
+		aheadMgr.readPage(&file10, pid[i], page);
+		sprintf((char*)tmpbuf, "test.10 Page %d %7.1f", pid[i], (float)pid[i]);
+		if(strncmp(page->getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: READ AHEAD CONTENTS DID NOT MATCH");
+		}
+		aheadMgr.unPinPage(&file10, pid[i], false);
+	}
+	stats = aheadMgr.getBufStats();
+	if (stats.prefetches == 0 || stats.misses + stats.prefetches != pages - 11
+			|| stats.hits != stats.prefetches)
+	{
+		PRINT_ERROR("ERROR :: SCAN WAS NOT READ AHEAD");
+	}
+
+	// nothing was dirtied, so nothing needs flushing
+	file10.close();
+	File::remove(filename);
+
+	std::cout << "Test 14 passed" << "\n";
+}
+
+void test15()
+{
+	// the background writer cleans all but a quarter of the pool behind a
+	// burst of dirty allocations, and the destructor writes back the rest
+	const std::string& filename = "test.11";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file11 = File::create(filename);
+	const PageId pages = 40;
+	const std::uint32_t frames = 20;
+	{
+		BufMgr trickleMgr(frames, TWO_Q, WRITE_BUFFERED, 0.25);
+		for (i = 0; i < pages; i++)
+		{
+			trickleMgr.allocPage(&file11, pid[i], page);
+			sprintf((char*)tmpbuf, "test.11 Page %d %7.1f", pid[i], (float)pid[i]);
+			rid[i] = page->insertRecord(tmpbuf);
+			trickleMgr.unPinPage(&file11, pid[i], true);
+		}
+		for (int wait = 0; wait < 500; wait++)
+		{
+			if (trickleMgr.getBufStats().diskwrites >= pages - frames / 4)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		if (trickleMgr.getBufStats().diskwrites < pages - frames / 4)
+		{
+			PRINT_ERROR("ERROR :: BACKGROUND WRITER DID NOT CATCH UP");
+		}
+	}
+	{
+		// without the background writer, frames are only written on eviction
+		BufMgr drainMgr(frames, TWO_Q, WRITE_BUFFERED, 1);
+		for (i = 0; i < frames / 2; i++)
+		{
+			drainMgr.readPage(&file11, pid[i], page);
+			sprintf((char*)tmpbuf, "test.11 Page %d again", pid[i]);
+			rid[i] = page->insertRecord(tmpbuf);
+			drainMgr.unPinPage(&file11, pid[i], true);
+		}
+		if (drainMgr.getBufStats().diskwrites != 0)
+		{
+			PRINT_ERROR("ERROR :: PAGES WRITTEN BEFORE EVICTION");
+		}
+	}
+
+	for (i = 0; i < pages; i++)
+	{
+		Page onDisk = file11.readPage(pid[i]);
+		if (i < frames / 2)
+			sprintf((char*)tmpbuf, "test.11 Page %d again", pid[i]);
+		else
+			sprintf((char*)tmpbuf, "test.11 Page %d %7.1f", pid[i], (float)pid[i]);
+		if(strncmp(onDisk.getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: DIRTY PAGES LOST AT SHUTDOWN");
+		}
+	}
+	file11.close();
+	File::remove(filename);
+
+	std::cout << "Test 15 passed" << "\n";
+}
+
+void test16()
+{
+	// batches of hits, misses and repeated pages are pinned and unpinned
+	// together, and a batch that fails leaves nothing pinned
+	const std::string& filename = "test.12";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file12 = File::create(filename);
+	const PageId pages = 30;
+	const std::uint32_t frames = 20;
+	for (i = 0; i < pages; i++)
+	{
+		Page newPage = file12.allocatePage();
+		pid[i] = newPage.page_number();
+		sprintf((char*)tmpbuf, "test.12 Page %d %7.1f", pid[i], (float)pid[i]);
+		rid[i] = newPage.insertRecord(tmpbuf);
+		file12.writePage(newPage);
+	}
+	file12.deletePage(pid[pages - 1]);
+	BufMgr batchMgr(frames);
+
+	// every other page is already in the pool, read backwards so as not to
+	// be read ahead of; the last one repeats
+	for (i = 10; i > 0; i -= 2)
+	{
+		batchMgr.readPage(&file12, pid[i - 2], page);
+		batchMgr.unPinPage(&file12, pid[i - 2], false);
+	}
+	batchMgr.clearBufStats();
+	PageId batch[11];
+	Page* batchPages[11];
+	for (i = 0; i < 10; i++)
+		batch[i] = pid[9 - i];
+	batch[10] = pid[0];
+	batchMgr.readPages(&file12, batch, 11, batchPages);
+	for (i = 0; i < 11; i++)
+	{
+		sprintf((char*)tmpbuf, "test.12 Page %d %7.1f", batch[i], (float)batch[i]);
+		const RecordId first = {batch[i], 1};
+		if(strncmp(batchPages[i]->getRecord(first).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: BATCH CONTENTS DID NOT MATCH");
+		}
+	}
+	BufStats stats = batchMgr.getBufStats();
+	if (stats.hits != 6 || stats.misses != 5 || batchPages[0] == batchPages[1]
+			|| batchPages[9] != batchPages[10])
+	{
+		PRINT_ERROR("ERROR :: WRONG BATCH COUNTS");
+	}
+	batchMgr.unPinPages(&file12, batch, 11, true);
+	try
+	{
+		batchMgr.unPinPages(&file12, batch, 10, false);
+		PRINT_ERROR("ERROR :: PageNotPinnedException should have been thrown before reaches this point.");
+	}
+	catch(PageNotPinnedException &)
+	{
+	}
+
+	// more pages than frames, then a page that is not in use
+	PageId tooMany[pages];
+	Page* tooManyPages[pages];
+	for (i = 0; i < frames + 1; i++)
+		tooMany[i] = pid[i];
+	try
+	{
+		batchMgr.readPages(&file12, tooMany, frames + 1, tooManyPages);
+		PRINT_ERROR("ERROR :: BufferExceededException should have been thrown before reaches this point.");
+	}
+	catch(BufferExceededException &)
+	{
+	}
+	tooMany[0] = pid[pages - 1];
+	try
+	{
+		batchMgr.readPages(&file12, tooMany, frames, tooManyPages);
+		PRINT_ERROR("ERROR :: InvalidPageException should have been thrown before reaches this point.");
+	}
+	catch(InvalidPageException &)
+	{
+	}
+	// nothing stayed pinned, so the whole pool is available
+	for (i = 0; i < frames; i++)
+		tooMany[i] = pid[pages - 2 - i];
+	batchMgr.readPages(&file12, tooMany, frames, tooManyPages);
+	batchMgr.unPinPages(&file12, tooMany, frames, false);
+
+	batchMgr.checkpoint();
+	for (i = 0; i < 10; i++)
+	{
+		Page onDisk = file12.readPage(pid[i]);
+		sprintf((char*)tmpbuf, "test.12 Page %d %7.1f", pid[i], (float)pid[i]);
+		if(strncmp(onDisk.getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: BATCH WRITE BACK DID NOT MATCH");
+		}
+	}
+	file12.close();
+	File::remove(filename);
+
+	std::cout << "Test 16 passed" << "\n";
+}
+
+void test17()
+{
+	// pages of a mapped file are used in place: more of them can be pinned
+	// than there are frames, and nothing may change them
+	const std::string& filename = "test.13";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	const PageId pages = 10;
+	const std::uint32_t frames = 4;
+	{
+		File file13 = File::create(filename);
+		for (i = 0; i < pages; i++)
+		{
+			Page newPage = file13.allocatePage();
+			pid[i] = newPage.page_number();
+			sprintf((char*)tmpbuf, "test.13 Page %d %7.1f", pid[i], (float)pid[i]);
+			rid[i] = newPage.insertRecord(tmpbuf);
+			file13.writePage(newPage);
+		}
+		file13.deletePage(pid[pages - 1]);
+	}
+	File mapped = File::openMapped(filename);
+	BufMgr mapMgr(frames);
+
+	Page* mappedPages[pages];
+	for (i = 0; i < pages - 1; i++)
+	{
+		mapMgr.readPage(&mapped, pid[i], mappedPages[i]);
+		sprintf((char*)tmpbuf, "test.13 Page %d %7.1f", pid[i], (float)pid[i]);
+		if(strncmp(mappedPages[i]->getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: MAPPED CONTENTS DID NOT MATCH");
+		}
+		if (mappedPages[i] != mapped.mappedPage(pid[i]))
+		{
+			PRINT_ERROR("ERROR :: MAPPED PAGE WAS COPIED");
+		}
+	}
+	// pinned twice, once by readPages
+	mapMgr.readPages(&mapped, pid, 2, mappedPages);
+	BufStats stats = mapMgr.getBufStats();
+	if (stats.hits != pages + 1 || stats.diskreads != 0)
+	{
+		PRINT_ERROR("ERROR :: WRONG MAPPED COUNTS");
+	}
+	try
+	{
+		mapMgr.readPage(&mapped, pid[pages - 1], page);
+		PRINT_ERROR("ERROR :: InvalidPageException should have been thrown before reaches this point.");
+	}
+	catch(InvalidPageException &)
+	{
+	}
+	try
+	{
+		mapMgr.unPinPage(&mapped, pid[0], true);
+		PRINT_ERROR("ERROR :: ReadOnlyFileException should have been thrown before reaches this point.");
+	}
+	catch(ReadOnlyFileException &)
+	{
+	}
+	mapMgr.unPinPages(&mapped, pid, pages - 1, false);
+	try
+	{
+		mapMgr.flushFile(&mapped);
+		PRINT_ERROR("ERROR :: PagePinnedException should have been thrown before reaches this point.");
+	}
+	catch(PagePinnedException &)
+	{
+	}
+	mapMgr.unPinPages(&mapped, pid, 2, false);
+	mapMgr.flushFile(&mapped);
+	mapMgr.prefetch(&mapped, pid[0], pages);
+
+	try
+	{
+		mapMgr.allocPage(&mapped, i, page);
+		PRINT_ERROR("ERROR :: ReadOnlyFileException should have been thrown before reaches this point.");
+	}
+	catch(ReadOnlyFileException &)
+	{
+	}
+	try
+	{
+		mapped.writePage(mapped.readPage(pid[0]));
+		PRINT_ERROR("ERROR :: ReadOnlyFileException should have been thrown before reaches this point.");
+	}
+	catch(ReadOnlyFileException &)
+	{
+	}
+	mapped.close();
+	File::remove(filename);
+
+	std::cout << "Test 17 passed" << "\n";
+}
+
+void test18()
+{
+	// a partitioned pool still fills every frame before running out, and
+	// every event is counted in exactly one partition
+	const std::string& filename = "test.14";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file14 = File::create(filename);
+	const std::uint32_t frames = 18;
+	const int parts = 4;
+	for (i = 0; i < frames + 1; i++)
+	{
+		Page newPage = file14.allocatePage();
+		pid[i] = newPage.page_number();
+		sprintf((char*)tmpbuf, "test.14 Page %d %7.1f", pid[i], (float)pid[i]);
+		rid[i] = newPage.insertRecord(tmpbuf);
+		file14.writePage(newPage);
+	}
+	for (int placement = PLACE_NODE_LOCAL; placement <= PLACE_HASHED; placement++)
+	{
+		BufMgr partMgr(frames, TWO_Q, WRITE_BUFFERED, 0.1, parts, (BufPlacement)placement);
+		BufStats stats = partMgr.getBufStats();
+		std::uint32_t total = 0;
+		for (const PartitionBufStats& partition : stats.partitions)
+			total += partition.frames;
+		if (stats.partitions.size() != parts || total != frames)
+		{
+			PRINT_ERROR("ERROR :: WRONG PARTITIONS");
+		}
+
+		// backwards, so as not to be read ahead of
+		Page* pinned[frames];
+		for (i = frames; i > 0; i--)
+		{
+			partMgr.readPage(&file14, pid[i - 1], pinned[i - 1]);
+			sprintf((char*)tmpbuf, "test.14 Page %d %7.1f", pid[i - 1], (float)pid[i - 1]);
+			if(strncmp(pinned[i - 1]->getRecord(rid[i - 1]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: PARTITIONED CONTENTS DID NOT MATCH");
+			}
+		}
+		try
+		{
+			partMgr.readPage(&file14, pid[frames], page);
+			PRINT_ERROR("ERROR :: BufferExceededException should have been thrown before reaches this point.");
+		}
+		catch(BufferExceededException &)
+		{
+		}
+		for (i = 0; i < frames; i++)
+			partMgr.unPinPage(&file14, pid[i], false);
+		partMgr.readPage(&file14, pid[frames], page);
+		partMgr.unPinPage(&file14, pid[frames], false);
+		partMgr.readPage(&file14, pid[frames], page);
+		partMgr.unPinPage(&file14, pid[frames], false);
+
+		stats = partMgr.getBufStats();
+		std::uint64_t hits = 0, misses = 0, evictions = 0;
+		for (const PartitionBufStats& partition : stats.partitions)
+		{
+			hits += partition.counters[STAT_HITS];
+			misses += partition.counters[STAT_MISSES];
+			evictions += partition.counters[STAT_EVICTIONS];
+		}
+		if (hits != stats.hits || misses != stats.misses || evictions != stats.evictions
+				|| stats.misses != frames + 1 || stats.hits != 1 || stats.evictions != 1)
+		{
+			PRINT_ERROR("ERROR :: WRONG PARTITION COUNTS");
+		}
+	}
+
+	// never more partitions than frames
+	BufMgr tinyMgr(3, TWO_Q, WRITE_BUFFERED, 0.1, 8);
+	if (tinyMgr.getBufStats().partitions.size() != 3)
+	{
+		PRINT_ERROR("ERROR :: WRONG PARTITIONS");
+	}
+	file14.close();
+	File::remove(filename);
+
+	std::cout << "Test 18 passed" << "\n";
+}
+
+void test19()
+{
+	// every kind of arena falls back to one the system provides, aligned
+	// for its pages, and holds pages like any other
+	const std::string& filename = "test.15";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file15 = File::create(filename);
+	const std::uint32_t frames = 300;
+	for (int pages = POOL_HUGE_1GB; pages <= POOL_SMALL; pages++)
+	{
+		BufMgr arenaMgr(frames, TWO_Q, WRITE_BUFFERED, 0.1, 0, PLACE_NODE_LOCAL, (PoolPages)pages);
+		const std::uintptr_t start = (std::uintptr_t)arenaMgr.bufPool;
+		const std::uintptr_t alignment = arenaMgr.poolPages() == POOL_SMALL ? 4096
+				: arenaMgr.poolPages() == POOL_HUGE_1GB ? 1UL << 30 : 2UL << 20;
+		if (arenaMgr.poolPages() < pages || start % alignment != 0)
+		{
+			PRINT_ERROR("ERROR :: WRONG ARENA");
+		}
+		for (i = 0; i < 5; i++)
+		{
+			arenaMgr.allocPage(&file15, pid[i], page);
+			sprintf((char*)tmpbuf, "test.15 Page %d %7.1f", pid[i], (float)pid[i]);
+			rid[i] = page->insertRecord(tmpbuf);
+			arenaMgr.unPinPage(&file15, pid[i], true);
+		}
+		arenaMgr.checkpoint();
+		for (i = 5; i > 0; i--)
+		{
+			arenaMgr.readPage(&file15, pid[i - 1], page);
+			sprintf((char*)tmpbuf, "test.15 Page %d %7.1f", pid[i - 1], (float)pid[i - 1]);
+			if(strncmp(page->getRecord(rid[i - 1]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: ARENA CONTENTS DID NOT MATCH");
+			}
+			arenaMgr.unPinPage(&file15, pid[i - 1], false);
+		}
+	}
+	file15.close();
+	File::remove(filename);
+
+	std::cout << "Test 19 passed" << "\n";
+}
+
+void test20()
+{
+	// a direct I/O file keeps its pages through write-backs of a small pool,
+	// unaligned reads and writes, and page deletes, and reads back the same
+	// without direct I/O
+	const std::string& filename = "test.16";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	const PageId pages = 50;
+	{
+		File file16 = File::create(filename, true);
+		BufMgr directMgr(10);
+		for (i = 0; i < pages; i++)
+		{
+			directMgr.allocPage(&file16, pid[i], page);
+			if ((std::uintptr_t)page % File::DIRECT_ALIGNMENT != 0)
+			{
+				PRINT_ERROR("ERROR :: FRAME NOT ALIGNED");
+			}
+			sprintf((char*)tmpbuf, "test.16 Page %d %7.1f", pid[i], (float)pid[i]);
+			rid[i] = page->insertRecord(tmpbuf);
+			directMgr.unPinPage(&file16, pid[i], true);
+		}
+		// every third page goes, unlinking it from the page before it
+		for (i = 0; i < pages; i += 3)
+			directMgr.disposePage(&file16, pid[i]);
+		directMgr.checkpoint();
+		for (i = 1; i < pages; i += 3)
+		{
+			Page copy = file16.readPage(pid[i]);
+			sprintf((char*)tmpbuf, "test.16 Page %d %7.1f", pid[i], (float)pid[i]);
+			if(strncmp(copy.getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: DIRECT CONTENTS DID NOT MATCH");
+			}
+		}
+	}
+
+	File file16 = File::open(filename);
+	if (file16.isDirect())
+	{
+		PRINT_ERROR("ERROR :: REOPENED FILE STILL DIRECT");
+	}
+	PageId used = 0;
+	for (FileIterator iter = file16.begin(); iter != file16.end(); ++iter)
+	{
+		Page copy = *iter;
+		for (i = 0; i < pages && pid[i] != copy.page_number(); i++)
+			;
+		sprintf((char*)tmpbuf, "test.16 Page %d %7.1f", pid[i], (float)pid[i]);
+		if (i == pages || i % 3 == 0 ||
+				strncmp(copy.getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: DIRECT FILE DID NOT READ BACK");
+		}
+		used++;
+	}
+	if (used != pages - (pages + 2) / 3)
+	{
+		PRINT_ERROR("ERROR :: WRONG NUMBER OF PAGES");
+	}
+	file16.close();
+	File::remove(filename);
+
+	// a file of the packed layout, its header and pages back to back, and an
+	// empty file are refused instead of read at the wrong offsets
+	for (int old = 0; old < 2; old++)
+	{
+		FILE* out = fopen(filename.c_str(), "wb");
+		const std::uint32_t header[5] = {2, 1, 0, 0, 0};
+		if (old == 0 &&
+				(fwrite(header, sizeof(header), 1, out) != 1 || fwrite(tmpbuf, sizeof(tmpbuf), 1, out) != 1))
+		{
+			PRINT_ERROR("ERROR :: OLD FILE NOT WRITTEN");
+		}
+		fclose(out);
+		try
+		{
+			File::open(filename);
+			PRINT_ERROR("ERROR :: OLD LAYOUT FILE OPENED");
+		}
+		catch (BadFileFormatException &)
+		{
+		}
+		File::remove(filename);
+	}
+
+	std::cout << "Test 20 passed" << "\n";
+}
+
+void test21()
+{
+	// the hot page set saved by one buffer manager warms up the next one,
+	// hottest pages first when the pool is smaller
+	const std::string& filename = "test.17";
+	const std::string& sidecar = "test.17.hot";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	std::remove(sidecar.c_str());
+	File file17 = File::create(filename);
+	const PageId pages = 12;
+	{
+		BufMgr coldMgr(20);
+		if (coldMgr.warmUp(sidecar, std::vector<File*>(1, &file17)) != 0)
+		{
+			PRINT_ERROR("ERROR :: WARMED UP WITHOUT A SIDECAR");
+		}
+		coldMgr.dumpHotSetEvery(sidecar, std::chrono::milliseconds(1));
+		for (i = 0; i < pages; i++)
+		{
+			coldMgr.allocPage(&file17, pid[i], page);
+			sprintf((char*)tmpbuf, "test.17 Page %d %7.1f", pid[i], (float)pid[i]);
+			rid[i] = page->insertRecord(tmpbuf);
+			coldMgr.unPinPage(&file17, pid[i], true);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		FILE* saved = fopen(sidecar.c_str(), "rb");
+		if (saved == NULL)
+		{
+			PRINT_ERROR("ERROR :: HOT SET NOT SAVED PERIODICALLY");
+		}
+		fclose(saved);
+		// past the last periodic save, only the last pages are referenced
+		// when the destructor saves
+		coldMgr.dumpHotSetEvery(sidecar, std::chrono::hours(1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		coldMgr.saveHotSet(sidecar);
+		for (i = pages - 3; i < pages; i++)
+		{
+			coldMgr.readPage(&file17, pid[i], page);
+			coldMgr.unPinPage(&file17, pid[i], false);
+		}
+	}
+
+	{
+		BufMgr warmMgr(20);
+		if (warmMgr.warmUp(sidecar, std::vector<File*>(1, &file17)) != pages)
+		{
+			PRINT_ERROR("ERROR :: WRONG NUMBER OF PAGES WARMED UP");
+		}
+		for (i = 0; i < pages; i++)
+		{
+			warmMgr.readPage(&file17, pid[i], page);
+			sprintf((char*)tmpbuf, "test.17 Page %d %7.1f", pid[i], (float)pid[i]);
+			if(strncmp(page->getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: WARMED UP CONTENTS DID NOT MATCH");
+			}
+			warmMgr.unPinPage(&file17, pid[i], false);
+		}
+		if (warmMgr.getBufStats().misses != 0)
+		{
+			PRINT_ERROR("ERROR :: WARMED UP PAGES MISSED");
+		}
+	}
+
+	{
+		BufMgr smallMgr(3);
+		if (smallMgr.warmUp(sidecar, std::vector<File*>(1, &file17)) != 3)
+		{
+			PRINT_ERROR("ERROR :: WRONG NUMBER OF PAGES WARMED UP");
+		}
+		for (i = pages - 3; i < pages; i++)
+		{
+			smallMgr.readPage(&file17, pid[i], page);
+			smallMgr.unPinPage(&file17, pid[i], false);
+		}
+		if (smallMgr.getBufStats().misses != 0)
+		{
+			PRINT_ERROR("ERROR :: HOTTEST PAGES NOT WARMED UP");
+		}
+		if (smallMgr.warmUp(sidecar, std::vector<File*>()) != 0)
+		{
+			PRINT_ERROR("ERROR :: WARMED UP PAGES OF UNKNOWN FILES");
+		}
+	}
+	file17.close();
+	File::remove(filename);
+	std::remove(sidecar.c_str());
+
+	std::cout << "Test 21 passed" << "\n";
+}
+
+void test22()
+{
+	// the codec round-trips and rejects damage; a compressed file keeps its
+	// pages through the pool, takes less space, and stays compressed
+	char original[Page::SIZE], packed[Page::SIZE + 64], unpacked[Page::SIZE];
+	for (int run = 0; run < 3; run++)
+	{
+		for (std::size_t b = 0; b < Page::SIZE; b++)
+			original[b] = run == 0 ? (char)rand() : run == 1 ? (char)(b / 64) : 0;
+		const std::size_t length = PageCodec::compress(original, Page::SIZE, packed, sizeof(packed));
+		if (length == 0 || !PageCodec::decompress(packed, length, unpacked, Page::SIZE)
+				|| memcmp(original, unpacked, Page::SIZE) != 0)
+		{
+			PRINT_ERROR("ERROR :: CODEC DID NOT ROUND TRIP");
+		}
+		if (PageCodec::decompress(packed, length - 1, unpacked, Page::SIZE)
+				|| PageCodec::decompress(packed, length, unpacked, Page::SIZE - 1))
+		{
+			PRINT_ERROR("ERROR :: CODEC ACCEPTED DAMAGED INPUT");
+		}
+	}
+
+	const std::string& filename = "test.18";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	const PageId pages = 40;
+	{
+		File file18 = File::create(filename, false, true);
+		BufMgr compressedMgr(8);
+		for (i = 0; i < pages; i++)
+		{
+			compressedMgr.allocPage(&file18, pid[i], page);
+			sprintf((char*)tmpbuf, "test.18 Page %d %7.1f", pid[i], (float)pid[i]);
+			rid[i] = page->insertRecord(tmpbuf);
+			if (i % 10 == 9)
+			{
+				// one page in ten does not compress and is stored as it is
+				std::string noise(Page::SIZE / 2, '\0');
+				for (std::size_t b = 0; b < noise.size(); b++)
+					noise[b] = (char)rand();
+				page->insertRecord(noise);
+			}
+			compressedMgr.unPinPage(&file18, pid[i], true);
+		}
+		for (i = 0; i < pages; i += 4)
+			compressedMgr.disposePage(&file18, pid[i]);
+		compressedMgr.checkpoint();
+	}
+
+	File file18 = File::openMapped(filename);
+	if (!file18.isCompressed() || file18.isMapped())
+	{
+		PRINT_ERROR("ERROR :: COMPRESSED FILE NOT REOPENED COMPRESSED");
+	}
+	{
+		BufMgr readMgr(8);
+		for (i = 0; i < pages; i++)
+		{
+			if (i % 4 == 0)
+				continue;
+			readMgr.readPage(&file18, pid[i], page);
+			sprintf((char*)tmpbuf, "test.18 Page %d %7.1f", pid[i], (float)pid[i]);
+			if(strncmp(page->getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: COMPRESSED CONTENTS DID NOT MATCH");
+			}
+			readMgr.unPinPage(&file18, pid[i], false);
+		}
+		readMgr.prefetch(&file18, 1, pages);
+	}
+	PageId used = 0;
+	for (FileIterator iter = file18.begin(); iter != file18.end(); ++iter)
+		used++;
+	if (used != pages - pages / 4)
+	{
+		PRINT_ERROR("ERROR :: WRONG NUMBER OF PAGES");
+	}
+	struct stat status;
+	stat(filename.c_str(), &status);
+	if ((std::uint64_t)status.st_blocks * 512 >= (std::uint64_t)(pages + 2) * Page::SIZE)
+	{
+		PRINT_ERROR("ERROR :: COMPRESSED FILE NOT SMALLER");
+	}
+	file18.close();
+	File::remove(filename);
+
+	std::cout << "Test 22 passed" << "\n";
+}
+
+void test23()
+{
+	// flushing one file of a shared pool writes back and drops only its own
+	// frames, even while pages of another file are pinned
+	const std::string& filenameA = "test.19";
+	const std::string& filenameB = "test.20";
+	try
+	{
+		File::remove(filenameA);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	try
+	{
+		File::remove(filenameB);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file19 = File::create(filenameA);
+	File file20 = File::create(filenameB);
+	const PageId pages = 10;
+	PageId pidB[pages];
+	RecordId ridB[pages];
+	BufMgr sharedMgr(2 * pages, TWO_Q, WRITE_BUFFERED, 1);
+
+	for (i = 0; i < pages; i++)
+	{
+		sharedMgr.allocPage(&file19, pid[i], page);
+		sprintf((char*)tmpbuf, "test.19 Page %d %7.1f", pid[i], (float)pid[i]);
+		rid[i] = page->insertRecord(tmpbuf);
+		sharedMgr.unPinPage(&file19, pid[i], true);
+
+		sharedMgr.allocPage(&file20, pidB[i], page);
+		sprintf((char*)tmpbuf, "test.20 Page %d %7.1f", pidB[i], (float)pidB[i]);
+		ridB[i] = page->insertRecord(tmpbuf);
+		if (i != 0)
+			sharedMgr.unPinPage(&file20, pidB[i], true);
+	}
+
+	sharedMgr.flushFile(&file19);
+	for (i = 0; i < pages; i++)
+	{
+		Page onDisk = file19.readPage(pid[i]);
+		sprintf((char*)tmpbuf, "test.19 Page %d %7.1f", pid[i], (float)pid[i]);
+		if(strncmp(onDisk.getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: FLUSHED CONTENTS DID NOT MATCH");
+		}
+	}
+	BufStats stats = sharedMgr.getBufStats();
+	for (const FileBufStats &fileStats : stats.files)
+	{
+		const std::uint64_t expected = fileStats.filename == filenameA ? pages : 0;
+		if (fileStats.counters[STAT_DISKWRITES] != expected)
+		{
+			PRINT_ERROR("ERROR :: FLUSH WROTE BACK THE WRONG FILE");
+		}
+	}
+
+	// the other file's pages stayed in the pool, and the flushed file's did not
+	sharedMgr.clearBufStats();
+	for (i = 1; i < pages; i++)
+	{
+		sharedMgr.readPage(&file20, pidB[i], page);
+		sharedMgr.unPinPage(&file20, pidB[i], false);
+	}
+	sharedMgr.readPage(&file19, pid[0], page);
+	sharedMgr.unPinPage(&file19, pid[0], false);
+	stats = sharedMgr.getBufStats();
+	if (stats.hits != pages - 1 || stats.misses != 1)
+	{
+		PRINT_ERROR("ERROR :: FLUSH DROPPED THE WRONG FRAMES");
+	}
+
+	try
+	{
+		sharedMgr.flushFile(&file20);
+		PRINT_ERROR("ERROR :: Pages pinned for file being flushed. Exception should have been thrown before execution reaches this point.");
+	}
+	catch(PagePinnedException &e)
+	{
+	}
+	sharedMgr.unPinPage(&file20, pidB[0], true);
+	sharedMgr.flushFile(&file20);
+	sharedMgr.flushFile(&file20);
+	for (i = 0; i < pages; i++)
+	{
+		Page onDisk = file20.readPage(pidB[i]);
+		sprintf((char*)tmpbuf, "test.20 Page %d %7.1f", pidB[i], (float)pidB[i]);
+		if(strncmp(onDisk.getRecord(ridB[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: FLUSHED CONTENTS DID NOT MATCH");
+		}
+	}
+
+	sharedMgr.flushFile(&file19);
+	file19.close();
+	file20.close();
+	File::remove(filenameA);
+	File::remove(filenameB);
+
+	std::cout << "Test 23 passed" << "\n";
+}
+
+void test24()
+{
+	// changes logged through the write-ahead log survive a crash that loses
+	// every dirty page, and checkpoints shorten the log
+	const std::string& filename = "test.21";
+	const std::string& logname = "test.wal";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	std::remove((logname + ".master").c_str());
+	for (int s = 1; s < 16; s++)
+		std::remove((logname + "." + std::to_string(s)).c_str());
+	const PageId pages = 20;
+	{
+		File created = File::create(filename);
+		for (i = 0; i < pages; i++)
+			pid[i] = created.allocatePage().page_number();
+	}
+
+	// the child must not write out what this process has buffered
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0)
+	{
+		File file21 = File::open(filename);
+		WriteAheadLog log(logname, WriteAheadLog::MIN_SEGMENT_SIZE);
+		BufMgr logMgr(2 * pages, TWO_Q, WRITE_BUFFERED, 1, 0, PLACE_NODE_LOCAL, POOL_HUGE_TRANSPARENT, &log);
+		std::vector<std::thread> writers;
+		for (PageId t = 0; t < 4; t++)
+		{
+			writers.push_back(std::thread([&, t]() {
+				for (PageId p = t; p < pages; p += 4)
+				{
+					Page *mine;
+					char text[100];
+					logMgr.readPage(&file21, pid[p], mine);
+					sprintf(text, "test.21 Page %d %7.1f", pid[p], (float)pid[p]);
+					mine->insertRecord(text);
+					const Lsn lsn = logMgr.logUpdate(&file21, pid[p], 0, Page::SIZE);
+					logMgr.unPinPage(&file21, pid[p], true);
+					log.flush(lsn);
+				}
+			}));
+		}
+		for (std::thread &writer : writers)
+			writer.join();
+		// crash: no page is written back and nothing more is logged
+		_exit(0);
+	}
+	waitpid(child, NULL, 0);
+
+	File file21 = File::open(filename);
+	for (i = 0; i < pages; i++)
+	{
+		if (file21.readPage(pid[i]).lsn() != 0)
+		{
+			PRINT_ERROR("ERROR :: PAGE WRITTEN BACK BEFORE THE CRASH");
+		}
+	}
+	struct stat st;
+	if (stat((logname + ".3").c_str(), &st) != 0)
+	{
+		PRINT_ERROR("ERROR :: LOG DID NOT MOVE ON TO NEW SEGMENTS");
+	}
+	std::vector<File*> files(1, &file21);
+	{
+		WriteAheadLog log(logname);
+		if (log.recover(files) != pages)
+		{
+			PRINT_ERROR("ERROR :: RECOVERY DID NOT REDO EVERY LOGGED CHANGE");
+		}
+		if (log.recover(files) != 0)
+		{
+			PRINT_ERROR("ERROR :: RECOVERY REDID CHANGES ALREADY APPLIED");
+		}
+	}
+	for (i = 0; i < pages; i++)
+	{
+		Page onDisk = file21.readPage(pid[i]);
+		PageIterator record = onDisk.begin();
+		sprintf((char*)tmpbuf, "test.21 Page %d %7.1f", pid[i], (float)pid[i]);
+		if (onDisk.lsn() == 0 || record == onDisk.end() || *record != tmpbuf)
+		{
+			PRINT_ERROR("ERROR :: RECOVERED CONTENTS DID NOT MATCH");
+		}
+	}
+
+	{
+		WriteAheadLog log(logname);
+		BufMgr logMgr(2 * pages, TWO_Q, WRITE_BUFFERED, 1, 0, PLACE_NODE_LOCAL, POOL_HUGE_TRANSPARENT, &log);
+		// a dirty page holds the redo point back until it is written back
+		logMgr.readPage(&file21, pid[0], page);
+		const Lsn first = logMgr.logUpdate(&file21, pid[0], 0, Page::SIZE);
+		logMgr.unPinPage(&file21, pid[0], true);
+		if (logMgr.fuzzyCheckpoint() != first || log.redoLsn() != first)
+		{
+			PRINT_ERROR("ERROR :: CHECKPOINT MOVED THE REDO POINT PAST A DIRTY PAGE");
+		}
+		if (stat((logname + ".1").c_str(), &st) == 0 || stat((logname + ".2").c_str(), &st) == 0)
+		{
+			PRINT_ERROR("ERROR :: CHECKPOINT KEPT SEGMENTS BEFORE THE REDO POINT");
+		}
+		logMgr.flushFile(&file21);
+		if (logMgr.fuzzyCheckpoint() != log.endLsn())
+		{
+			PRINT_ERROR("ERROR :: CHECKPOINT DID NOT MOVE THE REDO POINT TO THE END");
+		}
+	}
+
+	// a record torn by a crash ends the log, and the one before it is kept
+	const std::size_t offset = sizeof(PageHeader) + 4000;
+	Lsn torn;
+	{
+		WriteAheadLog log(logname);
+		if (log.recover(files) != 0)
+		{
+			PRINT_ERROR("ERROR :: RECOVERY REDID A CHECKPOINTED CHANGE");
+		}
+		log.append(filename, pid[1], offset, "kept", 4);
+		torn = log.append(filename, pid[1], offset, "torn", 4);
+		log.flush(torn);
+	}
+	const std::string segment = logname + "." + std::to_string(torn / WriteAheadLog::MIN_SEGMENT_SIZE);
+	if (truncate(segment.c_str(), torn % WriteAheadLog::MIN_SEGMENT_SIZE + 40) != 0)
+	{
+		PRINT_ERROR("ERROR :: COULD NOT TEAR THE LOG");
+	}
+	{
+		WriteAheadLog log(logname);
+		if (log.endLsn() != torn)
+		{
+			PRINT_ERROR("ERROR :: LOG KEPT A TORN RECORD");
+		}
+		if (log.recover(files) != 1)
+		{
+			PRINT_ERROR("ERROR :: RECOVERY DID NOT STOP AT THE TORN RECORD");
+		}
+	}
+	Page onDisk = file21.readPage(pid[1]);
+	if (memcmp(reinterpret_cast<const char*>(&onDisk) + offset, "kept", 4) != 0)
+	{
+		PRINT_ERROR("ERROR :: RECOVERY LOST THE RECORD BEFORE THE TORN ONE");
+	}
+
+	file21.close();
+	File::remove(filename);
+	std::remove((logname + ".master").c_str());
+	for (int s = 1; s < 16; s++)
+		std::remove((logname + "." + std::to_string(s)).c_str());
+
+	std::cout << "Test 24 passed" << "\n";
+}
+
+void test25()
+{
+	// records are read in place, and inserted from bytes that are no string
+	Page scratch;
+	const char bytes[] = {'a', '\0', 'b', 'c'};
+	const RecordId binary = scratch.insertRecord(RecordView(bytes, sizeof(bytes)));
+	const RecordId text = scratch.insertRecord("hello!");
+	const RecordView view = scratch.getRecordView(binary);
+	if (view.size() != sizeof(bytes) || memcmp(view.data(), bytes, sizeof(bytes)) != 0 ||
+		scratch.getRecord(binary) != std::string(bytes, sizeof(bytes)))
+	{
+		PRINT_ERROR("ERROR :: RECORD VIEW DID NOT MATCH THE RECORD");
+	}
+	const char* start = reinterpret_cast<const char*>(&scratch);
+	if (view.data() < start || view.data() + view.size() > start + Page::SIZE)
+	{
+		PRINT_ERROR("ERROR :: RECORD VIEW IS NOT IN PLACE ON THE PAGE");
+	}
+
+	PageIterator record = scratch.begin();
+	if (*record != view || (*++record).data() != scratch.getRecordView(text).data() ||
+		*record != "hello!" || record.getCurrentRecord() != text || ++record != scratch.end())
+	{
+		PRINT_ERROR("ERROR :: PAGE ITERATOR DID NOT VIEW THE RECORDS IN PLACE");
+	}
+
+	// the new bytes may be a view of the page being updated
+	scratch.updateRecord(binary, scratch.getRecordView(text));
+	if (scratch.getRecord(binary) != "hello!" || scratch.getRecord(text) != "hello!")
+	{
+		PRINT_ERROR("ERROR :: UPDATE FROM A VIEW OF THE SAME PAGE DID NOT MATCH");
+	}
+
+	std::cout << "Test 25 passed" << "\n";
+}
+
+void test26()
+{
+	// random inserts, updates and deletes of small records reuse slots and
+	// compact the page only when an insert needs the space
+	Page scratch;
+	std::map<SlotId, std::string> expected;
+	unsigned seed = 26;
+	for (int op = 0; op < 20000; op++)
+	{
+		const unsigned choice = rand_r(&seed) % 4;
+		const std::string bytes(1 + rand_r(&seed) % 24, (char)('a' + op % 26));
+		if (choice < 2 || expected.empty())
+		{
+			if (scratch.hasSpaceForRecord(bytes))
+			{
+				const RecordId rid = scratch.insertRecord(bytes);
+				if (expected.count(rid.slot_number) != 0)
+				{
+					PRINT_ERROR("ERROR :: INSERT REUSED A SLOT IN USE");
+				}
+				expected[rid.slot_number] = bytes;
+			}
+			continue;
+		}
+		std::map<SlotId, std::string>::iterator victim = expected.begin();
+		std::advance(victim, rand_r(&seed) % expected.size());
+		const RecordId rid = {scratch.page_number(), victim->first};
+		if (choice == 2)
+		{
+			scratch.deleteRecord(rid);
+			expected.erase(victim);
+		}
+		else if (bytes.size() <= scratch.getFreeSpace() + victim->second.size())
+		{
+			scratch.updateRecord(rid, bytes);
+			victim->second = bytes;
+		}
+	}
+
+	std::size_t used = 0;
+	std::map<SlotId, std::string>::const_iterator model = expected.begin();
+	for (PageIterator record = scratch.begin(); record != scratch.end(); ++record, ++model)
+	{
+		if (model == expected.end() || record.getCurrentRecord().slot_number != model->first ||
+			*record != model->second)
+		{
+			PRINT_ERROR("ERROR :: PAGE RECORDS DID NOT MATCH AFTER DELETES");
+		}
+		used += model->second.size();
+	}
+	if (model != expected.end() || expected.size() < 100)
+	{
+		PRINT_ERROR("ERROR :: PAGE LOST RECORDS");
+	}
+
+	// every hole left by a delete is found again by one large insert
+	const std::size_t free = scratch.getFreeSpace();
+	if (free + used > Page::DATA_SIZE)
+	{
+		PRINT_ERROR("ERROR :: PAGE COUNTED MORE FREE SPACE THAN IT HAS");
+	}
+	const std::string large(free - sizeof(PageSlot), 'z');
+	if (!scratch.hasSpaceForRecord(large))
+	{
+		PRINT_ERROR("ERROR :: PAGE DID NOT COUNT THE SPACE OF DELETED RECORDS");
+	}
+	const RecordId rid = scratch.insertRecord(large);
+	if (scratch.getRecord(rid) != large)
+	{
+		PRINT_ERROR("ERROR :: RECORD INSERTED AFTER COMPACTION DID NOT MATCH");
+	}
+	for (const std::pair<const SlotId, std::string> &entry : expected)
+	{
+		const RecordId kept = {scratch.page_number(), entry.first};
+		if (scratch.getRecord(kept) != entry.second)
+		{
+			PRINT_ERROR("ERROR :: COMPACTION MOVED A RECORD WRONG");
+		}
+	}
+
+	std::cout << "Test 26 passed" << "\n";
+}
+
+void test27()
+{
+	// the free space map finds the page with room in one lookup, follows
+	// pages changed through the pool and deleted, and outlives the file object
+	const std::string& filename = "test.22";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	const std::string record(100, 'r');
+	const PageId pages = 8;
+	{
+		File file22 = File::create(filename);
+		for (i = 0; i < pages; i++)
+		{
+			Page page = file22.allocatePage();
+			pid[i] = page.page_number();
+			// leave room for a record of 1000 bytes on the sixth page only
+			while (page.getFreeSpace() > (i == 5 ? 1200 : 200))
+				rid[i] = page.insertRecord(record);
+			file22.writePage(page);
+		}
+		if (file22.findPageWithSpace(600) != pid[5] || file22.findPageWithSpace(1200) != Page::INVALID_NUMBER ||
+			file22.findPageWithSpace(Page::SIZE) != Page::INVALID_NUMBER)
+		{
+			PRINT_ERROR("ERROR :: FREE SPACE MAP DID NOT FIND THE PAGE WITH ROOM");
+		}
+
+		// a page emptied in the pool is found before it is written back
+		BufMgr mapMgr(pages);
+		mapMgr.readPage(&file22, pid[2], page);
+		while (page->getFreeSpace() < 3000)
+		{
+			RecordId doomed = {pid[2], page->begin().getCurrentRecord().slot_number};
+			page->deleteRecord(doomed);
+		}
+		mapMgr.unPinPage(&file22, pid[2], true);
+		if (file22.findPageWithSpace(2000) != pid[2] || file22.findPageWithSpace(600) != pid[2])
+		{
+			PRINT_ERROR("ERROR :: FREE SPACE MAP MISSED A PAGE CHANGED IN THE POOL");
+		}
+		mapMgr.flushFile(&file22);
+		file22.deletePage(pid[2]);
+		if (file22.findPageWithSpace(600) != pid[5])
+		{
+			PRINT_ERROR("ERROR :: FREE SPACE MAP OFFERED A DELETED PAGE");
+		}
+		pid[pages] = file22.allocatePage().page_number();
+		if (pid[pages] != pid[2] || file22.findPageWithSpace(2000) != pid[2])
+		{
+			PRINT_ERROR("ERROR :: FREE SPACE MAP MISSED A REUSED PAGE");
+		}
+	}
+
+	{
+		File file22 = File::open(filename);
+		if (!File::exists(filename + ".fsm") || file22.findPageWithSpace(2000) != pid[2] ||
+			file22.findPageWithSpace(600) != pid[2])
+		{
+			PRINT_ERROR("ERROR :: FREE SPACE MAP WAS NOT STORED");
+		}
+		// a caller that finds the page fuller reports it and looks again
+		Page reused = file22.readPage(pid[2]);
+		while (reused.hasSpaceForRecord(record))
+			reused.insertRecord(record);
+		file22.recordFreeSpace(pid[2], 0);
+		if (file22.findPageWithSpace(600) != pid[5])
+		{
+			PRINT_ERROR("ERROR :: FREE SPACE MAP KEPT A STALE ENTRY");
+		}
+		file22.writePage(reused);
+		if (file22.findPageWithSpace(600) != pid[5])
+		{
+			PRINT_ERROR("ERROR :: FREE SPACE MAP MISSED A PAGE WRITTEN");
+		}
+	}
+	File::remove(filename);
+	if (File::exists(filename + ".fsm"))
+	{
+		PRINT_ERROR("ERROR :: FREE SPACE MAP OUTLIVED ITS FILE");
+	}
+
+	std::cout << "Test 27 passed" << "\n";
+}
+
+void test28()
+{
+	// records appended in bulk are packed into new pages linked at the end
+	// of the file, in order, past a free page that stays free
+	const std::string& filename = "test.23";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file23 = File::create(filename);
+	for (i = 0; i < 3; i++)
+	{
+		Page existing = file23.allocatePage();
+		pid[i] = existing.page_number();
+		existing.insertRecord("existing");
+		file23.writePage(existing);
+	}
+	file23.deletePage(pid[1]);
+	const PageId limit = file23.pageLimit();
+
+	std::vector<std::string> tuples;
+	unsigned seed = 28;
+	for (i = 0; i < 20000; i++)
+		tuples.push_back(std::string(10 + rand_r(&seed) % 50, (char)('a' + i % 26)) + std::to_string(i));
+	const std::vector<RecordView> views(tuples.begin(), tuples.end());
+	const std::vector<RecordId> rids = file23.appendRecords(views.data(), views.size());
+	if (rids.size() != tuples.size() || rids.front().page_number != limit ||
+		file23.pageLimit() != rids.back().page_number + 1 || file23.pageLimit() - limit <= 64)
+	{
+		PRINT_ERROR("ERROR :: APPENDED RECORDS WERE NOT PACKED INTO NEW PAGES");
+	}
+
+	std::size_t next = 0;
+	std::size_t existing = 0;
+	for (FileIterator iter = file23.begin(); iter != file23.end(); ++iter)
+	{
+		Page scanned = *iter;
+		for (PageIterator record = scanned.begin(); record != scanned.end(); ++record)
+		{
+			if (scanned.page_number() < limit)
+			{
+				existing += *record == "existing";
+				continue;
+			}
+			if (next >= rids.size() || record.getCurrentRecord() != rids[next] || *record != tuples[next])
+			{
+				PRINT_ERROR("ERROR :: APPENDED RECORDS DID NOT MATCH IN ORDER");
+			}
+			next++;
+		}
+	}
+	if (next != rids.size() || existing != 2)
+	{
+		PRINT_ERROR("ERROR :: FILE SCAN DID NOT FIND EVERY RECORD AFTER APPEND");
+	}
+	if (file23.allocatePage().page_number() != pid[1])
+	{
+		PRINT_ERROR("ERROR :: APPEND CHANGED THE FREE LIST");
+	}
+
+	// a record too large for any page appends nothing
+	const std::string large(Page::DATA_SIZE, 'l');
+	const RecordView both[] = {RecordView("fits"), RecordView(large)};
+	try
+	{
+		file23.appendRecords(both, 2);
+		PRINT_ERROR("ERROR :: APPEND OF A RECORD LARGER THAN A PAGE SUCCEEDED");
+	}
+	catch(InsufficientSpaceException &)
+	{
+	}
+	if (file23.pageLimit() != rids.back().page_number + 1)
+	{
+		PRINT_ERROR("ERROR :: FAILED APPEND CHANGED THE FILE");
+	}
+	file23.close();
+	File::remove(filename);
+
+	std::cout << "Test 28 passed" << "\n";
+}
+
+void test29()
+{
+	// records sorted in a budget of a few frames spill into runs merged in
+	// several passes, and come out in order with every duplicate
+	const std::string& filename = "test.24";
+	std::vector<std::string> tuples;
+	unsigned seed = 29;
+	for (i = 0; i < 30000; i++)
+		tuples.push_back(std::to_string(rand_r(&seed) % 20000) + std::string(rand_r(&seed) % 12, 'x'));
+	std::vector<std::string> expected(tuples);
+	std::sort(expected.begin(), expected.end());
+	{
+		ExternalSort sort(*bufMgr, 4, filename);
+		for (const std::string& tuple : tuples)
+			sort.add(tuple);
+		RecordView record;
+		std::size_t next = 0;
+		while (sort.next(record))
+		{
+			if (next >= expected.size() || record != expected[next])
+			{
+				PRINT_ERROR("ERROR :: EXTERNAL SORT RETURNED A RECORD OUT OF ORDER");
+			}
+			next++;
+		}
+		if (next != expected.size() || sort.size() != expected.size() || sort.runsWritten() <= 3)
+		{
+			PRINT_ERROR("ERROR :: EXTERNAL SORT DID NOT MERGE EVERY RUN");
+		}
+		try
+		{
+			sort.add("late");
+			PRINT_ERROR("ERROR :: RECORD ADDED TO A SORT BEING READ");
+		}
+		catch(BadgerDbException &)
+		{
+		}
+	}
+	if (File::exists(filename + ".run1") || File::exists(filename + ".run4"))
+	{
+		PRINT_ERROR("ERROR :: EXTERNAL SORT LEFT ITS RUNS BEHIND");
+	}
+
+	// an ordering of its own, and records that fit in memory are not written
+	{
+		ExternalSort sort(*bufMgr, 16, filename,
+			[](const RecordView& a, const RecordView& b) { return a.size() > b.size(); });
+		for (i = 0; i < 100; i++)
+			sort.add(std::string(i % 10 + 1, 'r'));
+		RecordView record;
+		std::size_t previous = Page::SIZE;
+		std::size_t count = 0;
+		while (sort.next(record))
+		{
+			if (record.size() > previous)
+			{
+				PRINT_ERROR("ERROR :: EXTERNAL SORT IGNORED ITS ORDERING");
+			}
+			previous = record.size();
+			count++;
+		}
+		if (count != 100 || sort.runsWritten() != 0)
+		{
+			PRINT_ERROR("ERROR :: SORT IN MEMORY WROTE RUNS");
+		}
+	}
+
+	// a record too large for any page is refused
+	ExternalSort sort(*bufMgr, 4, filename);
+	try
+	{
+		sort.add(std::string(Page::DATA_SIZE, 'l'));
+		PRINT_ERROR("ERROR :: SORT OF A RECORD LARGER THAN A PAGE SUCCEEDED");
+	}
+	catch(InsufficientSpaceException &)
+	{
+	}
+
+	std::cout << "Test 29 passed" << "\n";
+}
+
+void test30()
+{
+	// the pool grows into frames reserved for it and shrinks back while
+	// other threads read and dirty its pages
+	const std::string& filename = "test.25";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file25 = File::create(filename);
+	const int pages = 200;
+	std::vector<PageId> pageNos(pages);
+	std::vector<RecordId> rids(pages);
+	for (i = 0; i < pages; i++)
+	{
+		Page newPage = file25.allocatePage();
+		pageNos[i] = newPage.page_number();
+		sprintf((char*)tmpbuf, "test.25 Page %d %7.1f", pageNos[i], (float)pageNos[i]);
+		rids[i] = newPage.insertRecord(tmpbuf);
+		file25.writePage(newPage);
+	}
+
+	BufMgr resizeMgr(16, TWO_Q, WRITE_BUFFERED, 1, 2, PLACE_NODE_LOCAL, POOL_HUGE_TRANSPARENT, NULL, 128);
+	if (resizeMgr.poolSize() != 16 || resizeMgr.poolCapacity() != 128)
+	{
+		PRINT_ERROR("ERROR :: WRONG POOL SIZE");
+	}
+	for (i = 0; i < 16; i++)
+		resizeMgr.readPage(&file25, pageNos[i], page);
+	try
+	{
+		resizeMgr.readPage(&file25, pageNos[16], page);
+		PRINT_ERROR("ERROR :: BufferExceededException should have been thrown before reaches this point.");
+	}
+	catch(BufferExceededException &)
+	{
+	}
+	// frames added are free at once, next to pinned pages
+	resizeMgr.resize(64);
+	for (i = 16; i < 64; i++)
+		resizeMgr.readPage(&file25, pageNos[i], page);
+	try
+	{
+		resizeMgr.readPage(&file25, pageNos[64], page);
+		PRINT_ERROR("ERROR :: BufferExceededException should have been thrown before reaches this point.");
+	}
+	catch(BufferExceededException &)
+	{
+	}
+	std::uint32_t total = 0;
+	for (const PartitionBufStats& partition : resizeMgr.getBufStats().partitions)
+		total += partition.frames;
+	if (resizeMgr.poolSize() != 64 || total != 64)
+	{
+		PRINT_ERROR("ERROR :: WRONG POOL SIZE");
+	}
+	for (i = 0; i < 64; i++)
+		resizeMgr.unPinPage(&file25, pageNos[i], true);
+
+	// shrinking evicts pages readers have pinned once they let go of them
+	std::atomic<bool> stop(false);
+	std::atomic<int> mismatches(0);
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 2; t++)
+	{
+		readers.push_back(std::thread([&, t]() {
+			unsigned seed = 30 + t;
+			char expected[100];
+			while (!stop)
+			{
+				const int p = rand_r(&seed) % pages;
+				Page* read;
+				resizeMgr.readPage(&file25, pageNos[p], read);
+				sprintf(expected, "test.25 Page %d %7.1f", pageNos[p], (float)pageNos[p]);
+				if (strncmp(read->getRecord(rids[p]).c_str(), expected, strlen(expected)) != 0)
+					mismatches++;
+				resizeMgr.unPinPage(&file25, pageNos[p], p % 3 == 0);
+			}
+		}));
+	}
+	const std::uint32_t sizes[] = {8, 96, 12, 128, 8, 40};
+	for (const std::uint32_t size : sizes)
+	{
+		resizeMgr.resize(size);
+		if (resizeMgr.poolSize() != size)
+		{
+			PRINT_ERROR("ERROR :: WRONG POOL SIZE");
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	stop = true;
+	for (std::thread &reader : readers)
+		reader.join();
+	if (mismatches != 0)
+	{
+		PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH WHILE RESIZING");
+	}
+
+	// no more frames than the pool was shrunk to
+	resizeMgr.resize(4);
+	for (i = 0; i < 4; i++)
+		resizeMgr.readPage(&file25, pageNos[i], page);
+	try
+	{
+		resizeMgr.readPage(&file25, pageNos[4], page);
+		PRINT_ERROR("ERROR :: BufferExceededException should have been thrown before reaches this point.");
+	}
+	catch(BufferExceededException &)
+	{
+	}
+	for (i = 0; i < 4; i++)
+		resizeMgr.unPinPage(&file25, pageNos[i], false);
+	for (const std::uint32_t size : {0u, 129u})
+	{
+		try
+		{
+			resizeMgr.resize(size);
+			PRINT_ERROR("ERROR :: POOL RESIZED BEYOND ITS FRAMES");
+		}
+		catch(BadgerDbException &)
+		{
+		}
+	}
+
+	// pages written back by the shrinks are intact on disk
+	resizeMgr.flushFile(&file25);
+	for (i = 0; i < pages; i++)
+	{
+		Page stored = file25.readPage(pageNos[i]);
+		sprintf((char*)tmpbuf, "test.25 Page %d %7.1f", pageNos[i], (float)pageNos[i]);
+		if(strncmp(stored.getRecord(rids[i]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH AFTER RESIZING");
+		}
+	}
+	file25.close();
+	File::remove(filename);
+
+	std::cout << "Test 30 passed" << "\n";
+}
+
+/**
+ * Lines of a perf export holding text
+ */
+int tracedLines(const std::string& path, const char* text)
+{
+	FILE* in = fopen(path.c_str(), "r");
+	if (in == NULL)
+		return -1;
+	int lines = 0;
+	char line[512];
+	while (fgets(line, sizeof(line), in) != NULL)
+		if (strstr(line, text) != NULL)
+			lines++;
+	fclose(in);
+	return lines;
+}
+
+void test31()
+{
+	// page-level events of the pool and the file are traced if the build
+	// traces, and the rings export whether or not it does
+	const std::string& filename = "test.26";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	File file26 = File::create(filename);
+	Trace::clear();
+	{
+		BufMgr traceMgr(4);
+		std::vector<PageId> pageNos(8);
+		for (i = 0; i < 8; i++)
+		{
+			traceMgr.allocPage(&file26, pageNos[i], page);
+			page->insertRecord("test.26");
+			traceMgr.unPinPage(&file26, pageNos[i], true);
+		}
+		for (i = 0; i < 2; i++)
+		{
+			traceMgr.readPage(&file26, pageNos[0], page);
+			traceMgr.unPinPage(&file26, pageNos[0], false);
+		}
+		traceMgr.flushFile(&file26);
+	}
+	if (!Trace::exportPerf("test.26.perf") || !Trace::exportChrome("test.26.json"))
+	{
+		PRINT_ERROR("ERROR :: TRACE NOT EXPORTED");
+	}
+#ifdef BADGERDB_TRACING
+	if (tracedLines("test.26.perf", "badgerdb:buffer_miss:") < 1
+		|| tracedLines("test.26.perf", "badgerdb:buffer_hit:") < 1
+		|| tracedLines("test.26.perf", "badgerdb:buffer_evict:") < 4
+		|| tracedLines("test.26.perf", "badgerdb:buffer_write_back:") < 4
+		|| tracedLines("test.26.perf", "badgerdb:file_write: object=test.26 ") < 8
+		|| tracedLines("test.26.perf", "badgerdb:file_read: object=test.26 ") < 1)
+	{
+		PRINT_ERROR("ERROR :: PAGE EVENTS NOT TRACED");
+	}
+	if (tracedLines("test.26.json", "\"name\":\"write\",\"cat\":\"file\"") < 8)
+	{
+		PRINT_ERROR("ERROR :: PAGE EVENTS NOT IN CHROME TRACE");
+	}
+#else
+	if (tracedLines("test.26.perf", "badgerdb:") != 0 || tracedLines("test.26.json", "\"name\"") != 0)
+	{
+		PRINT_ERROR("ERROR :: EVENTS TRACED BY A BUILD WITHOUT TRACING");
+	}
+#endif
+	if (tracedLines("test.26.json", "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") != 1
+		|| tracedLines("test.26.json", "]}") != 1)
+	{
+		PRINT_ERROR("ERROR :: CHROME TRACE MALFORMED");
+	}
+
+	// a full ring keeps its newest events; those of threads that have exited
+	// stay until cleared
+	Trace::clear();
+	std::thread recorder([]() {
+		for (std::uint32_t n = 0; n < Trace::RING_EVENTS + 100; n++)
+			Trace::record(TRACE_SCAN_PAGE, file1ptr, n, Trace::now(), 0);
+	});
+	recorder.join();
+	Trace::record(TRACE_SCAN_PAGE, file2ptr, 1, Trace::now(), 0);
+	Trace::exportPerf("test.26.perf");
+	if (tracedLines("test.26.perf", "badgerdb:btree_scan_page:") != (int)Trace::RING_EVENTS + 1
+		|| tracedLines("test.26.perf", " page=99 ") != 0
+		|| tracedLines("test.26.perf", " page=100 ") != 1)
+	{
+		PRINT_ERROR("ERROR :: WRONG EVENTS KEPT BY THE RINGS");
+	}
+	Trace::clear();
+	Trace::exportPerf("test.26.perf");
+	if (tracedLines("test.26.perf", "badgerdb:") != 0)
+	{
+		PRINT_ERROR("ERROR :: EVENTS KEPT AFTER CLEAR");
+	}
+
+	remove("test.26.perf");
+	remove("test.26.json");
+	file26.close();
+	File::remove(filename);
+
+	std::cout << "Test 31 passed" << "\n";
+}
+
+/**
+ * Flips a bit of the byte at position of a file on disk, behind the back
+ * of File
+ */
+void damagePage(const std::string& filename, const off_t position)
+{
+	const int fd = open(filename.c_str(), O_RDWR);
+	char byte;
+	if (fd < 0 || pread(fd, &byte, 1, position) != 1)
+	{
+		PRINT_ERROR("ERROR :: PAGE NOT DAMAGED");
+	}
+	byte ^= 0x10;
+	if (pwrite(fd, &byte, 1, position) != 1 || close(fd) != 0)
+	{
+		PRINT_ERROR("ERROR :: PAGE NOT DAMAGED");
+	}
+}
+
+/**
+ * Polls a statistic of bufMgr, which a background thread counts, until it
+ * reaches at least target; false if it does not within ten seconds
+ */
+bool waitForStat(BufMgr& mgr, std::uint64_t BufStats::*stat, const std::uint64_t target)
+{
+	for (int n = 0; n < 1000; n++)
+	{
+		if (mgr.getBufStats().*stat >= target)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+void test32()
+{
+	// pages written carry a CRC-32C that is checked when they are read back,
+	// at once or by the scrubber
+	const std::string& filename = "test.27";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException &)
+	{
+	}
+	// the check value of CRC-32C, and the same checksum whatever the path
+	// and however the bytes are split
+	std::vector<unsigned char> bytes(3 * Page::SIZE + 13);
+	for (std::size_t b = 0; b < bytes.size(); b++)
+		bytes[b] = (unsigned char)(b * 2654435761u >> 13);
+	const std::uint32_t whole = Crc32c::extend(0, bytes.data(), bytes.size());
+	if (Crc32c::extend(0, "123456789", 9) != 0xe3069283
+		|| Crc32c::extendPortable(0, "123456789", 9) != 0xe3069283
+		|| Crc32c::extendPortable(0, bytes.data(), bytes.size()) != whole
+		|| Crc32c::extend(Crc32c::extend(0, bytes.data(), 1001), bytes.data() + 1001, bytes.size() - 1001) != whole)
+	{
+		PRINT_ERROR("ERROR :: WRONG CRC-32C");
+	}
+
+	File file27 = File::create(filename);
+	if (!file27.hasChecksums())
+	{
+		PRINT_ERROR("ERROR :: NEW FILE WITHOUT CHECKSUMS");
+	}
+	const int pages = 8;
+	std::vector<PageId> pageNos(pages);
+	{
+		BufMgr writeMgr(4);
+		for (i = 0; i < pages; i++)
+		{
+			writeMgr.allocPage(&file27, pageNos[i], page);
+			sprintf((char*)tmpbuf, "test.27 Page %d %7.1f", pageNos[i], (float)pageNos[i]);
+			page->insertRecord(tmpbuf);
+			writeMgr.unPinPage(&file27, pageNos[i], true);
+		}
+		writeMgr.flushFile(&file27);
+	}
+	const PageId damaged = pageNos[3];
+	// pages lie at their page number times the page size
+	damagePage(filename, (off_t)damaged * Page::SIZE + Page::SIZE / 2);
+
+	{
+		BufMgr checkMgr(4);
+		try
+		{
+			checkMgr.readPage(&file27, damaged, page);
+			PRINT_ERROR("ERROR :: CorruptPageException should have been thrown before reaches this point.");
+		}
+		catch(CorruptPageException &e)
+		{
+			if (e.page_number() != damaged || e.filename() != filename)
+			{
+				PRINT_ERROR("ERROR :: WRONG CORRUPT PAGE");
+			}
+		}
+		for (i = 0; i < pages; i++)
+		{
+			if (pageNos[i] == damaged)
+				continue;
+			checkMgr.readPage(&file27, pageNos[i], page);
+			checkMgr.unPinPage(&file27, pageNos[i], false);
+		}
+		BufStats stats = checkMgr.getBufStats();
+		if (stats.checksumFailures != 1 || stats.verified != pages - 1)
+		{
+			PRINT_ERROR("ERROR :: WRONG CHECKSUM STATS");
+		}
+		// a batch with the page leaves nothing pinned, and so does its prefetch
+		PageId batch[2] = {pageNos[0], damaged};
+		Page* batchPages[2];
+		try
+		{
+			checkMgr.readPages(&file27, batch, 2, batchPages);
+			PRINT_ERROR("ERROR :: CorruptPageException should have been thrown before reaches this point.");
+		}
+		catch(CorruptPageException &)
+		{
+		}
+		checkMgr.prefetch(&file27, damaged, 1);
+		try
+		{
+			checkMgr.readPage(&file27, damaged, page);
+			PRINT_ERROR("ERROR :: CorruptPageException should have been thrown before reaches this point.");
+		}
+		catch(CorruptPageException &)
+		{
+		}
+		if (checkMgr.getBufStats().checksumFailures != 3)
+		{
+			PRINT_ERROR("ERROR :: WRONG CHECKSUM STATS");
+		}
+		// unchecked, the page is handed out as read
+		checkMgr.verifyChecksums(CHECKSUM_OFF);
+		checkMgr.readPage(&file27, damaged, page);
+		checkMgr.unPinPage(&file27, damaged, false);
+		checkMgr.flushFile(&file27);
+	}
+
+	{
+		// the scrubber drops the page once it is unpinned, and it throws at
+		// its next read; the others pass
+		BufMgr scrubMgr(4);
+		scrubMgr.verifyChecksums(CHECKSUM_SCRUB);
+		scrubMgr.readPage(&file27, damaged, page);
+		scrubMgr.unPinPage(&file27, damaged, false);
+		scrubMgr.readPage(&file27, pageNos[4], page);
+		scrubMgr.unPinPage(&file27, pageNos[4], false);
+		if (!waitForStat(scrubMgr, &BufStats::checksumFailures, 1) || !waitForStat(scrubMgr, &BufStats::verified, 1))
+		{
+			PRINT_ERROR("ERROR :: PAGES NOT SCRUBBED");
+		}
+		try
+		{
+			scrubMgr.readPage(&file27, damaged, page);
+			PRINT_ERROR("ERROR :: CorruptPageException should have been thrown before reaches this point.");
+		}
+		catch(CorruptPageException &)
+		{
+		}
+		// a page written again since is not damaged any more
+		Page rewritten = file27.readPage(damaged);
+		file27.writePage(rewritten);
+		scrubMgr.readPage(&file27, damaged, page);
+		scrubMgr.unPinPage(&file27, damaged, false);
+		scrubMgr.flushFile(&file27);
+		if (scrubMgr.getBufStats().checksumFailures != 2)
+		{
+			PRINT_ERROR("ERROR :: WRONG CHECKSUM STATS");
+		}
+	}
+	file27.close();
+	File::remove(filename);
+
+	// compressed pages are checked as they were before compression
+	File compressed = File::create(filename, false, true);
+	{
+		BufMgr writeMgr(4);
+		for (i = 0; i < pages; i++)
+		{
+			writeMgr.allocPage(&compressed, pageNos[i], page);
+			page->insertRecord("test.27 compressed");
+			writeMgr.unPinPage(&compressed, pageNos[i], true);
+		}
+		writeMgr.flushFile(&compressed);
+		for (i = 0; i < pages; i++)
+		{
+			writeMgr.readPage(&compressed, pageNos[i], page);
+			writeMgr.unPinPage(&compressed, pageNos[i], false);
+		}
+		if (writeMgr.getBufStats().verified != pages || writeMgr.getBufStats().checksumFailures != 0)
+		{
+			PRINT_ERROR("ERROR :: COMPRESSED PAGES NOT CHECKED");
+		}
+	}
+	compressed.close();
+	File::remove(filename);
+
+	std::cout << "Test 32 passed" << "\n";
+}
+
+void test33()
+{
+	// a table striped over three files, scanned by workers that steal
+	// chunks of pages from each other
+	const std::vector<std::string> names = {"test.28.0", "test.28.1", "test.28.2"};
+	for (const std::string& name : names)
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch(FileNotFoundException &)
+		{
+		}
+	}
+	// eight records a page, so that every segment has several chunks
+	const int records = 3000;
+	std::vector<char> record(1000, 'x');
+	std::vector<ShardRecordId> ids(records + 1);
+	const auto recordOf = [&](int n) {
+		sprintf(record.data(), "test.28 record %06d", n);
+		return RecordView(record.data(), record.size());
+	};
+	const auto numberOf = [](const std::string& found) {
+		int n = -1;
+		sscanf(found.c_str(), "test.28 record %d", &n);
+		return n;
+	};
+	std::vector<std::atomic<int> > seen(records + 1);
+	const auto countRecords = [&](const unsigned, const std::uint32_t, Page& scanned) {
+		for (PageIterator it = scanned.begin(); it != scanned.end(); ++it)
+		{
+			const int n = numberOf(*it);
+			if (n >= 0 && n <= records)
+				seen[n]++;
+		}
+	};
+
+	BufMgr tableMgr(100);
+	{
+		ShardedTable table = ShardedTable::create(tableMgr, names);
+		if (table.segmentCount() != 3)
+		{
+			PRINT_ERROR("ERROR :: WRONG SEGMENT COUNT");
+		}
+		for (int n = 0; n < records; n++)
+			ids[n] = table.insertRecord(recordOf(n));
+		// pages are dealt out to the segments in turn
+		PageId fewest = table.segment(0).pageLimit(), most = fewest, used = 0;
+		for (std::uint32_t s = 0; s < 3; s++)
+		{
+			fewest = std::min(fewest, table.segment(s).pageLimit());
+			most = std::max(most, table.segment(s).pageLimit());
+			used += table.segment(s).pageLimit() - 1;
+		}
+		if (most - fewest > 1 || fewest < 1 + 2 * ShardedTable::CHUNK_PAGES)
+		{
+			PRINT_ERROR("ERROR :: PAGES NOT STRIPED");
+		}
+		for (int n = 0; n < records; n += 211)
+		{
+			if (numberOf(table.getRecord(ids[n])) != n)
+			{
+				PRINT_ERROR("ERROR :: WRONG RECORD");
+			}
+		}
+
+		// a slow worker has its chunks taken by the others, and every record
+		// is seen once
+		const ShardScanStats stats = table.scan(4, [&](const unsigned worker, const std::uint32_t segment, Page& scanned) {
+			if (worker == 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+			countRecords(worker, segment, scanned);
+		});
+		if (stats.pages != used || stats.steals == 0 || stats.chunks < 9)
+		{
+			PRINT_ERROR("ERROR :: WRONG SCAN STATS");
+		}
+		for (int n = 0; n < records; n++)
+		{
+			if (seen[n] != 1)
+			{
+				PRINT_ERROR("ERROR :: RECORD NOT SCANNED ONCE");
+			}
+		}
+
+		// the first exception stops the scan and leaves nothing pinned
+		try
+		{
+			table.scan(3, [](const unsigned, const std::uint32_t segment, Page&) {
+				if (segment == 1)
+					throw InsufficientSpaceException(0, 0, 0);
+			});
+			PRINT_ERROR("ERROR :: InsufficientSpaceException should have been thrown before reaches this point.");
+		}
+		catch(InsufficientSpaceException &)
+		{
+		}
+		table.flush();
+	}
+
+	{
+		// reopened, the table carries on striping
+		ShardedTable table = ShardedTable::open(tableMgr, names);
+		for (int n = records - 1; n <= records; n++)
+			ids[n] = table.insertRecord(recordOf(n));
+		if (numberOf(table.getRecord(ids[records])) != records
+			|| numberOf(table.getRecord(ids[0])) != 0)
+		{
+			PRINT_ERROR("ERROR :: WRONG RECORD");
+		}
+		for (std::atomic<int>& count : seen)
+			count = 0;
+		const ShardScanStats stats = table.scan(0, countRecords);
+		if (stats.pages == 0 || seen[records] != 1 || seen[records - 1] != 2 || seen[0] != 1)
+		{
+			PRINT_ERROR("ERROR :: WRONG SCAN AFTER REOPEN");
+		}
+	}
+	ShardedTable::remove(names);
+	if (File::exists(names[0]) || File::exists(names[2]))
+	{
+		PRINT_ERROR("ERROR :: SEGMENT NOT REMOVED");
+	}
+
+	std::cout << "Test 33 passed" << "\n";
+}
+
+void test34()
+{
+	// scans of a file share their reads, and read it through a ring of
+	// frames that leaves the rest of the pool alone
+	const std::string& filename = "test.29";
+	const std::string& hotname = "test.29.hot";
+	for (const std::string& name : {filename, hotname})
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch(FileNotFoundException &)
+		{
+		}
+	}
+	const int pages = 200;
+	const int hotPages = 24;
+	File file29 = File::create(filename);
+	File hot = File::create(hotname);
+	std::vector<PageId> pageNos(pages);
+	for (int p = 0; p < pages; p++)
+	{
+		Page fresh = file29.allocatePage();
+		sprintf((char*)tmpbuf, "test.29 page %d", fresh.page_number());
+		fresh.insertRecord(tmpbuf);
+		file29.writePage(fresh);
+		pageNos[p] = fresh.page_number();
+	}
+	// a page not in use is skipped
+	const PageId freed = pageNos[pages / 2];
+	file29.deletePage(freed);
+	const int used = pages - 1;
+	for (int p = 0; p < hotPages; p++)
+	{
+		Page fresh = hot.allocatePage();
+		hot.writePage(fresh);
+	}
+
+	const auto numberOf = [](Page* scanned) {
+		int n = -1;
+		sscanf(scanned->getRecord(scanned->begin().getCurrentRecord()).c_str(), "test.29 page %d", &n);
+		return n;
+	};
+
+	{
+		BufMgr scanMgr(64);
+		for (PageId p = 1; p <= (PageId)hotPages; p++)
+		{
+			scanMgr.readPage(&hot, p, page);
+			scanMgr.unPinPage(&hot, p, false);
+		}
+		scanMgr.clearBufStats();
+
+		// one scan reads every page once in order, reusing the frames of its ring
+		std::map<int, int> seen;
+		{
+			SharedScan scan = scanMgr.openSharedScan(&file29);
+			if (scan.startPage() != 1 || scan.pageNo() != Page::INVALID_NUMBER)
+			{
+				PRINT_ERROR("ERROR :: WRONG SHARED SCAN START");
+			}
+			PageId last = 0;
+			while (scan.next(page))
+			{
+				if (scan.pageNo() <= last || numberOf(page) != (int)scan.pageNo())
+				{
+					PRINT_ERROR("ERROR :: WRONG SHARED SCAN PAGE");
+				}
+				last = scan.pageNo();
+				seen[numberOf(page)]++;
+			}
+			if (scan.pageNo() != Page::INVALID_NUMBER || scan.next(page))
+			{
+				PRINT_ERROR("ERROR :: SHARED SCAN NOT CLOSED");
+			}
+		}
+		BufStats stats = scanMgr.getBufStats();
+		const std::uint64_t ring = std::min<std::uint64_t>(BufMgr::SCAN_RING_FRAMES, 64 / 8);
+		if ((int)seen.size() != used || seen.count(freed) != 0 || stats.misses != (std::uint64_t)used
+			|| stats.ringReuses != used - ring || stats.evictions != stats.ringReuses)
+		{
+			PRINT_ERROR("ERROR :: WRONG SHARED SCAN STATS");
+		}
+		// the pages read before are all still in the pool
+		scanMgr.clearBufStats();
+		for (PageId p = 1; p <= (PageId)hotPages; p++)
+		{
+			scanMgr.readPage(&hot, p, page);
+			scanMgr.unPinPage(&hot, p, false);
+		}
+		if (scanMgr.getBufStats().misses != 0)
+		{
+			PRINT_ERROR("ERROR :: SHARED SCAN EVICTED POOL PAGES");
+		}
+
+		// a second scan joins the first where it is, and wraps around
+		scanMgr.clearBufStats();
+		seen.clear();
+		{
+			SharedScan first = scanMgr.openSharedScan(&file29);
+			for (int p = 0; p < 50; p++)
+			{
+				first.next(page);
+				seen[numberOf(page)]++;
+			}
+			SharedScan second = scanMgr.openSharedScan(&file29);
+			if (second.startPage() != first.pageNo())
+			{
+				PRINT_ERROR("ERROR :: SHARED SCAN DID NOT JOIN");
+			}
+			bool firstMore = true, secondMore = true;
+			PageId previous = 0;
+			bool wrapped = false;
+			while (firstMore || secondMore)
+			{
+				if (firstMore && (firstMore = first.next(page)))
+					seen[numberOf(page)]++;
+				if (secondMore && (secondMore = second.next(page)))
+				{
+					seen[numberOf(page)]++;
+					wrapped = wrapped || second.pageNo() < previous;
+					previous = second.pageNo();
+				}
+			}
+			if (!wrapped)
+			{
+				PRINT_ERROR("ERROR :: SHARED SCAN DID NOT WRAP");
+			}
+		}
+		stats = scanMgr.getBufStats();
+		bool twice = (int)seen.size() == used;
+		for (const auto& count : seen)
+			twice = twice && count.second == 2;
+		// the pages the second scan started after are read again, the others once
+		if (!twice || stats.misses > (std::uint64_t)used + 50 || stats.misses < (std::uint64_t)used)
+		{
+			PRINT_ERROR("ERROR :: SCANS DID NOT SHARE READS");
+		}
+
+		// scans closed early leave nothing pinned, and the next starts afresh
+		{
+			SharedScan early = scanMgr.openSharedScan(&file29);
+			early.next(page);
+			early.next(page);
+			SharedScan moved(std::move(early));
+			moved.next(page);
+		}
+		SharedScan afresh = scanMgr.openSharedScan(&file29);
+		if (afresh.startPage() != 1)
+		{
+			PRINT_ERROR("ERROR :: SHARED SCAN DID NOT START AFRESH");
+		}
+		afresh.close();
+
+		// scans on several threads each see every page once
+		std::vector<std::thread> scanners;
+		std::atomic<int> wrong(0);
+		for (int t = 0; t < 4; t++)
+		{
+			scanners.emplace_back([&]() {
+				std::vector<int> counts(pages + 2, 0);
+				SharedScan scan = scanMgr.openSharedScan(&file29);
+				Page* scanned;
+				while (scan.next(scanned))
+					counts[numberOf(scanned)]++;
+				for (int p = 0; p < pages; p++)
+				{
+					if (counts[pageNos[p]] != (pageNos[p] == freed ? 0 : 1))
+						wrong++;
+				}
+			});
+		}
+		for (std::thread& scanner : scanners)
+			scanner.join();
+		if (wrong != 0)
+		{
+			PRINT_ERROR("ERROR :: CONCURRENT SHARED SCANS MISSED PAGES");
+		}
+		scanMgr.flushFile(&file29);
+		scanMgr.flushFile(&hot);
+	}
+	file29.close();
+	hot.close();
+	File::remove(filename);
+	File::remove(hotname);
+
+	std::cout << "Test 34 passed" << "\n";
+}
+
+void test35()
+{
+	// write-backs of a file closed before it was synced are skipped by
+	// checkpoints and by the destructor, and the file reopened under the same
+	// name is synced again
+	const std::string& filename = "test.35";
+	const std::string& othername = "test.35.other";
+	for (const std::string& name : {filename, othername})
+	{
+		try
+		{
+			File::remove(name);
+		}
+		catch(FileNotFoundException &)
+		{
+		}
+	}
+	BufMgr* syncMgr = new BufMgr(4);
+	File* closed = new File(File::create(filename));
+	File other = File::create(othername);
+	PageId pageno;
+	Page* page;
+	for (int i = 0; i < 8; i++)
+	{
+		syncMgr->allocPage(closed, pageno, page);
+		sprintf((char*)tmpbuf, "test.35 Page %d", pageno);
+		page->insertRecord(tmpbuf);
+		syncMgr->unPinPage(closed, pageno, true);
+	}
+	// the pages of the closed file are all written back by evictions
+	for (int i = 0; i < 8; i++)
+	{
+		syncMgr->allocPage(&other, pageno, page);
+		syncMgr->unPinPage(&other, pageno, true);
+	}
+	delete closed;
+	if (File::isOpen(filename))
+	{
+		PRINT_ERROR("ERROR :: FILE LEFT OPEN");
+	}
+	syncMgr->fuzzyCheckpoint();
+
+	File reopened = File::open(filename);
+	syncMgr->readPage(&reopened, 1, page);
+	sprintf((char*)tmpbuf, "test.35 Page %d", 1);
+	const RecordId first = {1, 1};
+	if (page->getRecord(first) != tmpbuf)
+	{
+		PRINT_ERROR("ERROR :: WRITE-BACK OF CLOSED FILE LOST");
+	}
+	page->insertRecord(tmpbuf);
+	syncMgr->unPinPage(&reopened, 1, true);
+	for (int i = 0; i < 8; i++)
+	{
+		syncMgr->allocPage(&other, pageno, page);
+		syncMgr->unPinPage(&other, pageno, true);
+	}
+	syncMgr->fuzzyCheckpoint();
+	syncMgr->flushFile(&other);
+	syncMgr->flushFile(&reopened);
+	delete syncMgr;
+	reopened.close();
+	other.close();
+	File::remove(filename);
+	File::remove(othername);
+
+	std::cout << "Test 35 passed" << "\n";
+}
+
+void test36()
+{
+	// asynchronous transfers cut short are I/O errors on every backend, not
+	// torn pages taken as whole
+	const std::string& filename = "test.36";
+	std::vector<std::unique_ptr<IoEngine> > engines;
+	if (UringEngine::supported())
+		engines.emplace_back(new UringEngine(4));
+	if (AioEngine::supported())
+		engines.emplace_back(new AioEngine(4));
+	engines.emplace_back(new SyncEngine(4));
+	// writes past the size limit come back short rather than killing us
+	signal(SIGXFSZ, SIG_IGN);
+
+	for (std::unique_ptr<IoEngine> &engine : engines)
+	{
+		try
+		{
+			File::remove(filename);
+		}
+		catch(FileNotFoundException &)
+		{
+		}
+		File file36 = File::create(filename);
+		Page last;
+		for (i = 0; i < 3; i++)
+		{
+			last = file36.allocatePage();
+			sprintf((char*)tmpbuf, "test.36 Page %d", last.page_number());
+			last.insertRecord(tmpbuf);
+			file36.writePage(last);
+		}
+		// tear the last page, which ends the file
+		struct stat info;
+		stat(filename.c_str(), &info);
+		const off_t torn = info.st_size - Page::SIZE / 2;
+		if (truncate(filename.c_str(), torn) != 0)
+		{
+			PRINT_ERROR("ERROR :: COULD NOT TRUNCATE FILE");
+		}
+		int readError = 0;
+		Page copy;
+		file36.readPageAsync(*engine, last.page_number(), copy, [&readError](const int error) {
+			readError = error;
+		});
+		engine->submit();
+		engine->drain();
+
+		struct rlimit limit;
+		getrlimit(RLIMIT_FSIZE, &limit);
+		const struct rlimit saved = limit;
+		limit.rlim_cur = torn;
+		setrlimit(RLIMIT_FSIZE, &limit);
+		int writeError = 0;
+		file36.writePageAsync(*engine, last, [&writeError](const int error) {
+			writeError = error;
+		});
+		engine->submit();
+		engine->drain();
+		setrlimit(RLIMIT_FSIZE, &saved);
+		if (readError != EIO || writeError != EIO)
+		{
+			PRINT_ERROR("ERROR :: SHORT TRANSFER TAKEN AS WHOLE");
+		}
+		file36.close();
+		File::remove(filename);
+	}
+
+	std::cout << "Test 36 passed" << "\n";
+}
+
+void test37()
+{
+	// statistics are kept per opened file rather than per File object, and
+	// the slots of closed files go to new ones, so that far more files than
+	// there are slots open and close one after the other without ending up
+	// in "<other>"
+	const int files = 2 * BufStatsCollector::MAX_FILES;
+	BufMgr statsMgr(8);
+	PageId pageno;
+	Page* page;
+	for (int f = 0; f <= files; f++)
+	{
+		sprintf((char*)tmpbuf, "test.37.%d", f);
+		const std::string filename((char*)tmpbuf);
+		try
+		{
+			File::remove(filename);
+		}
+		catch(FileNotFoundException &)
+		{
+		}
+		File file37 = File::create(filename);
+		// a copy of the File object counts for the same file
+		File copy = file37;
+		statsMgr.allocPage(&file37, pageno, page);
+		statsMgr.unPinPage(&file37, pageno, true);
+		statsMgr.allocPage(&copy, pageno, page);
+		statsMgr.unPinPage(&copy, pageno, true);
+		statsMgr.flushFile(&file37);
+		statsMgr.flushFile(&copy);
+		if (f == files)
+		{
+			BufStats stats = statsMgr.getBufStats();
+			std::uint64_t allocs = 0;
+			bool found = false;
+			for (const FileBufStats &fileStats : stats.files)
+			{
+				allocs += fileStats.counters[STAT_ALLOCS];
+				found = found || (fileStats.filename == filename
+						&& fileStats.counters[STAT_ALLOCS] == 2);
+			}
+			if (!found || allocs != 2 * (std::uint64_t)(files + 1))
+			{
+				PRINT_ERROR("ERROR :: WRONG PER FILE COUNTS");
+			}
+		}
+		copy.close();
+		file37.close();
+		File::remove(filename);
+	}
+
+	std::cout << "Test 37 passed" << "\n";
+}
@@ -5,8 +5,12 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <functional>
 
+#include "crc32c.h"
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
 #include "exceptions/invalid_slot_exception.h"
@@ -25,12 +29,23 @@ void Page::initialize() {
   header_.free_space_upper_bound = DATA_SIZE;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
+  header_.first_free_slot = INVALID_SLOT;
+  header_.fragmented_space = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
-  data_.assign(DATA_SIZE, char());
+  header_.lsn = 0;
+  header_.checksum = 0;
+  std::memset(data_, 0, DATA_SIZE);
 }
 
-RecordId Page::insertRecord(const std::string& record_data) {
+std::uint32_t Page::computeChecksum() const {
+  // Everything before the next page number, then the data area.
+  const std::uint32_t header_crc =
+      Crc32c::extend(0, &header_, offsetof(PageHeader, next_page_number));
+  return Crc32c::extend(header_crc, data_, DATA_SIZE);
+}
+
+RecordId Page::insertRecord(const RecordView& record_data) {
   if (!hasSpaceForRecord(record_data)) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
@@ -41,13 +56,25 @@ RecordId Page::insertRecord(const std::string& record_data) {
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  return getRecordView(record_id).str();
+}
+
+RecordView Page::getRecordView(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-  return data_.substr(slot.item_offset, slot.item_length);
+  return RecordView(data_ + slot.item_offset, slot.item_length);
 }
 
 void Page::updateRecord(const RecordId& record_id,
-                        const std::string& record_data) {
+                        const RecordView& record_data) {
+  // The new bytes may be a view of this page, which the delete below moves.
+  const std::less<const char*> before;
+  if (!before(record_data.data(), data_) &&
+      before(record_data.data(), data_ + DATA_SIZE)) {
+    const std::string copy = record_data.str();
+    updateRecord(record_id, copy);
+    return;
+  }
   validateRecordId(record_id);
   const PageSlot* slot = getSlot(record_id.slot_number);
   const std::size_t free_space_after_delete =
@@ -71,60 +98,37 @@ void Page::deleteRecord(const RecordId& record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
   PageSlot* slot = getSlot(record_id.slot_number);
-  data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
+  std::memset(data_ + slot->item_offset, 0, slot->item_length);
 
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
-    }
-  }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = data_.substr(move_offset, move_bytes);
-    data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
+  // The space is taken back at once only if the record borders the free
+  // space; otherwise it is a hole until the next compaction.
+  if (slot->item_offset == header_.free_space_upper_bound) {
+    header_.free_space_upper_bound += slot->item_length;
+  } else {
+    header_.fragmented_space += slot->item_length;
   }
-  header_.free_space_upper_bound += slot->item_length;
 
   // Mark slot as unused.
   slot->used = false;
-  slot->item_offset = 0;
-  slot->item_length = 0;
+  pushFreeSlot(record_id.slot_number);
   ++header_.num_free_slots;
 
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
-    // Last slot in the list, so we need to free any unused slots that are at
-    // the end of the slot list.
-    int num_slots_to_delete = 1;
-    for (SlotId i = 1; i < header_.num_slots; ++i) {
-      // Traverse list backwards, looking for unused slots.
-      const PageSlot* other_slot = getSlot(header_.num_slots - i);
-      if (!other_slot->used) {
-        ++num_slots_to_delete;
-      } else {
-        // Stop at the first used slot we find, since we can't move used slots
-        // without affecting record IDs.
-        break;
-      }
+    // Last slot in the list, so we free the unused slots that are at the end
+    // of the slot list.  Stop at the first used slot, since we can't move used
+    // slots without affecting record IDs.
+    while (header_.num_slots > 0 && !getSlot(header_.num_slots)->used) {
+      unlinkFreeSlot(header_.num_slots);
+      --header_.num_slots;
+      --header_.num_free_slots;
     }
-    header_.num_slots -= num_slots_to_delete;
-    header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
   }
 }
 
-bool Page::hasSpaceForRecord(const std::string& record_data) const {
+bool Page::hasSpaceForRecord(const RecordView& record_data) const {
   std::size_t record_size = record_data.length();
-  if (header_.num_free_slots == 0) {
+  if (header_.first_free_slot == INVALID_SLOT) {
     record_size += sizeof(PageSlot);
   }
   return record_size <= getFreeSpace();
@@ -141,31 +145,26 @@ const PageSlot& Page::getSlot(const SlotId slot_number) const {
 }
 
 SlotId Page::getAvailableSlot() {
-  SlotId slot_number = INVALID_SLOT;
-  if (header_.num_free_slots > 0) {
-    // Have an allocated but unused slot that we can reuse.
-    for (SlotId i = 1; i <= header_.num_slots; ++i) {
-      const PageSlot* slot = getSlot(i);
-      if (!slot->used) {
-        // We don't decrement the number of free slots until someone actually
-        // puts data in the slot.
-        slot_number = i;
-        break;
-      }
-    }
-  } else {
+  if (header_.first_free_slot == INVALID_SLOT) {
     // Have to allocate a new slot.
-    slot_number = header_.num_slots + 1;
+    if (header_.free_space_upper_bound <
+        header_.free_space_lower_bound + sizeof(PageSlot)) {
+      compact();
+    }
     ++header_.num_slots;
     ++header_.num_free_slots;
     header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    getSlot(header_.num_slots)->used = false;
+    pushFreeSlot(header_.num_slots);
   }
-  assert(slot_number != INVALID_SLOT);
-  return static_cast<SlotId>(slot_number);
+  // We don't take the slot off the list until someone actually puts data in
+  // it.
+  assert(header_.first_free_slot != INVALID_SLOT);
+  return header_.first_free_slot;
 }
 
 void Page::insertRecordInSlot(const SlotId slot_number,
-                              const std::string& record_data) {
+                              const RecordView& record_data) {
   if (slot_number > header_.num_slots ||
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
@@ -175,12 +174,71 @@ void Page::insertRecordInSlot(const SlotId slot_number,
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
+  if (header_.free_space_upper_bound - header_.free_space_lower_bound <
+      record_length) {
+    compact();
+  }
+  unlinkFreeSlot(slot_number);
   slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
-  data_.replace(slot->item_offset, slot->item_length, record_data);
+  std::memcpy(data_ + slot->item_offset, record_data.data(),
+              slot->item_length);
+}
+
+void Page::pushFreeSlot(const SlotId slot_number) {
+  PageSlot* slot = getSlot(slot_number);
+  slot->item_offset = header_.first_free_slot;
+  slot->item_length = INVALID_SLOT;
+  if (header_.first_free_slot != INVALID_SLOT) {
+    getSlot(header_.first_free_slot)->item_length = slot_number;
+  }
+  header_.first_free_slot = slot_number;
+}
+
+void Page::unlinkFreeSlot(const SlotId slot_number) {
+  const PageSlot* slot = getSlot(slot_number);
+  const SlotId next = slot->item_offset;
+  const SlotId previous = slot->item_length;
+  if (previous == INVALID_SLOT) {
+    header_.first_free_slot = next;
+  } else {
+    getSlot(previous)->item_offset = next;
+  }
+  if (next != INVALID_SLOT) {
+    getSlot(next)->item_length = previous;
+  }
+}
+
+void Page::compact() {
+  // Records are moved towards the end in the order they lie, the last one
+  // first, so that none is overwritten before it has been moved.
+  SlotId order[DATA_SIZE / sizeof(PageSlot)];
+  std::size_t count = 0;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    if (getSlot(i)->used) {
+      order[count++] = i;
+    }
+  }
+  std::sort(order, order + count, [this](const SlotId a, const SlotId b) {
+    return getSlot(a)->item_offset > getSlot(b)->item_offset;
+  });
+  std::uint16_t end = DATA_SIZE;
+  for (std::size_t i = 0; i < count; ++i) {
+    PageSlot* slot = getSlot(order[i]);
+    end -= slot->item_length;
+    if (end != slot->item_offset) {
+      std::memmove(data_ + end, data_ + slot->item_offset, slot->item_length);
+      slot->item_offset = end;
+    }
+  }
+  // What lay between the old and the new bounds is free space now.
+  std::memset(data_ + header_.free_space_upper_bound, 0,
+              end - header_.free_space_upper_bound);
+  header_.free_space_upper_bound = end;
+  header_.fragmented_space = 0;
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
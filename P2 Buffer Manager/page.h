@@ -8,9 +8,15 @@
 #pragma once
 
 #include <cstddef>
+#include <cstring>
 #include <stdint.h>
 #include <memory>
+#include <ostream>
 #include <string>
+#include <type_traits>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 #include "types.h"
 
@@ -23,6 +29,12 @@ namespace badgerdb {
  * contains a pointer to the next page in the file.
  */
 struct PageHeader {
+  /**
+   * LSN of the last write-ahead log record applied to the page, 0 if none.
+   * Kept ahead of the fields any write of the page may leave out.
+   */
+  Lsn lsn;
+
   /**
    * Lower bound of the free space.  This is the offset of the first unused byte
    * after the slot array.
@@ -47,6 +59,18 @@ struct PageHeader {
    */
   SlotId num_free_slots;
 
+  /**
+   * First slot of the list of the slots allocated but not in use, or
+   * Page::INVALID_SLOT if there is none.
+   */
+  SlotId first_free_slot;
+
+  /**
+   * Bytes of deleted records between free_space_upper_bound and the end of
+   * the data area, reclaimed when the page is next compacted.
+   */
+  std::uint16_t fragmented_space;
+
   /**
    * Number of the page within the file.
    */
@@ -57,6 +81,13 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * CRC-32C of the page as it was last written, of every byte but this
+   * field and next_page_number, which the file rewrites in place.  Set by
+   * File on every write; only meaningful in files with checksums.
+   */
+  std::uint32_t checksum;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -73,6 +104,9 @@ struct PageHeader {
 
 /**
  * @brief Slot metadata that tracks where a record is in the data space.
+ *
+ * A slot not in use is on the page's list of free slots instead, and its
+ * offset and length fields hold the next and previous slot on that list.
  */
 struct PageSlot {
   /**
@@ -82,16 +116,96 @@ struct PageSlot {
   bool used;
 
   /**
-   * Offset of the data item in the page.
+   * Offset of the data item in the page; for an unused slot, the next free
+   * slot.
    */
   std::uint16_t item_offset;
 
   /**
-   * Length of the data item in this slot.
+   * Length of the data item in this slot; for an unused slot, the previous
+   * free slot.
    */
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Bytes of a record, referred to where they are instead of copied.
+ *
+ * A view of a record on a page is valid until the page is changed, moved or
+ * evicted.  Views are made implicitly from strings and string literals, so
+ * anything taking a view takes those as well, and convert back to copies in
+ * strings.  With C++17 they convert to and from std::string_view.
+ */
+class RecordView {
+ public:
+  /**
+   * Constructs a view of no bytes.
+   */
+  RecordView() : data_(NULL), size_(0) {}
+
+  /**
+   * Constructs a view of size bytes at data.
+   */
+  RecordView(const char* data, const std::size_t size)
+      : data_(data), size_(size) {}
+
+  /**
+   * Constructs a view of the bytes of a string, valid while it is unchanged.
+   */
+  RecordView(const std::string& bytes)
+      : data_(bytes.data()), size_(bytes.size()) {}
+
+  /**
+   * Constructs a view of a null-terminated string, not counting the null.
+   */
+  RecordView(const char* bytes)
+      : data_(bytes), size_(std::strlen(bytes)) {}
+
+#if __cplusplus >= 201703L
+  RecordView(const std::string_view bytes)
+      : data_(bytes.data()), size_(bytes.size()) {}
+
+  operator std::string_view() const { return std::string_view(data_, size_); }
+#endif
+
+  /**
+   * Returns the first byte viewed; the bytes are not null-terminated.
+   */
+  const char* data() const { return data_; }
+
+  /**
+   * Returns the number of bytes viewed.
+   */
+  std::size_t size() const { return size_; }
+  std::size_t length() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  char operator[](const std::size_t i) const { return data_[i]; }
+
+  /**
+   * Returns a copy of the bytes.
+   */
+  std::string str() const { return std::string(data_, size_); }
+  operator std::string() const { return str(); }
+
+  bool operator==(const RecordView& rhs) const {
+    return size_ == rhs.size_ && (size_ == 0 ||
+                                  std::memcmp(data_, rhs.data_, size_) == 0);
+  }
+
+  bool operator!=(const RecordView& rhs) const { return !(*this == rhs); }
+
+ private:
+  const char* data_;
+  std::size_t size_;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const RecordView& record) {
+  return out.write(record.data(), record.size());
+}
+
 class PageIterator;
 
 /**
@@ -102,6 +216,10 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * A Page is exactly SIZE bytes, laid out in memory as it is on disk: the
+ * header followed by the data area.  It holds no pointers, so it can be
+ * copied with memcpy and read from or written to disk in place.
+ *
  * @warning This class is not threadsafe.
  */
 class Page {
@@ -133,23 +251,33 @@ class Page {
   Page();
 
   /**
-   * Inserts a new record into the page.
+   * Inserts a new record into the page, copying its bytes in.
    *
    * @param record_data  Bytes that compose the record.
    * @return  ID of the newly inserted record.
    */
-  RecordId insertRecord(const std::string& record_data);
+  RecordId insertRecord(const RecordView& record_data);
 
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
    * stored on the page; use updateRecord to change it.
    *
    * @see updateRecord
+   * @see getRecordView
    * @param record_id  ID of the record to return.
    * @return  The record.
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID in place on the page, without
+   * copying it.  The view is valid until the page is next changed.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  View of the record.
+   */
+  RecordView getRecordView(const RecordId& record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -158,11 +286,12 @@ class Page {
    * @param record_id   ID of record to update.
    * @param record_data Updated bytes that compose the record.
    */
-  void updateRecord(const RecordId& record_id, const std::string& record_data);
+  void updateRecord(const RecordId& record_id, const RecordView& record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
+   * Deletes the record with the given ID.  Its bytes are not moved over: the
+   * page is compacted only once an insert needs the space, so that deletes
+   * take time in the size of the record alone.  Slot array is compacted if
    * the slot deleted is at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
@@ -175,15 +304,17 @@ class Page {
    * @param record_data Bytes that compose the record.
    * @return  Whether the page can hold the data.
    */
-  bool hasSpaceForRecord(const std::string& record_data) const;
+  bool hasSpaceForRecord(const RecordView& record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, counting that of deleted records
+   * not yet compacted away.
    *
    * @return  Free space in bytes.
    */
   std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+                                              header_.free_space_lower_bound +
+                                              header_.fragmented_space; }
 
   /**
    * Returns this page's number in its file.
@@ -199,6 +330,22 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the LSN of the last write-ahead log record applied to this page.
+   *
+   * @return  LSN, 0 if no record was applied.
+   */
+  Lsn lsn() const { return header_.lsn; }
+
+  /**
+   * Returns the CRC-32C of the page as it is now, of the bytes the checksum
+   * field of the header covers.  It differs from the checksum stored if the
+   * page was damaged on disk, or changed since it was read.
+   *
+   * @return  Checksum.
+   */
+  std::uint32_t computeChecksum() const;
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -239,10 +386,16 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
-   * <allow_slot_compaction> is set.
+   * Sets the LSN of the last write-ahead log record applied to this page.
+   *
+   * @param new_lsn  LSN of the record.
+   */
+  void set_lsn(const Lsn new_lsn) { header_.lsn = new_lsn; }
+
+  /**
+   * Deletes the record with the given ID, leaving its space to the next
+   * compaction.  Slot array is compacted if the slot deleted is at the end of
+   * the slot array and <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
    * @param allow_slot_compaction If true, the slot array will be compacted if
@@ -272,9 +425,10 @@ class Page {
   const PageSlot& getSlot(const SlotId slot_number) const;
 
   /**
-   * Returns the slot number of an available slot.  If no slots are available
-   * to be reused, allocates a new slot.  Updates available slot count in the
-   * header metadata, but does not mark returned slot as used.  If a new slot is
+   * Returns the slot number of an available slot, the first on the list of
+   * free slots.  If no slots are available to be reused, allocates a new slot
+   * and puts it on the list.  Updates available slot count in the header
+   * metadata, but does not mark returned slot as used.  If a new slot is
    * allocated, updates the free space lower bound.
    *
    * Callers are responsible for making sure there is enough space to allocate a
@@ -288,8 +442,10 @@ class Page {
   SlotId getAvailableSlot();
 
   /**
-   * Inserts record data into the given slot.  The slot should not be currently
-   * in use.  <slot_number> must be less than <header_.num_slots>.
+   * Inserts record data into the given slot, taking it off the list of free
+   * slots.  The slot should not be currently in use.  <slot_number> must be
+   * less than <header_.num_slots>.  The page is compacted first if the free
+   * space between the slots and the records is too small.
    *
    * Callers are responsible for making sure there is enough space to hold the
    * record before calling this method.
@@ -301,7 +457,27 @@ class Page {
    * @throws  SlotInUseException  Thrown when given slot is in use.
    */
   void insertRecordInSlot(const SlotId slot_number,
-                          const std::string& record_data);
+                          const RecordView& record_data);
+
+  /**
+   * Puts an unused slot at the front of the list of free slots.
+   *
+   * @param slot_number   Number of the slot.
+   */
+  void pushFreeSlot(const SlotId slot_number);
+
+  /**
+   * Takes an unused slot off the list of free slots, wherever it is on it.
+   *
+   * @param slot_number   Number of the slot.
+   */
+  void unlinkFreeSlot(const SlotId slot_number);
+
+  /**
+   * Moves the records against the end of the data area, in the order they
+   * are there, so that all the free space lies between them and the slots.
+   */
+  void compact();
 
   /**
    * Throws an exception if the given record ID is not valid for this page
@@ -329,11 +505,12 @@ class Page {
    * Data stored on the page.  Includes bookkeeping information about slots as
    * well as actual content.
    */
-
-  std::string data_;
+  char data_[DATA_SIZE];
 
   friend class File;
   friend class PageIterator;
+  friend class BufMgr;
+  friend class WriteAheadLog;
   friend class PageTest;
   friend class BufferTest;
 };
@@ -342,5 +519,15 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(offsetof(PageHeader, checksum) ==
+                  offsetof(PageHeader, next_page_number) + sizeof(PageId) &&
+              offsetof(PageHeader, checksum) + sizeof(std::uint32_t) ==
+                  sizeof(PageHeader),
+              "The checksum must follow the next page number and end the header.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "In-memory page layout must match the on-disk layout.");
+static_assert(std::is_standard_layout<Page>::value &&
+              std::is_trivially_copyable<Page>::value,
+              "Page must be copyable as raw bytes.");
 
 }
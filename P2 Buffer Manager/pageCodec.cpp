@@ -0,0 +1,216 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "pageCodec.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace badgerdb {
+
+namespace {
+
+// Shortest match the format encodes.
+const std::size_t MIN_MATCH = 4;
+
+// The format ends every block with literals: the last match starts at least
+// MATCH_LIMIT bytes and ends at least LAST_LITERALS bytes before the end.
+const std::size_t MATCH_LIMIT = 12;
+const std::size_t LAST_LITERALS = 5;
+
+// Size of the hash table of recent positions, in bits.
+const int HASH_BITS = 12;
+
+std::uint32_t read32(const unsigned char* bytes) {
+  std::uint32_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+std::uint64_t read64(const unsigned char* bytes) {
+  std::uint64_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+std::uint32_t hashOf(const std::uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// Writes the 255-byte extension of a length field, or returns false if it
+// does not fit before end.
+bool putLength(std::size_t length, unsigned char*& out,
+               const unsigned char* end) {
+  while (length >= 255) {
+    if (out == end) {
+      return false;
+    }
+    *out++ = 255;
+    length -= 255;
+  }
+  if (out == end) {
+    return false;
+  }
+  *out++ = static_cast<unsigned char>(length);
+  return true;
+}
+
+// Reads the extension of a length field, or returns false if source ends.
+bool getLength(std::size_t& length, const unsigned char*& in,
+               const unsigned char* end) {
+  unsigned char byte;
+  do {
+    if (in == end) {
+      return false;
+    }
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// Writes one sequence: the literals, then a match unless offset is 0.
+bool putSequence(const unsigned char* literals, const std::size_t literal_length,
+                 const std::size_t offset, const std::size_t match_length,
+                 unsigned char*& out, const unsigned char* end) {
+  if (out == end) {
+    return false;
+  }
+  unsigned char* token = out++;
+  *token = static_cast<unsigned char>((literal_length < 15 ? literal_length : 15) << 4);
+  if (literal_length >= 15 && !putLength(literal_length - 15, out, end)) {
+    return false;
+  }
+  if (static_cast<std::size_t>(end - out) < literal_length) {
+    return false;
+  }
+  std::memcpy(out, literals, literal_length);
+  out += literal_length;
+  if (offset == 0) {
+    return true;
+  }
+  if (end - out < 2) {
+    return false;
+  }
+  *out++ = static_cast<unsigned char>(offset);
+  *out++ = static_cast<unsigned char>(offset >> 8);
+  const std::size_t extra = match_length - MIN_MATCH;
+  *token |= static_cast<unsigned char>(extra < 15 ? extra : 15);
+  return extra < 15 || putLength(extra - 15, out, end);
+}
+
+}
+
+const std::size_t PageCodec::MAX_INPUT;
+
+std::size_t PageCodec::compress(const char* source, const std::size_t length,
+                                char* target, const std::size_t capacity) {
+  if (length > MAX_INPUT) {
+    return 0;
+  }
+  const unsigned char* const input = reinterpret_cast<const unsigned char*>(source);
+  unsigned char* out = reinterpret_cast<unsigned char*>(target);
+  const unsigned char* const end = out + capacity;
+  // Positions plus one, so that zero means none.
+  std::uint16_t recent[1 << HASH_BITS] = {0};
+  std::size_t anchor = 0;
+  if (length > MATCH_LIMIT) {
+    std::size_t position = 0;
+    while (position < length - MATCH_LIMIT) {
+      const std::uint32_t sequence = read32(input + position);
+      std::uint16_t& slot = recent[hashOf(sequence)];
+      const std::size_t candidate = slot;
+      slot = static_cast<std::uint16_t>(position + 1);
+      if (candidate == 0 || read32(input + candidate - 1) != sequence) {
+        ++position;
+        continue;
+      }
+      const std::size_t match = candidate - 1;
+      std::size_t match_length = MIN_MATCH;
+      while (position + match_length + 8 <= length - LAST_LITERALS &&
+             read64(input + match + match_length) ==
+                 read64(input + position + match_length)) {
+        match_length += 8;
+      }
+      while (position + match_length < length - LAST_LITERALS &&
+             input[match + match_length] == input[position + match_length]) {
+        ++match_length;
+      }
+      if (!putSequence(input + anchor, position - anchor, position - match,
+                       match_length, out, end)) {
+        return 0;
+      }
+      position += match_length;
+      anchor = position;
+    }
+  }
+  if (!putSequence(input + anchor, length - anchor, 0, 0, out, end)) {
+    return 0;
+  }
+  return out - reinterpret_cast<unsigned char*>(target);
+}
+
+bool PageCodec::decompress(const char* source, const std::size_t length,
+                           char* target, const std::size_t size) {
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(source);
+  const unsigned char* const in_end = in + length;
+  unsigned char* const output = reinterpret_cast<unsigned char*>(target);
+  std::size_t produced = 0;
+  for (;;) {
+    if (in == in_end) {
+      return false;
+    }
+    const unsigned char token = *in++;
+    std::size_t literal_length = token >> 4;
+    if (literal_length == 15 && !getLength(literal_length, in, in_end)) {
+      return false;
+    }
+    if (literal_length > static_cast<std::size_t>(in_end - in) ||
+        literal_length > size - produced) {
+      return false;
+    }
+    std::memcpy(output + produced, in, literal_length);
+    in += literal_length;
+    produced += literal_length;
+    if (in == in_end) {
+      // The last sequence has no match.
+      return produced == size;
+    }
+    if (in_end - in < 2) {
+      return false;
+    }
+    const std::size_t offset = in[0] | (in[1] << 8);
+    in += 2;
+    if (offset == 0 || offset > produced) {
+      return false;
+    }
+    std::size_t match_length = token & 15;
+    if (match_length == 15 && !getLength(match_length, in, in_end)) {
+      return false;
+    }
+    match_length += MIN_MATCH;
+    if (match_length > size - produced) {
+      return false;
+    }
+    // A match closer than its length repeats its first offset bytes; copy
+    // them in chunks that double, each from bytes already produced.
+    const unsigned char* const match = output + produced - offset;
+    unsigned char* const copy = output + produced;
+    std::size_t copied = 0;
+    std::size_t chunk = offset;
+    while (copied < match_length) {
+      const std::size_t bytes =
+          chunk < match_length - copied ? chunk : match_length - copied;
+      std::memcpy(copy + copied, match, bytes);
+      copied += bytes;
+      chunk = copied + offset;
+    }
+    produced += match_length;
+  }
+}
+
+}
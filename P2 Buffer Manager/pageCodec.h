@@ -0,0 +1,56 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace badgerdb {
+
+/**
+* @brief Compression of pages in the LZ4 block format
+*
+* A greedy LZ77 compressor with one hash table probe per position, fast
+* enough to run on every page write, and a decompressor that checks every
+* length and offset against the buffers, so that a damaged page is reported
+* rather than overrunning memory.  Inputs are at most MAX_INPUT bytes; matches
+* may reach back over the whole input.
+*/
+class PageCodec {
+ public:
+	/**
+	 * Largest input the codec accepts, bounded by the 16 bit match offsets
+	 */
+  static const std::size_t MAX_INPUT = 65535;
+
+	/**
+	 * Compresses length bytes of source into target
+	 *
+	 * @param source    Bytes to compress
+	 * @param length    Number of bytes, at most MAX_INPUT
+	 * @param target    Buffer receiving the compressed bytes
+	 * @param capacity  Size of target
+	 * @return  Number of compressed bytes, or 0 if they do not fit into
+	 *          capacity
+	 */
+  static std::size_t compress(const char* source, const std::size_t length,
+                              char* target, const std::size_t capacity);
+
+	/**
+	 * Decompresses length bytes of source into exactly size bytes of target
+	 *
+	 * @param source    Compressed bytes
+	 * @param length    Number of compressed bytes
+	 * @param target    Buffer receiving the decompressed bytes
+	 * @param size      Number of bytes the source decompresses to
+	 * @return  False if source is damaged or does not decompress to size bytes
+	 */
+  static bool decompress(const char* source, const std::size_t length,
+                         char* target, const std::size_t size);
+};
+
+}
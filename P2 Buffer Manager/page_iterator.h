@@ -92,15 +92,25 @@ class PageIterator {
   }
 
   /**
-   * Dereferences the iterator, returning a copy of the current record in the
-   * page.
+   * Dereferences the iterator, returning the current record in place on the
+   * page; nothing is copied.  The view converts to a string copy where one
+   * is needed.
    *
-   * @return  Record in page.
+   * @return  View of the record in page, valid until the page is changed.
    */
-	inline std::string operator*() const {
-		return page_->getRecord(current_record_); 
+	inline RecordView operator*() const {
+		return page_->getRecordView(current_record_); 
 	}
 
+  /**
+   * Returns the ID of the current record.
+   *
+   * @return  ID of the record the iterator points to.
+   */
+  const RecordId& getCurrentRecord() const {
+    return current_record_;
+  }
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
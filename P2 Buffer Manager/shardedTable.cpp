@@ -0,0 +1,303 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "shardedTable.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+const PageId ShardedTable::CHUNK_PAGES;
+
+namespace {
+
+/**
+ * Pages first to first + count - 1 of a segment
+ */
+struct Chunk {
+  std::uint32_t segment;
+  PageId first;
+  PageId count;
+};
+
+/**
+ * Chunks queued for a worker: it takes them from the front, the others
+ * steal from the back
+ */
+struct WorkQueue {
+  std::mutex latch;
+  std::deque<Chunk> chunks;
+};
+
+void checkNames(const std::vector<std::string>& names)
+{
+  if (names.empty()) {
+    throw BadgerDbException("Sharded table of no segments");
+  }
+}
+
+}
+
+ShardedTable ShardedTable::create(BufMgr& bufMgr, const std::vector<std::string>& names,
+                                  const bool direct)
+{
+  checkNames(names);
+  std::vector<std::unique_ptr<File> > segments;
+  try {
+    for (const std::string& name : names) {
+      segments.emplace_back(new File(File::create(name, direct)));
+    }
+  } catch (...) {
+    std::vector<std::string> made;
+    for (const std::unique_ptr<File>& file : segments) {
+      made.push_back(file->filename());
+    }
+    segments.clear();
+    for (const std::string& name : made) {
+      try {
+        File::remove(name);
+      } catch (...) {
+      }
+    }
+    throw;
+  }
+  return ShardedTable(bufMgr, std::move(segments));
+}
+
+ShardedTable ShardedTable::open(BufMgr& bufMgr, const std::vector<std::string>& names,
+                                const bool direct)
+{
+  checkNames(names);
+  std::vector<std::unique_ptr<File> > segments;
+  for (const std::string& name : names) {
+    segments.emplace_back(new File(File::open(name, direct)));
+  }
+  return ShardedTable(bufMgr, std::move(segments));
+}
+
+void ShardedTable::remove(const std::vector<std::string>& names)
+{
+  std::exception_ptr failure;
+  for (const std::string& name : names) {
+    try {
+      File::remove(name);
+    } catch (...) {
+      if (!failure) {
+        failure = std::current_exception();
+      }
+    }
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+ShardedTable::ShardedTable(BufMgr& bufMgr, std::vector<std::unique_ptr<File> >&& segments)
+  : bufMgr(&bufMgr), segments(std::move(segments)), tailSegment(0),
+    tailPage(Page::INVALID_NUMBER) {}
+
+ShardedTable::ShardedTable(ShardedTable&& other)
+  : bufMgr(other.bufMgr), segments(std::move(other.segments)), tailSegment(other.tailSegment),
+    tailPage(other.tailPage)
+{
+  other.segments.clear();
+  other.tailPage = Page::INVALID_NUMBER;
+}
+
+ShardedTable::~ShardedTable()
+{
+  // Nothing to report a failure to; the pages stay in the pool, and the
+  // buffer manager reports them when it goes.
+  for (const std::unique_ptr<File>& file : segments) {
+    try {
+      bufMgr->flushFile(file.get());
+    } catch (...) {
+    }
+  }
+}
+
+std::uint32_t ShardedTable::nextSegment() const
+{
+  const std::uint32_t count = segmentCount();
+  const std::uint32_t start = tailPage == Page::INVALID_NUMBER ? 0 : (tailSegment + 1) % count;
+  std::uint32_t best = start;
+  for (std::uint32_t k = 1; k < count; k++) {
+    const std::uint32_t s = (start + k) % count;
+    if (segments[s]->pageLimit() < segments[best]->pageLimit()) {
+      best = s;
+    }
+  }
+  return best;
+}
+
+ShardRecordId ShardedTable::insertRecord(const RecordView& record)
+{
+  Page* page;
+  if (tailPage != Page::INVALID_NUMBER) {
+    File* file = segments[tailSegment].get();
+    bufMgr->readPage(file, tailPage, page);
+    try {
+      const RecordId rid = page->insertRecord(record);
+      bufMgr->unPinPage(file, tailPage, true);
+      return ShardRecordId{tailSegment, rid};
+    } catch (InsufficientSpaceException&) {
+      bufMgr->unPinPage(file, tailPage, false);
+    } catch (...) {
+      bufMgr->unPinPage(file, tailPage, false);
+      throw;
+    }
+  }
+
+  // The new page becomes the tail before the record goes in, so that a
+  // record too large for it leaves no empty page behind that is never used.
+  const std::uint32_t next = nextSegment();
+  File* file = segments[next].get();
+  PageId pageNo;
+  bufMgr->allocPage(file, pageNo, page);
+  tailSegment = next;
+  tailPage = pageNo;
+  RecordId rid;
+  try {
+    rid = page->insertRecord(record);
+  } catch (...) {
+    bufMgr->unPinPage(file, pageNo, true);
+    throw;
+  }
+  bufMgr->unPinPage(file, pageNo, true);
+  return ShardRecordId{next, rid};
+}
+
+std::string ShardedTable::getRecord(const ShardRecordId& id)
+{
+  File* file = segments.at(id.segment).get();
+  Page* page;
+  bufMgr->readPage(file, id.rid.page_number, page);
+  std::string record;
+  try {
+    record = page->getRecord(id.rid);
+  } catch (...) {
+    bufMgr->unPinPage(file, id.rid.page_number, false);
+    throw;
+  }
+  bufMgr->unPinPage(file, id.rid.page_number, false);
+  return record;
+}
+
+void ShardedTable::flush()
+{
+  for (const std::unique_ptr<File>& file : segments) {
+    bufMgr->flushFile(file.get());
+  }
+}
+
+ShardScanStats ShardedTable::scan(unsigned workers, const PageVisitor& visit)
+{
+  if (workers == 0) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  ShardScanStats stats = {0, 0, 0};
+  std::vector<WorkQueue> queues(workers);
+  for (std::uint32_t s = 0; s < segmentCount(); s++) {
+    const PageId limit = segments[s]->pageLimit();
+    for (PageId first = 1; first < limit; first += CHUNK_PAGES) {
+      const Chunk chunk = {s, first, std::min<PageId>(CHUNK_PAGES, limit - first)};
+      queues[s % workers].chunks.push_back(chunk);
+      stats.chunks++;
+    }
+  }
+
+  std::atomic<std::uint64_t> pages(0);
+  std::atomic<std::uint64_t> steals(0);
+  std::atomic<bool> failed(false);
+  std::mutex failureLatch;
+  std::exception_ptr failure;
+
+  const auto take = [&](const unsigned w, Chunk& chunk) {
+    {
+      std::lock_guard<std::mutex> guard(queues[w].latch);
+      if (!queues[w].chunks.empty()) {
+        chunk = queues[w].chunks.front();
+        queues[w].chunks.pop_front();
+        return true;
+      }
+    }
+    // Nothing is queued once the scan has started, so queues found empty
+    // stay empty and a worker that finds them all empty is done.
+    for (unsigned k = 1; k < workers; k++) {
+      WorkQueue& victim = queues[(w + k) % workers];
+      std::lock_guard<std::mutex> guard(victim.latch);
+      if (!victim.chunks.empty()) {
+        chunk = victim.chunks.back();
+        victim.chunks.pop_back();
+        steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  };
+
+  const auto work = [&](const unsigned w) {
+    try {
+      Chunk chunk;
+      while (!failed.load(std::memory_order_relaxed) && take(w, chunk)) {
+        File* file = segments[chunk.segment].get();
+        bufMgr->prefetch(file, chunk.first, chunk.count);
+        for (PageId pageNo = chunk.first; pageNo < chunk.first + chunk.count; pageNo++) {
+          if (failed.load(std::memory_order_relaxed)) {
+            break;
+          }
+          Page* page;
+          try {
+            bufMgr->readPage(file, pageNo, page);
+          } catch (InvalidPageException&) {
+            // a free page
+            continue;
+          }
+          try {
+            visit(w, chunk.segment, *page);
+          } catch (...) {
+            bufMgr->unPinPage(file, pageNo, false);
+            throw;
+          }
+          bufMgr->unPinPage(file, pageNo, false);
+          pages.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(failureLatch);
+      if (!failure) {
+        failure = std::current_exception();
+      }
+      failed = true;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned w = 1; w < workers; w++) {
+    threads.emplace_back(work, w);
+  }
+  work(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  stats.pages = pages;
+  stats.steals = steals;
+  return stats;
+}
+
+}
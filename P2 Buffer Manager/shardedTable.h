@@ -0,0 +1,222 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+* @brief Identifier of a record of a ShardedTable: the segment holding it and
+* its record id there
+*/
+struct ShardRecordId {
+	/**
+	 * Index of the segment, in the order of the names the table was made of
+	 */
+  std::uint32_t segment;
+
+	/**
+	 * Record id within the segment
+	 */
+  RecordId rid;
+
+  bool operator==(const ShardRecordId& rhs) const {
+    return segment == rhs.segment && rid == rhs.rid;
+  }
+
+  bool operator!=(const ShardRecordId& rhs) const {
+    return !(*this == rhs);
+  }
+};
+
+/**
+* @brief Work done by ShardedTable::scan()
+*/
+struct ShardScanStats {
+	/**
+	 * Used pages visited
+	 */
+  std::uint64_t pages;
+
+	/**
+	 * Chunks of pages handed out to the workers
+	 */
+  std::uint64_t chunks;
+
+	/**
+	 * Chunks a worker took from the queue of another
+	 */
+  std::uint64_t steals;
+};
+
+/**
+* @brief A table of records striped over several files, its segments, which
+* may sit on different disks, all read through one buffer manager
+*
+* Records are appended to the last page placed; a new page goes to the
+* segment with the fewest pages, the one after the last first, so that the
+* pages of the table are dealt out to the segments in turn and each of them
+* holds about as many.  scan() reads the segments in parallel: they are cut
+* into chunks of CHUNK_PAGES pages, each chunk prefetched before it is read,
+* and the chunks of every segment are queued for one worker, the one its
+* index gives modulo the workers.  A worker takes its chunks from the front
+* of its queue and, once it is empty, steals from the back of the queues of
+* the others, so that a slow disk or a busy worker does not hold up the
+* scan while others sit idle.
+*
+* Inserts are not safe to call concurrently with each other or with scan();
+* a single scan runs its own workers.  The files have to be flushed before
+* the table goes, which its destructor does: the buffer manager keeps the
+* segments' pages by the address of their File objects.
+*/
+class ShardedTable {
+ public:
+	/**
+	 * Pages of a segment handed to a worker at a time
+	 */
+  static const PageId CHUNK_PAGES = 32;
+
+	/**
+	 * Called by scan() for every used page of the table, on the thread of
+	 * one worker, with the page pinned; it must not change the page
+	 *
+	 * @param worker  	Index of the worker, below the number of workers
+	 * @param segment 	Index of the segment of the page
+	 * @param page    	The page
+	 */
+  typedef std::function<void(const unsigned worker, const std::uint32_t segment,
+                             Page& page)> PageVisitor;
+
+	/**
+	 * Creates a table of new, empty files, one a segment
+	 *
+	 * @param bufMgr  	Buffer manager the pages are read through
+	 * @param names   	Names of the segments, at least one
+	 * @param direct  	Open the files with O_DIRECT, see File::create()
+   * @throws  BadgerDbException If names is empty
+   * @throws  FileExistsException If a file exists already; the files made before are removed
+	 */
+  static ShardedTable create(BufMgr& bufMgr, const std::vector<std::string>& names,
+                             const bool direct = false);
+
+	/**
+	 * Opens a table made by create(), of the same names in the same order
+	 *
+	 * @param bufMgr  	Buffer manager the pages are read through
+	 * @param names   	Names of the segments
+	 * @param direct  	Open the files with O_DIRECT, see File::open()
+   * @throws  BadgerDbException If names is empty
+   * @throws  FileNotFoundException If a file does not exist
+	 */
+  static ShardedTable open(BufMgr& bufMgr, const std::vector<std::string>& names,
+                           const bool direct = false);
+
+	/**
+	 * Removes the files of a table that is not open
+	 *
+	 * @param names   	Names of the segments
+   * @throws  FileNotFoundException If a file does not exist; the others are removed
+	 */
+  static void remove(const std::vector<std::string>& names);
+
+  ShardedTable(ShardedTable&& other);
+
+  ShardedTable(const ShardedTable&) = delete;
+  ShardedTable& operator=(const ShardedTable&) = delete;
+
+	/**
+	 * Flushes the segments
+	 */
+  ~ShardedTable();
+
+	/**
+	 * Inserts a record into the last page placed, or into a new page placed
+	 * on the next segment if it does not fit
+	 *
+	 * @param record  	Record to insert
+	 * @return 		Identifier of the record
+   * @throws  InsufficientSpaceException If the record does not fit an empty page
+	 */
+  ShardRecordId insertRecord(const RecordView& record);
+
+	/**
+	 * Returns the record with the given identifier
+	 *
+   * @throws  InvalidPageException If its page is not in use
+   * @throws  InvalidRecordException If there is no such record
+	 */
+  std::string getRecord(const ShardRecordId& id);
+
+	/**
+	 * Writes the dirty pages of every segment out and syncs it
+	 *
+   * @throws  PagePinnedException If a page of the table is pinned
+	 */
+  void flush();
+
+	/**
+	 * Reads every used page of the table once with workers threads, the
+	 * calling thread counted, calling visit for each.  The first exception
+	 * thrown, by visit or a read, stops the workers and is rethrown once they
+	 * have stopped.
+	 *
+	 * @param workers 	Number of workers, 0 for the number of hardware threads
+	 * @param visit   	Called for every used page
+	 * @return 		Pages visited, and how the chunks of pages were shared out
+	 */
+  ShardScanStats scan(unsigned workers, const PageVisitor& visit);
+
+	/**
+	 * Number of segments
+	 */
+  std::uint32_t segmentCount() const {
+    return static_cast<std::uint32_t>(segments.size());
+  }
+
+	/**
+	 * The file of a segment
+	 */
+  File& segment(const std::uint32_t index) {
+    return *segments[index];
+  }
+
+ private:
+  ShardedTable(BufMgr& bufMgr, std::vector<std::unique_ptr<File> >&& segments);
+
+	/**
+	 * Index of the segment the next page goes to: the one with the fewest
+	 * pages, searched from the one after the last placed
+	 */
+  std::uint32_t nextSegment() const;
+
+  BufMgr* bufMgr;
+
+	/**
+	 * Files of the segments; on the heap, so that their addresses outlive a move
+	 */
+  std::vector<std::unique_ptr<File> > segments;
+
+	/**
+	 * Segment and number of the page records are appended to; no page
+	 * before the first insert
+	 */
+  std::uint32_t tailSegment;
+  PageId tailPage;
+};
+
+}
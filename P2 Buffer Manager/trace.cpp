@@ -0,0 +1,290 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+namespace badgerdb {
+
+const std::uint32_t Trace::RING_EVENTS;
+
+namespace {
+
+/**
+ * Names and categories of the events, by TraceEvent
+ */
+const char* const EVENT_NAMES[TRACE_EVENT_COUNT] = {
+  "hit", "miss", "evict", "write back", "read", "write", "leaf split", "internal split",
+  "scan page"
+};
+const char* const EVENT_CATEGORIES[TRACE_EVENT_COUNT] = {
+  "buffer", "buffer", "buffer", "buffer", "file", "file", "btree", "btree", "btree"
+};
+
+/**
+ * One event of a ring.  The fields are atomics written and read relaxed, so
+ * that an export racing with the thread overwriting the slot reads no torn
+ * values; seq tells it whether the slot changed under it (a seqlock).
+ */
+struct Slot {
+  std::atomic<std::uint64_t> seq;
+  std::atomic<std::uint64_t> start;
+  std::atomic<std::uint64_t> nanos;
+  std::atomic<std::uintptr_t> object;
+  std::atomic<std::uint64_t> where;  /* page number above the event */
+};
+
+/**
+ * Events of one thread, written by that thread alone
+ */
+struct Ring {
+  pid_t tid;
+  std::atomic<std::uint64_t> next;   /* number of events recorded */
+  std::atomic<std::uint64_t> floor;  /* events before it were cleared */
+  Slot slots[Trace::RING_EVENTS];
+
+  Ring() : tid(static_cast<pid_t>(syscall(SYS_gettid))), next(0), floor(0)
+  {
+    for (Slot& slot : slots) {
+      slot.seq = 0;
+    }
+  }
+};
+
+/**
+ * An event copied out of a ring for an export
+ */
+struct Copied {
+  std::uint64_t start;
+  std::uint64_t nanos;
+  std::uintptr_t object;
+  std::uint32_t pageNo;
+  TraceEvent event;
+  pid_t tid;
+};
+
+/**
+ * Every ring, and the names of the objects; rings are added once per thread
+ */
+struct Registry {
+  std::mutex latch;
+  std::vector<std::shared_ptr<Ring> > rings;
+  std::unordered_map<std::uintptr_t, std::string> names;
+};
+
+/**
+ * The registry, never destroyed: threads still running at exit may trace
+ * after static objects are gone, as may objects destroyed with them
+ */
+Registry& registry()
+{
+  static Registry* const instance = new Registry;
+  return *instance;
+}
+
+thread_local std::shared_ptr<Ring> threadRing;
+
+Ring& ringOfThread()
+{
+  if (!threadRing) {
+    threadRing = std::make_shared<Ring>();
+    Registry& all = registry();
+    std::lock_guard<std::mutex> guard(all.latch);
+    all.rings.push_back(threadRing);
+  }
+  return *threadRing;
+}
+
+/**
+ * Copies out the events of every ring still intact, in time order, with
+ * the names of their objects
+ */
+std::vector<Copied> collect(std::unordered_map<std::uintptr_t, std::string>& named)
+{
+  std::vector<std::shared_ptr<Ring> > all;
+  {
+    Registry& registered = registry();
+    std::lock_guard<std::mutex> guard(registered.latch);
+    all = registered.rings;
+    named = registered.names;
+  }
+  std::vector<Copied> events;
+  for (const std::shared_ptr<Ring>& ring : all) {
+    const std::uint64_t next = ring->next.load(std::memory_order_acquire);
+    std::uint64_t first = ring->floor.load(std::memory_order_relaxed);
+    if (next > first + Trace::RING_EVENTS) {
+      first = next - Trace::RING_EVENTS;
+    }
+    for (std::uint64_t n = first; n < next; n++) {
+      const Slot& slot = ring->slots[n % Trace::RING_EVENTS];
+      const std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      if (seq != 2 * n + 2) {
+        continue;
+      }
+      Copied event;
+      event.start = slot.start.load(std::memory_order_relaxed);
+      event.nanos = slot.nanos.load(std::memory_order_relaxed);
+      event.object = slot.object.load(std::memory_order_relaxed);
+      const std::uint64_t where = slot.where.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // overwritten while it was copied
+      if (slot.seq.load(std::memory_order_relaxed) != seq) {
+        continue;
+      }
+      event.pageNo = static_cast<std::uint32_t>(where >> 8);
+      event.event = static_cast<TraceEvent>(where & 0xff);
+      event.tid = ring->tid;
+      events.push_back(event);
+    }
+  }
+  std::sort(events.begin(), events.end(),
+            [](const Copied& a, const Copied& b) { return a.start < b.start; });
+  return events;
+}
+
+/**
+ * Name of an object in an export: its own, or its address
+ */
+std::string nameOf(const std::unordered_map<std::uintptr_t, std::string>& named,
+                   const std::uintptr_t object)
+{
+  const auto found = named.find(object);
+  if (found != named.end()) {
+    return found->second;
+  }
+  char address[2 + 2 * sizeof(object) + 1];
+  std::snprintf(address, sizeof(address), "0x%" PRIxPTR, object);
+  return address;
+}
+
+/**
+ * text as the contents of a JSON string
+ */
+std::string escaped(const std::string& text)
+{
+  std::string result;
+  for (const char c : text) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char code[8];
+      std::snprintf(code, sizeof(code), "\\u%04x", c);
+      result += code;
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+}
+
+std::uint64_t Trace::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const TraceEvent event, const void* object, const std::uint32_t pageNo,
+                   const std::uint64_t start, const std::uint64_t nanos)
+{
+  Ring& ring = ringOfThread();
+  const std::uint64_t n = ring.next.load(std::memory_order_relaxed);
+  Slot& slot = ring.slots[n % RING_EVENTS];
+  // odd while the slot is being written
+  slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.start.store(start, std::memory_order_relaxed);
+  slot.nanos.store(nanos, std::memory_order_relaxed);
+  slot.object.store(reinterpret_cast<std::uintptr_t>(object), std::memory_order_relaxed);
+  slot.where.store(static_cast<std::uint64_t>(pageNo) << 8 | event, std::memory_order_relaxed);
+  slot.seq.store(2 * n + 2, std::memory_order_release);
+  ring.next.store(n + 1, std::memory_order_release);
+}
+
+void Trace::name(const void* object, const std::string& name)
+{
+  Registry& all = registry();
+  std::lock_guard<std::mutex> guard(all.latch);
+  all.names[reinterpret_cast<std::uintptr_t>(object)] = name;
+}
+
+void Trace::clear()
+{
+  Registry& all = registry();
+  std::lock_guard<std::mutex> guard(all.latch);
+  // a ring only the registry holds belongs to a thread that has exited
+  all.rings.erase(std::remove_if(all.rings.begin(), all.rings.end(),
+                                 [](const std::shared_ptr<Ring>& ring) { return ring.use_count() == 1; }),
+                  all.rings.end());
+  for (const std::shared_ptr<Ring>& ring : all.rings) {
+    ring->floor.store(ring->next.load(std::memory_order_acquire), std::memory_order_relaxed);
+  }
+}
+
+bool Trace::exportChrome(const std::string& path)
+{
+  std::unordered_map<std::uintptr_t, std::string> named;
+  const std::vector<Copied> events = collect(named);
+  FILE* out = std::fopen(path.c_str(), "w");
+  if (out == NULL) {
+    return false;
+  }
+  const int pid = static_cast<int>(getpid());
+  std::fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (std::size_t i = 0; i < events.size(); i++) {
+    const Copied& event = events[i];
+    std::fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,",
+                 i == 0 ? "" : ",", EVENT_NAMES[event.event], EVENT_CATEGORIES[event.event], pid,
+                 static_cast<int>(event.tid), event.start / 1000.0);
+    if (event.nanos > 0) {
+      std::fprintf(out, "\"ph\":\"X\",\"dur\":%.3f,", event.nanos / 1000.0);
+    } else {
+      std::fprintf(out, "\"ph\":\"i\",\"s\":\"t\",");
+    }
+    std::fprintf(out, "\"args\":{\"object\":\"%s\",\"page\":%" PRIu32 "}}",
+                 escaped(nameOf(named, event.object)).c_str(), event.pageNo);
+  }
+  std::fprintf(out, "\n]}\n");
+  return std::fclose(out) == 0;
+}
+
+bool Trace::exportPerf(const std::string& path)
+{
+  std::unordered_map<std::uintptr_t, std::string> named;
+  const std::vector<Copied> events = collect(named);
+  FILE* out = std::fopen(path.c_str(), "w");
+  if (out == NULL) {
+    return false;
+  }
+  const int pid = static_cast<int>(getpid());
+  for (const Copied& event : events) {
+    // perf script: comm pid/tid seconds.microseconds: event: fields
+    std::string name = EVENT_NAMES[event.event];
+    std::replace(name.begin(), name.end(), ' ', '_');
+    std::fprintf(out, "badgerdb %d/%d %" PRIu64 ".%06" PRIu64 ": badgerdb:%s_%s: object=%s page=%" PRIu32
+                 " nanos=%" PRIu64 "\n",
+                 pid, static_cast<int>(event.tid), event.start / 1000000000, event.start / 1000 % 1000000,
+                 EVENT_CATEGORIES[event.event], name.c_str(), nameOf(named, event.object).c_str(),
+                 event.pageNo, event.nanos);
+  }
+  return std::fclose(out) == 0;
+}
+
+}
@@ -0,0 +1,145 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace badgerdb {
+
+/**
+* @brief Page-level events traced by the buffer manager, the file and the B+ tree
+*/
+enum TraceEvent {
+	TRACE_BUF_HIT = 0,        /* readPage found the page in the pool */
+	TRACE_BUF_MISS = 1,       /* readPage read the page into a frame */
+	TRACE_BUF_EVICT = 2,      /* a page left the pool to free its frame */
+	TRACE_BUF_WRITE_BACK = 3, /* a dirty page was written back, in the background or not */
+	TRACE_FILE_READ = 4,      /* File read a page, timed */
+	TRACE_FILE_WRITE = 5,     /* File wrote a page, timed */
+	TRACE_LEAF_SPLIT = 6,     /* a B+ tree leaf split, timed */
+	TRACE_NONLEAF_SPLIT = 7,  /* a B+ tree internal node split, timed */
+	TRACE_SCAN_PAGE = 8,      /* a B+ tree scan moved on to the next leaf */
+	TRACE_EVENT_COUNT = 9
+};
+
+/**
+* @brief Tracing of page-level events into per-thread rings, exported as a
+* Chrome trace or as perf script text
+*
+* Events are recorded through the BADGERDB_TRACE macros, which compile to
+* nothing unless BADGERDB_TRACING is defined, so that builds without it pay
+* nothing; the B+ tree traces its splits and scans when it is built with
+* BADGERDB_TRACING and this directory on its include path, and trace.cpp.
+* Every thread records into a ring of its own of RING_EVENTS
+* events, without a latch or a shared atomic: a full ring overwrites its
+* oldest events.  Rings outlive their threads until clear(), so events of
+* threads that have exited are exported too.
+*
+* Events name the object they happened to (a File, a BTreeIndex) by its
+* address; name() gives an address a name for the exports.  Export while
+* threads trace is safe, though it may leave out events recorded meanwhile.
+*/
+class Trace {
+ public:
+	/**
+	 * Events kept per thread
+	 */
+  static const std::uint32_t RING_EVENTS = 1 << 13;
+
+	/**
+	 * Nanoseconds on the clock the events are timed by
+	 */
+  static std::uint64_t now();
+
+	/**
+	 * Records an event into the ring of the calling thread
+	 *
+	 * @param event   	Kind of event
+	 * @param object  	Object it happened to
+	 * @param pageNo  	Page number
+	 * @param start   	now() at the event, or at its start
+	 * @param nanos   	How long it took, 0 for an instant
+	 */
+  static void record(const TraceEvent event, const void* object, const std::uint32_t pageNo,
+                     const std::uint64_t start, const std::uint64_t nanos);
+
+	/**
+	 * Names object in the exports, for example a File by its file name
+	 */
+  static void name(const void* object, const std::string& name);
+
+	/**
+	 * Drops every event recorded, and the rings of threads that have exited
+	 */
+  static void clear();
+
+	/**
+	 * Writes the events recorded as a Chrome trace (JSON), to be loaded into
+	 * chrome://tracing or Perfetto.  Timed events are complete events, the
+	 * others instants; the file and page are arguments of every event.
+	 *
+	 * @param path   	Name of the file written
+	 * @return 		False if it could not be written
+	 */
+  static bool exportChrome(const std::string& path);
+
+	/**
+	 * Writes the events recorded as the text perf script prints, one line an
+	 * event, in time order, for the tools that read perf script output
+	 *
+	 * @param path   	Name of the file written
+	 * @return 		False if it could not be written
+	 */
+  static bool exportPerf(const std::string& path);
+
+	/**
+	 * Records a timed event when it goes out of scope
+	 */
+  class Span {
+   public:
+    Span(const TraceEvent event, const void* object, const std::uint32_t pageNo)
+      : event(event), object(object), pageNo(pageNo), start(now()) {}
+
+    ~Span()
+    {
+      record(event, object, pageNo, start, now() - start);
+    }
+
+   private:
+    const TraceEvent event;
+    const void* const object;
+    const std::uint32_t pageNo;
+    const std::uint64_t start;
+  };
+};
+
+}
+
+#ifdef BADGERDB_TRACING
+#define BADGERDB_TRACE_CONCAT2(a, b) a##b
+#define BADGERDB_TRACE_CONCAT(a, b) BADGERDB_TRACE_CONCAT2(a, b)
+/**
+ * Records an instant event
+ */
+#define BADGERDB_TRACE(event, object, pageNo) \
+  ::badgerdb::Trace::record((event), (object), (pageNo), ::badgerdb::Trace::now(), 0)
+/**
+ * Records an event timed from here to the end of the enclosing scope
+ */
+#define BADGERDB_TRACE_SPAN(event, object, pageNo) \
+  ::badgerdb::Trace::Span BADGERDB_TRACE_CONCAT(traceSpan, __LINE__)((event), (object), (pageNo))
+/**
+ * Names an object in the exports
+ */
+#define BADGERDB_TRACE_NAME(object, objectName) ::badgerdb::Trace::name((object), (objectName))
+#else
+#define BADGERDB_TRACE(event, object, pageNo) ((void)0)
+#define BADGERDB_TRACE_SPAN(event, object, pageNo) ((void)0)
+#define BADGERDB_TRACE_NAME(object, objectName) ((void)0)
+#endif
@@ -24,6 +24,12 @@ typedef std::uint16_t SlotId;
  */
 typedef std::uint32_t FrameId;
 
+/**
+ * @brief Log sequence number: position of a record in the write-ahead log.
+ * LSNs grow from one record to the next; 0 is no record.
+ */
+typedef std::uint64_t Lsn;
+
 /**
  * @brief Identifier for a record in a page.
  */
@@ -0,0 +1,511 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wal.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+/**
+ * Kinds of log records: a change to a page, and the end of a segment, which
+ * sends readers on to the next one
+ */
+static const std::uint16_t RECORD_PAGE = 1;
+static const std::uint16_t RECORD_END = 2;
+
+/**
+ * Longest file name a record may carry
+ */
+static const std::size_t MAX_NAME_LENGTH = 4096;
+
+/**
+ * First word of the master file
+ */
+static const std::uint64_t MASTER_MAGIC = 0x3157414c47444142ULL;  // "BADGLAW1"
+
+/**
+ * Header of a log record, followed by the file name and the bytes
+ */
+struct LogRecord {
+  Lsn lsn;                   /* LSN of the record, its position in the log */
+  std::uint64_t checksum;    /* of the rest of the record, then of lsn */
+  std::uint32_t pageNo;
+  std::uint16_t type;        /* RECORD_PAGE or RECORD_END */
+  std::uint16_t nameLength;
+  std::uint16_t offset;      /* of the bytes in the page */
+  std::uint16_t length;      /* of the bytes */
+  std::uint32_t unused;
+};
+
+static_assert(sizeof(LogRecord) == 32, "log records are laid out without padding");
+
+/**
+ * Bytes covered by the checksum of a record, after lsn and checksum
+ */
+static const std::size_t CHECKED_FROM = offsetof(LogRecord, pageNo);
+
+/**
+ * Contents of the master file
+ */
+struct Master {
+  std::uint64_t magic;
+  std::uint64_t segmentSize;
+  Lsn redo;
+  std::uint64_t checksum;    /* of the fields before it */
+};
+
+/**
+ * FNV-1a of bytes, continued from hash
+ */
+static std::uint64_t hashBytes(std::uint64_t hash, const void* bytes, const std::size_t length)
+{
+  const unsigned char* p = static_cast<const unsigned char*>(bytes);
+  for (std::size_t i = 0; i < length; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static const std::uint64_t HASH_START = 0xcbf29ce484222325ULL;
+
+/**
+ * Checksum of a record laid out at bytes, total bytes long, at LSN lsn.  The
+ * LSN goes in last, so that all but it can be hashed before it is known.
+ */
+static std::uint64_t recordChecksum(const char* bytes, const std::size_t total, const Lsn lsn)
+{
+  return hashBytes(hashBytes(HASH_START, bytes + CHECKED_FROM, total - CHECKED_FROM), &lsn, sizeof(lsn));
+}
+
+/**
+ * Writes all of length bytes at offset of fd, false on failure with errno set
+ */
+static bool writeFully(const int fd, const char* bytes, std::size_t length, off_t offset)
+{
+  while (length > 0) {
+    const ssize_t n = pwrite(fd, bytes, length, offset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    bytes += n;
+    length -= n;
+    offset += n;
+  }
+  return true;
+}
+
+/**
+ * Reads the whole file name into contents; false if there is no such file
+ */
+static bool readFile(const std::string& name, std::string& contents)
+{
+  const int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return false;
+    throw FileIOException(name, "open", errno);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    const int error = errno;
+    close(fd);
+    throw FileIOException(name, "read", error);
+  }
+  contents.resize(st.st_size);
+  std::size_t done = 0;
+  while (done < contents.size()) {
+    const ssize_t n = pread(fd, &contents[done], contents.size() - done, done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      const int error = n < 0 ? errno : 0;
+      close(fd);
+      if (error != 0)
+        throw FileIOException(name, "read", error);
+      break;
+    }
+    done += n;
+  }
+  contents.resize(done);
+  close(fd);
+  return true;
+}
+
+/**
+ * Syncs the directory path is in, making files created, renamed or removed
+ * there durable
+ */
+static void syncDirectory(const std::string& path)
+{
+  const std::size_t slash = path.rfind('/');
+  const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    throw FileIOException(dir, "open", errno);
+  if (fsync(fd) != 0) {
+    const int error = errno;
+    close(fd);
+    throw FileIOException(dir, "sync", error);
+  }
+  close(fd);
+}
+
+template <class Apply>
+Lsn WriteAheadLog::scan(const Lsn from, Apply apply) const
+{
+  Lsn lsn = from;
+  std::string contents;
+  for (std::uint64_t segment = from / segmentSize; readFile(segmentPath(segment), contents); segment++) {
+    std::size_t offset = lsn - segment * segmentSize;
+    for (;;) {
+      LogRecord header;
+      if (offset + sizeof(header) > contents.size())
+        return lsn;
+      std::memcpy(&header, contents.data() + offset, sizeof(header));
+      const std::size_t total = sizeof(header) + header.nameLength + header.length;
+      if (header.lsn != lsn || offset + total > contents.size() ||
+          (header.type != RECORD_PAGE && header.type != RECORD_END) ||
+          header.offset + header.length > Page::SIZE ||
+          header.checksum != recordChecksum(contents.data() + offset, total, lsn))
+        return lsn;
+      if (header.type == RECORD_END)
+        break;
+      const char* name = contents.data() + offset + sizeof(header);
+      apply(lsn, std::string(name, header.nameLength), header.pageNo, header.offset,
+            name + header.nameLength, header.length);
+      offset += total;
+      lsn += total;
+    }
+    lsn = (segment + 1) * segmentSize;
+  }
+  return lsn;
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& path, const std::size_t segmentSize)
+	: path(path), segmentSize(segmentSize < MIN_SEGMENT_SIZE ? MIN_SEGMENT_SIZE : segmentSize),
+	  nextLsn(0), durable(0), redo(0), firstSegment(0), flushing(false), error(0)
+{
+  const std::string master = path + ".master";
+  std::string contents;
+  if (!readFile(master, contents)) {
+    // a new log; segment 0 is never used, so that no record has LSN 0
+    redo = this->segmentSize;
+    writeMaster(redo);
+  } else {
+    Master m;
+    std::memcpy(&m, contents.data(), contents.size() < sizeof(m) ? contents.size() : sizeof(m));
+    if (contents.size() != sizeof(m) || m.magic != MASTER_MAGIC ||
+        m.checksum != hashBytes(HASH_START, &m, offsetof(Master, checksum)) ||
+        m.segmentSize < MIN_SEGMENT_SIZE || m.redo < m.segmentSize)
+      throw FileIOException(master, "read", EINVAL);
+    this->segmentSize = m.segmentSize;
+    redo = m.redo;
+  }
+  firstSegment = redo / this->segmentSize;
+
+  // segments a crash kept checkpoint() from removing
+  for (std::uint64_t s = firstSegment - 1; s > 0 && std::remove(segmentPath(s).c_str()) == 0; s--) {
+  }
+
+  // cut off whatever follows the last intact record
+  const Lsn end = scan(redo, [](Lsn, const std::string&, PageId, std::size_t, const char*, std::size_t) {});
+  const std::uint64_t last = end / this->segmentSize;
+  const int fd = open(segmentPath(last).c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    const bool cut = ftruncate(fd, end - last * this->segmentSize) == 0 && fsync(fd) == 0;
+    const int failure = errno;
+    close(fd);
+    if (!cut)
+      throw FileIOException(segmentPath(last), "truncate", failure);
+  } else if (errno != ENOENT) {
+    throw FileIOException(segmentPath(last), "open", errno);
+  }
+  bool removed = false;
+  for (std::uint64_t s = last + 1; std::remove(segmentPath(s).c_str()) == 0; s++)
+    removed = true;
+  if (removed)
+    syncDirectory(path);
+  nextLsn = durable = end;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+  try {
+    flush(endLsn());
+  }
+  catch (...) {
+  }
+  for (const std::pair<const std::uint64_t, int>& segment : segments)
+    close(segment.second);
+}
+
+std::string WriteAheadLog::segmentPath(const std::uint64_t segment) const
+{
+  return path + "." + std::to_string(segment);
+}
+
+void WriteAheadLog::queue(const Lsn lsn, const char* bytes, const std::size_t length)
+{
+  if (pending.empty() || pending.back().start + pending.back().bytes.size() != lsn)
+    pending.push_back(Pending{lsn, std::string()});
+  pending.back().bytes.append(bytes, length);
+}
+
+Lsn WriteAheadLog::append(const std::string& filename, const PageId pageNo, const std::size_t offset,
+                          const char* bytes, const std::size_t length)
+{
+  if (filename.size() > MAX_NAME_LENGTH)
+    throw FileIOException(filename, "log", ENAMETOOLONG);
+  if (offset > Page::SIZE || length > Page::SIZE - offset)
+    throw FileIOException(filename, "log", EINVAL);
+
+  LogRecord header;
+  std::memset(&header, 0, sizeof(header));
+  header.pageNo = pageNo;
+  header.type = RECORD_PAGE;
+  header.nameLength = filename.size();
+  header.offset = offset;
+  header.length = length;
+  const std::size_t total = sizeof(header) + filename.size() + length;
+  std::string record(total, '\0');
+  std::memcpy(&record[0], &header, sizeof(header));
+  std::memcpy(&record[sizeof(header)], filename.data(), filename.size());
+  std::memcpy(&record[sizeof(header) + filename.size()], bytes, length);
+  const std::uint64_t partial = hashBytes(HASH_START, record.data() + CHECKED_FROM, total - CHECKED_FROM);
+
+  std::lock_guard<std::mutex> guard(latch);
+  if (error != 0)
+    throw FileIOException(path, "write", error);
+  const std::uint64_t segment = nextLsn / segmentSize;
+  if (nextLsn + total + sizeof(LogRecord) > (segment + 1) * segmentSize) {
+    // records never span segments; the end record leaves room for itself
+    LogRecord end;
+    std::memset(&end, 0, sizeof(end));
+    end.type = RECORD_END;
+    end.lsn = nextLsn;
+    end.checksum = recordChecksum(reinterpret_cast<const char*>(&end), sizeof(end), nextLsn);
+    queue(nextLsn, reinterpret_cast<const char*>(&end), sizeof(end));
+    nextLsn = (segment + 1) * segmentSize;
+  }
+  header.lsn = nextLsn;
+  header.checksum = hashBytes(partial, &header.lsn, sizeof(header.lsn));
+  std::memcpy(&record[0], &header, sizeof(header));
+  queue(nextLsn, record.data(), total);
+  nextLsn += total;
+  return header.lsn;
+}
+
+void WriteAheadLog::flush(const Lsn lsn)
+{
+  std::unique_lock<std::mutex> lock(latch);
+  for (;;) {
+    if (error != 0)
+      throw FileIOException(path, "write", error);
+    if (lsn < durable)
+      return;
+    if (!flushing)
+      break;
+    // the write in progress may cover lsn; if not, the next one will
+    flushed.wait(lock);
+  }
+  // lead a write of everything appended so far, on behalf of every waiter
+  flushing = true;
+  std::vector<Pending> out;
+  out.swap(pending);
+  const Lsn end = nextLsn;
+  lock.unlock();
+  try {
+    writeOut(out);
+  }
+  catch (const FileIOException& e) {
+    lock.lock();
+    error = e.error() != 0 ? e.error() : EIO;
+    flushing = false;
+    flushed.notify_all();
+    throw;
+  }
+  lock.lock();
+  durable = end;
+  flushing = false;
+  flushed.notify_all();
+}
+
+void WriteAheadLog::writeOut(const std::vector<Pending>& out)
+{
+  std::vector<std::uint64_t> written;
+  bool created = false;
+  for (const Pending& piece : out) {
+    const std::uint64_t segment = piece.start / segmentSize;
+    std::map<std::uint64_t, int>::iterator it = segments.find(segment);
+    if (it == segments.end()) {
+      const int fd = open(segmentPath(segment).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+      if (fd < 0)
+        throw FileIOException(segmentPath(segment), "open", errno);
+      it = segments.insert(std::make_pair(segment, fd)).first;
+      created = true;
+    }
+    if (!writeFully(it->second, piece.bytes.data(), piece.bytes.size(), piece.start - segment * segmentSize))
+      throw FileIOException(segmentPath(segment), "write", errno);
+    if (written.empty() || written.back() != segment)
+      written.push_back(segment);
+  }
+  // in order, so that no segment is durable before the end of the one before
+  for (const std::uint64_t segment : written) {
+    if (fdatasync(segments[segment]) != 0)
+      throw FileIOException(segmentPath(segment), "sync", errno);
+  }
+  if (created)
+    syncDirectory(path);
+  // segments before the last one written to take no more records
+  while (!written.empty() && segments.begin()->first < written.back()) {
+    close(segments.begin()->second);
+    segments.erase(segments.begin());
+  }
+}
+
+Lsn WriteAheadLog::endLsn() const
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return nextLsn;
+}
+
+Lsn WriteAheadLog::durableLsn() const
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return durable;
+}
+
+Lsn WriteAheadLog::redoLsn() const
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return redo;
+}
+
+void WriteAheadLog::writeMaster(const Lsn redoFrom) const
+{
+  Master m;
+  m.magic = MASTER_MAGIC;
+  m.segmentSize = segmentSize;
+  m.redo = redoFrom;
+  m.checksum = hashBytes(HASH_START, &m, offsetof(Master, checksum));
+
+  // written in full under another name first and renamed over the old one
+  const std::string master = path + ".master";
+  const std::string temp = master + ".tmp";
+  const int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw FileIOException(temp, "open", errno);
+  if (!writeFully(fd, reinterpret_cast<const char*>(&m), sizeof(m), 0) || fsync(fd) != 0) {
+    const int failure = errno;
+    close(fd);
+    std::remove(temp.c_str());
+    throw FileIOException(temp, "write", failure);
+  }
+  close(fd);
+  if (std::rename(temp.c_str(), master.c_str()) != 0) {
+    const int failure = errno;
+    std::remove(temp.c_str());
+    throw FileIOException(master, "rename", failure);
+  }
+  syncDirectory(path);
+}
+
+void WriteAheadLog::checkpoint(const Lsn redoFrom)
+{
+  std::lock_guard<std::mutex> serial(checkpointLatch);
+  flush(endLsn());
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    if (redoFrom <= redo)
+      return;
+  }
+  writeMaster(redoFrom);
+  std::uint64_t first;
+  const std::uint64_t last = redoFrom / segmentSize;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    redo = redoFrom;
+    first = firstSegment;
+    if (last > firstSegment)
+      firstSegment = last;
+  }
+  // segments left behind if this fails are removed when the log is opened
+  for (std::uint64_t s = first; s < last; s++)
+    std::remove(segmentPath(s).c_str());
+}
+
+std::uint64_t WriteAheadLog::recover(const std::vector<File*>& files)
+{
+  // pages of mapped files cannot be written to
+  std::map<std::string, File*> byName;
+  for (File* file : files) {
+    if (!file->isClosed() && !file->isMapped())
+      byName[file->filename()] = file;
+  }
+
+  // every page replayed into is read once and written once; NULL for pages
+  // whose records are skipped
+  struct Replayed {
+    std::unique_ptr<Page> page;
+    bool changed;
+  };
+  std::map<std::pair<File*, PageId>, Replayed> pages;
+  std::uint64_t applied = 0;
+  scan(redoLsn(), [&](const Lsn lsn, const std::string& name, const PageId pageNo,
+                      const std::size_t offset, const char* bytes, const std::size_t length) {
+    std::map<std::string, File*>::const_iterator file = byName.find(name);
+    if (file == byName.end())
+      return;
+    const std::pair<File*, PageId> key(file->second, pageNo);
+    std::map<std::pair<File*, PageId>, Replayed>::iterator it = pages.find(key);
+    if (it == pages.end()) {
+      Replayed replayed = {std::unique_ptr<Page>(), false};
+      if (pageNo < file->second->pageLimit()) {
+        try {
+          replayed.page.reset(new Page(file->second->readPage(pageNo)));
+        }
+        catch (const InvalidPageException&) {
+        }
+      }
+      it = pages.insert(std::make_pair(key, std::move(replayed))).first;
+    }
+    Page* page = it->second.page.get();
+    if (page == NULL || page->lsn() >= lsn)
+      return;
+    std::memcpy(reinterpret_cast<char*>(page) + offset, bytes, length);
+    page->set_lsn(lsn);
+    it->second.changed = true;
+    applied++;
+  });
+
+  std::vector<File*> written;
+  for (std::pair<const std::pair<File*, PageId>, Replayed>& entry : pages) {
+    if (!entry.second.changed)
+      continue;
+    entry.first.first->writePage(*entry.second.page);
+    if (written.empty() || written.back() != entry.first.first)
+      written.push_back(entry.first.first);
+  }
+  for (File* file : written)
+    file->sync();
+  return applied;
+}
+
+}
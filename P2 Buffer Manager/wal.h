@@ -0,0 +1,235 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+* @brief Write-ahead log of changes to pages
+*
+* Every record redoes one change: bytes written at an offset of a page, named
+* by file name and page number.  Records are appended to memory and written
+* out in order to the segment files path.1, path.2, ... of segmentSize bytes
+* each; the LSN of a record is its position in that sequence, so LSNs grow
+* from one record to the next.  flush() makes the records up to an LSN
+* durable.  Threads flushing at the same time share one sequential write and
+* one fdatasync (group commit), so making a change durable costs a log sync
+* instead of the random write of the page it changed.
+*
+* A page carries the LSN of the last record applied to it (Page::lsn()), so
+* that replaying a record twice does no harm.  checkpoint() records in
+* path.master the LSN that recovery starts from and removes the segments
+* before it; recover() replays the records from there into the files.  Every
+* record carries a checksum and the log ends at the first one missing or
+* damaged, so a crash loses only records that were never flushed.
+*
+* All methods are threadsafe.
+*/
+class WriteAheadLog {
+ public:
+	/**
+	 * Default size of a segment file
+	 */
+  static const std::size_t DEFAULT_SEGMENT_SIZE = 16 << 20;
+
+	/**
+	 * Smallest segment size, which leaves room for a record of a whole page
+	 */
+  static const std::size_t MIN_SEGMENT_SIZE = 1 << 16;
+
+	/**
+	 * Opens the log at path, creating it if there is none, and finds its end.
+	 * Whatever follows the end, such as records torn by a crash, is removed.
+	 *
+	 * @param path         Path the segment files and the master file are named after
+	 * @param segmentSize  Size of a segment file, raised to MIN_SEGMENT_SIZE if
+	 *                     smaller; an existing log keeps the size it was created with
+	 * @throws FileIOException If the log cannot be read or created
+	 */
+  explicit WriteAheadLog(const std::string& path, const std::size_t segmentSize = DEFAULT_SEGMENT_SIZE);
+
+	/**
+	 * Flushes the log, dropping errors, and closes it
+	 */
+  ~WriteAheadLog();
+
+	/**
+	 * Appends a record of length bytes written at offset of a page.  The
+	 * record is durable once flush() has been called for its LSN.
+	 *
+	 * @param filename  Name of the file of the page
+	 * @param pageNo    Page number in the file
+	 * @param offset    Offset of the bytes in the page
+	 * @param bytes     New contents of the bytes
+	 * @param length    Number of bytes, with offset at most Page::SIZE
+	 * @return  LSN of the record
+	 * @throws FileIOException If the name is too long, the bytes run past the
+	 *                         page, or a write of the log failed before
+	 */
+  Lsn append(const std::string& filename, const PageId pageNo, const std::size_t offset,
+             const char* bytes, const std::size_t length);
+
+	/**
+	 * Makes the record at lsn and every record before it durable.  Returns at
+	 * once if they are; otherwise joins the write in progress, or writes and
+	 * syncs everything appended so far.
+	 *
+	 * @param lsn  LSN of a record
+	 * @throws FileIOException If the log cannot be written; the log takes no
+	 *                         more records after a failed write
+	 */
+  void flush(const Lsn lsn);
+
+	/**
+	 * LSN the next record appended will get at the earliest
+	 */
+  Lsn endLsn() const;
+
+	/**
+	 * LSN of the first record that may not be durable yet
+	 */
+  Lsn durableLsn() const;
+
+	/**
+	 * LSN recovery starts from, as recorded by the last checkpoint()
+	 */
+  Lsn redoLsn() const;
+
+	/**
+	 * Flushes the log and records that recovery may start from redo, because
+	 * every change before it is durable in its file; the segments wholly
+	 * before redo are removed.  The master file is replaced atomically.
+	 *
+	 * @param redo  LSN recovery is to start from, at most endLsn()
+	 * @throws FileIOException If the log or the master file cannot be written
+	 */
+  void checkpoint(const Lsn redo);
+
+	/**
+	 * Replays the records from redoLsn() on into the pages they changed, in
+	 * order, skipping those already applied to a page, and syncs the files
+	 * written to.  Records of files not among files, and of pages not in use
+	 * or beyond the end of their file, are skipped.  To be called before the
+	 * files are read through a buffer manager.
+	 *
+	 * @param files  Open files the records may belong to, matched by name
+	 * @return  Number of records applied
+	 * @throws FileIOException If a file cannot be written or synced
+	 */
+  std::uint64_t recover(const std::vector<File*>& files);
+
+ private:
+	/**
+	 * Bytes appended but not yet written, starting at LSN start
+	 */
+  struct Pending {
+    Lsn start;
+    std::string bytes;
+  };
+
+	/**
+	 * Path the files of the log are named after
+	 */
+  const std::string path;
+
+	/**
+	 * Size of a segment file
+	 */
+  std::size_t segmentSize;
+
+	/**
+	 * LSN the next record goes to, and the pending bytes up to it; guarded by latch
+	 */
+  Lsn nextLsn;
+  std::vector<Pending> pending;
+
+	/**
+	 * Everything before durable is on disk; guarded by latch
+	 */
+  Lsn durable;
+
+	/**
+	 * LSN recovery starts from, and the first segment not yet removed;
+	 * guarded by latch
+	 */
+  Lsn redo;
+  std::uint64_t firstSegment;
+
+	/**
+	 * True while a thread writes out the pending bytes, without latch; set
+	 * and cleared with latch held
+	 */
+  bool flushing;
+
+	/**
+	 * errno of the write that failed, 0 if none has
+	 */
+  int error;
+
+	/**
+	 * Descriptors of the open segment files, used only by the flushing thread
+	 */
+  std::map<std::uint64_t, int> segments;
+
+	/**
+	 * Serialises checkpoint() calls, taken before latch
+	 */
+  std::mutex checkpointLatch;
+
+	/**
+	 * Protects the fields above; never held during I/O
+	 */
+  mutable std::mutex latch;
+
+	/**
+	 * Signalled with latch whenever a flush completes
+	 */
+  std::condition_variable flushed;
+
+	/**
+	 * Name of the file of segment
+	 */
+  std::string segmentPath(const std::uint64_t segment) const;
+
+	/**
+	 * Reads the records from LSN from on, calling apply for every page record
+	 * with its LSN, file name, page number, offset, bytes and length, and
+	 * returns the LSN following the last intact record
+	 */
+  template <class Apply>
+  Lsn scan(const Lsn from, Apply apply) const;
+
+	/**
+	 * Writes the master file, recording segmentSize and redo
+	 */
+  void writeMaster(const Lsn redoFrom) const;
+
+	/**
+	 * Adds bytes to the pending ones, at lsn; called with latch held
+	 */
+  void queue(const Lsn lsn, const char* bytes, const std::size_t length);
+
+	/**
+	 * Writes the pending bytes taken from the log and syncs the segments
+	 * written to, with latch not held
+	 */
+  void writeOut(const std::vector<Pending>& out);
+};
+
+}
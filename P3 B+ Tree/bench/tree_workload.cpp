@@ -0,0 +1,268 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+/**
+ * Inserts keys into an INTEGER index one at a time, in one of four orders,
+ * then times point lookups, range scans and index-only range scans, which
+ * return the keys too, of the tree built:
+ *   sorted    0, 1, 2, ...
+ *   reversed  keys - 1, keys - 2, ...
+ *   random    every key once, in an order of a permutation of the keys
+ *   skewed    keys / 16 distinct keys, drawn Zipfian (theta 0.99), so that a
+ *             few keys have most of the duplicates
+ * Keys are made as they are inserted, so runs of 10^9 keys take no memory
+ * beyond the buffer pool.  Reports insert throughput, the share of it that
+ * leaf and internal node splits took, latency percentiles of lookups and
+ * scans, the height of the tree and how full its leaves are, and the buffer
+ * pool accesses and disk reads of every operation.
+ *
+ * Build from the B+ tree directory like main.cpp in runTests.sh, with
+ * bench/tree_workload.cpp in place of main.cpp:
+ *   g++ -std=c++14 -O2 -pthread -I. -I"../P2 Buffer Manager" \
+ *       bench/tree_workload.cpp btree.cpp bloomFilter.cpp keySearch.cpp \
+ *       filescan.cpp <exception and P2 sources of runTests.sh> -o tree_workload
+ * Run: ./tree_workload [keys] [sorted|reversed|random|skewed|all] [frames]
+ *                      [queries] [scan width]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "btree.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+
+using namespace badgerdb;
+
+static const char *const RELATION = "bench.relation";
+
+static const char *const WORKLOADS[] = {"sorted", "reversed", "random",
+                                        "skewed"};
+
+// distinct keys of the skewed workload, as a fraction of the keys inserted
+static const std::uint64_t SKEW_DIVISOR = 16;
+
+/**
+ * The key of every insert of a workload, made on demand.
+ */
+class KeyGenerator {
+ public:
+  KeyGenerator(const std::string &workload, std::uint64_t keys)
+      : workload(workload), keys(keys), distinct(keys), seed(42) {
+    // a multiplier prime to the number of keys makes i * step a permutation
+    step = (std::uint64_t)(keys * 0.6180339887) | 1;
+    while (gcd(step, keys) != 1) step += 2;
+    if (workload == "skewed") {
+      distinct = std::max<std::uint64_t>(1, keys / SKEW_DIVISOR);
+      // Gray et al., Quickly Generating Billion-Record Synthetic Databases
+      for (std::uint64_t rank = 1; rank <= distinct; rank++)
+        zetan += 1 / std::pow((double)rank, THETA);
+      zeta2 = 1 + 1 / std::pow(2.0, THETA);
+      eta = (1 - std::pow(2.0 / distinct, 1 - THETA)) / (1 - zeta2 / zetan);
+    }
+  }
+
+  // number of different keys the workload inserts
+  std::uint64_t distinctKeys() const { return distinct; }
+
+  // the key of insert i
+  int key(std::uint64_t i) {
+    if (workload == "sorted") return (int)i;
+    if (workload == "reversed") return (int)(keys - 1 - i);
+    if (workload == "random") return (int)((i * step) % keys);
+    const double u = rand_r(&seed) / (RAND_MAX + 1.0);
+    const double uz = u * zetan;
+    std::uint64_t rank =
+        uz < 1 ? 0
+               : uz < zeta2 ? 1
+                            : (std::uint64_t)(distinct *
+                                              std::pow(eta * u - eta + 1,
+                                                       1 / (1 - THETA)));
+    if (rank >= distinct) rank = distinct - 1;
+    // the hottest keys are spread over the key space, not all at its start
+    return (int)((rank * 2654435761ULL) % distinct);
+  }
+
+ private:
+  static constexpr double THETA = 0.99;
+
+  static std::uint64_t gcd(std::uint64_t a, std::uint64_t b) {
+    while (b != 0) {
+      const std::uint64_t r = a % b;
+      a = b;
+      b = r;
+    }
+    return a;
+  }
+
+  const std::string workload;
+  const std::uint64_t keys;
+  std::uint64_t distinct;
+  std::uint64_t step;
+  unsigned seed;
+  double zetan = 0, zeta2 = 0, eta = 0;
+};
+
+/**
+ * Buffer pool accesses and disk reads since the last call.
+ */
+struct PoolCounter {
+  explicit PoolCounter(BufMgr &bufMgr) : bufMgr(bufMgr) { bufMgr.clearBufStats(); }
+
+  void print(const char *what, std::uint64_t operations) {
+    const BufStats stats = bufMgr.getBufStats();
+    printf("  %-8s %8.2f pool accesses  %8.4f disk reads per operation\n",
+           what, (double)stats.accesses / operations,
+           (double)stats.diskreads / operations);
+    bufMgr.clearBufStats();
+  }
+
+  // leave out what was done since the last call
+  void skip() { bufMgr.clearBufStats(); }
+
+  BufMgr &bufMgr;
+};
+
+static void printPercentiles(const char *what, std::vector<double> &nanos) {
+  std::sort(nanos.begin(), nanos.end());
+  const auto at = [&](double q) {
+    return nanos[std::min(nanos.size() - 1, (std::size_t)(q * nanos.size()))] /
+           1000;
+  };
+  printf("  %-8s p50 %8.2f  p90 %8.2f  p99 %8.2f  p99.9 %8.2f  max %8.2f us\n",
+         what, at(0.5), at(0.9), at(0.99), at(0.999), nanos.back() / 1000);
+}
+
+static double nanosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+static void run(const std::string &workload, std::uint64_t keys,
+                std::uint32_t frames, std::uint64_t queries,
+                int scanWidth) {
+  try {
+    File::remove(RELATION);
+  } catch (FileNotFoundException &) {
+  }
+  // the index starts empty, from a relation without tuples
+  { PageFile relation = PageFile::create(RELATION); }
+
+  BufMgr bufMgr(frames);
+  std::string indexName;
+  {
+    BTreeIndex index(RELATION, indexName, &bufMgr, 0, INTEGER);
+    KeyGenerator generator(workload, keys);
+    printf("%s: %llu keys, %llu distinct, %u frames\n", workload.c_str(),
+           (unsigned long long)keys,
+           (unsigned long long)generator.distinctKeys(), frames);
+
+    PoolCounter pool(bufMgr);
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < keys; i++) {
+      const int key = generator.key(i);
+      const RecordId rid = {(PageId)(i / 100 + 1), (SlotId)(i % 100 + 1)};
+      index.insertEntry(&key, rid);
+    }
+    const double insertNanos = nanosSince(start);
+    const SplitStats splits = index.splitStats();
+    printf("  insert   %12.0f keys/s\n", keys / (insertNanos / 1e9));
+    printf("  splits   %llu leaves (%.1f%% of insert time, %.2f us each), "
+           "%llu internal (%.1f%%, %.2f us each)\n",
+           (unsigned long long)splits.leafSplits,
+           100 * splits.leafSplitNanos / insertNanos,
+           splits.leafSplits ? splits.leafSplitNanos / 1000.0 / splits.leafSplits : 0,
+           (unsigned long long)splits.nonLeafSplits,
+           100 * splits.nonLeafSplitNanos / insertNanos,
+           splits.nonLeafSplits
+               ? splits.nonLeafSplitNanos / 1000.0 / splits.nonLeafSplits
+               : 0);
+    pool.print("insert", keys);
+
+    const IndexShape shape = index.shape();
+    printf("  tree     height %d, %zu leaves %.1f%% full, %zu internal nodes\n",
+           shape.height, shape.leaves, 100 * shape.leafFill, shape.nonLeaves);
+    pool.skip();
+
+    // point lookups of keys inserted
+    std::vector<double> nanos;
+    nanos.reserve(queries);
+    std::vector<RecordId> rids;
+    unsigned seed = 7;
+    const std::uint64_t domain = generator.distinctKeys();
+    for (std::uint64_t q = 0; q < queries; q++) {
+      const int key = (int)(((std::uint64_t)rand_r(&seed) << 16 ^ rand_r(&seed)) % domain);
+      rids.clear();
+      start = std::chrono::steady_clock::now();
+      index.lookup(&key, rids);
+      nanos.push_back(nanosSince(start));
+    }
+    printPercentiles("lookup", nanos);
+    pool.print("lookup", queries);
+
+    // scans of scanWidth consecutive keys
+    nanos.clear();
+    RecordId batch[256];
+    for (std::uint64_t q = 0; q < queries; q++) {
+      const int low = (int)(((std::uint64_t)rand_r(&seed) << 16 ^ rand_r(&seed)) % domain);
+      const int high = low + scanWidth;
+      start = std::chrono::steady_clock::now();
+      try {
+        BTreeScan scan = index.openScan(&low, GTE, &high, LT);
+        while (scan.nextBatch(batch, 256) > 0) {
+        }
+      } catch (NoSuchKeyFoundException &) {
+      }
+      nanos.push_back(nanosSince(start));
+    }
+    printPercentiles("scan", nanos);
+    pool.print("scan", queries);
+
+    // the same scans, with the keys of the entries
+    nanos.clear();
+    int keyBatch[256];
+    for (std::uint64_t q = 0; q < queries; q++) {
+      const int low = (int)(((std::uint64_t)rand_r(&seed) << 16 ^ rand_r(&seed)) % domain);
+      const int high = low + scanWidth;
+      start = std::chrono::steady_clock::now();
+      try {
+        BTreeScan scan = index.openScan(&low, GTE, &high, LT);
+        while (scan.nextEntries(keyBatch, batch, 256) > 0) {
+        }
+      } catch (NoSuchKeyFoundException &) {
+      }
+      nanos.push_back(nanosSince(start));
+    }
+    printPercentiles("keys", nanos);
+    pool.print("keys", queries);
+  }
+  File::remove(indexName);
+  File::remove(RELATION);
+}
+
+int main(int argc, char **argv) {
+  const std::uint64_t keys = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+  const std::string workload = argc > 2 ? argv[2] : "all";
+  const std::uint32_t frames = argc > 3 ? atoi(argv[3]) : 4096;
+  const std::uint64_t queries = argc > 4 ? strtoull(argv[4], NULL, 10) : 100000;
+  const int scanWidth = argc > 5 ? atoi(argv[5]) : 100;
+  if (keys == 0 || keys > (std::uint64_t)INT32_MAX + 1) {
+    fprintf(stderr, "keys must be between 1 and 2^31\n");
+    return 1;
+  }
+  for (const char *name : WORKLOADS)
+    if (workload == "all" || workload == name)
+      run(name, keys, frames, queries, scanWidth);
+  return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "bloomFilter.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * First word of a saved filter.
+ */
+static const std::uint64_t BLOOM_MAGIC = 0x314d4c4247444142ULL;  // "BADGBLM1"
+
+BloomFilter::BloomFilter(std::size_t keys)
+    : numKeys(keys),
+      numWords((keys * BLOOM_BITS_PER_KEY + 63) / 64 + 1),
+      words(new std::atomic<std::uint64_t>[numWords]) {
+  for (std::size_t w = 0; w < numWords; w++)
+    words[w].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * The probes of a hash are h, h + d, h + 2d, ... for a step d taken from the
+ * other bits of the hash.
+ */
+static std::uint64_t step(std::uint64_t hash) {
+  return ((hash >> 29) | (hash << 35)) | 1;
+}
+
+void BloomFilter::add(std::uint64_t hash) {
+  const std::uint64_t bits = numWords * 64, d = step(hash);
+  for (int i = 0; i < BLOOM_PROBES; i++, hash += d) {
+    std::uint64_t bit = hash % bits;
+    words[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_release);
+  }
+  numAdded.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool BloomFilter::mayContain(std::uint64_t hash) const {
+  const std::uint64_t bits = numWords * 64, d = step(hash);
+  for (int i = 0; i < BLOOM_PROBES; i++, hash += d) {
+    std::uint64_t bit = hash % bits;
+    if (!(words[bit / 64].load(std::memory_order_acquire) &
+          (1ULL << (bit % 64))))
+      return false;
+  }
+  return true;
+}
+
+std::uint64_t BloomFilter::hash(const void *bytes, std::size_t length) {
+  // FNV-1a, then the finalizer of MurmurHash3 to spread the bits
+  const unsigned char *p = (const unsigned char *)bytes;
+  std::uint64_t h = 0xcbf29ce484222325ULL;
+  for (std::size_t i = 0; i < length; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+bool BloomFilter::save(const std::string &name) const {
+  std::vector<std::uint64_t> out;
+  out.push_back(BLOOM_MAGIC);
+  out.push_back(numKeys);
+  out.push_back(added());
+  out.push_back(numWords);
+  for (std::size_t w = 0; w < numWords; w++)
+    out.push_back(words[w].load(std::memory_order_relaxed));
+  out.push_back(hash(out.data(), out.size() * sizeof(std::uint64_t)));
+
+  // written in full under another name first, so that a crash does not
+  // leave half a filter behind
+  const std::string temp = name + ".tmp";
+  std::FILE *file = std::fopen(temp.c_str(), "wb");
+  if (file == NULL) return false;
+  bool written = std::fwrite(out.data(), sizeof(std::uint64_t), out.size(),
+                             file) == out.size();
+  written = std::fclose(file) == 0 && written;
+  if (!written || std::rename(temp.c_str(), name.c_str()) != 0) {
+    std::remove(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<BloomFilter> BloomFilter::load(const std::string &name) {
+  std::unique_ptr<BloomFilter> filter;
+  std::FILE *file = std::fopen(name.c_str(), "rb");
+  if (file == NULL) return filter;
+
+  // the header must agree with the length of the file before it is trusted
+  std::uint64_t header[4];
+  long length = -1;
+  if (std::fread(header, sizeof(header), 1, file) == 1 &&
+      std::fseek(file, 0, SEEK_END) == 0)
+    length = std::ftell(file);
+  const long words = length / (long)sizeof(std::uint64_t) - 5;
+  bool sound = words > 0 && header[0] == BLOOM_MAGIC &&
+               header[3] == (std::uint64_t)words && header[1] < header[3] * 64 &&
+               (header[1] * BLOOM_BITS_PER_KEY + 63) / 64 + 1 == header[3];
+
+  std::vector<std::uint64_t> in;
+  if (sound) {
+    in.resize(header[3] + 5);
+    sound = std::fseek(file, 0, SEEK_SET) == 0 &&
+            std::fread(in.data(), sizeof(std::uint64_t), in.size(), file) ==
+                in.size() &&
+            in.back() == hash(in.data(),
+                              (in.size() - 1) * sizeof(std::uint64_t));
+  }
+  std::fclose(file);
+  if (!sound) return filter;
+
+  filter.reset(new BloomFilter(header[1]));
+  for (std::size_t w = 0; w < filter->numWords; w++)
+    filter->words[w].store(in[4 + w], std::memory_order_relaxed);
+  filter->numAdded.store(header[2], std::memory_order_relaxed);
+  return filter;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,89 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace badgerdb {
+
+/**
+ * @brief Number of bits of a Bloom filter per key it is sized for, which
+ * leaves about 1% of the keys not added passing it.
+ */
+const int BLOOM_BITS_PER_KEY = 10;
+
+/**
+ * @brief Number of bits of a Bloom filter each key sets.
+ */
+const int BLOOM_PROBES = 7;
+
+/**
+ * @brief A Bloom filter of hashes of keys, which any number of threads may
+ * add to and probe at once. Hashes are never removed, so keys deleted from
+ * the index go on passing the filter, as do more of the keys that were never
+ * added once more hashes are added than the filter was sized for.
+ */
+class BloomFilter {
+ public:
+  /**
+   * @param keys the number of keys to size the filter for
+   */
+  explicit BloomFilter(std::size_t keys);
+
+  /**
+   * Adds a hash, so that mayContain() is true for it from then on.
+   */
+  void add(std::uint64_t hash);
+
+  /**
+   * @return false if the hash was certainly never added
+   */
+  bool mayContain(std::uint64_t hash) const;
+
+  /**
+   * @return the number of hashes added
+   */
+  std::size_t added() const { return numAdded.load(std::memory_order_relaxed); }
+
+  /**
+   * @return the number of keys the filter was sized for
+   */
+  std::size_t capacity() const { return numKeys; }
+
+  /**
+   * Writes the filter to the file with the given name, replacing it.
+   *
+   * @return false if the file could not be written
+   */
+  bool save(const std::string &name) const;
+
+  /**
+   * Reads a filter written by save().
+   *
+   * @return the filter, or NULL if there is no such file or it is damaged
+   */
+  static std::unique_ptr<BloomFilter> load(const std::string &name);
+
+  /**
+   * @return a hash of the given bytes
+   */
+  static std::uint64_t hash(const void *bytes, std::size_t length);
+
+ private:
+  std::size_t numKeys;
+  std::size_t numWords;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> words;
+  std::atomic<std::size_t> numAdded{};
+};
+
+}  // namespace badgerdb
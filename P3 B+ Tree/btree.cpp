@@ -8,547 +8,2985 @@
 
 #include "btree.h"
 #include <algorithm>
-#include "filescan.h"
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include "keySearch.h"
+#include "page_iterator.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/invalid_page_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
-
+#ifdef BADGERDB_TRACING
+#include "trace.h"
+#else
+// builds without tracing need not have the buffer manager's trace.h
+#define BADGERDB_TRACE(event, object, pageNo) ((void)0)
+#define BADGERDB_TRACE_SPAN(event, object, pageNo) ((void)0)
+#define BADGERDB_TRACE_NAME(object, objectName) ((void)0)
+#endif
 
 using namespace std;
 
 namespace badgerdb {
 
 /**
- * Allocation helper method
+ * Orders the merge heap of SortedKeyRids so that the smallest pair is on top.
+ */
+template <class Key>
+static bool laterPair(const pair<KeyRid<Key>, size_t> &a,
+                      const pair<KeyRid<Key>, size_t> &b) {
+  return b.first < a.first;
+}
+
+template <class Key>
+SortedKeyRids<Key>::SortedKeyRids(size_t sortMemory)
+    : capacity(max<size_t>(1, sortMemory / sizeof(KeyRid<Key>))) {}
+
+template <class Key>
+SortedKeyRids<Key>::~SortedKeyRids() {
+  for (FILE *run : runs) fclose(run);
+}
+
+template <class Key>
+void SortedKeyRids<Key>::add(const Key &key, RecordId rid) {
+  if (pairs.size() == capacity) spill();
+  pairs.push_back(KeyRid<Key>{key, rid});
+  total++;
+}
+
+template <class Key>
+void SortedKeyRids<Key>::spill() {
+  sort(pairs.begin(), pairs.end());
+
+  // tmpfile() removes the file once it is closed
+  FILE *run = tmpfile();
+  if (run == NULL) throw runtime_error("bulk load: cannot create a run file");
+  runs.push_back(run);
+  if (fwrite(pairs.data(), sizeof(KeyRid<Key>), pairs.size(), run) !=
+      pairs.size())
+    throw runtime_error("bulk load: cannot write a run file");
+  pairs.clear();
+}
+
+template <class Key>
+void SortedKeyRids<Key>::finish() {
+  if (runs.empty()) {
+    sort(pairs.begin(), pairs.end());
+    return;
+  }
+  if (!pairs.empty()) spill();
+  vector<KeyRid<Key>>().swap(pairs);
+
+  // start the merge with the first pair of every run
+  for (size_t run = 0; run < runs.size(); run++) {
+    rewind(runs[run]);
+    pull(run);
+  }
+}
+
+template <class Key>
+void SortedKeyRids<Key>::merge(vector<unique_ptr<SortedKeyRids>> &sorted,
+                               unsigned threads) {
+  parts.swap(sorted);
+  sorted.clear();
+  bool inMemory = true;
+  for (auto &part : parts) {
+    total += part->total;
+    inMemory = inMemory && part->runs.empty();
+  }
+  if (inMemory) {
+    mergeInMemory(max(1u, threads));
+    return;
+  }
+
+  // the parts go through the merge heap as runs would
+  for (size_t part = 0; part < parts.size(); part++) pull(part);
+}
+
+template <class Key>
+void SortedKeyRids<Key>::mergeInMemory(unsigned threads) {
+  if (total == 0) {
+    parts.clear();
+    return;
+  }
+
+  // regular sampling: every part gives evenly spaced pairs, and evenly spaced
+  // samples split the pairs into one range a thread, so that no range has
+  // much more than twice its share of the pairs
+  vector<KeyRid<Key>> samples;
+  for (auto &part : parts)
+    for (unsigned s = 0; s < threads && !part->pairs.empty(); s++)
+      samples.push_back(part->pairs[s * part->pairs.size() / threads]);
+  sort(samples.begin(), samples.end());
+
+  // bounds[r][p] is where range r starts in part p, and also where in the
+  // merged pairs the range starts when summed over the parts
+  vector<vector<size_t>> bounds(threads + 1, vector<size_t>(parts.size()));
+  for (unsigned r = 1; r <= threads; r++) {
+    for (size_t p = 0; p < parts.size(); p++) {
+      const vector<KeyRid<Key>> &in = parts[p]->pairs;
+      bounds[r][p] = r == threads
+                         ? in.size()
+                         : lower_bound(in.begin(), in.end(),
+                                       samples[r * samples.size() / threads]) -
+                               in.begin();
+    }
+  }
+
+  pairs.resize(total);
+  auto mergeRange = [&](unsigned r) {
+    size_t out = 0;
+    vector<size_t> at = bounds[r];
+    vector<pair<KeyRid<Key>, size_t>> front;
+    for (size_t p = 0; p < parts.size(); p++) {
+      out += at[p];
+      if (at[p] < bounds[r + 1][p])
+        front.push_back(make_pair(parts[p]->pairs[at[p]], p));
+    }
+    make_heap(front.begin(), front.end(), laterPair<Key>);
+    while (!front.empty()) {
+      pop_heap(front.begin(), front.end(), laterPair<Key>);
+      pairs[out++] = front.back().first;
+      size_t p = front.back().second;
+      front.pop_back();
+      if (++at[p] < bounds[r + 1][p]) {
+        front.push_back(make_pair(parts[p]->pairs[at[p]], p));
+        push_heap(front.begin(), front.end(), laterPair<Key>);
+      }
+    }
+  };
+  vector<thread> mergers;
+  for (unsigned r = 1; r < threads; r++) mergers.emplace_back(mergeRange, r);
+  mergeRange(0);
+  for (thread &merger : mergers) merger.join();
+  parts.clear();
+}
+
+template <class Key>
+void SortedKeyRids<Key>::pull(size_t run) {
+  KeyRid<Key> entry;
+  if (!parts.empty()) {
+    if (parts[run]->next(entry)) {
+      heap.push_back(make_pair(entry, run));
+      push_heap(heap.begin(), heap.end(), laterPair<Key>);
+    }
+    return;
+  }
+  if (fread(&entry, sizeof(KeyRid<Key>), 1, runs[run]) != 1) {
+    if (ferror(runs[run])) throw runtime_error("bulk load: cannot read a run file");
+    return;
+  }
+  heap.push_back(make_pair(entry, run));
+  push_heap(heap.begin(), heap.end(), laterPair<Key>);
+}
+
+template <class Key>
+bool SortedKeyRids<Key>::next(KeyRid<Key> &out) {
+  if (runs.empty() && parts.empty()) {
+    if (nextPair == pairs.size()) return false;
+    out = pairs[nextPair++];
+    return true;
+  }
+  if (heap.empty()) return false;
+
+  pop_heap(heap.begin(), heap.end(), laterPair<Key>);
+  out = heap.back().first;
+  size_t run = heap.back().second;
+  heap.pop_back();
+  pull(run);
+  return true;
+}
+
+template class SortedKeyRids<int>;
+template class SortedKeyRids<double>;
+template class SortedKeyRids<StringKey>;
+template class SortedKeyRids<IncludedKey<int>>;
+template class SortedKeyRids<IncludedKey<double>>;
+template class SortedKeyRids<IncludedKey<StringKey>>;
+
+/**
+ * Latches
+ *
+ * The version that follows the page header in every node is odd while a
+ * thread holds the latch of the node. Readers wait for it to be even, read the
+ * node, then validate that the version has not changed; writers latch a node
+ * only if its version is still the one they read, and never wait while they
+ * hold a latch, so that threads cannot deadlock. Reads of a node that is being
+ * modified may see it half done: they are only used once validated, and
+ * indexes read from nodes are kept within the node until then.
+ */
+static_assert(sizeof(atomic<uint64_t>) == sizeof(uint64_t),
+              "the version of a node must be a plain word");
+
+static_assert(offsetof(non_leaf_node_int, version) == sizeof(PageHeader) &&
+                  offsetof(leaf_node_int, version) == sizeof(PageHeader) &&
+                  offsetof(leaf_node_int_include, version) ==
+                      sizeof(PageHeader) &&
+                  offsetof(leaf_node_int_packed, version) ==
+                      sizeof(PageHeader) &&
+                  offsetof(non_leaf_node_string, version) ==
+                      sizeof(PageHeader) &&
+                  offsetof(free_node, version) == sizeof(PageHeader),
+              "the version of a node must follow the page header");
+
+static atomic<uint64_t> &versionOf(Page *page) {
+  return *reinterpret_cast<atomic<uint64_t> *>(reinterpret_cast<char *>(page) +
+                                               sizeof(PageHeader));
+}
+
+/**
+ * Waits until the node is not latched and returns its version.
+ */
+static uint64_t readLatch(Page *page) {
+  uint64_t version;
+  for (int spins = 0;
+       (version = versionOf(page).load(memory_order_acquire)) & 1; spins++)
+    if (spins >= 64) this_thread::yield();
+  return version;
+}
+
+/**
+ * Checks that the node has not changed since its version was read, and so
+ * that what was read from it since is consistent.
+ */
+static bool validate(Page *page, uint64_t version) {
+  atomic_thread_fence(memory_order_acquire);
+  return versionOf(page).load(memory_order_relaxed) == version;
+}
+
+/**
+ * Latches the node if it has not changed since its version was read.
+ */
+static bool upgradeLatch(Page *page, uint64_t version) {
+  if (!versionOf(page).compare_exchange_strong(version, version + 1,
+                                               memory_order_acquire))
+    return false;
+  // no reader may see a modification with the old version
+  atomic_thread_fence(memory_order_release);
+  return true;
+}
+
+static void unlatch(Page *page) {
+  versionOf(page).fetch_add(1, memory_order_release);
+}
+
+/**
+ * Key types
+ *
+ * Each key type T gives the Key, the Leaf and NonLeaf node structures and
+ * LEAF_SIZE, the most pairs a leaf holds, the SortKey the bulk load sorts,
+ * along with:
+ *   value(v)           the member of a KeyValue holding a Key
+ *   fromBytes(p)       the key at p, in a search parameter or a record
+ *   sortKey(p,q,len)   the SortKey of the key at p of a record, and its
+ *                      INCLUDE column of len bytes at q
+ *   lowerBound(a,n,k)  the index of the first of n sorted keys not below k
+ *   upperBound(a,n,k)  the index of the first of n sorted keys above k
+ *   separator(l,r)     a key above l and not above r, to tell apart a node
+ *                      ending with l from its right sibling starting with r
+ *   hash(k)            a hash of k for the Bloom filter, the same for equal
+ *                      keys
+ * and the operations on non-leaf nodes, of which child and childIndex may
+ * read a node that is being modified:
+ *   children(n)        the number of children
+ *   child(n,i)         the page number of the i-th child
+ *   key(n,i)           the separator between the i-th child and the next
+ *   childIndex(n,k,right)  the index of the child to descend to for key k,
+ *                      the right one of two if k equals their separator
+ *   fits(n,i,k)        whether separator k fits in after the i-th child
+ *   insertChild(n,i,k,p)  inserts child p after the i-th child, with the
+ *                      separator k between them
+ *   removeChild(n,i)   removes the i-th child, i > 0, and the separator on
+ *                      its left
+ *   splitKey(n)        the separator split(n,...) moves up
+ *   split(n,m,mid)     moves the upper half of node n to the empty node m,
+ *                      returning the separator of the two in mid
+ *   build(n,c,len)     fills n with len children, each with the separator
+ *                      from the child on its left (that of c[0] is unused)
+ *   pack(c,fill,sizes) splits the children of a level into nodes filled up
+ *                      to the fill factor, appending their sizes
+ * and the operations on leaves, of which those that only read may read a leaf
+ * that is being modified:
+ *   leafKey(l,i)       the key of the i-th pair
+ *   leafRid(l,i)       the record id of the i-th pair
+ *   leafLowerBound(l,n,k)  the index of the first of n pairs not below k
+ *   leafUpperBound(l,n,k)  the index of the first of n pairs above k
+ *   leafRids(l,i,n,out)  copies the record ids of n pairs from the i-th on
+ *   leafKeys(l,i,n,out)  copies the keys of n pairs from the i-th on
+ *   leafIncludes(l,i,n,len,out)  copies len bytes of the INCLUDE values of n
+ *                      pairs from the i-th on, NULs for leaves without them
+ *   leafFits(l,k,r)    whether the pair (k,r) fits in
+ *   leafFitsRid(l,r)   whether a pair fits in with its record id changed to r
+ *   leafMergeable(l,r) whether to merge leaf r into its left sibling l: they
+ *                      fit into one, and one of them is under half full
+ *   leafInsert(l,i,k,r,v)  inserts the pair (k,r), with INCLUDE value v if
+ *                      the leaf keeps one, before the i-th
+ *   leafRemove(l,i)    removes the i-th pair
+ *   leafSetRid(l,i,r)  changes the record id of the i-th pair to r
+ *   leafSplit(l,m,i)   moves the pairs from the i-th on to the empty leaf m
+ *   leafMerge(l,r)     appends the pairs of leaf r to l
+ *   LeafWriter(l,fill) fills the empty leaf l with pairs in order: add(k,r)
+ *                      appends a pair, k a SortKey, unless the leaf is filled
+ *                      up to the fill factor, finish() completes the leaf
+ * Callers link leaves to their siblings.
+ * Scans descend to the left of a key equal to a separator, so that they
+ * start at the first leaf that may hold it and move right from there, and
+ * inserts to its right, so that new entries go after those equal to them.
+ */
+
+/**
+ * Non-leaf operations for fixed size keys kept in plain arrays.
+ */
+template <class T, class K, class NodeT, int SIZE>
+struct ArrayKeys {
+  typedef K Key;
+  typedef NodeT NonLeaf;
+
+  static int children(const NonLeaf *node) {
+    return min(max(node->count, 1), SIZE + 1);
+  }
+
+  static PageId child(const NonLeaf *node, int i) {
+    return node->pageNoArray[min(i, SIZE)];
+  }
+
+  static Key key(const NonLeaf *node, int i) {
+    return node->keyArray[min(i, SIZE - 1)];
+  }
+
+  static int childIndex(const NonLeaf *node, const Key &key, bool right) {
+    int keys = min(max(node->count, 1), SIZE + 1) - 1;
+    return right ? T::upperBound(node->keyArray, keys, key)
+                 : T::lowerBound(node->keyArray, keys, key);
+  }
+
+  static Key separator(const Key &leftLast, const Key &rightFirst) {
+    return rightFirst;
+  }
+
+  static bool fits(const NonLeaf *node, int i, const Key &key) {
+    return node->count < SIZE + 1;
+  }
+
+  /**
+   * Inserts the given key-(page number) pair into the node at the given
+   * index.
+   */
+  static void insertChild(NonLeaf *n, int i, const Key &key, PageId pid) {
+    const size_t len = SIZE - i - 1;
+
+    // shift items for extra space
+    memmove(&n->keyArray[i + 1], &n->keyArray[i], len * sizeof(Key));
+    memmove(&n->pageNoArray[i + 2], &n->pageNoArray[i + 1],
+            len * sizeof(PageId));
+
+    // store the key and page number to the node
+    n->keyArray[i] = key;
+    n->pageNoArray[i + 1] = pid;
+    n->count++;
+  }
+
+  /**
+   * Removes the i-th child, and the key on its left, from the node.
+   */
+  static void removeChild(NonLeaf *n, int i) {
+    const size_t len = n->count - i - 1;
+
+    // shift items over the removed ones
+    memmove(&n->keyArray[i - 1], &n->keyArray[i], len * sizeof(Key));
+    memmove(&n->pageNoArray[i], &n->pageNoArray[i + 1],
+            len * sizeof(PageId));
+
+    n->count--;
+    n->keyArray[n->count - 1] = Key();
+    n->pageNoArray[n->count] = 0;
+  }
+
+  static Key splitKey(const NonLeaf *node) {
+    return node->keyArray[(node->count - 1) / 2];
+  }
+
+  /**
+   * Splits the node in the middle, the middle key moving up.
+   */
+  static void split(NonLeaf *curr, NonLeaf *next, Key &midVal) {
+    int i = (curr->count - 1) / 2;
+    midVal = curr->keyArray[i];
+    size_t len = SIZE - i;
+
+    // copy keys and values after the middle key to new node
+    memcpy(&next->keyArray, &curr->keyArray[i + 1], (len - 1) * sizeof(Key));
+    memcpy(&next->pageNoArray, &curr->pageNoArray[i + 1],
+           len * sizeof(PageId));
+
+    // remove elements from old node
+    memset(&curr->keyArray[i], 0, len * sizeof(Key));
+    memset(&curr->pageNoArray[i + 1], 0, len * sizeof(PageId));
+
+    next->count = curr->count - (i + 1);
+    curr->count = i + 1;
+  }
+
+  static void build(NonLeaf *node, const pair<Key, PageId> *children,
+                    size_t len) {
+    node->pageNoArray[0] = children[0].second;
+    for (size_t j = 1; j < len; j++) {
+      node->keyArray[j - 1] = children[j].first;
+      node->pageNoArray[j] = children[j].second;
+    }
+    node->count = len;
+  }
+
+  static void pack(const vector<pair<Key, PageId>> &children,
+                   float fillFactor, vector<size_t> &sizes) {
+    // at least two children per node, spread evenly
+    const size_t count = children.size();
+    const size_t perNode = max(2, (int)((SIZE + 1) * fillFactor));
+    const size_t nodes = (count + perNode - 1) / perNode;
+    for (size_t i = 0; i < nodes; i++)
+      sizes.push_back(count / nodes + (i < count % nodes));
+  }
+};
+
+/**
+ * This is the helper method that returns the number of entries of a leaf
+ * that may be being modified, kept within the leaf.
+ */
+template <class T>
+static int entries(const typename T::Leaf *node) {
+  return min(max(node->count, 0), (int)T::LEAF_SIZE);
+}
+
+/**
+ * The INCLUDE values of a leaf, or NULL for a leaf that keeps none.
+ */
+template <class K, int SIZE>
+static IncludeValue *includesOf(leaf_node<K, SIZE> *node) {
+  return NULL;
+}
+
+template <class K, int SIZE>
+static const IncludeValue *includesOf(const leaf_node<K, SIZE> *node) {
+  return NULL;
+}
+
+template <class K, int SIZE>
+static IncludeValue *includesOf(leaf_node_include<K, SIZE> *node) {
+  return node->includeArray;
+}
+
+template <class K, int SIZE>
+static const IncludeValue *includesOf(const leaf_node_include<K, SIZE> *node) {
+  return node->includeArray;
+}
+
+/**
+ * Leaf operations for keys and record ids kept in plain arrays, and INCLUDE
+ * values for leaves that keep them.
+ */
+template <class T, class K, class LeafT>
+struct ArrayLeaves {
+  typedef LeafT Leaf;
+  typedef K SortKey;
+
+  static K sortKey(const char *key, const char *include, int length) {
+    return T::fromBytes(key);
+  }
+
+  static K leafKey(const Leaf *node, int i) { return node->keyArray[i]; }
+
+  static RecordId leafRid(const Leaf *node, int i) { return node->ridArray[i]; }
+
+  static int leafLowerBound(const Leaf *node, int count, const K &key) {
+    return T::lowerBound(node->keyArray, count, key);
+  }
+
+  static int leafUpperBound(const Leaf *node, int count, const K &key) {
+    return T::upperBound(node->keyArray, count, key);
+  }
+
+  static void leafRids(const Leaf *node, int first, int len, RecordId *out) {
+    memcpy(out, &node->ridArray[first], len * sizeof(RecordId));
+  }
+
+  static void leafKeys(const Leaf *node, int first, int len, K *out) {
+    memcpy(out, &node->keyArray[first], len * sizeof(K));
+  }
+
+  static void leafIncludes(const Leaf *node, int first, int len, int length,
+                           char *out) {
+    const IncludeValue *includes = includesOf(node);
+    for (int i = 0; i < len; i++, out += length) {
+      if (includes != NULL)
+        memcpy(out, includes[first + i].data, length);
+      else
+        memset(out, 0, length);
+    }
+  }
+
+  static bool leafFits(const Leaf *node, const K &key, RecordId rid) {
+    return entries<T>(node) < T::LEAF_SIZE;
+  }
+
+  static bool leafFitsRid(const Leaf *node, RecordId rid) { return true; }
+
+  static bool leafMergeable(const Leaf *left, const Leaf *right) {
+    int leftCount = entries<T>(left);
+    int rightCount = entries<T>(right);
+    return leftCount + rightCount <= T::LEAF_SIZE &&
+           min(leftCount, rightCount) < T::LEAF_SIZE / 2;
+  }
+
+  /**
+   * This is the helper method that inserts the given pair into the leaf node
+   * at the given insertion index.
+   *
+   * @param node a leaf node
+   * @param i  insertion index
+   * @param key  key of pair to be inserted
+   * @param rid the record ID of the pair to be inserted
+   * @param include the INCLUDE value of the pair, if the leaf keeps one
+   */
+  static void leafInsert(Leaf *node, int i, const K &key, RecordId rid,
+                         const IncludeValue &include) {
+    const size_t len = T::LEAF_SIZE - i - 1;
+
+    // shift items for the extra space
+    memmove(&node->keyArray[i + 1], &node->keyArray[i], len * sizeof(K));
+    memmove(&node->ridArray[i + 1], &node->ridArray[i],
+            len * sizeof(RecordId));
+
+    // save the key and record id to the leaf node
+    node->keyArray[i] = key;
+    node->ridArray[i] = rid;
+    if (IncludeValue *includes = includesOf(node)) {
+      memmove(&includes[i + 1], &includes[i], len * sizeof(IncludeValue));
+      includes[i] = include;
+    }
+    node->count++;
+  }
+
+  /**
+   * This is the helper method that removes the pair at the given index from
+   * the leaf node.
+   *
+   * @param node a leaf node
+   * @param i  index of the pair
+   */
+  static void leafRemove(Leaf *node, int i) {
+    const size_t len = node->count - i - 1;
+
+    // shift items over the removed pair
+    memmove(&node->keyArray[i], &node->keyArray[i + 1], len * sizeof(K));
+    memmove(&node->ridArray[i], &node->ridArray[i + 1],
+            len * sizeof(RecordId));
+
+    node->count--;
+    node->keyArray[node->count] = K();
+    node->ridArray[node->count] = RecordId();
+    if (IncludeValue *includes = includesOf(node)) {
+      memmove(&includes[i], &includes[i + 1], len * sizeof(IncludeValue));
+      includes[node->count] = IncludeValue();
+    }
+  }
+
+  static void leafSetRid(Leaf *node, int i, RecordId rid) {
+    node->ridArray[i] = rid;
+  }
+
+  /**
+   * This is the helper method to splits a leaf node into two.
+   *
+   * @param node a pointer to the original node
+   * @param newNode a pointer to the new node
+   * @param index the index where the split occurs.
+   */
+  static void leafSplit(Leaf *node, Leaf *newNode, int index) {
+    const size_t len = T::LEAF_SIZE - index;
+
+    // copy elements to new node
+    memcpy(&newNode->keyArray, &node->keyArray[index], len * sizeof(K));
+    memcpy(&newNode->ridArray, &node->ridArray[index],
+           len * sizeof(RecordId));
+
+    // remove elements from old
+    memset(&node->keyArray[index], 0, len * sizeof(K));
+    memset(&node->ridArray[index], 0, len * sizeof(RecordId));
+
+    if (IncludeValue *includes = includesOf(node)) {
+      memcpy(includesOf(newNode), &includes[index],
+             len * sizeof(IncludeValue));
+      memset(&includes[index], 0, len * sizeof(IncludeValue));
+    }
+
+    newNode->count = node->count - index;
+    node->count = index;
+  }
+
+  static void leafMerge(Leaf *left, const Leaf *right) {
+    memcpy(&left->keyArray[left->count], right->keyArray,
+           right->count * sizeof(K));
+    memcpy(&left->ridArray[left->count], right->ridArray,
+           right->count * sizeof(RecordId));
+    if (IncludeValue *includes = includesOf(left))
+      memcpy(&includes[left->count], includesOf(right),
+             right->count * sizeof(IncludeValue));
+    left->count += right->count;
+  }
+
+  /**
+   * Writes pairs straight into the arrays; the bulk load spreads them over
+   * the leaves by count.
+   */
+  class LeafWriter {
+   public:
+    LeafWriter(Leaf *node, float fillFactor) : node(node) {}
+
+    bool add(const K &key, RecordId rid) {
+      if (node->count == T::LEAF_SIZE) return false;
+      node->keyArray[node->count] = key;
+      node->ridArray[node->count] = rid;
+      node->count++;
+      return true;
+    }
+
+    bool add(const IncludedKey<K> &key, RecordId rid) {
+      if (!add(key.key, rid)) return false;
+      includesOf(node)[node->count - 1] = key.include;
+      return true;
+    }
+
+    void finish() {}
+
+   private:
+    Leaf *node;
+  };
+};
+
+struct IntKeys : ArrayKeys<IntKeys, int, non_leaf_node_int,
+                           INTARRAYNONLEAFSIZE>,
+                 ArrayLeaves<IntKeys, int, leaf_node_int> {
+  static const int LEAF_SIZE = INTARRAYLEAFSIZE;
+
+  static int &value(KeyValue &v) { return v.intValue; }
+
+  static int fromBytes(const char *bytes) {
+    int key;
+    memcpy(&key, bytes, sizeof(int));
+    return key;
+  }
+
+  static int lowerBound(const int *array, int length, int key) {
+    return lowerBoundInt(array, length, key);
+  }
+
+  static int upperBound(const int *array, int length, int key) {
+    return key == INT_MAX ? length : lowerBoundInt(array, length, key + 1);
+  }
+
+  static uint64_t hash(int key) { return BloomFilter::hash(&key, sizeof(int)); }
+};
+
+struct DoubleKeys : ArrayKeys<DoubleKeys, double, non_leaf_node_double,
+                              DOUBLEARRAYNONLEAFSIZE>,
+                    ArrayLeaves<DoubleKeys, double, leaf_node_double> {
+  static const int LEAF_SIZE = DOUBLEARRAYLEAFSIZE;
+
+  static double &value(KeyValue &v) { return v.doubleValue; }
+
+  static double fromBytes(const char *bytes) {
+    double key;
+    memcpy(&key, bytes, sizeof(double));
+    return key;
+  }
+
+  static int lowerBound(const double *array, int length, double key) {
+    return lower_bound(array, array + length, key) - array;
+  }
+
+  static int upperBound(const double *array, int length, double key) {
+    return upper_bound(array, array + length, key) - array;
+  }
+
+  static uint64_t hash(double key) {
+    // -0.0 equals 0.0, with other bytes
+    if (key == 0) key = 0;
+    return BloomFilter::hash(&key, sizeof(double));
+  }
+};
+
+/**
+ * String keys: leaves hold whole keys, non-leaf nodes hold the separators
+ * without their common prefix, packed one after another (see
+ * non_leaf_node_string).
+ */
+struct StringKeys : ArrayLeaves<StringKeys, StringKey, leaf_node_string> {
+  typedef StringKey Key;
+  typedef non_leaf_node_string NonLeaf;
+  static const int LEAF_SIZE = STRINGARRAYLEAFSIZE;
+
+  /**
+   * Most children a node has room for, with keys of no bytes.
+   */
+  static const int MAX_CHILDREN =
+      (STRINGNONLEAFBYTES + sizeof(short)) / (sizeof(PageId) + sizeof(short));
+
+  static StringKey &value(KeyValue &v) { return v.stringValue; }
+
+  static StringKey fromBytes(const char *bytes) {
+    StringKey key{};
+    strncpy(key.data, bytes, STRINGSIZE);
+    return key;
+  }
+
+  static int lowerBound(const StringKey *array, int length,
+                        const StringKey &key) {
+    return lower_bound(array, array + length, key) - array;
+  }
+
+  static int upperBound(const StringKey *array, int length,
+                        const StringKey &key) {
+    return upper_bound(array, array + length, key) - array;
+  }
+
+  static uint64_t hash(const StringKey &key) {
+    return BloomFilter::hash(key.data, STRINGSIZE);
+  }
+
+  /**
+   * The shortest prefix of rightFirst above leftLast, padded with NULs.
+   */
+  static StringKey separator(const StringKey &leftLast,
+                             const StringKey &rightFirst) {
+    int length = 0;
+    while (length < STRINGSIZE && leftLast.data[length] == rightFirst.data[length])
+      length++;
+
+    StringKey sep{};
+    memcpy(sep.data, rightFirst.data, min(length + 1, STRINGSIZE));
+    return sep;
+  }
+
+  /**
+   * The length of the key without its NUL padding.
+   */
+  static int keyLength(const StringKey &key) {
+    int length = STRINGSIZE;
+    while (length > 0 && key.data[length - 1] == 0) length--;
+    return length;
+  }
+
+  static int commonPrefix(const StringKey &a, const StringKey &b) {
+    int limit = min(keyLength(a), keyLength(b));
+    int length = 0;
+    while (length < limit && a.data[length] == b.data[length]) length++;
+    return length;
+  }
+
+  /**
+   * The number of children of the node, kept within the node.
+   */
+  static int children(const NonLeaf *node) {
+    return min(max(node->count, 1), MAX_CHILDREN);
+  }
+
+  static PageId child(const NonLeaf *node, int i) {
+    PageId pid;
+    memcpy(&pid, node->data + min(i, MAX_CHILDREN - 1) * sizeof(PageId),
+           sizeof(PageId));
+    return pid;
+  }
+
+  /**
+   * The offset of the key bytes within data.
+   */
+  static int keysOffset(const NonLeaf *node) {
+    int count = children(node);
+    return count * sizeof(PageId) + (count - 1) * sizeof(short);
+  }
+
+  /**
+   * The offset, among the key bytes, just past the suffix of the i-th key.
+   */
+  static int keyEnd(const NonLeaf *node, int i) {
+    unsigned short end;
+    memcpy(&end,
+           node->data + children(node) * sizeof(PageId) + i * sizeof(short),
+           sizeof(short));
+    return min<int>(end, STRINGNONLEAFBYTES - keysOffset(node));
+  }
+
+  static const char *keyBytes(const NonLeaf *node) {
+    return node->data + keysOffset(node);
+  }
+
+  static int prefixLength(const NonLeaf *node) {
+    return min<int>(max<int>(node->prefixLength, 0), STRINGSIZE);
+  }
+
+  /**
+   * Compares key, whose prefix is that of the node, with the i-th key.
+   */
+  static int compareKey(const NonLeaf *node, int i, const StringKey &key) {
+    int prefix = prefixLength(node);
+    int start = i == 0 ? 0 : keyEnd(node, i - 1);
+    int length = min(max(keyEnd(node, i) - start, 0), STRINGSIZE - prefix);
+    int c = memcmp(key.data + prefix, keyBytes(node) + start, length);
+    if (c != 0) return c;
+
+    // the stored key is padded with NULs
+    for (int j = prefix + length; j < STRINGSIZE; j++)
+      if (key.data[j] != 0) return 1;
+    return 0;
+  }
+
+  static StringKey key(const NonLeaf *node, int i) {
+    int prefix = prefixLength(node);
+    int start = i == 0 ? 0 : keyEnd(node, i - 1);
+    int length = min(max(keyEnd(node, i) - start, 0), STRINGSIZE - prefix);
+
+    StringKey key{};
+    memcpy(key.data, node->prefix, prefix);
+    memcpy(key.data + prefix, keyBytes(node) + start, length);
+    return key;
+  }
+
+  static int childIndex(const NonLeaf *node, const StringKey &key,
+                        bool right) {
+    int keys = children(node) - 1;
+    int c = memcmp(key.data, node->prefix, prefixLength(node));
+    if (c < 0) return 0;
+    if (c > 0) return keys;
+
+    // the first key not below key, or above it if right
+    int low = 0, high = keys;
+    while (low < high) {
+      int mid = (low + high) / 2;
+      int c = compareKey(node, mid, key);
+      if (c > 0 || (right && c == 0))
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    return low;
+  }
+
+  static void decode(const NonLeaf *node, vector<StringKey> &keys,
+                     vector<PageId> &children) {
+    for (int i = 0; i < node->count; i++) children.push_back(child(node, i));
+    for (int i = 0; i + 1 < node->count; i++) {
+      int start = i == 0 ? 0 : keyEnd(node, i - 1);
+      StringKey key{};
+      memcpy(key.data, node->prefix, node->prefixLength);
+      memcpy(key.data + node->prefixLength, keyBytes(node) + start,
+             keyEnd(node, i) - start);
+      keys.push_back(key);
+    }
+  }
+
+  /**
+   * The bytes count children with the given keys take, all but prefixLength
+   * bytes of each key stored.
+   */
+  static size_t encodedSize(int count, size_t keyBytes, int prefixLength) {
+    return count * sizeof(PageId) + (count - 1) * sizeof(short) + keyBytes -
+           (count - 1) * prefixLength;
+  }
+
+  /**
+   * The bytes count children with the given keys take, and the length of
+   * the prefix they share.
+   */
+  static size_t encodedSize(const StringKey *keys, int count,
+                            int &prefixLength) {
+    // the keys are sorted and so share the prefix of the first and last
+    prefixLength = count > 1 ? commonPrefix(keys[0], keys[count - 2]) : 0;
+    size_t bytes = 0;
+    for (int i = 0; i + 1 < count; i++) bytes += keyLength(keys[i]);
+    return encodedSize(count, bytes, prefixLength);
+  }
+
+  /**
+   * Writes count children and the count - 1 keys between them into the
+   * node, which they must fit.
+   */
+  static void encode(NonLeaf *node, const StringKey *keys,
+                     const PageId *children, int count) {
+    int prefixLength;
+    size_t size = encodedSize(keys, count, prefixLength);
+
+    node->count = count;
+    node->prefixLength = prefixLength;
+    node->keyBytes = size - count * sizeof(PageId) - (count - 1) * sizeof(short);
+    memset(node->prefix, 0, STRINGSIZE);
+    if (count > 1) memcpy(node->prefix, keys[0].data, prefixLength);
+    memset(node->data, 0, STRINGNONLEAFBYTES);
+
+    memcpy(node->data, children, count * sizeof(PageId));
+    char *ends = node->data + count * sizeof(PageId);
+    char *out = ends + (count - 1) * sizeof(short);
+    unsigned short end = 0;
+    for (int i = 0; i + 1 < count; i++) {
+      int length = keyLength(keys[i]) - prefixLength;
+      memcpy(out + end, keys[i].data + prefixLength, length);
+      end += length;
+      memcpy(ends + i * sizeof(short), &end, sizeof(short));
+    }
+  }
+
+  static bool fits(const NonLeaf *node, int i, const StringKey &key) {
+    vector<StringKey> keys;
+    vector<PageId> children;
+    decode(node, keys, children);
+    keys.insert(keys.begin() + i, key);
+
+    int prefixLength;
+    return encodedSize(keys.data(), keys.size() + 1, prefixLength) <=
+           (size_t)STRINGNONLEAFBYTES;
+  }
+
+  static void insertChild(NonLeaf *node, int i, const StringKey &key,
+                          PageId pid) {
+    vector<StringKey> keys;
+    vector<PageId> children;
+    decode(node, keys, children);
+
+    keys.insert(keys.begin() + i, key);
+    children.insert(children.begin() + i + 1, pid);
+    encode(node, keys.data(), children.data(), children.size());
+  }
+
+  static void removeChild(NonLeaf *node, int i) {
+    vector<StringKey> keys;
+    vector<PageId> children;
+    decode(node, keys, children);
+
+    // the keys left share at least the prefix, and so fit
+    keys.erase(keys.begin() + i - 1);
+    children.erase(children.begin() + i);
+    encode(node, keys.data(), children.data(), children.size());
+  }
+
+  /**
+   * The index of the key in the middle of the bytes the keys take, so that
+   * each half takes at most half of them and fits.
+   */
+  static size_t middle(const vector<StringKey> &keys) {
+    const int prefix = commonPrefix(keys.front(), keys.back());
+    const int perKey = sizeof(PageId) + sizeof(short) - prefix;
+    int total = 0, half = 0;
+    for (const StringKey &k : keys) total += keyLength(k) + perKey;
+    size_t mid = 0;
+    while (mid + 1 < keys.size() &&
+           half + keyLength(keys[mid]) + perKey <= total / 2)
+      half += keyLength(keys[mid++]) + perKey;
+    return max<size_t>(mid, 1);
+  }
+
+  static StringKey splitKey(const NonLeaf *node) {
+    vector<StringKey> keys;
+    vector<PageId> children;
+    decode(node, keys, children);
+    return keys[middle(keys)];
+  }
+
+  static void split(NonLeaf *curr, NonLeaf *next, StringKey &midVal) {
+    vector<StringKey> keys;
+    vector<PageId> children;
+    decode(curr, keys, children);
+
+    size_t mid = middle(keys);
+    midVal = keys[mid];
+    encode(curr, keys.data(), children.data(), mid + 1);
+    encode(next, keys.data() + mid + 1, children.data() + mid + 1,
+           children.size() - mid - 1);
+  }
+
+  static void build(NonLeaf *node, const pair<StringKey, PageId> *children,
+                    size_t len) {
+    vector<StringKey> keys;
+    vector<PageId> pages;
+    for (size_t j = 0; j < len; j++) {
+      if (j > 0) keys.push_back(children[j].first);
+      pages.push_back(children[j].second);
+    }
+    encode(node, keys.data(), pages.data(), len);
+  }
+
+  static void pack(const vector<pair<StringKey, PageId>> &children,
+                   float fillFactor, vector<size_t> &sizes) {
+    const size_t limit = STRINGNONLEAFBYTES * fillFactor;
+    size_t first = 0;
+    while (first < children.size()) {
+      // take children while their keys fit, and at least two
+      size_t len = 1, bytes = 0;
+      while (first + len < children.size()) {
+        const StringKey &key = children[first + len].first;
+        int prefix = commonPrefix(children[first + 1].first, key);
+        if (len >= 2 &&
+            encodedSize(len + 1, bytes + keyLength(key), prefix) > limit)
+          break;
+        bytes += keyLength(key);
+        len++;
+      }
+      sizes.push_back(len);
+      first += len;
+    }
+  }
+};
+
+const int StringKeys::MAX_CHILDREN;
+
+static_assert(sizeof(leaf_node_int_packed) <= Page::SIZE,
+              "a packed leaf must fit in a page");
+
+/**
+ * INTEGER keys in packed leaves (see leaf_node_int_packed), with the non-leaf
+ * nodes of IntKeys. A pair is read where it is stored; a change decodes all
+ * the pairs of the leaf and encodes them again, as a change to a non-leaf
+ * node of STRING keys does.
+ */
+struct PackedIntKeys : IntKeys {
+  typedef leaf_node_int_packed Leaf;
+  static const int LEAF_SIZE = INTPACKEDLEAFSIZE;
+
+  /**
+   * The distinct pages of record ids, in the order they are first added.
+   */
+  class PageTable {
+   public:
+    PageTable() { memset(slots, 0, sizeof(slots)); }
+
+    /**
+     * The index of the page, or -1 if it is not in the table.
+     */
+    int find(PageId page) const {
+      for (int h = hash(page);; h = (h + 1) % SLOTS) {
+        if (slots[h] == 0) return -1;
+        if (pages[slots[h] - 1] == page) return slots[h] - 1;
+      }
+    }
+
+    /**
+     * The index of the page, added if it is new, or -1 if the table is full.
+     */
+    int add(PageId page) {
+      int h = hash(page);
+      for (; slots[h] != 0; h = (h + 1) % SLOTS)
+        if (pages[slots[h] - 1] == page) return slots[h] - 1;
+      if (size == INTPACKEDLEAFPAGES) return -1;
+      pages[size] = page;
+      slots[h] = ++size;
+      return size - 1;
+    }
+
+    int size{};
+    PageId pages[INTPACKEDLEAFPAGES];
+
+   private:
+    // open addressing, in twice as many slots as pages: indexes plus one
+    static const int SLOTS = 512;
+    static int hash(PageId page) { return (page * 2654435761U) >> 23; }
+    short slots[SLOTS];
+  };
+
+  /**
+   * The number of bytes of the data of a leaf of the given shape.
+   */
+  static size_t encodedSize(int pages, int width, size_t count) {
+    return pages * sizeof(PageId) + count * (width + sizeof(SlotId) + 1);
+  }
+
+  /**
+   * The fewest bytes of 1, 2 or 4 that hold the given difference of keys.
+   */
+  static int widthFor(uint32_t range) {
+    return range <= 0xFF ? 1 : range <= 0xFFFF ? 2 : 4;
+  }
+
+  static int width(const Leaf *node) {
+    return node->keyWidth == 1 || node->keyWidth == 2 ? node->keyWidth : 4;
+  }
+
+  /**
+   * Reads a U at the given offset of the data of a leaf, kept within the data
+   * while the leaf may be being modified.
+   */
+  template <class U>
+  static U load(const Leaf *node, size_t offset) {
+    U value;
+    memcpy(&value, node->data + min(offset, sizeof(node->data) - sizeof(U)),
+           sizeof(U));
+    return value;
+  }
+
+  /**
+   * The difference of the i-th key from the smallest.
+   */
+  static uint32_t delta(const Leaf *node, int width, int i) {
+    size_t offset = node->pages * sizeof(PageId) + (size_t)i * width;
+    if (width == 1) return load<uint8_t>(node, offset);
+    if (width == 2) return load<uint16_t>(node, offset);
+    return load<uint32_t>(node, offset);
+  }
+
+  /**
+   * The index of the first of count keys whose difference from the smallest
+   * is not below target.
+   */
+  static int search(const Leaf *node, int count, uint64_t target) {
+    const int w = width(node);
+    int low = 0, high = count;
+    while (low < high) {
+      int mid = (low + high) / 2;
+      if (delta(node, w, mid) < target)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    return low;
+  }
+
+  /**
+   * The i-th record id, with the slot numbers of the count pairs at the
+   * given offset.
+   */
+  static RecordId readRid(const Leaf *node, size_t slots, int count, int i) {
+    RecordId rid;
+    rid.slot_number = load<SlotId>(node, slots + i * sizeof(SlotId));
+    uint8_t page = load<uint8_t>(node, slots + count * sizeof(SlotId) + i);
+    rid.page_number = load<PageId>(node, page * sizeof(PageId));
+    return rid;
+  }
+
+  static size_t slotsOffset(const Leaf *node, int count) {
+    return node->pages * sizeof(PageId) + (size_t)count * width(node);
+  }
+
+  static bool hasPage(const Leaf *node, PageId page) {
+    for (int p = 0; p < node->pages; p++)
+      if (load<PageId>(node, p * sizeof(PageId)) == page) return true;
+    return false;
+  }
+
+  static void store(char *&out, const void *value, size_t size) {
+    // the page index of an empty leaf has no data
+    if (size > 0) memcpy(out, value, size);
+    out += size;
+  }
+
+  static void decode(const Leaf *node, vector<int> &keys,
+                     vector<RecordId> &rids) {
+    for (int i = 0; i < node->count; i++) {
+      keys.push_back(leafKey(node, i));
+      rids.push_back(leafRid(node, i));
+    }
+  }
+
+  /**
+   * Writes count sorted pairs to the leaf, which must have room for them.
+   */
+  static void encode(Leaf *node, const int *keys, const RecordId *rids,
+                     size_t count) {
+    PageTable table;
+    vector<uint8_t> pageIndex(count);
+    for (size_t i = 0; i < count; i++)
+      pageIndex[i] = table.add(rids[i].page_number);
+
+    const uint32_t base = count > 0 ? keys[0] : 0;
+    const int w = widthFor(count > 0 ? (uint32_t)keys[count - 1] - base : 0);
+
+    memset(node->data, 0, sizeof(node->data));
+    char *out = node->data;
+    store(out, table.pages, table.size * sizeof(PageId));
+    for (size_t i = 0; i < count; i++) {
+      uint32_t d = (uint32_t)keys[i] - base;
+      uint8_t d8 = d;
+      uint16_t d16 = d;
+      store(out, w == 1 ? (void *)&d8 : w == 2 ? (void *)&d16 : (void *)&d, w);
+    }
+    for (size_t i = 0; i < count; i++)
+      store(out, &rids[i].slot_number, sizeof(SlotId));
+    store(out, pageIndex.data(), count);
+
+    node->base = base;
+    node->keyWidth = w;
+    node->pages = table.size;
+    node->count = count;
+  }
+
+  static int leafKey(const Leaf *node, int i) {
+    return (int)((uint32_t)node->base + delta(node, width(node), i));
+  }
+
+  static RecordId leafRid(const Leaf *node, int i) {
+    int count = entries<PackedIntKeys>(node);
+    return readRid(node, slotsOffset(node, count), count, i);
+  }
+
+  static int leafLowerBound(const Leaf *node, int count, int key) {
+    if (key <= node->base) return 0;
+    return search(node, count, (int64_t)key - node->base);
+  }
+
+  static int leafUpperBound(const Leaf *node, int count, int key) {
+    if (key < node->base) return 0;
+    return search(node, count, (int64_t)key - node->base + 1);
+  }
+
+  static void leafRids(const Leaf *node, int first, int len, RecordId *out) {
+    int count = entries<PackedIntKeys>(node);
+    size_t slots = slotsOffset(node, count);
+    for (int i = 0; i < len; i++) out[i] = readRid(node, slots, count, first + i);
+  }
+
+  static void leafKeys(const Leaf *node, int first, int len, int *out) {
+    int w = width(node);
+    for (int i = 0; i < len; i++)
+      out[i] = (int)((uint32_t)node->base + delta(node, w, first + i));
+  }
+
+  /**
+   * Packed leaves keep no INCLUDE values.
+   */
+  static void leafIncludes(const Leaf *node, int first, int len, int length,
+                           char *out) {
+    memset(out, 0, (size_t)len * length);
+  }
+
+  static bool leafFits(const Leaf *node, int key, RecordId rid) {
+    int count = entries<PackedIntKeys>(node);
+    if (count == LEAF_SIZE) return false;
+    int pages = node->pages;
+    if (!hasPage(node, rid.page_number)) {
+      if (pages == INTPACKEDLEAFPAGES) return false;
+      pages++;
+    }
+    if (count == 0) return true;
+    int64_t low = min<int64_t>(node->base, key);
+    int64_t high = max<int64_t>(leafKey(node, count - 1), key);
+    return encodedSize(pages, widthFor(high - low), count + 1) <=
+           (size_t)INTPACKEDLEAFBYTES;
+  }
+
+  static bool leafFitsRid(const Leaf *node, RecordId rid) {
+    if (hasPage(node, rid.page_number)) return true;
+    return node->pages < INTPACKEDLEAFPAGES &&
+           encodedSize(node->pages + 1, width(node),
+                       entries<PackedIntKeys>(node)) <=
+               (size_t)INTPACKEDLEAFBYTES;
+  }
+
+  static bool leafMergeable(const Leaf *left, const Leaf *right) {
+    int leftCount = entries<PackedIntKeys>(left);
+    int rightCount = entries<PackedIntKeys>(right);
+    if (leftCount + rightCount > LEAF_SIZE) return false;
+    size_t leftBytes = encodedSize(left->pages, width(left), leftCount);
+    size_t rightBytes = encodedSize(right->pages, width(right), rightCount);
+    if (min(leftBytes, rightBytes) >= (size_t)INTPACKEDLEAFBYTES / 2)
+      return false;
+    if (leftCount == 0 || rightCount == 0) return true;
+
+    PageTable table;
+    for (int p = 0; p < left->pages; p++)
+      if (table.add(load<PageId>(left, p * sizeof(PageId))) < 0) return false;
+    for (int p = 0; p < right->pages; p++)
+      if (table.add(load<PageId>(right, p * sizeof(PageId))) < 0) return false;
+    int64_t range = (int64_t)leafKey(right, rightCount - 1) - left->base;
+    return range >= 0 &&
+           encodedSize(table.size, widthFor(range), leftCount + rightCount) <=
+               (size_t)INTPACKEDLEAFBYTES;
+  }
+
+  static void leafInsert(Leaf *node, int i, int key, RecordId rid,
+                         const IncludeValue &include) {
+    vector<int> keys;
+    vector<RecordId> rids;
+    decode(node, keys, rids);
+    keys.insert(keys.begin() + i, key);
+    rids.insert(rids.begin() + i, rid);
+    encode(node, keys.data(), rids.data(), keys.size());
+  }
+
+  static void leafRemove(Leaf *node, int i) {
+    vector<int> keys;
+    vector<RecordId> rids;
+    decode(node, keys, rids);
+    keys.erase(keys.begin() + i);
+    rids.erase(rids.begin() + i);
+    encode(node, keys.data(), rids.data(), keys.size());
+  }
+
+  static void leafSetRid(Leaf *node, int i, RecordId rid) {
+    vector<int> keys;
+    vector<RecordId> rids;
+    decode(node, keys, rids);
+    rids[i] = rid;
+    encode(node, keys.data(), rids.data(), keys.size());
+  }
+
+  static void leafSplit(Leaf *node, Leaf *newNode, int index) {
+    vector<int> keys;
+    vector<RecordId> rids;
+    decode(node, keys, rids);
+    encode(newNode, keys.data() + index, rids.data() + index,
+           keys.size() - index);
+    encode(node, keys.data(), rids.data(), index);
+  }
+
+  static void leafMerge(Leaf *left, const Leaf *right) {
+    vector<int> keys;
+    vector<RecordId> rids;
+    decode(left, keys, rids);
+    decode(right, keys, rids);
+    encode(left, keys.data(), rids.data(), keys.size());
+  }
+
+  /**
+   * Gathers pairs while they encode within the fill factor of the leaf,
+   * whatever their number, and encodes them at the end.
+   */
+  class LeafWriter {
+   public:
+    LeafWriter(Leaf *node, float fillFactor)
+        : node(node), limit(INTPACKEDLEAFBYTES * fillFactor) {}
+
+    bool add(int key, RecordId rid) {
+      // at least one pair per leaf
+      if (!keys.empty()) {
+        int pages = table.size + (table.find(rid.page_number) < 0);
+        uint32_t range = (uint32_t)key - (uint32_t)keys[0];
+        if (keys.size() == (size_t)LEAF_SIZE || pages > INTPACKEDLEAFPAGES ||
+            encodedSize(pages, widthFor(range), keys.size() + 1) > limit)
+          return false;
+      }
+      table.add(rid.page_number);
+      keys.push_back(key);
+      rids.push_back(rid);
+      return true;
+    }
+
+    void finish() { encode(node, keys.data(), rids.data(), keys.size()); }
+
+   private:
+    Leaf *node;
+    size_t limit;
+    PageTable table;
+    vector<int> keys;
+    vector<RecordId> rids;
+  };
+};
+
+const int PackedIntKeys::PageTable::SLOTS;
+
+/**
+ * Keys of an index with an INCLUDE column: the keys and non-leaf nodes of
+ * Base, with leaves that keep the INCLUDE value of every pair next to it
+ * (see leaf_node_include). The bulk load sorts the keys with their INCLUDE
+ * values.
  */
+template <class Base, class LeafT, int SIZE>
+struct Included
+    : Base,
+      ArrayLeaves<Included<Base, LeafT, SIZE>, typename Base::Key, LeafT> {
+  typedef typename Base::Key Key;
+  typedef ArrayLeaves<Included, Key, LeafT> Leaves;
+  typedef LeafT Leaf;
+  typedef IncludedKey<Key> SortKey;
+  typedef typename Leaves::LeafWriter LeafWriter;
+  static const int LEAF_SIZE = SIZE;
+
+  static SortKey sortKey(const char *key, const char *include, int length) {
+    SortKey sorted{};
+    sorted.key = Base::fromBytes(key);
+    memcpy(sorted.include.data, include, length);
+    return sorted;
+  }
+
+  using Leaves::leafKey;
+  using Leaves::leafRid;
+  using Leaves::leafLowerBound;
+  using Leaves::leafUpperBound;
+  using Leaves::leafRids;
+  using Leaves::leafKeys;
+  using Leaves::leafIncludes;
+  using Leaves::leafFits;
+  using Leaves::leafFitsRid;
+  using Leaves::leafMergeable;
+  using Leaves::leafInsert;
+  using Leaves::leafRemove;
+  using Leaves::leafSetRid;
+  using Leaves::leafSplit;
+  using Leaves::leafMerge;
+};
+
+static_assert(sizeof(leaf_node_string_include) <= Page::SIZE &&
+                  sizeof(leaf_node_double_include) <= Page::SIZE &&
+                  sizeof(leaf_node_int_include) <= Page::SIZE,
+              "a leaf with an INCLUDE column must fit a page");
+
+typedef Included<IntKeys, leaf_node_int_include, INTINCLUDELEAFSIZE>
+    IncludedIntKeys;
+typedef Included<DoubleKeys, leaf_node_double_include, DOUBLEINCLUDELEAFSIZE>
+    IncludedDoubleKeys;
+typedef Included<StringKeys, leaf_node_string_include, STRINGINCLUDELEAFSIZE>
+    IncludedStringKeys;
 
 /**
- * Allocate a page in the buffer
+ * The data area of a page, after its header, where nodes and the meta info are
+ * laid out.
+ */
+static char *pageData(Page *page) {
+  return reinterpret_cast<char *>(page) + sizeof(PageHeader);
+}
+
+static_assert(sizeof(IndexMetaInfo) <= Page::DATA_SIZE,
+              "the meta info must fit the data area of a page");
+
+/**
+ * Allocate a zeroed page in the buffer for a node, taking the first freed node
+ * if there is one.
  *
  * @param newPageId the page number of the new node
- * @return a reference to the new internal node
+ * @param level the level of the node, -1 for a leaf
+ * @return the page of the new node
+ */
+Page *BTreeIndex::allocNode(PageId &newPageId, int level) {
+  Page *newPage = NULL;
+  {
+    lock_guard<mutex> guard(metaLatch);
+    if (indexMetaInfo.freePageNo != 0) {
+      newPageId = indexMetaInfo.freePageNo;
+      bufMgr->readPage(file, newPageId, newPage);
+      indexMetaInfo.freePageNo = ((free_node *)newPage)->nextFreePageNo;
+      storeMetaPage();
+    }
+  }
+
+  if (newPage == NULL) {
+    bufMgr->allocPage(file, newPageId, newPage);
+    memset(pageData(newPage), 0, Page::DATA_SIZE);
+  } else {
+    // the version goes on growing, so that no reader of the freed node can
+    // take it for the new one
+    versionOf(newPage).fetch_add(2, memory_order_relaxed);
+    memset(pageData(newPage) + sizeof(uint64_t), 0,
+           Page::DATA_SIZE - sizeof(uint64_t));
+  }
+  ((leaf_node_int *)newPage)->level = level;
+  return newPage;
+}
+
+/**
+ * Put a node that is no longer in the tree at the head of the freed nodes,
+ * with its latch held.
+ *
+ * @param pageNum the page number of the node
+ * @param page the page of the node
+ */
+void BTreeIndex::freeNode(PageId pageNum, Page *page) {
+  lock_guard<mutex> guard(metaLatch);
+  free_node *node = (free_node *)page;
+  node->level = FREENODELEVEL;
+  node->nextFreePageNo = indexMetaInfo.freePageNo;
+  indexMetaInfo.freePageNo = pageNum;
+  storeMetaPage();
+}
+
+/**
+ * This is the constructor of the btree. It checks if the specified index file exists.
+ * If the index file exists, the file is opened, if the index file does not exist, a new
+ * index file is created and bulk loaded from the relation.
+ *
+ * @param relationName The name of the relation on which to build the index.
+ * @param outIndexName The name of the index file.
+ * @param bufMgrIn The instance of the global buffer manager.
+ * @param attrByteOffset The byte offset of the attribute in the tuple on which
+ * to build the index.
+ * @param attrType The data type of the attribute we are indexing.
+ * @param fillFactor The fraction of the slots of each node the bulk load fills.
+ * @param sortMemory The number of bytes of pairs the bulk load sorts in memory.
+ * @param packLeaves Whether to store the pairs of INTEGER keys in packed
+ * leaves, unless the index file exists.
+ * @param useFilter Whether to keep a Bloom filter of the keys.
+ * @param buildThreads The number of threads the bulk load reads and sorts the
+ * pairs with, or 0 for one per core.
+ * @param includeByteOffset The byte offset of the INCLUDE column in the tuple.
+ * @param includeLength The number of bytes of the INCLUDE column, 0 for none.
+ */
+BTreeIndex::BTreeIndex(const string &relationName, string &outIndexName,
+                       BufMgr *bufMgrIn, const int attrByteOffset_,
+                       const Datatype attrType, const float fillFactor,
+                       const size_t sortMemory, const bool packLeaves,
+                       const bool useFilter, const unsigned buildThreads,
+                       const int includeByteOffset,
+                       const int includeLength) {
+  bufMgr = bufMgrIn;
+  attrByteOffset = attrByteOffset_;
+  attributeType = attrType;
+
+  ostringstream idx_str{};
+  idx_str << relationName << ',' << attrByteOffset;
+  outIndexName = idx_str.str();
+  filterName = outIndexName + ".bloom";
+  BADGERDB_TRACE_NAME(this, outIndexName);
+
+  if (includeLength < 0 || includeLength > INCLUDESIZE ||
+      (includeLength > 0 && includeByteOffset < 0))
+    throw BadIndexInfoException(outIndexName);
+
+  relationName.copy(indexMetaInfo.relationName, 20, 0);
+  indexMetaInfo.attrByteOffset = attrByteOffset;
+  indexMetaInfo.attrType = attrType;
+  indexMetaInfo.packedLeaves =
+      packLeaves && attrType == INTEGER && includeLength == 0;
+  indexMetaInfo.includeByteOffset = includeLength > 0 ? includeByteOffset : 0;
+  indexMetaInfo.includeLength = includeLength;
+
+  if (File::exists(outIndexName)) {
+    file = new BlobFile(outIndexName, false);
+    headerPageNum = file->getFirstPageNo();
+
+    Page *headerPage;
+    bufMgr->readPage(file, headerPageNum, headerPage);
+    IndexMetaInfo stored;
+    memcpy(&stored, pageData(headerPage), sizeof(IndexMetaInfo));
+    bufMgr->unPinPage(file, headerPageNum, false);
+
+    // the index must have been built over the same attribute
+    if (strncmp(stored.relationName, indexMetaInfo.relationName, 20) != 0 ||
+        stored.attrByteOffset != attrByteOffset ||
+        stored.attrType != attrType) {
+      bufMgr->flushFile(file);
+      delete file;
+      throw BadIndexInfoException(outIndexName);
+    }
+    indexMetaInfo.rootPageNo = stored.rootPageNo;
+    indexMetaInfo.freePageNo = stored.freePageNo;
+    indexMetaInfo.packedLeaves = stored.packedLeaves;
+    indexMetaInfo.includeByteOffset = stored.includeByteOffset;
+    indexMetaInfo.includeLength = stored.includeLength;
+    rootPageNum = stored.rootPageNo;
+
+    // the saved filter only holds the keys until the index changes, and is
+    // saved again when it is closed; one that took in many more keys than it
+    // was sized for is built again, larger
+    unique_ptr<BloomFilter> saved = BloomFilter::load(filterName);
+    remove(filterName.c_str());
+    if (useFilter) {
+      if (saved != NULL && saved->added() <= 2 * saved->capacity())
+        filter = move(saved);
+      else
+        buildFilter();
+    }
+    return;
+  }
+
+  file = new BlobFile(outIndexName, true);
+  remove(filterName.c_str());
+
+  // the meta page comes first, so that it is found again on open
+  Page *headerPage;
+  bufMgr->allocPage(file, headerPageNum, headerPage);
+  bufMgr->unPinPage(file, headerPageNum, true);
+
+  unsigned threads = buildThreads;
+  if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        bulkLoad<PackedIntKeys>(relationName, fillFactor, sortMemory, threads);
+      else if (indexMetaInfo.includeLength > 0)
+        bulkLoad<IncludedIntKeys>(relationName, fillFactor, sortMemory,
+                                  threads);
+      else
+        bulkLoad<IntKeys>(relationName, fillFactor, sortMemory, threads);
+      break;
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        bulkLoad<IncludedDoubleKeys>(relationName, fillFactor, sortMemory,
+                                     threads);
+      else
+        bulkLoad<DoubleKeys>(relationName, fillFactor, sortMemory, threads);
+      break;
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        bulkLoad<IncludedStringKeys>(relationName, fillFactor, sortMemory,
+                                     threads);
+      else
+        bulkLoad<StringKeys>(relationName, fillFactor, sortMemory, threads);
+      break;
+  }
+  rootPageNum = indexMetaInfo.rootPageNo;
+  writeMetaPage();
+  if (useFilter) buildFilter();
+}
+
+/**
+ * This is the helper method that writes indexMetaInfo, with the current
+ * root, to the meta page.
+ */
+void BTreeIndex::writeMetaPage() {
+  lock_guard<mutex> guard(metaLatch);
+  indexMetaInfo.rootPageNo = rootPageNum;
+  storeMetaPage();
+}
+
+/**
+ * This is the helper method that writes indexMetaInfo to the meta page, with
+ * metaLatch held.
+ */
+void BTreeIndex::storeMetaPage() {
+  Page *headerPage;
+  bufMgr->readPage(file, headerPageNum, headerPage);
+  memcpy(pageData(headerPage), &indexMetaInfo, sizeof(IndexMetaInfo));
+  bufMgr->unPinPage(file, headerPageNum, true);
+}
+
+/**
+ * This is the helper method that builds the tree bottom-up from the sorted
+ * pairs of the relation: it fills leaves left to right, then each level of
+ * internal nodes from the one below, and sets the root page.
+ *
+ * @param relationName the relation to scan
+ * @param fillFactor the fraction of the slots of each node to fill
+ * @param sortMemory the number of bytes of pairs to sort in memory
+ * @param threads the number of threads to read and sort the pairs with
+ */
+template <class T>
+void BTreeIndex::bulkLoad(const string &relationName, float fillFactor,
+                          size_t sortMemory, unsigned threads) {
+  typedef typename T::Key Key;
+  SortedKeyRids<typename T::SortKey> pairs(sortMemory);
+  if (threads > 1) {
+    readPairsParallel<T>(relationName, sortMemory, threads, pairs);
+  } else {
+    PageFile relation(relationName, false);
+    PageId pageNum = relation.getFirstPageNo();
+    while (pageNum != Page::INVALID_NUMBER) {
+      Page *page;
+      bufMgr->readPage(&relation, pageNum, page);
+      try {
+        addPagePairs<T>(page, pairs);
+      } catch (...) {
+        bufMgr->unPinPage(&relation, pageNum, false);
+        throw;
+      }
+      const PageId nextPageNum = page->next_page_number();
+      bufMgr->unPinPage(&relation, pageNum, false);
+      pageNum = nextPageNum;
+    }
+    bufMgr->flushFile(&relation);
+    pairs.finish();
+  }
+
+  fillFactor = min(max(fillFactor, 0.0f), 1.0f);
+  vector<pair<Key, PageId>> level;
+  buildLeaves<T>(pairs, fillFactor, level);
+
+  // add levels of internal nodes until one node is left
+  bool aboveLeaves = true;
+  while (level.size() > 1) {
+    vector<pair<Key, PageId>> parents;
+    buildNonLeaves<T>(level, fillFactor, aboveLeaves, parents);
+    level.swap(parents);
+    aboveLeaves = false;
+  }
+  indexMetaInfo.rootPageNo = level[0].second;
+}
+
+/**
+ * This is the helper method that adds the pairs of the records of a page of
+ * the relation. The keys, and INCLUDE values, are read in place on the page;
+ * no record is copied.
+ *
+ * @param page the page, pinned
+ * @param pairs receives the pairs
+ */
+template <class T>
+void BTreeIndex::addPagePairs(Page *page,
+                              SortedKeyRids<typename T::SortKey> &pairs) {
+  for (PageIterator it = page->begin(); it != page->end(); ++it) {
+    const char *record = (*it).data();
+    pairs.add(T::sortKey(record + attrByteOffset,
+                         record + indexMetaInfo.includeByteOffset,
+                         indexMetaInfo.includeLength),
+              it.getCurrentRecord());
+  }
+}
+
+/**
+ * This is the helper method that reads and sorts the pairs of the relation
+ * with several threads. The page numbers of the relation are split into chunks
+ * that the threads claim in turn, so that they read pages at the same time;
+ * each prefetches its chunk, adds the pairs of the records of its used pages
+ * to a sorter of its own and skips the free ones. The sorters are then sorted
+ * and merged into pairs, so the order the pages are read in does not matter.
+ *
+ * @param relationName the relation to scan
+ * @param sortMemory the number of bytes of pairs to sort in memory
+ * @param threads the number of threads
+ * @param pairs receives the pairs, sorted
+ */
+template <class T>
+void BTreeIndex::readPairsParallel(const string &relationName,
+                                   size_t sortMemory, unsigned threads,
+                                   SortedKeyRids<typename T::SortKey> &pairs) {
+  typedef typename T::SortKey Key;
+  static const PageId CHUNK_PAGES = 32;
+
+  // half the memory for the sorters, the other half for their merge
+  vector<unique_ptr<SortedKeyRids<Key>>> parts;
+  for (unsigned w = 0; w < threads; w++)
+    parts.emplace_back(new SortedKeyRids<Key>(sortMemory / 2 / threads));
+
+  PageFile relation(relationName, false);
+  // page 0 is the header of the file
+  const PageId limit = relation.pageLimit();
+  atomic<PageId> nextChunk(1);
+  atomic<bool> failed(false);
+  mutex failureLatch;
+  exception_ptr failure;
+  auto work = [&](unsigned w) {
+    try {
+      while (!failed.load(memory_order_relaxed)) {
+        const PageId first =
+            nextChunk.fetch_add(CHUNK_PAGES, memory_order_relaxed);
+        if (first >= limit) break;
+        const PageId count = min(CHUNK_PAGES, limit - first);
+        bufMgr->prefetch(&relation, first, count);
+        for (PageId pageNum = first; pageNum < first + count; pageNum++) {
+          Page *page;
+          try {
+            bufMgr->readPage(&relation, pageNum, page);
+          } catch (InvalidPageException &) {
+            // a free page
+            continue;
+          }
+          try {
+            addPagePairs<T>(page, *parts[w]);
+          } catch (...) {
+            bufMgr->unPinPage(&relation, pageNum, false);
+            throw;
+          }
+          bufMgr->unPinPage(&relation, pageNum, false);
+        }
+      }
+      parts[w]->finish();
+    } catch (...) {
+      lock_guard<mutex> guard(failureLatch);
+      if (!failure) failure = current_exception();
+      failed.store(true, memory_order_relaxed);
+    }
+  };
+  vector<thread> workers;
+  for (unsigned w = 1; w < threads; w++) workers.emplace_back(work, w);
+  work(0);
+  for (thread &worker : workers) worker.join();
+  bufMgr->flushFile(&relation);
+  if (failure) rethrow_exception(failure);
+
+  pairs.merge(parts, threads);
+}
+
+/**
+ * This is the helper method that builds a new Bloom filter from the keys of
+ * the leaves, while no other thread uses the index.
+ */
+void BTreeIndex::buildFilter() {
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        buildFilterKeys<PackedIntKeys>();
+      else if (indexMetaInfo.includeLength > 0)
+        buildFilterKeys<IncludedIntKeys>();
+      else
+        buildFilterKeys<IntKeys>();
+      break;
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        buildFilterKeys<IncludedDoubleKeys>();
+      else
+        buildFilterKeys<DoubleKeys>();
+      break;
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        buildFilterKeys<IncludedStringKeys>();
+      else
+        buildFilterKeys<StringKeys>();
+      break;
+  }
+}
+
+/**
+ * buildFilter() for keys of type T.
+ */
+template <class T>
+void BTreeIndex::buildFilterKeys() {
+  typedef typename T::Leaf Leaf;
+  typedef typename T::NonLeaf NonLeaf;
+
+  // the leftmost leaf
+  PageId pageNum = rootPageNum;
+  Page *page;
+  bufMgr->readPage(file, pageNum, page);
+  while (!isLeaf(page)) {
+    PageId childNum = T::child((NonLeaf *)page, 0);
+    bufMgr->unPinPage(file, pageNum, false);
+    pageNum = childNum;
+    bufMgr->readPage(file, pageNum, page);
+  }
+
+  // the hashes of all the keys, left to right, to size the filter for them
+  vector<uint64_t> hashes;
+  while (1) {
+    Leaf *node = (Leaf *)page;
+    for (int i = 0; i < node->count; i++)
+      hashes.push_back(T::hash(T::leafKey(node, i)));
+    PageId next = node->rightSibPageNo;
+    bufMgr->unPinPage(file, pageNum, false);
+    if (next == 0) break;
+    pageNum = next;
+    bufMgr->readPage(file, pageNum, page);
+  }
+
+  filter.reset(new BloomFilter(hashes.size()));
+  for (uint64_t hash : hashes) filter->add(hash);
+}
+
+/**
+ * This is the helper method that writes the sorted pairs into linked leaves,
+ * spreading them evenly so that no leaf is filled beyond the fill factor.
+ *
+ * @param pairs the sorted pairs
+ * @param fillFactor the fraction of each leaf to fill
+ * @param level receives the key separating every leaf from the one on its
+ * left, and its page number
+ */
+template <class T>
+void BTreeIndex::buildLeaves(SortedKeyRids<typename T::SortKey> &pairs,
+                             float fillFactor,
+                             vector<pair<typename T::Key, PageId>> &level) {
+  typedef typename T::Leaf Leaf;
+
+  // at least one pair per leaf
+  const size_t count = pairs.size();
+  const size_t perLeaf = max(1, (int)(T::LEAF_SIZE * fillFactor));
+  const size_t leaves = max<size_t>(1, (count + perLeaf - 1) / perLeaf);
+
+  KeyRid<typename T::SortKey> entry;
+  bool more = pairs.next(entry);
+  PageId prevPageId = 0;
+  Leaf *prevNode = NULL;
+  for (size_t i = 0; i == 0 || more; i++) {
+    PageId pageId;
+    Leaf *node = (Leaf *)allocNode(pageId, -1);
+
+    // the first count % leaves leaves take one extra pair; leaves that fill
+    // up on fewer, as packed leaves may, leave the rest to more leaves
+    size_t len = i < leaves ? count / leaves + (i < count % leaves) : count;
+    typename T::LeafWriter writer(node, fillFactor);
+    for (size_t j = 0; j < len && more && writer.add(entry.key, entry.rid);
+         j++)
+      more = pairs.next(entry);
+    writer.finish();
+
+    // link the previous leaf to this one
+    if (prevNode != NULL) {
+      level.push_back(make_pair(
+          T::separator(T::leafKey(prevNode, prevNode->count - 1),
+                       T::leafKey(node, 0)),
+          pageId));
+      prevNode->rightSibPageNo = pageId;
+      bufMgr->unPinPage(file, prevPageId, true);
+    } else {
+      level.push_back(make_pair(T::leafKey(node, 0), pageId));
+    }
+    prevNode = node;
+    prevPageId = pageId;
+  }
+  bufMgr->unPinPage(file, prevPageId, true);
+}
+
+/**
+ * This is the helper method that writes the internal nodes above one level
+ * of the tree, filling no node beyond the fill factor.
+ *
+ * @param children the key separating every child from the one on its left,
+ * and its page number
+ * @param fillFactor the fraction of the space of each node to fill
+ * @param aboveLeaves whether the children are leaves
+ * @param level receives the key separating every new node from the one on
+ * its left, and its page number
+ */
+template <class T>
+void BTreeIndex::buildNonLeaves(
+    const vector<pair<typename T::Key, PageId>> &children, float fillFactor,
+    bool aboveLeaves, vector<pair<typename T::Key, PageId>> &level) {
+  typedef typename T::NonLeaf NonLeaf;
+  vector<size_t> sizes;
+  T::pack(children, fillFactor, sizes);
+
+  size_t child = 0;
+  for (size_t len : sizes) {
+    PageId pageId;
+    NonLeaf *node = (NonLeaf *)allocNode(pageId, aboveLeaves ? 1 : 0);
+    level.push_back(make_pair(children[child].first, pageId));
+
+    // each key separates a child from the one on its left
+    T::build(node, &children[child], len);
+    child += len;
+    bufMgr->unPinPage(file, pageId, true);
+  }
+}
+
+/**
+ * This is the helper method that checks if the page stores a leaf node or
+ * an internal node.
+ *
+ * @param page the page
+ * @return true if the page stores a leaf node
+ *         false if the page stores an internal node
+ */
+bool BTreeIndex::isLeaf(Page *page) {
+  return ((leaf_node_int *)page)->level == -1;
+}
+
+
+/**
+ * This is the helper method that tries to insert the given pair, descending
+ * from the root. It gives up when a node it read changes or has to split
+ * first, in which case the caller tries again.
+ *
+ * @param key the key of the pair to be inserted
+ * @param rid the record ID of the key-record pair to be inserted
+ * @param include the INCLUDE value of the pair, if the leaves keep one
+ * @param splitPage the page number of an internal node to split on the way
+ * down, or 0; updated when a node needs to split before its child can
+ * @return true if the pair was inserted
  */
-non_leaf_node_int *BTreeIndex::allocNonLeafNode(PageId &newPageId) {
-  non_leaf_node_int *newNode;
-  bufMgr->allocPage(file, newPageId, (Page *&)newNode);
-  memset(newNode, 0, Page::SIZE);
-  return newNode;
+template <class T>
+bool BTreeIndex::tryInsert(const typename T::Key &key, RecordId rid,
+                           const IncludeValue &include, PageId &splitPage) {
+  typedef typename T::Leaf Leaf;
+  typedef typename T::NonLeaf NonLeaf;
+
+  Page *parent = NULL;
+  PageId parentNum = 0;
+  uint64_t parentVersion = 0;
+  int childIndex = 0;
+
+  PageId pageNum = rootPageNum;
+  Page *page;
+  bufMgr->readPage(file, pageNum, page);
+  uint64_t version = readLatch(page);
+
+  bool inserted = false, dirty = false;
+
+  // the root may have split before its version was read
+  if (pageNum == rootPageNum) {
+    while (!isLeaf(page)) {
+      NonLeaf *node = (NonLeaf *)page;
+
+      // split the node that had no room for a child, then start over
+      if (pageNum == splitPage && node->count >= 3) {
+        splitPage = 0;
+        dirty = splitChild<T>(parent, parentNum, parentVersion, childIndex,
+                              page, pageNum, version, splitPage);
+        break;
+      }
+
+      int i = T::childIndex(node, key, true);
+      PageId childNum = T::child(node, i);
+      if (!validate(page, version)) break;
+
+      Page *childPage;
+      bufMgr->readPage(file, childNum, childPage);
+      uint64_t childVersion = readLatch(childPage);
+
+      // the child may have split before its version was read
+      if (!validate(page, version)) {
+        bufMgr->unPinPage(file, childNum, false);
+        break;
+      }
+
+      if (parent != NULL) bufMgr->unPinPage(file, parentNum, false);
+      parent = page;
+      parentNum = pageNum;
+      parentVersion = version;
+      childIndex = i;
+      page = childPage;
+      pageNum = childNum;
+      version = childVersion;
+    }
+
+    if (isLeaf(page)) {
+      Leaf *leaf = (Leaf *)page;
+      if (!T::leafFits(leaf, key, rid)) {
+        // split the full leaf, then start over
+        dirty = splitChild<T>(parent, parentNum, parentVersion, childIndex,
+                              page, pageNum, version, splitPage);
+      } else if (upgradeLatch(page, version)) {
+        // after the entries with an equal key
+        int index = T::leafUpperBound(leaf, leaf->count, key);
+        T::leafInsert(leaf, index, key, rid, include);
+        unlatch(page);
+        inserted = dirty = true;
+      }
+    }
+  }
+
+  bufMgr->unPinPage(file, pageNum, dirty);
+  if (parent != NULL) bufMgr->unPinPage(file, parentNum, dirty && !inserted);
+  return inserted;
 }
 
 /**
- * Allocate a page in the buffer for a leaf node
+ * This is the helper method that splits a node in two, and adds the new node
+ * to its parent, or to a new root. Both nodes must be unchanged since their
+ * versions were read.
  *
- * @param newPageId the page number for the new node
- * @return a reference to the new leaf node
+ * @param parent the parent page, or NULL if the node is the root
+ * @param parentNum the page number of the parent
+ * @param parentVersion the version of the parent
+ * @param childIndex the index of the node among the children of the parent
+ * @param page the page of the node
+ * @param pageNum the page number of the node
+ * @param version the version of the node
+ * @param splitPage set to the parent if it has no room for the new node
+ * @return true if the node was split
  */
-leaf_node_int *BTreeIndex::allocLeafNode(PageId &newPageId) {
-  leaf_node_int *newNode = (leaf_node_int *)allocNonLeafNode(newPageId);
-  newNode->level = -1;
-  return newNode;
+template <class T>
+bool BTreeIndex::splitChild(Page *parent, PageId parentNum,
+                            uint64_t parentVersion, int childIndex,
+                            Page *page, PageId pageNum, uint64_t version,
+                            PageId &splitPage) {
+  typedef typename T::Key Key;
+  typedef typename T::Leaf Leaf;
+  typedef typename T::NonLeaf NonLeaf;
+
+  if (parent != NULL && !upgradeLatch(parent, parentVersion)) return false;
+  if (!upgradeLatch(page, version)) {
+    if (parent != NULL) unlatch(parent);
+    return false;
+  }
+
+  // the key that will separate the two halves
+  const bool leaf = isLeaf(page);
+  Key midVal;
+  if (leaf) {
+    Leaf *node = (Leaf *)page;
+    int mid = node->count / 2;
+    midVal = T::separator(T::leafKey(node, mid - 1), T::leafKey(node, mid));
+  } else {
+    midVal = T::splitKey((NonLeaf *)page);
+  }
+
+  // a parent without room for it splits first
+  if (parent != NULL && !T::fits((NonLeaf *)parent, childIndex, midVal)) {
+    splitPage = parentNum;
+    unlatch(page);
+    unlatch(parent);
+    return false;
+  }
+
+  const auto splitStart = std::chrono::steady_clock::now();
+  BADGERDB_TRACE_SPAN(leaf ? TRACE_LEAF_SPLIT : TRACE_NONLEAF_SPLIT, this,
+                      pageNum);
+
+  // the new node is complete before any other thread can reach it
+  PageId newPageNum;
+  Page *newPage = allocNode(newPageNum, ((leaf_node_int *)page)->level);
+  if (leaf) {
+    Leaf *node = (Leaf *)page;
+    Leaf *newNode = (Leaf *)newPage;
+    T::leafSplit(node, newNode, node->count / 2);
+    newNode->rightSibPageNo = node->rightSibPageNo;
+    node->rightSibPageNo = newPageNum;
+  } else {
+    T::split((NonLeaf *)page, (NonLeaf *)newPage, midVal);
+  }
+  bufMgr->unPinPage(file, newPageNum, true);
+
+  if (parent != NULL) {
+    T::insertChild((NonLeaf *)parent, childIndex, midVal, newPageNum);
+  } else {
+    // grow a new root above both halves
+    PageId newRootNum;
+    NonLeaf *newRoot = (NonLeaf *)allocNode(newRootNum, leaf ? 1 : 0);
+    pair<Key, PageId> children[2] = {make_pair(midVal, pageNum),
+                                     make_pair(midVal, newPageNum)};
+    T::build(newRoot, children, 2);
+    bufMgr->unPinPage(file, newRootNum, true);
+
+    rootPageNum = newRootNum;
+    writeMetaPage();
+  }
+
+  unlatch(page);
+  if (parent != NULL) unlatch(parent);
+  const uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - splitStart)
+                             .count();
+  (leaf ? leafSplits : nonLeafSplits)++;
+  (leaf ? leafSplitNanos : nonLeafSplitNanos) += nanos;
+  return true;
+}
+
+/**
+ * This is the helper method that inserts a pair from the root, trying again
+ * until no other thread is in the way.
+ *
+ * @param key the key of the pair
+ * @param rid the record id of the pair
+ * @param include the INCLUDE value of the pair, if the leaves keep one
+ */
+template <class T>
+void BTreeIndex::insertKey(const typename T::Key &key, RecordId rid,
+                           const IncludeValue &include) {
+  // before the entry, so that no lookup finds the entry and not the key
+  if (filter != NULL) filter->add(T::hash(key));
+  PageId splitPage = 0;
+  while (!tryInsert<T>(key, rid, include, splitPage)) {
+  }
+}
+
+/**
+ * Insert a new entry using the pair <value,rid>.
+ * Start from root to recursively find out the leaf to insert the entry in.
+ * The insertion may cause splitting of leaf node. This splitting will require
+ * addition of new leaf page number entry into the parent non-leaf, which may
+ * in-turn get split. This may continue all the way upto the root causing the
+ * root to get split. If root gets split, metapage needs to be changed
+ * accordingly. Make sure to unpin pages as soon as you can.
+ * @param key			Key to insert, pointer to integer/double/char
+ *string
+ * @param rid			Record ID of a record whose entry is getting
+ *inserted into the index.
+ * @param include	The bytes of the INCLUDE column of the record, or NULL
+ **/
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid,
+                                   const void *include) {
+  const char *bytes = (const char *)key;
+  IncludeValue value{};
+  if (include != NULL)
+    memcpy(value.data, include, indexMetaInfo.includeLength);
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        insertKey<PackedIntKeys>(IntKeys::fromBytes(bytes), rid, value);
+      else if (indexMetaInfo.includeLength > 0)
+        insertKey<IncludedIntKeys>(IntKeys::fromBytes(bytes), rid, value);
+      else
+        insertKey<IntKeys>(IntKeys::fromBytes(bytes), rid, value);
+      break;
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        insertKey<IncludedDoubleKeys>(DoubleKeys::fromBytes(bytes), rid,
+                                      value);
+      else
+        insertKey<DoubleKeys>(DoubleKeys::fromBytes(bytes), rid, value);
+      break;
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        insertKey<IncludedStringKeys>(StringKeys::fromBytes(bytes), rid,
+                                      value);
+      else
+        insertKey<StringKeys>(StringKeys::fromBytes(bytes), rid, value);
+      break;
+  }
 }
 
 /**
- * This is the constructor of the btree. It checks if the specified index file exists.
- * If the index file exists, the file is opened, if the index file does not exist, a new
- * index file is created.
+ * This is the helper method that tries to delete the given pair, or to change
+ * its record id. The leaf goes, and is freed, with its last pair if it has a
+ * left sibling with the same parent.
  *
- * @param relationName The name of the relation on which to build the index.
- * @param outIndexName The name of the index file.
- * @param bufMgrIn The instance of the global buffer manager.
- * @param attrByteOffset The byte offset of the attribute in the tuple on which
- * to build the index.
- * @param attrType The data type of the attribute we are indexing.
+ * @param key the key of the pair
+ * @param rid the record id of the pair
+ * @param newRid the record id to store in the pair instead, or NULL to delete
+ * it
+ * @param found set to whether the pair was there
+ * @param moved set to whether the pair was deleted instead of changed,
+ * because the leaf had no room for the new record id
+ * @return false if a node changed on the way, and the caller must try again
  */
-BTreeIndex::BTreeIndex(const string &relationName, string &outIndexName,
-                       BufMgr *bufMgrIn, const int attrByteOffset_,
-                       const Datatype attrType) {
-  bufMgr = bufMgrIn;
-  attrByteOffset = attrByteOffset_;
-  attributeType = attrType;
-
-  ostringstream idx_str{};
-  idx_str << relationName << ',' << attrByteOffset;
-  outIndexName = idx_str.str();
+template <class T>
+bool BTreeIndex::tryDelete(const typename T::Key &key, RecordId rid,
+                           const RecordId *newRid, bool &found, bool &moved) {
+  typedef typename T::Leaf Leaf;
+  typedef typename T::NonLeaf NonLeaf;
+
+  Page *parent = NULL;
+  PageId parentNum = 0;
+  uint64_t parentVersion = 0;
+  int childIndex = 0;
+
+  PageId pageNum = rootPageNum;
+  Page *page;
+  bufMgr->readPage(file, pageNum, page);
+  uint64_t version = readLatch(page);
+
+  bool done = false, dirty = false, parentDirty = false;
+  bool valid = pageNum == rootPageNum;
+  while (valid && !isLeaf(page)) {
+    NonLeaf *node = (NonLeaf *)page;
+    int i = T::childIndex(node, key, false);
+    PageId childNum = T::child(node, i);
+    if (!validate(page, version)) {
+      valid = false;
+      break;
+    }
 
-  relationName.copy(indexMetaInfo.relationName, 20, 0);
-  indexMetaInfo.attrByteOffset = attrByteOffset;
-  indexMetaInfo.attrType = attrType;
+    Page *childPage;
+    bufMgr->readPage(file, childNum, childPage);
+    uint64_t childVersion = readLatch(childPage);
+    if (!validate(page, version)) {
+      bufMgr->unPinPage(file, childNum, false);
+      valid = false;
+      break;
+    }
 
-  file = new BlobFile(outIndexName, true);
+    if (parent != NULL) bufMgr->unPinPage(file, parentNum, false);
+    parent = page;
+    parentNum = pageNum;
+    parentVersion = version;
+    childIndex = i;
+    page = childPage;
+    pageNum = childNum;
+    version = childVersion;
+  }
 
-  allocLeafNode(indexMetaInfo.rootPageNo);
-  bufMgr->unPinPage(file, indexMetaInfo.rootPageNo, true);
+  // the pair may be in a right sibling, behind others with the same key
+  while (valid) {
+    Leaf *leaf = (Leaf *)page;
+    int count = entries<T>(leaf);
+    int i = T::leafLowerBound(leaf, count, key);
+    while (i < count && T::leafKey(leaf, i) == key &&
+           !(T::leafRid(leaf, i) == rid))
+      i++;
+    bool here = i < count && T::leafKey(leaf, i) == key;
+    bool fits = newRid == NULL || T::leafFitsRid(leaf, *newRid);
+    PageId next = leaf->rightSibPageNo;
+    if (!validate(page, version)) break;
+
+    if (here) {
+      if (newRid == NULL && count == 1 && parent != NULL && childIndex > 0) {
+        done = dirty = parentDirty = freeLeaf<T>(
+            parent, parentVersion, childIndex, page, pageNum, version);
+      } else if (upgradeLatch(page, version)) {
+        // a leaf without room for the new record id gives up the pair, for
+        // the caller to insert again
+        if (newRid != NULL && fits)
+          T::leafSetRid(leaf, i, *newRid);
+        else
+          T::leafRemove(leaf, i);
+        moved = !fits;
+        unlatch(page);
+        done = dirty = true;
+      }
+      found = true;
+      break;
+    }
+    if (i < count || next == 0) {
+      found = false;
+      done = true;
+      break;
+    }
 
-  FileScan fscan(relationName, bufMgr);
-  try {
-    RecordId scanRecordID;
-    while (1) {
-      fscan.scanNext(scanRecordID);
-      std::string recordStr = fscan.getRecord();
-      const char *record = recordStr.c_str();
-      int key = *((int *)(record + attrByteOffset));
-      insertEntry(&key, scanRecordID);
+    // the parent of the sibling is not known
+    Page *nextPage;
+    bufMgr->readPage(file, next, nextPage);
+    uint64_t nextVersion = readLatch(nextPage);
+    if (!validate(page, version)) {
+      bufMgr->unPinPage(file, next, false);
+      break;
     }
-  } catch (EndOfFileException e) {
+    bufMgr->unPinPage(file, pageNum, false);
+    if (parent != NULL) bufMgr->unPinPage(file, parentNum, false);
+    parent = NULL;
+    page = nextPage;
+    pageNum = next;
+    version = nextVersion;
   }
+
+  bufMgr->unPinPage(file, pageNum, dirty);
+  if (parent != NULL) bufMgr->unPinPage(file, parentNum, parentDirty);
+  return done;
 }
 
 /**
- * This is the helper method that checks if the page stores a leaf node or
- * an internal node.
+ * This is the helper method that takes a leaf holding one pair out of the
+ * tree, linking its left sibling, which has the same parent, to its right
+ * one, and frees it. All three must be unchanged since their versions were
+ * read.
  *
- * @param page the page 
- * @return true if the page stores a leaf node
- *         false if the page stores an internal node
+ * @param parent the parent page
+ * @param parentVersion the version of the parent
+ * @param childIndex the index of the leaf among the children of the parent,
+ * above 0
+ * @param page the page of the leaf
+ * @param pageNum the page number of the leaf
+ * @param version the version of the leaf
+ * @return true if the leaf was freed
  */
-bool BTreeIndex::isLeaf(Page *page) { return *((int *)page) == -1; }
+template <class T>
+bool BTreeIndex::freeLeaf(Page *parent, uint64_t parentVersion,
+                          int childIndex, Page *page, PageId pageNum,
+                          uint64_t version) {
+  typedef typename T::Leaf Leaf;
+  typedef typename T::NonLeaf NonLeaf;
+
+  PageId leftNum = T::child((NonLeaf *)parent, childIndex - 1);
+  if (!validate(parent, parentVersion)) return false;
+
+  Page *left;
+  bufMgr->readPage(file, leftNum, left);
+  uint64_t leftVersion = readLatch(left);
+
+  bool freed = false;
+  if (upgradeLatch(parent, parentVersion)) {
+    if (upgradeLatch(left, leftVersion)) {
+      if (upgradeLatch(page, version)) {
+        ((Leaf *)left)->rightSibPageNo = ((Leaf *)page)->rightSibPageNo;
+        T::removeChild((NonLeaf *)parent, childIndex);
+        freeNode(pageNum, page);
+        unlatch(page);
+        freed = true;
+      }
+      unlatch(left);
+    }
+    unlatch(parent);
+  }
+  bufMgr->unPinPage(file, leftNum, freed);
+  return freed;
+}
 
 /**
- * This is the helper method to checks and see that if an internal node is full
+ * This is the helper method that deletes a pair, or changes its record id,
+ * trying again until no other thread is in the way.
  *
- * @param node node
- * @return true if an internal node is full
- *         false if an internal node is not full
+ * @param key the key of the pair
+ * @param rid the record id of the pair
+ * @param newRid the record id to store in the pair instead, or NULL to delete
+ * it
+ * @throws  NoSuchKeyFoundException If the pair is not in the index.
  */
-bool BTreeIndex::isNonLeafFull(non_leaf_node_int *node) {
-  return node->pageNoArray[INTARRAYNONLEAFSIZE] != 0;
+template <class T>
+void BTreeIndex::deleteKey(const typename T::Key &key, RecordId rid,
+                           const RecordId *newRid) {
+  bool found = false, moved = false;
+  while (!tryDelete<T>(key, rid, newRid, found, moved)) {
+  }
+  if (!found) throw NoSuchKeyFoundException();
+  // only packed leaves run out of room for a record id, and they keep no
+  // INCLUDE values
+  if (moved) insertKey<T>(key, *newRid, IncludeValue());
 }
 
 /**
- * This is the helper method to checks that if a leaf node is full
- *
- * @param node a leaf node
- * @return true if a leaf node is full
- *         false if a leaf node is not full
+ * This is the helper method that deletes or changes a pair whose key is in
+ * the search parameter key.
  */
-bool BTreeIndex::isLeafFull(leaf_node_int *node) {
-  return !(node->ridArray[INTARRAYLEAFSIZE - 1].page_number == 0 &&
-           node->ridArray[INTARRAYLEAFSIZE - 1].slot_number == 0);
+void BTreeIndex::changeEntry(const void *key, const RecordId rid,
+                             const RecordId *newRid) {
+  const char *bytes = (const char *)key;
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        deleteKey<PackedIntKeys>(IntKeys::fromBytes(bytes), rid, newRid);
+      else if (indexMetaInfo.includeLength > 0)
+        deleteKey<IncludedIntKeys>(IntKeys::fromBytes(bytes), rid, newRid);
+      else
+        deleteKey<IntKeys>(IntKeys::fromBytes(bytes), rid, newRid);
+      break;
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        deleteKey<IncludedDoubleKeys>(DoubleKeys::fromBytes(bytes), rid,
+                                      newRid);
+      else
+        deleteKey<DoubleKeys>(DoubleKeys::fromBytes(bytes), rid, newRid);
+      break;
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        deleteKey<IncludedStringKeys>(StringKeys::fromBytes(bytes), rid,
+                                      newRid);
+      else
+        deleteKey<StringKeys>(StringKeys::fromBytes(bytes), rid, newRid);
+      break;
+  }
 }
 
 /**
- * This is the helper method that returns the number of records stored in the leaf 
- * node. And we assume that all records are continuously stored and valid records
- * are nonzero.
- *
- * @param node a leaf node
- * @return the number of records stored in the leaf node
- */
-int BTreeIndex::numInLeaf(leaf_node_int *node) {
-  static auto comp = [](const RecordId &r1, const RecordId &r2) {
-    return r1.page_number > r2.page_number;
-  };
-  static RecordId emptyRecord{};
-
-  RecordId *start = node->ridArray;
-  RecordId *end = &node->ridArray[INTARRAYLEAFSIZE];
-
-  return lower_bound(start, end, emptyRecord, comp) - start;
+ * Delete the entry <key,rid>. A leaf left empty is taken out of the tree and
+ * its page freed when it has a left sibling with the same parent; otherwise
+ * nodes are not merged until compact() is called.
+ * @param key			Key of the entry, pointer to integer/double/char
+ *string
+ * @param rid			Record ID of the entry
+ * @throws  NoSuchKeyFoundException If the entry is not in the index.
+ **/
+const void BTreeIndex::deleteEntry(const void *key, const RecordId rid) {
+  changeEntry(key, rid, NULL);
 }
 
 /**
- * This is the helper method that returns the number of records stored in the internal 
- * node. And we assume that all records are continuously stored and valid records
- * are nonzero.
- *
- * @param node an internal node
- * @return the number of records stored in the internal node
- */
-int BTreeIndex::numInNonLeaf(non_leaf_node_int *node) {
-  static auto comp = [](const PageId &p1, const PageId &p2) { return p1 > p2; };
-  PageId *start = node->pageNoArray;
-  PageId *end = &node->pageNoArray[INTARRAYNONLEAFSIZE + 1];
-  return lower_bound(start, end, 0, comp) - start;
+ * Change the record id of the entry <key,oldRid> to newRid, in place.
+ * @param key			Key of the entry, pointer to integer/double/char
+ *string
+ * @param oldRid			Record ID of the entry
+ * @param newRid			Record ID to store in the entry instead
+ * @throws  NoSuchKeyFoundException If the entry is not in the index.
+ **/
+const void BTreeIndex::updateEntry(const void *key, const RecordId oldRid,
+                                   const RecordId newRid) {
+  changeEntry(key, oldRid, &newRid);
 }
 
 /**
- * This is the helper method that find the index of the first integer larger than 
- * (or equal to) the given key.
+ * This is the helper method that descends to the node just above the leaves
+ * whose range holds the given key, or to the leftmost such node.
  *
- * @param array an interger array
- * @param length the length of the array
- * @param key the target key
- * @param includeKey whether the current key is included
- *
- * @return a. the index of the first integer larger than the given key if
- *            includeKey = false
- *         b. the index of the first integer larger than or equal to the
- *            given key if includeKey = true
- *         c. -1 if the key is not found
+ * @param key the key
+ * @param leftmost whether to take the leftmost node instead
+ * @param pageNum receives the page number of the node
+ * @param page receives the node, pinned
+ * @param version receives the version of the node
+ * @param hasFence receives whether there are nodes on the right of the node
+ * @param fence receives the lowest key of the node on its right
+ * @return false if the root is a leaf
  */
-int BTreeIndex::findLargerInt(const int *array, int length, int key,
-                               bool includeKey) {
-  if (!includeKey) key++;
-  int result = lower_bound(array, &array[length], key) - array;
-  return result >= length ? -1 : result;
+template <class T>
+bool BTreeIndex::descendAboveLeaves(const typename T::Key &key, bool leftmost,
+                                    PageId &pageNum, Page *&page,
+                                    uint64_t &version, bool &hasFence,
+                                    typename T::Key &fence) {
+  typedef typename T::NonLeaf NonLeaf;
+  while (1) {
+    pageNum = rootPageNum;
+    bufMgr->readPage(file, pageNum, page);
+    version = readLatch(page);
+    hasFence = false;
+
+    bool valid = pageNum == rootPageNum;
+    if (valid && isLeaf(page)) {
+      bool leaf = validate(page, version);
+      if (leaf) {
+        bufMgr->unPinPage(file, pageNum, false);
+        return false;
+      }
+      valid = false;
+    }
+    while (valid && ((NonLeaf *)page)->level != 1) {
+      NonLeaf *node = (NonLeaf *)page;
+      int i = leftmost ? 0 : T::childIndex(node, key, true);
+      PageId childNum = T::child(node, i);
+
+      // the ranges narrow on the way down
+      if (i < T::children(node) - 1) {
+        fence = T::key(node, i);
+        hasFence = true;
+      }
+      if (!validate(page, version)) {
+        valid = false;
+        break;
+      }
+
+      Page *childPage;
+      bufMgr->readPage(file, childNum, childPage);
+      uint64_t childVersion = readLatch(childPage);
+      valid = validate(page, version);
+
+      bufMgr->unPinPage(file, valid ? pageNum : childNum, false);
+      if (valid) {
+        pageNum = childNum;
+        page = childPage;
+        version = childVersion;
+      }
+    }
+    if (valid) return true;
+    bufMgr->unPinPage(file, pageNum, false);
+  }
 }
 
 /**
- * This is the helper method that find the index of the first key smaller than the 
- * given key.
+ * This is the helper method that merges each child of a node just above the
+ * leaves into its left sibling while the two are at most one leaf's worth,
+ * and one of them is under half full, freeing the right one.
  *
- * @param node an internal node
- * @param key the key to find
- * @return the index of the first key smaller than the given key
- *         return the largest index if not found
+ * @param page the node
+ * @param version the version of the node, updated as the node changes
+ * @param merged incremented for every leaf merged
+ * @return false if the node changed, and must be looked up again
  */
-int BTreeIndex::findSmallerKeyIndex(non_leaf_node_int *node, int key) {
-  int len = numInNonLeaf(node);
-  int result = findLargerInt(node->keyArray, len - 1, key);
-  return result == -1 ? len - 1 : result;
+template <class T>
+bool BTreeIndex::mergeChildren(Page *page, uint64_t &version, size_t &merged) {
+  typedef typename T::Leaf Leaf;
+  typedef typename T::NonLeaf NonLeaf;
+  NonLeaf *node = (NonLeaf *)page;
+
+  int i = 0;
+  while (1) {
+    int count = T::children(node);
+    PageId leftNum = T::child(node, i);
+    PageId rightNum = T::child(node, i + 1);
+    if (!validate(page, version)) return false;
+    if (i + 1 >= count) return true;
+
+    Page *left, *right;
+    bufMgr->readPage(file, leftNum, left);
+    uint64_t leftVersion = readLatch(left);
+    bufMgr->readPage(file, rightNum, right);
+    uint64_t rightVersion = readLatch(right);
+
+    Leaf *leftLeaf = (Leaf *)left;
+    Leaf *rightLeaf = (Leaf *)right;
+    bool worth = T::leafMergeable(leftLeaf, rightLeaf);
+
+    bool done = false;
+    if (!worth) {
+      i++;
+    } else if (!upgradeLatch(page, version)) {
+      bufMgr->unPinPage(file, leftNum, false);
+      bufMgr->unPinPage(file, rightNum, false);
+      return false;
+    } else {
+      if (upgradeLatch(left, leftVersion)) {
+        if (upgradeLatch(right, rightVersion)) {
+          T::leafMerge(leftLeaf, rightLeaf);
+          leftLeaf->rightSibPageNo = rightLeaf->rightSibPageNo;
+          T::removeChild(node, i + 1);
+          freeNode(rightNum, right);
+          unlatch(right);
+          done = true;
+          merged++;
+        }
+        unlatch(left);
+      }
+      unlatch(page);
+      version += 2;
+    }
+    bufMgr->unPinPage(file, leftNum, done);
+    bufMgr->unPinPage(file, rightNum, done);
+  }
 }
 
 /**
- * This is the helper method that find the insertaion index for a key in a leaf node
+ * This is the helper method that makes the only child of the root the root,
+ * as long as the root has one child.
  *
- * @param node a leaf node
- * @param key the key to be inserted
- * @return the insertaion index for a key in a leaf node
+ * @return the number of nodes freed
  */
-int BTreeIndex::findInsertionIndexLeaf(leaf_node_int *node, int key) {
-  int len = numInLeaf(node);
-  int result = findLargerInt(node->keyArray, len, key);
-  return result == -1 ? len : result;
+template <class T>
+size_t BTreeIndex::collapseRoot() {
+  typedef typename T::NonLeaf NonLeaf;
+  size_t freed = 0;
+  while (1) {
+    PageId rootNum = rootPageNum;
+    Page *root;
+    bufMgr->readPage(file, rootNum, root);
+    uint64_t version = readLatch(root);
+
+    bool single = rootNum == rootPageNum && !isLeaf(root) &&
+                  T::children((NonLeaf *)root) == 1;
+    PageId childNum = single ? T::child((NonLeaf *)root, 0) : 0;
+    bool valid = validate(root, version);
+
+    // nothing splits the root while it is latched
+    bool collapsed = false;
+    if (valid && single && upgradeLatch(root, version)) {
+      rootPageNum = childNum;
+      writeMetaPage();
+      freeNode(rootNum, root);
+      unlatch(root);
+      collapsed = true;
+      freed++;
+    }
+    bufMgr->unPinPage(file, rootNum, collapsed);
+    if (valid && !single) return freed;
+  }
 }
 
 /**
- * This is the helper method that find the index of the first key larger than the given 
- * key in the leaf node
- *
- * @param node a leaf node
- * @param key the key to find
- * @param includeKey whether the current key is included
- *
- * @return a. the index of the first integer larger than the given key if
- *            includeKey is false
- *         b. the index of the first integer larger than or equal to the
- *            given key if includeKey is true
- *         c. -1 if the key is not found
+ * compact() for keys of type T.
  */
-int BTreeIndex::findIndexLeaf(leaf_node_int *node, int key, bool includeKey) {
-  return findLargerInt(node->keyArray, numInLeaf(node), key, includeKey);
+template <class T>
+size_t BTreeIndex::compactKeys() {
+  typename T::Key key{};
+  bool leftmost = true, hasFence = true;
+  size_t freed = 0;
+
+  // the nodes above the leaves, left to right
+  while (hasFence) {
+    PageId pageNum;
+    Page *page;
+    uint64_t version;
+    typename T::Key fence{};
+    if (!descendAboveLeaves<T>(key, leftmost, pageNum, page, version,
+                               hasFence, fence))
+      break;
+
+    size_t merged = 0;
+    bool valid = mergeChildren<T>(page, version, merged);
+    bufMgr->unPinPage(file, pageNum, merged > 0);
+    freed += merged;
+    if (!valid) {
+      hasFence = true;
+      continue;
+    }
+    key = fence;
+    leftmost = false;
+  }
+  return freed + collapseRoot<T>();
 }
 
 /**
- * This is the helper method that inserts the given pair into the leaf node at 
- * the given insertion index.
- *
- * @param node a leaf node
- * @param i  insertion index
- * @param key  key of pair to be inserted
- * @param rid the record ID of the pair to be inserted
- */
-void BTreeIndex::insertionLeafNode(leaf_node_int *node, int i, int key,
-                                  RecordId rid) {
-  const size_t len = INTARRAYLEAFSIZE - i - 1;
-
-  // shift items for the extra space
-  memmove(&node->keyArray[i + 1], &node->keyArray[i], len * sizeof(int));
-  memmove(&node->ridArray[i + 1], &node->ridArray[i], len * sizeof(RecordId));
-
-  // save the key and record id to the leaf node
-  node->keyArray[i] = key;
-  node->ridArray[i] = rid;
+ * Merge leaves that deletes left under half full into their left siblings,
+ * and make the only child of the root the root, freeing the nodes no longer
+ * in the tree for new ones. The index can be used by other threads meanwhile,
+ * so this may run in a background thread.
+ * @return the number of nodes freed
+ **/
+size_t BTreeIndex::compact() {
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves) return compactKeys<PackedIntKeys>();
+      if (indexMetaInfo.includeLength > 0) return compactKeys<IncludedIntKeys>();
+      return compactKeys<IntKeys>();
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0) return compactKeys<IncludedDoubleKeys>();
+      return compactKeys<DoubleKeys>();
+    case STRING:
+      if (indexMetaInfo.includeLength > 0) return compactKeys<IncludedStringKeys>();
+      return compactKeys<StringKeys>();
+  }
+  return 0;
 }
 
 /**
- * This is the helper method that inserts the given key-(page number) pair into 
- * the given leaf node at the given index.
- *
- * @param n an internal node
- * @param i  insertion index
- * @param key  key of the pair
- * @param pid  page number of the pair
- */
-void BTreeIndex::insertionNonLeafNode(non_leaf_node_int *n, int i, int key,
-                                     PageId pid) {
-  const size_t len = INTARRAYNONLEAFSIZE - i - 1;
-
-  // shift items for extra space
-  memmove(&n->keyArray[i + 1], &n->keyArray[i], len * sizeof(int));
-  memmove(&n->pageNoArray[i + 2], &n->pageNoArray[i + 1], len * sizeof(PageId));
-
-  // store the key and page number to the node
-  n->keyArray[i] = key;
-  n->pageNoArray[i + 1] = pid;
+ * Walk every node of the tree to find its height, its numbers of leaves,
+ * internal nodes and entries, and how full its leaves are. The index must not
+ * change meanwhile.
+ * @return the shape of the tree
+ **/
+IndexShape BTreeIndex::shape() {
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves) return shapeOf<PackedIntKeys>();
+      if (indexMetaInfo.includeLength > 0) return shapeOf<IncludedIntKeys>();
+      return shapeOf<IntKeys>();
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0) return shapeOf<IncludedDoubleKeys>();
+      return shapeOf<DoubleKeys>();
+    case STRING:
+      if (indexMetaInfo.includeLength > 0) return shapeOf<IncludedStringKeys>();
+      return shapeOf<StringKeys>();
+  }
+  return IndexShape();
 }
 
 /**
- * This is the helper method to splits a leaf node into two.
- *
- * @param node a pointer to the original node
- * @param newNode a pointer to the new node
- * @param index the index where the split occurs.
+ * shape() for keys of type T: the nodes of each level are found from the
+ * children of the level above, one level at a time.
  */
-void BTreeIndex::splitLeaf(leaf_node_int *node, leaf_node_int *newNode,
-                               int index) {
-  const size_t len = INTARRAYLEAFSIZE - index;
-
-  // copy elements to new node
-  memcpy(&newNode->keyArray, &node->keyArray[index], len * sizeof(int));
-  memcpy(&newNode->ridArray, &node->ridArray[index], len * sizeof(RecordId));
+template <class T>
+IndexShape BTreeIndex::shapeOf() {
+  typedef typename T::Leaf Leaf;
+  typedef typename T::NonLeaf NonLeaf;
+
+  IndexShape shape;
+  vector<PageId> level(1, rootPageNum);
+  while (!level.empty()) {
+    shape.height++;
+    vector<PageId> below;
+    for (PageId pageNum : level) {
+      Page *page;
+      bufMgr->readPage(file, pageNum, page);
+      if (isLeaf(page)) {
+        shape.leaves++;
+        shape.entries += ((Leaf *)page)->count;
+      } else {
+        NonLeaf *node = (NonLeaf *)page;
+        shape.nonLeaves++;
+        for (int i = 0; i < T::children(node); i++)
+          below.push_back(T::child(node, i));
+      }
+      bufMgr->unPinPage(file, pageNum, false);
+    }
+    level.swap(below);
+  }
+  shape.leafFill = (double)shape.entries / (shape.leaves * T::LEAF_SIZE);
+  return shape;
+}
 
-  // remove elements from old
-  memset(&node->keyArray[index], 0, len * sizeof(int));
-  memset(&node->ridArray[index], 0, len * sizeof(RecordId));
+/**
+ * @return the splits done since the index was opened, and their cost
+ **/
+SplitStats BTreeIndex::splitStats() const {
+  SplitStats stats;
+  stats.leafSplits = leafSplits;
+  stats.nonLeafSplits = nonLeafSplits;
+  stats.leafSplitNanos = leafSplitNanos;
+  stats.nonLeafSplitNanos = nonLeafSplitNanos;
+  return stats;
 }
 
 /**
- * This is the helper method that splits the internal node by the given index.
+ * This is the helper method that descends from the root to the leaf that
+ * holds the first element larger than or equal to the given key.
  *
- * @param node an internal node
- * @param i the index where the split occurs.
- * @param keepKey if keepKey is true, then the pair at the index does not need 
- * to be moved up and will be moved to the newly created
- * internal node.
- * @return a pointer to the newly created internal node.
+ * @param key the key
+ * @param pageNum receives the page number of the leaf
+ * @param page receives the leaf, pinned
+ * @param version receives the version of the leaf
  */
-void BTreeIndex::splitNonLeaf(non_leaf_node_int *curr, non_leaf_node_int *next,
-                                  int i, bool keepKey) {
-  size_t len = INTARRAYNONLEAFSIZE - i;
-
-  // copy keys to new node
-  if (keepKey)
-    memcpy(&next->keyArray, &curr->keyArray[i], len * sizeof(int));
-  else
-    memcpy(&next->keyArray, &curr->keyArray[i + 1], (len - 1) * sizeof(int));
-
-  // copy values to new node
-  memcpy(&next->pageNoArray, &curr->pageNoArray[i + 1], len * sizeof(PageId));
-
-  // remove elements from old node
-  memset(&curr->keyArray[i], 0, len * sizeof(int));
-  memset(&curr->pageNoArray[i + 1], 0, len * sizeof(PageId));
+template <class T>
+void BTreeIndex::descend(const typename T::Key &key, PageId &pageNum,
+                         Page *&page, uint64_t &version) {
+  typedef typename T::NonLeaf NonLeaf;
+  while (1) {
+    pageNum = rootPageNum;
+    bufMgr->readPage(file, pageNum, page);
+    version = readLatch(page);
+
+    bool valid = pageNum == rootPageNum;
+    while (valid && !isLeaf(page)) {
+      NonLeaf *node = (NonLeaf *)page;
+      PageId childNum = T::child(node, T::childIndex(node, key, false));
+      if (!validate(page, version)) {
+        valid = false;
+        break;
+      }
+
+      Page *childPage;
+      bufMgr->readPage(file, childNum, childPage);
+      uint64_t childVersion = readLatch(childPage);
+      valid = validate(page, version);
+
+      bufMgr->unPinPage(file, valid ? pageNum : childNum, false);
+      if (valid) {
+        pageNum = childNum;
+        page = childPage;
+        version = childVersion;
+      }
+    }
+    if (valid) return;
+    bufMgr->unPinPage(file, pageNum, false);
+  }
 }
 
 /**
- * Create a new root with midVal, pid1 and pid2.
- *
- * @param midVal the first middle value of the new root
- * @param pid1 the first page number in the new root
- * @param pid2 the second page number in the new root
- *
- * @return the page id of the new root
+ * @return the scan state of the calling thread
  */
-PageId BTreeIndex::splitRootNode(int midVal, PageId pid1, PageId pid2) {
-  // alloc a new page for root
-  PageId newRoot_pageID;
-  non_leaf_node_int *newRoot = allocNonLeafNode(newRoot_pageID);
-
-  // set key and page numbers
-  newRoot->keyArray[0] = midVal;
-  newRoot->pageNoArray[0] = pid1;
-  newRoot->pageNoArray[1] = pid2;
-
-  // unpin the root page
-  bufMgr->unPinPage(file, newRoot_pageID, true);
-
-  return newRoot_pageID;
+BTreeIndex::ScanState &BTreeIndex::threadScan() {
+  const thread::id self = this_thread::get_id();
+  ScanShard &shard = scanShards[hash<thread::id>()(self) % SCAN_SHARDS];
+  lock_guard<mutex> guard(shard.latch);
+  return shard.scans[self];
 }
 
 /**
- * This is the helper method that inserts the given pair into the given leaf node.
- *
- * @param originalNode a leaf node
- * @param originalPage the page id of the page that stores the leaf node
- * @param key the key of the pair
- * @param rid the record id of the pair
- * @param midVal a reference to an integer in the parent node.
- * @return The page number of the newly created page.
+ * This is the helper method that changes the currently scanning page to the
+ * given right sibling of the current page.
+ * @param scan the scan
+ * @param nextPageNum the page number of the right sibling.
+ * @return false, with the scan left on the current page, if the current page
+ * changed since the scan found its place in it
  */
-PageId BTreeIndex::insertToLeafPage(Page *origPage, PageId originalPage, int key,
-                                    RecordId rid, int &midVal) {
-  leaf_node_int *originalNode = (leaf_node_int *)origPage;
-
-  // finde the insertion index
-  int index = findInsertionIndexLeaf(originalNode, key);
-
-  // if is not full, insert the key and record id
-  if (!isLeafFull(originalNode)) {
-    insertionLeafNode(originalNode, index, key, rid);
-    bufMgr->unPinPage(file, originalPage, true);
-    return 0;
+bool BTreeIndex::moveToNext(ScanState &scan, PageId nextPageNum) {
+  Page *nextPage;
+  bufMgr->readPage(file, nextPageNum, nextPage);
+  uint64_t nextVersion = readLatch(nextPage);
+
+  // the sibling may have been freed before its version was read
+  if (!validate(scan.page, scan.version)) {
+    bufMgr->unPinPage(file, nextPageNum, false);
+    return false;
   }
 
-  // get the middle index for spliting the page
-  const int midIndex = INTARRAYLEAFSIZE / 2;
-
-  // find out whether the new element is insert to the left of the old node
-  bool insertLeft = index < midIndex;
-
-  // allocate a page for the new node
-  PageId newPageId;
-  leaf_node_int *newNode = allocLeafNode(newPageId);
-
-  // split the node to originalNode and newNode
-  splitLeaf(originalNode, newNode, midIndex + insertLeft);
-
-  // insert the key and record id
-  if (insertLeft)
-    insertionLeafNode(originalNode, index, key, rid);
-  else
-    insertionLeafNode(newNode, index - midIndex, key, rid);
-
-  // set the next page id
-  newNode->rightSibPageNo = originalNode->rightSibPageNo;
-  originalNode->rightSibPageNo = newPageId;
-
-  // unpin the new node and the original node
-  bufMgr->unPinPage(file, originalPage, true);
-  bufMgr->unPinPage(file, newPageId, true);
-
-  // set the middle value
-  midVal = newNode->keyArray[0];
-  return newPageId;
+  bufMgr->unPinPage(file, scan.pageNum, false);
+  BADGERDB_TRACE(TRACE_SCAN_PAGE, this, nextPageNum);
+  scan.pageNum = nextPageNum;
+  scan.page = nextPage;
+  scan.version = nextVersion;
+  scan.nextEntry = 0;
+  return true;
 }
 
 /**
- * This is the helper method that recursively insert the given pair into the 
- * subtree with the given root node.
- *
- * @param originalPage page id of the page 
- * @param key the key of the pair to be inserted
- * @param rid the record ID of the key-record pair to be inserted
- * @param midVal a pointer to an integer value to be stored in the parent node.
- * @return the page number of the newly created node if a split occurs, or 0
- *         otherwise.
+ * This is the helper method that puts the scan at the first element not below
+ * target, or above it if after, then past up to skip elements equal to it.
+ * @param scan the scan
+ * @param target the key
+ * @param after whether to start above target
+ * @param skip the number of elements equal to target to move past
+ * @param rid the record id to look for among the elements moved past, or NULL
+ * @param matched receives the number of elements moved past up to the last
+ * with that record id, 0 if there is none
+ * @return false if a leaf changed on the way, and the scan must start over
  */
-PageId BTreeIndex::insert(PageId originalPage, int key, RecordId rid,
-                          int &midVal) {
-  Page *origPage;
-  bufMgr->readPage(file, originalPage, origPage);
-
-  if (isLeaf(origPage)) 
-    return insertToLeafPage(origPage, originalPage, key, rid, midVal);
-
-  non_leaf_node_int *originalNode = (non_leaf_node_int *)origPage;
-
-  // find the page id
-  int origChildPageIndex = findSmallerKeyIndex(originalNode, key);
-  PageId origChildPageId = originalNode->pageNoArray[origChildPageIndex];
-
-  // insert key
-  int newChildMidVal;
-  PageId newChildPageId = insert(origChildPageId, key, rid, newChildMidVal);
+template <class T>
+bool BTreeIndex::place(ScanState &scan, const typename T::Key &target,
+                       bool after, size_t skip, const RecordId *rid,
+                       size_t &matched) {
+  typedef typename T::Leaf Leaf;
+  if (scan.page != NULL) bufMgr->unPinPage(file, scan.pageNum, false);
+  descend<T>(target, scan.pageNum, scan.page, scan.version);
+
+  size_t skipped = 0;
+  matched = 0;
+  while (1) {
+    Leaf *node = (Leaf *)scan.page;
+    int count = entries<T>(node);
+    int i = after ? T::leafUpperBound(node, count, target)
+                  : T::leafLowerBound(node, count, target);
+    for (; skipped < skip && i < count && T::leafKey(node, i) == target;
+         i++) {
+      skipped++;
+      if (rid != NULL && T::leafRid(node, i) == *rid) matched = skipped;
+    }
+    PageId next = node->rightSibPageNo;
+    if (!validate(scan.page, scan.version)) return false;
 
-  // not split in child
-  if (newChildPageId == 0) {
-    bufMgr->unPinPage(file, originalPage, false);
-    return 0;
+    // the place may be at the start of the right sibling
+    if (i < count || next == 0) {
+      scan.nextEntry = i;
+      return true;
+    }
+    if (!moveToNext(scan, next)) return false;
   }
+}
 
-  // add splitted child to currNode
-  int index = findSmallerKeyIndex(originalNode, newChildMidVal);
-  if (!isNonLeafFull(originalNode)) {  // current node is not full
-    insertionNonLeafNode(originalNode, index, newChildMidVal, newChildPageId);
-    bufMgr->unPinPage(file, originalPage, true);
-    return 0;
+/**
+ * This is the helper method that finds the place of the scan from the root:
+ * the first element within the low bound, or the one after the last element
+ * returned.
+ * @param scan the scan
+ */
+template <class T>
+void BTreeIndex::seek(ScanState &scan) {
+  typedef typename T::Key Key;
+  if (!scan.returned) {
+    const Key low = T::value(scan.lowValue);
+    size_t matched;
+    while (!place<T>(scan, low, scan.lowOp == GT, 0, NULL, matched)) {
+    }
+    return;
   }
 
-  // the middle index for spliting the page
-  int midIndex = (INTARRAYNONLEAFSIZE - 1) / 2;
-
-  // check to see that whether the new element is insert to the left half of the original node
-  bool insertLeft = index < midIndex;
-
-  // split
-  int splitIndex = midIndex + insertLeft;
-  int insertIndex = insertLeft ? index : index - midIndex;
-
-  // insert to right
-  bool moveKeyUp = !insertLeft && insertIndex == 0;
-
-  // if we need to move key up, set midVal = key, else key at splited index
-  midVal = moveKeyUp ? newChildMidVal : originalNode->keyArray[splitIndex];
-
-  // alloc a page for the new node
-  PageId newPageId;
-  non_leaf_node_int *newNode = allocNonLeafNode(newPageId);
-
-  // split the node to originalNode and newNode
-  splitNonLeaf(originalNode, newNode, splitIndex, moveKeyUp);
-
-  // need to insert
-  if (!moveKeyUp) {
-    non_leaf_node_int *node = insertLeft ? originalNode : newNode;
-    insertionNonLeafNode(node, insertIndex, newChildMidVal, newChildPageId);
+  // the elements with the last key returned that were returned come first,
+  // less any deleted since: the last one returned is the last with its
+  // record id among them, if it is still there
+  const Key last = T::value(scan.lastKey);
+  while (1) {
+    size_t matched;
+    if (!place<T>(scan, last, false, scan.lastKeyCount, &scan.lastRid,
+                  matched))
+      continue;
+    if (matched == 0 || matched == scan.lastKeyCount) return;
+    if (!place<T>(scan, last, false, matched, NULL, matched)) continue;
+    scan.lastKeyCount = matched;
+    return;
   }
-
-  // write the page back
-  bufMgr->unPinPage(file, originalPage, true);
-  bufMgr->unPinPage(file, newPageId, true);
-
-  // return new page
-  return newPageId;
 }
 
 /**
- * Insert a new entry using the pair <value,rid>.
- * Start from root to recursively find out the leaf to insert the entry in.
- * The insertion may cause splitting of leaf node. This splitting will require
- * addition of new leaf page number entry into the parent non-leaf, which may
- * in-turn get split. This may continue all the way upto the root causing the
- * root to get split. If root gets split, metapage needs to be changed
- * accordingly. Make sure to unpin pages as soon as you can.
- * @param key			Key to insert, pointer to integer/double/char
- *string
- * @param rid			Record ID of a record whose entry is getting
- *inserted into the index.
- **/
-const void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
-  int midval;
-  PageId pid = insert(indexMetaInfo.rootPageNo, *(int *)key, rid, midval);
+ * This is the helper method that reads the next element of the scan without
+ * moving past it, going on to the next leaf if needed.
+ * @param scan the scan
+ * @param key receives the key of the element
+ * @param rid receives the record id of the element
+ * @return false if the scan is past the last leaf
+ */
+template <class T>
+bool BTreeIndex::peek(ScanState &scan, typename T::Key &key, RecordId &rid) {
+  typedef typename T::Leaf Leaf;
+  while (1) {
+    Leaf *node = (Leaf *)scan.page;
+    if (scan.nextEntry < entries<T>(node)) {
+      key = T::leafKey(node, scan.nextEntry);
+      rid = T::leafRid(node, scan.nextEntry);
+      if (validate(scan.page, scan.version)) return true;
+    } else {
+      PageId next = node->rightSibPageNo;
+      if (validate(scan.page, scan.version)) {
+        if (next == 0) return false;
+        if (moveToNext(scan, next)) continue;
+      }
+    }
 
-  if (pid != 0)
-    indexMetaInfo.rootPageNo = splitRootNode(midval, indexMetaInfo.rootPageNo, pid);
+    // the leaf changed since the scan found its place in it
+    seek<T>(scan);
+  }
 }
 
 /**
- * This is the helper method that changes the currently scanning page to the next page pointed 
- * to by the current page.
- * @param node the node stored in the currently scanning page.
+ * This is the helper method that notes that the scan returned n elements
+ * ending with count elements with the given key, the last with the given
+ * record id.
  */
-void BTreeIndex::moveToNext(leaf_node_int *node) {
-  bufMgr->unPinPage(file, currentPageNum, false);
-  currentPageNum = node->rightSibPageNo;
-  bufMgr->readPage(file, currentPageNum, currentPageData);
-  nextEntry = 0;
+template <class T>
+void BTreeIndex::remember(ScanState &scan, const typename T::Key &key,
+                          RecordId rid, size_t n, size_t count) {
+  if (scan.returned && count == n && T::value(scan.lastKey) == key) {
+    scan.lastKeyCount += n;
+  } else {
+    T::value(scan.lastKey) = key;
+    scan.lastKeyCount = count;
+  }
+  scan.lastRid = rid;
+  scan.returned = true;
 }
 
 /**
- * This is the helper method that recursively find the page id of the first element larger than 
- * or equal to the lower bound given.
+ * This is the helper method that checks a key against the high bound of the
+ * scan.
+ * @param scan the scan
+ * @param key the key
+ * @return true if the key is not above the range
  */
-void BTreeIndex::setPageScan() {
-  bufMgr->readPage(file, currentPageNum, currentPageData);
-  if (isLeaf(currentPageData)) return;
-
-  non_leaf_node_int *node = (non_leaf_node_int *)currentPageData;
-
-  bufMgr->unPinPage(file, currentPageNum, false);
-  currentPageNum = node->pageNoArray[findSmallerKeyIndex(node, lowValInt)];
-  setPageScan();
+template <class T>
+bool BTreeIndex::belowHigh(ScanState &scan, const typename T::Key &key) {
+  const typename T::Key &high = T::value(scan.highValue);
+  return scan.highOp == LT ? key < high : !(high < key);
 }
 
 /**
- * This is the helper method that finds the first element in the currently scanning page that 
- * is within the given bound.
+ * startScan() for keys of type T.
  */
-void BTreeIndex::entryScanIndex() {
-  leaf_node_int *node = (leaf_node_int *)currentPageData;
-  int entryIndex = findIndexLeaf(node, lowValInt, lowOp == GTE);
-  if (entryIndex == -1)
-    moveToNext(node);
-  else
-    nextEntry = entryIndex;
+template <class T>
+void BTreeIndex::startScanKeys(ScanState &scan, const void *lowValParm,
+                               const void *highValParm) {
+  typename T::Key low = T::fromBytes((const char *)lowValParm);
+  typename T::Key high = T::fromBytes((const char *)highValParm);
+  if (high < low) throw BadScanrangeException();
+
+  T::value(scan.lowValue) = low;
+  T::value(scan.highValue) = high;
+
+  scan.executing = true;
+  scan.returned = false;
+  scan.page = NULL;
+  seek<T>(scan);
+
+  typename T::Key key;
+  RecordId rid;
+  if (!peek<T>(scan, key, rid) || !belowHigh<T>(scan, key)) {
+    endScan(scan);
+    throw NoSuchKeyFoundException();
+  }
 }
 
 /**
@@ -568,43 +3006,61 @@ const void BTreeIndex::startScan(const void *lowValParm,
                                  const Operator lowOpParm,
                                  const void *highValParm,
                                  const Operator highOpParm) {
+  startScan(threadScan(), lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+/**
+ * This is the helper method that starts the given scan, ending it first if it
+ * is executing.
+ */
+void BTreeIndex::startScan(ScanState &scan, const void *lowValParm,
+                           const Operator lowOpParm, const void *highValParm,
+                           const Operator highOpParm) {
   if (lowOpParm != GT && lowOpParm != GTE) throw BadOpcodesException();
   if (highOpParm != LT && highOpParm != LTE) throw BadOpcodesException();
 
-  lowValInt = *((int *)lowValParm);
-  highValInt = *((int *)highValParm);
-  if (lowValInt > highValInt) throw BadScanrangeException();
-
-  lowOp = lowOpParm;
-  highOp = highOpParm;
-
-  scanExecuting = true;
-
-  currentPageNum = indexMetaInfo.rootPageNo;
-
-  setPageScan();
-  entryScanIndex();
-
-  leaf_node_int *node = (leaf_node_int *)currentPageData;
-  RecordId outRid = node->ridArray[nextEntry];
-  if ((outRid.page_number == 0 && outRid.slot_number == 0) ||
-      node->keyArray[nextEntry] > highValInt ||
-      (node->keyArray[nextEntry] == highValInt && highOp == LT)) {
-    endScan();
-    throw NoSuchKeyFoundException();
+  if (scan.executing) endScan(scan);
+  scan.lowOp = lowOpParm;
+  scan.highOp = highOpParm;
+
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        startScanKeys<PackedIntKeys>(scan, lowValParm, highValParm);
+      else if (indexMetaInfo.includeLength > 0)
+        startScanKeys<IncludedIntKeys>(scan, lowValParm, highValParm);
+      else
+        startScanKeys<IntKeys>(scan, lowValParm, highValParm);
+      break;
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        startScanKeys<IncludedDoubleKeys>(scan, lowValParm, highValParm);
+      else
+        startScanKeys<DoubleKeys>(scan, lowValParm, highValParm);
+      break;
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        startScanKeys<IncludedStringKeys>(scan, lowValParm, highValParm);
+      else
+        startScanKeys<StringKeys>(scan, lowValParm, highValParm);
+      break;
   }
 }
 
 /**
- * This is the helper method that continuely scanning the next entry.
+ * scanNext() for keys of type T.
  */
-void BTreeIndex::setNextEntry() {
-  nextEntry++;
-  leaf_node_int *node = (leaf_node_int *)currentPageData;
-  if (nextEntry >= INTARRAYLEAFSIZE ||
-      node->ridArray[nextEntry].page_number == 0) {
-    moveToNext(node);
+template <class T>
+void BTreeIndex::scanNextKey(ScanState &scan, RecordId &outRid) {
+  typename T::Key key;
+  RecordId rid;
+  if (!peek<T>(scan, key, rid) ||     // past the last leaf
+      !belowHigh<T>(scan, key)) {     // value is out of range
+    throw IndexScanCompletedException();
   }
+  outRid = rid;
+  scan.nextEntry++;
+  remember<T>(scan, key, rid, 1, 1);
 }
 
 /**
@@ -614,23 +3070,209 @@ void BTreeIndex::setNextEntry() {
  *
  * @param outRid An output value
  * @throws ScanNotInitializedException If no scan has been initialized.
- * @throws IndexScanCompletedException If no more records, satisfying the scan 
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
  * criteria, are left to be scanned.
  */
 const void BTreeIndex::scanNext(RecordId &outRid) {
-  if (!scanExecuting) throw ScanNotInitializedException();
+  scanNext(threadScan(), outRid);
+}
+
+/**
+ * This is the helper method that fetches the next record id of the given
+ * scan.
+ */
+void BTreeIndex::scanNext(ScanState &scan, RecordId &outRid) {
+  if (!scan.executing) throw ScanNotInitializedException();
+
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        scanNextKey<PackedIntKeys>(scan, outRid);
+      else if (indexMetaInfo.includeLength > 0)
+        scanNextKey<IncludedIntKeys>(scan, outRid);
+      else
+        scanNextKey<IntKeys>(scan, outRid);
+      break;
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        scanNextKey<IncludedDoubleKeys>(scan, outRid);
+      else
+        scanNextKey<DoubleKeys>(scan, outRid);
+      break;
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        scanNextKey<IncludedStringKeys>(scan, outRid);
+      else
+        scanNextKey<StringKeys>(scan, outRid);
+      break;
+  }
+}
 
-  leaf_node_int *node = (leaf_node_int *)currentPageData;
-  outRid = node->ridArray[nextEntry];
-  int val = node->keyArray[nextEntry];
+/**
+ * scanNextBatch() and scanNextEntries() for keys of type T: the keys and
+ * INCLUDE values are copied with the record ids when keys and includes are
+ * not NULL.
+ */
+template <class T>
+size_t BTreeIndex::scanNextKeys(ScanState &scan, RecordId *out, size_t max,
+                                typename T::Key *keys, char *includes) {
+  typedef typename T::Key Key;
+  typedef typename T::Leaf Leaf;
+  const Key high = T::value(scan.highValue);
+  const int includeLength = indexMetaInfo.includeLength;
+  size_t found = 0;
+  while (found < max) {
+    Leaf *node = (Leaf *)scan.page;
+    int count = entries<T>(node);
+    int first = scan.nextEntry;
+
+    if (first < count) {
+      // the entries of this leaf before the first one above the range
+      int end = scan.highOp == LT
+                    ? T::leafLowerBound(node, count, high)
+                    : T::leafUpperBound(node, count, high);
+
+      size_t len = end > first ? end - first : 0;
+      len = std::min(len, max - found);
+      T::leafRids(node, first, len, &out[found]);
+      if (keys != NULL) T::leafKeys(node, first, len, &keys[found]);
+      if (includes != NULL && includeLength > 0)
+        T::leafIncludes(node, first, len, includeLength,
+                        includes + found * includeLength);
+
+      // the last key copied, and how many of the copied entries have it
+      Key last{};
+      size_t same = 0;
+      if (len > 0) {
+        last = T::leafKey(node, first + len - 1);
+        while (same < len && T::leafKey(node, first + len - 1 - same) == last)
+          same++;
+      }
+      if (!validate(scan.page, scan.version)) {
+        seek<T>(scan);
+        continue;
+      }
+
+      // stop at the end of the range
+      if (len == 0) break;
+      found += len;
+      scan.nextEntry += len;
+      remember<T>(scan, last, out[found - 1], len, same);
+      continue;
+    }
 
-  if ((outRid.page_number == 0 &&
-       outRid.slot_number == 0) ||            // empty record ID is empty
-      val > highValInt ||                     // value is out of range
-      (val == highValInt && highOp == LT)) {  // value reaches the higher end
-    throw IndexScanCompletedException();
+    // stop at the end of the last leaf
+    PageId next = node->rightSibPageNo;
+    if (!validate(scan.page, scan.version)) {
+      seek<T>(scan);
+      continue;
+    }
+    if (next == 0) break;
+    if (!moveToNext(scan, next)) seek<T>(scan);
+  }
+  return found;
+}
+
+/**
+ * This method fetches the record ids of up to max next tuples that match the
+ * scan criteria, copying them from the leaves a run at a time.
+ *
+ * @param out Receives the record ids found
+ * @param max Number of record ids out has room for
+ * @return the number of record ids found, less than max once the scan is at
+ * its end
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ */
+size_t BTreeIndex::scanNextBatch(RecordId *out, size_t max) {
+  return scanNextBatch(threadScan(), out, max);
+}
+
+/**
+ * This is the helper method that fetches up to max next record ids of the
+ * given scan.
+ */
+size_t BTreeIndex::scanNextBatch(ScanState &scan, RecordId *out, size_t max) {
+  if (!scan.executing) throw ScanNotInitializedException();
+
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        return scanNextKeys<PackedIntKeys>(scan, out, max, NULL, NULL);
+      if (indexMetaInfo.includeLength > 0)
+        return scanNextKeys<IncludedIntKeys>(scan, out, max, NULL, NULL);
+      return scanNextKeys<IntKeys>(scan, out, max, NULL, NULL);
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        return scanNextKeys<IncludedDoubleKeys>(scan, out, max, NULL, NULL);
+      return scanNextKeys<DoubleKeys>(scan, out, max, NULL, NULL);
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        return scanNextKeys<IncludedStringKeys>(scan, out, max, NULL, NULL);
+      return scanNextKeys<StringKeys>(scan, out, max, NULL, NULL);
+  }
+  return 0;
+}
+
+/**
+ * This method fetches up to max next tuples that match the scan criteria,
+ * with their keys and INCLUDE values, from the leaves alone.
+ *
+ * @param keys Receives the keys, an array of the type of the key
+ * @param outRids Receives the record ids
+ * @param max Number of entries the arrays have room for
+ * @param includes Receives the INCLUDE values, includeLength() bytes each,
+ * unless NULL
+ * @return the number of entries found, less than max once the scan is at its
+ * end
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ */
+size_t BTreeIndex::scanNextEntries(void *keys, RecordId *outRids, size_t max,
+                                   void *includes) {
+  return scanNextEntries(threadScan(), keys, outRids, max, includes);
+}
+
+/**
+ * This is the helper method that fetches up to max next entries of the given
+ * scan, with their keys and INCLUDE values.
+ */
+size_t BTreeIndex::scanNextEntries(ScanState &scan, void *keys,
+                                   RecordId *outRids, size_t max,
+                                   void *includes) {
+  if (!scan.executing) throw ScanNotInitializedException();
+
+  char *bytes = (char *)includes;
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        return scanNextKeys<PackedIntKeys>(scan, outRids, max, (int *)keys,
+                                           bytes);
+      if (indexMetaInfo.includeLength > 0)
+        return scanNextKeys<IncludedIntKeys>(scan, outRids, max, (int *)keys,
+                                             bytes);
+      return scanNextKeys<IntKeys>(scan, outRids, max, (int *)keys, bytes);
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        return scanNextKeys<IncludedDoubleKeys>(scan, outRids, max,
+                                                (double *)keys, bytes);
+      return scanNextKeys<DoubleKeys>(scan, outRids, max, (double *)keys,
+                                      bytes);
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        return scanNextKeys<IncludedStringKeys>(scan, outRids, max,
+                                                (StringKey *)keys, bytes);
+      return scanNextKeys<StringKeys>(scan, outRids, max, (StringKey *)keys,
+                                      bytes);
   }
-  setNextEntry();
+  return 0;
+}
+
+/**
+ * This is the helper method that ends the given scan and unpins its page.
+ */
+void BTreeIndex::endScan(ScanState &scan) {
+  scan.executing = false;
+  bufMgr->unPinPage(file, scan.pageNum, false);
+  scan.page = NULL;
 }
 
 /**
@@ -640,21 +3282,187 @@ const void BTreeIndex::scanNext(RecordId &outRid) {
  * @throws ScanNotInitializedException If no scan has been initialized.
  */
 const void BTreeIndex::endScan() {
-  if (!scanExecuting) throw ScanNotInitializedException();
-  scanExecuting = false;
-  bufMgr->unPinPage(file, currentPageNum, false);
+  ScanState &scan = threadScan();
+  if (!scan.executing) throw ScanNotInitializedException();
+  endScan(scan);
+}
+
+/**
+ * lookup() for keys of type T.
+ */
+template <class T>
+size_t BTreeIndex::lookupKey(const typename T::Key &key,
+                             vector<RecordId> &outRids) {
+  typedef typename T::Leaf Leaf;
+  if (filter != NULL && !filter->mayContain(T::hash(key))) return 0;
+
+  // the entries with the key may go on into right siblings
+  ScanState scan;
+  while (1) {
+    outRids.clear();
+    size_t matched;
+    if (!place<T>(scan, key, false, 0, NULL, matched)) continue;
+
+    bool valid = true;
+    while (1) {
+      Leaf *node = (Leaf *)scan.page;
+      int count = entries<T>(node);
+      int i = scan.nextEntry;
+      for (; i < count && T::leafKey(node, i) == key; i++)
+        outRids.push_back(T::leafRid(node, i));
+      PageId next = node->rightSibPageNo;
+      valid = validate(scan.page, scan.version);
+      if (!valid || i < count || next == 0) break;
+      valid = moveToNext(scan, next);
+      if (!valid) break;
+    }
+    if (valid) break;
+  }
+  bufMgr->unPinPage(file, scan.pageNum, false);
+  return outRids.size();
+}
+
+/**
+ * This method finds the record ids of every entry with the given key, without
+ * a scan.
+ *
+ * @param key Key to find, pointer to integer/double/char string
+ * @param outRids Receives the record ids, in the order of the entries
+ * @return the number of record ids found, 0 if the key is not in the index
+ */
+size_t BTreeIndex::lookup(const void *key, vector<RecordId> &outRids) {
+  const char *bytes = (const char *)key;
+  outRids.clear();
+  switch (attributeType) {
+    case INTEGER:
+      if (indexMetaInfo.packedLeaves)
+        return lookupKey<PackedIntKeys>(IntKeys::fromBytes(bytes), outRids);
+      if (indexMetaInfo.includeLength > 0)
+        return lookupKey<IncludedIntKeys>(IntKeys::fromBytes(bytes), outRids);
+      return lookupKey<IntKeys>(IntKeys::fromBytes(bytes), outRids);
+    case DOUBLE:
+      if (indexMetaInfo.includeLength > 0)
+        return lookupKey<IncludedDoubleKeys>(DoubleKeys::fromBytes(bytes),
+                                             outRids);
+      return lookupKey<DoubleKeys>(DoubleKeys::fromBytes(bytes), outRids);
+    case STRING:
+      if (indexMetaInfo.includeLength > 0)
+        return lookupKey<IncludedStringKeys>(StringKeys::fromBytes(bytes),
+                                             outRids);
+      return lookupKey<StringKeys>(StringKeys::fromBytes(bytes), outRids);
+  }
+  return 0;
+}
+
+/**
+ * Begin a filtered scan of the index in a cursor of its own.
+ *
+ * @param lowValParm The low value to be tested.
+ * @param lowOpParm The operation to be used in testing the low range.
+ * @param highValParm The high value to be tested.
+ * @param highOpParm The operation to be used in testing the high range.
+ * @return the cursor
+ */
+BTreeScan BTreeIndex::openScan(const void *lowValParm,
+                               const Operator lowOpParm,
+                               const void *highValParm,
+                               const Operator highOpParm) {
+  BTreeScan cursor(this);
+  startScan(cursor.state, lowValParm, lowOpParm, highValParm, highOpParm);
+  return cursor;
+}
+
+/**
+ * BTreeScan
+ *
+ * A cursor is a ScanState of its own; the index does all the work on it.
+ * Moving a cursor hands over the pin of its leaf.
+ */
+BTreeScan::BTreeScan(BTreeScan &&other)
+    : index(other.index), state(other.state) {
+  other.state.executing = false;
+  other.state.page = NULL;
+}
+
+BTreeScan &BTreeScan::operator=(BTreeScan &&other) {
+  if (this != &other) {
+    if (state.executing) index->endScan(state);
+    index = other.index;
+    state = other.state;
+    other.state.executing = false;
+    other.state.page = NULL;
+  }
+  return *this;
+}
+
+/**
+ * Closes the scan if it is still open.
+ */
+BTreeScan::~BTreeScan() {
+  if (state.executing) index->endScan(state);
+}
+
+/**
+ * Fetch the record id of the next index entry that matches the scan.
+ *
+ * @param outRid An output value
+ * @throws ScanNotInitializedException If the scan has been closed.
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ * criteria, are left to be scanned.
+ */
+void BTreeScan::next(RecordId &outRid) { index->scanNext(state, outRid); }
+
+/**
+ * Fetch the record ids of up to max next index entries that match the scan.
+ *
+ * @param out Receives the record ids found
+ * @param max Number of record ids out has room for
+ * @return the number of record ids found
+ * @throws ScanNotInitializedException If the scan has been closed.
+ */
+size_t BTreeScan::nextBatch(RecordId *out, size_t max) {
+  return index->scanNextBatch(state, out, max);
+}
+
+/**
+ * Fetch up to max next index entries that match the scan, with their keys and
+ * INCLUDE values.
+ *
+ * @param keys Receives the keys
+ * @param outRids Receives the record ids
+ * @param max Number of entries the arrays have room for
+ * @param includes Receives the INCLUDE values, unless NULL
+ * @return the number of entries found
+ * @throws ScanNotInitializedException If the scan has been closed.
+ */
+size_t BTreeScan::nextEntries(void *keys, RecordId *outRids, size_t max,
+                              void *includes) {
+  return index->scanNextEntries(state, keys, outRids, max, includes);
+}
+
+/**
+ * Terminate the scan and unpin its leaf.
+ *
+ * @throws ScanNotInitializedException If the scan has been closed.
+ */
+void BTreeScan::close() {
+  if (!state.executing) throw ScanNotInitializedException();
+  index->endScan(state);
 }
 
   /**
-   * BTreeIndex Destructor. 
+   * BTreeIndex Destructor.
    * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
    * and delete file instance thereby closing the index file.
-   * Destructor should not throw any exceptions. All exceptions should be caught in here itself. 
+   * Destructor should not throw any exceptions. All exceptions should be caught in here itself.
    * */
 BTreeIndex::~BTreeIndex() {
-  if (scanExecuting) endScan();
+  for (ScanShard &shard : scanShards)
+    for (auto &entry : shard.scans)
+      if (entry.second.executing) endScan(entry.second);
   bufMgr->flushFile(file);
   delete file;
+  if (filter != NULL) filter->save(filterName);
 }
 
-} 
\ No newline at end of file
+}
@@ -8,11 +8,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "string.h"
 
+#include "bloomFilter.h"
 #include "buffer.h"
 #include "file.h"
 #include "page.h"
@@ -38,18 +47,154 @@ enum Operator {
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr             key
-//                                                  rid
+//                                      version, level, count   sibling ptr
+//                                      key               rid
 const int INTARRAYLEAFSIZE =
-    (Page::SIZE - sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (sizeof(int) + sizeof(RecordId));
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo
-//                                                     key       pageNo
-const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) /
-                                (sizeof(int) + sizeof(PageId));
+//                                      version, level, count   extra pageNo
+//                                      key               pageNo
+const int INTARRAYNONLEAFSIZE =
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (sizeof(int) + sizeof(PageId));
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                      version, level, count   sibling ptr
+//                                      key               rid
+const int DOUBLEARRAYLEAFSIZE =
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (sizeof(double) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+//                                      version, level, count   extra pageNo
+//                                      key               pageNo
+const int DOUBLEARRAYNONLEAFSIZE =
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (sizeof(double) + sizeof(PageId));
+
+/**
+ * @brief Number of bytes holding the keys and record ids of a packed B+Tree
+ * leaf for INTEGER key.
+ */
+//                                      version, level, count, base
+//                                      sibling ptr       key width, pages
+const int INTPACKEDLEAFBYTES =
+    Page::DATA_SIZE - sizeof(std::uint64_t) - 3 * sizeof(int) -
+    sizeof(PageId) - 2 * sizeof(std::uint8_t);
+
+/**
+ * @brief Most distinct pages the record ids of a packed B+Tree leaf lie on.
+ */
+const int INTPACKEDLEAFPAGES = 255;
+
+/**
+ * @brief Most pairs a packed B+Tree leaf for INTEGER key holds, with keys of
+ * one byte and record ids on one page.
+ */
+//                                      page
+//                                      key, slot, page index
+const int INTPACKEDLEAFSIZE = (INTPACKEDLEAFBYTES - sizeof(PageId)) /
+                              (1 + sizeof(SlotId) + sizeof(std::uint8_t));
+
+/**
+ * @brief Number of bytes of a STRING key. Keys are the first STRINGSIZE bytes
+ * of the attribute, padded with NULs.
+ */
+const int STRINGSIZE = 32;
+
+/**
+ * @brief A STRING key, compared byte by byte.
+ */
+struct StringKey {
+  char data[STRINGSIZE];
+};
+
+inline bool operator<(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) < 0;
+}
+
+inline bool operator==(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) == 0;
+}
+
+inline bool operator!=(const StringKey &a, const StringKey &b) {
+  return !(a == b);
+}
+
+/**
+ * @brief Number of key slots in B+Tree leaf for STRING key.
+ */
+//                                      version, level, count   sibling ptr
+//                                      key               rid
+const int STRINGARRAYLEAFSIZE =
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (STRINGSIZE + sizeof(RecordId));
+
+/**
+ * @brief Most bytes of the INCLUDE column of an index, a range of bytes of the
+ * records kept in the leaves next to every key.
+ */
+const int INCLUDESIZE = 16;
+
+/**
+ * @brief The INCLUDE value of an entry, padded with NULs.
+ */
+struct IncludeValue {
+  char data[INCLUDESIZE];
+};
+
+/**
+ * @brief Number of key slots in B+Tree leaf with an INCLUDE column, for
+ * INTEGER, DOUBLE and STRING key.
+ */
+//                                      version, level, count   sibling ptr
+//                                      key               rid   include
+const int INTINCLUDELEAFSIZE =
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (sizeof(int) + sizeof(RecordId) + INCLUDESIZE);
+const int DOUBLEINCLUDELEAFSIZE =
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (sizeof(double) + sizeof(RecordId) + INCLUDESIZE);
+const int STRINGINCLUDELEAFSIZE =
+    (Page::DATA_SIZE - sizeof(std::uint64_t) - 2 * sizeof(int) -
+     sizeof(PageId)) /
+    (STRINGSIZE + sizeof(RecordId) + INCLUDESIZE);
+
+/**
+ * @brief Number of bytes holding the children and keys of a B+Tree non-leaf
+ * for STRING key.
+ */
+//                                      version, level, count   prefix length,
+//                                      prefix                  key bytes
+const int STRINGNONLEAFBYTES = Page::DATA_SIZE - sizeof(std::uint64_t) -
+                               2 * sizeof(int) - STRINGSIZE - 2 * sizeof(short);
+
+/**
+ * @brief Default fraction of the slots of each node filled when the index is
+ * bulk loaded. The slack lets later inserts land without splitting at once.
+ */
+const float BULKLOAD_FILL_FACTOR = 0.9f;
+
+/**
+ * @brief Default number of bytes of (key, rid) pairs sorted in memory while
+ * bulk loading. Larger relations are sorted in runs spilled to temporary files.
+ */
+const std::size_t BULKLOAD_SORT_MEMORY = 64 * 1024 * 1024;
 
 /**
  * @brief The meta page, which holds metadata for Index file, is always first
@@ -81,6 +226,61 @@ struct IndexMetaInfo {
    * Page number of root page of the B+ Tree inside the file index file.
    */
   PageId rootPageNo;
+
+  /**
+   * Page number of the first freed node, 0 if there is none.
+   */
+  PageId freePageNo;
+
+  /**
+   * Whether the leaves are packed leaf_node_int_packed nodes, which only
+   * indexes on INTEGER keys have.
+   */
+  bool packedLeaves;
+
+  /**
+   * Offset and length of the INCLUDE column inside records, whose bytes the
+   * leaves keep with every key; a length of 0 for an index without one.
+   */
+  int includeByteOffset;
+  int includeLength;
+};
+
+/**
+ * @brief The shape of an index, as found by a walk of all its nodes.
+ */
+struct IndexShape {
+  /**
+   * Number of levels of nodes, 1 for a root that is a leaf.
+   */
+  int height = 0;
+
+  /**
+   * Number of leaves and of internal nodes in the tree.
+   */
+  std::size_t leaves = 0;
+  std::size_t nonLeaves = 0;
+
+  /**
+   * Number of entries in the leaves.
+   */
+  std::size_t entries = 0;
+
+  /**
+   * Fraction of the slots of the leaves that hold entries.
+   */
+  double leafFill = 0;
+};
+
+/**
+ * @brief Counts of the splits of an index since it was opened, and the time
+ * they took, kept apart for leaves and internal nodes.
+ */
+struct SplitStats {
+  std::uint64_t leafSplits = 0;
+  std::uint64_t nonLeafSplits = 0;
+  std::uint64_t leafSplitNanos = 0;
+  std::uint64_t nonLeafSplitNanos = 0;
 };
 
 /*
@@ -90,45 +290,86 @@ are the format in which the information is stored in the pages for the index
 file depending on what kind of node they are. The level memeber of each non leaf
 structure seen below is set to 1 if the nodes at this level are just above the
 leaf nodes. Otherwise set to 0.
+
+Every node starts with the header of its page, in which File and BufMgr keep
+the number, LSN and checksum of the page, so the fields of the node follow it
+in the Page::DATA_SIZE bytes of the data area.
+
+After the page header every node has a version, the latch of optimistic lock
+coupling: it is odd while a thread modifies the node and grows each time one is
+done, so that readers, which take no latch, can tell if the node changed under
+them.
 */
 
 /**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ * @brief Structure for non-leaf nodes whose keys are stored in an array, for
+ * INTEGER and DOUBLE keys.
  */
-struct non_leaf_node_int {
+template <class Key, int SIZE>
+struct non_leaf_node {
+  /**
+   * Header of the page, which File and BufMgr keep; the node leaves it alone.
+   */
+  PageHeader header;
+
+  /**
+   * Version of the node, odd while it is being modified.
+   */
+  std::uint64_t version = 0;
+
   /**
    * Level of the node in the tree.
    */
   int level = 0;
 
+  /**
+   * Number of child pages in pageNoArray, one more than the number of keys.
+   */
+  int count = 0;
+
   /**
    * Stores keys.
    */
-  int keyArray[INTARRAYNONLEAFSIZE]{};
+  Key keyArray[SIZE]{};
 
   /**
    * Stores page numbers of child pages which themselves are other non-leaf/leaf
    * nodes in the tree.
    */
-  PageId pageNoArray[INTARRAYNONLEAFSIZE + 1]{};
+  PageId pageNoArray[SIZE + 1]{};
 };
 
 /**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all leaf nodes.
  */
+template <class Key, int SIZE>
+struct leaf_node {
+  /**
+   * Header of the page, which File and BufMgr keep; the node leaves it alone.
+   */
+  PageHeader header;
+
+  /**
+   * Version of the node, odd while it is being modified.
+   */
+  std::uint64_t version = 0;
 
-struct leaf_node_int {
   int level = -1;
 
+  /**
+   * Number of entries in keyArray and ridArray.
+   */
+  int count = 0;
+
   /**
    * Stores keys.
    */
-  int keyArray[INTARRAYLEAFSIZE]{};
+  Key keyArray[SIZE]{};
 
   /**
    * Stores RecordIds.
    */
-  RecordId ridArray[INTARRAYLEAFSIZE]{};
+  RecordId ridArray[SIZE]{};
 
   /**
    * Page number of the leaf on the right side.
@@ -138,12 +379,454 @@ struct leaf_node_int {
   PageId rightSibPageNo = 0;
 };
 
+typedef non_leaf_node<int, INTARRAYNONLEAFSIZE> non_leaf_node_int;
+typedef leaf_node<int, INTARRAYLEAFSIZE> leaf_node_int;
+typedef non_leaf_node<double, DOUBLEARRAYNONLEAFSIZE> non_leaf_node_double;
+typedef leaf_node<double, DOUBLEARRAYLEAFSIZE> leaf_node_double;
+typedef leaf_node<StringKey, STRINGARRAYLEAFSIZE> leaf_node_string;
+
+/**
+ * @brief Structure for leaf nodes of an index with an INCLUDE column, which
+ * keep the INCLUDE value of every entry after its record id.
+ */
+template <class Key, int SIZE>
+struct leaf_node_include {
+  /**
+   * Header of the page, which File and BufMgr keep; the node leaves it alone.
+   */
+  PageHeader header;
+
+  /**
+   * Version of the node, odd while it is being modified.
+   */
+  std::uint64_t version = 0;
+
+  int level = -1;
+
+  /**
+   * Number of entries in keyArray, ridArray and includeArray.
+   */
+  int count = 0;
+
+  /**
+   * Stores keys.
+   */
+  Key keyArray[SIZE]{};
+
+  /**
+   * Stores RecordIds.
+   */
+  RecordId ridArray[SIZE]{};
+
+  /**
+   * Stores the INCLUDE values.
+   */
+  IncludeValue includeArray[SIZE]{};
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+  PageId rightSibPageNo = 0;
+};
+
+typedef leaf_node_include<int, INTINCLUDELEAFSIZE> leaf_node_int_include;
+typedef leaf_node_include<double, DOUBLEINCLUDELEAFSIZE>
+    leaf_node_double_include;
+typedef leaf_node_include<StringKey, STRINGINCLUDELEAFSIZE>
+    leaf_node_string_include;
+
+/**
+ * @brief Structure for packed leaf nodes for INTEGER key, which hold two to
+ * three times as many pairs as leaf_node_int. Keys are stored as their
+ * difference from the smallest key of the leaf, in the fewest of 1, 2 or 4
+ * bytes that hold the largest difference. Record ids are stored as their slot
+ * number and the index of their page in a table of the distinct pages of the
+ * leaf, so that keys close together, of tuples stored together, take 4 or 5
+ * bytes a pair instead of 12.
+ */
+struct leaf_node_int_packed {
+  /**
+   * Header of the page, which File and BufMgr keep; the node leaves it alone.
+   */
+  PageHeader header;
+
+  /**
+   * Version of the node, odd while it is being modified.
+   */
+  std::uint64_t version = 0;
+
+  int level = -1;
+
+  /**
+   * Number of pairs.
+   */
+  int count = 0;
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+  PageId rightSibPageNo = 0;
+
+  /**
+   * Smallest key of the leaf, that the stored keys are differences from.
+   */
+  int base = 0;
+
+  /**
+   * Number of bytes of every stored key, 1, 2 or 4.
+   */
+  std::uint8_t keyWidth = 1;
+
+  /**
+   * Number of pages in the page table, at most INTPACKEDLEAFPAGES.
+   */
+  std::uint8_t pages = 0;
+
+  /**
+   * The page table, then the count keys, then the count slot numbers of the
+   * record ids, then the count indexes of their pages in the table of one
+   * byte each.
+   */
+  char data[INTPACKEDLEAFBYTES]{};
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ * Keys are kept short so that many fit: every key of the node starts with
+ * the node's prefix, which is stored once, keys are stored without their
+ * trailing NULs, and the keys separating leaves are cut to the shortest
+ * prefix of the right leaf's first key that is still above the left leaf's
+ * last key.
+ */
+struct non_leaf_node_string {
+  /**
+   * Header of the page, which File and BufMgr keep; the node leaves it alone.
+   */
+  PageHeader header;
+
+  /**
+   * Version of the node, odd while it is being modified.
+   */
+  std::uint64_t version = 0;
+
+  /**
+   * Level of the node in the tree.
+   */
+  int level = 0;
+
+  /**
+   * Number of child pages, one more than the number of keys.
+   */
+  int count = 0;
+
+  /**
+   * Number of bytes of prefix every key of the node starts with.
+   */
+  short prefixLength = 0;
+
+  /**
+   * Number of bytes of keys stored after their prefix.
+   */
+  short keyBytes = 0;
+
+  /**
+   * Bytes every key of the node starts with.
+   */
+  char prefix[STRINGSIZE]{};
+
+  /**
+   * The count page numbers of the children, then the end offsets of the
+   * count - 1 keys within the key bytes as shorts, then the key bytes.
+   */
+  char data[STRINGNONLEAFBYTES]{};
+};
+
+/**
+ * @brief Level of the nodes deletes and compaction took out of the tree.
+ */
+const int FREENODELEVEL = -2;
+
+/**
+ * @brief Structure for freed nodes, kept in a list for reuse by new nodes.
+ * The version goes on from that of the node, so that a reader that still
+ * holds its page number can tell that it changed.
+ */
+struct free_node {
+  /**
+   * Header of the page, which File and BufMgr keep; the node leaves it alone.
+   */
+  PageHeader header;
+
+  /**
+   * Version of the node, odd while it is being modified.
+   */
+  std::uint64_t version = 0;
+
+  int level = FREENODELEVEL;
+
+  /**
+   * Page number of the next freed node, 0 at the end of the list.
+   */
+  PageId nextFreePageNo = 0;
+};
+
+/**
+ * @brief The key, of the type of the index, of the bounds of a scan.
+ */
+union KeyValue {
+  int intValue;
+  double doubleValue;
+  StringKey stringValue;
+};
+
+/**
+ * @brief A key and the record id of the tuple it was taken from.
+ */
+template <class Key>
+struct KeyRid {
+  Key key;
+  RecordId rid;
+
+  /**
+   * Orders by key, then by record id so that the order is deterministic.
+   */
+  bool operator<(const KeyRid &rhs) const {
+    if (key < rhs.key) return true;
+    if (rhs.key < key) return false;
+    if (rid.page_number != rhs.rid.page_number)
+      return rid.page_number < rhs.rid.page_number;
+    return rid.slot_number < rhs.rid.slot_number;
+  }
+};
+
+typedef KeyRid<int> IntKeyRid;
+
+/**
+ * @brief A key with the INCLUDE value of its tuple, ordered by the key alone,
+ * which the bulk load of an index with an INCLUDE column sorts.
+ */
+template <class Key>
+struct IncludedKey {
+  Key key;
+  IncludeValue include;
+
+  bool operator<(const IncludedKey &rhs) const { return key < rhs.key; }
+};
+
+/**
+ * @brief Sorts the (key, rid) pairs of a relation for the bulk load. Pairs are
+ * sorted in memory until they exceed the given budget, then written out as
+ * sorted runs to temporary files which next() merges back in one pass. A
+ * parallel bulk load fills one sorter per thread and merges them into another
+ * with merge(). Instantiated for int, double and StringKey keys, and for them
+ * as IncludedKey.
+ */
+template <class Key>
+class SortedKeyRids {
+ public:
+  /**
+   * @param sortMemory number of bytes of pairs to keep in memory
+   */
+  explicit SortedKeyRids(std::size_t sortMemory);
+
+  /**
+   * Closes and thereby removes the temporary run files.
+   */
+  ~SortedKeyRids();
+
+  /**
+   * Adds a pair. Must not be called after finish().
+   */
+  void add(const Key &key, RecordId rid);
+
+  /**
+   * Sorts the pairs still in memory and prepares the merge of the runs.
+   */
+  void finish();
+
+  /**
+   * Fetches the next pair in sorted order.
+   *
+   * @param out the next pair
+   * @return false if all pairs have been returned
+   */
+  bool next(KeyRid<Key> &out);
+
+  /**
+   * Takes the pairs of sorters on which finish() has been called, instead of
+   * adding pairs and calling finish(). If none of them wrote runs, they are
+   * merged into memory by the given number of threads, each merging one range
+   * of keys; otherwise next() merges them as it goes, like runs.
+   *
+   * @param sorted the sorters, left empty
+   * @param threads the number of threads to merge with
+   */
+  void merge(std::vector<std::unique_ptr<SortedKeyRids>> &sorted,
+             unsigned threads);
+
+  /**
+   * @return the number of pairs added
+   */
+  std::size_t size() const { return total; }
+
+ private:
+  /**
+   * Sorts the pairs in memory and writes them to a new run file.
+   */
+  void spill();
+
+  /**
+   * Reads the next pair of a run, or of a part if there are parts, into the
+   * merge heap, if it has one.
+   */
+  void pull(std::size_t run);
+
+  /**
+   * Merges the parts, none of which wrote runs, into pairs.
+   */
+  void mergeInMemory(unsigned threads);
+
+  std::vector<KeyRid<Key>> pairs;
+  std::size_t capacity;
+  std::size_t total{};
+  std::size_t nextPair{};
+  std::vector<std::FILE *> runs;
+  std::vector<std::unique_ptr<SortedKeyRids>> parts;
+  std::vector<std::pair<KeyRid<Key>, std::size_t>> heap;
+};
+
 /**
  * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
- * of a relation. This index supports only one scan at a time.
+ * of a relation. Every thread may run one scan of the index at a time, while
+ * other threads insert into it.
+ *
+ * The algorithms are written once as member templates over a key type T,
+ * defined in btree.cpp for each Datatype, which gives the key, the leaf and
+ * non-leaf structures and the operations on the non-leaf nodes.
+ *
+ * Threads synchronise with optimistic lock coupling on the versions of the
+ * nodes. Readers take no latch: they read a node, then check that its version
+ * has not changed, and start over from the root if it has. Inserts latch only
+ * the node they modify and its parent, and split full nodes on the way down
+ * before the parent could run out of room. A scan remembers the last key it
+ * returned, and finds its place again from the root if its leaf changes; new
+ * entries are placed after those with an equal key, so that none of the
+ * entries the scan has returned move in front of it. The buffer manager must
+ * be safe for use by several threads.
+ *
+ * Deletes rebalance lazily: a leaf left empty is freed at once if its left
+ * sibling has the same parent, and compact() merges leaves left under half
+ * full. Freed nodes are kept in a list for new nodes to reuse; their versions
+ * go on growing, so that readers still holding their page numbers notice.
+ *
+ * Besides the one scan each thread runs through startScan(), any number of
+ * scans can be opened with openScan(), each in a BTreeScan of its own.
+ *
+ * An index on INTEGER keys may be built with packed leaves, with the key type
+ * PackedIntKeys: fewer leaves to read for a scan and to cache, for a few
+ * instructions more to decode a key, and a leaf encoded again on every change.
+ *
+ * lookup() finds the entries with one key without a scan. An index may keep a
+ * Bloom filter of its keys, with which lookup() answers most keys not in the
+ * index without reading any page. The filter is saved next to the index file
+ * when the index is closed and removed when it is opened, so that an index
+ * that was not closed builds its filter again from the leaves.
+ *
+ * scanNextEntries() returns the keys of the entries with their record ids,
+ * read from the leaves, for queries that need nothing but the key. An index
+ * may also be built with an INCLUDE column, up to INCLUDESIZE bytes of every
+ * record kept next to its key, which scans return too without reading the
+ * relation; its leaves, with the key types Included, hold fewer entries.
  */
+class BTreeScan;
+
 class BTreeIndex {
  private:
+  friend class BTreeScan;
+
+  /**
+   * @brief The state of one scan.
+   */
+  struct ScanState {
+    /**
+     * True if an index scan has been started.
+     */
+    bool executing{};
+
+    /**
+     * Page number of current page being scanned.
+     */
+    PageId pageNum{};
+
+    /**
+     * Current Page being scanned, pinned until the scan moves on.
+     */
+    Page *page{};
+
+    /**
+     * Version of the current page when the scan found its place in it.
+     */
+    std::uint64_t version{};
+
+    /**
+     * Index of next entry to be scanned in current leaf being scanned.
+     */
+    int nextEntry{};
+
+    /**
+     * Low value for scan.
+     */
+    KeyValue lowValue{};
+
+    /**
+     * High value for scan.
+     */
+    KeyValue highValue{};
+
+    /**
+     * Low Operator. Can only be GT(>) or GTE(>=).
+     */
+    Operator lowOp{GT};
+
+    /**
+     * High Operator. Can only be LT(<) or LTE(<=).
+     */
+    Operator highOp{LT};
+
+    /**
+     * True once the scan has returned an entry.
+     */
+    bool returned{};
+
+    /**
+     * Key of the last entry returned.
+     */
+    KeyValue lastKey{};
+
+    /**
+     * Number of entries with the last key returned.
+     */
+    std::size_t lastKeyCount{};
+
+    /**
+     * Record id of the last entry returned.
+     */
+    RecordId lastRid{};
+  };
+
+  /**
+   * Number of shards of the scan states, each with its own latch.
+   */
+  static const int SCAN_SHARDS = 16;
+
+  /**
+   * @brief The scan states of the threads whose ids hash to one shard.
+   */
+  struct ScanShard {
+    std::mutex latch;
+    std::unordered_map<std::thread::id, ScanState> scans;
+  };
+
   /**
    * File object for the index file.
    */
@@ -154,6 +837,11 @@ class BTreeIndex {
    */
   BufMgr *bufMgr{};
 
+  /**
+   * Page number of the meta page, the first page of the index file.
+   */
+  PageId headerPageNum{};
+
   /**
    * Datatype of attribute over which index is built.
    */
@@ -164,65 +852,62 @@ class BTreeIndex {
    */
   int attrByteOffset{};
 
-  // MEMBERS SPECIFIC TO SCANNING
-
   /**
-   * True if an index scan has been started.
+   * Page number of the root, changed with the root latched when it splits.
    */
-  bool scanExecuting{};
+  std::atomic<PageId> rootPageNum{};
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Serialises writes of the meta page, and of the list of freed nodes.
    */
-  int nextEntry{};
+  std::mutex metaLatch;
 
   /**
-   * Page number of current page being scanned.
+   * Bloom filter of the keys inserted into the index, or NULL if it has none.
    */
-  PageId currentPageNum{};
+  std::unique_ptr<BloomFilter> filter;
 
   /**
-   * Current Page being scanned.
+   * Name of the file the Bloom filter is saved to.
    */
-  Page *currentPageData{};
+  std::string filterName;
 
-  /**
-   * Low INTEGER value for scan.
-   */
-  int lowValInt{};
+  // MEMBERS SPECIFIC TO SCANNING
 
   /**
-   * High INTEGER value for scan.
+   * Scan states of the threads that have scanned the index with startScan().
    */
-  int highValInt{};
+  ScanShard scanShards[SCAN_SHARDS];
+
+  struct IndexMetaInfo indexMetaInfo {};
 
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * Splits done so far and the nanoseconds they took, of leaves and of
+   * internal nodes; a split that grows a new root counts its root.
    */
-  Operator lowOp{GT};
+  std::atomic<std::uint64_t> leafSplits{};
+  std::atomic<std::uint64_t> nonLeafSplits{};
+  std::atomic<std::uint64_t> leafSplitNanos{};
+  std::atomic<std::uint64_t> nonLeafSplitNanos{};
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Allocate a zeroed page in the buffer for a node, taking the first freed
+   * node if there is one.
+   *
+   * @param newPageId the page number of the new node
+   * @param level the level of the node, -1 for a leaf
+   * @return the page of the new node
    */
-  Operator highOp{LT};
-
-  struct IndexMetaInfo indexMetaInfo {};
+  Page *allocNode(PageId &newPageId, int level);
 
   /**
-   * Alloc a page in the buffer for a leaf node
+   * Put a node that is no longer in the tree at the head of the freed nodes,
+   * with its latch held.
    *
-   * @param newPageId the page number for the new node
-   * @return a pointer to the new leaf node
+   * @param pageNum the page number of the node
+   * @param page the page of the node
    */
-  leaf_node_int *allocLeafNode(PageId &newPageId);
- 
- /**
-  * Allocate a page in the buffer
-  *
-  * @param newPageId the page number of the new node
-  * @return a reference to the new internal node
-  */
-  non_leaf_node_int *allocNonLeafNode(PageId &newPageId);
+  void freeNode(PageId pageNum, Page *page);
 
   /**
   * This is the helper method that checks if the page stores a leaf node or
@@ -234,208 +919,416 @@ class BTreeIndex {
   */
   bool isLeaf(Page *page);
 
-  /**
-  * This is the helper method to checks and see that if an internal node is full
+ /**
+  * This is the helper method that tries to insert the given pair, descending
+  * from the root. It gives up when a node it read changes or has to split
+  * first, in which case the caller tries again.
   *
-  * @param node node
-  * @return true if an internal node is full
-  *         false if an internal node is not full
+  * @param key the key of the pair to be inserted
+  * @param rid the record ID of the key-record pair to be inserted
+  * @param include the INCLUDE value of the pair, if the leaves keep one
+  * @param splitPage the page number of an internal node to split on the way
+  * down, or 0; updated when a node needs to split before its child can
+  * @return true if the pair was inserted
   */
-  bool isNonLeafFull(non_leaf_node_int *node);
+  template <class T>
+  bool tryInsert(const typename T::Key &key, RecordId rid,
+                 const IncludeValue &include, PageId &splitPage);
 
-  /**
-  * This is the helper method to checks that if a leaf node is full
+ /**
+  * This is the helper method that splits a node in two, and adds the new node
+  * to its parent, or to a new root. Both nodes must be unchanged since their
+  * versions were read.
   *
-  * @param node a leaf node
-  * @return true if a leaf node is full
-  *         false if a leaf node is not full
+  * @param parent the parent page, or NULL if the node is the root
+  * @param parentNum the page number of the parent
+  * @param parentVersion the version of the parent
+  * @param childIndex the index of the node among the children of the parent
+  * @param page the page of the node
+  * @param pageNum the page number of the node
+  * @param version the version of the node
+  * @param splitPage set to the parent if it has no room for the new node
+  * @return true if the node was split
   */
-  bool isLeafFull(leaf_node_int *node);
+  template <class T>
+  bool splitChild(Page *parent, PageId parentNum, std::uint64_t parentVersion,
+                  int childIndex, Page *page, PageId pageNum,
+                  std::uint64_t version, PageId &splitPage);
 
  /**
-  * This is the helper method that returns the number of records stored in the leaf 
-  * node. And we assume that all records are continuously stored and valid records
-  * are nonzero.
+  * This is the helper method that inserts a pair from the root, trying again
+  * until no other thread is in the way.
   *
-  * @param node a leaf node
-  * @return the number of records stored in the leaf node
+  * @param key the key of the pair
+  * @param rid the record id of the pair
+  * @param include the INCLUDE value of the pair, if the leaves keep one
   */
-  int numInLeaf(leaf_node_int *node);
+  template <class T>
+  void insertKey(const typename T::Key &key, RecordId rid,
+                 const IncludeValue &include);
 
-  /**
-  * This is the helper method that returns the number of records stored in the internal 
-  * node. And we assume that all records are continuously stored and valid records
-  * are nonzero.
+ /**
+  * This is the helper method that tries to delete the given pair, or to change
+  * its record id. The leaf goes, and is freed, with its last pair if it has a
+  * left sibling with the same parent.
   *
-  * @param node an internal node
-  * @return the number of records stored in the internal node
+  * @param key the key of the pair
+  * @param rid the record id of the pair
+  * @param newRid the record id to store in the pair instead, or NULL to delete
+  * it
+  * @param found set to whether the pair was there
+  * @param moved set to whether the pair was deleted instead of changed,
+  * because the leaf had no room for the new record id
+  * @return false if a node changed on the way, and the caller must try again
   */
-  int numInNonLeaf(non_leaf_node_int *node);
+  template <class T>
+  bool tryDelete(const typename T::Key &key, RecordId rid,
+                 const RecordId *newRid, bool &found, bool &moved);
 
-  /**
-  * This is the helper method that find the index of the first integer larger than 
-  * (or equal to) the given key.
-  *
-  * @param array an interger array
-  * @param length the length of the array
-  * @param key the target key
-  * @param includeKey whether the current key is included
+ /**
+  * This is the helper method that takes a leaf holding one pair out of the
+  * tree, linking its left sibling, which has the same parent, to its right
+  * one, and frees it. All three must be unchanged since their versions were
+  * read.
   *
-  * @return a. the index of the first integer larger than the given key if
-  *            includeKey = false
-  *         b. the index of the first integer larger than or equal to the
-  *            given key if includeKey = true
-  *         c. -1 if the key is not found
+  * @param parent the parent page
+  * @param parentVersion the version of the parent
+  * @param childIndex the index of the leaf among the children of the parent,
+  * above 0
+  * @param page the page of the leaf
+  * @param pageNum the page number of the leaf
+  * @param version the version of the leaf
+  * @return true if the leaf was freed
   */
-  int findLargerInt(const int *array, int length, int key, bool includeKey = true);
+  template <class T>
+  bool freeLeaf(Page *parent, std::uint64_t parentVersion, int childIndex,
+                Page *page, PageId pageNum, std::uint64_t version);
 
-  /**
-  * This is the helper method that find the index of the first key smaller than the 
-  * given key.
+ /**
+  * This is the helper method that deletes a pair, or changes its record id,
+  * trying again until no other thread is in the way.
   *
-  * @param node an internal node
-  * @param key the key to find
-  * @return the index of the first key smaller than the given key
-  *         return the largest index if not found
+  * @param key the key of the pair
+  * @param rid the record id of the pair
+  * @param newRid the record id to store in the pair instead, or NULL to delete
+  * it
+  * @throws  NoSuchKeyFoundException If the pair is not in the index.
   */
-  int findSmallerKeyIndex(non_leaf_node_int *node, int key);
+  template <class T>
+  void deleteKey(const typename T::Key &key, RecordId rid,
+                 const RecordId *newRid);
 
-  /**
-  * This is the helper method that find the insertaion index for a key in a leaf node
-  *
-  * @param node a leaf node
-  * @param key the key to be inserted
-  * @return the insertaion index for a key in a leaf node
+ /**
+  * This is the helper method that deletes or changes a pair whose key is in
+  * the search parameter key.
   */
-  int findInsertionIndexLeaf(leaf_node_int *node, int key);
+  void changeEntry(const void *key, const RecordId rid,
+                   const RecordId *newRid);
 
-  /**
-  * This is the helper method that find the index of the first key larger than the given 
-  * key in the leaf node
-  *
-  * @param node a leaf node
-  * @param key the key to find
-  * @param includeKey whether the current key is included
+ /**
+  * This is the helper method that descends to the node just above the leaves
+  * whose range holds the given key, or to the leftmost such node.
   *
-  * @return a. the index of the first integer larger than the given key if
-  *            includeKey is false
-  *         b. the index of the first integer larger than or equal to the
-  *            given key if includeKey is true
-  *         c. -1 if the key is not found
+  * @param key the key
+  * @param leftmost whether to take the leftmost node instead
+  * @param pageNum receives the page number of the node
+  * @param page receives the node, pinned
+  * @param version receives the version of the node
+  * @param hasFence receives whether there are nodes on the right of the node
+  * @param fence receives the lowest key of the node on its right
+  * @return false if the root is a leaf
   */
-  int findIndexLeaf(leaf_node_int *node, int key, bool includeKey);
+  template <class T>
+  bool descendAboveLeaves(const typename T::Key &key, bool leftmost,
+                          PageId &pageNum, Page *&page,
+                          std::uint64_t &version, bool &hasFence,
+                          typename T::Key &fence);
 
-  /**
-  * This is the helper method that inserts the given pair into the leaf node at 
-  * the given insertion index.
+ /**
+  * This is the helper method that merges each child of a node just above the
+  * leaves into its left sibling while the two are at most one leaf's worth,
+  * and one of them is under half full, freeing the right one.
   *
-  * @param node a leaf node
-  * @param i  insertion index
-  * @param key  key of pair to be inserted
-  * @param rid the record ID of the pair to be inserted
+  * @param page the node
+  * @param version the version of the node, updated as the node changes
+  * @param merged incremented for every leaf merged
+  * @return false if the node changed, and must be looked up again
   */
-  void insertionLeafNode(leaf_node_int *node, int i, int key, RecordId rid);
+  template <class T>
+  bool mergeChildren(Page *page, std::uint64_t &version, std::size_t &merged);
 
-  /**
-  * This is the helper method that inserts the given key-(page number) pair into 
-  * the given leaf node at the given index.
+ /**
+  * This is the helper method that makes the only child of the root the root,
+  * as long as the root has one child.
   *
-  * @param n an internal node
-  * @param i  insertion index
-  * @param key  key of the pair
-  * @param pid  page number of the pair
+  * @return the number of nodes freed
   */
-  void insertionNonLeafNode(non_leaf_node_int *n, int i, int key, PageId pid);
+  template <class T>
+  std::size_t collapseRoot();
 
-  /**
-  * This is the helper method to splits a leaf node into two.
+ /**
+  * compact() for keys of type T.
+  */
+  template <class T>
+  std::size_t compactKeys();
+
+ /**
+  * This is the helper method that builds the tree bottom-up from the sorted
+  * pairs of the relation: it fills leaves left to right, then each level of
+  * internal nodes from the one below, and sets the root page.
   *
-  * @param node a pointer to the original node
-  * @param newNode a pointer to the new node
-  * @param index the index where the split occurs.
+  * @param relationName the relation to scan
+  * @param fillFactor the fraction of the slots of each node to fill
+  * @param sortMemory the number of bytes of pairs to sort in memory
+  * @param threads the number of threads to read and sort the pairs with
   */
-  void splitLeaf(leaf_node_int *node, leaf_node_int *newNode, int index);
+  template <class T>
+  void bulkLoad(const std::string &relationName, float fillFactor,
+                std::size_t sortMemory, unsigned threads);
 
-  /**
-  * This is the helper method that splits the internal node by the given index.
+ /**
+  * This is the helper method that adds the pairs of the records of a page of
+  * the relation, reading the keys, and INCLUDE values, in place.
   *
-  * @param node an internal node
-  * @param i the index where the split occurs.
-  * @param keepKey if keepKey is true, then the pair at the index does not need 
-  * to be moved up and will be moved to the newly created
-  * internal node.
-  * @return a pointer to the newly created internal node.
+  * @param page the page, pinned
+  * @param pairs receives the pairs
   */
-  void splitNonLeaf(non_leaf_node_int *curr, non_leaf_node_int *next, int i,
-                        bool keepMidKey);
+  template <class T>
+  void addPagePairs(Page *page, SortedKeyRids<typename T::SortKey> &pairs);
 
  /**
-  * Create a new root with midVal, pid1 and pid2.
+  * This is the helper method that reads and sorts the pairs of the relation
+  * with several threads. Each thread claims the next chunk of page numbers of
+  * the relation in turn and adds the pairs of the records of its used pages to
+  * a sorter of its own, which it then sorts; the sorters are merged into pairs.
   *
-  * @param midVal the first middle value of the new root
-  * @param pid1 the first page number in the new root
-  * @param pid2 the second page number in the new root
+  * @param relationName the relation to scan
+  * @param sortMemory the number of bytes of pairs to sort in memory
+  * @param threads the number of threads
+  * @param pairs receives the pairs, sorted
+  */
+  template <class T>
+  void readPairsParallel(const std::string &relationName,
+                         std::size_t sortMemory, unsigned threads,
+                         SortedKeyRids<typename T::SortKey> &pairs);
+
+ /**
+  * This is the helper method that builds a new Bloom filter from the keys of
+  * the leaves, while no other thread uses the index.
+  */
+  void buildFilter();
+
+ /**
+  * buildFilter() for keys of type T.
+  */
+  template <class T>
+  void buildFilterKeys();
+
+ /**
+  * shape() for keys of type T.
+  */
+  template <class T>
+  IndexShape shapeOf();
+
+ /**
+  * This is the helper method that writes indexMetaInfo, with the current
+  * root, to the meta page.
+  */
+  void writeMetaPage();
+
+ /**
+  * This is the helper method that writes indexMetaInfo to the meta page, with
+  * metaLatch held.
+  */
+  void storeMetaPage();
+
+ /**
+  * This is the helper method that writes the sorted pairs into linked leaves,
+  * spreading them evenly so that no leaf is filled beyond the fill factor.
   *
-  * @return the page id of the new root
+  * @param pairs the sorted pairs
+  * @param fillFactor the fraction of each leaf to fill
+  * @param level receives the key separating every leaf from the one on its
+  * left, and its page number
   */
-  PageId splitRootNode(int midVal, PageId pid1, PageId pid2);
+  template <class T>
+  void buildLeaves(SortedKeyRids<typename T::SortKey> &pairs, float fillFactor,
+                   std::vector<std::pair<typename T::Key, PageId>> &level);
 
-  /**
-  * This is the helper method that inserts the given pair into the given leaf node.
+ /**
+  * This is the helper method that writes the internal nodes above one level
+  * of the tree, filling no node beyond the fill factor.
   *
-  * @param originalNode a leaf node
-  * @param originalPage the page id of the page that stores the leaf node
-  * @param key the key of the pair
-  * @param rid the record id of the pair
-  * @param midVal a reference to an integer in the parent node.
-  * @return The page number of the newly created page.
+  * @param children the key separating every child from the one on its left,
+  * and its page number
+  * @param fillFactor the fraction of the space of each node to fill
+  * @param aboveLeaves whether the children are leaves
+  * @param level receives the key separating every new node from the one on
+  * its left, and its page number
   */
-  PageId insertToLeafPage(Page *origPage, PageId originalPage, int key,
-                          RecordId rid, int &midVal);
+  template <class T>
+  void buildNonLeaves(
+      const std::vector<std::pair<typename T::Key, PageId>> &children,
+      float fillFactor, bool aboveLeaves,
+      std::vector<std::pair<typename T::Key, PageId>> &level);
 
  /**
-  * This is the helper method that recursively insert the given pair into the 
-  * subtree with the given root node.
+  * This is the helper method that descends from the root to the leaf that
+  * holds the first element larger than or equal to the given key.
   *
-  * @param originalPage page id of the page 
-  * @param key the key of the pair to be inserted
-  * @param rid the record ID of the key-record pair to be inserted
-  * @param midVal a pointer to an integer value to be stored in the parent node.
-  * @return the page number of the newly created node if a split occurs, or 0
-  *         otherwise.
+  * @param key the key
+  * @param pageNum receives the page number of the leaf
+  * @param page receives the leaf, pinned
+  * @param version receives the version of the leaf
+  */
+  template <class T>
+  void descend(const typename T::Key &key, PageId &pageNum, Page *&page,
+               std::uint64_t &version);
+
+ /**
+  * @return the scan state of the calling thread
+  */
+  ScanState &threadScan();
+
+ /**
+  * This is the helper method that changes the currently scanning page to the
+  * given right sibling of the current page.
+  * @param scan the scan
+  * @param nextPageNum the page number of the right sibling.
+  * @return false, with the scan left on the current page, if the current page
+  * changed since the scan found its place in it
+  */
+  bool moveToNext(ScanState &scan, PageId nextPageNum);
+
+ /**
+  * This is the helper method that puts the scan at the first element not below
+  * target, or above it if after, then past up to skip elements equal to it.
+  * @param scan the scan
+  * @param target the key
+  * @param after whether to start above target
+  * @param skip the number of elements equal to target to move past
+  * @param rid the record id to look for among the elements moved past, or NULL
+  * @param matched receives the number of elements moved past up to the last
+  * with that record id, 0 if there is none
+  * @return false if a leaf changed on the way, and the scan must start over
+  */
+  template <class T>
+  bool place(ScanState &scan, const typename T::Key &target, bool after,
+             std::size_t skip, const RecordId *rid, std::size_t &matched);
+
+ /**
+  * This is the helper method that finds the place of the scan from the root:
+  * the first element within the low bound, or the one after the last element
+  * returned.
+  * @param scan the scan
+  */
+  template <class T>
+  void seek(ScanState &scan);
+
+ /**
+  * This is the helper method that reads the next element of the scan without
+  * moving past it, going on to the next leaf if needed.
+  * @param scan the scan
+  * @param key receives the key of the element
+  * @param rid receives the record id of the element
+  * @return false if the scan is past the last leaf
+  */
+  template <class T>
+  bool peek(ScanState &scan, typename T::Key &key, RecordId &rid);
+
+ /**
+  * This is the helper method that notes that the scan returned n elements
+  * ending with count elements with the given key, the last with the given
+  * record id.
+  */
+  template <class T>
+  void remember(ScanState &scan, const typename T::Key &key, RecordId rid,
+                std::size_t n, std::size_t count);
+
+ /**
+  * This is the helper method that checks a key against the high bound of the
+  * scan.
+  * @param scan the scan
+  * @param key the key
+  * @return true if the key is not above the range
+  */
+  template <class T>
+  bool belowHigh(ScanState &scan, const typename T::Key &key);
+
+ /**
+  * startScan() for keys of type T.
+  */
+  template <class T>
+  void startScanKeys(ScanState &scan, const void *lowValParm,
+                     const void *highValParm);
+
+ /**
+  * This is the helper method that starts the given scan, which must not be
+  * executing.
+  * @throws  BadOpcodesException, BadScanrangeException and
+  * NoSuchKeyFoundException as startScan() does
   */
-  PageId insert(PageId originalPage, int key, RecordId rid, int &midVal);
+  void startScan(ScanState &scan, const void *lowValParm,
+                 const Operator lowOpParm, const void *highValParm,
+                 const Operator highOpParm);
 
  /**
-  * This is the helper method that changes the currently scanning page to the next page pointed 
-  * to by the current page.
-  * @param node the node stored in the currently scanning page.
+  * This is the helper method that fetches the next record id of the given
+  * scan, as scanNext() does.
   */
-  void moveToNext(leaf_node_int *node);
+  void scanNext(ScanState &scan, RecordId &outRid);
 
  /**
-  * This is the helper method that recursively find the page id of the first element larger than 
-  * or equal to the lower bound given.
+  * This is the helper method that fetches up to max next record ids of the
+  * given scan, as scanNextBatch() does.
   */
-  void setPageScan();
+  size_t scanNextBatch(ScanState &scan, RecordId *out, size_t max);
 
  /**
-  * This is the helper method that finds the first element in the currently scanning page that 
-  * is within the given bound.
+  * This is the helper method that fetches up to max next entries of the given
+  * scan, as scanNextEntries() does.
   */
-  void entryScanIndex();
+  size_t scanNextEntries(ScanState &scan, void *keys, RecordId *outRids,
+                         size_t max, void *includes);
 
  /**
-  * This is the helper method that continuely scanning the next entry.
+  * scanNext() for keys of type T.
   */
-  void setNextEntry();
+  template <class T>
+  void scanNextKey(ScanState &scan, RecordId &outRid);
 
+ /**
+  * scanNextBatch() and scanNextEntries() for keys of type T.
+  * @param keys receives the keys of the entries too, unless NULL
+  * @param includes receives their INCLUDE values too, unless NULL
+  */
+  template <class T>
+  size_t scanNextKeys(ScanState &scan, RecordId *out, size_t max,
+                      typename T::Key *keys, char *includes);
+
+ /**
+  * This is the helper method that ends the given scan and unpins its page.
+  */
+  void endScan(ScanState &scan);
+
+ /**
+  * lookup() for keys of type T.
+  */
+  template <class T>
+  std::size_t lookupKey(const typename T::Key &key,
+                        std::vector<RecordId> &outRids);
  public:
   /**
    * BTreeIndex Constructor.
    * Check to see if the corresponding index file exists. If so, open the
-   * file. If not, create it and insert entries for every tuple in the base
-   * relation using FileScan class.
+   * file and take the root page from its meta page, without reading the
+   * relation. If not, create it and bulk load it with an entry for every tuple in
+   * the base relation: the (key, rid) pairs, read in place from its pages, are sorted,
+   * externally when they exceed sortMemory, and packed into leaves and
+   * internal nodes bottom-up in one sequential pass. With more than one build
+   * thread, the threads share out the pages of the relation and sort the
+   * pairs of their pages, and the sorted parts are merged in parallel; the
+   * tree built is the same.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
@@ -445,21 +1338,44 @@ class BTreeIndex {
    * index is to be built, in the record
    * @param attrType						Datatype
    * of attribute over which index is built
+   * @param fillFactor        Fraction of the slots of each node filled by the
+   * bulk load, between 0 and 1
+   * @param sortMemory        Number of bytes of (key, rid) pairs the bulk load
+   * sorts in memory
+   * @param packLeaves        Whether to store the pairs of INTEGER keys in
+   * packed leaves (see leaf_node_int_packed); ignored for other types, and
+   * for an existing index file, which keeps the leaves it was built with
+   * @param useFilter         Whether to keep a Bloom filter of the keys for
+   * lookup(), taking BLOOM_BITS_PER_KEY bits of memory a key
+   * @param buildThreads      Number of threads the bulk load reads and sorts
+   * the pairs with, or 0 for one per core; the sorts and the merge of a
+   * parallel load each get half of sortMemory
+   * @param includeByteOffset Offset in the record of the INCLUDE column kept
+   * in the leaves with every key; ignored without an includeLength
+   * @param includeLength     Number of bytes of the INCLUDE column, at most
+   * INCLUDESIZE, or 0 for none; an index with one has no packed leaves, and
+   * an existing index file keeps the column it was built with
    * @throws  BadIndexInfoException     If the index file already exists for
    * the corresponding attribute, but values in metapage(relationName,
    * attribute byte offset, attribute type etc.) do not match with values
-   * received through constructor parameters.
+   * received through constructor parameters, or if the INCLUDE column is
+   * longer than INCLUDESIZE.
    */
   BTreeIndex(const std::string &relationName, std::string &outIndexName,
              BufMgr *bufMgrIn, const int attrByteOffset,
-             const Datatype attrType);
+             const Datatype attrType,
+             const float fillFactor = BULKLOAD_FILL_FACTOR,
+             const std::size_t sortMemory = BULKLOAD_SORT_MEMORY,
+             const bool packLeaves = false, const bool useFilter = false,
+             const unsigned buildThreads = 1, const int includeByteOffset = -1,
+             const int includeLength = 0);
 
   /**
    * BTreeIndex Destructor.
    * End any initialized scan, flush index file, after unpinning any pinned
    * pages, from the buffer manager and delete file instance thereby closing the
    * index file. Destructor should not throw any exceptions. All exceptions
-   * should be caught in here itself.
+   * should be caught in here itself. No other thread may use the index then.
    * */
   ~BTreeIndex();
 
@@ -470,19 +1386,72 @@ class BTreeIndex {
    *addition of new leaf page number entry into the parent non-leaf, which may
    *in-turn get split. This may continue all the way upto the root causing the
    *root to get split. If root gets split, metapage needs to be changed
-   *accordingly. Make sure to unpin pages as soon as you can.
+   *accordingly. Make sure to unpin pages as soon as you can. Any number of
+   *threads may insert at once.
    * @param key			Key to insert, pointer to integer/double/char
    *string
    * @param rid			Record ID of a record whose entry is getting
    *inserted into the index.
+   * @param include	The includeLength() bytes of the INCLUDE column of the
+   *record, or NULL to store NULs; ignored by an index without one
+   **/
+  const void insertEntry(const void *key, const RecordId rid,
+                         const void *include = NULL);
+
+  /**
+   * Delete the entry <key,rid>. A leaf left empty is taken out of the tree
+   * and its page freed when it has a left sibling with the same parent;
+   * otherwise nodes are not merged until compact() is called. Any number of
+   * threads may delete at once, beside inserts and scans.
+   * @param key			Key of the entry, pointer to integer/double/char
+   *string
+   * @param rid			Record ID of the entry
+   * @throws  NoSuchKeyFoundException If the entry is not in the index.
+   **/
+  const void deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Change the record id of the entry <key,oldRid> to newRid, in place, as
+   * when the tuple moves. Scans see the entry once, with one record id or the
+   * other, except when a packed leaf has no room for the page of newRid: the
+   * entry is then deleted and inserted again, and a scan may miss it.
+   * @param key			Key of the entry, pointer to integer/double/char
+   *string
+   * @param oldRid			Record ID of the entry
+   * @param newRid			Record ID to store in the entry instead
+   * @throws  NoSuchKeyFoundException If the entry is not in the index.
+   **/
+  const void updateEntry(const void *key, const RecordId oldRid,
+                         const RecordId newRid);
+
+  /**
+   * Merge leaves that deletes left under half full into their left siblings,
+   * and make the only child of the root the root, freeing the nodes no longer
+   * in the tree for new ones. Internal nodes are not merged. The index can be
+   * used by other threads meanwhile, so this may run in a background thread.
+   * @return the number of nodes freed
    **/
-  const void insertEntry(const void *key, const RecordId rid);
+  std::size_t compact();
+
+  /**
+   * Walk every node of the tree to find its height, its numbers of leaves,
+   * internal nodes and entries, and how full its leaves are. The index must
+   * not change meanwhile.
+   * @return the shape of the tree
+   **/
+  IndexShape shape();
+
+  /**
+   * @return the splits done since the index was opened, and their cost
+   **/
+  SplitStats splitStats() const;
 
   /**
    * Begin a filtered scan of the index.  For instance, if the method is called
    * using ("a",GT,"d",LTE) then we should seek all entries with a value
    * greater than "a" and less than or equal to "d".
-   * If another scan is already executing, that needs to be ended here.
+   * If another scan is already executing in the calling thread, that needs to
+   * be ended here; scans of other threads go on.
    * Set up all the variables for scan. Start from root to find out the leaf
    *page that contains the first RecordID that satisfies the scan parameters.
    *Keep that page pinned in the buffer pool.
@@ -501,6 +1470,40 @@ class BTreeIndex {
   const void startScan(const void *lowVal, const Operator lowOp,
                        const void *highVal, const Operator highOp);
 
+  /**
+   * Begin a filtered scan of the index, like startScan(), in a cursor of its
+   * own. The cursor keeps its leaf pinned, and nothing else: any number of
+   * cursors, in any threads, can scan the index at once, and they leave the
+   * scan of the calling thread alone. Every cursor must be closed or
+   * destroyed before the index is.
+   * @param lowVal	Low value of range, pointer to integer / double / char
+   *string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char
+   *string
+   * @param highOp	High operator (LT/LTE)
+   * @return the cursor, positioned before the first entry of the range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   **/
+  BTreeScan openScan(const void *lowVal, const Operator lowOp,
+                     const void *highVal, const Operator highOp);
+
+  /**
+   * Find the record ids of every entry with the given key, without a scan:
+   * the leaves that may hold it are read from the root, and the calling
+   * thread's scan is left alone. Keys not in the index are no error, and most
+   * of them are answered from the Bloom filter, if the index keeps one,
+   * without reading a page.
+   * @param key	Key to find, pointer to integer / double / char string
+   * @param outRids	Receives the record ids, in the order of the entries
+   * @return the number of record ids found, 0 if the key is not in the index
+   **/
+  size_t lookup(const void *key, std::vector<RecordId> &outRids);
+
   /**
    * Fetch the record id of the next index entry that matches the scan.
    * Return the next record from current page being scanned. If current page has
@@ -516,10 +1519,124 @@ class BTreeIndex {
   const void scanNext(RecordId &outRid);  // returned record id
 
   /**
-   * Terminate the current scan. Unpin any pinned pages. Reset scan specific
-   *variables.
+   * Fetch the record ids of up to max next index entries that match the scan.
+   * Whole runs of matching entries are copied from each leaf, moving on to its
+   * right sibling as scanNext() does. Ends of scans are reported by returning
+   * fewer than max record ids rather than by an exception.
+   * @param out	Receives the record ids found
+   * @param max	Number of record ids out has room for
+   * @return the number of record ids stored in out, 0 once the scan is completed
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  size_t scanNextBatch(RecordId *out, size_t max);
+
+  /**
+   * Fetch up to max next index entries that match the scan, with their keys
+   * and INCLUDE values, as scanNextBatch() fetches their record ids: an
+   * index-only scan, which reads no page of the relation.
+   * @param keys	Receives the keys, as an array of int, double or StringKey
+   *for an index on INTEGER, DOUBLE or STRING keys
+   * @param outRids	Receives the record ids
+   * @param max	Number of entries the arrays have room for
+   * @param includes	Receives includeLength() bytes of INCLUDE column an
+   *entry, one after another, unless NULL
+   * @return the number of entries found, 0 once the scan is completed
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  size_t scanNextEntries(void *keys, RecordId *outRids, size_t max,
+                         void *includes = NULL);
+
+  /**
+   * @return the number of bytes of the INCLUDE column, 0 if the index has
+   * none
+   **/
+  int includeLength() const { return indexMetaInfo.includeLength; }
+
+  /**
+   * Terminate the current scan of the calling thread. Unpin any pinned pages.
+   *Reset scan specific variables.
    * @throws ScanNotInitializedException If no scan has been initialized.
    **/
   const void endScan();
 };
+
+/**
+ * @brief A scan of a BTreeIndex opened with BTreeIndex::openScan().
+ *
+ * A cursor holds the pin of its current leaf until it is closed, destroyed,
+ * or moved from. It may be moved to another thread, but used by only one
+ * thread at a time.
+ */
+class BTreeScan {
+ public:
+  BTreeScan(BTreeScan &&other);
+  BTreeScan &operator=(BTreeScan &&other);
+  BTreeScan(const BTreeScan &) = delete;
+  BTreeScan &operator=(const BTreeScan &) = delete;
+
+  /**
+   * Closes the scan if it is still open.
+   */
+  ~BTreeScan();
+
+  /**
+   * Fetch the record id of the next index entry that matches the scan, as
+   * BTreeIndex::scanNext() does.
+   * @param outRid	RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @throws ScanNotInitializedException If the scan has been closed.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void next(RecordId &outRid);
+
+  /**
+   * Fetch the record ids of up to max next index entries that match the scan,
+   * as BTreeIndex::scanNextBatch() does.
+   * @param out	Receives the record ids found
+   * @param max	Number of record ids out has room for
+   * @return the number of record ids stored in out, 0 once the scan is completed
+   * @throws ScanNotInitializedException If the scan has been closed.
+   **/
+  size_t nextBatch(RecordId *out, size_t max);
+
+  /**
+   * Fetch up to max next index entries that match the scan, with their keys
+   * and INCLUDE values, as BTreeIndex::scanNextEntries() does.
+   * @param keys	Receives the keys
+   * @param outRids	Receives the record ids
+   * @param max	Number of entries the arrays have room for
+   * @param includes	Receives the INCLUDE values, unless NULL
+   * @return the number of entries found, 0 once the scan is completed
+   * @throws ScanNotInitializedException If the scan has been closed.
+   **/
+  size_t nextEntries(void *keys, RecordId *outRids, size_t max,
+                     void *includes = NULL);
+
+  /**
+   * Terminate the scan and unpin its leaf.
+   * @throws ScanNotInitializedException If the scan has been closed.
+   **/
+  void close();
+
+  /**
+   * @return true until the scan is closed
+   */
+  bool isOpen() const { return state.executing; }
+
+ private:
+  friend class BTreeIndex;
+
+  explicit BTreeScan(BTreeIndex *index) : index(index) {}
+
+  /**
+   * The index scanned.
+   */
+  BTreeIndex *index;
+
+  /**
+   * The place and bounds of the scan.
+   */
+  BTreeIndex::ScanState state;
+};
 }  // namespace badgerdb
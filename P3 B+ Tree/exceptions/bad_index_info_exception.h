@@ -0,0 +1,42 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when an index file exists but was built over
+ *        another attribute, or the index is asked for an INCLUDE column it
+ *        cannot hold.
+ */
+class BadIndexInfoException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a bad index info exception for the given index file.
+   *
+   * @param name  Name of the index file.
+   */
+  explicit BadIndexInfoException(const std::string& name);
+
+  /**
+   * Returns the name of the index file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Name of the index file that caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
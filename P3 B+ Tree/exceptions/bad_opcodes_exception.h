@@ -0,0 +1,28 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a scan is started with operators that
+ *        do not bound a range from below and above.
+ */
+class BadOpcodesException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a bad opcodes exception.
+   */
+  explicit BadOpcodesException();
+};
+
+}
@@ -0,0 +1,27 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file scan has no records left.
+ */
+class EndOfFileException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an end of file exception.
+   */
+  explicit EndOfFileException();
+};
+
+}
@@ -0,0 +1,28 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when an index scan has no record ids left
+ *        in its range.
+ */
+class IndexScanCompletedException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an index scan completed exception.
+   */
+  explicit IndexScanCompletedException();
+};
+
+}
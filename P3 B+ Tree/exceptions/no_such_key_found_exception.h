@@ -0,0 +1,28 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when no key of an index lies in the range of
+ *        a scan.
+ */
+class NoSuchKeyFoundException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a no such key found exception.
+   */
+  explicit NoSuchKeyFoundException();
+};
+
+}
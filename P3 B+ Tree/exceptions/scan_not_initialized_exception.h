@@ -0,0 +1,28 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a scan is continued or ended without
+ *        one having been started.
+ */
+class ScanNotInitializedException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a scan not initialized exception.
+   */
+  explicit ScanNotInitializedException();
+};
+
+}
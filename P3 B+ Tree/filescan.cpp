@@ -0,0 +1,71 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "filescan.h"
+
+#include "exceptions/end_of_file_exception.h"
+
+namespace badgerdb {
+
+FileScan::FileScan(const std::string& relationName, BufMgr* bufMgrIn)
+    : file(relationName, false /* create_new */),
+      bufMgr(bufMgrIn),
+      currentPage(NULL),
+      currentPageNo(Page::INVALID_NUMBER),
+      curDirty(false) {
+  nextPageNo = file.getFirstPageNo();
+}
+
+FileScan::~FileScan() {
+  // Nothing to report a failure to; the pages stay in the pool.
+  try {
+    releasePage();
+    bufMgr->flushFile(&file);
+  } catch (...) {
+  }
+}
+
+void FileScan::releasePage() {
+  if (currentPage != NULL) {
+    currentPage = NULL;
+    bufMgr->unPinPage(&file, currentPageNo, curDirty);
+    curDirty = false;
+  }
+}
+
+void FileScan::scanNext(RecordId& outRid) {
+  if (currentPage != NULL) {
+    ++pageRecordIter;
+    if (pageRecordIter != currentPage->end()) {
+      outRid = pageRecordIter.getCurrentRecord();
+      return;
+    }
+  }
+  // Move on to the next page that holds a record.
+  while (true) {
+    if (currentPage != NULL) {
+      nextPageNo = currentPage->next_page_number();
+      releasePage();
+    }
+    if (nextPageNo == Page::INVALID_NUMBER) {
+      throw EndOfFileException();
+    }
+    currentPageNo = nextPageNo;
+    bufMgr->readPage(&file, currentPageNo, currentPage);
+    pageRecordIter = currentPage->begin();
+    if (pageRecordIter != currentPage->end()) {
+      outRid = pageRecordIter.getCurrentRecord();
+      return;
+    }
+  }
+}
+
+std::string FileScan::getRecord() {
+  return *pageRecordIter;
+}
+
+}
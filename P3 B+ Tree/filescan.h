@@ -0,0 +1,92 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Scans the records of a relation in the order of its pages, reading
+ *        them through the buffer manager.
+ *
+ * The page holding the current record stays pinned until the scan moves past
+ * it, so getRecord() reads the record in place.
+ */
+class FileScan {
+ public:
+  /**
+   * Opens the relation for a scan from its first record.
+   *
+   * @param relationName  Name of the relation file.
+   * @param bufMgr        Buffer manager the pages are read through.
+   * @throws  FileNotFoundException  If the relation doesn't exist.
+   */
+  FileScan(const std::string& relationName, BufMgr* bufMgr);
+
+  /**
+   * Unpins the current page and flushes the pages of the relation.
+   */
+  ~FileScan();
+
+  FileScan(const FileScan&) = delete;
+  FileScan& operator=(const FileScan&) = delete;
+
+  /**
+   * Moves to the next record of the relation.
+   *
+   * @param outRid  Receives the record id of the record.
+   * @throws  EndOfFileException  If there is no record left.
+   */
+  void scanNext(RecordId& outRid);
+
+  /**
+   * Returns a copy of the current record.
+   */
+  std::string getRecord();
+
+  /**
+   * Marks the current page dirty, so that it is written back once unpinned.
+   */
+  void markDirty() { curDirty = true; }
+
+ private:
+  /**
+   * Unpins the current page, if any.
+   */
+  void releasePage();
+
+  PageFile file;
+  BufMgr* bufMgr;
+
+  /**
+   * Page of the current record, pinned, or NULL before the first record and
+   * after the last.
+   */
+  Page* currentPage;
+  PageId currentPageNo;
+  bool curDirty;
+
+  /**
+   * Current record of currentPage.
+   */
+  PageIterator pageRecordIter;
+
+  /**
+   * Number of the page the scan goes on with once currentPage is done.
+   */
+  PageId nextPageNo;
+};
+
+}
@@ -0,0 +1,75 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "keySearch.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace badgerdb {
+
+/**
+ * Counts the keys of array[0, length) that are less than key.
+ */
+static int countLess(const int *array, int length, int key) {
+  int count = 0;
+  int i = 0;
+#if defined(__AVX512F__)
+  const __m512i keys = _mm512_set1_epi32(key);
+  for (; i + 16 <= length; i += 16) {
+    __m512i v = _mm512_loadu_si512(array + i);
+    count += __builtin_popcount(_mm512_cmplt_epi32_mask(v, keys));
+  }
+#elif defined(__AVX2__)
+  const __m256i keys = _mm256_set1_epi32(key);
+  for (; i + 8 <= length; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(array + i));
+    __m256i less = _mm256_cmpgt_epi32(keys, v);
+    count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const int32x4_t keys = vdupq_n_s32(key);
+  int32x4_t less = vdupq_n_s32(0);
+  for (; i + 4 <= length; i += 4) {
+    // every lane that compares true adds -1
+    less = vaddq_s32(less, vreinterpretq_s32_u32(
+                               vcltq_s32(vld1q_s32(array + i), keys)));
+  }
+  count = -vaddvq_s32(less);
+#endif
+  for (; i < length; i++) count += array[i] < key;
+  return count;
+}
+
+int lowerBoundInt(const int *array, int length, int key) {
+  // the answer stays within [base, base + length]
+  const int *base = array;
+  while (length > KEYSEARCH_WINDOW) {
+    int half = length / 2;
+    base = base[half - 1] < key ? base + half : base;
+    length -= half;
+  }
+  return (int)(base - array) + countLess(base, length, key);
+}
+
+const char *keySearchIsa() {
+#if defined(__AVX512F__)
+  return "avx512";
+#elif defined(__AVX2__)
+  return "avx2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,39 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+namespace badgerdb {
+
+/**
+ * @brief Number of keys below which lowerBoundInt() stops halving the range
+ * and compares every key that is left with vector instructions.
+ */
+const int KEYSEARCH_WINDOW = 64;
+
+/**
+ * Finds the index of the first key in a sorted array that is not less than
+ * the given key, as std::lower_bound does. The range is halved without
+ * branches down to KEYSEARCH_WINDOW keys, then the keys less than the given
+ * key are counted with AVX-512, AVX2 or NEON instructions when the compiler
+ * targets them, or with a plain loop otherwise.
+ *
+ * @param array the sorted keys
+ * @param length the number of keys
+ * @param key the key to find
+ * @return the index of the first key not less than key, or length if there is
+ *         none
+ */
+int lowerBoundInt(const int *array, int length, int key);
+
+/**
+ * @return the instruction set lowerBoundInt() was compiled for
+ */
+const char *keySearchIsa();
+
+}  // namespace badgerdb
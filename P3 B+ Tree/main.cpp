@@ -6,6 +6,9 @@
  */
 
 
+#include <atomic>
+#include <fstream>
+#include <thread>
 #include <vector>
 #include "btree.h"
 #include "page.h"
@@ -20,6 +23,7 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -70,11 +74,27 @@ void createRelationBackward();
 void createRelationRandom();
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intScanBatch(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, size_t batchSize);
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+int stringScan(BTreeIndex *index, const char *lowVal, Operator lowOp, const char *highVal, Operator highOp);
 void indexTests();
 void test1();
 void test2();
 void test3();
 void test4();
+void test5();
+void test6();
+void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
 void errorTests();
 void deleteFiles();
 void outOfBound();
@@ -145,7 +165,21 @@ int main(int argc, char **argv)
 	test2();
 	test3();
 	test4();
+	test5();
+	test6();
+	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
   	errorTests();
+	deleteFiles();
 
   return 1;
 }
@@ -191,6 +225,678 @@ void test4() {
   deleteRelation();
 }
 
+void test5() {
+  // Bulk load half full nodes from sorted runs spilled 1000 pairs at a time
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test5" << std::endl;
+  createRelationRandom();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, 0.5f, 1000 * sizeof(IntKeyRid));
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14);
+    checkPassFail(intScan(&index, -3, GT, 3, LT), 3);
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize);
+    checkPassFail(intScan(&index, 4999, GT, 6000, LT), 0);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test6() {
+  // Insert into a bulk loaded tree whose nodes are all full
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test6" << std::endl;
+  createRelationForward();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, 1.0f);
+    // index every tuple from 1000 to 2999 a second time
+    for (int key = 1000; key < 3000; key++) {
+      RecordId keyRid;
+      index.startScan(&key, GTE, &key, LTE);
+      index.scanNext(keyRid);
+      index.endScan();
+      index.insertEntry(&key, keyRid);
+    }
+    checkPassFail(intScan(&index, 0, GTE, 1000, LT), 1000);
+    checkPassFail(intScan(&index, 1000, GTE, 3000, LT), 4000);
+    checkPassFail(intScan(&index, 2990, GTE, 3010, LT), 30);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize + 2000);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+void test7() {
+  // Reopen an index from its meta page instead of rebuilding it
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test7" << std::endl;
+  createRelationForward();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, 1.0f);
+    // entries that only the saved index has, splitting full leaves
+    for (int key = 0; key < relationSize; key += 2) {
+      RecordId keyRid;
+      index.startScan(&key, GTE, &key, LTE);
+      index.scanNext(keyRid);
+      index.endScan();
+      index.insertEntry(&key, keyRid);
+    }
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intScan(&index, 0, GTE, 10, LT), 15);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize * 3 / 2);
+  }
+  try {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     DOUBLE);
+    std::cout << "BadIndexInfoException Test 1 Failed." << std::endl;
+  } catch (BadIndexInfoException e) {
+    std::cout << "BadIndexInfoException Test 1 Passed." << std::endl;
+  }
+  deleteFiles();
+  deleteRelation();
+}
+void test8() {
+  // Batched scans, with batches ending inside and at the end of leaves
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test8" << std::endl;
+  createRelationRandom();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intScanBatch(&index, 25, GT, 40, LT, 4), 14);
+    checkPassFail(intScanBatch(&index, 20, GTE, 35, LTE, 16), 16);
+    checkPassFail(intScanBatch(&index, 300, GT, 400, LT, 1), 99);
+    checkPassFail(intScanBatch(&index, 0, GTE, 5000, LT, 613), relationSize);
+    checkPassFail(intScanBatch(&index, 0, GTE, 5000, LT, INTARRAYLEAFSIZE),
+                  relationSize);
+    checkPassFail(intScanBatch(&index, 4999, GT, 6000, LT, 100), 0);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test9() {
+  // Indexes on the double and the string field
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test9" << std::endl;
+  createRelationRandom();
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
+    checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14);
+    checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16);
+    checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3);
+    checkPassFail(doubleScan(&index, 2.5, GT, 4.5, LTE), 2);
+    checkPassFail(doubleScan(&index, 0, GTE, 5000, LT), relationSize);
+  }
+  {
+    // keys are "%05d string record", so "00025" sorts before the key of 25
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING, 0.5f);
+    checkPassFail(stringScan(&index, "00025", GT, "00040", LT), 15);
+    checkPassFail(stringScan(&index, "00300 string record", GT, "00400", LT), 99);
+    checkPassFail(stringScan(&index, "", GTE, "99999", LT), relationSize);
+    checkPassFail(stringScan(&index, "04999 string record", GT, "5", LT), 0);
+
+    // index every tuple from 1000 to 1999 a second time
+    for (int i = 1000; i < 2000; i++) {
+      char key[STRINGSIZE];
+      sprintf(key, "%05d string record", i);
+      RecordId keyRid;
+      index.startScan(key, GTE, key, LTE);
+      index.scanNext(keyRid);
+      index.endScan();
+      index.insertEntry(key, keyRid);
+    }
+  }
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+    checkPassFail(stringScan(&index, "01", GTE, "02", LT), 2000);
+    checkPassFail(stringScan(&index, "", GTE, "99999", LT), relationSize + 1000);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test10() {
+  // Inserts from several threads while other threads scan
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test10" << std::endl;
+  createRelationForward();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int numWriters = 4;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numWriters; t++) {
+      threads.push_back(std::thread([&index, t]() {
+        // index every tuple with a key of t modulo numWriters a second time
+        for (int key = t; key < relationSize; key += numWriters) {
+          RecordId keyRid;
+          index.startScan(&key, GTE, &key, LTE);
+          index.scanNext(keyRid);
+          index.endScan();
+          index.insertEntry(&key, keyRid);
+        }
+      }));
+    }
+    // every scan sees each first entry once, and no entry twice
+    std::atomic<int> badScans(0);
+    for (int t = 0; t < 2; t++) {
+      threads.push_back(std::thread([&index, &badScans]() {
+        for (int pass = 0; pass < 5; pass++) {
+          int lowVal = 0, highVal = relationSize, numResults = 0;
+          RecordId scanRid;
+          index.startScan(&lowVal, GTE, &highVal, LT);
+          try {
+            while (1) {
+              index.scanNext(scanRid);
+              numResults++;
+            }
+          } catch (IndexScanCompletedException e) {
+          }
+          index.endScan();
+          if (numResults < relationSize || numResults > 2 * relationSize)
+            badScans++;
+        }
+      }));
+    }
+    for (std::thread &thread : threads) thread.join();
+
+    checkPassFail(badScans.load(), 0);
+    checkPassFail(intScan(&index, 0, GTE, 10, LT), 20);
+    checkPassFail(intScan(&index, 2990, GTE, 3010, LT), 40);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), 2 * relationSize);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test11() {
+  // Several cursors on one index, beside the scan of the thread
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test11" << std::endl;
+  createRelationRandom();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int lowVal = 0, highVal = 100, otherLowVal = 4000, otherHighVal = 4100;
+    BTreeScan first = index.openScan(&lowVal, GTE, &highVal, LT);
+    BTreeScan second = index.openScan(&otherLowVal, GT, &otherHighVal, LTE);
+    index.startScan(&lowVal, GTE, &highVal, LT);
+
+    // take turns until all three scans are completed
+    int numFirst = 0, numSecond = 0, numThread = 0;
+    bool more = true;
+    while (more) {
+      RecordId scanRid;
+      more = false;
+      try {
+        first.next(scanRid);
+        numFirst++;
+        more = true;
+      } catch (IndexScanCompletedException e) {
+      }
+      try {
+        second.next(scanRid);
+        numSecond++;
+        more = true;
+      } catch (IndexScanCompletedException e) {
+      }
+      try {
+        index.scanNext(scanRid);
+        numThread++;
+        more = true;
+      } catch (IndexScanCompletedException e) {
+      }
+    }
+    index.endScan();
+    checkPassFail(numFirst, 100);
+    checkPassFail(numSecond, 100);
+    checkPassFail(numThread, 100);
+
+    // a self-join of [0,10) with itself, holding the outer cursor throughout
+    int numJoined = 0;
+    highVal = 10;
+    BTreeScan outer = index.openScan(&lowVal, GTE, &highVal, LT);
+    RecordId outerRid, innerRids[16];
+    try {
+      while (1) {
+        outer.next(outerRid);
+        BTreeScan inner = index.openScan(&lowVal, GTE, &highVal, LT);
+        numJoined += inner.nextBatch(innerRids, 16);
+      }
+    } catch (IndexScanCompletedException e) {
+    }
+    checkPassFail(numJoined, 100);
+
+    // moving a cursor hands over its scan
+    BTreeScan moved = std::move(outer);
+    first.close();
+    try {
+      first.next(outerRid);
+      std::cout << "ScanNotInitialized Test 3 Failed." << std::endl;
+    } catch (ScanNotInitializedException e) {
+      std::cout << "ScanNotInitialized Test 3 Passed." << std::endl;
+    }
+    checkPassFail(outer.isOpen(), false);
+    checkPassFail(moved.isOpen(), true);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test12() {
+  // Deletes and updates, then compaction of the leaves they left sparse
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test12" << std::endl;
+  createRelationForward();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    // delete every tuple but those with a key of 0 modulo 10
+    RecordId keyRids[3];
+    for (int key = 0; key < relationSize; key++) {
+      RecordId keyRid;
+      index.startScan(&key, GTE, &key, LTE);
+      index.scanNext(keyRid);
+      index.endScan();
+      if (key == 1) keyRids[0] = keyRid;
+      if (key == 20) keyRids[1] = keyRid;
+      if (key == 30) keyRids[2] = keyRid;
+      if (key % 10 != 0) index.deleteEntry(&key, keyRid);
+    }
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 1);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize / 10);
+
+    try {
+      int key = 1;
+      index.deleteEntry(&key, keyRids[0]);
+      std::cout << "NoSuchKeyFoundException Test 1 Failed." << std::endl;
+    } catch (NoSuchKeyFoundException e) {
+      std::cout << "NoSuchKeyFoundException Test 1 Passed." << std::endl;
+    }
+
+    // the entry of 20 now points to the tuple of 30
+    int key = 20;
+    RecordId keyRid;
+    index.updateEntry(&key, keyRids[1], keyRids[2]);
+    index.startScan(&key, GTE, &key, LTE);
+    index.scanNext(keyRid);
+    index.endScan();
+    bool moved = keyRid == keyRids[2];
+    checkPassFail(moved, true);
+
+    bool freed = index.compact() > 0;
+    checkPassFail(freed, true);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize / 10);
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize / 10);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test13() {
+  // Packed leaves: fewer pages, and the same answers as plain leaves
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test13" << std::endl;
+  createRelationRandom();
+  std::streamoff plainBytes, packedBytes;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  }
+  plainBytes = std::ifstream(intIndexName, std::ios::ate).tellg();
+  deleteFiles();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY, true);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14);
+    checkPassFail(intScan(&index, -3, GT, 3, LT), 3);
+    checkPassFail(intScanBatch(&index, 0, GTE, 5000, LT, 613), relationSize);
+  }
+  packedBytes = std::ifstream(intIndexName, std::ios::ate).tellg();
+  bool smaller = packedBytes < plainBytes;
+  checkPassFail(smaller, true);
+  {
+    // the index keeps its packed leaves when it is opened again
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    // delete every tuple from 0 to 1999, then index every tuple from 2000
+    // to 2999 a second time, splitting leaves
+    RecordId zeroRid;
+    for (int key = 0; key < 3000; key++) {
+      RecordId keyRid;
+      index.startScan(&key, GTE, &key, LTE);
+      index.scanNext(keyRid);
+      index.endScan();
+      if (key == 0) zeroRid = keyRid;
+      if (key < 2000)
+        index.deleteEntry(&key, keyRid);
+      else
+        index.insertEntry(&key, keyRid);
+    }
+    checkPassFail(intScan(&index, 0, GTE, 2000, LT), 0);
+    checkPassFail(intScan(&index, 2990, GTE, 3010, LT), 30);
+    checkPassFail(intScanBatch(&index, 0, GTE, 5000, LT, 100), relationSize - 1000);
+
+    // the entry of 4999 now points to the tuple of 0
+    int key = 4999;
+    RecordId keyRid;
+    index.startScan(&key, GTE, &key, LTE);
+    index.scanNext(keyRid);
+    index.endScan();
+    index.updateEntry(&key, keyRid, zeroRid);
+    index.startScan(&key, GTE, &key, LTE);
+    index.scanNext(keyRid);
+    index.endScan();
+    bool moved = keyRid == zeroRid;
+    checkPassFail(moved, true);
+
+    bool freed = index.compact() > 0;
+    checkPassFail(freed, true);
+    checkPassFail(intScan(&index, 1000, GTE, 3000, LT), 2000);
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize - 1000);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test14() {
+  // Lookups of one key, with and without a Bloom filter
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test14" << std::endl;
+  createRelationRandom();
+  std::vector<RecordId> rids;
+  int key = 2500;
+  RecordId keyRid;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, true);
+    int found = index.lookup(&key, rids);
+    checkPassFail(found, 1);
+    keyRid = rids[0];
+
+    // entries with one key that go on over several leaves
+    for (int i = 0; i < 2 * INTARRAYLEAFSIZE; i++)
+      index.insertEntry(&key, keyRid);
+    found = index.lookup(&key, rids);
+    checkPassFail(found, 2 * INTARRAYLEAFSIZE + 1);
+    bool same = rids.back() == keyRid;
+    checkPassFail(same, true);
+  }
+  {
+    // the filter saved with the index rules out nearly every missing key
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, true);
+    int found = 0;
+    std::uint64_t accesses = bufMgr->getBufStats().accesses;
+    for (int missing = 5000; missing < 15000; missing++)
+      found += index.lookup(&missing, rids);
+    accesses = bufMgr->getBufStats().accesses - accesses;
+    checkPassFail(found, 0);
+    bool filtered = accesses < 1000;
+    checkPassFail(filtered, true);
+    found = index.lookup(&key, rids);
+    checkPassFail(found, 2 * INTARRAYLEAFSIZE + 1);
+  }
+  {
+    // without a filter, a missing key is looked for in the leaves
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    key = -1;
+    int found = index.lookup(&key, rids);
+    checkPassFail(found, 0);
+  }
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, true);
+    int found = index.lookup("00025 string record", rids);
+    checkPassFail(found, 1);
+    found = index.lookup("00025", rids);
+    checkPassFail(found, 0);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test15() {
+  // Bulk loads by several threads build the same index as one thread
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test15" << std::endl;
+  createRelationRandom();
+  std::ostringstream serial, parallel, spilled;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  }
+  serial << std::ifstream(intIndexName, std::ios::binary).rdbuf();
+  deleteFiles();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, false, 4);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize);
+  }
+  parallel << std::ifstream(intIndexName, std::ios::binary).rdbuf();
+  deleteFiles();
+  bool same = parallel.str() == serial.str();
+  checkPassFail(same, true);
+  {
+    // sorted parts that spilled runs are merged as the leaves are written
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULKLOAD_FILL_FACTOR, 1000 * sizeof(IntKeyRid),
+                     false, false, 3);
+  }
+  spilled << std::ifstream(intIndexName, std::ios::binary).rdbuf();
+  same = spilled.str() == serial.str();
+  checkPassFail(same, true);
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, false, 0);
+    checkPassFail(stringScan(&index, "00025", GT, "00040", LT), 15);
+    checkPassFail(stringScan(&index, "", GTE, "99999", LT), relationSize);
+  }
+  deleteFiles();
+  {
+    // the threads skip the free pages of the relation
+    File relation = File::open(relationName);
+    int removed = 0;
+    Page page = relation.readPage(2);
+    for (PageIterator it = page.begin(); it != page.end(); ++it) removed++;
+    relation.deletePage(2);
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, false, 4);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), relationSize - removed);
+  }
+  deleteFiles();
+  deleteRelation();
+}
+
+void test16() {
+  // Index-only scans return the keys of the entries, and INCLUDE columns
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test16" << std::endl;
+  createRelationRandom();
+  const int batch = 100;
+  int keys[batch];
+  RecordId rids[batch];
+  double includes[batch];
+  {
+    // the keys in order, each with the record id of its tuple
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(index.includeLength(), 0);
+    int low = 25, high = 4000, found = 0;
+    bool same = true;
+    BTreeScan scan = index.openScan(&low, GTE, &high, LT);
+    size_t n;
+    while ((n = scan.nextEntries(keys, rids, batch)) > 0) {
+      for (size_t k = 0; k < n; k++, found++) {
+        Page *page;
+        bufMgr->readPage(file1, rids[k].page_number, page);
+        RECORD record = *reinterpret_cast<const RECORD *>(
+            page->getRecord(rids[k]).data());
+        bufMgr->unPinPage(file1, rids[k].page_number, false);
+        same = same && keys[k] == low + found && record.i == keys[k];
+      }
+    }
+    checkPassFail(found, 3975);
+    checkPassFail(same, true);
+  }
+  deleteFiles();
+  {
+    // the d of every tuple kept with its key
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     true, false, 1, offsetof(tuple, d), sizeof(double));
+    checkPassFail(index.includeLength(), (int)sizeof(double));
+
+    // new entries bring theirs, and leaves split and merge with them
+    RecordId newRid = {1, 1};
+    for (int key = relationSize; key < relationSize + 2 * INTINCLUDELEAFSIZE;
+         key++) {
+      double d = key * 0.5;
+      index.insertEntry(&key, newRid, &d);
+    }
+    std::vector<RecordId> found;
+    for (int key = 0; key < 3000; key++) {
+      index.lookup(&key, found);
+      index.deleteEntry(&key, found[0]);
+    }
+    bool compacted = index.compact() > 0;
+    checkPassFail(compacted, true);
+
+    int low = 0, high = relationSize + 2 * INTINCLUDELEAFSIZE, count = 0;
+    bool same = true;
+    index.startScan(&low, GTE, &high, LT);
+    size_t n;
+    while ((n = index.scanNextEntries(keys, rids, batch, includes)) > 0) {
+      for (size_t k = 0; k < n; k++, count++) {
+        double d = keys[k] < relationSize ? keys[k] : keys[k] * 0.5;
+        same = same && keys[k] == 3000 + count && includes[k] == d;
+      }
+    }
+    index.endScan();
+    checkPassFail(count, relationSize - 3000 + 2 * INTINCLUDELEAFSIZE);
+    checkPassFail(same, true);
+  }
+  {
+    // the index file keeps its INCLUDE column
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(index.includeLength(), (int)sizeof(double));
+    int low = 4990, high = 5010;
+    index.startScan(&low, GTE, &high, LT);
+    size_t n = index.scanNextEntries(keys, rids, batch, includes);
+    index.endScan();
+    checkPassFail((int)n, 20);
+    bool same = includes[9] == 4999 && includes[10] == 2500;
+    checkPassFail(same, true);
+  }
+  deleteFiles();
+  {
+    // STRING keys, with the i of their tuples, built by two threads
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, false, 2, offsetof(tuple, i), sizeof(int));
+    StringKey strings[batch];
+    index.startScan("00025", GT, "00040", LT);
+    size_t n = index.scanNextEntries(strings, rids, batch, keys);
+    index.endScan();
+    checkPassFail((int)n, 15);
+    bool same = true;
+    for (size_t k = 0; k < n; k++) {
+      char expected[STRINGSIZE + 1];
+      snprintf(expected, sizeof(expected), "%05d string record", (int)(25 + k));
+      same = same && keys[k] == (int)(25 + k) &&
+             strncmp(strings[k].data, expected, STRINGSIZE) == 0;
+    }
+    checkPassFail(same, true);
+  }
+  {
+    // DOUBLE keys, with the start of s
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, false, 1, offsetof(tuple, s), INCLUDESIZE);
+    double low = 100, high = 110;
+    double doubles[batch];
+    char strings[batch][INCLUDESIZE];
+    BTreeScan scan = index.openScan(&low, GT, &high, LTE);
+    size_t n = scan.nextEntries(doubles, rids, batch, strings);
+    checkPassFail((int)n, 10);
+    bool same = doubles[0] == 101 &&
+                memcmp(strings[0], "00101 string rec", INCLUDESIZE) == 0;
+    checkPassFail(same, true);
+  }
+  deleteFiles();
+  bool thrown = false;
+  try {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE, BULKLOAD_FILL_FACTOR, BULKLOAD_SORT_MEMORY,
+                     false, false, 1, offsetof(tuple, s), INCLUDESIZE + 1);
+  } catch (BadIndexInfoException &e) {
+    thrown = true;
+  }
+  checkPassFail(thrown, true);
+  deleteRelation();
+}
+
+void test17() {
+  // Nodes evicted from a small pool are written back and read in again, with
+  // page headers that still name their pages
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test17" << std::endl;
+  createRelationRandom();
+  {
+    BufMgr small(10);
+    BTreeIndex index(relationName, intIndexName, &small, offsetof(tuple, i),
+                     INTEGER);
+    RecordId newRid = {1, 1};
+    for (int copy = 0; copy < 3; copy++)
+      for (int key = 0; key < relationSize; key++)
+        index.insertEntry(&key, newRid);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), 4 * relationSize);
+    bool evicted = small.getBufStats().dirtyEvictions > 0;
+    checkPassFail(evicted, true);
+  }
+  {
+    BufMgr small(10);
+    BTreeIndex index(relationName, intIndexName, &small, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 4 * 14);
+    checkPassFail(intScan(&index, 0, GTE, 5000, LT), 4 * relationSize);
+  }
+  {
+    File indexFile = File::open(intIndexName);
+    bool named = true;
+    for (PageId pageNo = 1; pageNo < indexFile.pageLimit(); pageNo++)
+      named = named && indexFile.readPage(pageNo).page_number() == pageNo;
+    checkPassFail(named, true);
+  }
+  deleteFiles();
+  deleteRelation();
+}
 
 void outOfBound() {
   std::cout << "Create a B+ Tree index on the integer field" << std::endl;
@@ -469,11 +1175,147 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 	return numResults;
 }
 
+int intScanBatch(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, size_t batchSize)
+{
+	std::vector<RecordId> batch(batchSize);
+	Page *curPage;
+	int numResults = 0;
+	int lastKey = lowVal;
+
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		return 0;
+	}
+
+	size_t found;
+	while((found = index->scanNextBatch(batch.data(), batchSize)) > 0)
+	{
+		// every key is in the range and no smaller than the one before
+		for(size_t i = 0; i < found; i++)
+		{
+			bufMgr->readPage(file1, batch[i].page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(batch[i]).data()));
+			bufMgr->unPinPage(file1, batch[i].page_number, false);
+			if(myRec.i < lastKey || myRec.i > highVal || (myRec.i == highVal && highOp == LT))
+				return -1;
+			lastKey = myRec.i;
+		}
+		numResults += found;
+		if(found < batchSize)
+			break;
+	}
+	checkPassFail(index->scanNextBatch(batch.data(), batchSize), 0);
+	index->endScan();
+
+	std::cout << "Batched scan of " << numResults << " results" << std::endl;
+	return numResults;
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
+	RecordId scanRid;
+	Page *curPage;
+	int numResults = 0;
+
+	std::cout << "Scan for " << (lowOp == GT ? "(" : "[") << lowVal << "," << highVal << (highOp == LT ? ")" : "]") << std::endl;
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while(1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+		}
+		catch(IndexScanCompletedException e)
+		{
+			break;
+		}
+		bufMgr->readPage(file1, scanRid.page_number, curPage);
+		RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+		bufMgr->unPinPage(file1, scanRid.page_number, false);
+		if(myRec.d < lowVal || myRec.d > highVal)
+			return -1;
+		numResults++;
+	}
+	index->endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
+int stringScan(BTreeIndex *index, const char *lowVal, Operator lowOp, const char *highVal, Operator highOp)
+{
+	RecordId scanRid;
+	Page *curPage;
+	int numResults = 0;
+	std::string lastKey = lowVal;
+
+	std::cout << "Scan for " << (lowOp == GT ? "(" : "[") << lowVal << "," << highVal << (highOp == LT ? ")" : "]") << std::endl;
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while(1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+		}
+		catch(IndexScanCompletedException e)
+		{
+			break;
+		}
+		// every key is in the range and no smaller than the one before
+		bufMgr->readPage(file1, scanRid.page_number, curPage);
+		RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+		bufMgr->unPinPage(file1, scanRid.page_number, false);
+		std::string key(myRec.s, strnlen(myRec.s, STRINGSIZE));
+		if(key < lastKey || key > highVal)
+			return -1;
+		lastKey = key;
+		numResults++;
+	}
+	index->endScan();
+
+	std::cout << "Number of results: " << numResults << std::endl;
+	return numResults;
+}
+
 void deleteFiles() {
   try {
     File::remove(intIndexName);
   } catch (FileNotFoundException e) {
   }
+  try {
+    File::remove(doubleIndexName);
+  } catch (FileNotFoundException e) {
+  }
+  try {
+    File::remove(stringIndexName);
+  } catch (FileNotFoundException e) {
+  }
+  // Bloom filters saved next to the indexes
+  std::remove((intIndexName + ".bloom").c_str());
+  std::remove((doubleIndexName + ".bloom").c_str());
+  std::remove((stringIndexName + ".bloom").c_str());
 }
 
 
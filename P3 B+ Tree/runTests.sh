@@ -0,0 +1,5 @@
+P2="../P2 Buffer Manager"
+g++ -std=c++14 -O2 -pthread -I. -I"$P2" main.cpp btree.cpp bloomFilter.cpp keySearch.cpp filescan.cpp \
+    exceptions/*.cpp "$P2"/buf*.cpp "$P2"/crc32c.cpp "$P2"/file.cpp "$P2"/ioEngine.cpp "$P2"/page.cpp \
+    "$P2"/pageCodec.cpp "$P2"/trace.cpp "$P2"/wal.cpp "$P2"/exceptions/*.cpp -o badgerdb_main
+./badgerdb_main